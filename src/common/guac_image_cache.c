@@ -0,0 +1,323 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+#include "guac_image_cache.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+guac_common_image_cache* guac_common_image_cache_alloc(guac_client* client,
+        size_t budget) {
+
+    guac_common_image_cache* cache = calloc(1,
+            sizeof(guac_common_image_cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->client = client;
+    cache->budget = budget;
+
+    return cache;
+
+}
+
+size_t guac_common_image_cache_parse_size(const char* value) {
+
+    char* end;
+    long size;
+
+    errno = 0;
+    size = strtol(value, &end, 10);
+
+    /* Disable cache for anything but a non-negative integer */
+    if (end == value || *end != '\0' || size <= 0)
+        return 0;
+
+    /* Limit excessive sizes, including those too large to parse */
+    if (errno == ERANGE || size > GUAC_COMMON_IMAGE_CACHE_MAX_SIZE)
+        size = GUAC_COMMON_IMAGE_CACHE_MAX_SIZE;
+
+    return (size_t) size * 1024;
+
+}
+
+/**
+ * Removes the given entry from the recently-used list of the given cache.
+ *
+ * @param cache The image cache containing the entry.
+ * @param entry The entry to remove.
+ */
+static void __guac_common_image_cache_unlink(guac_common_image_cache* cache,
+        guac_common_image_cache_entry* entry) {
+
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        cache->newest = entry->older;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        cache->oldest = entry->newer;
+
+}
+
+/**
+ * Adds the given entry to the recently-used list of the given cache as the
+ * most recently used entry.
+ *
+ * @param cache The image cache containing the entry.
+ * @param entry The entry to add.
+ */
+static void __guac_common_image_cache_link(guac_common_image_cache* cache,
+        guac_common_image_cache_entry* entry) {
+
+    entry->newer = NULL;
+    entry->older = cache->newest;
+
+    if (cache->newest != NULL)
+        cache->newest->newer = entry;
+    else
+        cache->oldest = entry;
+
+    cache->newest = entry;
+
+}
+
+/**
+ * Frees the given entry, returning its buffer to the client. The entry must
+ * already have been removed from the cache.
+ *
+ * @param cache The image cache which contained the entry.
+ * @param entry The entry to free.
+ */
+static void __guac_common_image_cache_free_entry(guac_common_image_cache* cache,
+        guac_common_image_cache_entry* entry) {
+
+    guac_client_free_buffer(cache->client, entry->buffer);
+    cairo_surface_destroy(entry->image);
+    free(entry);
+
+}
+
+/**
+ * Evicts the least recently used image from the given cache, disposing of
+ * the buffer containing that image.
+ *
+ * @param cache The image cache to evict an image from, which must not be
+ *              empty.
+ * @param socket The socket over which any instructions should be sent.
+ */
+static void __guac_common_image_cache_evict(guac_common_image_cache* cache,
+        guac_socket* socket) {
+
+    guac_common_image_cache_entry* entry = cache->oldest;
+    guac_common_image_cache_entry** current =
+        &cache->buckets[entry->hash % GUAC_COMMON_IMAGE_CACHE_BUCKETS];
+
+    /* Remove from bucket */
+    while (*current != entry)
+        current = &(*current)->next_in_bucket;
+    *current = entry->next_in_bucket;
+
+    __guac_common_image_cache_unlink(cache, entry);
+    cache->size -= entry->size;
+    cache->evictions++;
+
+    /* Release client-side memory */
+    guac_protocol_send_dispose(socket, entry->buffer);
+    __guac_common_image_cache_free_entry(cache, entry);
+
+}
+
+void guac_common_image_cache_free(guac_common_image_cache* cache) {
+
+    guac_common_image_cache_entry* current = cache->newest;
+
+    while (current != NULL) {
+        guac_common_image_cache_entry* older = current->older;
+        __guac_common_image_cache_free_entry(cache, current);
+        current = older;
+    }
+
+    free(cache);
+
+}
+
+int guac_common_image_cache_accepts(guac_common_image_cache* cache,
+        int width, int height) {
+
+    return width * height >= GUAC_COMMON_IMAGE_CACHE_MIN_AREA
+        && (size_t) width * height <= cache->budget / 4;
+
+}
+
+const guac_layer* guac_common_image_cache_lookup(guac_common_image_cache* cache,
+        cairo_surface_t* image, unsigned int hash) {
+
+    guac_common_image_cache_entry* current =
+        cache->buckets[hash % GUAC_COMMON_IMAGE_CACHE_BUCKETS];
+
+    for (; current != NULL; current = current->next_in_bucket) {
+
+        /* Images are only identical if their contents match */
+        if (current->hash != hash || guac_surface_cmp(current->image, image))
+            continue;
+
+        /* Image is now most recently used */
+        __guac_common_image_cache_unlink(cache, current);
+        __guac_common_image_cache_link(cache, current);
+
+        cache->hits++;
+        return current->buffer;
+
+    }
+
+    cache->misses++;
+    return NULL;
+
+}
+
+/**
+ * Returns whether every pixel of the given image is opaque.
+ *
+ * @param image The image to test.
+ * @return Non-zero if the image is opaque, zero otherwise.
+ */
+static int __guac_common_image_cache_is_opaque(cairo_surface_t* image) {
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int width = cairo_image_surface_get_width(image);
+    int height = cairo_image_surface_get_height(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    int x, y;
+
+    if (cairo_image_surface_get_format(image) == CAIRO_FORMAT_RGB24)
+        return 1;
+
+    for (y = 0; y < height; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        uint32_t alpha = 0xFF000000;
+
+        for (x = 0; x < width; x++)
+            alpha &= row[x];
+
+        if (alpha != 0xFF000000)
+            return 0;
+
+    }
+
+    return 1;
+
+}
+
+void guac_common_image_cache_store(guac_common_image_cache* cache,
+        guac_socket* socket, cairo_surface_t* image, unsigned int hash,
+        const guac_layer* layer, int x, int y) {
+
+    guac_common_image_cache_entry* entry;
+    guac_common_image_cache_entry** bucket;
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int width = cairo_image_surface_get_width(image);
+    int height = cairo_image_surface_get_height(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    unsigned char* copy_data;
+    int copy_stride;
+    int row;
+
+    if (!guac_common_image_cache_accepts(cache, width, height))
+        return;
+
+    /* Transparent regions would be drawn differently by a copy */
+    if (!__guac_common_image_cache_is_opaque(image))
+        return;
+
+    /* Make room for new image */
+    while (cache->size + (size_t) width * height * 4 > cache->budget)
+        __guac_common_image_cache_evict(cache, socket);
+
+    entry = malloc(sizeof(guac_common_image_cache_entry));
+    if (entry == NULL)
+        return;
+
+    entry->hash = hash;
+    entry->size = (size_t) width * height * 4;
+
+    /* Retain server-side copy for verifying future matches */
+    entry->image = cairo_image_surface_create(
+            cairo_image_surface_get_format(image), width, height);
+    copy_data = cairo_image_surface_get_data(entry->image);
+    copy_stride = cairo_image_surface_get_stride(entry->image);
+
+    for (row = 0; row < height; row++)
+        memcpy(copy_data + row * copy_stride, data + row * stride, width * 4);
+
+    cairo_surface_mark_dirty(entry->image);
+
+    /* Copy image into its own buffer on client side */
+    entry->buffer = guac_client_alloc_buffer(cache->client);
+    guac_protocol_send_copy(socket, layer, x, y, width, height,
+            GUAC_COMP_OVER, entry->buffer, 0, 0);
+
+    /* Add to cache as most recently used */
+    bucket = &cache->buckets[hash % GUAC_COMMON_IMAGE_CACHE_BUCKETS];
+    entry->next_in_bucket = *bucket;
+    *bucket = entry;
+
+    __guac_common_image_cache_link(cache, entry);
+    cache->size += entry->size;
+
+}
+
+
+void guac_common_image_cache_dup(guac_common_image_cache* cache,
+        guac_socket* socket) {
+
+    guac_common_image_cache_entry* entry;
+
+    for (entry = cache->newest; entry != NULL; entry = entry->older) {
+
+        int width = cairo_image_surface_get_width(entry->image);
+        int height = cairo_image_surface_get_height(entry->image);
+
+        /* Recreate buffer containing cached image */
+        guac_protocol_send_size(socket, entry->buffer, width, height);
+        guac_protocol_send_png(socket, GUAC_COMP_OVER, entry->buffer, 0, 0,
+                entry->image);
+
+    }
+
+}
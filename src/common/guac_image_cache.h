@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __GUAC_COMMON_IMAGE_CACHE_H
+#define __GUAC_COMMON_IMAGE_CACHE_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+#include <stddef.h>
+
+/**
+ * A per-connection cache of images recently sent to the client, each of
+ * which is retained within its own client-side offscreen buffer. Images
+ * which are sent again can then be drawn with a "copy" from the cached
+ * buffer, rather than being encoded and sent again, as is common for
+ * toolbar icons, window decorations and dialogs which are shown repeatedly.
+ * Images are identified by guac_hash_surface(), with any collisions resolved
+ * by guac_surface_cmp() against a server-side copy of each cached image.
+ *
+ * @file guac_image_cache.h
+ */
+
+/**
+ * The number of hash buckets within each image cache.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_BUCKETS 1024
+
+/**
+ * The minimum number of pixels an image must contain for it to be cached.
+ * Smaller images cost little to send, and not much more than the "copy"
+ * which would replace them.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_MIN_AREA 1024
+
+/**
+ * The largest amount of client-side memory which may be used by an image
+ * cache, in kilobytes.
+ */
+#define GUAC_COMMON_IMAGE_CACHE_MAX_SIZE (1024*1024)
+
+typedef struct guac_common_image_cache_entry guac_common_image_cache_entry;
+
+/**
+ * A single image within an image cache.
+ */
+struct guac_common_image_cache_entry {
+
+    /**
+     * The hash of the cached image, as returned by guac_hash_surface().
+     */
+    unsigned int hash;
+
+    /**
+     * A server-side copy of the cached image, used to verify that images
+     * having the same hash are actually identical.
+     */
+    cairo_surface_t* image;
+
+    /**
+     * The client-side buffer containing the cached image at its upper-left
+     * corner.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The number of bytes of client-side memory occupied by this image.
+     */
+    size_t size;
+
+    /**
+     * The next entry within the same hash bucket, or NULL if this is the
+     * last entry of its bucket.
+     */
+    guac_common_image_cache_entry* next_in_bucket;
+
+    /**
+     * The next more recently used entry, or NULL if this is the most
+     * recently used entry.
+     */
+    guac_common_image_cache_entry* newer;
+
+    /**
+     * The next less recently used entry, or NULL if this is the least
+     * recently used entry.
+     */
+    guac_common_image_cache_entry* older;
+
+};
+
+/**
+ * A cache of images which have been sent to the client, limited to a
+ * configurable amount of client-side memory. When full, the least recently
+ * used images are evicted to make room for new images.
+ */
+typedef struct guac_common_image_cache {
+
+    /**
+     * The client whose buffers hold the cached images.
+     */
+    guac_client* client;
+
+    /**
+     * The maximum number of bytes of client-side memory which may be
+     * occupied by cached images.
+     */
+    size_t budget;
+
+    /**
+     * The number of bytes of client-side memory currently occupied by cached
+     * images.
+     */
+    size_t size;
+
+    /**
+     * All cached images, grouped by hash.
+     */
+    guac_common_image_cache_entry* buckets[GUAC_COMMON_IMAGE_CACHE_BUCKETS];
+
+    /**
+     * The most recently used cached image, or NULL if the cache is empty.
+     */
+    guac_common_image_cache_entry* newest;
+
+    /**
+     * The least recently used cached image, or NULL if the cache is empty.
+     */
+    guac_common_image_cache_entry* oldest;
+
+    /**
+     * The number of lookups which found a cached image.
+     */
+    int hits;
+
+    /**
+     * The number of lookups which did not find a cached image.
+     */
+    int misses;
+
+    /**
+     * The number of images evicted to make room for other images.
+     */
+    int evictions;
+
+} guac_common_image_cache;
+
+/**
+ * Allocates a new, empty image cache whose images may occupy at most the
+ * given number of bytes of client-side memory.
+ *
+ * @param client The client whose buffers should hold the cached images.
+ * @param budget The maximum number of bytes of client-side memory which may
+ *               be occupied by cached images.
+ * @return A newly-allocated image cache, or NULL if the cache could not be
+ *         allocated.
+ */
+guac_common_image_cache* guac_common_image_cache_alloc(guac_client* client,
+        size_t budget);
+
+/**
+ * Parses the given image cache size, in kilobytes, as given in a connection
+ * argument, returning the corresponding number of bytes. Sizes which are
+ * not valid positive integers disable the cache, while sizes larger
+ * than GUAC_COMMON_IMAGE_CACHE_MAX_SIZE are reduced to that size.
+ *
+ * @param value The image cache size to parse, in kilobytes.
+ * @return The image cache size in bytes, or zero if images should not be
+ *         cached.
+ */
+size_t guac_common_image_cache_parse_size(const char* value);
+
+/**
+ * Frees the given image cache, returning all buffers it used to the client.
+ * No instructions are sent.
+ *
+ * @param cache The image cache to free.
+ */
+void guac_common_image_cache_free(guac_common_image_cache* cache);
+
+/**
+ * Returns whether the given cache would accept an image of the given
+ * dimensions.
+ *
+ * @param cache The image cache to query.
+ * @param width The width of the image, in pixels.
+ * @param height The height of the image, in pixels.
+ * @return Non-zero if an image of the given dimensions could be cached, zero
+ *         otherwise.
+ */
+int guac_common_image_cache_accepts(guac_common_image_cache* cache,
+        int width, int height);
+
+/**
+ * Searches the given cache for an image identical to the given image,
+ * marking that image as most recently used if found.
+ *
+ * @param cache The image cache to search.
+ * @param image The image to search for.
+ * @param hash The hash of the image to search for, as returned by
+ *             guac_hash_surface().
+ * @return The buffer containing the cached image at its upper-left corner,
+ *         or NULL if no identical image is cached.
+ */
+const guac_layer* guac_common_image_cache_lookup(guac_common_image_cache* cache,
+        cairo_surface_t* image, unsigned int hash);
+
+/**
+ * Adds the given image, which must already have been drawn to the given
+ * layer at the given coordinates, to the given cache. The image is copied
+ * into a newly-allocated buffer by the client, evicting the least recently
+ * used images as necessary. Images which are not opaque, or which the cache
+ * does not accept, are ignored.
+ *
+ * @param cache The image cache to add the image to.
+ * @param socket The socket over which any instructions should be sent.
+ * @param image The image to add.
+ * @param hash The hash of the image, as returned by guac_hash_surface().
+ * @param layer The layer which contains the image.
+ * @param x The X coordinate of the image within the layer.
+ * @param y The Y coordinate of the image within the layer.
+ */
+void guac_common_image_cache_store(guac_common_image_cache* cache,
+        guac_socket* socket, cairo_surface_t* image, unsigned int hash,
+        const guac_layer* layer, int x, int y);
+
+/**
+ * Sends every image within the given cache over the given socket, recreating
+ * the client-side buffers containing those images, such that a remote display
+ * which has not received any prior images can use the cache.
+ *
+ * @param cache The cache whose images should be sent.
+ * @param socket The socket to send the images over.
+ */
+void guac_common_image_cache_dup(guac_common_image_cache* cache,
+        guac_socket* socket);
+
+#endif
+
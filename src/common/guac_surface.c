@@ -21,16 +21,27 @@
  */
 
 #include "config.h"
+#include "guac_image_cache.h"
 #include "guac_rect.h"
 #include "guac_surface.h"
+#include "guac_surface_kernels.h"
 
 #include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/encoder-pool.h>
+#include <guacamole/error.h>
+#include <guacamole/hash.h>
 #include <guacamole/layer.h>
+#include <guacamole/pacing.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <time.h>
 
 /**
  * The width of an update which should be considered negible and thus
@@ -58,6 +69,14 @@
  */
 #define GUAC_SURFACE_BASE_COST 4096
 
+/**
+ * The largest factor by which GUAC_SURFACE_BASE_COST may be scaled up or
+ * down as the frame duration of the connection changes, such that updates
+ * are combined more readily on fast connections and less readily on slow
+ * connections.
+ */
+#define GUAC_SURFACE_COST_SCALE 4
+
 /**
  * An increase in cost is negligible if it is less than
  * 1/GUAC_SURFACE_NEGLIGIBLE_INCREASE of the old cost.
@@ -71,6 +90,95 @@
  */
 #define GUAC_SURFACE_FILL_PATTERN_FACTOR 3
 
+/**
+ * The maximum number of rectangles among which the cheapest combination is
+ * searched for exhaustively when planning a flush. Planning with more
+ * rectangles first combines each rectangle only with its neighbors.
+ */
+#define GUAC_SURFACE_PLAN_MAX_CANDIDATES 64
+
+/**
+ * The number of following rectangles, in plan order, considered neighbors of
+ * each rectangle when combining rectangles locally.
+ */
+#define GUAC_SURFACE_PLAN_WINDOW 16
+
+/**
+ * The maximum number of passes made combining rectangles locally before
+ * planning a flush continues with whatever rectangles remain.
+ */
+#define GUAC_SURFACE_PLAN_MAX_PASSES 8
+
+/**
+ * The minimum width and height of an update, in pixels, for which motion
+ * detection will be attempted.
+ */
+#define GUAC_SURFACE_MOTION_MIN_SIZE 64
+
+/**
+ * The minimum number of consecutive rows or columns which must have moved
+ * for the move to be sent as a "copy".
+ */
+#define GUAC_SURFACE_MOTION_MIN_LENGTH 16
+
+/**
+ * The maximum number of previous rows or columns which a changed row or
+ * column may match for those matches to be considered evidence of motion.
+ * Lines which match more often, such as blank lines, could have come from
+ * anywhere.
+ */
+#define GUAC_SURFACE_MOTION_MAX_MATCHES 4
+
+/**
+ * The minimum number of pixels an update must contain before lossy
+ * compression will be considered for that update.
+ */
+#define GUAC_SURFACE_LOSSY_MIN_AREA (64*64)
+
+/**
+ * The number of pixels above which an update is large enough to be sent with
+ * lossy compression if photographic, regardless of how frequently it changes.
+ */
+#define GUAC_SURFACE_LOSSY_LARGE_AREA (256*256)
+
+/**
+ * The minimum average rate at which the region covered by an update must be
+ * changing, in updates per second, for the update to be considered part of
+ * video or animation, and thus a candidate for lossy compression.
+ */
+#define GUAC_SURFACE_LOSSY_FRAMERATE 3
+
+/**
+ * The number of points to sample along each axis of an update when estimating
+ * the number of distinct colors it contains.
+ */
+#define GUAC_SURFACE_COLOR_SAMPLES 16
+
+/**
+ * The number of distinct colors among the sampled points of an update at or
+ * above which that update is considered photographic.
+ */
+#define GUAC_SURFACE_PHOTO_COLORS 48
+
+/**
+ * The number of consecutive flushes of the same rectangle which may reuse a
+ * remembered color census before the colors are counted again.
+ */
+#define GUAC_SURFACE_PALETTE_MAX_REUSES 8
+
+/**
+ * The number of pixels at or above which a lossless update is streamed to the
+ * client as it is encoded, rather than encoded in its entirety beforehand,
+ * if the client supports the img instruction.
+ */
+#define GUAC_SURFACE_STREAM_MIN_AREA (256*256)
+
+/**
+ * The maximum number of bytes to send in an individual blob when streaming
+ * image data to the client.
+ */
+#define GUAC_SURFACE_BLOB_SIZE 4096
+
 /* Define cairo_format_stride_for_width() if missing */
 #ifndef HAVE_CAIRO_FORMAT_STRIDE_FOR_WIDTH
 #define cairo_format_stride_for_width(format, width) (width*4)
@@ -134,9 +242,205 @@ static void __guac_common_clip_rect(guac_common_surface* surface,
 
 }
 
+/**
+ * Returns the estimated cost of sending the given rectangle of the given
+ * surface as an image.
+ *
+ * @param surface The surface containing the rectangle.
+ * @param rect The rectangle to estimate the cost of.
+ * @return The estimated cost of sending the given rectangle as an image.
+ */
+static int __guac_common_surface_cost(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+    return surface->update_cost + rect->width * rect->height;
+}
+
+/**
+ * Returns the base cost of each update of the given surface, scaled by how
+ * the current frame duration of the connection compares to the default. On
+ * fast connections, which are limited by the number of updates rather than
+ * their size, updates are costlier and thus combined more readily. On slow
+ * connections, which are limited by the number of pixels sent, updates are
+ * cheaper and thus combined less readily.
+ *
+ * Surfaces which are not associated with any client use the default frame
+ * duration.
+ *
+ * @param surface The surface whose update cost should be determined.
+ * @return The base cost of each update of the given surface.
+ */
+static int __guac_common_surface_update_cost(guac_common_surface* surface) {
+
+    int duration = GUAC_PACING_DEFAULT_FRAME_DURATION;
+    int cost;
+
+    if (surface->client != NULL)
+        duration = guac_pacing_get_frame_duration(surface->client->pacing);
+
+    cost = GUAC_SURFACE_BASE_COST * GUAC_PACING_DEFAULT_FRAME_DURATION
+        / duration;
+
+    if (cost < GUAC_SURFACE_BASE_COST / GUAC_SURFACE_COST_SCALE)
+        return GUAC_SURFACE_BASE_COST / GUAC_SURFACE_COST_SCALE;
+
+    if (cost > GUAC_SURFACE_BASE_COST * GUAC_SURFACE_COST_SCALE)
+        return GUAC_SURFACE_BASE_COST * GUAC_SURFACE_COST_SCALE;
+
+    return cost;
+
+}
+
+/**
+ * Returns whether the bit corresponding to the tile at the given index is set
+ * within the damage bitmap of the given surface.
+ *
+ * @param surface The surface whose damage bitmap should be checked.
+ * @param index The index of the tile, in row-major order.
+ * @return Non-zero if the tile is damaged, zero otherwise.
+ */
+static int __guac_common_surface_is_damaged(guac_common_surface* surface,
+        int index) {
+    return (surface->damage[index / 64] >> (index % 64)) & 1;
+}
+
+/**
+ * Calculates the region of the given surface covered by the tile at the
+ * given column and row of the damage map, excluding any portion of the tile
+ * which lies beyond the bounds of the surface.
+ *
+ * @param surface The surface containing the tile.
+ * @param column The column of the tile.
+ * @param row The row of the tile.
+ * @param bounds The rectangle to populate with the region covered.
+ */
+static void __guac_common_surface_tile_bounds(guac_common_surface* surface,
+        int column, int row, guac_common_rect* bounds) {
+
+    int x = column * GUAC_COMMON_SURFACE_TILE_SIZE;
+    int y = row    * GUAC_COMMON_SURFACE_TILE_SIZE;
+
+    int width  = surface->width  - x;
+    int height = surface->height - y;
+
+    if (width  > GUAC_COMMON_SURFACE_TILE_SIZE) width  = GUAC_COMMON_SURFACE_TILE_SIZE;
+    if (height > GUAC_COMMON_SURFACE_TILE_SIZE) height = GUAC_COMMON_SURFACE_TILE_SIZE;
+
+    guac_common_rect_init(bounds, x, y, width, height);
+
+}
+
+/**
+ * Calculates the range of columns and rows of tiles covered by the given
+ * rectangle, which must lie within the bounds of the given surface.
+ *
+ * @param rect The rectangle whose tiles should be determined.
+ * @param min_column Pointer to an int which will receive the first column.
+ * @param min_row Pointer to an int which will receive the first row.
+ * @param max_column Pointer to an int which will receive the last column.
+ * @param max_row Pointer to an int which will receive the last row.
+ */
+static void __guac_common_surface_tile_range(const guac_common_rect* rect,
+        int* min_column, int* min_row, int* max_column, int* max_row) {
+
+    *min_column = rect->x / GUAC_COMMON_SURFACE_TILE_SIZE;
+    *min_row    = rect->y / GUAC_COMMON_SURFACE_TILE_SIZE;
+    *max_column = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_TILE_SIZE;
+    *max_row    = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_TILE_SIZE;
+
+}
+
+/**
+ * Allocates a damage map covering the entire given surface, with all tiles
+ * undamaged and no tile contents known to be present on the remote display.
+ * If the damage map cannot be allocated, the surface is left without one,
+ * tracking damage only by its bounds.
+ *
+ * @param surface The surface to allocate a damage map for.
+ */
+static void __guac_common_surface_alloc_tiles(guac_common_surface* surface) {
+
+    int count;
+
+    surface->tile_columns = (surface->width  + GUAC_COMMON_SURFACE_TILE_SIZE - 1) / GUAC_COMMON_SURFACE_TILE_SIZE;
+    surface->tile_rows    = (surface->height + GUAC_COMMON_SURFACE_TILE_SIZE - 1) / GUAC_COMMON_SURFACE_TILE_SIZE;
+
+    count = surface->tile_columns * surface->tile_rows;
+    surface->tiles = calloc(count, sizeof(guac_common_surface_tile));
+    surface->damage = calloc(count / 64 + 1, sizeof(uint64_t));
+    surface->dirty = 0;
+
+    /* Track damage by bounds alone if the map cannot be allocated */
+    if (surface->tiles == NULL || surface->damage == NULL) {
+        free(surface->tiles);
+        free(surface->damage);
+        surface->tiles = NULL;
+        surface->damage = NULL;
+        surface->tile_columns = 0;
+        surface->tile_rows = 0;
+    }
+
+}
+
+/**
+ * Returns the region of existing damage within the tiles covered by the given
+ * rectangle, such as would be sent together with an update to that
+ * rectangle.
+ *
+ * @param surface The surface to be queried.
+ * @param rect The rectangle whose tiles should be inspected.
+ * @param damage The rectangle to populate with the bounds of the damage
+ *               found, if any.
+ * @return Non-zero if any of the tiles covered by the given rectangle are
+ *         damaged, zero otherwise.
+ */
+static int __guac_common_surface_local_damage(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_common_rect* damage) {
+
+    int min_column, min_row, max_column, max_row;
+    int column, row;
+    int found = 0;
+
+    guac_common_rect bounded = *rect;
+    __guac_common_bound_rect(surface, &bounded, NULL, NULL);
+
+    if (!surface->dirty || bounded.width <= 0 || bounded.height <= 0)
+        return 0;
+
+    /* Without a damage map, all damage is one region */
+    if (surface->tiles == NULL) {
+        *damage = surface->dirty_rect;
+        return 1;
+    }
+
+    __guac_common_surface_tile_range(&bounded, &min_column, &min_row,
+            &max_column, &max_row);
+
+    for (row = min_row; row <= max_row; row++) {
+        for (column = min_column; column <= max_column; column++) {
+
+            int index = row * surface->tile_columns + column;
+            if (!__guac_common_surface_is_damaged(surface, index))
+                continue;
+
+            if (found)
+                guac_common_rect_extend(damage,
+                        &surface->tiles[index].dirty_rect);
+            else
+                *damage = surface->tiles[index].dirty_rect;
+
+            found = 1;
+
+        }
+    }
+
+    return found;
+
+}
+
 /**
  * Returns whether the given rectangle should be combined into the existing
- * dirty rectangle, to be eventually flushed as a "png" instruction.
+ * damage, to be eventually flushed as a "png" instruction, rather than
+ * sent as its own instruction.
  *
  * @param surface The surface to be queried.
  * @param rect The update rectangle.
@@ -148,12 +452,14 @@ static void __guac_common_clip_rect(guac_common_surface* surface,
  */
 static int __guac_common_should_combine(guac_common_surface* surface, const guac_common_rect* rect, int rect_only) {
 
-    if (surface->dirty) {
+    guac_common_rect dirty_rect;
+
+    if (__guac_common_surface_local_damage(surface, rect, &dirty_rect)) {
 
         int combined_cost, dirty_cost, update_cost;
 
         /* Simulate combination */
-        guac_common_rect combined = surface->dirty_rect;
+        guac_common_rect combined = dirty_rect;
         guac_common_rect_extend(&combined, rect);
 
         /* Combine if result is still small */
@@ -161,9 +467,9 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
             return 1;
 
         /* Estimate costs of the existing update, new update, and both combined */
-        combined_cost = GUAC_SURFACE_BASE_COST + combined.width * combined.height;
-        dirty_cost    = GUAC_SURFACE_BASE_COST + surface->dirty_rect.width * surface->dirty_rect.height;
-        update_cost   = GUAC_SURFACE_BASE_COST + rect->width * rect->height;
+        combined_cost = __guac_common_surface_cost(surface, &combined);
+        dirty_cost    = __guac_common_surface_cost(surface, &dirty_rect);
+        update_cost   = __guac_common_surface_cost(surface, rect);
 
         /* Reduce cost if no image data */
         if (rect_only)
@@ -181,7 +487,7 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
             return 1;
 
         /* Combine if we anticipate further updates, as this update follows a common fill pattern */
-        if (rect->x == surface->dirty_rect.x && rect->y == surface->dirty_rect.y + surface->dirty_rect.height) {
+        if (rect->x == dirty_rect.x && rect->y == dirty_rect.y + dirty_rect.height) {
             if (combined_cost <= (dirty_cost + update_cost) * GUAC_SURFACE_FILL_PATTERN_FACTOR)
                 return 1;
         }
@@ -194,152 +500,191 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
 }
 
 /**
- * Expands the dirty rect of the given surface to contain the rect described by the given
- * coordinates.
+ * Marks the tiles covered by the given rectangle as damaged, extending the
+ * damaged region of each tile to include the rectangle.
  *
  * @param surface The surface to mark as dirty.
  * @param rect The rectangle of the update which is dirtying the surface.
  */
 static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_common_rect* rect) {
 
+    int min_column, min_row, max_column, max_row;
+    int column, row;
+
+    /* Only damage within the bounds of the surface can be tracked */
+    guac_common_rect bounded = *rect;
+    __guac_common_bound_rect(surface, &bounded, NULL, NULL);
+
     /* Ignore empty rects */
-    if (rect->width <= 0 || rect->height <= 0)
+    if (bounded.width <= 0 || bounded.height <= 0)
         return;
 
-    /* If already dirty, update existing rect */
+    /* Track bounds of all damage */
     if (surface->dirty)
-        guac_common_rect_extend(&surface->dirty_rect, rect);
-
-    /* Otherwise init dirty rect */
-    else {
-        surface->dirty_rect = *rect;
-        surface->dirty = 1;
-    }
-
-}
-
-/**
- * Flushes the PNG update currently described by the dirty rectangle within the
- * given surface to that surface's PNG queue. There MUST be space within the
- * queue.
- *
- * @param surface The surface to flush.
- */
-static void __guac_common_surface_flush_to_queue(guac_common_surface* surface) {
+        guac_common_rect_extend(&surface->dirty_rect, &bounded);
+    else
+        surface->dirty_rect = bounded;
 
-    guac_common_surface_png_rect* rect;
+    surface->dirty = 1;
 
-    /* Do not flush if not dirty */
-    if (!surface->dirty)
+    /* Damage of individual tiles is tracked only if possible */
+    if (surface->tiles == NULL)
         return;
 
-    /* Add new rect to queue */
-    rect = &(surface->png_queue[surface->png_queue_length++]);
-    rect->rect = surface->dirty_rect;
-    rect->flushed = 0;
+    __guac_common_surface_tile_range(&bounded, &min_column, &min_row,
+            &max_column, &max_row);
 
-    /* Surface now flushed */
-    surface->dirty = 0;
+    for (row = min_row; row <= max_row; row++) {
+        for (column = min_column; column <= max_column; column++) {
 
-}
+            int index = row * surface->tile_columns + column;
+            guac_common_surface_tile* tile = &surface->tiles[index];
 
-void guac_common_surface_flush_deferred(guac_common_surface* surface) {
+            /* Restrict update to bounds of tile */
+            guac_common_rect damage = bounded;
+            guac_common_rect bounds;
+            __guac_common_surface_tile_bounds(surface, column, row, &bounds);
+            guac_common_rect_constrain(&damage, &bounds);
 
-    /* Do not flush if not dirty */
-    if (!surface->dirty)
-        return;
+            /* If already damaged, update existing rect */
+            if (__guac_common_surface_is_damaged(surface, index))
+                guac_common_rect_extend(&tile->dirty_rect, &damage);
 
-    /* Flush if queue size has reached maximum (space is reserved for the final dirty rect,
-     * as guac_common_surface_flush() MAY add an additional rect to the queue */
-    if (surface->png_queue_length == GUAC_COMMON_SURFACE_QUEUE_SIZE-1)
-        guac_common_surface_flush(surface);
+            /* Otherwise init damaged rect */
+            else {
+                tile->dirty_rect = damage;
+                surface->damage[index / 64] |= (uint64_t) 1 << (index % 64);
+            }
 
-    /* Append dirty rect to queue */
-    __guac_common_surface_flush_to_queue(surface);
+        }
+    }
 
 }
 
 /**
- * Transfers a single uint32_t using the given transfer function.
+ * Records that the given rectangle of the remote display has been updated
+ * by an instruction other than an image (such as "copy" or "rect"), such that
+ * the contents of the tiles covered are no longer known.
  *
- * @param op The transfer function to use.
- * @param src The source of the uint32_t value.
- * @param dst THe destination which will hold the result of the transfer.
- * @return Non-zero if the destination value was changed, zero otherwise.
+ * @param surface The surface whose remote display was updated.
+ * @param rect The rectangle which was updated.
  */
-static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_t* src, uint32_t* dst) {
+static void __guac_common_surface_invalidate_tiles(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-    uint32_t orig = *dst;
+    int min_column, min_row, max_column, max_row;
+    int column, row;
 
-    switch (op) {
+    guac_common_rect bounded = *rect;
+    __guac_common_bound_rect(surface, &bounded, NULL, NULL);
 
-        case GUAC_TRANSFER_BINARY_BLACK:
-            *dst = 0xFF000000;
-            break;
+    /* Ignore empty rects, or if no tile contents are known */
+    if (bounded.width <= 0 || bounded.height <= 0 || surface->tiles == NULL)
+        return;
 
-        case GUAC_TRANSFER_BINARY_WHITE:
-            *dst = 0xFFFFFFFF;
-            break;
+    __guac_common_surface_tile_range(&bounded, &min_column, &min_row,
+            &max_column, &max_row);
 
-        case GUAC_TRANSFER_BINARY_SRC:
-            *dst = *src;
-            break;
+    for (row = min_row; row <= max_row; row++)
+        for (column = min_column; column <= max_column; column++)
+            surface->tiles[row * surface->tile_columns + column].hash_valid = 0;
 
-        case GUAC_TRANSFER_BINARY_DEST:
-            /* NOP */
-            break;
+}
 
-        case GUAC_TRANSFER_BINARY_NSRC:
-            *dst = ~(*src);
-            break;
+/**
+ * Records that the given rectangle of the remote display now contains the
+ * current contents of that rectangle of the given surface, updating the
+ * copy of the remote display used for motion detection, if any.
+ *
+ * @param surface The surface whose remote display was updated.
+ * @param rect The rectangle which was updated.
+ */
+static void __guac_common_surface_sync_shadow(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-        case GUAC_TRANSFER_BINARY_NDEST:
-            *dst = ~(*dst);
-            break;
+    int y;
 
-        case GUAC_TRANSFER_BINARY_AND:
-            *dst = (*dst) & (*src);
-            break;
+    if (surface->shadow == NULL)
+        return;
 
-        case GUAC_TRANSFER_BINARY_NAND:
-            *dst = ~((*dst) & (*src));
-            break;
+    for (y = rect->y; y < rect->y + rect->height; y++) {
+        int offset = y * surface->stride + rect->x * 4;
+        memcpy(surface->shadow + offset, surface->buffer + offset,
+                rect->width * 4);
+    }
 
-        case GUAC_TRANSFER_BINARY_OR:
-            *dst = (*dst) | (*src);
-            break;
+}
 
-        case GUAC_TRANSFER_BINARY_NOR:
-            *dst = ~((*dst) | (*src));
-            break;
+/**
+ * Records that the given rectangle of the remote display contains only an
+ * approximation of the contents of that rectangle of the given surface, such
+ * that the copy of the remote display used for motion detection, if any,
+ * must not be trusted within that rectangle. The rectangle is cleared to
+ * transparent pixels, which never match moved content.
+ *
+ * @param surface The surface whose remote display was updated.
+ * @param rect The rectangle which was updated.
+ */
+static void __guac_common_surface_forget_shadow(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-        case GUAC_TRANSFER_BINARY_XOR:
-            *dst = (*dst) ^ (*src);
-            break;
+    int y;
 
-        case GUAC_TRANSFER_BINARY_XNOR:
-            *dst = ~((*dst) ^ (*src));
-            break;
+    if (surface->shadow == NULL)
+        return;
 
-        case GUAC_TRANSFER_BINARY_NSRC_AND:
-            *dst = (*dst) & ~(*src);
-            break;
+    for (y = rect->y; y < rect->y + rect->height; y++)
+        memset(surface->shadow + y * surface->stride + rect->x * 4, 0,
+                rect->width * 4);
 
-        case GUAC_TRANSFER_BINARY_NSRC_NAND:
-            *dst = ~((*dst) & ~(*src));
-            break;
+}
 
-        case GUAC_TRANSFER_BINARY_NSRC_OR:
-            *dst = (*dst) | ~(*src);
-            break;
+/**
+ * Adds the changed columns of a single row to the bounds of the changed
+ * region of a rectangle.
+ *
+ * @param y The row, relative to the rectangle.
+ * @param first The first changed column of the row.
+ * @param last The last changed column of the row.
+ * @param min_x Pointer to the leftmost changed column so far.
+ * @param min_y Pointer to the topmost changed row so far.
+ * @param max_x Pointer to the rightmost changed column so far.
+ * @param max_y Pointer to the bottommost changed row so far.
+ */
+static void __guac_common_surface_track_row(int y, int first, int last,
+        int* min_x, int* min_y, int* max_x, int* max_y) {
 
-        case GUAC_TRANSFER_BINARY_NSRC_NOR:
-            *dst = ~((*dst) | ~(*src));
-            break;
+    if (first < *min_x) *min_x = first;
+    if (y     < *min_y) *min_y = y;
+    if (last  > *max_x) *max_x = last;
+    if (y     > *max_y) *max_y = y;
 
-    }
+}
 
-    return *dst != orig;
+/**
+ * Restricts the given rectangle to the given bounds of its changed region,
+ * which are relative to the rectangle. If the bounds are empty (no pixels
+ * changed), the rectangle is given zero dimensions.
+ *
+ * @param rect The rectangle to restrict.
+ * @param min_x The leftmost changed column.
+ * @param min_y The topmost changed row.
+ * @param max_x The rightmost changed column.
+ * @param max_y The bottommost changed row.
+ */
+static void __guac_common_surface_restrict_rect(guac_common_rect* rect,
+        int min_x, int min_y, int max_x, int max_y) {
+
+    if (max_x >= min_x && max_y >= min_y) {
+        rect->x += min_x;
+        rect->y += min_y;
+        rect->width = max_x - min_x + 1;
+        rect->height = max_y - min_y + 1;
+    }
+    else {
+        rect->width = 0;
+        rect->height = 0;
+    }
 
 }
 
@@ -356,7 +701,9 @@ static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_
 static void __guac_common_surface_rect(guac_common_surface* dst, guac_common_rect* rect,
                                        int red, int green, int blue) {
 
-    int x, y;
+    const guac_common_surface_kernels* kernels = guac_common_surface_get_kernels();
+
+    int y;
 
     int dst_stride;
     unsigned char* dst_buffer;
@@ -374,23 +721,13 @@ static void __guac_common_surface_rect(guac_common_surface* dst, guac_common_rec
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+        int first, last;
 
         /* Set row */
-        for (x=0; x < rect->width; x++) {
-
-            uint32_t old_color = *dst_current;
-
-            if (old_color != color) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-                *dst_current = color;
-            }
-
-            dst_current++;
-        }
+        if (kernels->fill((uint32_t*) dst_buffer, rect->width, color,
+                    &first, &last))
+            __guac_common_surface_track_row(y, first, last,
+                    &min_x, &min_y, &max_x, &max_y);
 
         /* Next row */
         dst_buffer += dst_stride;
@@ -398,16 +735,7 @@ static void __guac_common_surface_rect(guac_common_surface* dst, guac_common_rec
     }
 
     /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
 
 }
 
@@ -430,10 +758,12 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
                                       guac_common_surface* dst, guac_common_rect* rect,
                                       int opaque) {
 
+    const guac_common_surface_kernels* kernels = guac_common_surface_get_kernels();
+
     unsigned char* dst_buffer = dst->buffer;
     int dst_stride = dst->stride;
 
-    int x, y;
+    int y;
 
     int min_x = rect->width - 1;
     int min_y = rect->height - 1;
@@ -449,29 +779,23 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
+        const uint32_t* src_current = (const uint32_t*) src_buffer;
         uint32_t* dst_current = (uint32_t*) dst_buffer;
 
-        /* Copy row */
-        for (x=0; x < rect->width; x++) {
-
-            if (opaque || (*src_current & 0xFF000000)) {
-
-                uint32_t new_color = *src_current | 0xFF000000;
-                uint32_t old_color = *dst_current;
+        int changed;
+        int first, last;
 
-                if (old_color != new_color) {
-                    if (x < min_x) min_x = x;
-                    if (y < min_y) min_y = y;
-                    if (x > max_x) max_x = x;
-                    if (y > max_y) max_y = y;
-                    *dst_current = new_color;
-                }
-            }
+        /* Copy row, skipping fully-transparent pixels unless opaque */
+        if (opaque)
+            changed = kernels->put(src_current, dst_current, rect->width,
+                    0xFF000000, &first, &last);
+        else
+            changed = kernels->mask(src_current, dst_current, rect->width,
+                    0xFFFFFFFF, 0xFF000000, &first, &last);
 
-            src_current++;
-            dst_current++;
-        }
+        if (changed)
+            __guac_common_surface_track_row(y, first, last,
+                    &min_x, &min_y, &max_x, &max_y);
 
         /* Next row */
         src_buffer += src_stride;
@@ -480,16 +804,7 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
     }
 
     /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
 
     /* Update source X/Y */
     *sx += rect->x - orig_x;
@@ -500,7 +815,8 @@ static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
 /**
  * Fills the given surface with color, using the given buffer as a mask. Color
  * will be added to the given surface iff the corresponding pixel within the
- * buffer is opaque.
+ * buffer is opaque. The dimensions and location of the destination rectangle
+ * will be altered to remove as many unchanged pixels as possible.
  *
  * @param src_buffer The buffer to use as a mask.
  * @param src_stride The number of bytes in each row of the source buffer.
@@ -517,11 +833,18 @@ static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_s
                                             guac_common_surface* dst, guac_common_rect* rect,
                                             int red, int green, int blue) {
 
+    const guac_common_surface_kernels* kernels = guac_common_surface_get_kernels();
+
     unsigned char* dst_buffer = dst->buffer;
     int dst_stride = dst->stride;
 
     uint32_t color = 0xFF000000 | (red << 16) | (green << 8) | blue;
-    int x, y;
+    int y;
+
+    int min_x = rect->width - 1;
+    int min_y = rect->height - 1;
+    int max_x = 0;
+    int max_y = 0;
 
     src_buffer += src_stride*sy + 4*sx;
     dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
@@ -529,19 +852,13 @@ static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_s
     /* For each row */
     for (y=0; y < rect->height; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
-
-        /* Stencil row */
-        for (x=0; x < rect->width; x++) {
+        int first, last;
 
-            /* Fill with color if opaque */
-            if (*src_current & 0xFF000000)
-                *dst_current = color;
-
-            src_current++;
-            dst_current++;
-        }
+        /* Stencil row, filling with color wherever the mask is opaque */
+        if (kernels->mask((const uint32_t*) src_buffer, (uint32_t*) dst_buffer,
+                    rect->width, 0x00000000, color, &first, &last))
+            __guac_common_surface_track_row(y, first, last,
+                    &min_x, &min_y, &max_x, &max_y);
 
         /* Next row */
         src_buffer += src_stride;
@@ -549,30 +866,116 @@ static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_s
 
     }
 
+    /* Restrict destination rect to only updated pixels */
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
+
 }
 
 /**
- * Copies data from the given surface to the given destination surface using
- * the specified transfer function.
+ * Returns whether the result of the given transfer function depends on the
+ * source pixels.
  *
- * @param src_buffer The buffer to copy.
- * @param src_stride The number of bytes in each row of the source buffer.
- * @param sx The X coordinate of the source rectangle.
- * @param sy The Y coordinate of the source rectangle.
- * @param op The transfer function to use.
- * @param dst The destination surface.
- * @param rect The destination rectangle.
+ * @param op The transfer function to test.
+ * @return Non-zero if the given transfer function reads the source, zero
+ *         otherwise.
  */
-static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, int* sy,
+static int __guac_common_surface_transfer_reads_source(guac_transfer_function op) {
+
+    switch (op) {
+
+        case GUAC_TRANSFER_BINARY_BLACK:
+        case GUAC_TRANSFER_BINARY_WHITE:
+        case GUAC_TRANSFER_BINARY_DEST:
+        case GUAC_TRANSFER_BINARY_NDEST:
+            return 0;
+
+        default:
+            return 1;
+
+    }
+
+}
+
+/**
+ * Transfers a row of pixels whose destination begins the given distance to
+ * the right of its source within the same row, without requiring a copy of
+ * the source. The row is transferred right-to-left in pieces no wider than
+ * that distance, such that no piece overwrites source pixels which have not
+ * yet been read.
+ *
+ * @param kernel The kernel of the transfer function to use.
+ * @param src The row of source pixels.
+ * @param dst The row of destination pixels.
+ * @param width The number of pixels in the row.
+ * @param distance The number of pixels between the start of the source and
+ *                 the start of the destination, which must be positive.
+ * @param first Pointer to an int which will receive the column of the first
+ *              changed pixel, if any pixels changed.
+ * @param last Pointer to an int which will receive the column of the last
+ *             changed pixel, if any pixels changed.
+ * @return Non-zero if any pixel of the destination row changed, zero
+ *         otherwise.
+ */
+static int __guac_common_surface_transfer_row_backward(
+        guac_common_surface_transfer_kernel* kernel, const uint32_t* src,
+        uint32_t* dst, int width, int distance, int* first, int* last) {
+
+    int changed = 0;
+    int end = width;
+
+    while (end > 0) {
+
+        int piece_first, piece_last;
+        int start = end - distance;
+        if (start < 0)
+            start = 0;
+
+        /* Pieces are transferred right-to-left, thus the last changed column
+         * is found first */
+        if (kernel(src + start, dst + start, end - start,
+                    &piece_first, &piece_last)) {
+            if (!changed)
+                *last = start + piece_last;
+            *first = start + piece_first;
+            changed = 1;
+        }
+
+        end = start;
+
+    }
+
+    return changed;
+
+}
+
+/**
+ * Copies data from the given surface to the given destination surface using
+ * the specified transfer function.
+ *
+ * @param src_buffer The buffer to copy.
+ * @param src_stride The number of bytes in each row of the source buffer.
+ * @param sx The X coordinate of the source rectangle.
+ * @param sy The Y coordinate of the source rectangle.
+ * @param op The transfer function to use.
+ * @param dst The destination surface.
+ * @param rect The destination rectangle.
+ */
+static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, int* sy,
                                            guac_transfer_function op,
                                            guac_common_surface* dst, guac_common_rect* rect) {
 
+    guac_common_surface_transfer_kernel* kernel =
+        guac_common_surface_get_kernels()->transfer[op];
+
     unsigned char* src_buffer = src->buffer;
     unsigned char* dst_buffer = dst->buffer;
 
-    int x, y;
-    int src_stride, dst_stride;
-    int step = 1;
+    int src_stride = src->stride;
+    int dst_stride = dst->stride;
+
+    uint32_t* scratch = NULL;
+    int distance = 0;
+    int i, y;
 
     int min_x = rect->width - 1;
     int min_y = rect->height - 1;
@@ -582,75 +985,72 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
     int orig_x = rect->x;
     int orig_y = rect->y;
 
-    /* Copy forwards only if destination is in a different surface or is before source */
-    if (src != dst || rect->y < *sy || (rect->y == *sy && rect->x < *sx)) {
-        src_buffer += src->stride * (*sy) + 4 * (*sx);
-        dst_buffer += (dst->stride * rect->y) + (4 * rect->x);
-        src_stride = src->stride;
-        dst_stride = dst->stride;
-        step = 1;
+    int backward_rows;
+
+    /* DEST leaves the destination untouched */
+    if (kernel == NULL) {
+        rect->width = 0;
+        rect->height = 0;
+        return;
     }
 
-    /* Otherwise, copy backwards */
-    else {
-        src_buffer += src->stride * (*sy + rect->height - 1) + 4 * (*sx + rect->width - 1);
-        dst_buffer += dst->stride * (rect->y + rect->height - 1) + 4 * (rect->x + rect->width - 1);
-        src_stride = -src->stride;
-        dst_stride = -dst->stride;
-        step = -1;
+    /* Rows must be transferred bottom-up if the destination is below the
+     * source within the same surface, as the source would otherwise be
+     * overwritten before it is read */
+    backward_rows = (src == dst && rect->y > *sy);
+
+    /* Kernels transfer left-to-right, so rows which overlap their source with
+     * the destination to the right must first be copied aside */
+    if (src == dst && rect->y == *sy && rect->x > *sx
+            && __guac_common_surface_transfer_reads_source(op)) {
+
+        scratch = malloc(rect->width * sizeof(uint32_t));
+
+        /* Transfer in non-overlapping pieces if no copy can be made */
+        if (scratch == NULL)
+            distance = rect->x - *sx;
+
     }
 
-    /* For each row */
-    for (y=0; y < rect->height; y++) {
+    src_buffer += src_stride * (*sy) + 4 * (*sx);
+    dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+    /* For each row */
+    for (i=0; i < rect->height; i++) {
 
-        /* Transfer each pixel in row */
-        for (x=0; x < rect->width; x++) {
+        const uint32_t* src_current;
+        uint32_t* dst_current;
+        int changed, first, last;
 
-            if (__guac_common_surface_transfer_int(op, src_current, dst_current)) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-            }
+        y = backward_rows ? rect->height - 1 - i : i;
+        src_current = (const uint32_t*) (src_buffer + src_stride * y);
 
-            src_current += step;
-            dst_current += step;
+        if (scratch != NULL) {
+            memcpy(scratch, src_current, rect->width * sizeof(uint32_t));
+            src_current = scratch;
         }
 
-        /* Next row */
-        src_buffer += src_stride;
-        dst_buffer += dst_stride;
+        dst_current = (uint32_t*) (dst_buffer + dst_stride * y);
 
-    }
+        /* Transfer row */
+        if (distance > 0)
+            changed = __guac_common_surface_transfer_row_backward(kernel,
+                    src_current, dst_current, rect->width, distance,
+                    &first, &last);
+        else
+            changed = kernel(src_current, dst_current, rect->width,
+                    &first, &last);
 
-    /* Translate X coordinate space of moving backwards */
-    if (step < 0) {
-        int old_max_x = max_x;
-        max_x = rect->width - 1 - min_x;
-        min_x = rect->width - 1 - old_max_x;
-    }
+        if (changed)
+            __guac_common_surface_track_row(y, first, last,
+                    &min_x, &min_y, &max_x, &max_y);
 
-    /* Translate Y coordinate space of moving backwards */
-    if (dst_stride < 0) {
-        int old_max_y = max_y;
-        max_y = rect->height - 1 - min_y;
-        min_y = rect->height - 1 - old_max_y;
     }
 
+    free(scratch);
+
     /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+    __guac_common_surface_restrict_rect(rect, min_x, min_y, max_x, max_y);
 
     /* Update source X/Y */
     *sx += rect->x - orig_x;
@@ -658,16 +1058,55 @@ static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, in
 
 }
 
-guac_common_surface* guac_common_surface_alloc(guac_socket* socket, const guac_layer* layer, int w, int h) {
+/**
+ * Allocates a new heat map large enough to cover a surface of the given size,
+ * with all update history cleared.
+ *
+ * @param w The width of the surface.
+ * @param h The height of the surface.
+ * @return A newly-allocated heat map, which must eventually be freed with
+ *         free().
+ */
+static guac_common_surface_heat_cell* __guac_common_surface_alloc_heat_map(
+        int w, int h) {
+
+    int columns = (w + GUAC_COMMON_SURFACE_HEAT_CELL_SIZE - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int rows    = (h + GUAC_COMMON_SURFACE_HEAT_CELL_SIZE - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    /* Always allocate at least one cell, such that calloc() succeeds */
+    if (columns * rows == 0)
+        return calloc(1, sizeof(guac_common_surface_heat_cell));
+
+    return calloc(columns * rows, sizeof(guac_common_surface_heat_cell));
+
+}
+
+guac_common_surface* guac_common_surface_alloc(guac_client* client, guac_socket* socket,
+        const guac_layer* layer, int w, int h) {
 
     /* Init surface */
     guac_common_surface* surface = malloc(sizeof(guac_common_surface));
+    surface->client = client;
     surface->layer = layer;
     surface->socket = socket;
     surface->width = w;
     surface->height = h;
-    surface->dirty = 0;
-    surface->png_queue_length = 0;
+    memset(&surface->last_flush, 0, sizeof(surface->last_flush));
+
+    /* Nothing yet damaged */
+    __guac_common_surface_alloc_tiles(surface);
+
+    /* Lossy compression and image caching are disabled unless requested */
+    surface->update_cost = GUAC_SURFACE_BASE_COST;
+    surface->lossy_quality = 0;
+    surface->image_cache = NULL;
+    surface->shadow = NULL;
+    memset(&surface->motion_stats, 0, sizeof(surface->motion_stats));
+    surface->heat_map = __guac_common_surface_alloc_heat_map(w, h);
+
+    /* No color census has yet been performed */
+    memset(surface->palette_cache, 0, sizeof(surface->palette_cache));
+    surface->palette_cache_next = 0;
 
     /* Create corresponding Cairo surface */
     surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, w);
@@ -695,6 +1134,10 @@ void guac_common_surface_free(guac_common_surface* surface) {
     if (surface->realized)
         guac_protocol_send_dispose(surface->socket, surface->layer);
 
+    free(surface->heat_map);
+    free(surface->tiles);
+    free(surface->damage);
+    free(surface->shadow);
     free(surface->buffer);
     free(surface);
 
@@ -709,6 +1152,13 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     int old_stride;
     guac_common_rect old_rect;
 
+    guac_common_surface_tile* old_tiles;
+    uint64_t* old_damage;
+    guac_common_rect old_dirty_rect;
+    int old_tile_count;
+    int old_dirty;
+    int i;
+
     int sx = 0;
     int sy = 0;
 
@@ -731,13 +1181,54 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
     /* Free old data */
     free(old_buffer);
 
-    /* Resize dirty rect to fit new surface dimensions */
-    if (surface->dirty) {
-        __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
-        if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
-            surface->dirty = 0;
+    /* Remote display retains any contents within the new bounds, with motion
+     * detection disabled if no copy can be kept */
+    if (surface->shadow != NULL) {
+
+        unsigned char* old_shadow = surface->shadow;
+        surface->shadow = calloc(h, surface->stride);
+
+        if (surface->shadow != NULL) {
+            for (i = 0; i < old_rect.height; i++)
+                memcpy(surface->shadow + i * surface->stride,
+                        old_shadow + i * old_stride, old_rect.width * 4);
+        }
+
+        free(old_shadow);
+
+    }
+
+    /* Update history no longer corresponds to the same regions */
+    free(surface->heat_map);
+    surface->heat_map = __guac_common_surface_alloc_heat_map(w, h);
+    memset(surface->palette_cache, 0, sizeof(surface->palette_cache));
+
+    /* Rebuild damage map for new surface dimensions */
+    old_tiles = surface->tiles;
+    old_damage = surface->damage;
+    old_tile_count = surface->tile_columns * surface->tile_rows;
+    old_dirty_rect = surface->dirty_rect;
+    old_dirty = surface->dirty;
+    __guac_common_surface_alloc_tiles(surface);
+
+    /* Carry over any damage which remains within the new bounds */
+    for (i = 0; i < old_tile_count; i++) {
+        if ((old_damage[i / 64] >> (i % 64)) & 1) {
+            guac_common_rect damage = old_tiles[i].dirty_rect;
+            __guac_common_bound_rect(surface, &damage, NULL, NULL);
+            __guac_common_mark_dirty(surface, &damage);
+        }
+    }
+
+    /* Carry over bounds of damage if no damage map was available */
+    if (old_tiles == NULL && old_dirty) {
+        __guac_common_bound_rect(surface, &old_dirty_rect, NULL, NULL);
+        __guac_common_mark_dirty(surface, &old_dirty_rect);
     }
 
+    free(old_tiles);
+    free(old_damage);
+
     /* Update Guacamole layer */
     if (surface->realized)
         guac_protocol_send_size(socket, layer, w, h);
@@ -752,6 +1243,15 @@ void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_
     int w = cairo_image_surface_get_width(src);
     int h = cairo_image_surface_get_height(src);
 
+    guac_common_surface_draw_buffer(surface, x, y, w, h, buffer, stride,
+            format != CAIRO_FORMAT_ARGB32);
+
+}
+
+void guac_common_surface_draw_buffer(guac_common_surface* surface,
+        int x, int y, int w, int h, unsigned char* buffer, int stride,
+        int opaque) {
+
     int sx = 0;
     int sy = 0;
 
@@ -764,13 +1264,7 @@ void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_
         return;
 
     /* Update backing surface */
-    __guac_common_surface_put(buffer, stride, &sx, &sy, surface, &rect, format != CAIRO_FORMAT_ARGB32);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
-
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        guac_common_surface_flush_deferred(surface);
+    __guac_common_surface_put(buffer, stride, &sx, &sy, surface, &rect, opaque);
 
     /* Always defer draws */
     __guac_common_mark_dirty(surface, &rect);
@@ -799,10 +1293,6 @@ void guac_common_surface_paint(guac_common_surface* surface, int x, int y, cairo
     /* Update backing surface */
     __guac_common_surface_fill_mask(buffer, stride, sx, sy, surface, &rect, red, green, blue);
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        guac_common_surface_flush_deferred(surface);
-
     /* Always defer draws */
     __guac_common_mark_dirty(surface, &rect);
 
@@ -816,6 +1306,7 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy, int w, i
     const guac_layer* dst_layer = dst->layer;
 
     guac_common_rect rect;
+    int immediate = 0;
     guac_common_rect_init(&rect, dx, dy, w, h);
 
     /* Clip operation */
@@ -840,13 +1331,50 @@ void guac_common_surface_copy(guac_common_surface* src, int sx, int sy, int w, i
         guac_common_surface_flush(src);
         guac_protocol_send_copy(socket, src_layer, sx, sy, rect.width, rect.height,
                                 GUAC_COMP_OVER, dst_layer, rect.x, rect.y);
+        __guac_common_surface_invalidate_tiles(dst, &rect);
         dst->realized = 1;
+        immediate = 1;
     }
 
     /* Update backing surface last if destination rect can intersect source rect */
     if (src == dst)
         __guac_common_surface_transfer(src, &sx, &sy, GUAC_TRANSFER_BINARY_SRC, dst, &rect);
 
+    /* Remote display now matches backing surface */
+    if (immediate)
+        __guac_common_surface_sync_shadow(dst, &rect);
+
+}
+
+void guac_common_surface_copy_immediate(guac_common_surface* src,
+        int sx, int sy, int w, int h, guac_common_surface* dst, int dx, int dy) {
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, dx, dy, w, h);
+
+    /* Clip operation */
+    __guac_common_clip_rect(dst, &rect, &sx, &sy);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Update backing surface, sending nothing if nothing changed */
+    __guac_common_surface_transfer(src, &sx, &sy, GUAC_TRANSFER_BINARY_SRC, dst, &rect);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Source must be current on the remote display. Pending damage of the
+     * destination need not be flushed, as it will be flushed from the
+     * already-updated backing surface. */
+    guac_common_surface_flush(src);
+    guac_protocol_send_copy(dst->socket, src->layer, sx, sy,
+            rect.width, rect.height, GUAC_COMP_OVER, dst->layer,
+            rect.x, rect.y);
+
+    /* Remote display now matches backing surface */
+    __guac_common_surface_invalidate_tiles(dst, &rect);
+    __guac_common_surface_sync_shadow(dst, &rect);
+    dst->realized = 1;
+
 }
 
 void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int w, int h,
@@ -857,6 +1385,7 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
     const guac_layer* dst_layer = dst->layer;
 
     guac_common_rect rect;
+    int immediate = 0;
     guac_common_rect_init(&rect, dx, dy, w, h);
 
     /* Clip operation */
@@ -880,13 +1409,19 @@ void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int
         guac_common_surface_flush(dst);
         guac_common_surface_flush(src);
         guac_protocol_send_transfer(socket, src_layer, sx, sy, rect.width, rect.height, op, dst_layer, rect.x, rect.y);
+        __guac_common_surface_invalidate_tiles(dst, &rect);
         dst->realized = 1;
+        immediate = 1;
     }
 
     /* Update backing surface last if destination rect can intersect source rect */
     if (src == dst)
         __guac_common_surface_transfer(src, &sx, &sy, op, dst, &rect);
 
+    /* Remote display now matches backing surface */
+    if (immediate)
+        __guac_common_surface_sync_shadow(dst, &rect);
+
 }
 
 void guac_common_surface_rect(guac_common_surface* surface,
@@ -918,6 +1453,8 @@ void guac_common_surface_rect(guac_common_surface* surface,
         guac_common_surface_flush(surface);
         guac_protocol_send_rect(socket, layer, rect.x, rect.y, rect.width, rect.height);
         guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer, red, green, blue, 0xFF);
+        __guac_common_surface_invalidate_tiles(surface, &rect);
+        __guac_common_surface_sync_shadow(surface, &rect);
         surface->realized = 1;
     }
 
@@ -943,128 +1480,1646 @@ void guac_common_surface_reset_clip(guac_common_surface* surface) {
 }
 
 /**
- * Flushes the PNG update currently described by the dirty rectangle within the
- * given surface directly to a "png" instruction, which is sent on the socket
- * associated with the surface.
+ * A single PNG update which has been planned by a flush of a surface and is
+ * awaiting encoding and transmission.
+ */
+typedef struct __guac_common_surface_png_job {
+
+    /**
+     * The surface being flushed.
+     */
+    guac_common_surface* surface;
+
+    /**
+     * The rectangle of the surface to encode.
+     */
+    guac_common_rect rect;
+
+    /**
+     * Whether this update should be encoded as JPEG rather than PNG.
+     */
+    int lossy;
+
+    /**
+     * The JPEG quality to use if the update is lossy, reduced from the
+     * quality requested for the surface if the connection is slow.
+     */
+    int quality;
+
+    /**
+     * Whether this update should be encoded and streamed to the client while
+     * being sent, rather than encoded by the encoder pool beforehand.
+     */
+    int streamed;
+
+    /**
+     * The palette hint to use when encoding this update as PNG, updated with
+     * the result of the color census once encoded.
+     */
+    guac_palette_hint palette_hint;
+
+    /**
+     * Non-zero if the palette hint was taken from the palette cache of the
+     * surface, and thus no census will be performed.
+     */
+    int palette_cached;
+
+    /**
+     * Non-zero if this update should be added to the image cache of the
+     * surface once sent.
+     */
+    int cacheable;
+
+    /**
+     * The hash of the contents of this update, as returned by
+     * guac_hash_surface(), if this update is cacheable.
+     */
+    unsigned int hash;
+
+    /**
+     * The encoded image data, or NULL if encoding failed.
+     */
+    void* data;
+
+    /**
+     * The number of bytes of encoded image data.
+     */
+    int length;
+
+    /**
+     * The value of guac_error after encoding failed, or GUAC_STATUS_SUCCESS
+     * if encoding succeeded. As jobs may run on other threads, whose
+     * guac_error is separate, this is restored on the flushing thread once
+     * the job completes.
+     */
+    guac_status error;
+
+    /**
+     * The value of guac_error_message after encoding failed, or NULL if
+     * encoding succeeded.
+     */
+    const char* error_message;
+
+} __guac_common_surface_png_job;
+
+/**
+ * Returns the current value of a monotonic clock, in microseconds.
+ *
+ * @return The current value of a monotonic clock, in microseconds.
+ */
+static int64_t __guac_common_surface_usec() {
+
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+
+    return (int64_t) current.tv_sec * 1000000 + current.tv_nsec / 1000;
+
+}
+
+/**
+ * Returns a new Cairo surface which refers directly to the contents of the
+ * given rectangle of the given surface.
  *
- * @param surface The surface to flush.
+ * @param surface The surface containing the image data.
+ * @param rect The rectangle within the surface to refer to.
+ * @return A new Cairo surface which must eventually be destroyed with
+ *         cairo_surface_destroy().
  */
-static void __guac_common_surface_flush_to_png(guac_common_surface* surface) {
+static cairo_surface_t* __guac_common_surface_get_rect(
+        guac_common_surface* surface, const guac_common_rect* rect) {
+
+    unsigned char* buffer = surface->buffer + rect->y * surface->stride + rect->x * 4;
+    return cairo_image_surface_create_for_data(buffer, CAIRO_FORMAT_RGB24,
+                                               rect->width, rect->height,
+                                               surface->stride);
 
-    if (surface->dirty) {
+}
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
+/**
+ * Returns whether the client associated with the given surface supports the
+ * img instruction, which is implied by the client having declared its
+ * supported image mimetypes during the handshake.
+ *
+ * @param surface The surface whose client should be checked.
+ * @return Non-zero if the img instruction is supported, zero otherwise.
+ */
+static int __guac_common_surface_supports_img(guac_common_surface* surface) {
+    return surface->client != NULL
+        && surface->client->info.image_mimetypes != NULL;
+}
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer + surface->dirty_rect.y * surface->stride + surface->dirty_rect.x * 4;
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer, CAIRO_FORMAT_RGB24,
-                                                                    surface->dirty_rect.width,
-                                                                    surface->dirty_rect.height,
-                                                                    surface->stride);
+/**
+ * Returns whether the client associated with the given surface has declared
+ * support for the given image mimetype.
+ *
+ * @param surface The surface whose client should be checked.
+ * @param mimetype The mimetype to check.
+ * @return Non-zero if the mimetype is supported, zero otherwise.
+ */
+static int __guac_common_surface_supports_mimetype(
+        guac_common_surface* surface, const char* mimetype) {
 
-        /* Send PNG for rect */
-        guac_protocol_send_png(socket, GUAC_COMP_OVER, layer, surface->dirty_rect.x, surface->dirty_rect.y, rect);
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+    const char** current;
 
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+    /* No additional formats if none declared */
+    if (!__guac_common_surface_supports_img(surface))
+        return 0;
 
+    for (current = surface->client->info.image_mimetypes; *current != NULL;
+            current++) {
+        if (strcmp(*current, mimetype) == 0)
+            return 1;
     }
 
+    return 0;
+
 }
 
 /**
- * Comparator for instances of guac_common_surface_png_rect, the elements
- * which make up a surface's PNG buffer.
+ * Returns the average rate at which the heat map cells covered by the given
+ * rectangle have been updated, in updates per second. Cells which have not
+ * yet been updated enough times to fill their history contribute zero.
  *
- * @see qsort
+ * @param surface The surface whose heat map should be inspected.
+ * @param rect The rectangle to calculate the framerate of.
+ * @return The average framerate of the given rectangle.
  */
-static int __guac_common_surface_png_rect_compare(const void* a, const void* b) {
+static int __guac_common_surface_get_framerate(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    int columns = (surface->width + GUAC_COMMON_SURFACE_HEAT_CELL_SIZE - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    int x, y;
+    int sum = 0;
+    int count = 0;
 
-    guac_common_surface_png_rect* ra = (guac_common_surface_png_rect*) a;
-    guac_common_surface_png_rect* rb = (guac_common_surface_png_rect*) b;
+    for (y = min_y; y <= max_y; y++) {
 
-    /* Order roughly top to bottom, left to right */
-    if (ra->rect.y != rb->rect.y) return ra->rect.y - rb->rect.y;
-    if (ra->rect.x != rb->rect.x) return ra->rect.x - rb->rect.x;
+        guac_common_surface_heat_cell* cell = &surface->heat_map[y * columns + min_x];
 
-    /* Wider updates should come first (more likely to intersect later) */
-    if (ra->rect.width != rb->rect.width) return rb->rect.width - ra->rect.width;
+        for (x = min_x; x <= max_x; x++, cell++) {
 
-    /* Shorter updates should come first (less likely to increase cost) */
-    return ra->rect.height - rb->rect.height;
+            int newest_entry = (cell->oldest_entry + GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1)
+                             % GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE;
+
+            guac_timestamp oldest = cell->history[cell->oldest_entry];
+            guac_timestamp newest = cell->history[newest_entry];
+
+            /* Only cells with complete history have a known framerate */
+            if (oldest != 0 && newest > oldest)
+                sum += 1000 * (GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1)
+                     / (newest - oldest);
+
+            count++;
+
+        }
+
+    }
+
+    if (count == 0)
+        return 0;
+
+    return sum / count;
 
 }
 
-void guac_common_surface_flush(guac_common_surface* surface) {
+/**
+ * Records an update to the given rectangle at the given time within the heat
+ * map of the given surface.
+ *
+ * @param surface The surface whose heat map should be updated.
+ * @param rect The rectangle which was updated.
+ * @param timestamp The time of the update.
+ */
+static void __guac_common_surface_touch_rect(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_timestamp timestamp) {
 
-    guac_common_surface_png_rect* current = surface->png_queue;
+    int columns = (surface->width + GUAC_COMMON_SURFACE_HEAT_CELL_SIZE - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
 
-    int i, j;
-    int original_queue_length;
-    int flushed = 0;
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    int x, y;
 
-    /* Flush final dirty rect to queue */
-    __guac_common_surface_flush_to_queue(surface);
-    original_queue_length = surface->png_queue_length;
+    for (y = min_y; y <= max_y; y++) {
 
-    /* Sort updates to make combination less costly */
-    qsort(surface->png_queue, surface->png_queue_length, sizeof(guac_common_surface_png_rect),
-          __guac_common_surface_png_rect_compare);
+        guac_common_surface_heat_cell* cell = &surface->heat_map[y * columns + min_x];
 
-    /* Flush all rects in queue */
-    for (i=0; i < surface->png_queue_length; i++) {
+        for (x = min_x; x <= max_x; x++, cell++) {
+            cell->history[cell->oldest_entry] = timestamp;
+            cell->oldest_entry = (cell->oldest_entry + 1)
+                               % GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE;
+        }
 
-        /* Get next unflushed candidate */
-        guac_common_surface_png_rect* candidate = current;
-        if (!candidate->flushed) {
+    }
 
-            int combined = 0;
+}
 
-            /* Build up rect as much as possible */
-            for (j=i; j < surface->png_queue_length; j++) {
+/**
+ * Returns whether the given rectangle of the given surface appears to be
+ * photographic, based on the number of distinct colors found at a grid of
+ * sample points.
+ *
+ * @param surface The surface containing the image data.
+ * @param rect The rectangle to inspect.
+ * @return Non-zero if the rectangle appears photographic, zero otherwise.
+ */
+static int __guac_common_surface_is_photographic(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-                if (!candidate->flushed) {
+    uint32_t colors[GUAC_SURFACE_PHOTO_COLORS];
+    int color_count = 0;
 
-                    /* Clip candidate within current bounds */
-                    __guac_common_bound_rect(surface, &candidate->rect, NULL, NULL);
-                    if (candidate->rect.width <= 0 || candidate->rect.height <= 0)
-                        candidate->flushed = 1;
+    int step_x = rect->width  / GUAC_SURFACE_COLOR_SAMPLES;
+    int step_y = rect->height / GUAC_SURFACE_COLOR_SAMPLES;
 
-                    /* Combine if reasonable */
-                    else if (__guac_common_should_combine(surface, &candidate->rect, 0) || !surface->dirty) {
-                        __guac_common_mark_dirty(surface, &candidate->rect);
-                        candidate->flushed = 1;
-                        combined++;
-                    }
+    int x, y, i;
 
-                }
+    if (step_x < 1) step_x = 1;
+    if (step_y < 1) step_y = 1;
 
-                candidate++;
+    for (y = rect->y; y < rect->y + rect->height; y += step_y) {
 
-            }
+        uint32_t* row = (uint32_t*) (surface->buffer + y * surface->stride);
 
-            /* Re-add to queue if there's room and this update was modified or we expect others might be */
-            if ((combined > 1 || i < original_queue_length)
-                    && surface->png_queue_length < GUAC_COMMON_SURFACE_QUEUE_SIZE)
-                __guac_common_surface_flush_to_queue(surface);
+        for (x = rect->x; x < rect->x + rect->width; x += step_x) {
 
-            /* Flush as PNG otherwise */
-            else {
-                if (surface->dirty) flushed++;
-                __guac_common_surface_flush_to_png(surface);
+            uint32_t color = row[x] & 0xFFFFFF;
+
+            /* Skip colors already seen */
+            for (i = 0; i < color_count; i++) {
+                if (colors[i] == color)
+                    break;
             }
 
+            if (i < color_count)
+                continue;
+
+            /* Stop once enough distinct colors have been found */
+            colors[color_count++] = color;
+            if (color_count == GUAC_SURFACE_PHOTO_COLORS)
+                return 1;
+
         }
 
-        current++;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Returns whether the given rectangle of the given surface should be sent
+ * using lossy compression. Lossy compression is used only if enabled for the
+ * surface and supported by the client, and only for sufficiently large,
+ * photographic updates which are either very large or changing frequently.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The rectangle of the update.
+ * @param framerate The rate at which the region covered by the update has
+ *                  been changing, in updates per second.
+ * @return Non-zero if the update should be sent as JPEG, zero otherwise.
+ */
+static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
+        const guac_common_rect* rect, int framerate) {
+
+    int area = rect->width * rect->height;
+
+    if (surface->lossy_quality <= 0 || area < GUAC_SURFACE_LOSSY_MIN_AREA)
+        return 0;
+
+    /* Only updates which change often or are very large benefit enough */
+    if (framerate < GUAC_SURFACE_LOSSY_FRAMERATE
+            && area < GUAC_SURFACE_LOSSY_LARGE_AREA)
+        return 0;
+
+    return __guac_common_surface_supports_mimetype(surface, "image/jpeg")
+        && __guac_common_surface_is_photographic(surface, rect);
+
+}
+
+/**
+ * Encodes the update described by the given __guac_common_surface_png_job,
+ * as JPEG if the update was deemed lossy and as PNG otherwise. If JPEG
+ * encoding fails, the update is encoded as PNG. This function is invoked by
+ * the encoder pool, and may run concurrently with the encoding of other
+ * updates.
+ *
+ * @param data The __guac_common_surface_png_job to encode.
+ */
+static void __guac_common_surface_encode_png(void* data) {
+
+    __guac_common_surface_png_job* job = (__guac_common_surface_png_job*) data;
+    guac_client* client = job->surface->client;
+    cairo_surface_t* rect;
+
+    /* Streamed updates are encoded only when sent */
+    if (job->streamed)
+        return;
 
+    rect = __guac_common_surface_get_rect(job->surface, &job->rect);
+
+    /* Fall back to PNG if lossy encoding is not possible */
+    if (job->lossy && guac_protocol_encode_jpeg(rect,
+                job->quality, &job->data, &job->length))
+        job->lossy = 0;
+
+    /* Encoding failures are handled when the update is sent */
+    if (!job->lossy && guac_protocol_encode_png_hinted(rect,
+                client != NULL ? client->png_compression
+                               : GUAC_PNG_COMPRESSION_DEFAULT,
+                &job->palette_hint, &job->data, &job->length)) {
+        job->data = NULL;
+        job->error = guac_error;
+        job->error_message = guac_error_message;
     }
 
-    /* Flush complete */
-    surface->png_queue_length = 0;
+    cairo_surface_destroy(rect);
+
+}
+
+/**
+ * Returns the palette cache entry of the given surface which corresponds to
+ * the given rectangle, if any.
+ *
+ * @param surface The surface whose palette cache should be searched.
+ * @param rect The rectangle to search for.
+ * @return The matching palette cache entry, or NULL if there is no such
+ *         entry.
+ */
+static guac_common_surface_palette_cache_entry* __guac_common_surface_find_palette(
+        guac_common_surface* surface, const guac_common_rect* rect) {
+
+    int i;
+
+    for (i = 0; i < GUAC_COMMON_SURFACE_PALETTE_CACHE_SIZE; i++) {
+
+        guac_common_surface_palette_cache_entry* entry = &surface->palette_cache[i];
+
+        if (entry->rect.width  == rect->width
+         && entry->rect.height == rect->height
+         && entry->rect.x      == rect->x
+         && entry->rect.y      == rect->y)
+            return entry;
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Returns the palette hint to use when encoding the given rectangle of the
+ * given surface as PNG. If the same rectangle was recently found to have too
+ * many colors for a palette, the census is skipped, though never more than
+ * GUAC_SURFACE_PALETTE_MAX_REUSES times in a row.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The rectangle of the update.
+ * @param cached Pointer to an int which will be set to non-zero if the hint
+ *               was taken from the cache, zero otherwise.
+ * @return The palette hint to use.
+ */
+static guac_palette_hint __guac_common_surface_get_palette_hint(
+        guac_common_surface* surface, const guac_common_rect* rect,
+        int* cached) {
+
+    guac_common_surface_palette_cache_entry* entry =
+        __guac_common_surface_find_palette(surface, rect);
+
+    if (entry != NULL && entry->hint == GUAC_PALETTE_HINT_TRUECOLOR
+            && entry->reuses < GUAC_SURFACE_PALETTE_MAX_REUSES) {
+        entry->reuses++;
+        *cached = 1;
+        return GUAC_PALETTE_HINT_TRUECOLOR;
+    }
+
+    *cached = 0;
+    return GUAC_PALETTE_HINT_UNKNOWN;
+
+}
+
+/**
+ * Stores the result of the color census of the given rectangle within the
+ * palette cache of the given surface, replacing the oldest entry if the
+ * rectangle is not already cached.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The rectangle whose colors were counted.
+ * @param hint The result of the census.
+ */
+static void __guac_common_surface_store_palette_hint(
+        guac_common_surface* surface, const guac_common_rect* rect,
+        guac_palette_hint hint) {
+
+    guac_common_surface_palette_cache_entry* entry =
+        __guac_common_surface_find_palette(surface, rect);
+
+    /* Replace oldest entry if not yet cached */
+    if (entry == NULL) {
+        entry = &surface->palette_cache[surface->palette_cache_next];
+        surface->palette_cache_next = (surface->palette_cache_next + 1)
+                                    % GUAC_COMMON_SURFACE_PALETTE_CACHE_SIZE;
+        entry->rect = *rect;
+    }
+
+    entry->hint = hint;
+    entry->reuses = 0;
+
+}
+
+/**
+ * Adds an update of the given rectangle of the given surface to the given
+ * array of pending updates, to be encoded and sent as a "png" instruction
+ * once all updates have been determined.
+ *
+ * @param surface The surface to flush.
+ * @param rect The rectangle to update.
+ * @param jobs The array of pending updates.
+ * @param job_count Pointer to the number of pending updates within the array,
+ *                  which will be incremented as the update is added.
+ */
+static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
+        const guac_common_rect* rect, __guac_common_surface_png_job* jobs,
+        int* job_count) {
+
+    __guac_common_surface_png_job* job = &(jobs[(*job_count)++]);
+
+    /* Choose lossy compression based on content and update frequency */
+    int framerate = __guac_common_surface_get_framerate(surface, rect);
+    __guac_common_surface_touch_rect(surface, rect,
+            guac_timestamp_current());
+
+    job->surface = surface;
+    job->rect = *rect;
+    job->lossy = __guac_common_surface_should_use_jpeg(surface, rect,
+            framerate);
+    job->quality = surface->lossy_quality;
+    if (surface->client != NULL)
+        job->quality = guac_pacing_get_lossy_quality(surface->client->pacing,
+                surface->lossy_quality);
+    job->palette_hint = __guac_common_surface_get_palette_hint(surface,
+            rect, &job->palette_cached);
+
+    /* Stream large lossless updates if possible */
+    job->streamed = !job->lossy
+        && rect->width * rect->height >= GUAC_SURFACE_STREAM_MIN_AREA
+        && __guac_common_surface_supports_img(surface);
+    job->data = NULL;
+    job->length = 0;
+    job->cacheable = 0;
+    job->error = GUAC_STATUS_SUCCESS;
+    job->error_message = NULL;
+
+    surface->realized = 1;
 
 }
 
+/**
+ * Sends the given JPEG data as an "img" instruction, followed by the data
+ * itself along a newly-allocated stream.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The rectangle of the update.
+ * @param data The encoded JPEG data.
+ * @param length The number of bytes of encoded JPEG data.
+ * @return Zero on success, non-zero if no stream could be allocated.
+ */
+static int __guac_common_surface_send_jpeg(guac_common_surface* surface,
+        const guac_common_rect* rect, void* data, int length) {
+
+    unsigned char* current = data;
+    int remaining = length;
+
+    /* Begin stream */
+    guac_stream* stream = guac_client_alloc_stream(surface->client);
+    if (stream == NULL)
+        return 1;
+
+    guac_protocol_send_img(surface->socket, stream, GUAC_COMP_OVER,
+            surface->layer, "image/jpeg", rect->x, rect->y);
+
+    /* Split image into chunks */
+    while (remaining > 0) {
+
+        /* Calculate size of next block */
+        int block_size = GUAC_SURFACE_BLOB_SIZE;
+        if (remaining < block_size)
+            block_size = remaining;
+
+        /* Send block */
+        guac_protocol_send_blob(surface->socket, stream, current, block_size);
+
+        /* Next block */
+        remaining -= block_size;
+        current += block_size;
+
+    }
+
+    /* End stream */
+    guac_protocol_send_end(surface->socket, stream);
+    guac_client_free_stream(surface->client, stream);
+
+    return 0;
+
+}
+
+/**
+ * Encodes the given update as PNG, sending the PNG data to the client along
+ * a newly-allocated stream as it is encoded.
+ *
+ * @param surface The surface being flushed.
+ * @param job The update to encode and send.
+ * @return Zero on success, non-zero if no stream could be allocated.
+ */
+static int __guac_common_surface_stream_png(guac_common_surface* surface,
+        __guac_common_surface_png_job* job) {
+
+    guac_stream* stream;
+    cairo_surface_t* image;
+
+    /* Allocate stream */
+    stream = guac_client_alloc_stream(surface->client);
+    if (stream == NULL)
+        return 1;
+
+    /* Encode and send simultaneously */
+    image = __guac_common_surface_get_rect(surface, &job->rect);
+    guac_protocol_stream_png(surface->socket, stream, GUAC_COMP_OVER,
+            surface->layer, job->rect.x, job->rect.y, image,
+            surface->client->png_compression, &job->palette_hint);
+    cairo_surface_destroy(image);
+
+    guac_client_free_stream(surface->client, stream);
+    return 0;
+
+}
+
+/**
+ * Encodes all given pending PNG updates in parallel using the encoder pool,
+ * then sends each update as a "png" instruction in the order given, updating
+ * the flush statistics of the surface, which must have been reset beforehand.
+ *
+ * @param surface The surface being flushed.
+ * @param jobs The array of pending updates.
+ * @param job_count The number of pending updates within the array.
+ */
+static void __guac_common_surface_send_png(guac_common_surface* surface,
+        __guac_common_surface_png_job* jobs, int job_count) {
+
+    guac_common_surface_flush_stats* stats = &surface->last_flush;
+    void** job_data;
+    int64_t start, encoded;
+    int i;
+
+    if (job_count == 0)
+        return;
+
+    /* Encode all updates, in parallel if the pool can be given the jobs */
+    start = __guac_common_surface_usec();
+    job_data = malloc(sizeof(void*) * job_count);
+    if (job_data != NULL) {
+
+        for (i = 0; i < job_count; i++)
+            job_data[i] = &jobs[i];
+
+        guac_encoder_pool_run(__guac_common_surface_encode_png, job_data,
+                job_count);
+
+        free(job_data);
+
+    }
+
+    else {
+        for (i = 0; i < job_count; i++)
+            __guac_common_surface_encode_png(&jobs[i]);
+    }
+
+    encoded = __guac_common_surface_usec();
+    stats->updates = job_count;
+
+    /* Report any encoding failure on this thread */
+    for (i = 0; i < job_count; i++) {
+        if (jobs[i].error != GUAC_STATUS_SUCCESS) {
+            guac_error = jobs[i].error;
+            guac_error_message = jobs[i].error_message;
+            break;
+        }
+    }
+
+    /* Send all updates in original order */
+    for (i = 0; i < job_count; i++) {
+
+        __guac_common_surface_png_job* job = &jobs[i];
+        guac_common_rect* rect = &job->rect;
+
+        /* Stream large updates if a stream is available for them */
+        if (job->streamed
+                && !__guac_common_surface_stream_png(surface, job)) {
+
+            stats->streamed_updates++;
+
+            /* Remember result of any census for future flushes */
+            if (job->palette_cached)
+                stats->palette_cache_hits++;
+            else
+                __guac_common_surface_store_palette_hint(surface, rect,
+                        job->palette_hint);
+
+        }
+
+        /* Send pre-encoded JPEG if a stream is available for it */
+        else if (job->data != NULL && job->lossy
+                && !__guac_common_surface_send_jpeg(surface, rect, job->data,
+                    job->length)) {
+            stats->lossy_updates++;
+            free(job->data);
+
+            /* Approximate contents must not be reused */
+            job->cacheable = 0;
+
+        }
+
+        /* Send pre-encoded PNG if available */
+        else if (job->data != NULL && !job->lossy) {
+
+            guac_protocol_send_png_data(surface->socket, GUAC_COMP_OVER,
+                    surface->layer, rect->x, rect->y, job->data, job->length);
+            free(job->data);
+
+            /* Remember result of any census for future flushes */
+            if (job->palette_cached)
+                stats->palette_cache_hits++;
+            else
+                __guac_common_surface_store_palette_hint(surface, rect,
+                        job->palette_hint);
+
+        }
+
+        /* Otherwise, encode and send directly as PNG */
+        else {
+
+            cairo_surface_t* image = __guac_common_surface_get_rect(surface,
+                    rect);
+
+            /* Discard any JPEG which could not be sent */
+            free(job->data);
+            job->data = NULL;
+            job->length = 0;
+
+            /* The PNG sent in its place is exact */
+            job->lossy = 0;
+
+            if (guac_protocol_encode_png_hinted(image,
+                        surface->client != NULL
+                            ? surface->client->png_compression
+                            : GUAC_PNG_COMPRESSION_DEFAULT,
+                        &job->palette_hint, &job->data, &job->length)
+                    || guac_protocol_send_png_data(surface->socket,
+                        GUAC_COMP_OVER, surface->layer, rect->x, rect->y,
+                        job->data, job->length)) {
+
+                /* Contents which were not sent must be treated as
+                 * approximate, and thus neither trusted nor cached */
+                job->lossy = 1;
+                job->cacheable = 0;
+                job->length = 0;
+
+            }
+
+            free(job->data);
+            cairo_surface_destroy(image);
+
+        }
+
+        stats->pixels += rect->width * rect->height;
+        stats->bytes += job->length;
+
+        if (job->lossy)
+            __guac_common_surface_forget_shadow(surface, rect);
+        else
+            __guac_common_surface_sync_shadow(surface, rect);
+
+        /* Retain copy of sent image for future flushes */
+        if (job->cacheable) {
+            cairo_surface_t* image = __guac_common_surface_get_rect(surface,
+                    rect);
+            guac_common_image_cache_store(surface->image_cache,
+                    surface->socket, image, job->hash, surface->layer,
+                    rect->x, rect->y);
+            cairo_surface_destroy(image);
+        }
+
+    }
+
+    stats->encode_time = encoded - start;
+    stats->send_time = __guac_common_surface_usec() - encoded;
+
+}
+
+/**
+ * Combines the given 64-bit hash with the given pixel value, returning the
+ * resulting hash.
+ *
+ * @param hash The hash of all preceding pixels.
+ * @param value The value of the next pixel.
+ * @return The hash of all preceding pixels and the given pixel.
+ */
+static inline uint64_t __guac_common_surface_hash_pixel(uint64_t hash,
+        uint32_t value) {
+
+    hash = (hash ^ value) * 0x9E3779B97F4A7C15;
+    return hash ^ (hash >> 29);
+
+}
+
+/**
+ * Returns a 64-bit hash of the contents of the given rectangle of the given
+ * surface.
+ *
+ * @param surface The surface containing the image data.
+ * @param rect The rectangle to hash.
+ * @return A 64-bit hash of the contents of the given rectangle.
+ */
+static uint64_t __guac_common_surface_hash_rect(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    uint64_t hash = 0xCBF29CE484222325;
+    int x, y;
+
+    for (y = 0; y < rect->height; y++) {
+
+        const uint32_t* row = (const uint32_t*) (surface->buffer
+                + (rect->y + y) * surface->stride + rect->x * 4);
+
+        for (x = 0; x < rect->width; x++)
+            hash = __guac_common_surface_hash_pixel(hash, row[x]);
+
+    }
+
+    return hash;
+
+}
+
+/**
+ * Returns the estimated change in cost if two rectangles are sent as a single
+ * update covering both, rather than as two separate updates. A negative
+ * value indicates that combining the rectangles is cheaper.
+ *
+ * @param surface The surface containing the rectangles.
+ * @param a The first rectangle.
+ * @param b The second rectangle.
+ * @return The estimated change in cost of combining the rectangles.
+ */
+static int __guac_common_surface_merge_cost(guac_common_surface* surface,
+        const guac_common_rect* a, const guac_common_rect* b) {
+
+    guac_common_rect combined = *a;
+    guac_common_rect_extend(&combined, b);
+
+    return __guac_common_surface_cost(surface, &combined)
+        - __guac_common_surface_cost(surface, a)
+        - __guac_common_surface_cost(surface, b);
+
+}
+
+/**
+ * Combines each of the given rectangles with those following it within
+ * GUAC_SURFACE_PLAN_WINDOW places, cheapest first, wherever the estimated
+ * cost of sending the combined rectangle does not exceed that of sending
+ * each rectangle separately. The order of the remaining rectangles is
+ * preserved.
+ *
+ * @param surface The surface containing the rectangles.
+ * @param rects The array of rectangles to combine, which will receive the
+ *              remaining rectangles.
+ * @param count The number of rectangles within the array.
+ * @return The number of rectangles remaining within the array.
+ */
+static int __guac_common_surface_merge_local(guac_common_surface* surface,
+        guac_common_rect* rects, int count) {
+
+    int remaining = 0;
+    int i, j;
+
+    for (i = 0; i < count; i++) {
+
+        /* Skip rectangles already combined into another */
+        if (rects[i].width == 0)
+            continue;
+
+        /* Combine with the cheapest neighbor until none would reduce cost */
+        for (;;) {
+
+            int best_cost = 1;
+            int best_j = -1;
+            int neighbors = 0;
+
+            for (j = i + 1; j < count
+                    && neighbors < GUAC_SURFACE_PLAN_WINDOW; j++) {
+
+                int merge_cost;
+
+                if (rects[j].width == 0)
+                    continue;
+
+                neighbors++;
+                merge_cost = __guac_common_surface_merge_cost(surface,
+                        &rects[i], &rects[j]);
+                if (merge_cost < best_cost) {
+                    best_cost = merge_cost;
+                    best_j = j;
+                }
+
+            }
+
+            if (best_j == -1)
+                break;
+
+            /* Combined rectangles are marked by their zero width */
+            guac_common_rect_extend(&rects[i], &rects[best_j]);
+            rects[best_j].width = 0;
+
+        }
+
+        rects[remaining++] = rects[i];
+
+    }
+
+    return remaining;
+
+}
+
+/**
+ * Covers the damaged region of each damaged tile of the given surface with
+ * rectangles, combining the damage of different tiles wherever the estimated
+ * cost of sending the combined rectangle does not exceed that of sending
+ * each rectangle separately. Combinations are made cheapest first, such that
+ * damage split across tiles by a single update is reassembled before any
+ * unrelated damage is combined with it. If too many rectangles result for
+ * the cheapest combinations to be found quickly, rectangles are first
+ * combined only with their neighbors. If the resulting rectangles would cost
+ * more than the single rectangle bounding all damage, that rectangle is used
+ * instead. The rectangles are produced roughly top to bottom, left to right.
+ *
+ * @param surface The surface whose damage should be covered.
+ * @param rects An array large enough to hold one rectangle per tile, which
+ *              will receive the resulting rectangles.
+ * @return The number of rectangles stored within the given array.
+ */
+static int __guac_common_surface_plan(guac_common_surface* surface,
+        guac_common_rect* rects) {
+
+    int count = 0;
+    int column, row, pass;
+    int i, j;
+
+    guac_common_rect bounds;
+    int64_t total_cost;
+
+    /* Join damage which continues exactly into the next tile of the same
+     * row, as happens when large regions are damaged */
+    for (row = 0; row < surface->tile_rows; row++) {
+
+        guac_common_rect* run = NULL;
+
+        for (column = 0; column < surface->tile_columns; column++) {
+
+            int index = row * surface->tile_columns + column;
+            guac_common_rect* damage = &surface->tiles[index].dirty_rect;
+
+            if (!__guac_common_surface_is_damaged(surface, index)) {
+                run = NULL;
+                continue;
+            }
+
+            if (run != NULL && run->x + run->width == damage->x
+                    && run->y == damage->y && run->height == damage->height)
+                run->width += damage->width;
+            else {
+                run = &rects[count++];
+                *run = *damage;
+            }
+
+        }
+
+    }
+
+    /* Combine neighboring rectangles while too many remain to search all
+     * combinations */
+    for (pass = 0; count > GUAC_SURFACE_PLAN_MAX_CANDIDATES
+            && pass < GUAC_SURFACE_PLAN_MAX_PASSES; pass++) {
+
+        int previous = count;
+        count = __guac_common_surface_merge_local(surface, rects, count);
+
+        if (count == previous)
+            break;
+
+    }
+
+    /* Repeatedly combine the pair of rectangles whose combination is
+     * cheapest, until no combination would reduce cost */
+    while (count <= GUAC_SURFACE_PLAN_MAX_CANDIDATES) {
+
+        int best_cost = 1;
+        int best_i = 0, best_j = 0;
+
+        for (i = 0; i < count; i++) {
+            for (j = i + 1; j < count; j++) {
+                int merge_cost = __guac_common_surface_merge_cost(surface, &rects[i],
+                        &rects[j]);
+                if (merge_cost < best_cost) {
+                    best_cost = merge_cost;
+                    best_i = i;
+                    best_j = j;
+                }
+            }
+        }
+
+        if (best_cost > 0)
+            break;
+
+        /* Combine pair, preserving order of remaining rectangles */
+        guac_common_rect_extend(&rects[best_i], &rects[best_j]);
+        memmove(&rects[best_j], &rects[best_j + 1],
+                sizeof(guac_common_rect) * (count - best_j - 1));
+        count--;
+
+    }
+
+    if (count <= 1)
+        return count;
+
+    /* Determine cost of plan relative to sending all damage at once */
+    bounds = rects[0];
+    total_cost = __guac_common_surface_cost(surface, &rects[0]);
+    for (i = 1; i < count; i++) {
+        guac_common_rect_extend(&bounds, &rects[i]);
+        total_cost += __guac_common_surface_cost(surface, &rects[i]);
+    }
+
+    /* Send all damage at once if cheaper */
+    if (__guac_common_surface_cost(surface, &bounds) <= total_cost) {
+        rects[0] = bounds;
+        return 1;
+    }
+
+    return count;
+
+}
+
+/**
+ * A row or column hash, along with the index of the row or column hashed.
+ */
+typedef struct __guac_common_surface_line_hash {
+
+    /**
+     * The hash of the contents of the row or column.
+     */
+    uint64_t hash;
+
+    /**
+     * The index of the row or column, relative to the rectangle hashed.
+     */
+    int index;
+
+} __guac_common_surface_line_hash;
+
+/**
+ * Comparator for instances of __guac_common_surface_line_hash, ordering
+ * by hash.
+ *
+ * @see qsort
+ */
+static int __guac_common_surface_line_hash_compare(const void* a,
+        const void* b) {
+
+    uint64_t hash_a = ((const __guac_common_surface_line_hash*) a)->hash;
+    uint64_t hash_b = ((const __guac_common_surface_line_hash*) b)->hash;
+
+    return (hash_a > hash_b) - (hash_a < hash_b);
+
+}
+
+/**
+ * Calculates the hash of each row and each column of the given rectangle
+ * within the given image data.
+ *
+ * @param data The image data to hash, having the same stride as the given
+ *             surface.
+ * @param surface The surface whose image data is being hashed.
+ * @param rect The rectangle to hash.
+ * @param rows An array of rect->height hashes which will receive the hash of
+ *             each row.
+ * @param columns An array of rect->width hashes which will receive the hash
+ *                of each column.
+ */
+static void __guac_common_surface_hash_lines(const unsigned char* data,
+        guac_common_surface* surface, const guac_common_rect* rect,
+        uint64_t* rows, uint64_t* columns) {
+
+    int x, y;
+
+    for (x = 0; x < rect->width; x++)
+        columns[x] = 0xCBF29CE484222325;
+
+    for (y = 0; y < rect->height; y++) {
+
+        const uint32_t* row = (const uint32_t*) (data
+                + (rect->y + y) * surface->stride + rect->x * 4);
+
+        uint64_t hash = 0xCBF29CE484222325;
+
+        for (x = 0; x < rect->width; x++) {
+            hash = __guac_common_surface_hash_pixel(hash, row[x]);
+            columns[x] = __guac_common_surface_hash_pixel(columns[x], row[x]);
+        }
+
+        rows[y] = hash;
+
+    }
+
+}
+
+/**
+ * Determines the offset by which lines (rows or columns) most likely moved
+ * between the previous and current contents of a rectangle, based on hashes
+ * of each line. Each changed line whose current contents match only a few
+ * lines of the previous contents votes for the offset to each match.
+ *
+ * @param current The hash of each line of the current contents.
+ * @param previous The hash of each line of the previous contents.
+ * @param length The number of lines.
+ * @param offset Pointer to an int which will receive the offset, such that
+ *               line i of the current contents most likely matches line
+ *               i + offset of the previous contents.
+ * @return The number of lines which voted for the offset returned.
+ */
+static int __guac_common_surface_find_offset(const uint64_t* current,
+        const uint64_t* previous, int length, int* offset) {
+
+    __guac_common_surface_line_hash* sorted;
+    int* votes;
+    int best = 0;
+    int i;
+
+    sorted = malloc(sizeof(__guac_common_surface_line_hash) * length);
+    votes = calloc(length * 2, sizeof(int));
+
+    /* Without room to count votes, no line votes for any offset */
+    if (sorted == NULL || votes == NULL) {
+        free(votes);
+        free(sorted);
+        return 0;
+    }
+
+    for (i = 0; i < length; i++) {
+        sorted[i].hash = previous[i];
+        sorted[i].index = i;
+    }
+
+    qsort(sorted, length, sizeof(__guac_common_surface_line_hash),
+            __guac_common_surface_line_hash_compare);
+
+    for (i = 0; i < length; i++) {
+
+        __guac_common_surface_line_hash key = { .hash = current[i] };
+        __guac_common_surface_line_hash* match;
+        __guac_common_surface_line_hash* first;
+        __guac_common_surface_line_hash* last;
+
+        /* Unchanged lines say nothing about motion */
+        if (current[i] == previous[i])
+            continue;
+
+        match = bsearch(&key, sorted, length,
+                sizeof(__guac_common_surface_line_hash),
+                __guac_common_surface_line_hash_compare);
+        if (match == NULL)
+            continue;
+
+        /* Find all matching lines */
+        first = last = match;
+        while (first > sorted && first[-1].hash == key.hash)
+            first--;
+        while (last < sorted + length - 1 && last[1].hash == key.hash)
+            last++;
+
+        /* Ignore lines which could have come from anywhere, like blank
+         * lines */
+        if (last - first >= GUAC_SURFACE_MOTION_MAX_MATCHES)
+            continue;
+
+        for (match = first; match <= last; match++) {
+            int vote = match->index - i + length;
+            if (++votes[vote] > best) {
+                best = votes[vote];
+                *offset = match->index - i;
+            }
+        }
+
+    }
+
+    free(votes);
+    free(sorted);
+
+    return best;
+
+}
+
+/**
+ * Returns whether the given row of the given rectangle of the surface
+ * currently contains exactly what the remote display contains within the
+ * given row of that same rectangle, and is entirely opaque.
+ *
+ * @param surface The surface to test, which must maintain a copy of the
+ *                remote display.
+ * @param rect The rectangle containing both rows.
+ * @param y The row of the current contents, relative to the rectangle.
+ * @param source_y The row of the remote display, relative to the rectangle.
+ * @return Non-zero if the rows match, zero otherwise.
+ */
+static int __guac_common_surface_row_moved(guac_common_surface* surface,
+        const guac_common_rect* rect, int y, int source_y) {
+
+    int offset = rect->x * 4;
+    const uint32_t* row = (const uint32_t*) (surface->buffer
+            + (rect->y + y) * surface->stride + offset);
+    const uint32_t* source = (const uint32_t*) (surface->shadow
+            + (rect->y + source_y) * surface->stride + offset);
+
+    uint32_t alpha = 0xFF000000;
+    int x;
+
+    for (x = 0; x < rect->width; x++) {
+        if (row[x] != source[x])
+            return 0;
+        alpha &= row[x];
+    }
+
+    return alpha == 0xFF000000;
+
+}
+
+/**
+ * Returns whether the given column of the given rectangle of the surface
+ * currently contains exactly what the remote display contains within the
+ * given column of that same rectangle, and is entirely opaque.
+ *
+ * @param surface The surface to test, which must maintain a copy of the
+ *                remote display.
+ * @param rect The rectangle containing both columns.
+ * @param x The column of the current contents, relative to the rectangle.
+ * @param source_x The column of the remote display, relative to the
+ *                 rectangle.
+ * @return Non-zero if the columns match, zero otherwise.
+ */
+static int __guac_common_surface_column_moved(guac_common_surface* surface,
+        const guac_common_rect* rect, int x, int source_x) {
+
+    uint32_t alpha = 0xFF000000;
+    int y;
+
+    for (y = 0; y < rect->height; y++) {
+
+        int offset = (rect->y + y) * surface->stride;
+        uint32_t value = ((uint32_t*) (surface->buffer + offset))[rect->x + x];
+
+        if (value != ((uint32_t*) (surface->shadow + offset))[rect->x + source_x])
+            return 0;
+
+        alpha &= value;
+
+    }
+
+    return alpha == 0xFF000000;
+
+}
+
+/**
+ * Searches the given rectangle of the given surface for content which the
+ * remote display already contains elsewhere within the same rectangle, as
+ * happens when scrolling or moving content, such that the content can be
+ * moved with a "copy" rather than sent again. Only moves along a single
+ * axis are detected.
+ *
+ * @param surface The surface to search, which must maintain a copy of the
+ *                remote display.
+ * @param rect The rectangle to search.
+ * @param moved The rectangle to populate with the destination of the moved
+ *              content, if found.
+ * @param sx Pointer to an int which will receive the X coordinate of the
+ *           source of the moved content within the remote display.
+ * @param sy Pointer to an int which will receive the Y coordinate of the
+ *           source of the moved content within the remote display.
+ * @return Non-zero if moved content was found, zero otherwise.
+ */
+static int __guac_common_surface_detect_motion(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_common_rect* moved,
+        int* sx, int* sy) {
+
+    uint64_t* current_rows = malloc(sizeof(uint64_t) * rect->height);
+    uint64_t* previous_rows = malloc(sizeof(uint64_t) * rect->height);
+    uint64_t* current_columns = malloc(sizeof(uint64_t) * rect->width);
+    uint64_t* previous_columns = malloc(sizeof(uint64_t) * rect->width);
+
+    int offset = 0;
+    int found = 0;
+    int start, length, i;
+
+    /* Without room to hash each line, no motion can be found */
+    if (current_rows == NULL || previous_rows == NULL
+            || current_columns == NULL || previous_columns == NULL) {
+        free(current_rows);
+        free(previous_rows);
+        free(current_columns);
+        free(previous_columns);
+        return 0;
+    }
+
+    __guac_common_surface_hash_lines(surface->buffer, surface, rect,
+            current_rows, current_columns);
+    __guac_common_surface_hash_lines(surface->shadow, surface, rect,
+            previous_rows, previous_columns);
+
+    /* Find longest run of rows which moved vertically */
+    if (__guac_common_surface_find_offset(current_rows, previous_rows,
+                rect->height, &offset) >= GUAC_SURFACE_MOTION_MIN_LENGTH) {
+
+        start = length = 0;
+        for (i = 0; i < rect->height; i++) {
+
+            int run_start = i;
+
+            while (i < rect->height && i + offset >= 0
+                    && i + offset < rect->height
+                    && __guac_common_surface_row_moved(surface, rect,
+                        i, i + offset))
+                i++;
+
+            if (i - run_start > length) {
+                start = run_start;
+                length = i - run_start;
+            }
+
+        }
+
+        if (length >= GUAC_SURFACE_MOTION_MIN_LENGTH) {
+            guac_common_rect_init(moved, rect->x, rect->y + start,
+                    rect->width, length);
+            *sx = rect->x;
+            *sy = rect->y + start + offset;
+            found = 1;
+        }
+
+    }
+
+    /* Otherwise, find longest run of columns which moved horizontally */
+    if (!found && __guac_common_surface_find_offset(current_columns,
+                previous_columns, rect->width, &offset)
+            >= GUAC_SURFACE_MOTION_MIN_LENGTH) {
+
+        start = length = 0;
+        for (i = 0; i < rect->width; i++) {
+
+            int run_start = i;
+
+            while (i < rect->width && i + offset >= 0
+                    && i + offset < rect->width
+                    && __guac_common_surface_column_moved(surface, rect,
+                        i, i + offset))
+                i++;
+
+            if (i - run_start > length) {
+                start = run_start;
+                length = i - run_start;
+            }
+
+        }
+
+        if (length >= GUAC_SURFACE_MOTION_MIN_LENGTH) {
+            guac_common_rect_init(moved, rect->x + start, rect->y,
+                    length, rect->height);
+            *sx = rect->x + start + offset;
+            *sy = rect->y;
+            found = 1;
+        }
+
+    }
+
+    free(current_rows);
+    free(previous_rows);
+    free(current_columns);
+    free(previous_columns);
+
+    return found;
+
+}
+
+/**
+ * Sends the given rectangle of the given surface, copying the image from the
+ * image cache of the surface if it was sent before, or adding an update to
+ * the given array of pending updates otherwise.
+ *
+ * @param surface The surface to flush.
+ * @param rect The rectangle to update.
+ * @param jobs The array of pending updates.
+ * @param job_count Pointer to the number of pending updates within the array,
+ *                  which will be incremented if an update is added.
+ */
+static void __guac_common_surface_flush_rect(guac_common_surface* surface,
+        const guac_common_rect* rect, __guac_common_surface_png_job* jobs,
+        int* job_count) {
+
+    cairo_surface_t* image;
+    const guac_layer* cached;
+    unsigned int hash;
+
+    /* Send image directly unless it may be cached */
+    if (surface->image_cache == NULL
+            || !guac_common_image_cache_accepts(surface->image_cache,
+                rect->width, rect->height)) {
+        __guac_common_surface_flush_to_png(surface, rect, jobs, job_count);
+        return;
+    }
+
+    image = __guac_common_surface_get_rect(surface, rect);
+    hash = guac_hash_surface(image);
+    cached = guac_common_image_cache_lookup(surface->image_cache, image,
+            hash);
+    cairo_surface_destroy(image);
+
+    /* Copy image from cache if already sent */
+    if (cached != NULL) {
+        guac_protocol_send_copy(surface->socket, cached, 0, 0,
+                rect->width, rect->height, GUAC_COMP_OVER,
+                surface->layer, rect->x, rect->y);
+        __guac_common_surface_sync_shadow(surface, rect);
+        surface->realized = 1;
+        surface->last_flush.cached_updates++;
+        return;
+    }
+
+    /* Otherwise send image, caching once sent */
+    __guac_common_surface_flush_to_png(surface, rect, jobs, job_count);
+    jobs[*job_count - 1].cacheable = 1;
+    jobs[*job_count - 1].hash = hash;
+
+}
+
+/**
+ * Sends the given rectangle of the given surface, moving any content which
+ * the remote display already contains elsewhere within the rectangle with a
+ * "copy", and sending the remainder with __guac_common_surface_flush_rect().
+ * Motion is only detected if enabled for the surface.
+ *
+ * @param surface The surface to flush.
+ * @param rect The rectangle to update.
+ * @param jobs The array of pending updates, which must have room for at
+ *             least two more updates.
+ * @param job_count Pointer to the number of pending updates within the array,
+ *                  which will be incremented as updates are added.
+ */
+static void __guac_common_surface_flush_motion(guac_common_surface* surface,
+        const guac_common_rect* rect, __guac_common_surface_png_job* jobs,
+        int* job_count) {
+
+    guac_common_rect moved, exposed;
+    int sx, sy;
+
+    /* Send normally if motion detection is impossible or not worthwhile */
+    if (surface->shadow == NULL
+            || rect->width < GUAC_SURFACE_MOTION_MIN_SIZE
+            || rect->height < GUAC_SURFACE_MOTION_MIN_SIZE) {
+        __guac_common_surface_flush_rect(surface, rect, jobs, job_count);
+        return;
+    }
+
+    surface->motion_stats.candidates++;
+
+    if (!__guac_common_surface_detect_motion(surface, rect, &moved,
+                &sx, &sy)) {
+        __guac_common_surface_flush_rect(surface, rect, jobs, job_count);
+        return;
+    }
+
+    /* Move content already present within remote display */
+    guac_protocol_send_copy(surface->socket, surface->layer, sx, sy,
+            moved.width, moved.height, GUAC_COMP_OVER, surface->layer,
+            moved.x, moved.y);
+    __guac_common_surface_sync_shadow(surface, &moved);
+
+    surface->motion_stats.hits++;
+    surface->motion_stats.pixels += moved.width * moved.height;
+    surface->last_flush.moved_updates++;
+    surface->last_flush.moved_pixels += moved.width * moved.height;
+
+    /* Send any exposed content before the moved content */
+    if (moved.y > rect->y) {
+        guac_common_rect_init(&exposed, rect->x, rect->y,
+                rect->width, moved.y - rect->y);
+        __guac_common_surface_flush_rect(surface, &exposed, jobs, job_count);
+    }
+    else if (moved.x > rect->x) {
+        guac_common_rect_init(&exposed, rect->x, rect->y,
+                moved.x - rect->x, rect->height);
+        __guac_common_surface_flush_rect(surface, &exposed, jobs, job_count);
+    }
+
+    /* Send any exposed content after the moved content */
+    if (moved.y + moved.height < rect->y + rect->height) {
+        guac_common_rect_init(&exposed, rect->x, moved.y + moved.height,
+                rect->width, rect->y + rect->height - moved.y - moved.height);
+        __guac_common_surface_flush_rect(surface, &exposed, jobs, job_count);
+    }
+    else if (moved.x + moved.width < rect->x + rect->width) {
+        guac_common_rect_init(&exposed, moved.x + moved.width, rect->y,
+                rect->x + rect->width - moved.x - moved.width, rect->height);
+        __guac_common_surface_flush_rect(surface, &exposed, jobs, job_count);
+    }
+
+}
+
+/**
+ * Sends the bounds of all damage to the given surface as a single update,
+ * as is done when the damage map of the surface, or the memory needed to
+ * plan a flush from that damage map, is unavailable.
+ *
+ * @param surface The surface to flush.
+ */
+static void __guac_common_surface_flush_bounds(guac_common_surface* surface) {
+
+    __guac_common_surface_png_job job;
+    int job_count = 0;
+
+    __guac_common_surface_flush_rect(surface, &surface->dirty_rect, &job,
+            &job_count);
+    __guac_common_surface_send_png(surface, &job, job_count);
+
+    /* Lossy updates leave the remote display with approximate contents */
+    if (job_count > 0 && job.lossy)
+        __guac_common_surface_invalidate_tiles(surface, &job.rect);
+
+}
+
+void guac_common_surface_flush(guac_common_surface* surface) {
+
+    guac_common_surface_flush_stats* stats = &surface->last_flush;
+    int tile_count = surface->tile_columns * surface->tile_rows;
+
+    guac_common_rect* rects;
+    __guac_common_surface_png_job* jobs;
+    int rect_count;
+    int job_count = 0;
+    int i;
+
+    /* Do not flush if not dirty */
+    if (!surface->dirty)
+        return;
+
+    memset(stats, 0, sizeof(guac_common_surface_flush_stats));
+
+    /* Combine updates as readily as the connection currently warrants */
+    surface->update_cost = __guac_common_surface_update_cost(surface);
+
+    /* Without a damage map, only the bounds of all damage are known */
+    if (surface->tiles == NULL) {
+        __guac_common_surface_flush_bounds(surface);
+        surface->dirty = 0;
+        return;
+    }
+
+    /* Skip tiles whose contents the remote display already contains */
+    for (i = 0; i < tile_count; i++) {
+
+        guac_common_surface_tile* tile = &surface->tiles[i];
+        guac_common_rect bounds;
+        uint64_t hash;
+
+        if (!__guac_common_surface_is_damaged(surface, i))
+            continue;
+
+        __guac_common_surface_tile_bounds(surface, i % surface->tile_columns,
+                i / surface->tile_columns, &bounds);
+        hash = __guac_common_surface_hash_rect(surface, &bounds);
+
+        stats->damaged_tiles++;
+
+        if (tile->hash_valid && tile->hash == hash) {
+            surface->damage[i / 64] &= ~((uint64_t) 1 << (i % 64));
+            stats->unchanged_tiles++;
+        }
+
+        /* Remote display will contain the current contents once flushed */
+        else {
+            tile->hash = hash;
+            tile->hash_valid = 1;
+        }
+
+    }
+
+    /* Cover remaining damage with as few updates as is reasonable */
+    jobs = NULL;
+    rects = malloc(sizeof(guac_common_rect) * tile_count);
+    if (rects != NULL) {
+
+        rect_count = __guac_common_surface_plan(surface, rects);
+
+        /* Each rectangle results in at most two updates */
+        jobs = malloc(sizeof(__guac_common_surface_png_job)
+                * (rect_count * 2 + 1));
+
+    }
+
+    /* Send a single update if no updates can be planned */
+    if (jobs == NULL)
+        __guac_common_surface_flush_bounds(surface);
+
+    else {
+
+        for (i = 0; i < rect_count; i++)
+            __guac_common_surface_flush_motion(surface, &rects[i], jobs,
+                    &job_count);
+
+        /* Encode and send all resulting updates */
+        __guac_common_surface_send_png(surface, jobs, job_count);
+
+        /* Lossy updates leave the remote display with approximate
+         * contents */
+        for (i = 0; i < job_count; i++) {
+            if (jobs[i].lossy)
+                __guac_common_surface_invalidate_tiles(surface,
+                        &jobs[i].rect);
+        }
+
+    }
+
+    free(jobs);
+    free(rects);
+
+    /* Flush complete */
+    memset(surface->damage, 0, sizeof(uint64_t) * (tile_count / 64 + 1));
+    surface->dirty = 0;
+
+}
+
+void guac_common_surface_set_motion_detection(guac_common_surface* surface,
+        int enabled) {
+
+    /* Disable motion detection, discarding copy of remote display */
+    if (!enabled) {
+        free(surface->shadow);
+        surface->shadow = NULL;
+        return;
+    }
+
+    if (surface->shadow != NULL)
+        return;
+
+    /* Remote display matches surface only once flushed */
+    guac_common_surface_flush(surface);
+
+    /* Motion detection remains disabled if no copy can be kept */
+    surface->shadow = malloc(surface->height * surface->stride);
+    if (surface->shadow != NULL)
+        memcpy(surface->shadow, surface->buffer,
+                surface->height * surface->stride);
+
+}
+
+
+void guac_common_surface_dup(guac_common_surface* surface,
+        guac_socket* socket) {
+
+    cairo_surface_t* image;
+
+    /* Buffers which do not yet exist on the client need not be sent */
+    if (!surface->realized)
+        return;
+
+    guac_protocol_send_size(socket, surface->layer,
+            surface->width, surface->height);
+
+    if (surface->width <= 0 || surface->height <= 0)
+        return;
+
+    /* Send entire contents, which may be more accurate than what the
+     * remote display of the original connection contains */
+    image = cairo_image_surface_create_for_data(surface->buffer,
+            CAIRO_FORMAT_RGB24, surface->width, surface->height,
+            surface->stride);
+
+    guac_protocol_send_png(socket, GUAC_COMP_OVER, surface->layer, 0, 0,
+            image);
+
+    cairo_surface_destroy(image);
+
+}
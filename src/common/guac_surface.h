@@ -24,35 +24,221 @@
 #define __GUAC_COMMON_SURFACE_H
 
 #include "config.h"
+#include "guac_image_cache.h"
 #include "guac_rect.h"
 
 #include <cairo/cairo.h>
+#include <guacamole/client.h>
 #include <guacamole/layer.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <stdint.h>
+
+/**
+ * The width and height of each tile of the damage map used to track which
+ * regions of a surface need to be flushed, in pixels.
+ */
+#define GUAC_COMMON_SURFACE_TILE_SIZE 32
+
+/**
+ * The width and height of each cell of the heat map used to track how
+ * frequently each region of a surface is updated, in pixels.
+ */
+#define GUAC_COMMON_SURFACE_HEAT_CELL_SIZE 64
+
+/**
+ * The number of update timestamps to remember for each cell of the heat map.
+ */
+#define GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE 5
 
 /**
- * The maximum number of updates to allow within the PNG queue.
+ * The number of recently-flushed rectangles for which the result of the color
+ * census performed during PNG encoding is remembered.
  */
-#define GUAC_COMMON_SURFACE_QUEUE_SIZE 256
+#define GUAC_COMMON_SURFACE_PALETTE_CACHE_SIZE 16
+
+/**
+ * A single tile of the damage map of a surface, covering
+ * GUAC_COMMON_SURFACE_TILE_SIZE square pixels.
+ */
+typedef struct guac_common_surface_tile {
+
+    /**
+     * The region of this tile which has been modified since the last flush,
+     * in surface coordinates. This is only meaningful if the bit
+     * corresponding to this tile is set within the damage bitmap of the
+     * surface.
+     */
+    guac_common_rect dirty_rect;
+
+    /**
+     * Hash of the entire contents of this tile as of the last flush which
+     * sent this tile losslessly. This is only meaningful if hash_valid is
+     * non-zero.
+     */
+    uint64_t hash;
+
+    /**
+     * Non-zero if the remote display is known to contain exactly the contents
+     * described by hash, zero otherwise. Tiles whose contents are later
+     * modified but which end up matching this hash at flush time need not be
+     * sent at all.
+     */
+    int hash_valid;
+
+} guac_common_surface_tile;
 
 /**
- * Representation of a PNG update, having a rectangle of image data (stored
- * elsewhere) and a flushed/not-flushed state.
+ * A single cell of the heat map of a surface, recording the times of the most
+ * recent updates to the region of the surface it covers.
  */
-typedef struct guac_common_surface_png_rect {
+typedef struct guac_common_surface_heat_cell {
 
     /**
-     * Whether this rectangle has been flushed.
+     * Circular buffer of the timestamps of the most recent updates to this
+     * cell. Entries which have never been set are zero.
      */
-    int flushed;
+    guac_timestamp history[GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE];
 
     /**
-     * The rectangle containing the PNG update.
+     * The index of the oldest entry within the history, which will be the
+     * next entry overwritten.
+     */
+    int oldest_entry;
+
+} guac_common_surface_heat_cell;
+
+/**
+ * The remembered result of the color census of a recently-flushed rectangle.
+ */
+typedef struct guac_common_surface_palette_cache_entry {
+
+    /**
+     * The rectangle which was flushed. Entries having a width of zero are
+     * unused.
      */
     guac_common_rect rect;
 
-} guac_common_surface_png_rect;
+    /**
+     * The result of the most recent census of the rectangle.
+     */
+    guac_palette_hint hint;
+
+    /**
+     * The number of times the result has been reused without a new census.
+     */
+    int reuses;
+
+} guac_common_surface_palette_cache_entry;
+
+/**
+ * Statistics describing a single flush of a surface.
+ */
+typedef struct guac_common_surface_flush_stats {
+
+    /**
+     * The number of updates sent, including lossy updates.
+     */
+    int updates;
+
+    /**
+     * The number of updates sent using lossy (JPEG) compression.
+     */
+    int lossy_updates;
+
+    /**
+     * The number of PNG updates which were encoded while being streamed to
+     * the client, rather than encoded beforehand.
+     */
+    int streamed_updates;
+
+    /**
+     * The number of PNG updates which reused a remembered color census rather
+     * than counting colors again.
+     */
+    int palette_cache_hits;
+
+    /**
+     * The number of damaged tiles inspected.
+     */
+    int damaged_tiles;
+
+    /**
+     * The number of damaged tiles which were not sent, as their contents
+     * matched what the remote display already contains.
+     */
+    int unchanged_tiles;
+
+    /**
+     * The number of updates sent as a "copy" from an image previously sent
+     * and retained within the image cache, rather than as a new image. These
+     * are not included within the number of updates sent.
+     */
+    int cached_updates;
+
+    /**
+     * The number of updates sent as a "copy" of content which the remote
+     * display already contained elsewhere, as detected by motion detection.
+     * These are not included within the number of updates sent.
+     */
+    int moved_updates;
+
+    /**
+     * The total number of pixels moved by all updates sent as a result of
+     * motion detection.
+     */
+    int moved_pixels;
+
+    /**
+     * The total number of pixels within all PNG updates sent.
+     */
+    int pixels;
+
+    /**
+     * The total number of bytes of encoded image data sent, prior to base64
+     * encoding, excluding streamed updates.
+     */
+    int bytes;
+
+    /**
+     * The wall-clock time spent encoding all updates which were not streamed,
+     * in microseconds.
+     */
+    int encode_time;
+
+    /**
+     * The wall-clock time spent writing all updates to the socket, including
+     * the time spent encoding streamed updates, in microseconds.
+     */
+    int send_time;
+
+} guac_common_surface_flush_stats;
+
+/**
+ * Statistics describing the effectiveness of motion detection over the
+ * lifetime of a surface.
+ */
+typedef struct guac_common_surface_motion_stats {
+
+    /**
+     * The number of updates large enough for motion detection to be
+     * attempted.
+     */
+    int candidates;
+
+    /**
+     * The number of updates within which moved content was found.
+     */
+    int hits;
+
+    /**
+     * The total number of pixels moved rather than sent.
+     */
+    int64_t pixels;
+
+} guac_common_surface_motion_stats;
 
 /**
  * Surface which backs a Guacamole buffer or layer, automatically
@@ -60,6 +246,12 @@ typedef struct guac_common_surface_png_rect {
  */
 typedef struct guac_common_surface {
 
+    /**
+     * The client associated with this surface, used to allocate streams and
+     * to determine which image formats are supported.
+     */
+    guac_client* client;
+
     /**
      * The layer this surface will draw to.
      */
@@ -96,10 +288,34 @@ typedef struct guac_common_surface {
     int dirty;
 
     /**
-     * The dirty rectangle.
+     * The bounds of all damage since the last flush. The surface is flushed
+     * as a single update covering these bounds if the damage map, or the
+     * memory needed to plan a flush from the damage map, is unavailable.
      */
     guac_common_rect dirty_rect;
 
+    /**
+     * The number of columns of tiles within the damage map.
+     */
+    int tile_columns;
+
+    /**
+     * The number of rows of tiles within the damage map.
+     */
+    int tile_rows;
+
+    /**
+     * The tiles of the damage map, row-major, or NULL if the damage map could
+     * not be allocated, in which case damage is tracked only by dirty_rect.
+     */
+    guac_common_surface_tile* tiles;
+
+    /**
+     * Bitmap of tiles which have been modified since the last flush, one bit
+     * per tile in the same order as the tiles themselves.
+     */
+    uint64_t* damage;
+
     /**
      * Whether the surface actually exists on the client.
      */
@@ -117,27 +333,84 @@ typedef struct guac_common_surface {
     guac_common_rect clip_rect;
 
     /**
-     * The number of updates in the PNG queue.
+     * Statistics describing the most recent flush of this surface which had
+     * any damage to flush.
+     */
+    guac_common_surface_flush_stats last_flush;
+
+    /**
+     * The JPEG quality to use for updates which are deemed photographic and
+     * frequently-changing, from 1 to 100. If zero, all updates are lossless.
+     * Lossy updates are only sent if the client supports "image/jpeg".
+     */
+    int lossy_quality;
+
+    /**
+     * The estimated cost of each update, regardless of its size, relative
+     * to the cost of each pixel sent. This determines how readily updates
+     * are combined, and is recalculated with each flush from the frame
+     * duration of the connection.
      */
-    int png_queue_length;
+    int update_cost;
 
     /**
-     * All queued PNG updates.
+     * The cache of images previously sent to the client, used to avoid
+     * sending the same image again, or NULL if images should not be cached.
+     * The cache may be shared by several surfaces of the same client, and is
+     * not freed with the surface.
      */
-    guac_common_surface_png_rect png_queue[GUAC_COMMON_SURFACE_QUEUE_SIZE];
+    guac_common_image_cache* image_cache;
+
+    /**
+     * A copy of the contents of the remote display, having the same stride
+     * as the buffer of this surface, which is used to detect content which
+     * has moved since being sent, such as when scrolling. This is NULL
+     * unless motion detection has been enabled with
+     * guac_common_surface_set_motion_detection().
+     */
+    unsigned char* shadow;
+
+    /**
+     * Statistics describing the effectiveness of motion detection for this
+     * surface.
+     */
+    guac_common_surface_motion_stats motion_stats;
+
+    /**
+     * Heat map of update frequency, one cell per
+     * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE square pixels, row-major.
+     */
+    guac_common_surface_heat_cell* heat_map;
+
+    /**
+     * The results of the color census of recently-flushed rectangles, allowing
+     * rectangles which are flushed repeatedly and which have too many colors
+     * for a palette to skip the census.
+     */
+    guac_common_surface_palette_cache_entry palette_cache[GUAC_COMMON_SURFACE_PALETTE_CACHE_SIZE];
+
+    /**
+     * The index of the palette cache entry which will be replaced next.
+     */
+    int palette_cache_next;
 
 } guac_common_surface;
 
 /**
  * Allocates a new guac_common_surface, assigning it to the given layer.
  *
+ * @param client The client associated with the new surface, or NULL if the
+ *               surface is not associated with any client. Surfaces without
+ *               a client are flushed using the default frame duration and
+ *               PNG compression, and only as lossless "png" instructions.
  * @param socket The socket to send instructions on when flushing.
  * @param layer The layer to associate with the new surface.
  * @param w The width of the surface.
  * @param h The height of the surface.
  * @return A newly-allocated guac_common_surface.
  */
-guac_common_surface* guac_common_surface_alloc(guac_socket* socket, const guac_layer* layer, int w, int h);
+guac_common_surface* guac_common_surface_alloc(guac_client* client, guac_socket* socket,
+        const guac_layer* layer, int w, int h);
 
 /**
  * Frees the given guac_common_surface. Beware that this will NOT free any
@@ -166,6 +439,27 @@ void guac_common_surface_resize(guac_common_surface* surface, int w, int h);
  */
 void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_surface_t* src);
 
+/**
+ * Draws the given image data to the given guac_common_surface. The data is
+ * copied directly from the given buffer, which must contain 32-bit pixels in
+ * the same format as a Cairo image surface, allowing a rectangle within a
+ * larger image to be drawn without first copying that rectangle into an
+ * image surface of its own.
+ *
+ * @param surface The surface to draw to.
+ * @param x The X coordinate of the draw location.
+ * @param y The Y coordinate of the draw location.
+ * @param w The width of the image data, in pixels.
+ * @param h The height of the image data, in pixels.
+ * @param buffer The first pixel of the upper-left corner of the image data.
+ * @param stride The number of bytes in each row of the image data.
+ * @param opaque Non-zero if the image data is opaque (its alpha channel
+ *               should be ignored), zero otherwise.
+ */
+void guac_common_surface_draw_buffer(guac_common_surface* surface,
+        int x, int y, int w, int h, unsigned char* buffer, int stride,
+        int opaque);
+
 /**
  * Paints to the given guac_common_surface using the given data as a stencil,
  * filling opaque regions with the specified color, and leaving transparent
@@ -197,6 +491,26 @@ void guac_common_surface_paint(guac_common_surface* surface, int x, int y, cairo
 void guac_common_surface_copy(guac_common_surface* src, int sx, int sy, int w, int h,
                               guac_common_surface* dst, int dx, int dy);
 
+/**
+ * Copies a rectangle of data between two different surfaces, always sending
+ * the changed portion of the rectangle as a "copy" instruction, without
+ * first flushing the destination surface, rather than possibly combining
+ * the update with other pending updates to be sent as an image. This allows
+ * content which the client already has, such as rendered glyphs retained
+ * within an offscreen buffer, to be reused no matter what else is pending.
+ *
+ * @param src The source surface, which must not be the destination surface.
+ * @param sx The X coordinate of the upper-left corner of the source rect.
+ * @param sy The Y coordinate of the upper-left corner of the source rect.
+ * @param w The width of the source rect.
+ * @param h The height of the source rect.
+ * @param dst The destination surface.
+ * @param dx The X coordinate of the upper-left corner of the destination rect.
+ * @param dy The Y coordinate of the upper-left corner of the destination rect.
+ */
+void guac_common_surface_copy_immediate(guac_common_surface* src,
+        int sx, int sy, int w, int h, guac_common_surface* dst, int dx, int dy);
+
 /**
  * Transfers a rectangle of data between two surfaces.
  *
@@ -251,21 +565,40 @@ void guac_common_surface_reset_clip(guac_common_surface* surface);
 
 /**
  * Flushes the given surface, drawing any pending operations on the remote
- * display.
+ * display. The damaged tiles of the surface are covered with as few
+ * rectangles as is reasonable, skipping any tiles whose contents the remote
+ * display already contains, and each rectangle is sent as an image.
  *
  * @param surface The surface to flush.
  */
 void guac_common_surface_flush(guac_common_surface* surface);
 
 /**
- * Schedules a deferred flush of the given surface. This will not immediately
- * flush the surface to the client. Instead, the result of the flush is
- * added to a queue which is reinspected and combined (if possible) with other
- * deferred flushes during the call to guac_common_surface_flush().
+ * Enables or disables motion detection for the given surface. While enabled,
+ * the surface retains a copy of the contents of the remote display, and
+ * content which has moved since it was sent, such as when scrolling, is
+ * moved with a "copy" rather than sent again as an image. Any pending
+ * operations are flushed before motion detection is enabled.
  *
- * @param surface The surface to flush.
+ * @param surface The surface to enable or disable motion detection for.
+ * @param enabled Non-zero if motion detection should be enabled, zero if it
+ *                should be disabled.
+ */
+void guac_common_surface_set_motion_detection(guac_common_surface* surface,
+        int enabled);
+
+/**
+ * Sends the complete current contents of the given surface over the given
+ * socket, creating the layer or buffer of the surface if necessary, such
+ * that a remote display which has not received any prior updates of the
+ * surface matches the surface. Nothing is sent for buffers which do not yet
+ * exist on the remote display.
+ *
+ * @param surface The surface to send.
+ * @param socket The socket to send the surface over.
  */
-void guac_common_surface_flush_deferred(guac_common_surface* surface);
+void guac_common_surface_dup(guac_common_surface* surface,
+        guac_socket* socket);
 
 #endif
 
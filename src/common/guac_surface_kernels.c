@@ -0,0 +1,758 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+#include "guac_surface_kernels.h"
+
+#include <guacamole/protocol-types.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * Stores the given range of changed columns, if any columns changed.
+ *
+ * @param changed_first The first changed column, or -1 if no columns changed.
+ * @param changed_last The last changed column.
+ * @param first Pointer to an int which will receive the first changed column.
+ * @param last Pointer to an int which will receive the last changed column.
+ * @return Non-zero if any columns changed, zero otherwise.
+ */
+static int __guac_common_surface_report_range(int changed_first,
+        int changed_last, int* first, int* last) {
+
+    if (changed_first < 0)
+        return 0;
+
+    *first = changed_first;
+    *last = changed_last;
+    return 1;
+
+}
+
+/**
+ * Merges the columns changed by a kernel processing the remainder of a row
+ * into the given range.
+ *
+ * @param offset The column at which the kernel processing the remainder of
+ *               the row began.
+ * @param tail_first The first column changed by that kernel, relative to the
+ *                   given offset.
+ * @param tail_last The last column changed by that kernel, relative to the
+ *                  given offset.
+ * @param changed_first Pointer to the first changed column of the row so far,
+ *                      or -1 if no columns have yet changed.
+ * @param changed_last Pointer to the last changed column of the row so far.
+ */
+static void __guac_common_surface_merge_range(int offset, int tail_first,
+        int tail_last, int* changed_first, int* changed_last) {
+
+    if (*changed_first < 0)
+        *changed_first = offset + tail_first;
+
+    *changed_last = offset + tail_last;
+
+}
+
+/**
+ * Generic implementation of guac_common_surface_put_kernel.
+ */
+static int __guac_common_surface_put_generic(const uint32_t* src,
+        uint32_t* dst, int width, uint32_t or_bits, int* first, int* last) {
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        uint32_t value = src[x] | or_bits;
+
+        if (dst[x] != value) {
+            if (changed_first < 0)
+                changed_first = x;
+            changed_last = x;
+            dst[x] = value;
+        }
+
+    }
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * Generic implementation of guac_common_surface_mask_kernel.
+ */
+static int __guac_common_surface_mask_generic(const uint32_t* src,
+        uint32_t* dst, int width, uint32_t and_bits, uint32_t or_bits,
+        int* first, int* last) {
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        uint32_t value;
+
+        /* Skip fully-transparent source pixels */
+        if (!(src[x] & 0xFF000000))
+            continue;
+
+        value = (src[x] & and_bits) | or_bits;
+
+        if (dst[x] != value) {
+            if (changed_first < 0)
+                changed_first = x;
+            changed_last = x;
+            dst[x] = value;
+        }
+
+    }
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * Generic implementation of guac_common_surface_fill_kernel.
+ */
+static int __guac_common_surface_fill_generic(uint32_t* dst, int width,
+        uint32_t color, int* first, int* last) {
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        if (dst[x] != color) {
+            if (changed_first < 0)
+                changed_first = x;
+            changed_last = x;
+            dst[x] = color;
+        }
+
+    }
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * Defines a generic transfer kernel named
+ * __guac_common_surface_transfer_NAME_generic(), which replaces each
+ * destination pixel "d" with the value of the given expression. The
+ * expression may refer to the destination pixel "d" and its corresponding
+ * source pixel "s".
+ */
+#define GUAC_COMMON_SURFACE_TRANSFER_GENERIC(name, expression)                \
+    static int __guac_common_surface_transfer_##name##_generic(               \
+            const uint32_t* src, uint32_t* dst, int width,                    \
+            int* first, int* last) {                                          \
+                                                                              \
+        int changed_first = -1;                                               \
+        int changed_last = -1;                                                \
+        int x;                                                                \
+                                                                              \
+        for (x = 0; x < width; x++) {                                         \
+                                                                              \
+            uint32_t s __attribute__((unused)) = src[x];                      \
+            uint32_t d = dst[x];                                              \
+            uint32_t value = (expression);                                    \
+                                                                              \
+            if (d != value) {                                                 \
+                if (changed_first < 0)                                        \
+                    changed_first = x;                                        \
+                changed_last = x;                                             \
+                dst[x] = value;                                               \
+            }                                                                 \
+                                                                              \
+        }                                                                     \
+                                                                              \
+        return __guac_common_surface_report_range(changed_first,              \
+                changed_last, first, last);                                   \
+                                                                              \
+    }
+
+/**
+ * Defines a transfer kernel named __guac_common_surface_transfer_NAME_ISA()
+ * for a transfer function which produces a constant color, implemented as a
+ * fill using __guac_common_surface_fill_ISA(). The source is never read.
+ */
+#define GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(name, isa, color)               \
+    static int __guac_common_surface_transfer_##name##_##isa(                 \
+            const uint32_t* src, uint32_t* dst, int width,                    \
+            int* first, int* last) {                                          \
+        return __guac_common_surface_fill_##isa(dst, width, color,            \
+                first, last);                                                 \
+    }
+
+/**
+ * Initializes a transfer kernel table using the kernels defined for the
+ * given instruction set by GUAC_COMMON_SURFACE_TRANSFER_GENERIC() (or its
+ * vectorized equivalents) and GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(). DEST
+ * has no kernel, as it never changes the destination.
+ */
+#define GUAC_COMMON_SURFACE_TRANSFER_TABLE(isa) {                              \
+    [GUAC_TRANSFER_BINARY_BLACK]     = __guac_common_surface_transfer_black_##isa,     \
+    [GUAC_TRANSFER_BINARY_WHITE]     = __guac_common_surface_transfer_white_##isa,     \
+    [GUAC_TRANSFER_BINARY_SRC]       = __guac_common_surface_transfer_src_##isa,       \
+    [GUAC_TRANSFER_BINARY_DEST]      = NULL,                                           \
+    [GUAC_TRANSFER_BINARY_NSRC]      = __guac_common_surface_transfer_nsrc_##isa,      \
+    [GUAC_TRANSFER_BINARY_NDEST]     = __guac_common_surface_transfer_ndest_##isa,     \
+    [GUAC_TRANSFER_BINARY_AND]       = __guac_common_surface_transfer_and_##isa,       \
+    [GUAC_TRANSFER_BINARY_NAND]      = __guac_common_surface_transfer_nand_##isa,      \
+    [GUAC_TRANSFER_BINARY_OR]        = __guac_common_surface_transfer_or_##isa,        \
+    [GUAC_TRANSFER_BINARY_NOR]       = __guac_common_surface_transfer_nor_##isa,       \
+    [GUAC_TRANSFER_BINARY_XOR]       = __guac_common_surface_transfer_xor_##isa,       \
+    [GUAC_TRANSFER_BINARY_XNOR]      = __guac_common_surface_transfer_xnor_##isa,      \
+    [GUAC_TRANSFER_BINARY_NSRC_AND]  = __guac_common_surface_transfer_nsrc_and_##isa,  \
+    [GUAC_TRANSFER_BINARY_NSRC_NAND] = __guac_common_surface_transfer_nsrc_nand_##isa, \
+    [GUAC_TRANSFER_BINARY_NSRC_OR]   = __guac_common_surface_transfer_nsrc_or_##isa,   \
+    [GUAC_TRANSFER_BINARY_NSRC_NOR]  = __guac_common_surface_transfer_nsrc_nor_##isa   \
+}
+
+GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(black, generic, 0xFF000000)
+GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(white, generic, 0xFFFFFFFF)
+
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(src,       s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nsrc,      ~s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(ndest,     ~d)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(and,       d & s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nand,      ~(d & s))
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(or,        d | s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nor,       ~(d | s))
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(xor,       d ^ s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(xnor,      ~(d ^ s))
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nsrc_and,  d & ~s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nsrc_nand, ~(d & ~s))
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nsrc_or,   d | ~s)
+GUAC_COMMON_SURFACE_TRANSFER_GENERIC(nsrc_nor,  ~(d | ~s))
+
+const guac_common_surface_kernels guac_common_surface_kernels_generic = {
+    .name = "generic",
+    .put  = __guac_common_surface_put_generic,
+    .mask = __guac_common_surface_mask_generic,
+    .fill = __guac_common_surface_fill_generic,
+    .transfer = GUAC_COMMON_SURFACE_TRANSFER_TABLE(generic)
+};
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Adds the pixels flagged within the given byte mask, as produced by
+ * _mm_movemask_epi8() or _mm256_movemask_epi8() over a per-pixel comparison,
+ * to the given range of changed columns.
+ *
+ * @param x The column of the first pixel covered by the mask.
+ * @param changed A byte mask having four bits set for each changed pixel.
+ * @param changed_first Pointer to the first changed column of the row so far,
+ *                      or -1 if no columns have yet changed.
+ * @param changed_last Pointer to the last changed column of the row so far.
+ */
+static void __guac_common_surface_track_block(int x, unsigned int changed,
+        int* changed_first, int* changed_last) {
+
+    if (*changed_first < 0)
+        *changed_first = x + __builtin_ctz(changed) / 4;
+
+    *changed_last = x + (31 - __builtin_clz(changed)) / 4;
+
+}
+
+/**
+ * SSE2 implementation of guac_common_surface_put_kernel, comparing four
+ * pixels at a time.
+ */
+__attribute__((target("sse2")))
+static int __guac_common_surface_put_sse2(const uint32_t* src,
+        uint32_t* dst, int width, uint32_t or_bits, int* first, int* last) {
+
+    const __m128i bits = _mm_set1_epi32(or_bits);
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i value = _mm_or_si128(
+                _mm_loadu_si128((const __m128i*) (src + x)), bits);
+        __m128i current = _mm_loadu_si128((const __m128i*) (dst + x));
+
+        unsigned int changed = ~_mm_movemask_epi8(
+                _mm_cmpeq_epi32(value, current)) & 0xFFFF;
+
+        if (changed) {
+            __guac_common_surface_track_block(x, changed,
+                    &changed_first, &changed_last);
+            _mm_storeu_si128((__m128i*) (dst + x), value);
+        }
+
+    }
+
+    if (__guac_common_surface_put_generic(src + x, dst + x, width - x,
+                or_bits, &tail_first, &tail_last))
+        __guac_common_surface_merge_range(x, tail_first, tail_last,
+                &changed_first, &changed_last);
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * SSE2 implementation of guac_common_surface_mask_kernel, blending four
+ * pixels at a time.
+ */
+__attribute__((target("sse2")))
+static int __guac_common_surface_mask_sse2(const uint32_t* src,
+        uint32_t* dst, int width, uint32_t and_bits, uint32_t or_bits,
+        int* first, int* last) {
+
+    const __m128i alpha = _mm_set1_epi32(0xFF000000);
+    const __m128i preserved = _mm_set1_epi32(and_bits);
+    const __m128i bits = _mm_set1_epi32(or_bits);
+    const __m128i zero = _mm_setzero_si128();
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i source = _mm_loadu_si128((const __m128i*) (src + x));
+        __m128i current = _mm_loadu_si128((const __m128i*) (dst + x));
+
+        /* Keep current pixels wherever the source is fully transparent */
+        __m128i transparent = _mm_cmpeq_epi32(
+                _mm_and_si128(source, alpha), zero);
+        __m128i value = _mm_or_si128(
+                _mm_and_si128(transparent, current),
+                _mm_andnot_si128(transparent, _mm_or_si128(
+                        _mm_and_si128(source, preserved), bits)));
+
+        unsigned int changed = ~_mm_movemask_epi8(
+                _mm_cmpeq_epi32(value, current)) & 0xFFFF;
+
+        if (changed) {
+            __guac_common_surface_track_block(x, changed,
+                    &changed_first, &changed_last);
+            _mm_storeu_si128((__m128i*) (dst + x), value);
+        }
+
+    }
+
+    if (__guac_common_surface_mask_generic(src + x, dst + x, width - x,
+                and_bits, or_bits, &tail_first, &tail_last))
+        __guac_common_surface_merge_range(x, tail_first, tail_last,
+                &changed_first, &changed_last);
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * SSE2 implementation of guac_common_surface_fill_kernel, comparing four
+ * pixels at a time.
+ */
+__attribute__((target("sse2")))
+static int __guac_common_surface_fill_sse2(uint32_t* dst, int width,
+        uint32_t color, int* first, int* last) {
+
+    const __m128i value = _mm_set1_epi32(color);
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i current = _mm_loadu_si128((const __m128i*) (dst + x));
+
+        unsigned int changed = ~_mm_movemask_epi8(
+                _mm_cmpeq_epi32(value, current)) & 0xFFFF;
+
+        if (changed) {
+            __guac_common_surface_track_block(x, changed,
+                    &changed_first, &changed_last);
+            _mm_storeu_si128((__m128i*) (dst + x), value);
+        }
+
+    }
+
+    if (__guac_common_surface_fill_generic(dst + x, width - x, color,
+                &tail_first, &tail_last))
+        __guac_common_surface_merge_range(x, tail_first, tail_last,
+                &changed_first, &changed_last);
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * AVX2 implementation of guac_common_surface_put_kernel, comparing eight
+ * pixels at a time.
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_put_avx2(const uint32_t* src,
+        uint32_t* dst, int width, uint32_t or_bits, int* first, int* last) {
+
+    const __m256i bits = _mm256_set1_epi32(or_bits);
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i value = _mm256_or_si256(
+                _mm256_loadu_si256((const __m256i*) (src + x)), bits);
+        __m256i current = _mm256_loadu_si256((const __m256i*) (dst + x));
+
+        unsigned int changed = ~(unsigned int) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi32(value, current));
+
+        if (changed) {
+            __guac_common_surface_track_block(x, changed,
+                    &changed_first, &changed_last);
+            _mm256_storeu_si256((__m256i*) (dst + x), value);
+        }
+
+    }
+
+    if (__guac_common_surface_put_sse2(src + x, dst + x, width - x,
+                or_bits, &tail_first, &tail_last))
+        __guac_common_surface_merge_range(x, tail_first, tail_last,
+                &changed_first, &changed_last);
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * AVX2 implementation of guac_common_surface_mask_kernel, blending eight
+ * pixels at a time.
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_mask_avx2(const uint32_t* src,
+        uint32_t* dst, int width, uint32_t and_bits, uint32_t or_bits,
+        int* first, int* last) {
+
+    const __m256i alpha = _mm256_set1_epi32(0xFF000000);
+    const __m256i preserved = _mm256_set1_epi32(and_bits);
+    const __m256i bits = _mm256_set1_epi32(or_bits);
+    const __m256i zero = _mm256_setzero_si256();
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i source = _mm256_loadu_si256((const __m256i*) (src + x));
+        __m256i current = _mm256_loadu_si256((const __m256i*) (dst + x));
+
+        /* Keep current pixels wherever the source is fully transparent */
+        __m256i transparent = _mm256_cmpeq_epi32(
+                _mm256_and_si256(source, alpha), zero);
+        __m256i value = _mm256_blendv_epi8(
+                _mm256_or_si256(_mm256_and_si256(source, preserved), bits),
+                current, transparent);
+
+        unsigned int changed = ~(unsigned int) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi32(value, current));
+
+        if (changed) {
+            __guac_common_surface_track_block(x, changed,
+                    &changed_first, &changed_last);
+            _mm256_storeu_si256((__m256i*) (dst + x), value);
+        }
+
+    }
+
+    if (__guac_common_surface_mask_sse2(src + x, dst + x, width - x,
+                and_bits, or_bits, &tail_first, &tail_last))
+        __guac_common_surface_merge_range(x, tail_first, tail_last,
+                &changed_first, &changed_last);
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * AVX2 implementation of guac_common_surface_fill_kernel, comparing eight
+ * pixels at a time.
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_fill_avx2(uint32_t* dst, int width,
+        uint32_t color, int* first, int* last) {
+
+    const __m256i value = _mm256_set1_epi32(color);
+
+    int changed_first = -1;
+    int changed_last = -1;
+    int tail_first, tail_last;
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i current = _mm256_loadu_si256((const __m256i*) (dst + x));
+
+        unsigned int changed = ~(unsigned int) _mm256_movemask_epi8(
+                _mm256_cmpeq_epi32(value, current));
+
+        if (changed) {
+            __guac_common_surface_track_block(x, changed,
+                    &changed_first, &changed_last);
+            _mm256_storeu_si256((__m256i*) (dst + x), value);
+        }
+
+    }
+
+    if (__guac_common_surface_fill_sse2(dst + x, width - x, color,
+                &tail_first, &tail_last))
+        __guac_common_surface_merge_range(x, tail_first, tail_last,
+                &changed_first, &changed_last);
+
+    return __guac_common_surface_report_range(changed_first, changed_last,
+            first, last);
+
+}
+
+/**
+ * Returns the bitwise complement of the given SSE2 vector.
+ */
+#define GUAC_COMMON_SURFACE_NOT_SSE2(v) _mm_xor_si128((v), _mm_set1_epi32(-1))
+
+/**
+ * Defines an SSE2 transfer kernel named
+ * __guac_common_surface_transfer_NAME_sse2(), equivalent to the generic
+ * kernel defined by GUAC_COMMON_SURFACE_TRANSFER_GENERIC(), but transferring
+ * four pixels at a time. The expression may refer to the vectors "d" and "s"
+ * of destination and source pixels respectively.
+ */
+#define GUAC_COMMON_SURFACE_TRANSFER_SSE2(name, expression)                   \
+    __attribute__((target("sse2")))                                           \
+    static int __guac_common_surface_transfer_##name##_sse2(                  \
+            const uint32_t* src, uint32_t* dst, int width,                    \
+            int* first, int* last) {                                          \
+                                                                              \
+        int changed_first = -1;                                               \
+        int changed_last = -1;                                                \
+        int tail_first, tail_last;                                            \
+        int x;                                                                \
+                                                                              \
+        for (x = 0; x + 4 <= width; x += 4) {                                 \
+                                                                              \
+            __m128i s __attribute__((unused)) =                               \
+                _mm_loadu_si128((const __m128i*) (src + x));                  \
+            __m128i d = _mm_loadu_si128((const __m128i*) (dst + x));          \
+            __m128i value = (expression);                                     \
+                                                                              \
+            unsigned int changed = ~_mm_movemask_epi8(                        \
+                    _mm_cmpeq_epi32(value, d)) & 0xFFFF;                      \
+                                                                              \
+            if (changed) {                                                    \
+                __guac_common_surface_track_block(x, changed,                 \
+                        &changed_first, &changed_last);                       \
+                _mm_storeu_si128((__m128i*) (dst + x), value);                \
+            }                                                                 \
+                                                                              \
+        }                                                                     \
+                                                                              \
+        if (__guac_common_surface_transfer_##name##_generic(src + x, dst + x, \
+                    width - x, &tail_first, &tail_last))                      \
+            __guac_common_surface_merge_range(x, tail_first, tail_last,       \
+                    &changed_first, &changed_last);                           \
+                                                                              \
+        return __guac_common_surface_report_range(changed_first,              \
+                changed_last, first, last);                                   \
+                                                                              \
+    }
+
+/**
+ * Returns the bitwise complement of the given AVX2 vector.
+ */
+#define GUAC_COMMON_SURFACE_NOT_AVX2(v)                                       \
+    _mm256_xor_si256((v), _mm256_set1_epi32(-1))
+
+/**
+ * Defines an AVX2 transfer kernel named
+ * __guac_common_surface_transfer_NAME_avx2(), equivalent to the SSE2 kernel
+ * defined by GUAC_COMMON_SURFACE_TRANSFER_SSE2(), but transferring eight
+ * pixels at a time.
+ */
+#define GUAC_COMMON_SURFACE_TRANSFER_AVX2(name, expression)                   \
+    __attribute__((target("avx2")))                                           \
+    static int __guac_common_surface_transfer_##name##_avx2(                  \
+            const uint32_t* src, uint32_t* dst, int width,                    \
+            int* first, int* last) {                                          \
+                                                                              \
+        int changed_first = -1;                                               \
+        int changed_last = -1;                                                \
+        int tail_first, tail_last;                                            \
+        int x;                                                                \
+                                                                              \
+        for (x = 0; x + 8 <= width; x += 8) {                                 \
+                                                                              \
+            __m256i s __attribute__((unused)) =                               \
+                _mm256_loadu_si256((const __m256i*) (src + x));               \
+            __m256i d = _mm256_loadu_si256((const __m256i*) (dst + x));       \
+            __m256i value = (expression);                                     \
+                                                                              \
+            unsigned int changed = ~(unsigned int) _mm256_movemask_epi8(      \
+                    _mm256_cmpeq_epi32(value, d));                            \
+                                                                              \
+            if (changed) {                                                    \
+                __guac_common_surface_track_block(x, changed,                 \
+                        &changed_first, &changed_last);                       \
+                _mm256_storeu_si256((__m256i*) (dst + x), value);             \
+            }                                                                 \
+                                                                              \
+        }                                                                     \
+                                                                              \
+        if (__guac_common_surface_transfer_##name##_sse2(src + x, dst + x,    \
+                    width - x, &tail_first, &tail_last))                      \
+            __guac_common_surface_merge_range(x, tail_first, tail_last,       \
+                    &changed_first, &changed_last);                           \
+                                                                              \
+        return __guac_common_surface_report_range(changed_first,              \
+                changed_last, first, last);                                   \
+                                                                              \
+    }
+
+GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(black, sse2, 0xFF000000)
+GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(white, sse2, 0xFFFFFFFF)
+
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(src,       s)
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nsrc,      GUAC_COMMON_SURFACE_NOT_SSE2(s))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(ndest,     GUAC_COMMON_SURFACE_NOT_SSE2(d))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(and,       _mm_and_si128(d, s))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nand,      GUAC_COMMON_SURFACE_NOT_SSE2(_mm_and_si128(d, s)))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(or,        _mm_or_si128(d, s))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nor,       GUAC_COMMON_SURFACE_NOT_SSE2(_mm_or_si128(d, s)))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(xor,       _mm_xor_si128(d, s))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(xnor,      GUAC_COMMON_SURFACE_NOT_SSE2(_mm_xor_si128(d, s)))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nsrc_and,  _mm_andnot_si128(s, d))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nsrc_nand, GUAC_COMMON_SURFACE_NOT_SSE2(_mm_andnot_si128(s, d)))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nsrc_or,   _mm_or_si128(d, GUAC_COMMON_SURFACE_NOT_SSE2(s)))
+GUAC_COMMON_SURFACE_TRANSFER_SSE2(nsrc_nor,  _mm_andnot_si128(d, s))
+
+GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(black, avx2, 0xFF000000)
+GUAC_COMMON_SURFACE_TRANSFER_CONSTANT(white, avx2, 0xFFFFFFFF)
+
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(src,       s)
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nsrc,      GUAC_COMMON_SURFACE_NOT_AVX2(s))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(ndest,     GUAC_COMMON_SURFACE_NOT_AVX2(d))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(and,       _mm256_and_si256(d, s))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nand,      GUAC_COMMON_SURFACE_NOT_AVX2(_mm256_and_si256(d, s)))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(or,        _mm256_or_si256(d, s))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nor,       GUAC_COMMON_SURFACE_NOT_AVX2(_mm256_or_si256(d, s)))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(xor,       _mm256_xor_si256(d, s))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(xnor,      GUAC_COMMON_SURFACE_NOT_AVX2(_mm256_xor_si256(d, s)))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nsrc_and,  _mm256_andnot_si256(s, d))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nsrc_nand, GUAC_COMMON_SURFACE_NOT_AVX2(_mm256_andnot_si256(s, d)))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nsrc_or,   _mm256_or_si256(d, GUAC_COMMON_SURFACE_NOT_AVX2(s)))
+GUAC_COMMON_SURFACE_TRANSFER_AVX2(nsrc_nor,  _mm256_andnot_si256(d, s))
+
+/**
+ * Kernels comparing and writing 16 bytes (four pixels) at a time.
+ */
+static const guac_common_surface_kernels __guac_common_surface_kernels_sse2 = {
+    .name = "sse2",
+    .put  = __guac_common_surface_put_sse2,
+    .mask = __guac_common_surface_mask_sse2,
+    .fill = __guac_common_surface_fill_sse2,
+    .transfer = GUAC_COMMON_SURFACE_TRANSFER_TABLE(sse2)
+};
+
+/**
+ * Kernels comparing and writing 32 bytes (eight pixels) at a time.
+ */
+static const guac_common_surface_kernels __guac_common_surface_kernels_avx2 = {
+    .name = "avx2",
+    .put  = __guac_common_surface_put_avx2,
+    .mask = __guac_common_surface_mask_avx2,
+    .fill = __guac_common_surface_fill_avx2,
+    .transfer = GUAC_COMMON_SURFACE_TRANSFER_TABLE(avx2)
+};
+
+#endif
+
+/**
+ * The kernels in use, selected at runtime based on the capabilities of the
+ * CPU.
+ */
+static const guac_common_surface_kernels* __guac_common_surface_kernels =
+    &guac_common_surface_kernels_generic;
+
+/**
+ * Guard ensuring the kernels are selected only once.
+ */
+static pthread_once_t __guac_common_surface_kernels_selected =
+    PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest kernels supported by the current CPU.
+ */
+static void __guac_common_surface_select_kernels() {
+
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        __guac_common_surface_kernels = &__guac_common_surface_kernels_avx2;
+
+    else if (__builtin_cpu_supports("sse2"))
+        __guac_common_surface_kernels = &__guac_common_surface_kernels_sse2;
+#endif
+
+}
+
+const guac_common_surface_kernels* guac_common_surface_get_kernels() {
+
+    pthread_once(&__guac_common_surface_kernels_selected,
+            __guac_common_surface_select_kernels);
+
+    return __guac_common_surface_kernels;
+
+}
+
@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __GUAC_COMMON_SURFACE_KERNELS_H
+#define __GUAC_COMMON_SURFACE_KERNELS_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+/**
+ * Row-level pixel kernels used by guac_common_surface to update its backing
+ * buffer. Each kernel updates a single row of 32-bit pixels, writing only
+ * where the result differs, and reports the first and last columns which
+ * actually changed such that the dirty rect can be shrunk without testing
+ * every pixel individually. Vectorized implementations are selected at
+ * runtime based on the capabilities of the CPU.
+ *
+ * @file guac_surface_kernels.h
+ */
+
+/**
+ * Copies a row of pixels, setting the given bits within each copied pixel.
+ *
+ * @param src The row of source pixels.
+ * @param dst The row of destination pixels.
+ * @param width The number of pixels in the row.
+ * @param or_bits The bits to set within each copied pixel. Passing zero copies
+ *                the source exactly, while passing 0xFF000000 forces each
+ *                copied pixel to be opaque.
+ * @param first Pointer to an int which will receive the column of the first
+ *              changed pixel, if any pixels changed.
+ * @param last Pointer to an int which will receive the column of the last
+ *             changed pixel, if any pixels changed.
+ * @return Non-zero if any pixel of the destination row changed, zero
+ *         otherwise.
+ */
+typedef int guac_common_surface_put_kernel(const uint32_t* src, uint32_t* dst,
+        int width, uint32_t or_bits, int* first, int* last);
+
+/**
+ * Updates only those pixels of a row whose corresponding source pixel is not
+ * fully transparent (has a non-zero alpha component), replacing each with
+ * ((source & and_bits) | or_bits). Pixels whose source is fully transparent
+ * are left untouched.
+ *
+ * @param src The row of source pixels, whose alpha components serve as the
+ *            mask.
+ * @param dst The row of destination pixels.
+ * @param width The number of pixels in the row.
+ * @param and_bits The bits of each source pixel to preserve. Passing zero
+ *                 fills masked pixels with or_bits alone.
+ * @param or_bits The bits to set within each updated pixel.
+ * @param first Pointer to an int which will receive the column of the first
+ *              changed pixel, if any pixels changed.
+ * @param last Pointer to an int which will receive the column of the last
+ *             changed pixel, if any pixels changed.
+ * @return Non-zero if any pixel of the destination row changed, zero
+ *         otherwise.
+ */
+typedef int guac_common_surface_mask_kernel(const uint32_t* src, uint32_t* dst,
+        int width, uint32_t and_bits, uint32_t or_bits, int* first, int* last);
+
+/**
+ * Fills a row of pixels with a single color.
+ *
+ * @param dst The row of destination pixels.
+ * @param width The number of pixels in the row.
+ * @param color The color to fill the row with.
+ * @param first Pointer to an int which will receive the column of the first
+ *              changed pixel, if any pixels changed.
+ * @param last Pointer to an int which will receive the column of the last
+ *             changed pixel, if any pixels changed.
+ * @return Non-zero if any pixel of the destination row changed, zero
+ *         otherwise.
+ */
+typedef int guac_common_surface_fill_kernel(uint32_t* dst, int width,
+        uint32_t color, int* first, int* last);
+
+/**
+ * Transfers a row of pixels using a particular transfer function (binary
+ * raster operation). Each transfer function has its own kernel, such that the
+ * operation need not be decided for each pixel.
+ *
+ * The source and destination rows may overlap only if the destination does
+ * not begin after the source, as the source would otherwise be overwritten
+ * before it is read.
+ *
+ * @param src The row of source pixels. Kernels for transfer functions which
+ *            produce a constant color (BLACK and WHITE) never read this row.
+ * @param dst The row of destination pixels.
+ * @param width The number of pixels in the row.
+ * @param first Pointer to an int which will receive the column of the first
+ *              changed pixel, if any pixels changed.
+ * @param last Pointer to an int which will receive the column of the last
+ *             changed pixel, if any pixels changed.
+ * @return Non-zero if any pixel of the destination row changed, zero
+ *         otherwise.
+ */
+typedef int guac_common_surface_transfer_kernel(const uint32_t* src,
+        uint32_t* dst, int width, int* first, int* last);
+
+/**
+ * The number of possible transfer functions, and thus the number of entries
+ * within the transfer kernel table of each guac_common_surface_kernels.
+ */
+#define GUAC_COMMON_SURFACE_TRANSFER_FUNCTIONS 16
+
+/**
+ * A complete set of row kernels for a particular instruction set.
+ */
+typedef struct guac_common_surface_kernels {
+
+    /**
+     * Human-readable name of the instruction set used by these kernels, such
+     * as "generic", "sse2", or "avx2".
+     */
+    const char* name;
+
+    /**
+     * Copies a row of pixels.
+     */
+    guac_common_surface_put_kernel* put;
+
+    /**
+     * Updates the pixels of a row selected by the alpha of a source row.
+     */
+    guac_common_surface_mask_kernel* mask;
+
+    /**
+     * Fills a row of pixels with a single color.
+     */
+    guac_common_surface_fill_kernel* fill;
+
+    /**
+     * Transfer kernels, indexed by guac_transfer_function. The entry for
+     * GUAC_TRANSFER_BINARY_DEST is NULL, as that transfer function never
+     * changes the destination.
+     */
+    guac_common_surface_transfer_kernel*
+        transfer[GUAC_COMMON_SURFACE_TRANSFER_FUNCTIONS];
+
+} guac_common_surface_kernels;
+
+/**
+ * Portable kernels which process one pixel at a time. These are always
+ * available, and serve as the reference against which vectorized kernels are
+ * tested and measured.
+ */
+extern const guac_common_surface_kernels guac_common_surface_kernels_generic;
+
+/**
+ * Returns the fastest set of kernels supported by the current CPU. The
+ * selection is made once, upon first call, and the same kernels are returned
+ * for all subsequent calls.
+ *
+ * @return The fastest set of kernels supported by the current CPU.
+ */
+const guac_common_surface_kernels* guac_common_surface_get_kernels();
+
+#endif
+
@@ -26,6 +26,9 @@
 #include "guac_list.h"
 
 #include <guacamole/client.h>
+#include <guacamole/error.h>
+#include <guacamole/socket.h>
+#include <guacamole/viewer.h>
 
 #include <stdlib.h>
 #include <string.h>
@@ -170,3 +173,32 @@ guac_client* guacd_client_map_remove(guacd_client_map* map, const char* id) {
 
 }
 
+
+guac_viewer* guacd_client_map_add_viewer(guacd_client_map* map,
+        const char* id, guac_socket* socket, int read_only) {
+
+    guac_viewer* viewer;
+
+    guac_common_list* bucket = __guacd_client_find_bucket(map, id);
+    guac_common_list_element* found;
+
+    /* Retrieve corresponding element, if any */
+    guac_common_list_lock(bucket);
+    found = __guacd_client_find(bucket, id);
+
+    /* If no such element, fail */
+    if (found == NULL) {
+        guac_common_list_unlock(bucket);
+        guac_error = GUAC_STATUS_NOT_FOUND;
+        guac_error_message = "No such connection";
+        return NULL;
+    }
+
+    /* Add viewer while the client is known to exist */
+    viewer = guac_client_add_viewer((guac_client*) found->data, socket,
+            read_only);
+
+    guac_common_list_unlock(bucket);
+    return viewer;
+
+}
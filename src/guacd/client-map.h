@@ -29,6 +29,8 @@
 #include "guac_list.h"
 
 #include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/viewer.h>
 
 #define GUACD_CLIENT_MAP_BUCKETS GUACD_CLIENT_MAX_CONNECTIONS*2
 
@@ -69,5 +71,14 @@ guac_client* guacd_client_map_retrieve(guacd_client_map* map, const char* id);
  */
 guac_client* guacd_client_map_remove(guacd_client_map* map, const char* id);
 
+/**
+ * Adds a viewer having the given socket to the client having the given ID,
+ * returning the new viewer. The client cannot be removed from the map while
+ * the viewer is being added. If no such client exists, or the viewer cannot
+ * be added, NULL is returned, and guac_error is set appropriately.
+ */
+guac_viewer* guacd_client_map_add_viewer(guacd_client_map* map,
+        const char* id, guac_socket* socket, int read_only);
+
 #endif
 
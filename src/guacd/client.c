@@ -28,12 +28,16 @@
 #include <guacamole/client.h>
 #include <guacamole/error.h>
 #include <guacamole/instruction.h>
+#include <guacamole/pacing.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
 #include <guacamole/timestamp.h>
+#include <guacamole/viewer.h>
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
 #include <time.h>
 
 /**
@@ -52,11 +56,65 @@ void __guacdd_sleep(int millis) {
 
 }
 
-void* __guacd_client_output_thread(void* data) {
+int guacd_client_end_frame(guac_client* client, guacd_registry_entry* entry) {
 
-    guac_client* client = (guac_client*) data;
     guac_socket* socket = client->socket;
 
+    /* Send sync instruction */
+    client->last_sent_timestamp = guac_timestamp_current();
+    if (guac_protocol_send_sync(socket, client->last_sent_timestamp)) {
+        guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
+                "Error sending \"sync\" instruction");
+        guac_client_stop(client);
+        return 1;
+    }
+
+    /* Flush */
+    if (guac_socket_flush(socket)) {
+        guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
+                "Error flushing output");
+        guac_client_stop(client);
+        return 1;
+    }
+
+    /* Measure connection as the frame is acknowledged */
+    guac_pacing_frame_sent(client->pacing,
+            client->last_sent_timestamp, socket->bytes_written);
+
+    /* Bring any other viewers up to date with the completed frame */
+    guac_client_sync_viewers(client);
+
+    /* Publish connection statistics */
+    if (entry != NULL)
+        guacd_registry_update(entry, client);
+
+    return 0;
+
+}
+
+/**
+ * The arguments of the input and output threads of a client.
+ */
+typedef struct guacd_client_io {
+
+    /**
+     * The client whose output is handled.
+     */
+    guac_client* client;
+
+    /**
+     * The connection registry entry of the client, or NULL if the client is
+     * not registered.
+     */
+    guacd_registry_entry* entry;
+
+} guacd_client_io;
+
+void* __guacd_client_output_thread(void* data) {
+
+    guacd_client_io* output = (guacd_client_io*) data;
+    guac_client* client = output->client;
+
     guac_client_log(client, GUAC_LOG_DEBUG,
             "Starting output thread.");
 
@@ -66,9 +124,10 @@ void* __guacd_client_output_thread(void* data) {
         /* Handle server messages */
         if (client->handle_messages) {
 
-            /* Only handle messages if synced within threshold */
+            /* Only handle messages if the client is keeping up, such that
+             * frames do not queue up within a slow connection */
             if (client->last_sent_timestamp - client->last_received_timestamp
-                    < GUACD_SYNC_THRESHOLD) {
+                    < guac_pacing_get_max_lag(client->pacing)) {
 
                 int retval = client->handle_messages(client);
                 if (retval) {
@@ -78,28 +137,19 @@ void* __guacd_client_output_thread(void* data) {
                     return NULL;
                 }
 
-                /* Send sync instruction */
-                client->last_sent_timestamp = guac_timestamp_current();
-                if (guac_protocol_send_sync(socket, client->last_sent_timestamp)) {
-                    guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
-                            "Error sending \"sync\" instruction");
-                    guac_client_stop(client);
+                /* End frame */
+                if (guacd_client_end_frame(client, output->entry))
                     return NULL;
-                }
-
-                /* Flush */
-                if (guac_socket_flush(socket)) {
-                    guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
-                            "Error flushing output");
-                    guac_client_stop(client);
-                    return NULL;
-                }
 
             }
 
-            /* Do not spin while waiting for old sync */
-            else
-                __guacdd_sleep(GUACD_MESSAGE_HANDLE_FREQUENCY);
+            /* Do not spin while waiting for old sync, but check again
+             * within a frame */
+            else {
+                int duration = guac_pacing_get_frame_duration(client->pacing);
+                __guacdd_sleep(duration < GUACD_MESSAGE_HANDLE_FREQUENCY
+                        ? duration : GUACD_MESSAGE_HANDLE_FREQUENCY);
+            }
 
         }
 
@@ -117,23 +167,116 @@ void* __guacd_client_output_thread(void* data) {
 
 }
 
+/**
+ * Handles the given instruction using the handlers of the given client,
+ * logging any failure.
+ *
+ * @param client The client which should handle the instruction.
+ * @param instruction The instruction to handle.
+ * @return Zero if the instruction was handled successfully, non-zero if the
+ *         handler failed and the connection should be stopped.
+ */
+static int __guacd_client_handle_instruction(guac_client* client,
+        guac_instruction* instruction) {
+
+    /* Reset guac_error and guac_error_message (client handlers are not
+     * guaranteed to set these) */
+    guac_error = GUAC_STATUS_SUCCESS;
+    guac_error_message = NULL;
+
+    /* Call handler, stop on error */
+    if (guac_client_handle_instruction(client, instruction) < 0) {
+
+        /* Log error */
+        guacd_client_log_guac_error(client, GUAC_LOG_WARNING,
+                "Connection aborted");
+
+        /* Log handler details */
+        guac_client_log(client, GUAC_LOG_DEBUG,
+                "Failing instruction handler in client was \"%s\"",
+                instruction->opcode);
+
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Returns whether the given instruction is a mouse instruction which is
+ * entirely superseded by the instruction immediately following it, and thus
+ * may be dropped. This is only the case if both are mouse instructions with
+ * the same button mask, such that only the reported position differs.
+ *
+ * @param instruction The instruction which may be dropped.
+ * @param next The instruction immediately following the given instruction.
+ * @return Non-zero if the given instruction may be dropped, zero otherwise.
+ */
+static int __guacd_client_mouse_superseded(guac_instruction* instruction,
+        guac_instruction* next) {
+
+    return instruction->opcode_id == GUAC_INSTRUCTION_OPCODE_MOUSE
+        && next->opcode_id == GUAC_INSTRUCTION_OPCODE_MOUSE
+        && instruction->argc >= 3 && next->argc >= 3
+        && strcmp(instruction->argv[2], next->argv[2]) == 0;
+
+}
+
+void guacd_client_handle_instructions(guac_client* client,
+        guac_instruction* instructions, int count,
+        long* mouse_received, long* mouse_dropped) {
+
+    int i;
+
+    for (i = 0; i < count && client->state == GUAC_CLIENT_RUNNING; i++) {
+
+        guac_instruction* instruction = &instructions[i];
+
+        if (instruction->opcode_id == GUAC_INSTRUCTION_OPCODE_MOUSE)
+            (*mouse_received)++;
+
+        /* Drop mouse instructions which only update the position of
+         * the mouse instruction immediately following */
+        if (client->coalesce_mouse && i + 1 < count
+                && __guacd_client_mouse_superseded(instruction,
+                    &instructions[i + 1])) {
+            (*mouse_dropped)++;
+            continue;
+        }
+
+        if (__guacd_client_handle_instruction(client, instruction))
+            guac_client_stop(client);
+
+    }
+
+}
+
 void* __guacd_client_input_thread(void* data) {
 
-    guac_client* client = (guac_client*) data;
+    guacd_client_io* input = (guacd_client_io*) data;
+    guac_client* client = input->client;
     guac_socket* socket = client->socket;
 
+    /* Instructions are parsed in place and reused for the life of the
+     * connection */
+    guac_instruction instructions[GUACD_INSTRUCTION_BATCH_SIZE];
+
+    /* Mouse coalescing statistics */
+    long mouse_received = 0;
+    long mouse_dropped = 0;
+
     guac_client_log(client, GUAC_LOG_DEBUG,
             "Starting input thread.");
 
     /* Guacamole client input loop */
     while (client->state == GUAC_CLIENT_RUNNING) {
 
-        /* Read instruction */
-        guac_instruction* instruction =
-            guac_instruction_read(socket, GUACD_USEC_TIMEOUT);
+        int count;
 
-        /* Stop on error */
-        if (instruction == NULL) {
+        /* Read instruction, stop on error */
+        if (guac_instruction_read_into(socket, GUACD_USEC_TIMEOUT,
+                    &instructions[0])) {
 
             if (guac_error == GUAC_STATUS_TIMEOUT)
                 guac_client_abort(client, GUAC_PROTOCOL_STATUS_CLIENT_TIMEOUT, "Client is not responding.");
@@ -145,53 +288,48 @@ void* __guacd_client_input_thread(void* data) {
                 guac_client_stop(client);
             }
 
-            return NULL;
+            break;
         }
 
-        /* Reset guac_error and guac_error_message (client handlers are not
-         * guaranteed to set these) */
-        guac_error = GUAC_STATUS_SUCCESS;
-        guac_error_message = NULL;
-
-        /* Call handler, stop on error */
-        if (guac_client_handle_instruction(client, instruction) < 0) {
+        /* Drain any further instructions already received in the same
+         * burst without waiting on the socket again */
+        count = 1 + guac_instruction_read_buffered(socket, &instructions[1],
+                GUACD_INSTRUCTION_BATCH_SIZE - 1);
 
-            /* Log error */
-            guacd_client_log_guac_error(client, GUAC_LOG_WARNING,
-                    "Connection aborted");
-
-            /* Log handler details */
-            guac_client_log(client, GUAC_LOG_DEBUG,
-                    "Failing instruction handler in client was \"%s\"",
-                    instruction->opcode);
-
-            guac_instruction_free(instruction);
-            guac_client_stop(client);
-            return NULL;
-        }
+        /* Handle all parsed instructions, stopping on error */
+        guacd_client_handle_instructions(client, instructions, count,
+                &mouse_received, &mouse_dropped);
 
-        /* Free allocated instruction */
-        guac_instruction_free(instruction);
+        /* Publish coalescing statistics */
+        if (input->entry != NULL)
+            guacd_registry_update_input(input->entry,
+                    mouse_received, mouse_dropped);
 
     }
 
     guac_client_log(client, GUAC_LOG_DEBUG,
-            "Input thread terminated.");
+            "Input thread terminated. %li of %li mouse events coalesced.",
+            mouse_dropped, mouse_received);
 
     return NULL;
 
 }
 
-int guacd_client_start(guac_client* client) {
+int guacd_client_start(guac_client* client, guacd_registry_entry* entry) {
 
     pthread_t input_thread, output_thread;
 
-    if (pthread_create(&output_thread, NULL, __guacd_client_output_thread, (void*) client)) {
+    guacd_client_io io = {
+        .client = client,
+        .entry  = entry
+    };
+
+    if (pthread_create(&output_thread, NULL, __guacd_client_output_thread, (void*) &io)) {
         guac_client_log(client, GUAC_LOG_ERROR, "Unable to start output thread");
         return -1;
     }
 
-    if (pthread_create(&input_thread, NULL, __guacd_client_input_thread, (void*) client)) {
+    if (pthread_create(&input_thread, NULL, __guacd_client_input_thread, (void*) &io)) {
         guac_client_log(client, GUAC_LOG_ERROR, "Unable to start input thread");
         guac_client_stop(client);
         pthread_join(output_thread, NULL);
@@ -207,3 +345,82 @@ int guacd_client_start(guac_client* client) {
 
 }
 
+
+void guacd_client_view(guac_viewer* viewer, int fd) {
+
+    guac_client* client = viewer->client;
+    guac_socket* socket = viewer->socket;
+
+    /* The viewer is only handed one instruction at a time, parsed in place */
+    guac_instruction instruction;
+    guac_timestamp last_input = guac_timestamp_current();
+
+    guac_client_log(client, GUAC_LOG_INFO, "Viewer joined (%s).",
+            viewer->read_only ? "read-only" : "read-write");
+
+    /* Handle input until the viewer leaves or the client stops */
+    while (client->state == GUAC_CLIENT_RUNNING) {
+
+        int result;
+
+        /* Disconnect viewers which can no longer receive output */
+        if (guac_viewer_failed(viewer)) {
+            guac_client_log(client, GUAC_LOG_INFO, "Viewer can no longer "
+                    "receive output.");
+            break;
+        }
+
+        if (guac_instruction_read_into(socket, GUACD_VIEWER_USEC_TIMEOUT,
+                    &instruction)) {
+
+            /* Wait only briefly between checks of the client state */
+            if (guac_error == GUAC_STATUS_TIMEOUT) {
+
+                if (guac_timestamp_current() - last_input < GUACD_TIMEOUT)
+                    continue;
+
+                guac_client_log(client, GUAC_LOG_INFO,
+                        "Viewer is not responding.");
+
+            }
+
+            else if (guac_error != GUAC_STATUS_CLOSED)
+                guacd_client_log_guac_error(client, GUAC_LOG_WARNING,
+                        "Viewer connection failure");
+
+            break;
+
+        }
+
+        last_input = guac_timestamp_current();
+
+        /* Reset guac_error and guac_error_message (client handlers are not
+         * guaranteed to set these) */
+        guac_error = GUAC_STATUS_SUCCESS;
+        guac_error_message = NULL;
+
+        result = guac_viewer_handle_instruction(viewer, &instruction);
+
+        /* Viewer disconnected */
+        if (result > 0)
+            break;
+
+        /* Input from viewers may fail the client as a whole */
+        if (result < 0) {
+            guacd_client_log_guac_error(client, GUAC_LOG_WARNING,
+                    "Connection aborted by viewer input");
+            guac_client_stop(client);
+            break;
+        }
+
+    }
+
+    guac_client_log(client, GUAC_LOG_INFO, "Viewer left.");
+
+    /* Unblock any pending write to the viewer, which may have stopped
+     * reading */
+    shutdown(fd, SHUT_RDWR);
+
+    guac_client_remove_viewer(viewer);
+
+}
@@ -25,16 +25,11 @@
 #define _GUACD_CLIENT_H
 
 #include "config.h"
+#include "registry.h"
 
 #include <guacamole/client.h>
-
-/**
- * The time to allow between sync responses in milliseconds. If a sync
- * instruction is sent to the client and no response is received within this
- * timeframe, server messages will not be handled until a sync instruction is
- * received from the client.
- */
-#define GUACD_SYNC_THRESHOLD 500
+#include <guacamole/instruction.h>
+#include <guacamole/viewer.h>
 
 /**
  * The time to allow between server sync messages in milliseconds. A sync
@@ -47,10 +42,12 @@
 #define GUACD_SYNC_FREQUENCY 5000
 
 /**
- * The amount of time to wait after handling server messages. If a client
- * plugin has a message handler, and sends instructions when server messages
- * are being handled, there will be a pause of this many milliseconds before
- * the next call to the message handler.
+ * The maximum amount of time to wait while the client has not yet
+ * acknowledged enough of the frames sent, in milliseconds. If a client plugin
+ * has a message handler, server messages will not be handled until enough
+ * frames are acknowledged, as determined by the measured round trip time of
+ * the connection, and the acknowledgements are checked again after the
+ * current frame duration or this many milliseconds, whichever is shorter.
  */
 #define GUACD_MESSAGE_HANDLE_FREQUENCY 50
 
@@ -67,13 +64,82 @@
  */
 #define GUACD_USEC_TIMEOUT (GUACD_TIMEOUT*1000)
 
+/**
+ * The number of microseconds to wait for input from a viewer before checking
+ * whether the client being viewed is still running. Viewers are only
+ * disconnected once no input has been received for GUACD_TIMEOUT
+ * milliseconds.
+ */
+#define GUACD_VIEWER_USEC_TIMEOUT 1000000
+
+/**
+ * The maximum number of already-buffered instructions to parse and handle
+ * at once after each instruction read by the input thread.
+ */
+#define GUACD_INSTRUCTION_BATCH_SIZE 32
+
 /**
  * The maximum number of concurrent connections to a single instance
  * of guacd.
  */
 #define GUACD_CLIENT_MAX_CONNECTIONS 65536
 
-int guacd_client_start(guac_client* client);
+/**
+ * Starts the input and output threads of the given client, which must already
+ * be initialized by its client plugin, returning only after both threads have
+ * terminated.
+ *
+ * @param client The client to start.
+ * @param entry The connection registry entry of the client, which will be
+ *              updated after each frame, or NULL if the client is not
+ *              registered.
+ * @return Zero if the client ran until disconnected, non-zero if its threads
+ *         could not be started.
+ */
+int guacd_client_start(guac_client* client, guacd_registry_entry* entry);
+
+/**
+ * Handles each of the given instructions, which must all have been received
+ * from the given client in the same burst, using the handlers of that client.
+ * If mouse coalescing is enabled for the client, mouse instructions which are
+ * superseded by the instruction immediately following them are dropped. The
+ * client is stopped if any handler fails.
+ *
+ * @param client The client which should handle the instructions.
+ * @param instructions The instructions to handle.
+ * @param count The number of instructions in the given array.
+ * @param mouse_received Pointer to the number of mouse instructions received
+ *                       thus far, which will be incremented accordingly.
+ * @param mouse_dropped Pointer to the number of mouse instructions dropped
+ *                      thus far, which will be incremented accordingly.
+ */
+void guacd_client_handle_instructions(guac_client* client,
+        guac_instruction* instructions, int count,
+        long* mouse_received, long* mouse_dropped);
+
+/**
+ * Ends the current frame of the given client, sending a "sync" instruction,
+ * flushing the client socket, and noting the frame for the sake of pacing
+ * and within the connection registry. The client is stopped if the frame
+ * cannot be sent.
+ *
+ * @param client The client whose frame should be ended.
+ * @param entry The connection registry entry of the client, or NULL if the
+ *              client is not registered.
+ * @return Zero if the frame was sent successfully, non-zero otherwise.
+ */
+int guacd_client_end_frame(guac_client* client, guacd_registry_entry* entry);
+
+/**
+ * Handles input from the given viewer, which must already have been added to
+ * its client, until the viewer leaves or the client stops, after which the
+ * viewer is removed from its client and freed. The connection of the viewer
+ * is shut down, but remains the responsibility of the caller.
+ *
+ * @param viewer The viewer to handle.
+ * @param fd The file descriptor of the connection of the viewer.
+ */
+void guacd_client_view(guac_viewer* viewer, int fd);
 
 #endif
 
@@ -24,8 +24,11 @@
 
 #include "conf-file.h"
 #include "conf-parse.h"
+#include "event.h"
+#include "prefork.h"
 
 #include <guacamole/client.h>
+#include <guacamole/encoder-pool.h>
 
 #include <errno.h>
 #include <stdio.h>
@@ -91,6 +94,92 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* Mouse coalescing */
+        else if (strcmp(param, "mouse_coalescing") == 0) {
+
+            int enabled = guacd_parse_boolean(value);
+
+            /* Invalid boolean */
+            if (enabled < 0) {
+                guacd_conf_parse_error = "Invalid value for mouse_coalescing. Valid values are: \"true\" and \"false\".";
+                return 1;
+            }
+
+            config->coalesce_mouse = enabled;
+            return 0;
+
+        }
+
+        /* Image encoder threads */
+        else if (strcmp(param, "encoder_threads") == 0) {
+
+            char* end;
+            long threads = strtol(value, &end, 10);
+
+            /* Invalid thread count */
+            if (*value == '\0' || *end != '\0' || threads < 0
+                    || threads > GUAC_ENCODER_POOL_MAX_THREADS) {
+                guacd_conf_parse_error = "Invalid number of encoder threads.";
+                return 1;
+            }
+
+            config->encoder_threads = threads;
+            return 0;
+
+        }
+
+        /* Event-driven connection threads */
+        else if (strcmp(param, "event_threads") == 0) {
+
+            char* end;
+            long threads = strtol(value, &end, 10);
+
+            /* Invalid thread count */
+            if (*value == '\0' || *end != '\0' || threads < 0
+                    || threads > GUACD_EVENT_MAX_THREADS) {
+                guacd_conf_parse_error = "Invalid number of event threads.";
+                return 1;
+            }
+
+#ifndef HAVE_SYS_EPOLL_H
+            /* Event-driven mode requires epoll */
+            if (threads > 0) {
+                guacd_conf_parse_error = "Event-driven mode is not supported "
+                                         "on this platform.";
+                return 1;
+            }
+#endif
+
+            config->event_threads = threads;
+            return 0;
+
+        }
+
+        /* Idle worker processes */
+        else if (strcmp(param, "prefork_workers") == 0) {
+
+            char* end;
+            long workers = strtol(value, &end, 10);
+
+            /* Invalid worker count */
+            if (*value == '\0' || *end != '\0' || workers < 0
+                    || workers > GUACD_PREFORK_MAX_WORKERS) {
+                guacd_conf_parse_error = "Invalid number of prefork workers.";
+                return 1;
+            }
+
+            config->prefork_workers = workers;
+            return 0;
+
+        }
+
+        /* Protocols preloaded by idle worker processes */
+        else if (strcmp(param, "prefork_protocols") == 0) {
+            free(config->prefork_protocols);
+            config->prefork_protocols = strdup(value);
+            return 0;
+        }
+
     }
 
     /* SSL-specific options */
@@ -183,6 +272,11 @@ guacd_config* guacd_conf_load() {
     conf->pidfile = NULL;
     conf->foreground = 0;
     conf->max_log_level = GUAC_LOG_INFO;
+    conf->coalesce_mouse = 1;
+    conf->encoder_threads = -1;
+    conf->event_threads = 0;
+    conf->prefork_workers = 0;
+    conf->prefork_protocols = NULL;
 
 #ifdef ENABLE_SSL
     conf->cert_file = NULL;
@@ -69,6 +69,40 @@ typedef struct guacd_config {
      */
     guac_client_log_level max_log_level;
 
+    /**
+     * Whether consecutive mouse instructions having the same button mask
+     * should be coalesced by default for each connection.
+     */
+    int coalesce_mouse;
+
+    /**
+     * The number of threads each connection should use for encoding images,
+     * in addition to the thread performing the drawing, or a negative value
+     * if the number of threads should be chosen automatically.
+     */
+    int encoder_threads;
+
+    /**
+     * The number of threads which should handle connections using the
+     * clients of event-driven client plugins, or zero if each connection
+     * should instead be handled by its own process.
+     */
+    int event_threads;
+
+    /**
+     * The number of idle worker processes which should be kept ready to
+     * handle new connections, or zero if a new process should be forked for
+     * each connection as it arrives.
+     */
+    int prefork_workers;
+
+    /**
+     * Comma-separated list of the protocols whose client plugins should be
+     * preloaded by each idle worker process, or NULL if no client plugins
+     * should be preloaded.
+     */
+    char* prefork_protocols;
+
 } guacd_config;
 
 /**
@@ -536,3 +536,14 @@ int guacd_parse_log_level(const char* name) {
 
 }
 
+int guacd_parse_boolean(const char* value) {
+
+    /* Translate boolean value */
+    if (strcmp(value, "true")  == 0) return 1;
+    if (strcmp(value, "false") == 0) return 0;
+
+    /* Not a boolean */
+    return -1;
+
+}
+
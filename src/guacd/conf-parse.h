@@ -56,6 +56,12 @@ int guacd_parse_conf(guacd_param_callback* callback, char* buffer, int length, v
  */
 int guacd_parse_log_level(const char* name);
 
+/**
+ * Parses the given boolean value, returning 1 for "true", 0 for "false", or
+ * -1 if the value is neither.
+ */
+int guacd_parse_boolean(const char* value);
+
 /**
  * Human-readable description of the current error, if any.
  */
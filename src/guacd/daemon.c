@@ -26,14 +26,21 @@
 #include "client-map.h"
 #include "conf-args.h"
 #include "conf-file.h"
+#include "event.h"
+#include "join.h"
 #include "log.h"
+#include "prefork.h"
+#include "registry.h"
 
 #include <guacamole/client.h>
+#include <guacamole/encoder-pool.h>
 #include <guacamole/error.h>
 #include <guacamole/instruction.h>
 #include <guacamole/plugin.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/viewer.h>
 
 #ifdef ENABLE_SSL
 #include <openssl/ssl.h>
@@ -45,11 +52,14 @@
 #include <libgen.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <syslog.h>
+#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -80,19 +90,76 @@ static void guacd_log_handshake_failure() {
 }
 
 /**
- * Creates a new guac_client for the connection on the given socket, adding
- * it to the client map based on its ID.
+ * Reads the next instruction of the handshake from the given socket, whatever
+ * its opcode, waiting no longer than GUACD_USEC_TIMEOUT.
+ *
+ * @param socket The guac_socket to read from.
+ * @return The instruction read, or NULL if an error occurs, in which case
+ *         guac_error is set appropriately.
  */
-static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket) {
+static guac_instruction* guacd_read_instruction(guac_socket* socket) {
+
+    /* Wait for data until timeout */
+    if (guac_instruction_waiting(socket, GUACD_USEC_TIMEOUT) <= 0)
+        return NULL;
+
+    return guac_instruction_read(socket, GUACD_USEC_TIMEOUT);
+
+}
+
+/**
+ * Returns a newly-allocated, NULL-terminated copy of the arguments of the
+ * given instruction, such that the instruction itself may be freed.
+ *
+ * @param instruction The instruction whose arguments should be copied.
+ * @return A newly-allocated, NULL-terminated array of newly-allocated copies
+ *         of each argument of the given instruction.
+ */
+static const char** guacd_copy_args(guac_instruction* instruction) {
+
+    int i;
+
+    const char** args = malloc(sizeof(char*) * (instruction->argc+1));
+    for (i = 0; i < instruction->argc; i++)
+        args[i] = strdup(instruction->argv[i]);
+
+    args[instruction->argc] = NULL;
+    return args;
+
+}
+
+/**
+ * Frees the given array of arguments, as returned by guacd_copy_args(). If
+ * the array is NULL, this function has no effect.
+ *
+ * @param args The array of arguments to free.
+ */
+static void guacd_free_args(const char** args) {
+
+    const char** current;
+
+    if (args == NULL)
+        return;
+
+    for (current = args; *current != NULL; current++)
+        free((char*) *current);
+
+    free(args);
+
+}
+
+/**
+ * Reads the "select" instruction which begins the handshake of the connection
+ * on the given socket, returning the name of the selected protocol.
+ *
+ * @param socket The guac_socket of the connection.
+ * @return A newly-allocated string containing the name of the selected
+ *         protocol, or NULL if the handshake fails.
+ */
+static char* guacd_read_select(guac_socket* socket) {
 
-    guac_client* client;
-    guac_client_plugin* plugin;
     guac_instruction* select;
-    guac_instruction* size;
-    guac_instruction* audio;
-    guac_instruction* video;
-    guac_instruction* connect;
-    int init_result;
+    char* protocol;
 
     /* Reset guac_error */
     guac_error = GUAC_STATUS_SUCCESS;
@@ -107,9 +174,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
         guacd_log_guac_error(GUAC_LOG_DEBUG,
                 "Error reading \"select\"");
 
-        /* Free resources */
-        guac_socket_free(socket);
-        return;
+        return NULL;
 
     }
 
@@ -121,17 +186,32 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
         guacd_log(GUAC_LOG_ERROR, "Bad number of arguments to \"select\" (%i)",
                 select->argc);
 
-        /* Free resources */
-        guac_socket_free(socket);
-        return;
+        guac_instruction_free(select);
+        return NULL;
     }
 
     guacd_log(GUAC_LOG_INFO, "Protocol \"%s\" selected", select->argv[0]);
 
-    /* Get plugin from protocol in select */
-    plugin = guac_client_plugin_open(select->argv[0]);
+    protocol = strdup(select->argv[0]);
     guac_instruction_free(select);
 
+    return protocol;
+
+}
+
+/**
+ * Opens the client plugin which provides support for the given protocol,
+ * logging any failure.
+ *
+ * @param protocol The name of the selected protocol.
+ * @return The client plugin for the given protocol, or NULL if the plugin
+ *         cannot be loaded.
+ */
+static guac_client_plugin* guacd_open_plugin(const char* protocol) {
+
+    /* Get plugin from protocol in select */
+    guac_client_plugin* plugin = guac_client_plugin_open(protocol);
+
     if (plugin == NULL) {
 
         /* Log error */
@@ -142,11 +222,128 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
             guacd_log_guac_error(GUAC_LOG_ERROR,
                     "Unable to load client plugin");
 
-        /* Free resources */
-        guac_socket_free(socket);
-        return;
+        return NULL;
     }
 
+    return plugin;
+
+}
+
+/**
+ * Closes the given client plugin, logging any failure.
+ *
+ * @param plugin The client plugin to close.
+ */
+static void guacd_close_plugin(guac_client_plugin* plugin) {
+
+    if (guac_client_plugin_close(plugin))
+        guacd_log_guac_error(GUAC_LOG_WARNING,
+                "Unable to close client plugin");
+
+}
+
+/**
+ * Removes the given client from the client map.
+ *
+ * @param map The client map containing the client.
+ * @param client The client to remove.
+ */
+static void guacd_map_remove(guacd_client_map* map, guac_client* client) {
+
+    if (guacd_client_map_remove(map, client->connection_id) == NULL)
+        guacd_log(GUAC_LOG_ERROR, "Unable to remove client. Internal client storage has failed");
+
+}
+
+/**
+ * Frees the given client, which must have been created by
+ * guacd_connect_client(), along with its mimetype lists.
+ *
+ * @param client The client to free.
+ */
+static void guacd_free_client(guac_client* client) {
+
+    const char** audio_mimetypes = client->info.audio_mimetypes;
+    const char** video_mimetypes = client->info.video_mimetypes;
+    const char** image_mimetypes = client->info.image_mimetypes;
+
+    guac_client_free(client);
+
+    /* Free mimetype lists */
+    guacd_free_args(audio_mimetypes);
+    guacd_free_args(video_mimetypes);
+    guacd_free_args(image_mimetypes);
+
+}
+
+/**
+ * Adds the given client to the connection registry, such that it is visible
+ * to all guacd processes.
+ *
+ * @param registry The connection registry.
+ * @param client The client to add.
+ * @param protocol The name of the protocol selected by the client.
+ * @return The registry entry of the client, or NULL if the registry is full.
+ */
+static guacd_registry_entry* guacd_register_client(guacd_registry* registry,
+        guac_client* client, const char* protocol) {
+
+    guacd_registry_entry* entry = guacd_registry_add(registry,
+            client->connection_id, protocol);
+
+    if (entry == NULL)
+        guacd_log(GUAC_LOG_WARNING, "Connection registry is full. Connection "
+                "\"%s\" will not be visible to other processes.",
+                client->connection_id);
+
+    return entry;
+
+}
+
+/**
+ * Removes the given entry from the connection registry, if any.
+ *
+ * @param registry The connection registry.
+ * @param entry The registry entry to remove, or NULL if the client was never
+ *              registered.
+ */
+static void guacd_unregister_client(guacd_registry* registry,
+        guacd_registry_entry* entry) {
+
+    if (entry != NULL)
+        guacd_registry_remove(registry, entry);
+
+}
+
+/**
+ * Completes the handshake of the connection on the given socket, whose
+ * protocol has already been selected, creating and initializing a new
+ * guac_client using the given client plugin and adding it to the client map
+ * based on its ID. Per-connection defaults are taken from the given
+ * configuration.
+ *
+ * @param map The client map to add the new client to.
+ * @param config The configuration of guacd.
+ * @param socket The guac_socket of the connection.
+ * @param plugin The client plugin for the selected protocol.
+ * @param shareable Non-zero if viewers joining the client can reach the
+ *                  current process, zero if the client must not allow
+ *                  viewers.
+ * @return The new client, initialized and ready to start, or NULL if the
+ *         handshake or initialization fails.
+ */
+static guac_client* guacd_connect_client(guacd_client_map* map,
+        guacd_config* config, guac_socket* socket,
+        guac_client_plugin* plugin, int shareable) {
+
+    guac_client* client;
+    guac_instruction* size;
+    guac_instruction* audio;
+    guac_instruction* video;
+    guac_instruction* image;
+    guac_instruction* connect;
+    int init_result;
+
     /* Send args response */
     if (guac_protocol_send_args(socket, plugin->args)
             || guac_socket_flush(socket)) {
@@ -154,13 +351,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
         /* Log error */
         guacd_log_handshake_failure();
         guacd_log_guac_error(GUAC_LOG_DEBUG, "Error sending \"args\"");
-
-        if (guac_client_plugin_close(plugin))
-            guacd_log_guac_error(GUAC_LOG_WARNING,
-                    "Unable to close client plugin");
-
-        guac_socket_free(socket);
-        return;
+        return NULL;
     }
 
     /* Get optimal screen size */
@@ -171,10 +362,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
         /* Log error */
         guacd_log_handshake_failure();
         guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading \"size\"");
-
-        /* Free resources */
-        guac_socket_free(socket);
-        return;
+        return NULL;
     }
 
     /* Get supported audio formats */
@@ -186,9 +374,8 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
         guacd_log_handshake_failure();
         guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading \"audio\"");
 
-        /* Free resources */
-        guac_socket_free(socket);
-        return;
+        guac_instruction_free(size);
+        return NULL;
     }
 
     /* Get supported video formats */
@@ -200,39 +387,68 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
         guacd_log_handshake_failure();
         guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading \"video\"");
 
-        /* Free resources */
-        guac_socket_free(socket);
-        return;
+        guac_instruction_free(audio);
+        guac_instruction_free(size);
+        return NULL;
+    }
+
+    /* Get optional image formats, or args from connect instruction */
+    image = NULL;
+    connect = guacd_read_instruction(socket);
+    if (connect != NULL && connect->opcode_id == GUAC_INSTRUCTION_OPCODE_IMAGE) {
+        image = connect;
+        connect = guacd_read_instruction(socket);
+    }
+
+    /* Validate connect instruction */
+    if (connect != NULL && connect->opcode_id != GUAC_INSTRUCTION_OPCODE_CONNECT) {
+        guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+        guac_error_message = "Instruction read did not have expected opcode";
+        guac_instruction_free(connect);
+        connect = NULL;
     }
 
-    /* Get args from connect instruction */
-    connect = guac_instruction_expect(
-            socket, GUACD_USEC_TIMEOUT, "connect");
     if (connect == NULL) {
 
         /* Log error */
         guacd_log_handshake_failure();
         guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading \"connect\"");
 
-        if (guac_client_plugin_close(plugin))
-            guacd_log_guac_error(GUAC_LOG_WARNING,
-                    "Unable to close client plugin");
+        if (image != NULL)
+            guac_instruction_free(image);
 
-        guac_socket_free(socket);
-        return;
+        guac_instruction_free(video);
+        guac_instruction_free(audio);
+        guac_instruction_free(size);
+        return NULL;
     }
 
     /* Get client */
     client = guac_client_alloc();
     if (client == NULL) {
         guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to create client");
-        guac_socket_free(socket);
-        return;
+
+        if (image != NULL)
+            guac_instruction_free(image);
+
+        guac_instruction_free(connect);
+        guac_instruction_free(video);
+        guac_instruction_free(audio);
+        guac_instruction_free(size);
+        return NULL;
     }
 
     client->socket = socket;
     client->log_handler = guacd_client_log;
 
+    /* Allow the connection to be joined by other viewers, if supported by
+     * the client plugin */
+    if (shareable && plugin->viewers && guac_client_allow_viewers(client))
+        guacd_log_guac_error(GUAC_LOG_WARNING, "Unable to allow viewers");
+
+    /* Apply configured default, which the client plugin may override */
+    client->coalesce_mouse = config->coalesce_mouse;
+
     /* Parse optimal screen dimensions from size instruction */
     client->info.optimal_width  = atoi(size->argv[0]);
     client->info.optimal_height = atoi(size->argv[1]);
@@ -245,17 +461,19 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
     else
         client->info.optimal_resolution = 96;
 
-    /* Store audio mimetypes */
-    client->info.audio_mimetypes = malloc(sizeof(char*) * (audio->argc+1));
-    memcpy(client->info.audio_mimetypes, audio->argv,
-            sizeof(char*) * audio->argc);
-    client->info.audio_mimetypes[audio->argc] = NULL;
+    /* Store mimetypes, independent of the instructions containing them */
+    client->info.audio_mimetypes = guacd_copy_args(audio);
+    client->info.video_mimetypes = guacd_copy_args(video);
 
-    /* Store video mimetypes */
-    client->info.video_mimetypes = malloc(sizeof(char*) * (video->argc+1));
-    memcpy(client->info.video_mimetypes, video->argv,
-            sizeof(char*) * video->argc);
-    client->info.video_mimetypes[video->argc] = NULL;
+    /* Store image mimetypes, if any were given */
+    if (image != NULL) {
+        client->info.image_mimetypes = guacd_copy_args(image);
+        guac_instruction_free(image);
+    }
+
+    guac_instruction_free(video);
+    guac_instruction_free(audio);
+    guac_instruction_free(size);
 
     /* Store client */
     if (guacd_client_map_add(map, client))
@@ -263,7 +481,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
 
     /* Send connection ID */
     guacd_log(GUAC_LOG_INFO, "Connection ID is \"%s\"", client->connection_id);
-    guac_protocol_send_ready(socket, client->connection_id);
+    guac_protocol_send_ready(client->socket, client->connection_id);
 
     /* Init client */
     init_result = guac_client_plugin_init_client(plugin,
@@ -273,50 +491,788 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket)
 
     /* If client could not be started, free everything and fail */
     if (init_result) {
+        guacd_log_guac_error(GUAC_LOG_INFO, "Connection did not succeed");
+        guacd_map_remove(map, client);
+        guacd_free_client(client);
+        return NULL;
+    }
 
-        guac_client_free(client);
+    return client;
 
-        guacd_log_guac_error(GUAC_LOG_INFO, "Connection did not succeed");
+}
+
+/**
+ * Returns whether the given value of the "select" instruction refers to an
+ * existing connection, rather than a protocol.
+ *
+ * @param selected The value of the "select" instruction.
+ * @return Non-zero if the given value is a connection ID, zero otherwise.
+ */
+static int guacd_is_connection_id(const char* selected) {
+    return selected[0] == '$';
+}
+
+/**
+ * Reads the remainder of the handshake of a viewer joining an existing
+ * connection, returning the "connect" instruction. The display and format
+ * preferences sent beforehand are ignored, as these are already determined
+ * by the connection being joined.
+ *
+ * @param socket The guac_socket of the joining connection.
+ * @return The "connect" instruction, or NULL if the handshake fails.
+ */
+static guac_instruction* guacd_read_viewer_connect(guac_socket* socket) {
+
+    int i;
+
+    /* Skip size, audio, video, and image */
+    for (i = 0; i < 5; i++) {
+
+        guac_instruction* instruction = guacd_read_instruction(socket);
+        if (instruction == NULL)
+            return NULL;
+
+        if (instruction->opcode_id == GUAC_INSTRUCTION_OPCODE_CONNECT)
+            return instruction;
+
+        guac_instruction_free(instruction);
+
+    }
+
+    guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+    guac_error_message = "Expected \"connect\" instruction";
+    return NULL;
+
+}
+
+/**
+ * Completes the handshake of a viewer joining the connection having the given
+ * ID, which must be handled by the current process, handling input from the
+ * viewer until the viewer leaves or the connection ends.
+ *
+ * @param map The client map containing the client being joined.
+ * @param socket The guac_socket of the joining connection.
+ * @param fd The file descriptor of the joining connection.
+ * @param connection_id The ID of the connection being joined.
+ */
+static void guacd_handle_viewer(guacd_client_map* map, guac_socket* socket,
+        int fd, const char* connection_id) {
+
+    static const char* viewer_args[] = { "read-only", NULL };
+
+    guac_instruction* connect;
+    guac_viewer* viewer;
+    int read_only;
+
+    /* Send args response */
+    if (guac_protocol_send_args(socket, viewer_args)
+            || guac_socket_flush(socket)) {
+        guacd_log_handshake_failure();
+        guacd_log_guac_error(GUAC_LOG_DEBUG, "Error sending \"args\"");
+        return;
+    }
+
+    connect = guacd_read_viewer_connect(socket);
+    if (connect == NULL) {
+        guacd_log_handshake_failure();
+        guacd_log_guac_error(GUAC_LOG_DEBUG, "Error reading \"connect\"");
+        return;
+    }
+
+    read_only = connect->argc >= 1 && strcmp(connect->argv[0], "true") == 0;
+    guac_instruction_free(connect);
 
-        if (guac_client_plugin_close(plugin))
-            guacd_log_guac_error(GUAC_LOG_WARNING,
-                    "Unable to close client plugin");
+    /* Viewers are told the ID of the connection joined, as if new, only once
+     * the connection is known to exist */
+    viewer = guacd_client_map_add_viewer(map, connection_id, socket,
+            read_only);
+    if (viewer == NULL) {
+        guacd_log_guac_error(GUAC_LOG_INFO, "Unable to join connection");
+        guac_protocol_send_error(socket, "Unable to join connection.",
+                GUAC_PROTOCOL_STATUS_RESOURCE_NOT_FOUND);
+        guac_socket_flush(socket);
+        return;
+    }
+
+    guacd_log(GUAC_LOG_INFO, "Joined connection \"%s\"", connection_id);
+    guacd_client_view(viewer, fd);
+
+}
+
+/**
+ * Handles a connection joining a client of the current process, as routed by
+ * another guacd process. This function is the guacd_join_handler of every
+ * process which handles clients.
+ *
+ * @param fd The file descriptor of the joining connection.
+ * @param connection_id The ID of the connection being joined.
+ * @param data The client map of the current process.
+ */
+static void guacd_handle_join(int fd, const char* connection_id, void* data) {
+
+    guacd_client_map* map = (guacd_client_map*) data;
+
+    guac_socket* socket = guac_socket_open(fd);
+    if (socket == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to open socket");
+        return;
+    }
+
+    guacd_handle_viewer(map, socket, fd, connection_id);
+    guac_socket_free(socket);
 
-        guac_socket_free(socket);
+}
+
+/**
+ * Handles a connection which has selected an existing connection rather than
+ * a protocol, joining that connection within the current process if the
+ * current process handles its client, or routing the joining connection to
+ * the process which does. The resources of the joining connection remain the
+ * responsibility of the caller.
+ *
+ * @param map The client map of the current process.
+ * @param registry The connection registry shared by all guacd processes.
+ * @param socket The guac_socket of the joining connection.
+ * @param fd The file descriptor of the joining connection.
+ * @param routable Non-zero if the joining connection may be routed to
+ *                 another process, zero if the state of the connection
+ *                 cannot be transferred, as is the case with SSL/TLS.
+ * @param connection_id The ID of the connection being joined.
+ */
+static void guacd_join_connection(guacd_client_map* map,
+        guacd_registry* registry, guac_socket* socket, int fd, int routable,
+        const char* connection_id) {
+
+    guacd_registry_entry found;
+
+    /* Join locally unless known to be handled by another process */
+    if (guacd_registry_find(registry, connection_id, &found)
+            || found.pid == getpid()) {
+        guacd_handle_viewer(map, socket, fd, connection_id);
         return;
     }
 
+    if (!routable) {
+        guacd_log(GUAC_LOG_ERROR, "Connection \"%s\" is handled by another "
+                "process and cannot be joined over SSL/TLS.", connection_id);
+        guac_protocol_send_error(socket, "Unable to join connection.",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(socket);
+        return;
+    }
+
+    if (guacd_join_route(found.pid, fd, connection_id)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to route viewer to process %i: %s",
+                (int) found.pid, strerror(errno));
+        guac_protocol_send_error(socket, "Unable to join connection.",
+                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+        guac_socket_flush(socket);
+    }
+    else
+        guacd_log(GUAC_LOG_DEBUG, "Viewer routed to process %i",
+                (int) found.pid);
+
+}
+
+/**
+ * Completes the handshake of the connection on the given socket, whose
+ * protocol has already been selected, running the resulting client with its
+ * own input and output threads until it disconnects. The client is listed
+ * within the connection registry while it runs.
+ *
+ * @param map The client map to add the new client to.
+ * @param registry The connection registry.
+ * @param config The configuration of guacd.
+ * @param socket The guac_socket of the connection.
+ * @param protocol The name of the selected protocol.
+ * @param plugin The client plugin for the selected protocol.
+ */
+static void guacd_run_client(guacd_client_map* map, guacd_registry* registry,
+        guacd_config* config, guac_socket* socket, const char* protocol,
+        guac_client_plugin* plugin) {
+
+    guacd_registry_entry* entry;
+    guac_client* client;
+    int shareable = 1;
+
+    /* Accept viewers joining the client of this process from elsewhere,
+     * refusing all viewers if they cannot reach this process */
+    if (plugin->viewers && guacd_join_listen(guacd_handle_join, map)) {
+        guacd_log(GUAC_LOG_WARNING, "Unable to receive joining connections: "
+                "%s. Connection will not be shared.", strerror(errno));
+        shareable = 0;
+    }
+
+    client = guacd_connect_client(map, config, socket, plugin, shareable);
+    if (client == NULL)
+        return;
+
+    entry = guacd_register_client(registry, client, protocol);
+
     /* Start client threads */
     guacd_log(GUAC_LOG_INFO, "Starting client");
-    if (guacd_client_start(client))
+    if (guacd_client_start(client, entry))
         guacd_log(GUAC_LOG_WARNING, "Client finished abnormally");
     else
         guacd_log(GUAC_LOG_INFO, "Client disconnected");
 
-    /* Remove client */
-    if (guacd_client_map_remove(map, client->connection_id) == NULL)
-        guacd_log(GUAC_LOG_ERROR, "Unable to remove client. Internal client storage has failed");
+    /* Remove and free client */
+    guacd_unregister_client(registry, entry);
+    guacd_map_remove(map, client);
+    guacd_free_client(client);
 
-    /* Free mimetype lists */
-    free(client->info.audio_mimetypes);
-    free(client->info.video_mimetypes);
+}
 
-    /* Free remaining instructions */
-    guac_instruction_free(audio);
-    guac_instruction_free(video);
-    guac_instruction_free(size);
+/**
+ * Creates a new guac_client for the connection on the given socket, adding
+ * it to the client map based on its ID. Per-connection defaults are taken
+ * from the given configuration. If the protocol has already been selected by
+ * the connection, its name must be given. Connections which select an
+ * existing connection instead join that connection as viewers, and may be
+ * routed to another process only if routable is non-zero.
+ */
+static void guacd_handle_connection(guacd_client_map* map,
+        guacd_registry* registry, guacd_config* config, guac_socket* socket,
+        int fd, int routable, const char* protocol) {
 
-    /* Clean up */
-    guac_client_free(client);
-    if (guac_client_plugin_close(plugin))
-        guacd_log_guac_error(GUAC_LOG_WARNING,
-                "Unable to close client plugin");
+    guac_client_plugin* plugin;
+    char* selected = NULL;
+
+    /* Each connection has its own process, and thus its own encoder pool */
+    guac_encoder_pool_set_threads(config->encoder_threads);
+
+    /* Read selected protocol if not already known */
+    if (protocol == NULL)
+        protocol = selected = guacd_read_select(socket);
+
+    /* Join existing connection if selected */
+    if (protocol != NULL && guacd_is_connection_id(protocol))
+        guacd_join_connection(map, registry, socket, fd, routable, protocol);
+
+    else if (protocol != NULL) {
+
+        plugin = guacd_open_plugin(protocol);
+        if (plugin != NULL) {
+            guacd_run_client(map, registry, config, socket, protocol,
+                    plugin);
+            guacd_close_plugin(plugin);
+        }
+
+    }
+
+    free(selected);
 
     /* Close socket */
     guac_socket_free(socket);
 
 }
 
+/**
+ * State shared by all connections which are handled by processes of their
+ * own.
+ */
+typedef struct guacd_process_context {
+
+    /**
+     * The client map which will contain the client of each connection.
+     */
+    guacd_client_map* map;
+
+    /**
+     * The connection registry shared by all guacd processes.
+     */
+    guacd_registry* registry;
+
+    /**
+     * The configuration of guacd.
+     */
+    guacd_config* config;
+
+#ifdef ENABLE_SSL
+    /**
+     * The SSL context to use for each connection, or NULL if SSL/TLS is not
+     * used.
+     */
+    SSL_CTX* ssl_context;
+#endif
+
+} guacd_process_context;
+
+/**
+ * Handles the connection having the given file descriptor within the current
+ * process, which is dedicated to that connection. This function is the
+ * guacd_prefork_handler of all prefork workers.
+ *
+ * @param fd The file descriptor of the connection.
+ * @param protocol The name of the protocol already selected by the
+ *                 connection, or NULL if the "select" instruction has not
+ *                 yet been read.
+ * @param data The guacd_process_context shared by all such connections.
+ */
+static void guacd_handle_process_connection(int fd, const char* protocol,
+        void* data) {
+
+    guacd_process_context* context = (guacd_process_context*) data;
+    guac_socket* socket;
+    int routable = 1;
+
+#ifdef ENABLE_SSL
+
+    /* If SSL chosen, use it */
+    if (context->ssl_context != NULL) {
+        socket = guac_socket_open_secure(context->ssl_context, fd);
+        if (socket == NULL) {
+            guacd_log_guac_error(GUAC_LOG_ERROR,
+                    "Unable to set up SSL/TLS");
+            return;
+        }
+        routable = 0;
+    }
+    else
+        socket = guac_socket_open(fd);
+#else
+    /* Open guac_socket */
+    socket = guac_socket_open(fd);
+#endif
+
+    guacd_handle_connection(context->map, context->registry, context->config,
+            socket, fd, routable, protocol);
+
+}
+
+/**
+ * A connection accepted while guacd handles the clients of event-driven
+ * client plugins using event threads, along with all resources which must be
+ * released once the connection is closed.
+ */
+typedef struct guacd_connection {
+
+    /**
+     * The client map which will contain the client of this connection.
+     */
+    guacd_client_map* map;
+
+    /**
+     * The connection registry shared by all guacd processes.
+     */
+    guacd_registry* registry;
+
+    /**
+     * The configuration of guacd.
+     */
+    guacd_config* config;
+
+    /**
+     * The socket connected to the launcher process which should hand the
+     * connection to a process of its own if its protocol is not
+     * event-driven.
+     */
+    int launcher_fd;
+
+    /**
+     * The file descriptor of the accepted connection.
+     */
+    int fd;
+
+    /**
+     * The name of the protocol selected by the connection, or NULL if no
+     * protocol has yet been selected.
+     */
+    char* protocol;
+
+    /**
+     * The guac_socket wrapping the file descriptor of the connection, or
+     * NULL if not yet opened.
+     */
+    guac_socket* socket;
+
+    /**
+     * The client plugin of the protocol selected by the connection, or NULL
+     * if no protocol has yet been selected.
+     */
+    guac_client_plugin* plugin;
+
+    /**
+     * The connection registry entry of the client of the connection, or NULL
+     * if the client is not registered.
+     */
+    guacd_registry_entry* entry;
+
+} guacd_connection;
+
+/**
+ * Releases all resources associated with the given connection, closing its
+ * file descriptor.
+ *
+ * @param connection The connection to close.
+ */
+static void guacd_close_connection(guacd_connection* connection) {
+
+    if (connection->plugin != NULL)
+        guacd_close_plugin(connection->plugin);
+
+    if (connection->socket != NULL)
+        guac_socket_free(connection->socket);
+
+    free(connection->protocol);
+
+    if (close(connection->fd) < 0)
+        guacd_log(GUAC_LOG_ERROR, "Error closing connection: %s",
+                strerror(errno));
+
+    free(connection);
+
+}
+
+/**
+ * Frees the given client, which was handled by the event threads, closing
+ * its connection. This function is the guacd_event_free_handler of all
+ * clients added to the event threads.
+ *
+ * @param client The client which has disconnected.
+ * @param data The guacd_connection of the client.
+ */
+static void guacd_free_event_client(guac_client* client, void* data) {
+
+    guacd_connection* connection = (guacd_connection*) data;
+
+    guacd_log(GUAC_LOG_INFO, "Client disconnected");
+
+    /* Remove and free client */
+    guacd_unregister_client(connection->registry, connection->entry);
+    guacd_map_remove(connection->map, client);
+    guacd_free_client(client);
+
+    guacd_close_connection(connection);
+
+}
+
+/**
+ * Reads a single byte from the connection of the given socket, which must
+ * be a socket allocated by guacd_open_select_socket(). Reading no more than
+ * one byte at a time guarantees that nothing beyond the instruction being
+ * parsed is consumed from the connection.
+ *
+ * @param socket The guac_socket being read.
+ * @param buf The buffer to read into.
+ * @param count The size of the buffer, which is ignored beyond the first
+ *              byte.
+ * @return The number of bytes read, zero at end of stream, or a negative
+ *         value if an error occurs.
+ */
+static ssize_t guacd_select_read_handler(guac_socket* socket, void* buf,
+        size_t count) {
+
+    guacd_connection* connection = (guacd_connection*) socket->data;
+
+    ssize_t retval = read(connection->fd, buf, 1);
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error reading data from socket";
+    }
+
+    return retval;
+
+}
+
+/**
+ * Waits for data on the connection of the given socket, which must be a
+ * socket allocated by guacd_open_select_socket().
+ *
+ * @param socket The guac_socket to wait on.
+ * @param usec_timeout The maximum number of microseconds to wait.
+ * @return Positive if data is available, zero if the timeout elapsed, or
+ *         negative if an error occurs.
+ */
+static int guacd_select_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guacd_connection* connection = (guacd_connection*) socket->data;
+
+    struct pollfd fds[] = {{
+        .fd      = connection->fd,
+        .events  = POLLIN,
+        .revents = 0
+    }};
+
+    int retval = poll(fds, 1, (usec_timeout + 999) / 1000);
+
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error while waiting for data on socket";
+    }
+
+    else if (retval == 0) {
+        guac_error = GUAC_STATUS_TIMEOUT;
+        guac_error_message = "Timeout while waiting for data on socket";
+    }
+
+    return retval;
+
+}
+
+/**
+ * Allocates a read-only guac_socket which reads the given connection without
+ * buffering anything beyond the instruction being read, such that the
+ * connection may still be handed to another process once "select" has been
+ * read, even if the client sent further instructions without waiting.
+ *
+ * @param connection The connection to read.
+ * @return A new guac_socket, or NULL if the socket cannot be allocated.
+ */
+static guac_socket* guacd_open_select_socket(guacd_connection* connection) {
+
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL)
+        return NULL;
+
+    socket->data = connection;
+    socket->read_handler = guacd_select_read_handler;
+    socket->select_handler = guacd_select_select_handler;
+
+    return socket;
+
+}
+
+/**
+ * Hands the given connection, whose protocol has already been selected, to
+ * the launcher process, which completes its handshake within a process of
+ * its own, as is done for all connections when event threads are not used.
+ * The process reads from the connection anew, which is safe as "select" is
+ * read without consuming anything further from the connection. The current
+ * process, having started threads, never forks itself. The resources of the
+ * connection remain the responsibility of the caller within the current
+ * process.
+ *
+ * @param connection The connection to hand to a process of its own.
+ */
+static void guacd_launch_connection(guacd_connection* connection) {
+
+    if (guacd_prefork_launch(connection->launcher_fd, connection->fd,
+                connection->protocol))
+        guacd_log(GUAC_LOG_ERROR, "Unable to hand connection to launcher "
+                "process: %s", strerror(errno));
+
+}
+
+/**
+ * Handles the given connection, which was accepted while guacd handles the
+ * clients of event-driven client plugins using event threads. Clients of
+ * event-driven client plugins are handed to the event threads, while all
+ * other connections are handed to processes of their own. This function is
+ * run in a thread of its own for each connection.
+ *
+ * @param data The guacd_connection to handle.
+ * @return Always NULL.
+ */
+static void* guacd_connection_thread(void* data) {
+
+    guacd_connection* connection = (guacd_connection*) data;
+    guac_socket* select_socket;
+    guac_client* client;
+
+    /* Read "select" alone, leaving anything sent afterwards unread until the
+     * process which will handle the connection is known */
+    select_socket = guacd_open_select_socket(connection);
+    if (select_socket == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to open socket");
+        guacd_close_connection(connection);
+        return NULL;
+    }
+
+    connection->protocol = guacd_read_select(select_socket);
+    guac_socket_free(select_socket);
+
+    if (connection->protocol == NULL) {
+        guacd_close_connection(connection);
+        return NULL;
+    }
+
+    /* Join existing connection if selected */
+    if (guacd_is_connection_id(connection->protocol)) {
+
+        connection->socket = guac_socket_open(connection->fd);
+        if (connection->socket == NULL) {
+            guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to open socket");
+            guacd_close_connection(connection);
+            return NULL;
+        }
+
+        guacd_join_connection(connection->map, connection->registry,
+                connection->socket, connection->fd, 1, connection->protocol);
+        guacd_close_connection(connection);
+        return NULL;
+
+    }
+
+    connection->plugin = guacd_open_plugin(connection->protocol);
+    if (connection->plugin == NULL) {
+        guacd_close_connection(connection);
+        return NULL;
+    }
+
+    /* Clients which cannot be driven by events retain a process of their
+     * own */
+    if (!connection->plugin->event_driven) {
+        guacd_launch_connection(connection);
+        guacd_close_connection(connection);
+        return NULL;
+    }
+
+    /* Open guac_socket which will not block the event threads */
+    connection->socket = guacd_event_socket_open(connection->fd);
+    if (connection->socket == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to open socket");
+        guacd_close_connection(connection);
+        return NULL;
+    }
+
+    /* Viewers of clients within this process always join locally */
+    client = guacd_connect_client(connection->map, connection->config,
+            connection->socket, connection->plugin, 1);
+    if (client == NULL) {
+        guacd_close_connection(connection);
+        return NULL;
+    }
+
+    connection->entry = guacd_register_client(connection->registry, client,
+            connection->protocol);
+
+    /* Hand client to event threads */
+    guacd_log(GUAC_LOG_INFO, "Starting client");
+    if (guacd_event_add(client, connection->socket, connection->entry,
+                guacd_free_event_client, connection) == 0)
+        return NULL;
+
+    /* Otherwise, run client using threads of its own */
+    if (guacd_client_start(client, connection->entry))
+        guacd_log(GUAC_LOG_WARNING, "Client finished abnormally");
+    else
+        guacd_log(GUAC_LOG_INFO, "Client disconnected");
+
+    /* Remove and free client */
+    guacd_unregister_client(connection->registry, connection->entry);
+    guacd_map_remove(connection->map, client);
+    guacd_free_client(client);
+
+    guacd_close_connection(connection);
+    return NULL;
+
+}
+
+/**
+ * Starts a new thread which handles the connection having the given file
+ * descriptor using guacd_connection_thread(). If the thread cannot be
+ * started, the connection is closed.
+ *
+ * @param map The client map which will contain the client of the connection.
+ * @param registry The connection registry shared by all guacd processes.
+ * @param config The configuration of guacd.
+ * @param launcher_fd The socket connected to the launcher process which
+ *                    should hand the connection to a process of its own if
+ *                    its protocol is not event-driven.
+ * @param fd The file descriptor of the accepted connection.
+ */
+static void guacd_handle_event_connection(guacd_client_map* map,
+        guacd_registry* registry, guacd_config* config, int launcher_fd,
+        int fd) {
+
+    pthread_t thread;
+    pthread_attr_t attributes;
+
+    guacd_connection* connection = calloc(1, sizeof(guacd_connection));
+    if (connection == NULL) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to allocate connection");
+        close(fd);
+        return;
+    }
+
+    connection->map = map;
+    connection->registry = registry;
+    connection->config = config;
+    connection->launcher_fd = launcher_fd;
+    connection->fd = fd;
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    if (pthread_create(&thread, &attributes, guacd_connection_thread,
+                connection)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to start connection thread");
+        guacd_close_connection(connection);
+    }
+
+    pthread_attr_destroy(&attributes);
+
+}
+
+/**
+ * Non-zero if the session table has been requested with SIGUSR1 and has not
+ * yet been logged, zero otherwise.
+ */
+static volatile sig_atomic_t guacd_session_table_requested = 0;
+
+/**
+ * Signal handler which requests that the session table be logged. This
+ * function is the handler of SIGUSR1 within the main daemon process.
+ *
+ * @param signum The signal received.
+ */
+static void guacd_request_session_table(int signum) {
+    guacd_session_table_requested = 1;
+}
+
+/**
+ * Logs the given connection as a row of the session table. This function is
+ * the guacd_registry_callback used by guacd_log_session_table().
+ *
+ * @param entry The registry entry of the connection.
+ * @param data Pointer to the current guac_timestamp.
+ */
+static void guacd_log_session(const guacd_registry_entry* entry, void* data) {
+
+    guac_timestamp now = *((guac_timestamp*) data);
+
+    guacd_log(GUAC_LOG_INFO, "Connection \"%s\": protocol %s, pid %i, "
+            "%lli seconds, %lli bytes in, %lli bytes out, %lli frames, "
+            "%lli ms lag, %lli of %lli mouse events coalesced",
+            entry->connection_id, entry->protocol,
+            (int) entry->pid, (long long) ((now - entry->started) / 1000),
+            (long long) entry->bytes_in, (long long) entry->bytes_out,
+            (long long) entry->frames, (long long) entry->lag,
+            (long long) entry->mouse_dropped,
+            (long long) entry->mouse_received);
+
+}
+
+/**
+ * Logs all connections within the given registry, first removing those of
+ * processes which no longer exist, followed by the state of the pool of
+ * prefork workers, if any.
+ *
+ * @param registry The connection registry.
+ * @param prefork_stats The shared statistics of the pool of prefork workers,
+ *                      or NULL if no such pool is used.
+ */
+static void guacd_log_session_table(guacd_registry* registry,
+        guacd_prefork_stats* prefork_stats) {
+
+    guac_timestamp now = guac_timestamp_current();
+    int count;
+
+    guacd_registry_sweep(registry);
+
+    count = guacd_registry_foreach(registry, guacd_log_session, &now);
+    guacd_log(GUAC_LOG_INFO, "%i active connection(s).", count);
+
+    if (prefork_stats != NULL)
+        guacd_log(GUAC_LOG_INFO, "%i of %i prefork workers ready, "
+                "%lli hits, %lli misses.", prefork_stats->ready,
+                prefork_stats->size, (long long) prefork_stats->hits,
+                (long long) prefork_stats->misses);
+
+}
+
 int redirect_fd(int fd, int flags) {
 
     /* Attempt to open bit bucket */
@@ -418,6 +1374,19 @@ int main(int argc, char* argv[]) {
 #endif
 
     guacd_client_map* map = guacd_client_map_alloc();
+    guacd_registry* registry;
+
+    /* Session table */
+    struct sigaction session_table_action;
+    sigset_t session_table_signals;
+    sigset_t wait_signals;
+    fd_set listen_fds;
+
+    /* Connection handling */
+    guacd_process_context context;
+    guacd_prefork_pool* prefork = NULL;
+    guacd_prefork_stats* prefork_stats = NULL;
+    int launcher_fd = -1;
 
     /* General */
     int retval;
@@ -434,6 +1403,14 @@ int main(int argc, char* argv[]) {
     /* Log start */
     guacd_log(GUAC_LOG_INFO, "Guacamole proxy daemon (guacd) version " VERSION " started");
 
+    /* Track connections within memory shared with all later processes */
+    registry = guacd_registry_alloc();
+    if (registry == NULL) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to allocate connection registry: %s",
+                strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
     /* Get addresses for binding */
     if ((retval = getaddrinfo(config->bind_host, config->bind_port,
                     &hints, &addresses))) {
@@ -566,6 +1543,13 @@ int main(int argc, char* argv[]) {
 
     }
 
+    /* Route viewers between processes using sockets within a directory of
+     * guacd's own */
+    if (guacd_join_init())
+        guacd_log(GUAC_LOG_WARNING, "Unable to create directory for joining "
+                "connections: %s. Connections handled by processes of their "
+                "own will not be shared.", strerror(errno));
+
     /* Ignore SIGPIPE */
     if (signal(SIGPIPE, SIG_IGN) == SIG_ERR) {
         guacd_log(GUAC_LOG_INFO, "Could not set handler for SIGPIPE to ignore. "
@@ -578,6 +1562,102 @@ int main(int argc, char* argv[]) {
                 "Child processes may pile up in the process table.");
     }
 
+    /* Log the session table upon SIGUSR1. The signal is blocked before any
+     * threads or processes are started, and is unblocked only while waiting
+     * for connections, such that only the daemon loop receives it. */
+    sigemptyset(&session_table_signals);
+    sigaddset(&session_table_signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &session_table_signals, &wait_signals);
+    sigdelset(&wait_signals, SIGUSR1);
+
+    session_table_action.sa_handler = guacd_request_session_table;
+    session_table_action.sa_flags = 0;
+    sigemptyset(&session_table_action.sa_mask);
+
+    if (sigaction(SIGUSR1, &session_table_action, NULL)) {
+        guacd_log(GUAC_LOG_INFO, "Could not set handler for SIGUSR1. "
+                "The session table will not be available.");
+    }
+
+    /* Connections handled by processes of their own share this context */
+    context.map = map;
+    context.registry = registry;
+    context.config = config;
+#ifdef ENABLE_SSL
+    context.ssl_context = ssl_context;
+#endif
+
+#ifdef ENABLE_SSL
+    /* Event threads do not support SSL/TLS */
+    if (config->event_threads > 0 && ssl_context != NULL) {
+        guacd_log(GUAC_LOG_WARNING, "Event threads cannot be used with "
+                "SSL/TLS. Each connection will have its own process.");
+        config->event_threads = 0;
+    }
+#endif
+
+    /* Share the statistics of any prefork workers with this process, even if
+     * the workers are kept by the launcher */
+    if (config->prefork_workers > 0) {
+        prefork_stats = guacd_prefork_stats_alloc();
+        if (prefork_stats == NULL)
+            guacd_log(GUAC_LOG_WARNING, "Unable to allocate shared memory "
+                    "for prefork statistics: %s", strerror(errno));
+    }
+
+    /* With event threads, connections of other protocols are handed to
+     * processes of their own by a launcher, forked before any threads are
+     * started, which also keeps any idle worker processes ready */
+    if (config->event_threads > 0) {
+
+        launcher_fd = guacd_prefork_launcher_start(config->prefork_workers,
+                config->prefork_protocols, guacd_handle_process_connection,
+                &context, prefork_stats);
+
+        if (launcher_fd < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to start launcher process: %s",
+                    strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+    }
+
+    /* Otherwise keep idle worker processes ready within this process, which
+     * remains single-threaded */
+    else if (config->prefork_workers > 0) {
+
+        prefork = guacd_prefork_pool_alloc(config->prefork_workers,
+                config->prefork_protocols, guacd_handle_process_connection,
+                &context, prefork_stats);
+
+        if (prefork == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to create prefork workers.");
+            exit(EXIT_FAILURE);
+        }
+
+    }
+
+    if (config->prefork_workers > 0)
+        guacd_log(GUAC_LOG_INFO, "Keeping %i prefork workers ready.",
+                config->prefork_workers);
+
+    /* Handle clients of event-driven client plugins using event threads,
+     * started only now that the process will no longer fork itself */
+    if (config->event_threads > 0) {
+
+        /* Connections handled by event threads share one encoder pool */
+        guac_encoder_pool_set_threads(config->encoder_threads);
+
+        if (guacd_event_start(config->event_threads)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to start event threads.");
+            exit(EXIT_FAILURE);
+        }
+
+        guacd_log(GUAC_LOG_INFO, "Using %i event threads for event-driven "
+                "protocols.", config->event_threads);
+
+    }
+
     /* Log listening status */
     guacd_log(GUAC_LOG_INFO, "Listening on host %s, port %s", bound_address, bound_port);
 
@@ -587,14 +1667,33 @@ int main(int argc, char* argv[]) {
     /* Daemon loop */
     for (;;) {
 
-        pid_t child_pid;
-
         /* Listen for connections */
         if (listen(socket_fd, 5) < 0) {
             guacd_log(GUAC_LOG_ERROR, "Could not listen on socket: %s", strerror(errno));
             return 3;
         }
 
+        /* Wait for connection, logging the session table if requested */
+        FD_ZERO(&listen_fds);
+        FD_SET(socket_fd, &listen_fds);
+        if (pselect(socket_fd + 1, &listen_fds, NULL, NULL, NULL,
+                    &wait_signals) < 0) {
+
+            if (errno != EINTR) {
+                guacd_log(GUAC_LOG_ERROR, "Could not wait for client "
+                        "connection: %s", strerror(errno));
+                return 3;
+            }
+
+            if (guacd_session_table_requested) {
+                guacd_session_table_requested = 0;
+                guacd_log_session_table(registry, prefork_stats);
+            }
+
+            continue;
+
+        }
+
         /* Accept connection */
         client_addr_len = sizeof(client_addr);
         connected_socket_fd = accept(socket_fd,
@@ -606,8 +1705,16 @@ int main(int argc, char* argv[]) {
             return 3;
         }
 
+        /* Hand connection to its own thread if using event threads */
+        if (config->event_threads > 0) {
+            guacd_handle_event_connection(map, registry, config,
+                    launcher_fd, connected_socket_fd);
+            continue;
+        }
+
         /* 
-         * Once connection is accepted, send child into background.
+         * Once connection is accepted, hand it to an idle worker process if
+         * one is ready, otherwise send child into background.
          *
          * Note that we prefer fork() over threads for connection-handling
          * processes as they give each connection its own memory area, and
@@ -615,42 +1722,27 @@ int main(int argc, char* argv[]) {
          * particular client plugin.
          */
 
-        child_pid = fork();
+        if (prefork == NULL || guacd_prefork_pool_dispatch(prefork,
+                    connected_socket_fd, NULL)) {
 
-        /* If error, log */
-        if (child_pid == -1)
-            guacd_log(GUAC_LOG_ERROR, "Error forking child process: %s", strerror(errno));
+            pid_t child_pid = fork();
 
-        /* If child, start client, and exit when finished */
-        else if (child_pid == 0) {
+            /* If error, log */
+            if (child_pid == -1)
+                guacd_log(GUAC_LOG_ERROR, "Error forking child process: %s", strerror(errno));
 
-            guac_socket* socket;
-
-#ifdef ENABLE_SSL
-
-            /* If SSL chosen, use it */
-            if (ssl_context != NULL) {
-                socket = guac_socket_open_secure(ssl_context, connected_socket_fd);
-                if (socket == NULL) {
-                    guacd_log_guac_error(GUAC_LOG_ERROR,
-                            "Unable to set up SSL/TLS");
-                    return 0;
-                }
+            /* If child, start client, and exit when finished */
+            else if (child_pid == 0) {
+                guacd_handle_process_connection(connected_socket_fd, NULL,
+                        &context);
+                close(connected_socket_fd);
+                return 0;
             }
-            else
-                socket = guac_socket_open(connected_socket_fd);
-#else
-            /* Open guac_socket */
-            socket = guac_socket_open(connected_socket_fd);
-#endif
 
-            guacd_handle_connection(map, socket);
-            close(connected_socket_fd);
-            return 0;
         }
 
-        /* If parent, close reference to child's descriptor */
-        else if (close(connected_socket_fd) < 0) {
+        /* Close daemon reference to child's descriptor */
+        if (close(connected_socket_fd) < 0) {
             guacd_log(GUAC_LOG_ERROR, "Error closing daemon reference to "
                     "child descriptor: %s", strerror(errno));
         }
@@ -0,0 +1,1189 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "event.h"
+#include "log.h"
+#include "registry.h"
+
+#include <guacamole/client.h>
+#include <guacamole/error.h>
+#include <guacamole/instruction.h>
+#include <guacamole/pacing.h>
+#include <guacamole/protocol.h>
+#include <guacamole/timestamp.h>
+
+#include <stdlib.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct guacd_event_connection;
+struct guacd_event_watch;
+
+/**
+ * The connection underlying a guac_socket opened with
+ * guacd_event_socket_open(), along with all output which has been written to
+ * that socket but not yet sent.
+ */
+typedef struct guacd_event_output {
+
+    /**
+     * The file descriptor of the connection.
+     */
+    int fd;
+
+    /**
+     * The epoll instance of the event thread handling the connection, or -1
+     * if the connection is not handled by an event thread, in which case
+     * all output is written immediately, blocking as necessary.
+     */
+    int epoll_fd;
+
+    /**
+     * The watch of the file descriptor within epoll_fd, which waits for the
+     * connection to become writable while output is queued.
+     */
+    struct guacd_event_watch* watch;
+
+    /**
+     * Output which has not yet been sent, beginning at offset start and
+     * ending at offset length.
+     */
+    char* pending;
+
+    /**
+     * The offset within pending of the first byte not yet sent.
+     */
+    size_t start;
+
+    /**
+     * The offset within pending just past the last byte queued.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for pending.
+     */
+    size_t size;
+
+    /**
+     * Non-zero if output can no longer be sent, zero otherwise.
+     */
+    int failed;
+
+    /**
+     * Non-zero once the connection is no longer handled by its event thread,
+     * in which case output is sent only if it can be sent without blocking,
+     * with the remainder sent as the socket is freed.
+     */
+    int closed;
+
+    /**
+     * Lock which guards all members of this structure other than fd.
+     */
+    pthread_mutex_t lock;
+
+} guacd_event_output;
+
+/**
+ * A single file descriptor of a connection which is being waited upon. The
+ * watch itself is the data associated with the file descriptor within epoll.
+ */
+typedef struct guacd_event_watch {
+
+    /**
+     * The connection owning the watched file descriptor.
+     */
+    struct guacd_event_connection* connection;
+
+    /**
+     * The watched file descriptor.
+     */
+    int fd;
+
+} guacd_event_watch;
+
+/**
+ * A connection whose client is driven by the events of an event thread.
+ */
+typedef struct guacd_event_connection {
+
+    /**
+     * The client of this connection.
+     */
+    guac_client* client;
+
+    /**
+     * The connection registry entry of the client, or NULL if the client is
+     * not registered.
+     */
+    guacd_registry_entry* entry;
+
+    /**
+     * The connection underlying the socket of the client, along with any
+     * output queued for that connection.
+     */
+    guacd_event_output* output;
+
+    /**
+     * Watch for instructions received on the socket of the client, and for
+     * the socket becoming writable while output is queued.
+     */
+    guacd_event_watch input;
+
+    /**
+     * Watch for messages signalled by the message_fd of the client. This
+     * watch is one-shot, and is re-armed only while the client is keeping up
+     * with the frames sent.
+     */
+    guacd_event_watch messages;
+
+    /**
+     * Non-zero if the messages watch has not been re-armed because too many
+     * frames are awaiting acknowledgement, zero otherwise.
+     */
+    int paused;
+
+    /**
+     * The time that data was last received from the client.
+     */
+    guac_timestamp last_input;
+
+    /**
+     * The number of mouse instructions received from the client.
+     */
+    long mouse_received;
+
+    /**
+     * The number of mouse instructions dropped due to coalescing.
+     */
+    long mouse_dropped;
+
+    /**
+     * The handler to call once the client has disconnected.
+     */
+    guacd_event_free_handler* free_handler;
+
+    /**
+     * Arbitrary data to pass to the free handler.
+     */
+    void* data;
+
+    /**
+     * The next connection handled by the same event thread, or NULL if this
+     * is the last such connection.
+     */
+    struct guacd_event_connection* next;
+
+} guacd_event_connection;
+
+/**
+ * An event thread, along with all connections that thread handles.
+ */
+typedef struct guacd_event_worker {
+
+    /**
+     * The epoll instance waiting on the file descriptors of all connections
+     * handled by this worker.
+     */
+    int epoll_fd;
+
+    /**
+     * The thread handling the events of this worker.
+     */
+    pthread_t thread;
+
+    /**
+     * Lock which guards the list of connections.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * All connections handled by this worker.
+     */
+    guacd_event_connection* connections;
+
+    /**
+     * The number of connections handled by this worker.
+     */
+    int connection_count;
+
+} guacd_event_worker;
+
+/**
+ * All event workers.
+ */
+static guacd_event_worker* __guacd_event_workers = NULL;
+
+/**
+ * The number of event workers.
+ */
+static int __guacd_event_worker_count = 0;
+
+/**
+ * Changes whether epoll waits for the connection of the given output to
+ * become writable, in addition to waiting for input. The output must be
+ * locked and handled by an event thread.
+ *
+ * @param output The output whose connection is being waited upon.
+ * @param writable Non-zero to wait for the connection to become writable,
+ *                 zero to wait only for input.
+ * @return Zero on success, non-zero if epoll could not be updated.
+ */
+static int __guacd_event_output_watch(guacd_event_output* output,
+        int writable) {
+
+    struct epoll_event event = {
+        .events   = writable ? EPOLLIN | EPOLLOUT : EPOLLIN,
+        .data.ptr = output->watch
+    };
+
+    return epoll_ctl(output->epoll_fd, EPOLL_CTL_MOD, output->fd, &event);
+
+}
+
+/**
+ * Sends the queued output of the given output, which must be locked.
+ *
+ * @param output The output whose queue should be sent.
+ * @param block Non-zero if all queued output should be sent, waiting for the
+ *              connection to become writable as necessary, zero if only
+ *              what can be sent without blocking should be sent.
+ * @return Zero if no error occurred, non-zero if the output has failed.
+ */
+static int __guacd_event_output_send(guacd_event_output* output,
+        int block) {
+
+    while (!output->failed && output->start < output->length) {
+
+        ssize_t written = write(output->fd, output->pending + output->start,
+                output->length - output->start);
+
+        if (written < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            /* Wait only if not handled by an event thread */
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+
+                struct pollfd fds[] = {{
+                    .fd      = output->fd,
+                    .events  = POLLOUT,
+                    .revents = 0
+                }};
+
+                if (!block)
+                    break;
+
+                if (poll(fds, 1, -1) >= 0 || errno == EINTR)
+                    continue;
+
+            }
+
+            output->failed = 1;
+            break;
+
+        }
+
+        output->start += written;
+
+    }
+
+    /* Reuse queue once empty */
+    if (output->start == output->length)
+        output->start = output->length = 0;
+
+    return output->failed;
+
+}
+
+/**
+ * Adds the given data to the queue of the given output, which must be
+ * locked, failing the output if the queue would grow beyond
+ * GUACD_EVENT_MAX_BACKLOG bytes.
+ *
+ * @param output The output to queue data for.
+ * @param buf The data to queue.
+ * @param count The number of bytes to queue.
+ * @return Zero if the data was queued, non-zero if the output has failed.
+ */
+static int __guacd_event_output_queue(guacd_event_output* output,
+        const void* buf, size_t count) {
+
+    size_t queued = output->length - output->start;
+
+    if (output->failed)
+        return 1;
+
+    if (queued + count > GUACD_EVENT_MAX_BACKLOG) {
+        output->failed = 1;
+        return 1;
+    }
+
+    /* Shift unsent data to start of queue, growing queue if necessary */
+    if (output->length + count > output->size) {
+
+        memmove(output->pending, output->pending + output->start, queued);
+        output->start = 0;
+        output->length = queued;
+
+        if (queued + count > output->size) {
+
+            size_t size = output->size * 2;
+            char* pending;
+
+            if (size < queued + count)
+                size = queued + count;
+
+            pending = realloc(output->pending, size);
+            if (pending == NULL) {
+                output->failed = 1;
+                return 1;
+            }
+
+            output->pending = pending;
+            output->size = size;
+
+        }
+
+    }
+
+    memcpy(output->pending + output->length, buf, count);
+    output->length += count;
+
+    return 0;
+
+}
+
+/**
+ * Writes the given buffers to the connection of the given output, queuing
+ * whatever cannot be sent immediately if the output is handled by an event
+ * thread, and otherwise blocking until everything is sent.
+ *
+ * @param output The output to write to.
+ * @param iov The buffers to write.
+ * @param iovcnt The number of buffers.
+ * @return Zero on success, non-zero if the output has failed.
+ */
+static int __guacd_event_output_write(guacd_event_output* output,
+        const struct iovec* iov, int iovcnt) {
+
+    ssize_t written = 0;
+    int was_empty;
+    int block;
+    int i;
+
+    pthread_mutex_lock(&output->lock);
+    block = (output->epoll_fd < 0 && !output->closed);
+
+    /* Preserve order of anything still queued */
+    if (__guacd_event_output_send(output, block)) {
+        pthread_mutex_unlock(&output->lock);
+        return 1;
+    }
+
+    was_empty = (output->length == 0);
+
+    /* Attempt to send immediately if nothing is queued */
+    if (was_empty) {
+
+        do {
+            written = writev(output->fd, iov, iovcnt);
+        } while (written < 0 && errno == EINTR);
+
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                output->failed = 1;
+                pthread_mutex_unlock(&output->lock);
+                return 1;
+            }
+            written = 0;
+        }
+
+    }
+
+    /* Queue whatever was not sent */
+    for (i = 0; i < iovcnt; i++) {
+
+        const char* base = (const char*) iov[i].iov_base;
+        size_t length = iov[i].iov_len;
+
+        if (written >= length) {
+            written -= length;
+            continue;
+        }
+
+        if (__guacd_event_output_queue(output, base + written,
+                    length - written)) {
+            pthread_mutex_unlock(&output->lock);
+            return 1;
+        }
+
+        written = 0;
+
+    }
+
+    /* Send any queued data, waiting for the connection to become writable
+     * if handled by an event thread */
+    if (output->epoll_fd < 0)
+        __guacd_event_output_send(output, block);
+
+    else if (was_empty && output->length > 0
+            && __guacd_event_output_watch(output, 1))
+        output->failed = 1;
+
+    pthread_mutex_unlock(&output->lock);
+    return output->failed;
+
+}
+
+/**
+ * Sends as much queued output of the given connection as can be sent without
+ * blocking, ceasing to wait for the connection to become writable once all
+ * output has been sent.
+ *
+ * @param connection The connection whose socket has become writable.
+ * @return Zero if no error occurred, non-zero if the output has failed.
+ */
+static int __guacd_event_output_drain(guacd_event_connection* connection) {
+
+    guacd_event_output* output = connection->output;
+    int failed;
+
+    pthread_mutex_lock(&output->lock);
+
+    failed = __guacd_event_output_send(output, 0);
+    if (!failed && output->length == 0
+            && __guacd_event_output_watch(output, 0))
+        failed = output->failed = 1;
+
+    pthread_mutex_unlock(&output->lock);
+
+    return failed;
+
+}
+
+/**
+ * Returns whether the given output has failed, such that no further output
+ * can be sent.
+ *
+ * @param output The output to check.
+ * @return Non-zero if the output has failed, zero otherwise.
+ */
+static int __guacd_event_output_failed(guacd_event_output* output) {
+
+    int failed;
+
+    pthread_mutex_lock(&output->lock);
+    failed = output->failed;
+    pthread_mutex_unlock(&output->lock);
+
+    return failed;
+
+}
+
+static ssize_t __guacd_event_socket_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guacd_event_output* output = (guacd_event_output*) socket->data;
+    ssize_t retval;
+
+    for (;;) {
+
+        retval = read(output->fd, buf, count);
+
+        /* Wait for data as a blocking socket would, which happens only if
+         * readiness was reported spuriously */
+        if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+
+            struct pollfd fds[] = {{
+                .fd      = output->fd,
+                .events  = POLLIN,
+                .revents = 0
+            }};
+
+            if (poll(fds, 1, -1) >= 0 || errno == EINTR)
+                continue;
+
+        }
+
+        else if (retval < 0 && errno == EINTR)
+            continue;
+
+        break;
+
+    }
+
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error reading data from socket";
+    }
+
+    return retval;
+
+}
+
+static ssize_t __guacd_event_socket_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    struct iovec iov = {
+        .iov_base = (void*) buf,
+        .iov_len  = count
+    };
+
+    if (__guacd_event_output_write((guacd_event_output*) socket->data,
+                &iov, 1)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error writing data to socket";
+        return -1;
+    }
+
+    return count;
+
+}
+
+static ssize_t __guacd_event_socket_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    ssize_t count = 0;
+    int i;
+
+    if (__guacd_event_output_write((guacd_event_output*) socket->data,
+                iov, iovcnt)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error writing data to socket";
+        return -1;
+    }
+
+    for (i = 0; i < iovcnt; i++)
+        count += iov[i].iov_len;
+
+    return count;
+
+}
+
+static int __guacd_event_socket_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guacd_event_output* output = (guacd_event_output*) socket->data;
+
+    struct pollfd fds[] = {{
+        .fd      = output->fd,
+        .events  = POLLIN,
+        .revents = 0
+    }};
+
+    int retval;
+
+    if (usec_timeout < 0)
+        retval = poll(fds, 1, -1);
+    else
+        retval = poll(fds, 1, (usec_timeout + 999) / 1000);
+
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error while waiting for data on socket";
+    }
+
+    else if (retval == 0) {
+        guac_error = GUAC_STATUS_TIMEOUT;
+        guac_error_message = "Timeout while waiting for data on socket";
+    }
+
+    return retval;
+
+}
+
+static int __guacd_event_socket_free_handler(guac_socket* socket) {
+
+    guacd_event_output* output = (guacd_event_output*) socket->data;
+    guac_timestamp deadline;
+
+    /* Send anything still buffered, waiting briefly for queued output to be
+     * sent */
+    guac_socket_flush(socket);
+    deadline = guac_timestamp_current() + GUACD_EVENT_DRAIN_TIMEOUT;
+
+    pthread_mutex_lock(&output->lock);
+
+    while (!output->failed && output->length > 0) {
+
+        struct pollfd fds[] = {{
+            .fd      = output->fd,
+            .events  = POLLOUT,
+            .revents = 0
+        }};
+
+        int remaining = deadline - guac_timestamp_current();
+        if (remaining <= 0 || poll(fds, 1, remaining) <= 0)
+            break;
+
+        __guacd_event_output_send(output, 0);
+
+    }
+
+    pthread_mutex_unlock(&output->lock);
+
+    pthread_mutex_destroy(&output->lock);
+    free(output->pending);
+    free(output);
+
+    return 0;
+
+}
+
+/**
+ * Returns whether the client of the given connection has fallen so far behind
+ * that further frames should be withheld until more are acknowledged, or
+ * until more of the output already queued has been sent.
+ *
+ * @param connection The connection to check.
+ * @return Non-zero if frames should be withheld, zero otherwise.
+ */
+static int __guacd_event_lagging(guacd_event_connection* connection) {
+
+    guac_client* client = connection->client;
+    guacd_event_output* output = connection->output;
+    size_t queued;
+
+    pthread_mutex_lock(&output->lock);
+    queued = output->length - output->start;
+    pthread_mutex_unlock(&output->lock);
+
+    return queued >= GUACD_EVENT_MAX_BACKLOG / 2
+        || client->last_sent_timestamp - client->last_received_timestamp
+            >= guac_pacing_get_max_lag(client->pacing);
+
+}
+
+/**
+ * Re-arms the one-shot messages watch of the given connection, such that
+ * the next message signalled will again be handled.
+ *
+ * @param worker The worker handling the connection.
+ * @param connection The connection whose messages watch should be re-armed.
+ */
+static void __guacd_event_arm(guacd_event_worker* worker,
+        guacd_event_connection* connection) {
+
+    struct epoll_event event = {
+        .events   = EPOLLIN | EPOLLONESHOT,
+        .data.ptr = &connection->messages
+    };
+
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, connection->messages.fd,
+                &event)) {
+        guac_client_log(connection->client, GUAC_LOG_ERROR,
+                "Unable to wait for server messages: %s", strerror(errno));
+        guac_client_stop(connection->client);
+    }
+
+}
+
+/**
+ * Resumes handling of the messages of the given connection if they were
+ * paused and the client has since caught up.
+ *
+ * @param worker The worker handling the connection.
+ * @param connection The connection to resume, if paused.
+ */
+static void __guacd_event_resume(guacd_event_worker* worker,
+        guacd_event_connection* connection) {
+
+    if (connection->paused && !__guacd_event_lagging(connection)) {
+        connection->paused = 0;
+        __guacd_event_arm(worker, connection);
+    }
+
+}
+
+/**
+ * Handles all instructions received thus far on the socket of the given
+ * connection, without waiting for any further data.
+ *
+ * @param worker The worker handling the connection.
+ * @param connection The connection whose socket is readable.
+ * @param instructions An array of GUACD_INSTRUCTION_BATCH_SIZE instructions
+ *                     which may be used for parsing.
+ */
+static void __guacd_event_handle_input(guacd_event_worker* worker,
+        guacd_event_connection* connection, guac_instruction* instructions) {
+
+    guac_client* client = connection->client;
+    guac_socket* socket = client->socket;
+
+    int count;
+
+    /* Read instruction, leaving any incomplete instruction buffered */
+    if (guac_instruction_read_into(socket, 0, &instructions[0])) {
+
+        if (guac_error == GUAC_STATUS_TIMEOUT) {
+            connection->last_input = guac_timestamp_current();
+            return;
+        }
+
+        if (guac_error != GUAC_STATUS_CLOSED)
+            guacd_client_log_guac_error(client, GUAC_LOG_WARNING,
+                    "Guacamole connection failure");
+
+        guac_client_stop(client);
+        return;
+
+    }
+
+    connection->last_input = guac_timestamp_current();
+
+    /* Handle everything received in the same burst */
+    count = 1 + guac_instruction_read_buffered(socket, &instructions[1],
+            GUACD_INSTRUCTION_BATCH_SIZE - 1);
+
+    do {
+        guacd_client_handle_instructions(client, instructions, count,
+                &connection->mouse_received, &connection->mouse_dropped);
+        count = guac_instruction_read_buffered(socket, instructions,
+                GUACD_INSTRUCTION_BATCH_SIZE);
+    } while (count > 0 && client->state == GUAC_CLIENT_RUNNING);
+
+    /* Publish coalescing statistics */
+    if (connection->entry != NULL)
+        guacd_registry_update_input(connection->entry,
+                connection->mouse_received, connection->mouse_dropped);
+
+    /* Received syncs may allow further frames */
+    __guacd_event_resume(worker, connection);
+
+}
+
+/**
+ * Handles the pending server messages of the given connection, ending the
+ * frame afterwards. If the client is not keeping up, handling of messages is
+ * paused instead.
+ *
+ * @param worker The worker handling the connection.
+ * @param connection The connection whose message_fd is readable.
+ */
+static void __guacd_event_handle_messages(guacd_event_worker* worker,
+        guacd_event_connection* connection) {
+
+    guac_client* client = connection->client;
+
+    /* Withhold frames until the client catches up */
+    if (__guacd_event_lagging(connection)) {
+        connection->paused = 1;
+        return;
+    }
+
+    if (client->handle_messages(client)) {
+        guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
+                "Error handling server messages");
+        guac_client_stop(client);
+        return;
+    }
+
+    if (guacd_client_end_frame(client, connection->entry))
+        return;
+
+    __guacd_event_arm(worker, connection);
+
+}
+
+/**
+ * Frees the given connection, which is no longer handled by any worker,
+ * invoking its free handler. This function is run in a thread of its own.
+ *
+ * @param data The connection to free.
+ * @return Always NULL.
+ */
+static void* __guacd_event_free_thread(void* data) {
+
+    guacd_event_connection* connection = (guacd_event_connection*) data;
+
+    guac_client_log(connection->client, GUAC_LOG_DEBUG,
+            "Connection events stopped. %li of %li mouse events coalesced.",
+            connection->mouse_dropped, connection->mouse_received);
+
+    connection->free_handler(connection->client, connection->data);
+    free(connection);
+
+    return NULL;
+
+}
+
+/**
+ * Removes the given connection from the given worker, which must be locked,
+ * and frees the connection in a separate thread.
+ *
+ * @param worker The worker handling the connection.
+ * @param connection The connection to remove.
+ */
+static void __guacd_event_remove(guacd_event_worker* worker,
+        guacd_event_connection* connection) {
+
+    pthread_t thread;
+    pthread_attr_t attributes;
+
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, connection->input.fd, NULL);
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, connection->messages.fd, NULL);
+    worker->connection_count--;
+
+    /* Output can no longer be sent by this worker */
+    pthread_mutex_lock(&connection->output->lock);
+    connection->output->epoll_fd = -1;
+    connection->output->closed = 1;
+    pthread_mutex_unlock(&connection->output->lock);
+
+    /* Free without blocking other connections, or inline as a last resort */
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attributes, __guacd_event_free_thread,
+                connection))
+        __guacd_event_free_thread(connection);
+    pthread_attr_destroy(&attributes);
+
+}
+
+/**
+ * Performs periodic maintenance of all connections handled by the given
+ * worker, aborting unresponsive clients, sending keep-alive frames to idle
+ * clients, resuming paused clients which have caught up, and removing clients
+ * which have disconnected.
+ *
+ * @param worker The worker whose connections should be maintained.
+ */
+static void __guacd_event_maintain(guacd_event_worker* worker) {
+
+    guac_timestamp now = guac_timestamp_current();
+    guacd_event_connection** current;
+
+    pthread_mutex_lock(&worker->lock);
+
+    current = &worker->connections;
+    while (*current != NULL) {
+
+        guacd_event_connection* connection = *current;
+        guac_client* client = connection->client;
+
+        /* Stop clients which can no longer be sent output */
+        if (client->state == GUAC_CLIENT_RUNNING
+                && __guacd_event_output_failed(connection->output)) {
+            guac_client_log(client, GUAC_LOG_INFO, "Client is not "
+                    "receiving output.");
+            guac_client_stop(client);
+        }
+
+        if (client->state == GUAC_CLIENT_RUNNING) {
+
+            /* Abort clients which have stopped responding */
+            if (now - connection->last_input > GUACD_TIMEOUT)
+                guac_client_abort(client, GUAC_PROTOCOL_STATUS_CLIENT_TIMEOUT,
+                        "Client is not responding.");
+
+            else {
+
+                /* Ensure idle clients continue to respond */
+                if (now - client->last_sent_timestamp >= GUACD_SYNC_FREQUENCY)
+                    guacd_client_end_frame(client, connection->entry);
+
+                __guacd_event_resume(worker, connection);
+
+            }
+
+        }
+
+        /* Remove clients which are no longer running */
+        if (client->state != GUAC_CLIENT_RUNNING) {
+            *current = connection->next;
+            __guacd_event_remove(worker, connection);
+            continue;
+        }
+
+        current = &connection->next;
+
+    }
+
+    pthread_mutex_unlock(&worker->lock);
+
+}
+
+/**
+ * Waits for and handles the events of all connections of the given worker
+ * for the life of guacd.
+ *
+ * @param data The worker to run.
+ * @return Always NULL.
+ */
+static void* __guacd_event_worker_thread(void* data) {
+
+    guacd_event_worker* worker = (guacd_event_worker*) data;
+    struct epoll_event events[GUACD_EVENT_MAX_EVENTS];
+
+    /* Instructions are parsed in place and reused for all connections */
+    guac_instruction instructions[GUACD_INSTRUCTION_BATCH_SIZE];
+
+    guac_timestamp last_maintained = guac_timestamp_current();
+
+    for (;;) {
+
+        int i;
+        int count = epoll_wait(worker->epoll_fd, events,
+                GUACD_EVENT_MAX_EVENTS, GUACD_MESSAGE_HANDLE_FREQUENCY);
+
+        if (count < 0 && errno != EINTR) {
+            guacd_log(GUAC_LOG_ERROR, "Error waiting for events: %s",
+                    strerror(errno));
+            break;
+        }
+
+        /* Handle all ready connections */
+        for (i = 0; i < count; i++) {
+
+            guacd_event_watch* watch = (guacd_event_watch*) events[i].data.ptr;
+            guacd_event_connection* connection = watch->connection;
+
+            /* Ignore remaining events of stopped clients until removed */
+            if (connection->client->state != GUAC_CLIENT_RUNNING)
+                continue;
+
+            if (watch != &connection->input) {
+                __guacd_event_handle_messages(worker, connection);
+                continue;
+            }
+
+            /* Send queued output as the connection becomes writable */
+            if ((events[i].events & EPOLLOUT)
+                    && __guacd_event_output_drain(connection)) {
+                guac_client_stop(connection->client);
+                continue;
+            }
+
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                __guacd_event_handle_input(worker, connection, instructions);
+
+        }
+
+        /* Maintain connections at the rate messages would otherwise be
+         * checked */
+        if (guac_timestamp_current() - last_maintained
+                >= GUACD_MESSAGE_HANDLE_FREQUENCY) {
+            __guacd_event_maintain(worker);
+            last_maintained = guac_timestamp_current();
+        }
+
+    }
+
+    return NULL;
+
+}
+
+int guacd_event_start(int threads) {
+
+    int i;
+
+    __guacd_event_workers = calloc(threads, sizeof(guacd_event_worker));
+    if (__guacd_event_workers == NULL)
+        return 1;
+
+    for (i = 0; i < threads; i++) {
+
+        guacd_event_worker* worker = &__guacd_event_workers[i];
+
+        worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (worker->epoll_fd < 0) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to create event queue: %s",
+                    strerror(errno));
+            return 1;
+        }
+
+        pthread_mutex_init(&worker->lock, NULL);
+
+        if (pthread_create(&worker->thread, NULL,
+                    __guacd_event_worker_thread, worker)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to start event thread");
+            close(worker->epoll_fd);
+            return 1;
+        }
+
+        /* Workers become usable only once started */
+        __guacd_event_worker_count++;
+
+    }
+
+    return 0;
+
+}
+
+guac_socket* guacd_event_socket_open(int fd) {
+
+    guac_socket* socket;
+
+    guacd_event_output* output = calloc(1, sizeof(guacd_event_output));
+    if (output == NULL)
+        return NULL;
+
+    output->fd = fd;
+    output->epoll_fd = -1;
+    pthread_mutex_init(&output->lock, NULL);
+
+    socket = guac_socket_alloc();
+    if (socket == NULL) {
+        pthread_mutex_destroy(&output->lock);
+        free(output);
+        return NULL;
+    }
+
+    socket->data = output;
+    socket->read_handler   = __guacd_event_socket_read_handler;
+    socket->write_handler  = __guacd_event_socket_write_handler;
+    socket->writev_handler = __guacd_event_socket_writev_handler;
+    socket->select_handler = __guacd_event_socket_select_handler;
+    socket->free_handler   = __guacd_event_socket_free_handler;
+
+    return socket;
+
+}
+
+int guacd_event_add(guac_client* client, guac_socket* socket,
+        guacd_registry_entry* entry, guacd_event_free_handler* free_handler,
+        void* data) {
+
+    int i;
+    guacd_event_worker* worker;
+    guacd_event_connection* connection;
+    guacd_event_output* output = (guacd_event_output*) socket->data;
+    struct epoll_event event;
+    int fd = output->fd;
+
+    if (__guacd_event_worker_count == 0 || client->message_fd < 0)
+        return 1;
+
+    /* Output must never block the event thread */
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK)) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Unable to make connection non-blocking: %s",
+                strerror(errno));
+        return 1;
+    }
+
+    connection = calloc(1, sizeof(guacd_event_connection));
+    if (connection == NULL)
+        return 1;
+
+    connection->client = client;
+    connection->entry = entry;
+    connection->output = output;
+    connection->input.connection = connection;
+    connection->input.fd = fd;
+    connection->messages.connection = connection;
+    connection->messages.fd = client->message_fd;
+    connection->last_input = guac_timestamp_current();
+    connection->free_handler = free_handler;
+    connection->data = data;
+
+    /* Choose least busy worker */
+    worker = &__guacd_event_workers[0];
+    for (i = 1; i < __guacd_event_worker_count; i++) {
+        if (__guacd_event_workers[i].connection_count
+                < worker->connection_count)
+            worker = &__guacd_event_workers[i];
+    }
+
+    pthread_mutex_lock(&worker->lock);
+    pthread_mutex_lock(&output->lock);
+
+    /* Wait for instructions, and for the connection to become writable if
+     * output is queued */
+    event.events = output->length > 0 ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = &connection->input;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event)) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Unable to wait for instructions: %s", strerror(errno));
+        pthread_mutex_unlock(&output->lock);
+        pthread_mutex_unlock(&worker->lock);
+        free(connection);
+        return 1;
+    }
+
+    /* Queue output which cannot be sent immediately from now on */
+    output->epoll_fd = worker->epoll_fd;
+    output->watch = &connection->input;
+    pthread_mutex_unlock(&output->lock);
+
+    /* Wait for server messages */
+    event.events = EPOLLIN | EPOLLONESHOT;
+    event.data.ptr = &connection->messages;
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, client->message_fd,
+                &event)) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Unable to wait for server messages: %s", strerror(errno));
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+
+        pthread_mutex_lock(&output->lock);
+        output->epoll_fd = -1;
+        pthread_mutex_unlock(&output->lock);
+
+        pthread_mutex_unlock(&worker->lock);
+        free(connection);
+        return 1;
+    }
+
+    connection->next = worker->connections;
+    worker->connections = connection;
+    worker->connection_count++;
+
+    pthread_mutex_unlock(&worker->lock);
+
+    return 0;
+
+}
+
+#else
+
+int guacd_event_start(int threads) {
+    guacd_log(GUAC_LOG_ERROR, "Event-driven mode is not supported on this "
+            "platform.");
+    return 1;
+}
+
+guac_socket* guacd_event_socket_open(int fd) {
+    return guac_socket_open(fd);
+}
+
+int guacd_event_add(guac_client* client, guac_socket* socket,
+        guacd_registry_entry* entry, guacd_event_free_handler* free_handler,
+        void* data) {
+    return 1;
+}
+
+#endif
+
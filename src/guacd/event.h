@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _GUACD_EVENT_H
+#define _GUACD_EVENT_H
+
+#include "config.h"
+#include "registry.h"
+
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The maximum number of threads which may be used to handle connections in
+ * event-driven mode.
+ */
+#define GUACD_EVENT_MAX_THREADS 64
+
+/**
+ * The maximum number of events to handle per wait within each event thread.
+ */
+#define GUACD_EVENT_MAX_EVENTS 64
+
+/**
+ * The maximum number of bytes of output which may be queued for a connection
+ * handled by the event threads while that connection is not reading. Once
+ * exceeded, all further output fails, and the connection is closed.
+ */
+#define GUACD_EVENT_MAX_BACKLOG 8388608
+
+/**
+ * The maximum number of milliseconds to wait for queued output to be sent
+ * once a connection handled by the event threads is closed.
+ */
+#define GUACD_EVENT_DRAIN_TIMEOUT 1000
+
+/**
+ * Handler which is called once a client handled by the event threads has
+ * disconnected and no longer has any events pending, and thus may be freed.
+ * The handler is called from a thread of its own, such that freeing the client
+ * cannot stall other connections.
+ *
+ * @param client The client which has disconnected.
+ * @param data The arbitrary data given when the client was added.
+ */
+typedef void guacd_event_free_handler(guac_client* client, void* data);
+
+/**
+ * Starts the given number of event threads, each of which waits for and
+ * handles the events of its own share of the connections added with
+ * guacd_event_add(). This function may be called only once.
+ *
+ * @param threads The number of event threads to start.
+ * @return Zero if all threads were started successfully, non-zero otherwise.
+ */
+int guacd_event_start(int threads);
+
+/**
+ * Opens a new guac_socket for the connection having the given file
+ * descriptor, suitable for use by a client which will be added to the event
+ * threads with guacd_event_add(). Until the client is added, the socket
+ * blocks like any other guac_socket. Once added, the file descriptor is made
+ * non-blocking, and output which cannot be sent immediately is queued and
+ * sent by the event thread as the connection becomes writable, such that a
+ * connection which stops reading never stalls the other connections of its
+ * event thread.
+ *
+ * @param fd The file descriptor of the connection.
+ * @return A new guac_socket, or NULL if the socket cannot be allocated.
+ */
+guac_socket* guacd_event_socket_open(int fd);
+
+/**
+ * Adds the given client, which must already be initialized by its client
+ * plugin, to the least busy event thread. Instructions received on the
+ * client's socket and messages signalled by its message_fd are handled by
+ * that thread as they arrive, and the client is passed to the given free
+ * handler once it has disconnected. The client must have a valid message_fd.
+ *
+ * @param client The client to add.
+ * @param socket The socket of the connection of the given client, as opened
+ *               with guacd_event_socket_open(), which remains the
+ *               responsibility of the caller.
+ * @param entry The connection registry entry of the client, which will be
+ *              updated after each frame, or NULL if the client is not
+ *              registered.
+ * @param free_handler The handler to call once the client has disconnected.
+ * @param data Arbitrary data to pass to the free handler.
+ * @return Zero if the client was added successfully, non-zero otherwise, in
+ *         which case the client remains the responsibility of the caller.
+ */
+int guacd_event_add(guac_client* client, guac_socket* socket,
+        guacd_registry_entry* entry, guacd_event_free_handler* free_handler,
+        void* data);
+
+#endif
+
@@ -0,0 +1,579 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#ifdef HAVE_STRUCT_UCRED_PID
+/* Required for struct ucred, as retrieved with SO_PEERCRED */
+#define _GNU_SOURCE
+#endif
+
+#include "join.h"
+#include "log.h"
+#include "registry.h"
+
+#include <errno.h>
+
+#if defined(HAVE_STRUCT_UCRED_PID) || HAVE_DECL_GETPEEREID
+
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/**
+ * The maximum number of file descriptors accepted within a single message
+ * by __guacd_join_receive(). Only the first is used, with any others being
+ * closed.
+ */
+#define GUACD_JOIN_RECEIVE_FDS 16
+
+/* SIGPIPE is ignored by guacd where sends cannot suppress it */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+/**
+ * The path of the directory created by guacd_join_init(), or an empty string
+ * if no such directory exists. As the directory is created before any other
+ * processes are forked, this path is shared by all guacd processes.
+ */
+static char __guacd_join_directory[PATH_MAX] = "";
+
+/**
+ * The ID of the process which created the directory within
+ * __guacd_join_directory, and which must remove it upon exit.
+ */
+static pid_t __guacd_join_directory_owner = 0;
+
+/**
+ * The path of the socket created by guacd_join_listen() within the current
+ * process, or an empty string if guacd_join_listen() has not succeeded.
+ */
+static char __guacd_join_socket[PATH_MAX] = "";
+
+/**
+ * The ID of the process which created the socket within
+ * __guacd_join_socket, and which must remove it upon exit.
+ */
+static pid_t __guacd_join_socket_owner = 0;
+
+/**
+ * A joining connection received by guacd_join_listen(), awaiting handling
+ * within a thread of its own.
+ */
+typedef struct guacd_join {
+
+    /**
+     * The handler given to guacd_join_listen().
+     */
+    guacd_join_handler* handler;
+
+    /**
+     * The data given to guacd_join_listen().
+     */
+    void* data;
+
+    /**
+     * The file descriptor of the socket connected to the sending process,
+     * from which the joining connection is received.
+     */
+    int route_fd;
+
+    /**
+     * The file descriptor of the joining connection, or -1 if not yet
+     * received.
+     */
+    int fd;
+
+    /**
+     * The ID of the connection being joined.
+     */
+    char connection_id[GUACD_REGISTRY_ID_SIZE];
+
+} guacd_join;
+
+/**
+ * The listening socket of the current process, along with the handler of
+ * each received connection.
+ */
+typedef struct guacd_join_listener {
+
+    /**
+     * The handler given to guacd_join_listen().
+     */
+    guacd_join_handler* handler;
+
+    /**
+     * The data given to guacd_join_listen().
+     */
+    void* data;
+
+    /**
+     * The file descriptor of the socket receiving joining connections.
+     */
+    int fd;
+
+} guacd_join_listener;
+
+/**
+ * Removes the socket and directory created within the current process, if
+ * any, ignoring those inherited from the process which created them. This
+ * function is registered with atexit().
+ */
+static void __guacd_join_cleanup() {
+
+    if (__guacd_join_socket_owner == getpid())
+        unlink(__guacd_join_socket);
+
+    /* Remove directory along with any sockets left by processes which did
+     * not exit cleanly */
+    if (__guacd_join_directory_owner == getpid()) {
+
+        DIR* dir = opendir(__guacd_join_directory);
+        if (dir != NULL) {
+
+            struct dirent* entry;
+            while ((entry = readdir(dir)) != NULL) {
+
+                char path[PATH_MAX];
+
+                if (strcmp(entry->d_name, ".") == 0
+                        || strcmp(entry->d_name, "..") == 0)
+                    continue;
+
+                if (snprintf(path, sizeof(path), "%s/%s",
+                            __guacd_join_directory, entry->d_name)
+                        < (int) sizeof(path))
+                    unlink(path);
+
+            }
+
+            closedir(dir);
+
+        }
+
+        rmdir(__guacd_join_directory);
+
+    }
+
+}
+
+/**
+ * Populates the given address with the path of the socket of the guacd
+ * process having the given process ID.
+ *
+ * @param address The address to populate.
+ * @param pid The process ID of the guacd process.
+ * @return Zero if the address was populated, non-zero if no directory was
+ *         created by guacd_join_init() or the path is too long, in which
+ *         case errno is set appropriately.
+ */
+static int __guacd_join_address(struct sockaddr_un* address, pid_t pid) {
+
+    int length;
+
+    if (__guacd_join_directory[0] == '\0') {
+        errno = ENOENT;
+        return 1;
+    }
+
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+
+    length = snprintf(address->sun_path, sizeof(address->sun_path),
+            GUACD_JOIN_SOCKET_PATH, __guacd_join_directory, (int) pid);
+
+    if (length >= (int) sizeof(address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Returns whether the process connected to the given socket is running as
+ * the same user as the current process and, if a process ID is given and the
+ * platform can report the ID of the connected process, is that process.
+ * Where only the user can be checked, the directory containing the sockets,
+ * being accessible only by that user, still prevents any other process from
+ * listening in place of the expected process.
+ *
+ * @param fd The file descriptor of a connected UNIX socket.
+ * @param pid The ID of the process expected to be connected, or zero if any
+ *            process may be connected.
+ * @return Non-zero if the connected process is trusted, zero otherwise.
+ */
+static int __guacd_join_peer_trusted(int fd, pid_t pid) {
+
+#ifdef HAVE_STRUCT_UCRED_PID
+
+    struct ucred credentials;
+    socklen_t length = sizeof(credentials);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &credentials, &length))
+        return 0;
+
+    return credentials.uid == geteuid() && (pid == 0 || credentials.pid == pid);
+
+#else
+
+    uid_t uid;
+    gid_t gid;
+
+    if (getpeereid(fd, &uid, &gid))
+        return 0;
+
+    return uid == geteuid();
+
+#endif
+
+}
+
+/**
+ * Receives a single joining connection from the given socket, connected to
+ * the sending process, populating the given guacd_join. Any file
+ * descriptors beyond the first are closed.
+ *
+ * @param fd The file descriptor of the connected socket.
+ * @param join The guacd_join to populate.
+ * @return Zero if a joining connection was received, non-zero otherwise.
+ */
+static int __guacd_join_receive(int fd, guacd_join* join) {
+
+    char control[CMSG_SPACE(sizeof(int) * GUACD_JOIN_RECEIVE_FDS)];
+    struct msghdr message;
+    struct cmsghdr* header;
+    struct iovec iov;
+    ssize_t received;
+
+    iov.iov_base = join->connection_id;
+    iov.iov_len = sizeof(join->connection_id) - 1;
+
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    do {
+        received = recvmsg(fd, &message, 0);
+    } while (received < 0 && errno == EINTR);
+
+    if (received <= 0)
+        return 1;
+
+    join->connection_id[received] = '\0';
+    join->fd = -1;
+
+    /* Keep only the first file descriptor received */
+    for (header = CMSG_FIRSTHDR(&message); header != NULL;
+            header = CMSG_NXTHDR(&message, header)) {
+
+        unsigned char* data = CMSG_DATA(header);
+        int count;
+        int i;
+
+        if (header->cmsg_level != SOL_SOCKET
+                || header->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < count; i++) {
+
+            int received_fd;
+            memcpy(&received_fd, data + i * sizeof(int), sizeof(int));
+
+            if (join->fd == -1)
+                join->fd = received_fd;
+            else
+                close(received_fd);
+
+        }
+
+    }
+
+    /* Ignore connections whose file descriptors did not all arrive */
+    if (join->fd != -1 && (message.msg_flags & MSG_CTRUNC)) {
+        close(join->fd);
+        join->fd = -1;
+    }
+
+    return join->fd == -1;
+
+}
+
+/**
+ * Receives a single joining connection from the socket connected to the
+ * sending process and handles it, closing all file descriptors once
+ * handled. Messages without a file descriptor are ignored.
+ *
+ * @param data The guacd_join to receive and handle.
+ * @return Always NULL.
+ */
+static void* __guacd_join_thread(void* data) {
+
+    guacd_join* join = (guacd_join*) data;
+
+    int received = !__guacd_join_receive(join->route_fd, join);
+    close(join->route_fd);
+
+    if (received) {
+        join->handler(join->fd, join->connection_id, join->data);
+        close(join->fd);
+    }
+
+    free(join);
+    return NULL;
+
+}
+
+/**
+ * Accepts joining connections until the listening socket fails, handing
+ * each to a thread of its own to be received and handled, such that a
+ * sending process which stalls cannot delay any other. Connections from
+ * processes running as any other user are rejected.
+ *
+ * @param data The guacd_join_listener of the current process.
+ * @return Always NULL.
+ */
+static void* __guacd_join_listen_thread(void* data) {
+
+    guacd_join_listener* listener = (guacd_join_listener*) data;
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    for (;;) {
+
+        pthread_t thread;
+        guacd_join* join;
+
+        int fd = accept(listener->fd, NULL, NULL);
+        if (fd < 0) {
+
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            guacd_log(GUAC_LOG_ERROR, "Unable to receive joining "
+                    "connection: %s", strerror(errno));
+            break;
+
+        }
+
+        if (!__guacd_join_peer_trusted(fd, 0)) {
+            guacd_log(GUAC_LOG_WARNING, "Rejected joining connection from "
+                    "process of another user.");
+            close(fd);
+            continue;
+        }
+
+        join = malloc(sizeof(guacd_join));
+        if (join == NULL) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to allocate joining "
+                    "connection");
+            close(fd);
+            continue;
+        }
+
+        join->handler = listener->handler;
+        join->data = listener->data;
+        join->route_fd = fd;
+        join->fd = -1;
+
+        if (pthread_create(&thread, &attributes, __guacd_join_thread,
+                    join)) {
+            guacd_log(GUAC_LOG_ERROR, "Unable to start thread for joining "
+                    "connection");
+            close(fd);
+            free(join);
+        }
+
+    }
+
+    pthread_attr_destroy(&attributes);
+
+    close(listener->fd);
+    free(listener);
+    return NULL;
+
+}
+
+int guacd_join_init() {
+
+    strncpy(__guacd_join_directory, GUACD_JOIN_DIRECTORY,
+            sizeof(__guacd_join_directory) - 1);
+
+    /* The directory is created accessible only by the current user */
+    if (mkdtemp(__guacd_join_directory) == NULL) {
+        __guacd_join_directory[0] = '\0';
+        return 1;
+    }
+
+    __guacd_join_directory_owner = getpid();
+    atexit(__guacd_join_cleanup);
+    return 0;
+
+}
+
+int guacd_join_listen(guacd_join_handler* handler, void* data) {
+
+    struct sockaddr_un address;
+    pthread_t thread;
+    pthread_attr_t attributes;
+    guacd_join_listener* listener;
+
+    if (__guacd_join_address(&address, getpid()))
+        return 1;
+
+    listener = malloc(sizeof(guacd_join_listener));
+    if (listener == NULL)
+        return 1;
+
+    listener->handler = handler;
+    listener->data = data;
+
+    listener->fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (listener->fd < 0) {
+        free(listener);
+        return 1;
+    }
+
+    /* Listen at the path derived from the current process ID, removing any
+     * socket left by an earlier process having the same ID */
+    unlink(address.sun_path);
+    if (bind(listener->fd, (struct sockaddr*) &address, sizeof(address))
+            || listen(listener->fd, GUACD_JOIN_BACKLOG)) {
+        int error = errno;
+        close(listener->fd);
+        free(listener);
+        errno = error;
+        return 1;
+    }
+
+    /* Remove socket when this process exits, using the handler inherited
+     * from the process which called guacd_join_init() */
+    strcpy(__guacd_join_socket, address.sun_path);
+    __guacd_join_socket_owner = getpid();
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    if (pthread_create(&thread, &attributes, __guacd_join_listen_thread,
+                listener)) {
+        pthread_attr_destroy(&attributes);
+        close(listener->fd);
+        free(listener);
+        errno = EAGAIN;
+        return 1;
+    }
+
+    pthread_attr_destroy(&attributes);
+    return 0;
+
+}
+
+int guacd_join_route(pid_t pid, int fd, const char* connection_id) {
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct sockaddr_un address;
+    struct msghdr message;
+    struct cmsghdr* header;
+    struct iovec iov;
+    int socket_fd;
+    int retval;
+
+    if (__guacd_join_address(&address, pid))
+        return 1;
+
+    socket_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+    if (socket_fd < 0)
+        return 1;
+
+    if (connect(socket_fd, (struct sockaddr*) &address, sizeof(address))) {
+        int error = errno;
+        close(socket_fd);
+        errno = error;
+        return 1;
+    }
+
+    /* Never hand the connection to anything but the expected process */
+    if (!__guacd_join_peer_trusted(socket_fd, pid)) {
+        close(socket_fd);
+        errno = EPERM;
+        return 1;
+    }
+
+    iov.iov_base = (void*) connection_id;
+    iov.iov_len = strlen(connection_id);
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    /* Attach file descriptor */
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    retval = sendmsg(socket_fd, &message, MSG_NOSIGNAL) < 0;
+
+    close(socket_fd);
+    return retval;
+
+}
+
+#else
+
+int guacd_join_init() {
+    errno = ENOSYS;
+    return 1;
+}
+
+int guacd_join_listen(guacd_join_handler* handler, void* data) {
+    errno = ENOSYS;
+    return 1;
+}
+
+int guacd_join_route(pid_t pid, int fd, const char* connection_id) {
+    errno = ENOSYS;
+    return 1;
+}
+
+#endif
+
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUACD_JOIN_H
+#define _GUACD_JOIN_H
+
+#include "config.h"
+
+#include <sys/types.h>
+
+/**
+ * The template of the path of the directory created by guacd_join_init() to
+ * contain the UNIX sockets on which guacd processes receive connections
+ * joining their clients, as accepted by mkdtemp().
+ */
+#define GUACD_JOIN_DIRECTORY "/tmp/guacd-XXXXXX"
+
+/**
+ * The format of the path of the UNIX socket on which each guacd process
+ * receives connections joining its clients, where the string is the path of
+ * the directory created by guacd_join_init() and the integer is the process
+ * ID.
+ */
+#define GUACD_JOIN_SOCKET_PATH "%s/join-%i"
+
+/**
+ * The maximum number of joining connections which may be waiting to be
+ * received by a single guacd process.
+ */
+#define GUACD_JOIN_BACKLOG 16
+
+/**
+ * Handler which is called, within a thread of its own, for each connection
+ * joining a client of the current process. The file descriptor of the
+ * connection is closed when this handler returns.
+ *
+ * @param fd The file descriptor of the joining connection, which has
+ *           already sent the "select" instruction.
+ * @param connection_id The ID of the connection being joined.
+ * @param data The arbitrary data given to guacd_join_listen().
+ */
+typedef void guacd_join_handler(int fd, const char* connection_id,
+        void* data);
+
+/**
+ * Creates the directory containing the sockets used to route joining
+ * connections between guacd processes, accessible only to the user running
+ * guacd. This must be called once, by the main guacd process, before any
+ * processes which may call guacd_join_listen() or guacd_join_route() are
+ * forked. The directory is removed when the current process exits. Routing
+ * requires that the user of each connected process can be checked, and
+ * thus fails with ENOSYS on platforms which support neither SO_PEERCRED
+ * nor getpeereid().
+ *
+ * @return Zero if the directory was created, non-zero otherwise, in which
+ *         case errno is set appropriately and no connections can be routed
+ *         between processes.
+ */
+int guacd_join_init();
+
+/**
+ * Begins receiving connections which join the clients of the current
+ * process, as sent by guacd_join_route() from other guacd processes. Each
+ * connection received is handled by the given handler within a thread of
+ * its own. Only connections sent by processes running as the same user as
+ * the current process are accepted. The socket of the current process is
+ * removed when the current process exits.
+ *
+ * @param handler The handler to call for each joining connection.
+ * @param data Arbitrary data to pass to the handler.
+ * @return Zero if connections can now be received, non-zero otherwise, in
+ *         which case errno is set appropriately.
+ */
+int guacd_join_listen(guacd_join_handler* handler, void* data);
+
+/**
+ * Sends the given joining connection to the guacd process having the given
+ * process ID, which must have called guacd_join_listen(). The connection is
+ * sent only if the receiving process is running as the same user as the
+ * current process. The file descriptor remains open within the current
+ * process, and should be closed by the caller.
+ *
+ * @param pid The process ID of the guacd process handling the client being
+ *            joined.
+ * @param fd The file descriptor of the joining connection.
+ * @param connection_id The ID of the connection being joined.
+ * @return Zero if the connection was sent successfully, non-zero otherwise,
+ *         in which case errno is set appropriately.
+ */
+int guacd_join_route(pid_t pid, int fd, const char* connection_id);
+
+#endif
+
@@ -0,0 +1,647 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "log.h"
+#include "prefork.h"
+
+#include <guacamole/client.h>
+#include <guacamole/error.h>
+#include <guacamole/plugin.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/**
+ * The directory listing the file descriptors open within the current
+ * process, on platforms providing such a directory.
+ */
+#define GUACD_PREFORK_FD_DIR "/proc/self/fd"
+
+/**
+ * The file mapped to allocate shared memory on platforms lacking anonymous
+ * mappings.
+ */
+#define GUACD_PREFORK_DEV_ZERO "/dev/zero"
+
+/**
+ * The number of file descriptors above which guacd_prefork_close_inherited()
+ * will not attempt to close file descriptors if the open file descriptors
+ * cannot be listed, regardless of the limit reported by the system, which
+ * may be very large or unlimited.
+ */
+#define GUACD_PREFORK_CLOSE_LIMIT 65536
+
+/**
+ * The maximum number of file descriptors accepted within a single message by
+ * __guacd_prefork_receive(). Only the first is used, with any others being
+ * closed.
+ */
+#define GUACD_PREFORK_RECEIVE_FDS 16
+
+/**
+ * Closes all file descriptors listed within GUACD_PREFORK_FD_DIR above the
+ * standard error, except the given file descriptor.
+ *
+ * @param fd The file descriptor which should remain open.
+ * @return Zero if the open file descriptors could be listed, non-zero
+ *         otherwise.
+ */
+static int __guacd_prefork_close_listed(int fd) {
+
+    struct dirent* entry;
+
+    DIR* dir = opendir(GUACD_PREFORK_FD_DIR);
+    if (dir == NULL)
+        return 1;
+
+    while ((entry = readdir(dir)) != NULL) {
+
+        char* end;
+        long current = strtol(entry->d_name, &end, 10);
+
+        /* Skip "." and "..", as well as the listing itself */
+        if (end == entry->d_name || *end != '\0')
+            continue;
+
+        if (current > STDERR_FILENO && current != fd
+                && current != dirfd(dir))
+            close(current);
+
+    }
+
+    closedir(dir);
+    return 0;
+
+}
+
+void guacd_prefork_close_inherited(int fd) {
+
+    long current;
+    long max_fd;
+
+    closelog();
+
+    if (__guacd_prefork_close_listed(fd) == 0)
+        return;
+
+    /* Otherwise close every possible file descriptor, within reason */
+    max_fd = sysconf(_SC_OPEN_MAX);
+    if (max_fd < 0 || max_fd > GUACD_PREFORK_CLOSE_LIMIT)
+        max_fd = GUACD_PREFORK_CLOSE_LIMIT;
+
+    for (current = STDERR_FILENO + 1; current < max_fd; current++) {
+        if (current != fd)
+            close(current);
+    }
+
+}
+
+guacd_prefork_stats* guacd_prefork_stats_alloc() {
+
+    guacd_prefork_stats* stats;
+
+    /* Allocate within shared memory, which is zero-filled */
+#ifdef MAP_ANONYMOUS
+    stats = mmap(NULL, sizeof(guacd_prefork_stats), PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+#else
+    int fd = open(GUACD_PREFORK_DEV_ZERO, O_RDWR);
+    if (fd < 0)
+        return NULL;
+
+    stats = mmap(NULL, sizeof(guacd_prefork_stats), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+
+    close(fd);
+#endif
+
+    if (stats == MAP_FAILED)
+        return NULL;
+
+    return stats;
+
+}
+
+/**
+ * Copies the size, number of ready workers, and hit and miss counts of the
+ * given pool into its statistics, if any. The pool must be locked.
+ *
+ * @param pool The pool whose statistics should be published.
+ */
+static void __guacd_prefork_publish(guacd_prefork_pool* pool) {
+
+    guacd_prefork_stats* stats = pool->stats;
+    if (stats == NULL)
+        return;
+
+    /* Written only by the process owning the pool, and read without
+     * locking, as readers need only recent values */
+    stats->size = pool->size;
+    stats->ready = pool->ready;
+    stats->hits = pool->hits;
+    stats->misses = pool->misses;
+
+}
+
+/**
+ * Sends the given connection file descriptor, along with the name of the
+ * protocol selected by that connection, if any, over the given socket.
+ *
+ * @param socket_fd The socket connected to the receiving worker.
+ * @param fd The file descriptor of the connection to send.
+ * @param protocol The name of the protocol already selected by the
+ *                 connection, or NULL if no protocol has been selected.
+ * @return Zero if the file descriptor was sent successfully, non-zero
+ *         otherwise, in which case errno is set appropriately.
+ */
+static int __guacd_prefork_send(int socket_fd, int fd, const char* protocol) {
+
+    char control[CMSG_SPACE(sizeof(int))];
+    struct msghdr message;
+    struct cmsghdr* header;
+    struct iovec iov;
+
+    /* Protocol name is sent with its null terminator, such that the message
+     * is never empty */
+    if (protocol == NULL)
+        protocol = "";
+
+    iov.iov_base = (void*) protocol;
+    iov.iov_len = strlen(protocol) + 1;
+
+    memset(&message, 0, sizeof(message));
+    memset(control, 0, sizeof(control));
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    /* Attach file descriptor */
+    header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+    return sendmsg(socket_fd, &message, MSG_NOSIGNAL) < 0;
+
+}
+
+/**
+ * Extracts the first file descriptor received within the given message,
+ * closing all others.
+ *
+ * @param message The message received with recvmsg().
+ * @return The first file descriptor received, or -1 if no file descriptor
+ *         was received.
+ */
+static int __guacd_prefork_extract_fd(struct msghdr* message) {
+
+    struct cmsghdr* header;
+    int fd = -1;
+
+    for (header = CMSG_FIRSTHDR(message); header != NULL;
+            header = CMSG_NXTHDR(message, header)) {
+
+        unsigned char* data = CMSG_DATA(header);
+        int count;
+        int i;
+
+        if (header->cmsg_level != SOL_SOCKET
+                || header->cmsg_type != SCM_RIGHTS)
+            continue;
+
+        count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        for (i = 0; i < count; i++) {
+
+            int received_fd;
+            memcpy(&received_fd, data + i * sizeof(int), sizeof(int));
+
+            if (fd == -1)
+                fd = received_fd;
+            else
+                close(received_fd);
+
+        }
+
+    }
+
+    return fd;
+
+}
+
+/**
+ * Waits for a connection file descriptor to be sent over the given socket
+ * using __guacd_prefork_send(). Messages lacking a file descriptor, or whose
+ * file descriptors were truncated, are ignored, as are any file descriptors
+ * beyond the first.
+ *
+ * @param socket_fd The socket connected to the parent process.
+ * @param protocol A buffer which will receive the name of the protocol
+ *                 already selected by the connection, which will be empty if
+ *                 no protocol has been selected.
+ * @param length The size of the given buffer, in bytes.
+ * @return The received file descriptor, or -1 if the parent closed the
+ *         socket or an error occurs.
+ */
+static int __guacd_prefork_receive(int socket_fd, char* protocol,
+        int length) {
+
+    char control[CMSG_SPACE(sizeof(int) * GUACD_PREFORK_RECEIVE_FDS)];
+    struct msghdr message;
+    struct iovec iov;
+    ssize_t received;
+    int fd;
+
+    do {
+
+        iov.iov_base = protocol;
+        iov.iov_len = length - 1;
+
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        do {
+            received = recvmsg(socket_fd, &message, 0);
+        } while (received < 0 && errno == EINTR);
+
+        /* Parent has exited or closed the socket */
+        if (received <= 0)
+            return -1;
+
+        protocol[received] = '\0';
+
+        fd = __guacd_prefork_extract_fd(&message);
+
+        /* Drop connections whose file descriptors did not all arrive */
+        if (fd != -1 && (message.msg_flags & MSG_CTRUNC)) {
+            guacd_log(GUAC_LOG_WARNING, "Ignoring connection received with "
+                    "truncated file descriptors.");
+            close(fd);
+            fd = -1;
+        }
+
+    } while (fd == -1);
+
+    return fd;
+
+}
+
+/**
+ * The main function of each worker process. The client plugins of all
+ * configured protocols are preloaded, after which the worker waits to be
+ * handed a connection, handling that connection with the handler of the
+ * pool.
+ *
+ * @param pool The pool which forked the worker.
+ * @param socket_fd The socket connected to the parent process.
+ */
+static void __guacd_prefork_worker(guacd_prefork_pool* pool, int socket_fd) {
+
+    char protocol[GUAC_PROTOCOL_NAME_LIMIT];
+    int fd;
+    int i;
+
+    /* Preload client plugins, which remain loaded for the life of the
+     * worker such that later opening the same plugin is immediate */
+    for (i = 0; i < pool->protocol_count; i++) {
+
+        guac_client_plugin* plugin =
+            guac_client_plugin_open(pool->protocols[i]);
+
+        if (plugin == NULL)
+            guacd_log_guac_error(GUAC_LOG_DEBUG,
+                    "Unable to preload client plugin");
+
+        else if (guac_client_plugin_preload(plugin))
+            guacd_log_guac_error(GUAC_LOG_WARNING,
+                    "Unable to initialize client plugin");
+
+    }
+
+    /* Wait for connection */
+    fd = __guacd_prefork_receive(socket_fd, protocol, sizeof(protocol));
+    close(socket_fd);
+
+    if (fd < 0)
+        return;
+
+    pool->handler(fd, protocol[0] != '\0' ? protocol : NULL, pool->data);
+    close(fd);
+
+}
+
+/**
+ * Forks a new idle worker, adding it to the given pool. The pool must be
+ * locked, and must have room for another worker.
+ *
+ * @param pool The pool to add the new worker to.
+ * @return Zero if the worker was forked successfully, non-zero otherwise.
+ */
+static int __guacd_prefork_spawn(guacd_prefork_pool* pool) {
+
+    guacd_prefork_worker* worker;
+    int fds[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+        guacd_log(GUAC_LOG_ERROR, "Unable to create socket for prefork "
+                "worker: %s", strerror(errno));
+        return 1;
+    }
+
+    pid = fork();
+
+    /* If error, log */
+    if (pid == -1) {
+        guacd_log(GUAC_LOG_ERROR, "Error forking prefork worker: %s",
+                strerror(errno));
+        close(fds[0]);
+        close(fds[1]);
+        return 1;
+    }
+
+    /* If child, wait for connection, and exit when finished */
+    if (pid == 0) {
+        guacd_prefork_close_inherited(fds[1]);
+        __guacd_prefork_worker(pool, fds[1]);
+        exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+
+    worker = &pool->workers[pool->ready++];
+    worker->pid = pid;
+    worker->fd = fds[0];
+
+    return 0;
+
+}
+
+/**
+ * Forks new idle workers until the given pool is full or a worker cannot be
+ * forked. The pool must be locked.
+ *
+ * @param pool The pool to fill.
+ */
+static void __guacd_prefork_fill(guacd_prefork_pool* pool) {
+
+    while (pool->ready < pool->size) {
+        if (__guacd_prefork_spawn(pool))
+            break;
+    }
+
+}
+
+/**
+ * Adds each protocol within the given comma-separated list to the protocols
+ * preloaded by the workers of the given pool, ignoring surrounding whitespace
+ * and empty entries.
+ *
+ * @param pool The pool whose preloaded protocols should be set.
+ * @param protocols A comma-separated list of protocol names.
+ */
+static void __guacd_prefork_parse_protocols(guacd_prefork_pool* pool,
+        const char* protocols) {
+
+    const char* start = protocols;
+
+    while (*start != '\0' && pool->protocol_count < GUACD_PREFORK_MAX_PROTOCOLS) {
+
+        const char* end;
+
+        /* Skip leading whitespace and separators */
+        while (*start == ',' || *start == ' ' || *start == '\t')
+            start++;
+
+        /* Find end of name */
+        end = start;
+        while (*end != '\0' && *end != ',' && *end != ' ' && *end != '\t')
+            end++;
+
+        if (end > start && end - start < GUAC_PROTOCOL_NAME_LIMIT) {
+            char* protocol = malloc(end - start + 1);
+            memcpy(protocol, start, end - start);
+            protocol[end - start] = '\0';
+            pool->protocols[pool->protocol_count++] = protocol;
+        }
+
+        start = end;
+
+    }
+
+}
+
+guacd_prefork_pool* guacd_prefork_pool_alloc(int size, const char* protocols,
+        guacd_prefork_handler* handler, void* data,
+        guacd_prefork_stats* stats) {
+
+    guacd_prefork_pool* pool = calloc(1, sizeof(guacd_prefork_pool));
+    if (pool == NULL)
+        return NULL;
+
+    if (size > GUACD_PREFORK_MAX_WORKERS)
+        size = GUACD_PREFORK_MAX_WORKERS;
+
+    pool->size = size;
+    pool->handler = handler;
+    pool->data = data;
+    pool->stats = stats;
+    pthread_mutex_init(&pool->lock, NULL);
+
+    if (protocols != NULL)
+        __guacd_prefork_parse_protocols(pool, protocols);
+
+    /* Fork initial workers */
+    pthread_mutex_lock(&pool->lock);
+    __guacd_prefork_fill(pool);
+    __guacd_prefork_publish(pool);
+    pthread_mutex_unlock(&pool->lock);
+
+    return pool;
+
+}
+
+/**
+ * The main function of the launcher process. Connections are received from
+ * the parent process until the parent closes the socket, each connection
+ * being handed to an idle worker of a pool owned by the launcher, if any, or
+ * to a newly-forked process otherwise.
+ *
+ * @param socket_fd The socket connected to the parent process.
+ * @param size The number of idle workers to keep ready, or zero if no pool
+ *             should be used.
+ * @param protocols The protocols whose client plugins should be preloaded
+ *                  by each idle worker, or NULL.
+ * @param handler The handler to call within each process once handed a
+ *                connection.
+ * @param data Arbitrary data to pass to the handler.
+ * @param stats The shared statistics of the pool, or NULL.
+ */
+static void __guacd_prefork_launcher(int socket_fd, int size,
+        const char* protocols, guacd_prefork_handler* handler, void* data,
+        guacd_prefork_stats* stats) {
+
+    guacd_prefork_pool* pool = NULL;
+    char protocol[GUAC_PROTOCOL_NAME_LIMIT];
+    int fd;
+
+    if (size > 0) {
+        pool = guacd_prefork_pool_alloc(size, protocols, handler, data,
+                stats);
+        if (pool == NULL)
+            guacd_log(GUAC_LOG_ERROR, "Unable to create prefork workers.");
+    }
+
+    while ((fd = __guacd_prefork_receive(socket_fd, protocol,
+                    sizeof(protocol))) >= 0) {
+
+        const char* selected = protocol[0] != '\0' ? protocol : NULL;
+
+        /* Fork a process of its own if no idle worker is ready */
+        if (pool == NULL
+                || guacd_prefork_pool_dispatch(pool, fd, selected)) {
+
+            pid_t pid = fork();
+
+            /* If error, log */
+            if (pid == -1)
+                guacd_log(GUAC_LOG_ERROR, "Error forking child process: %s",
+                        strerror(errno));
+
+            /* If child, handle connection, and exit when finished */
+            else if (pid == 0) {
+                guacd_prefork_close_inherited(fd);
+                handler(fd, selected, data);
+                close(fd);
+                exit(EXIT_SUCCESS);
+            }
+
+        }
+
+        close(fd);
+
+    }
+
+}
+
+int guacd_prefork_launcher_start(int size, const char* protocols,
+        guacd_prefork_handler* handler, void* data,
+        guacd_prefork_stats* stats) {
+
+    int fds[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds))
+        return -1;
+
+    pid = fork();
+
+    /* If error, clean up */
+    if (pid == -1) {
+        int error = errno;
+        close(fds[0]);
+        close(fds[1]);
+        errno = error;
+        return -1;
+    }
+
+    /* If child, launch connections until the parent exits */
+    if (pid == 0) {
+        guacd_prefork_close_inherited(fds[1]);
+        __guacd_prefork_launcher(fds[1], size, protocols, handler, data,
+                stats);
+        exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    return fds[0];
+
+}
+
+int guacd_prefork_launch(int launcher_fd, int fd, const char* protocol) {
+    return __guacd_prefork_send(launcher_fd, fd, protocol);
+}
+
+int guacd_prefork_pool_dispatch(guacd_prefork_pool* pool, int fd,
+        const char* protocol) {
+
+    int dispatched = 0;
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* Hand connection to the most recently forked idle worker, discarding
+     * any workers which have since exited */
+    while (!dispatched && pool->ready > 0) {
+
+        guacd_prefork_worker* worker = &pool->workers[--pool->ready];
+
+        if (__guacd_prefork_send(worker->fd, fd, protocol) == 0)
+            dispatched = 1;
+        else
+            guacd_log(GUAC_LOG_DEBUG, "Prefork worker %i is no longer "
+                    "available: %s", (int) worker->pid, strerror(errno));
+
+        close(worker->fd);
+
+    }
+
+    if (dispatched) {
+        pool->hits++;
+        guacd_log(GUAC_LOG_DEBUG, "Connection handed to prefork worker. "
+                "%i of %i workers remain ready (%li hits, %li misses).",
+                pool->ready, pool->size, pool->hits, pool->misses);
+    }
+
+    else {
+        pool->misses++;
+        guacd_log(GUAC_LOG_INFO, "No prefork worker was ready for "
+                "connection. Consider increasing the number of prefork "
+                "workers (%li hits, %li misses).", pool->hits, pool->misses);
+    }
+
+    /* Replace any workers used */
+    __guacd_prefork_fill(pool);
+    __guacd_prefork_publish(pool);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return !dispatched;
+
+}
+
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _GUACD_PREFORK_H
+#define _GUACD_PREFORK_H
+
+#include "config.h"
+
+#include <guacamole/plugin.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * The maximum number of idle worker processes which may be kept ready.
+ */
+#define GUACD_PREFORK_MAX_WORKERS 64
+
+/**
+ * The maximum number of client plugins which may be preloaded by each worker
+ * process.
+ */
+#define GUACD_PREFORK_MAX_PROTOCOLS 16
+
+/**
+ * Handler which is called within a worker process once it has been handed a
+ * connection. The file descriptor of the connection is closed and the worker
+ * process exits when this handler returns.
+ *
+ * @param fd The file descriptor of the connection.
+ * @param protocol The name of the protocol already selected by the
+ *                 connection, or NULL if the "select" instruction has not
+ *                 yet been read.
+ * @param data The arbitrary data given when the pool was created.
+ */
+typedef void guacd_prefork_handler(int fd, const char* protocol, void* data);
+
+/**
+ * Statistics describing a pool of idle worker processes, stored within
+ * memory shared by all guacd processes such that they may be read even
+ * while the pool is owned by another process. Each field is written only by
+ * the process owning the pool.
+ */
+typedef struct guacd_prefork_stats {
+
+    /**
+     * The number of idle workers which should be kept ready.
+     */
+    int size;
+
+    /**
+     * The number of idle workers which are ready.
+     */
+    int ready;
+
+    /**
+     * The number of connections handed to an idle worker.
+     */
+    int64_t hits;
+
+    /**
+     * The number of connections for which no idle worker was ready.
+     */
+    int64_t misses;
+
+} guacd_prefork_stats;
+
+/**
+ * An idle worker process, waiting to be handed a connection.
+ */
+typedef struct guacd_prefork_worker {
+
+    /**
+     * The process ID of the worker.
+     */
+    pid_t pid;
+
+    /**
+     * The file descriptor of the socket over which the connection will be
+     * passed to the worker.
+     */
+    int fd;
+
+} guacd_prefork_worker;
+
+/**
+ * A pool of idle worker processes, each having already been forked and
+ * having already preloaded the client plugins of the configured protocols,
+ * such that neither delays the handling of new connections.
+ */
+typedef struct guacd_prefork_pool {
+
+    /**
+     * The number of idle workers which should be kept ready.
+     */
+    int size;
+
+    /**
+     * The idle workers which are ready to be handed a connection.
+     */
+    guacd_prefork_worker workers[GUACD_PREFORK_MAX_WORKERS];
+
+    /**
+     * The number of idle workers which are ready.
+     */
+    int ready;
+
+    /**
+     * The names of the protocols whose client plugins are preloaded by each
+     * worker.
+     */
+    char* protocols[GUACD_PREFORK_MAX_PROTOCOLS];
+
+    /**
+     * The number of protocols whose client plugins are preloaded.
+     */
+    int protocol_count;
+
+    /**
+     * The handler to call within each worker once handed a connection.
+     */
+    guacd_prefork_handler* handler;
+
+    /**
+     * Arbitrary data to pass to the handler.
+     */
+    void* data;
+
+    /**
+     * The number of connections handed to an idle worker.
+     */
+    long hits;
+
+    /**
+     * The number of connections for which no idle worker was ready.
+     */
+    long misses;
+
+    /**
+     * The shared statistics which should be updated as the pool changes, or
+     * NULL if no statistics should be published.
+     */
+    guacd_prefork_stats* stats;
+
+    /**
+     * Lock which guards the workers and statistics of the pool.
+     */
+    pthread_mutex_t lock;
+
+} guacd_prefork_pool;
+
+/**
+ * Creates a new pool of idle worker processes, forking the given number of
+ * workers immediately. Each worker preloads the client plugins of the given
+ * protocols before waiting to be handed a connection.
+ *
+ * @param size The number of idle workers to keep ready.
+ * @param protocols A comma-separated list of the names of the protocols whose
+ *                  client plugins should be preloaded, or NULL if no client
+ *                  plugins should be preloaded.
+ * @param handler The handler to call within each worker once handed a
+ *                connection.
+ * @param data Arbitrary data to pass to the handler.
+ * @param stats The shared statistics which should be updated as the pool
+ *              changes, as returned by guacd_prefork_stats_alloc(), or NULL
+ *              if no statistics should be published.
+ * @return A new pool of idle worker processes, or NULL if the pool cannot be
+ *         allocated.
+ */
+guacd_prefork_pool* guacd_prefork_pool_alloc(int size, const char* protocols,
+        guacd_prefork_handler* handler, void* data,
+        guacd_prefork_stats* stats);
+
+/**
+ * Allocates zeroed pool statistics within memory which will be shared with
+ * all processes later forked from the current process. The statistics
+ * persist for the life of guacd.
+ *
+ * @return The new statistics, or NULL if the shared memory could not be
+ *         allocated.
+ */
+guacd_prefork_stats* guacd_prefork_stats_alloc();
+
+/**
+ * Hands the connection having the given file descriptor to an idle worker,
+ * replacing that worker with a newly-forked worker. If no idle worker is
+ * ready, the pool is replenished but the connection is not handed off. In
+ * either case, the given file descriptor remains open and must be closed by
+ * the caller.
+ *
+ * @param pool The pool to hand the connection to.
+ * @param fd The file descriptor of the connection.
+ * @param protocol The name of the protocol already selected by the
+ *                 connection, or NULL if the "select" instruction has not yet
+ *                 been read.
+ * @return Zero if the connection was handed to an idle worker, non-zero if
+ *         no idle worker was ready and the caller must handle the connection
+ *         itself.
+ */
+int guacd_prefork_pool_dispatch(guacd_prefork_pool* pool, int fd,
+        const char* protocol);
+
+/**
+ * Forks a launcher process which hands each connection later passed to it
+ * with guacd_prefork_launch() to a process of its own, using an idle worker
+ * of a pool owned by the launcher if one is ready, and forking a new process
+ * otherwise. As the launcher is forked while the calling process has only a
+ * single thread, it and the processes it forks remain safe to use even after
+ * the calling process has started other threads.
+ *
+ * @param size The number of idle workers the launcher should keep ready, or
+ *             zero if the launcher should fork each process as needed.
+ * @param protocols A comma-separated list of the names of the protocols whose
+ *                  client plugins should be preloaded by each idle worker,
+ *                  or NULL if no client plugins should be preloaded.
+ * @param handler The handler to call within each process once handed a
+ *                connection.
+ * @param data Arbitrary data to pass to the handler.
+ * @param stats The shared statistics which should be updated as the pool of
+ *              the launcher changes, or NULL.
+ * @return The file descriptor of the socket connected to the launcher, or
+ *         -1 if the launcher could not be started, in which case errno is
+ *         set appropriately.
+ */
+int guacd_prefork_launcher_start(int size, const char* protocols,
+        guacd_prefork_handler* handler, void* data,
+        guacd_prefork_stats* stats);
+
+/**
+ * Hands the connection having the given file descriptor to the launcher
+ * connected to the given socket. The given file descriptor remains open and
+ * must be closed by the caller. This function may be called from any thread.
+ *
+ * @param launcher_fd The socket connected to the launcher, as returned by
+ *                    guacd_prefork_launcher_start().
+ * @param fd The file descriptor of the connection.
+ * @param protocol The name of the protocol already selected by the
+ *                 connection, or NULL if the "select" instruction has not yet
+ *                 been read.
+ * @return Zero if the connection was handed to the launcher, non-zero
+ *         otherwise, in which case errno is set appropriately.
+ */
+int guacd_prefork_launch(int launcher_fd, int fd, const char* protocol);
+
+/**
+ * Closes all file descriptors inherited by a newly-forked process except the
+ * standard input, output, and error, and the given file descriptor, such that
+ * the process does not hold open the connections of its parent. The
+ * connection to the system log is reopened when next used.
+ *
+ * @param fd The file descriptor which should remain open.
+ */
+void guacd_prefork_close_inherited(int fd);
+
+#endif
+
@@ -0,0 +1,431 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "registry.h"
+
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/**
+ * The file mapped to allocate shared memory on platforms lacking anonymous
+ * mappings.
+ */
+#define GUACD_REGISTRY_DEV_ZERO "/dev/zero"
+
+/**
+ * Returns a hash code based on the given connection ID.
+ */
+static unsigned int __guacd_registry_hash(const char* str) {
+
+    unsigned int hash_value = 0;
+    int c;
+
+    /* Apply each character in string to the hash code */
+    while ((c = *(str++)))
+        hash_value = hash_value * 65599 + c;
+
+    return hash_value;
+
+}
+
+/**
+ * Atomically reads the given int, acting as a full memory barrier.
+ */
+static int __guacd_registry_load(int* value) {
+    return __sync_fetch_and_add(value, 0);
+}
+
+/**
+ * Atomically reads the generation counter of the given entry, acting as a
+ * full memory barrier.
+ */
+static unsigned int __guacd_registry_generation(guacd_registry_entry* entry) {
+    return __sync_fetch_and_add(&entry->generation, 0);
+}
+
+/**
+ * Atomically changes the state of the given entry, acting as a full memory
+ * barrier.
+ */
+static void __guacd_registry_set_state(guacd_registry_entry* entry,
+        guacd_registry_entry_state state) {
+    __sync_lock_test_and_set(&entry->state, state);
+    __sync_synchronize();
+}
+
+/**
+ * Copies the given entry into the given guacd_registry_entry if the entry
+ * describes an active connection and was not changed while being copied.
+ *
+ * @param entry The entry to copy.
+ * @param copy The guacd_registry_entry which should receive the copy.
+ * @return Zero if a consistent copy of an active entry was made, non-zero
+ *         otherwise.
+ */
+static int __guacd_registry_read(guacd_registry_entry* entry,
+        guacd_registry_entry* copy) {
+
+    unsigned int generation;
+
+    if (__guacd_registry_load(&entry->state) != GUACD_REGISTRY_ACTIVE)
+        return 1;
+
+    /* Skip entries which are mid-change */
+    generation = __guacd_registry_generation(entry);
+    if (generation % 2)
+        return 1;
+
+    memcpy(copy, entry, sizeof(guacd_registry_entry));
+
+    /* Fail if the entry was removed or reused while copying */
+    if (__guacd_registry_generation(entry) != generation)
+        return 1;
+
+    copy->connection_id[GUACD_REGISTRY_ID_SIZE - 1] = '\0';
+    copy->protocol[GUACD_REGISTRY_PROTOCOL_SIZE - 1] = '\0';
+    return 0;
+
+}
+
+/**
+ * Acquires the lock of the given registry, recovering the lock if the
+ * process holding it terminated.
+ *
+ * @param registry The registry to lock.
+ */
+static void __guacd_registry_lock(guacd_registry* registry) {
+    if (pthread_mutex_lock(registry->lock) == EOWNERDEAD)
+        pthread_mutex_consistent(registry->lock);
+}
+
+/**
+ * Releases the lock of the given registry.
+ *
+ * @param registry The registry to unlock.
+ */
+static void __guacd_registry_unlock(guacd_registry* registry) {
+    pthread_mutex_unlock(registry->lock);
+}
+
+/**
+ * Clears the given entry, which must already have been claimed, marking it
+ * as removed such that it may be reused. If the entry following it is free,
+ * no lookup can need to continue past the given entry, and it is instead
+ * marked free, along with any removed entries immediately before it. The
+ * registry must be locked.
+ *
+ * @param registry The registry containing the entry.
+ * @param entry The claimed entry to release.
+ */
+static void __guacd_registry_release(guacd_registry* registry,
+        guacd_registry_entry* entry) {
+
+    int index = entry - registry->entries;
+    int i;
+
+    __sync_add_and_fetch(&entry->generation, 1);
+    memset(entry->connection_id, 0, GUACD_REGISTRY_ID_SIZE);
+    entry->pid = 0;
+    __sync_add_and_fetch(&entry->generation, 1);
+
+    /* Leave entry in place if lookups may need to continue past it */
+    if (__guacd_registry_load(&registry->entries[
+                (index + 1) % GUACD_REGISTRY_SIZE].state)
+            != GUACD_REGISTRY_FREE) {
+        __guacd_registry_set_state(entry, GUACD_REGISTRY_REMOVED);
+        return;
+    }
+
+    __guacd_registry_set_state(entry, GUACD_REGISTRY_FREE);
+
+    /* Free any removed entries now followed by a free entry */
+    for (i = 1; i < GUACD_REGISTRY_SIZE; i++) {
+
+        guacd_registry_entry* previous = &registry->entries[
+            (index + GUACD_REGISTRY_SIZE - i) % GUACD_REGISTRY_SIZE];
+
+        if (!__sync_bool_compare_and_swap(&previous->state,
+                    GUACD_REGISTRY_REMOVED, GUACD_REGISTRY_FREE))
+            break;
+
+    }
+
+}
+
+guacd_registry* guacd_registry_alloc() {
+
+    /* Entries are followed by the lock, which is thus suitably aligned */
+    size_t entries_size = sizeof(guacd_registry_entry) * GUACD_REGISTRY_SIZE;
+    size_t size = entries_size + sizeof(pthread_mutex_t);
+    pthread_mutexattr_t lock_attributes;
+
+    guacd_registry* registry = malloc(sizeof(guacd_registry));
+    if (registry == NULL)
+        return NULL;
+
+    /* Allocate entries and lock within shared memory, which is zero-filled
+     * and thus already contains only free entries */
+#ifdef MAP_ANONYMOUS
+    registry->entries = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+#else
+    int fd = open(GUACD_REGISTRY_DEV_ZERO, O_RDWR);
+    if (fd < 0) {
+        free(registry);
+        return NULL;
+    }
+
+    registry->entries = mmap(NULL, size, PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+
+    close(fd);
+#endif
+
+    if (registry->entries == MAP_FAILED) {
+        free(registry);
+        return NULL;
+    }
+
+    /* Init lock shared with all processes */
+    registry->lock = (pthread_mutex_t*) (((char*) registry->entries)
+            + entries_size);
+
+    pthread_mutexattr_init(&lock_attributes);
+    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&lock_attributes, PTHREAD_MUTEX_ROBUST);
+
+    if (pthread_mutex_init(registry->lock, &lock_attributes)) {
+        pthread_mutexattr_destroy(&lock_attributes);
+        munmap(registry->entries, size);
+        free(registry);
+        return NULL;
+    }
+
+    pthread_mutexattr_destroy(&lock_attributes);
+    return registry;
+
+}
+
+guacd_registry_entry* guacd_registry_add(guacd_registry* registry,
+        const char* connection_id, const char* protocol) {
+
+    unsigned int start = __guacd_registry_hash(connection_id);
+    int attempt;
+    int i;
+
+    /* Retry once after removing the entries of dead processes */
+    for (attempt = 0; attempt < 2; attempt++) {
+
+        __guacd_registry_lock(registry);
+
+        /* Claim first free or removed entry at or after the hashed entry */
+        for (i = 0; i < GUACD_REGISTRY_SIZE; i++) {
+
+            guacd_registry_entry* entry =
+                &registry->entries[(start + i) % GUACD_REGISTRY_SIZE];
+
+            int state = __guacd_registry_load(&entry->state);
+            if (state != GUACD_REGISTRY_FREE
+                    && state != GUACD_REGISTRY_REMOVED)
+                continue;
+
+            if (!__sync_bool_compare_and_swap(&entry->state, state,
+                        GUACD_REGISTRY_CLAIMED))
+                continue;
+
+            /* Describe connection */
+            __sync_add_and_fetch(&entry->generation, 1);
+
+            strncpy(entry->connection_id, connection_id,
+                    GUACD_REGISTRY_ID_SIZE - 1);
+            entry->connection_id[GUACD_REGISTRY_ID_SIZE - 1] = '\0';
+
+            strncpy(entry->protocol, protocol,
+                    GUACD_REGISTRY_PROTOCOL_SIZE - 1);
+            entry->protocol[GUACD_REGISTRY_PROTOCOL_SIZE - 1] = '\0';
+
+            entry->pid = getpid();
+            entry->started = guac_timestamp_current();
+            entry->bytes_in = 0;
+            entry->bytes_out = 0;
+            entry->frames = 0;
+            entry->lag = 0;
+            entry->mouse_received = 0;
+            entry->mouse_dropped = 0;
+
+            __sync_add_and_fetch(&entry->generation, 1);
+
+            /* Publish entry */
+            __guacd_registry_set_state(entry, GUACD_REGISTRY_ACTIVE);
+            __guacd_registry_unlock(registry);
+            return entry;
+
+        }
+
+        __guacd_registry_unlock(registry);
+
+        if (guacd_registry_sweep(registry) == 0)
+            break;
+
+    }
+
+    /* Registry is full */
+    return NULL;
+
+}
+
+void guacd_registry_update(guacd_registry_entry* entry, guac_client* client) {
+
+    /* Statistics are written only by the owning process, and are not
+     * guarded by the generation counter, as readers need only recent values
+     * rather than values consistent with each other */
+    entry->bytes_in  = client->socket->bytes_read;
+    entry->bytes_out = client->socket->bytes_written;
+    entry->lag = client->last_sent_timestamp
+               - client->last_received_timestamp;
+    entry->frames++;
+
+}
+
+void guacd_registry_update_input(guacd_registry_entry* entry,
+        long mouse_received, long mouse_dropped) {
+
+    /* As with guacd_registry_update(), written only by the owning process */
+    entry->mouse_received = mouse_received;
+    entry->mouse_dropped = mouse_dropped;
+
+}
+
+void guacd_registry_remove(guacd_registry* registry,
+        guacd_registry_entry* entry) {
+
+    /* Do nothing if already removed */
+    if (!__sync_bool_compare_and_swap(&entry->state, GUACD_REGISTRY_ACTIVE,
+                GUACD_REGISTRY_CLAIMED))
+        return;
+
+    __guacd_registry_lock(registry);
+    __guacd_registry_release(registry, entry);
+    __guacd_registry_unlock(registry);
+
+}
+
+int guacd_registry_find(guacd_registry* registry, const char* connection_id,
+        guacd_registry_entry* found) {
+
+    unsigned int start = __guacd_registry_hash(connection_id);
+    int i;
+
+    for (i = 0; i < GUACD_REGISTRY_SIZE; i++) {
+
+        guacd_registry_entry* entry =
+            &registry->entries[(start + i) % GUACD_REGISTRY_SIZE];
+
+        /* No entry beyond a never-used entry can have this ID */
+        if (__guacd_registry_load(&entry->state) == GUACD_REGISTRY_FREE)
+            break;
+
+        if (__guacd_registry_read(entry, found) == 0
+                && strcmp(found->connection_id, connection_id) == 0)
+            return 0;
+
+    }
+
+    /* No such connection */
+    return 1;
+
+}
+
+int guacd_registry_foreach(guacd_registry* registry,
+        guacd_registry_callback* callback, void* data) {
+
+    guacd_registry_entry copy;
+    int count = 0;
+    int i;
+
+    for (i = 0; i < GUACD_REGISTRY_SIZE; i++) {
+
+        if (__guacd_registry_read(&registry->entries[i], &copy))
+            continue;
+
+        callback(&copy, data);
+        count++;
+
+    }
+
+    return count;
+
+}
+
+int guacd_registry_sweep(guacd_registry* registry) {
+
+    int removed = 0;
+    int i;
+
+    for (i = 0; i < GUACD_REGISTRY_SIZE; i++) {
+
+        guacd_registry_entry* entry = &registry->entries[i];
+        guacd_registry_entry copy;
+        unsigned int generation;
+
+        if (__guacd_registry_read(entry, &copy))
+            continue;
+
+        /* Skip entries of processes which still exist */
+        if (kill(copy.pid, 0) == 0 || errno != ESRCH)
+            continue;
+
+        /* Remove entry only if it was not reused in the meantime */
+        if (!__sync_bool_compare_and_swap(&entry->state,
+                    GUACD_REGISTRY_ACTIVE, GUACD_REGISTRY_CLAIMED))
+            continue;
+
+        generation = __guacd_registry_generation(entry);
+        if (generation != copy.generation) {
+            __guacd_registry_set_state(entry, GUACD_REGISTRY_ACTIVE);
+            continue;
+        }
+
+        __guacd_registry_lock(registry);
+        __guacd_registry_release(registry, entry);
+        __guacd_registry_unlock(registry);
+        removed++;
+
+    }
+
+    return removed;
+
+}
+
@@ -0,0 +1,287 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUACD_REGISTRY_H
+#define _GUACD_REGISTRY_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/**
+ * The number of entries within the connection registry, and thus the
+ * maximum number of connections which may be registered at once. This is
+ * equal to GUACD_CLIENT_MAX_CONNECTIONS.
+ */
+#define GUACD_REGISTRY_SIZE 65536
+
+/**
+ * The maximum number of bytes in a connection ID stored within the
+ * connection registry, including the null terminator.
+ */
+#define GUACD_REGISTRY_ID_SIZE 64
+
+/**
+ * The maximum number of bytes in a protocol name stored within the
+ * connection registry, including the null terminator.
+ */
+#define GUACD_REGISTRY_PROTOCOL_SIZE 32
+
+/**
+ * The state of an entry within the connection registry.
+ */
+typedef enum guacd_registry_entry_state {
+
+    /**
+     * The entry is unused, and no connection is stored beyond this entry
+     * due to a collision with an entry before it. Lookups stop at the first
+     * such entry.
+     */
+    GUACD_REGISTRY_FREE = 0,
+
+    /**
+     * The entry is being added or removed by the process which owns it.
+     */
+    GUACD_REGISTRY_CLAIMED,
+
+    /**
+     * The entry describes an active connection.
+     */
+    GUACD_REGISTRY_ACTIVE,
+
+    /**
+     * The entry described a connection which has since been removed, and
+     * may be reused. Lookups continue past such entries, which become free
+     * again once the entry following them is free.
+     */
+    GUACD_REGISTRY_REMOVED
+
+} guacd_registry_entry_state;
+
+/**
+ * A single connection within the connection registry. Each entry is written
+ * only by the process handling its connection, and may be read at any time
+ * by any other process sharing the registry.
+ */
+typedef struct guacd_registry_entry {
+
+    /**
+     * The current guacd_registry_entry_state of this entry. This must only
+     * be accessed atomically.
+     */
+    int state;
+
+    /**
+     * Counter which is incremented both before and after the connection ID,
+     * protocol, process ID, and start time of this entry are changed, and
+     * is thus odd while those fields are being written. Readers use this
+     * counter to detect whether the entry was reused while being read. This
+     * must only be accessed atomically.
+     */
+    unsigned int generation;
+
+    /**
+     * The ID of the connection, as sent to the client within the "ready"
+     * instruction.
+     */
+    char connection_id[GUACD_REGISTRY_ID_SIZE];
+
+    /**
+     * The name of the protocol selected by the connection.
+     */
+    char protocol[GUACD_REGISTRY_PROTOCOL_SIZE];
+
+    /**
+     * The ID of the process handling the connection.
+     */
+    pid_t pid;
+
+    /**
+     * The time at which the connection was registered.
+     */
+    guac_timestamp started;
+
+    /**
+     * The total number of bytes received from the client.
+     */
+    int64_t bytes_in;
+
+    /**
+     * The total number of bytes sent to the client.
+     */
+    int64_t bytes_out;
+
+    /**
+     * The number of frames sent to the client.
+     */
+    int64_t frames;
+
+    /**
+     * The amount of time between the most recent frame sent and the most
+     * recent frame acknowledged by the client when the last frame was sent,
+     * in milliseconds.
+     */
+    int64_t lag;
+
+    /**
+     * The total number of mouse instructions received from the client.
+     */
+    int64_t mouse_received;
+
+    /**
+     * The number of mouse instructions received from the client which were
+     * dropped, having been coalesced into the instruction following them.
+     */
+    int64_t mouse_dropped;
+
+} guacd_registry_entry;
+
+/**
+ * Table of all connections handled by guacd, indexed by connection ID.
+ * Unlike guacd_client_map, which is private to the process handling each
+ * connection, the registry is shared by the main daemon process and all
+ * processes forked from it, and may be read without locking.
+ */
+typedef struct guacd_registry {
+
+    /**
+     * All entries of the registry, stored within memory shared by all guacd
+     * processes, with each connection stored at the first available entry
+     * at or after the entry selected by the hash of its connection ID.
+     */
+    guacd_registry_entry* entries;
+
+    /**
+     * Lock within the same shared memory as the entries, which is acquired
+     * by any process claiming an entry or releasing an entry it claimed,
+     * such that an entry is never freed while a connection is being stored
+     * beyond it. Reading the registry does not require this lock. The lock
+     * remains usable even if a process holding it terminates.
+     */
+    pthread_mutex_t* lock;
+
+} guacd_registry;
+
+/**
+ * Callback which is invoked by guacd_registry_foreach() for each active
+ * connection.
+ *
+ * @param entry A copy of the entry of the connection.
+ * @param data The arbitrary data given to guacd_registry_foreach().
+ */
+typedef void guacd_registry_callback(const guacd_registry_entry* entry,
+        void* data);
+
+/**
+ * Allocates a new, empty connection registry within memory which will be
+ * shared with all processes later forked from the current process. The
+ * registry persists for the life of guacd.
+ *
+ * @return The new registry, or NULL if the shared memory could not be
+ *         allocated.
+ */
+guacd_registry* guacd_registry_alloc();
+
+/**
+ * Registers the connection having the given ID as handled by the current
+ * process. The returned entry must only be modified using
+ * guacd_registry_update() and guacd_registry_remove().
+ *
+ * @param registry The registry to add the connection to.
+ * @param connection_id The ID of the connection.
+ * @param protocol The name of the protocol selected by the connection.
+ * @return The entry of the connection, or NULL if the registry is full.
+ */
+guacd_registry_entry* guacd_registry_add(guacd_registry* registry,
+        const char* connection_id, const char* protocol);
+
+/**
+ * Updates the statistics of the given entry from the current state of the
+ * given client, counting one more frame sent. This function is intended to
+ * be called after each frame.
+ *
+ * @param entry The entry of the connection of the given client.
+ * @param client The client whose statistics should be stored.
+ */
+void guacd_registry_update(guacd_registry_entry* entry, guac_client* client);
+
+/**
+ * Updates the mouse coalescing statistics of the given entry. This function
+ * is intended to be called after each batch of instructions is handled.
+ *
+ * @param entry The entry of the connection receiving the instructions.
+ * @param mouse_received The total number of mouse instructions received.
+ * @param mouse_dropped The total number of mouse instructions dropped.
+ */
+void guacd_registry_update_input(guacd_registry_entry* entry,
+        long mouse_received, long mouse_dropped);
+
+/**
+ * Removes the given entry from the registry, such that it may be reused.
+ *
+ * @param registry The registry containing the entry.
+ * @param entry The entry of the connection to remove.
+ */
+void guacd_registry_remove(guacd_registry* registry,
+        guacd_registry_entry* entry);
+
+/**
+ * Looks up the connection having the given ID, copying its entry into the
+ * given guacd_registry_entry. No locks are acquired.
+ *
+ * @param registry The registry to search.
+ * @param connection_id The ID of the connection to find.
+ * @param found The guacd_registry_entry which should receive a copy of the
+ *              entry of the connection, if found.
+ * @return Zero if the connection was found, non-zero otherwise.
+ */
+int guacd_registry_find(guacd_registry* registry, const char* connection_id,
+        guacd_registry_entry* found);
+
+/**
+ * Invokes the given callback with a copy of the entry of each active
+ * connection. No locks are acquired.
+ *
+ * @param registry The registry to iterate.
+ * @param callback The callback to invoke for each active connection.
+ * @param data Arbitrary data to pass to the callback.
+ * @return The number of active connections.
+ */
+int guacd_registry_foreach(guacd_registry* registry,
+        guacd_registry_callback* callback, void* data);
+
+/**
+ * Removes all entries of connections whose processes no longer exist, such
+ * as those of processes which terminated abnormally.
+ *
+ * @param registry The registry to clean up.
+ * @return The number of entries removed.
+ */
+int guacd_registry_sweep(guacd_registry* registry);
+
+#endif
+
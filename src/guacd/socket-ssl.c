@@ -24,8 +24,10 @@
 
 #include "socket-ssl.h"
 
+#include <poll.h>
 #include <stdlib.h>
-#include <sys/select.h>
+#include <string.h>
+#include <sys/uio.h>
 
 #include <guacamole/error.h>
 #include <guacamole/socket.h>
@@ -69,28 +71,67 @@ static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
 
 }
 
+static ssize_t __guac_socket_ssl_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+    size_t length = 0;
+    int i;
+
+    /* Calculate total size of all buffers */
+    for (i = 0; i < iovcnt; i++)
+        length += iov[i].iov_len;
+
+    /* Grow combined buffer if necessary */
+    if (length > data->writev_buffer_size) {
+
+        char* buffer = realloc(data->writev_buffer, length);
+
+        /* Fall back to writing only the first buffer if out of memory */
+        if (buffer == NULL)
+            return __guac_socket_ssl_write_handler(socket,
+                    iov[0].iov_base, iov[0].iov_len);
+
+        data->writev_buffer = buffer;
+        data->writev_buffer_size = length;
+
+    }
+
+    /* Combine buffers */
+    length = 0;
+    for (i = 0; i < iovcnt; i++) {
+        memcpy(data->writev_buffer + length, iov[i].iov_base, iov[i].iov_len);
+        length += iov[i].iov_len;
+    }
+
+    /* Write everything with a single SSL_write() */
+    return __guac_socket_ssl_write_handler(socket, data->writev_buffer, length);
+
+}
+
 static int __guac_socket_ssl_select_handler(guac_socket* socket, int usec_timeout) {
 
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
 
-    fd_set fds;
-    struct timeval timeout;
+    struct pollfd fds[] = {{
+        .fd      = data->fd,
+        .events  = POLLIN,
+        .revents = 0,
+    }};
+
     int retval;
 
+    /* Data already decrypted by OpenSSL will not be seen by poll() */
+    if (SSL_pending(data->ssl) > 0)
+        return 1;
+
     /* No timeout if usec_timeout is negative */
     if (usec_timeout < 0)
-        retval = select(data->fd + 1, &fds, NULL, NULL, NULL); 
-
-    /* Handle timeout if specified */
-    else {
-        timeout.tv_sec = usec_timeout/1000000;
-        timeout.tv_usec = usec_timeout%1000000;
+        retval = poll(fds, 1, -1);
 
-        FD_ZERO(&fds);
-        FD_SET(data->fd, &fds);
-
-        retval = select(data->fd + 1, &fds, NULL, NULL, &timeout);
-    }
+    /* Handle timeout if specified, rounding up to nearest milliseconds */
+    else
+        retval = poll(fds, 1, (usec_timeout + 999) / 1000);
 
     /* Properly set guac_error */
     if (retval <  0) {
@@ -113,6 +154,7 @@ static int __guac_socket_ssl_free_handler(guac_socket* socket) {
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
     SSL_shutdown(data->ssl);
 
+    free(data->writev_buffer);
     free(data);
     return 0;
 }
@@ -126,6 +168,8 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
     /* Init SSL */
     data->context = context;
     data->ssl = SSL_new(context);
+    data->writev_buffer = NULL;
+    data->writev_buffer_size = 0;
     SSL_set_fd(data->ssl, fd);
 
     /* Accept SSL connection, handle errors */
@@ -146,6 +190,7 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd) {
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_ssl_read_handler;
     socket->write_handler  = __guac_socket_ssl_write_handler;
+    socket->writev_handler = __guac_socket_ssl_writev_handler;
     socket->select_handler = __guac_socket_ssl_select_handler;
     socket->free_handler   = __guac_socket_ssl_free_handler;
 
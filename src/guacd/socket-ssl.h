@@ -51,6 +51,18 @@ typedef struct guac_socket_ssl_data {
      */
     SSL* ssl;
 
+    /**
+     * Buffer into which multiple buffers passed to the writev handler are
+     * combined, such that they can be written with a single SSL_write().
+     * This buffer is allocated and grown as needed.
+     */
+    char* writev_buffer;
+
+    /**
+     * The size of the writev buffer, in bytes.
+     */
+    size_t writev_buffer_size;
+
 } guac_socket_ssl_data;
 
 /**
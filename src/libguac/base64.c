@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "base64.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * Function which encodes the given number of complete 3-byte groups as
+ * base64, returning the number of characters written.
+ */
+typedef size_t __guac_base64_encoder(const unsigned char* src,
+        size_t triplets, char* dst);
+
+/**
+ * All characters of the base64 alphabet, in order of value.
+ */
+static const char __guac_base64_characters[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Portable base64 encoder, converting one 3-byte group at a time.
+ */
+static size_t __guac_base64_encode_scalar(const unsigned char* src,
+        size_t triplets, char* dst) {
+
+    const unsigned char* end = src + triplets * 3;
+    char* start = dst;
+
+    while (src < end) {
+
+        int a = src[0];
+        int b = src[1];
+        int c = src[2];
+
+        *(dst++) = __guac_base64_characters[a >> 2];
+        *(dst++) = __guac_base64_characters[((a & 0x03) << 4) | (b >> 4)];
+        *(dst++) = __guac_base64_characters[((b & 0x0F) << 2) | (c >> 6)];
+        *(dst++) = __guac_base64_characters[c & 0x3F];
+
+        src += 3;
+
+    }
+
+    return dst - start;
+
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Encodes the first 12 bytes of the given vector as 16 base64 characters.
+ * The 12 input bytes are first spread into four 6-bit indices per 32-bit
+ * lane, and those indices are then translated to ASCII by adding a
+ * per-range offset looked up via PSHUFB.
+ */
+__attribute__((target("ssse3")))
+static __m128i __guac_base64_encode_block_ssse3(__m128i in) {
+
+    __m128i t0, t1, t2, t3, indices, offsets, less;
+
+    /* Offsets from each 6-bit value to its ASCII character, indexed by
+     * range (see reduction below) */
+    const __m128i shift_lut = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+
+    /* Duplicate bytes such that each 32-bit lane holds one 3-byte group */
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    /* Extract 6-bit fields into separate bytes */
+    t0 = _mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00));
+    t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    t2 = _mm_and_si128(in, _mm_set1_epi32(0x003F03F0));
+    t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+    indices = _mm_or_si128(t1, t3);
+
+    /* Reduce each value to the index of its range within shift_lut:
+     * 0-25 -> 13, 26-51 -> 0, 52-61 -> 1-10, 62 -> 11, 63 -> 12 */
+    offsets = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    offsets = _mm_or_si128(offsets, _mm_and_si128(less, _mm_set1_epi8(13)));
+
+    /* Translate to ASCII */
+    offsets = _mm_shuffle_epi8(shift_lut, offsets);
+    return _mm_add_epi8(indices, offsets);
+
+}
+
+/**
+ * SSSE3 base64 encoder, converting four 3-byte groups per iteration.
+ */
+__attribute__((target("ssse3")))
+static size_t __guac_base64_encode_ssse3(const unsigned char* src,
+        size_t triplets, char* dst) {
+
+    char* start = dst;
+
+    /* Each iteration reads 16 bytes but consumes only 12, so stop while at
+     * least 6 groups (18 bytes) remain to avoid reading past the input */
+    while (triplets >= 6) {
+
+        __m128i in = _mm_loadu_si128((const __m128i*) src);
+        _mm_storeu_si128((__m128i*) dst, __guac_base64_encode_block_ssse3(in));
+
+        src += 12;
+        dst += 16;
+        triplets -= 4;
+
+    }
+
+    /* Encode remaining groups one at a time */
+    dst += __guac_base64_encode_scalar(src, triplets, dst);
+    return dst - start;
+
+}
+
+/**
+ * Encodes 24 bytes, split as 12 bytes within each 128-bit lane of the given
+ * vector, as 32 base64 characters. This is identical to
+ * __guac_base64_encode_block_ssse3(), but operates on both lanes at once.
+ */
+__attribute__((target("avx2")))
+static __m256i __guac_base64_encode_block_avx2(__m256i in) {
+
+    __m256i t0, t1, t2, t3, indices, offsets, less;
+
+    const __m256i shift_lut = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+        '/' - 63, 'A', 0, 0);
+
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+        10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0FC0FC00));
+    t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003F03F0));
+    t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+    indices = _mm256_or_si256(t1, t3);
+
+    offsets = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+    offsets = _mm256_or_si256(offsets,
+            _mm256_and_si256(less, _mm256_set1_epi8(13)));
+
+    offsets = _mm256_shuffle_epi8(shift_lut, offsets);
+    return _mm256_add_epi8(indices, offsets);
+
+}
+
+/**
+ * AVX2 base64 encoder, converting eight 3-byte groups per iteration.
+ */
+__attribute__((target("avx2")))
+static size_t __guac_base64_encode_avx2(const unsigned char* src,
+        size_t triplets, char* dst) {
+
+    char* start = dst;
+
+    /* Each iteration reads 28 bytes (16 bytes at offsets 0 and 12) but
+     * consumes only 24, so stop while at least 10 groups remain */
+    while (triplets >= 10) {
+
+        __m256i in = _mm256_inserti128_si256(
+                _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*) src)),
+                _mm_loadu_si128((const __m128i*) (src + 12)), 1);
+
+        _mm256_storeu_si256((__m256i*) dst,
+                __guac_base64_encode_block_avx2(in));
+
+        src += 24;
+        dst += 32;
+        triplets -= 8;
+
+    }
+
+    /* Finish with narrower vectors */
+    dst += __guac_base64_encode_ssse3(src, triplets, dst);
+    return dst - start;
+
+}
+
+#endif
+
+/**
+ * The encoder selected for the current CPU.
+ */
+static __guac_base64_encoder* __guac_base64_encode =
+    __guac_base64_encode_scalar;
+
+/**
+ * Guard ensuring the encoder is selected only once.
+ */
+static pthread_once_t __guac_base64_encoder_selected = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest base64 encoder supported by the current CPU.
+ */
+static void __guac_base64_select_encoder() {
+
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        __guac_base64_encode = __guac_base64_encode_avx2;
+
+    else if (__builtin_cpu_supports("ssse3"))
+        __guac_base64_encode = __guac_base64_encode_ssse3;
+#endif
+
+}
+
+size_t guac_base64_encode_triplets(const unsigned char* src, size_t triplets,
+        char* dst) {
+
+    pthread_once(&__guac_base64_encoder_selected,
+            __guac_base64_select_encoder);
+
+    return __guac_base64_encode(src, triplets, dst);
+
+}
+
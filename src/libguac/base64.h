@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __GUAC_BASE64_H
+#define __GUAC_BASE64_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * Encodes the given number of complete 3-byte groups as base64, writing
+ * exactly four output characters per group. Padding is never written, as
+ * only complete groups are encoded.
+ *
+ * The fastest implementation supported by the current CPU is selected
+ * automatically upon first use.
+ *
+ * @param src The buffer containing the data to encode. This buffer must
+ *            contain at least (triplets * 3) bytes.
+ * @param triplets The number of complete 3-byte groups to encode.
+ * @param dst The buffer which should receive the encoded characters. This
+ *            buffer must have space for at least (triplets * 4) bytes.
+ * @return The number of characters written to dst, which will always be
+ *         triplets * 4.
+ */
+size_t guac_base64_encode_triplets(const unsigned char* src, size_t triplets,
+        char* dst);
+
+#endif
+
@@ -25,6 +25,7 @@
 #include "client.h"
 #include "client-handlers.h"
 #include "instruction.h"
+#include "pacing.h"
 #include "protocol.h"
 #include "stream.h"
 #include "timestamp.h"
@@ -35,19 +36,18 @@
 
 /* Guacamole instruction handler map */
 
-__guac_instruction_handler_mapping __guac_instruction_handler_map[] = {
-   {"sync",       __guac_handle_sync},
-   {"mouse",      __guac_handle_mouse},
-   {"key",        __guac_handle_key},
-   {"clipboard",  __guac_handle_clipboard},
-   {"disconnect", __guac_handle_disconnect},
-   {"size",       __guac_handle_size},
-   {"file",       __guac_handle_file},
-   {"pipe",       __guac_handle_pipe},
-   {"ack",        __guac_handle_ack},
-   {"blob",       __guac_handle_blob},
-   {"end",        __guac_handle_end},
-   {NULL,         NULL}
+__guac_instruction_handler* __guac_instruction_handler_table[GUAC_INSTRUCTION_OPCODE_COUNT] = {
+   [GUAC_INSTRUCTION_OPCODE_SYNC]       = __guac_handle_sync,
+   [GUAC_INSTRUCTION_OPCODE_MOUSE]      = __guac_handle_mouse,
+   [GUAC_INSTRUCTION_OPCODE_KEY]        = __guac_handle_key,
+   [GUAC_INSTRUCTION_OPCODE_CLIPBOARD]  = __guac_handle_clipboard,
+   [GUAC_INSTRUCTION_OPCODE_DISCONNECT] = __guac_handle_disconnect,
+   [GUAC_INSTRUCTION_OPCODE_SIZE]       = __guac_handle_size,
+   [GUAC_INSTRUCTION_OPCODE_FILE]       = __guac_handle_file,
+   [GUAC_INSTRUCTION_OPCODE_PIPE]       = __guac_handle_pipe,
+   [GUAC_INSTRUCTION_OPCODE_ACK]        = __guac_handle_ack,
+   [GUAC_INSTRUCTION_OPCODE_BLOB]       = __guac_handle_blob,
+   [GUAC_INSTRUCTION_OPCODE_END]        = __guac_handle_end
 };
 
 int64_t __guac_parse_int(const char* str) {
@@ -78,6 +78,11 @@ int __guac_handle_sync(guac_client* client, guac_instruction* instruction) {
         return -1;
 
     client->last_received_timestamp = timestamp;
+
+    /* Update estimates of connection speed */
+    guac_pacing_frame_acknowledged(client->pacing, timestamp,
+            guac_timestamp_current());
+
     return 0;
 }
 
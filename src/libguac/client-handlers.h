@@ -42,23 +42,6 @@
  */
 typedef int __guac_instruction_handler(guac_client* client, guac_instruction* copied);
 
-/**
- * Structure mapping an instruction opcode to an instruction handler.
- */
-typedef struct __guac_instruction_handler_mapping {
-
-    /**
-     * The instruction opcode which maps to a specific handler.
-     */
-    char* opcode;
-
-    /**
-     * The handler which maps to a specific opcode.
-     */
-    __guac_instruction_handler* handler;
-
-} __guac_instruction_handler_mapping;
-
 /**
  * Internal initial handler for the sync instruction. When a sync instruction
  * is received, this handler will be called. Sync instructions are automatically
@@ -137,12 +120,10 @@ int __guac_handle_size(guac_client* client, guac_instruction* instruction);
 int __guac_handle_disconnect(guac_client* client, guac_instruction* instruction);
 
 /**
- * Instruction handler mapping table. This is a NULL-terminated array of
- * __guac_instruction_handler_mapping structures, each mapping an opcode
- * to a __guac_instruction_handler. The end of the array must be marked
- * with a __guac_instruction_handler_mapping with the opcode set to
- * NULL (the NULL terminator).
+ * Instruction handler lookup table, indexed by guac_instruction_opcode. Each
+ * entry is the __guac_instruction_handler for the corresponding opcode, or
+ * NULL if instructions with that opcode are not handled automatically.
  */
-extern __guac_instruction_handler_mapping __guac_instruction_handler_map[];
+extern __guac_instruction_handler* __guac_instruction_handler_table[GUAC_INSTRUCTION_OPCODE_COUNT];
 
 #endif
@@ -27,6 +27,7 @@
 #include "error.h"
 #include "instruction.h"
 #include "layer.h"
+#include "pacing.h"
 #include "pool.h"
 #include "protocol.h"
 #include "socket.h"
@@ -39,6 +40,7 @@
 #include <uuid.h>
 #endif
 
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -201,6 +203,9 @@ guac_client* guac_client_alloc() {
         client->last_sent_timestamp = guac_timestamp_current();
 
     client->state = GUAC_CLIENT_RUNNING;
+    client->coalesce_mouse = 1;
+    client->png_compression = GUAC_PNG_COMPRESSION_DEFAULT;
+    client->message_fd = -1;
 
     /* Generate ID */
     client->connection_id = __guac_generate_connection_id();
@@ -209,6 +214,17 @@ guac_client* guac_client_alloc() {
         return NULL;
     }
 
+    /* Allocate connection estimates */
+    client->pacing = guac_pacing_alloc();
+    if (client->pacing == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for connection "
+            "estimates";
+        free(client->connection_id);
+        free(client);
+        return NULL;
+    }
+
     /* Allocate buffer and layer pools */
     client->__buffer_pool = guac_pool_alloc(GUAC_BUFFER_POOL_INITIAL_SIZE);
     client->__layer_pool = guac_pool_alloc(GUAC_BUFFER_POOL_INITIAL_SIZE);
@@ -216,6 +232,11 @@ guac_client* guac_client_alloc() {
     /* Allocate stream pool */
     client->__stream_pool = guac_pool_alloc(0);
 
+    /* Init list of viewers */
+    pthread_mutex_init(&(client->__viewers_lock), NULL);
+    pthread_cond_init(&(client->__viewers_changed), NULL);
+    pthread_mutex_init(&(client->__input_lock), NULL);
+
     /* Initialze streams */
     client->__input_streams = malloc(sizeof(guac_stream) * GUAC_CLIENT_MAX_STREAMS);
     client->__output_streams = malloc(sizeof(guac_stream) * GUAC_CLIENT_MAX_STREAMS);
@@ -231,6 +252,14 @@ guac_client* guac_client_alloc() {
 
 void guac_client_free(guac_client* client) {
 
+    /* Wait for all viewers to leave */
+    guac_client_stop(client);
+    pthread_mutex_lock(&(client->__viewers_lock));
+    while (client->__viewer_count > 0)
+        pthread_cond_wait(&(client->__viewers_changed),
+                &(client->__viewers_lock));
+    pthread_mutex_unlock(&(client->__viewers_lock));
+
     if (client->free_handler) {
 
         /* FIXME: Errors currently ignored... */
@@ -249,24 +278,48 @@ void guac_client_free(guac_client* client) {
     /* Free stream pool */
     guac_pool_free(client->__stream_pool);
 
+    /* Free connection estimates */
+    guac_pacing_free(client->pacing);
+
+    /* Free socket which shared output with viewers, if any. The original
+     * socket belongs to the caller. */
+    if (client->__owner_socket != NULL)
+        guac_socket_free(client->socket);
+
+    pthread_mutex_destroy(&(client->__viewers_lock));
+    pthread_cond_destroy(&(client->__viewers_changed));
+    pthread_mutex_destroy(&(client->__input_lock));
+
     free(client);
 }
 
 int guac_client_handle_instruction(guac_client* client, guac_instruction* instruction) {
 
-    /* For each defined instruction */
-    __guac_instruction_handler_mapping* current = __guac_instruction_handler_map;
-    while (current->opcode != NULL) {
+    __guac_instruction_handler* handler;
+
+    /* Ignore invalid opcode values */
+    if ((unsigned int) instruction->opcode_id >= GUAC_INSTRUCTION_OPCODE_COUNT)
+        return 0;
+
+    /* Call handler, if defined (unrecognized opcodes have no handler) */
+    handler = __guac_instruction_handler_table[instruction->opcode_id];
+    if (handler == NULL)
+        return 0;
+
+    /* Serialize input from viewers with that of the owning connection */
+    if (client->__owner_socket != NULL) {
+
+        int retval;
+
+        pthread_mutex_lock(&(client->__input_lock));
+        retval = handler(client, instruction);
+        pthread_mutex_unlock(&(client->__input_lock));
 
-        /* If recognized, call handler */
-        if (strcmp(instruction->opcode, current->opcode) == 0)
-            return current->handler(client, instruction);
+        return retval;
 
-        current++;
     }
 
-    /* If unrecognized, ignore */
-    return 0;
+    return handler(client, instruction);
 
 }
 
@@ -0,0 +1,281 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "error.h"
+#include "protocol.h"
+
+#include <cairo/cairo.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef ENABLE_JPEG
+#include <setjmp.h>
+#include <stdio.h>
+#include <string.h>
+#include <jpeglib.h>
+#include <jerror.h>
+
+/**
+ * The initial size of the buffer receiving JPEG data, in bytes. The buffer
+ * doubles in size whenever more space is needed.
+ */
+#define GUAC_JPEG_INITIAL_BUFFER_SIZE 8192
+
+/*
+ * Cairo stores each 32-bit pixel as a native-endian word, which is laid out
+ * in memory as BGRX only on little-endian platforms.
+ */
+#if defined(JCS_EXTENSIONS) && !defined(WORDS_BIGENDIAN)
+#define GUAC_JPEG_NATIVE_BGRX
+#endif
+
+/**
+ * libjpeg destination manager which writes JPEG data to a growable buffer in
+ * memory.
+ */
+typedef struct __guac_jpeg_destination {
+
+    /**
+     * The libjpeg destination manager. This MUST be the first member, such
+     * that the structure may be accessed via the destination manager pointer
+     * within the libjpeg compression structure.
+     */
+    struct jpeg_destination_mgr pub;
+
+    /**
+     * The buffer receiving the JPEG data.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The size of the buffer, in bytes.
+     */
+    size_t buffer_size;
+
+} __guac_jpeg_destination;
+
+/**
+ * libjpeg error manager which returns control to the encoder via longjmp()
+ * rather than terminating the process.
+ */
+typedef struct __guac_jpeg_error {
+
+    /**
+     * The libjpeg error manager. This MUST be the first member.
+     */
+    struct jpeg_error_mgr pub;
+
+    /**
+     * The jump buffer to return to if an error occurs.
+     */
+    jmp_buf jump;
+
+} __guac_jpeg_error;
+
+/**
+ * Called by libjpeg when compression begins.
+ */
+static void __guac_jpeg_init_destination(j_compress_ptr cinfo) {
+
+    __guac_jpeg_destination* dest = (__guac_jpeg_destination*) cinfo->dest;
+
+    dest->pub.next_output_byte = dest->buffer;
+    dest->pub.free_in_buffer = dest->buffer_size;
+
+}
+
+/**
+ * Called by libjpeg when the buffer is full, doubling the size of the
+ * buffer.
+ */
+static boolean __guac_jpeg_empty_output_buffer(j_compress_ptr cinfo) {
+
+    __guac_jpeg_destination* dest = (__guac_jpeg_destination*) cinfo->dest;
+    size_t used = dest->buffer_size;
+
+    /* Double size of buffer, failing if no memory */
+    unsigned char* buffer = realloc(dest->buffer, dest->buffer_size * 2);
+    if (buffer == NULL)
+        ERREXIT(cinfo, JERR_OUT_OF_MEMORY);
+
+    dest->buffer = buffer;
+    dest->buffer_size *= 2;
+
+    dest->pub.next_output_byte = buffer + used;
+    dest->pub.free_in_buffer = dest->buffer_size - used;
+
+    return TRUE;
+
+}
+
+/**
+ * Called by libjpeg when compression has completed.
+ */
+static void __guac_jpeg_term_destination(j_compress_ptr cinfo) {
+    /* Data remains in buffer */
+}
+
+/**
+ * Called by libjpeg on any fatal error, returning control to the encoder.
+ */
+static void __guac_jpeg_error_exit(j_common_ptr cinfo) {
+    __guac_jpeg_error* error = (__guac_jpeg_error*) cinfo->err;
+    longjmp(error->jump, 1);
+}
+
+int guac_protocol_encode_jpeg(cairo_surface_t* surface, int quality,
+        void** data, int* length) {
+
+    struct jpeg_compress_struct cinfo;
+    __guac_jpeg_error error;
+    __guac_jpeg_destination dest;
+
+    /* Rows are converted from Cairo's native format unless libjpeg can
+     * read that format directly */
+    JSAMPLE* volatile row = NULL;
+
+    int width, height, stride;
+    unsigned char* image;
+
+    /* Only 24-bit RGB surfaces can be represented as JPEG */
+    if (cairo_image_surface_get_format(surface) != CAIRO_FORMAT_RGB24) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "JPEG images cannot contain transparency";
+        return -1;
+    }
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    width  = cairo_image_surface_get_width(surface);
+    height = cairo_image_surface_get_height(surface);
+    stride = cairo_image_surface_get_stride(surface);
+    image  = cairo_image_surface_get_data(surface);
+
+    if (image == NULL) {
+        guac_error = GUAC_STATUS_INVALID_ARGUMENT;
+        guac_error_message = "Surface has no image data";
+        return -1;
+    }
+
+    /* Allocate initial output buffer */
+    dest.buffer_size = GUAC_JPEG_INITIAL_BUFFER_SIZE;
+    dest.buffer = malloc(dest.buffer_size);
+    if (dest.buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory for JPEG buffer";
+        return -1;
+    }
+
+    /* Return here on any libjpeg error */
+    cinfo.err = jpeg_std_error(&error.pub);
+    error.pub.error_exit = __guac_jpeg_error_exit;
+    if (setjmp(error.jump)) {
+        jpeg_destroy_compress(&cinfo);
+        free(dest.buffer);
+        free(row);
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "libjpeg failed to encode image";
+        return -1;
+    }
+
+    jpeg_create_compress(&cinfo);
+
+    /* Write to memory */
+    dest.pub.init_destination = __guac_jpeg_init_destination;
+    dest.pub.empty_output_buffer = __guac_jpeg_empty_output_buffer;
+    dest.pub.term_destination = __guac_jpeg_term_destination;
+    cinfo.dest = (struct jpeg_destination_mgr*) &dest;
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+
+#ifdef GUAC_JPEG_NATIVE_BGRX
+    /* Read Cairo's native 32-bit format directly */
+    cinfo.input_components = 4;
+    cinfo.in_color_space = JCS_EXT_BGRX;
+#else
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    row = malloc(width * 3);
+    if (row == NULL)
+        ERREXIT(&cinfo, JERR_OUT_OF_MEMORY);
+#endif
+
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, quality, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    while (cinfo.next_scanline < cinfo.image_height) {
+
+        unsigned char* current = image + cinfo.next_scanline * stride;
+        JSAMPROW rows[1];
+
+#ifdef GUAC_JPEG_NATIVE_BGRX
+        rows[0] = current;
+#else
+        int x;
+        JSAMPLE* converted = row;
+
+        /* Convert native-endian 32-bit pixels to 24-bit RGB */
+        for (x = 0; x < width; x++) {
+            uint32_t color = ((uint32_t*) current)[x];
+            *(converted++) = (color >> 16) & 0xFF;
+            *(converted++) = (color >> 8)  & 0xFF;
+            *(converted++) =  color        & 0xFF;
+        }
+
+        rows[0] = row;
+#endif
+
+        jpeg_write_scanlines(&cinfo, rows, 1);
+
+    }
+
+    jpeg_finish_compress(&cinfo);
+
+    *data = dest.buffer;
+    *length = dest.buffer_size - dest.pub.free_in_buffer;
+
+    jpeg_destroy_compress(&cinfo);
+    free(row);
+    return 0;
+
+}
+
+#else
+
+int guac_protocol_encode_jpeg(cairo_surface_t* surface, int quality,
+        void** data, int* length) {
+
+    /* JPEG support not compiled in */
+    guac_error = GUAC_STATUS_NOT_SUPPORTED;
+    guac_error_message = "JPEG support not available";
+    return -1;
+
+}
+
+#endif
+
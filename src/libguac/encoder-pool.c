@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "encoder-pool.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+/**
+ * Lock which must be acquired to access or modify any state of the pool.
+ */
+static pthread_mutex_t __guac_encoder_pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Lock which is held for the duration of each batch. Only one batch is
+ * distributed across the pool at a time; concurrent calls to
+ * guac_encoder_pool_run() which find this lock held run their jobs on the
+ * invoking thread instead of waiting.
+ */
+static pthread_mutex_t __guac_encoder_pool_batch_lock =
+    PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition which is signalled when a new batch of jobs becomes available.
+ */
+static pthread_cond_t __guac_encoder_pool_work = PTHREAD_COND_INITIALIZER;
+
+/**
+ * Condition which is signalled when all jobs of the current batch have
+ * completed.
+ */
+static pthread_cond_t __guac_encoder_pool_done = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The number of threads requested, or a negative value if the number of
+ * threads should be chosen automatically.
+ */
+static int __guac_encoder_pool_threads = -1;
+
+/**
+ * The number of threads which have been started.
+ */
+static int __guac_encoder_pool_started = 0;
+
+/**
+ * The job of the current batch, if any.
+ */
+static guac_encoder_pool_job* __guac_encoder_pool_job = NULL;
+
+/**
+ * The data pointers of the current batch, if any.
+ */
+static void** __guac_encoder_pool_data = NULL;
+
+/**
+ * The number of jobs in the current batch.
+ */
+static int __guac_encoder_pool_count = 0;
+
+/**
+ * The index of the next job of the current batch which has not yet been
+ * claimed by any thread.
+ */
+static int __guac_encoder_pool_next = 0;
+
+/**
+ * The number of jobs of the current batch which have completed.
+ */
+static int __guac_encoder_pool_completed = 0;
+
+/**
+ * Claims and runs jobs from the current batch until no unclaimed jobs
+ * remain. The pool lock must be held when this function is called, and will
+ * be held when this function returns.
+ */
+static void __guac_encoder_pool_run_available() {
+
+    while (__guac_encoder_pool_next < __guac_encoder_pool_count) {
+
+        /* Claim next job */
+        guac_encoder_pool_job* job = __guac_encoder_pool_job;
+        void* data = __guac_encoder_pool_data[__guac_encoder_pool_next++];
+
+        /* Run job without holding lock */
+        pthread_mutex_unlock(&__guac_encoder_pool_lock);
+        job(data);
+        pthread_mutex_lock(&__guac_encoder_pool_lock);
+
+        /* Signal if batch is complete */
+        if (++__guac_encoder_pool_completed == __guac_encoder_pool_count)
+            pthread_cond_broadcast(&__guac_encoder_pool_done);
+
+    }
+
+}
+
+/**
+ * The main loop of each thread within the pool, running jobs from each
+ * batch as they become available.
+ */
+static void* __guac_encoder_pool_thread(void* data) {
+
+    pthread_mutex_lock(&__guac_encoder_pool_lock);
+
+    for (;;) {
+
+        /* Wait for work */
+        while (__guac_encoder_pool_next >= __guac_encoder_pool_count)
+            pthread_cond_wait(&__guac_encoder_pool_work,
+                    &__guac_encoder_pool_lock);
+
+        __guac_encoder_pool_run_available();
+
+    }
+
+    return NULL;
+
+}
+
+/**
+ * Returns the number of threads which should be in the pool, resolving the
+ * automatic setting if necessary. The pool lock must be held when this
+ * function is called.
+ */
+static int __guac_encoder_pool_wanted_threads() {
+
+    long processors;
+    int threads = __guac_encoder_pool_threads;
+
+    /* Use one thread per additional processor if automatic */
+    if (threads < 0) {
+        processors = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = processors > 1 ? processors - 1 : 0;
+    }
+
+    if (threads > GUAC_ENCODER_POOL_MAX_THREADS)
+        threads = GUAC_ENCODER_POOL_MAX_THREADS;
+
+    return threads;
+
+}
+
+/**
+ * Guards registration of the fork handlers of the pool.
+ */
+static pthread_once_t __guac_encoder_pool_fork_init = PTHREAD_ONCE_INIT;
+
+/**
+ * Acquires all locks of the pool prior to fork(), such that no batch is in
+ * progress and the state of the pool is consistent within the child.
+ */
+static void __guac_encoder_pool_fork_prepare() {
+    pthread_mutex_lock(&__guac_encoder_pool_batch_lock);
+    pthread_mutex_lock(&__guac_encoder_pool_lock);
+}
+
+/**
+ * Releases all locks of the pool within the parent after fork().
+ */
+static void __guac_encoder_pool_fork_parent() {
+    pthread_mutex_unlock(&__guac_encoder_pool_lock);
+    pthread_mutex_unlock(&__guac_encoder_pool_batch_lock);
+}
+
+/**
+ * Resets the pool within the child after fork(). Only the forking thread
+ * exists within the child, thus the pool threads must be started again.
+ */
+static void __guac_encoder_pool_fork_child() {
+    pthread_cond_init(&__guac_encoder_pool_work, NULL);
+    pthread_cond_init(&__guac_encoder_pool_done, NULL);
+    __guac_encoder_pool_started = 0;
+    pthread_mutex_unlock(&__guac_encoder_pool_lock);
+    pthread_mutex_unlock(&__guac_encoder_pool_batch_lock);
+}
+
+/**
+ * Registers the fork handlers of the pool.
+ */
+static void __guac_encoder_pool_register_fork() {
+    pthread_atfork(__guac_encoder_pool_fork_prepare,
+            __guac_encoder_pool_fork_parent,
+            __guac_encoder_pool_fork_child);
+}
+
+/**
+ * Starts any threads which have been requested but not yet started. The pool
+ * lock must be held when this function is called.
+ */
+static void __guac_encoder_pool_start_threads() {
+
+    int wanted = __guac_encoder_pool_wanted_threads();
+
+    /* Processes forked after threads exist must not inherit a pool lacking
+     * its threads */
+    if (__guac_encoder_pool_started < wanted)
+        pthread_once(&__guac_encoder_pool_fork_init,
+                __guac_encoder_pool_register_fork);
+
+    while (__guac_encoder_pool_started < wanted) {
+
+        pthread_t thread;
+
+        /* Jobs still run on the invoking thread if threads are unavailable */
+        if (pthread_create(&thread, NULL, __guac_encoder_pool_thread, NULL))
+            break;
+
+        pthread_detach(thread);
+        __guac_encoder_pool_started++;
+
+    }
+
+}
+
+void guac_encoder_pool_set_threads(int threads) {
+    pthread_mutex_lock(&__guac_encoder_pool_lock);
+    __guac_encoder_pool_threads = threads;
+    pthread_mutex_unlock(&__guac_encoder_pool_lock);
+}
+
+int guac_encoder_pool_get_threads() {
+
+    int threads;
+
+    pthread_mutex_lock(&__guac_encoder_pool_lock);
+    threads = __guac_encoder_pool_wanted_threads();
+    pthread_mutex_unlock(&__guac_encoder_pool_lock);
+
+    return threads;
+
+}
+
+void guac_encoder_pool_run(guac_encoder_pool_job* job, void** data,
+        int count) {
+
+    int i;
+
+    /* Run serially if parallelism cannot help, or if the pool is busy with
+     * another caller's batch, which may belong to an unrelated connection
+     * and must not stall this thread */
+    if (count <= 1 || guac_encoder_pool_get_threads() == 0
+            || pthread_mutex_trylock(&__guac_encoder_pool_batch_lock)) {
+        for (i = 0; i < count; i++)
+            job(data[i]);
+        return;
+    }
+
+    pthread_mutex_lock(&__guac_encoder_pool_lock);
+
+    __guac_encoder_pool_start_threads();
+
+    /* Publish batch */
+    __guac_encoder_pool_job = job;
+    __guac_encoder_pool_data = data;
+    __guac_encoder_pool_count = count;
+    __guac_encoder_pool_next = 0;
+    __guac_encoder_pool_completed = 0;
+    pthread_cond_broadcast(&__guac_encoder_pool_work);
+
+    /* Participate in the batch, then wait for jobs claimed by others */
+    __guac_encoder_pool_run_available();
+    while (__guac_encoder_pool_completed < __guac_encoder_pool_count)
+        pthread_cond_wait(&__guac_encoder_pool_done,
+                &__guac_encoder_pool_lock);
+
+    /* Batch complete */
+    __guac_encoder_pool_job = NULL;
+    __guac_encoder_pool_data = NULL;
+    __guac_encoder_pool_count = 0;
+    __guac_encoder_pool_next = 0;
+
+    pthread_mutex_unlock(&__guac_encoder_pool_lock);
+    pthread_mutex_unlock(&__guac_encoder_pool_batch_lock);
+
+}
+
@@ -32,6 +32,7 @@
 
 #include "client-types.h"
 #include "protocol-types.h"
+#include "socket-types.h"
 #include "stream-types.h"
 
 #include <stdarg.h>
@@ -108,6 +109,12 @@ typedef int guac_client_video_handler(guac_client* client, char* mimetype);
  */
 typedef int guac_client_free_handler(guac_client* client);
 
+/**
+ * Handler which writes the current state of the client to the given socket,
+ * such that a newly-joined viewer can be brought up to date.
+ */
+typedef int guac_client_join_handler(guac_client* client, guac_socket* socket);
+
 /**
  * Handler for logging messages
  */
@@ -118,5 +125,12 @@ typedef void guac_client_log_handler(guac_client* client, guac_client_log_level
  */
 typedef int guac_client_init_handler(guac_client* client, int argc, char** argv);
 
+/**
+ * Handler which should perform any process-wide initialization required by
+ * the clients of a client plugin, such that this work need not be performed
+ * when the first client is initialized.
+ */
+typedef int guac_client_preload_handler();
+
 #endif
 
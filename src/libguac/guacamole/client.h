@@ -34,11 +34,14 @@
 #include "client-constants.h"
 #include "instruction-types.h"
 #include "layer-types.h"
+#include "pacing-types.h"
 #include "pool-types.h"
 #include "socket-types.h"
 #include "stream-types.h"
 #include "timestamp-types.h"
+#include "viewer-types.h"
 
+#include <pthread.h>
 #include <stdarg.h>
 
 struct guac_client_info {
@@ -71,6 +74,13 @@ struct guac_client_info {
      */
     const char** video_mimetypes;
 
+    /**
+     * NULL-terminated array of client-supported image mimetypes, beyond
+     * "image/png", which is always supported. If the client did not declare
+     * support for any additional image formats, this will be NULL.
+     */
+    const char** image_mimetypes;
+
     /**
      * The DPI of the physical remote display if configured for the optimal
      * width/height combination described here. This need not be honored by
@@ -113,6 +123,31 @@ struct guac_client {
      */
     guac_timestamp last_sent_timestamp;
 
+    /**
+     * Estimates of the round trip time and bandwidth of the connection to
+     * the web-client, updated as each frame is sent and acknowledged, along
+     * with the frame duration and image quality those estimates suggest.
+     * This is always allocated along with the client.
+     */
+    guac_pacing* pacing;
+
+    /**
+     * Whether consecutive mouse instructions having the same button mask may
+     * be coalesced before being handled, such that only the most recent
+     * position is passed to mouse_handler. Mouse instructions are never
+     * reordered relative to other instructions. This is set to the guacd
+     * default before the client plugin is initialized, and may be changed
+     * per connection by the client plugin during initialization.
+     */
+    int coalesce_mouse;
+
+    /**
+     * The tradeoff between encoding speed and output size to use when
+     * encoding image updates as PNG. This is GUAC_PNG_COMPRESSION_DEFAULT
+     * unless changed by the client plugin during initialization.
+     */
+    guac_png_compression png_compression;
+
     /**
      * Information structure containing properties exposed by the remote
      * client during the initial handshake process.
@@ -142,6 +177,16 @@ struct guac_client {
      */
     guac_client_handle_messages* handle_messages;
 
+    /**
+     * File descriptor which becomes readable whenever the message handler of
+     * this client has messages to handle, or -1 if no such file descriptor
+     * exists. If set, the message handler must not block when this file
+     * descriptor is readable, allowing the Guacamole proxy to wait on this
+     * file descriptor alongside those of other connections rather than
+     * dedicating a thread to calling the message handler.
+     */
+    int message_fd;
+
     /**
      * Handler for mouse events sent by the Gaucamole web-client.
      *
@@ -342,6 +387,27 @@ struct guac_client {
      */
     guac_client_free_handler* free_handler;
 
+    /**
+     * Handler for bringing additional viewers up to date. This handler will
+     * be called at the end of a frame, after all pending drawing operations
+     * have been written, whenever a viewer joins the connection or catches up
+     * after falling too far behind. The handler must write the complete
+     * current state of the display to the given socket, and only to the given
+     * socket, using the same layers and buffers as the rest of the client.
+     *
+     * Other viewers may be added to a client only if this handler is defined.
+     *
+     * Example:
+     * @code
+     *     int join_handler(guac_client* client, guac_socket* socket);
+     *
+     *     int guac_client_init(guac_client* client, int argc, char** argv) {
+     *         client->join_handler = join_handler;
+     *     }
+     * @endcode
+     */
+    guac_client_join_handler* join_handler;
+
     /**
      * Logging handler. This handler will be called via guac_client_log() when
      * the client needs to log messages of any type.
@@ -404,13 +470,50 @@ struct guac_client {
      */
     char* connection_id;
 
+    /**
+     * The socket of the connection which created this client, if viewers
+     * are allowed, in which case the socket field of this client refers to a
+     * socket which sends all data both to this socket and to each viewer.
+     * If viewers are not allowed, this will be NULL.
+     */
+    guac_socket* __owner_socket;
+
+    /**
+     * All viewers of this client other than the connection which created
+     * it, as a linked list.
+     */
+    guac_viewer* __viewers;
+
+    /**
+     * The number of viewers within __viewers.
+     */
+    int __viewer_count;
+
+    /**
+     * Lock which guards the list of viewers and the state of each viewer.
+     */
+    pthread_mutex_t __viewers_lock;
+
+    /**
+     * Condition which is signalled whenever a viewer is removed.
+     */
+    pthread_cond_t __viewers_changed;
+
+    /**
+     * Lock which is held while instructions are handled if viewers are
+     * allowed, such that the handlers of the client are never invoked by
+     * the connection which created the client and a viewer at once.
+     */
+    pthread_mutex_t __input_lock;
+
 };
 
 /**
  * Returns a new, barebones guac_client. This new guac_client has no handlers
  * set, but is otherwise usable.
  *
- * @return A pointer to the new client.
+ * @return A pointer to the new client, or NULL if the client cannot be
+ *         allocated, in which case guac_error will be set appropriately.
  */
 guac_client* guac_client_alloc();
 
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _GUAC_ENCODER_POOL_H
+#define _GUAC_ENCODER_POOL_H
+
+/**
+ * Provides a process-wide pool of threads for performing independent,
+ * CPU-bound encoding jobs (such as PNG compression) in parallel.
+ *
+ * @file encoder-pool.h
+ */
+
+/**
+ * The maximum number of threads which may be added to the encoder pool.
+ */
+#define GUAC_ENCODER_POOL_MAX_THREADS 16
+
+/**
+ * A single encoding job, invoked with the data associated with that job.
+ * Jobs within the same batch may run concurrently on different threads, and
+ * thus must not modify any data shared with other jobs. As guac_error and
+ * guac_error_message are thread-local, any failure must be recorded within
+ * the job's data for the invoking thread to inspect once the batch is
+ * complete.
+ *
+ * @param data The data associated with the job.
+ */
+typedef void guac_encoder_pool_job(void* data);
+
+/**
+ * Sets the number of threads which should be added to the encoder pool, in
+ * addition to the thread invoking guac_encoder_pool_run(). If zero, all jobs
+ * are run serially by the invoking thread. If negative, the number of
+ * threads is chosen automatically based on the number of available
+ * processors. Threads are started lazily, upon first use, and are never
+ * stopped, thus reducing the number of threads after the pool has been used
+ * has no effect.
+ *
+ * @param threads The number of threads to add to the pool, which will be
+ *                limited to GUAC_ENCODER_POOL_MAX_THREADS, or a negative
+ *                value to choose automatically.
+ */
+void guac_encoder_pool_set_threads(int threads);
+
+/**
+ * Returns the number of threads which will be added to the encoder pool, in
+ * addition to the thread invoking guac_encoder_pool_run().
+ *
+ * @return The number of threads in the encoder pool.
+ */
+int guac_encoder_pool_get_threads();
+
+/**
+ * Runs the given job once for each of the given data pointers, distributing
+ * the jobs across the encoder pool and the invoking thread, returning only
+ * after all jobs have completed. Only one batch of jobs is distributed
+ * across the pool at a time; if another batch is already running, the jobs
+ * are instead run serially by the invoking thread, such that no caller ever
+ * waits for the jobs of another.
+ *
+ * @param job The job to run.
+ * @param data An array of data pointers, one for each invocation of the job.
+ * @param count The number of data pointers in the array.
+ */
+void guac_encoder_pool_run(guac_encoder_pool_job* job, void** data,
+        int count);
+
+#endif
+
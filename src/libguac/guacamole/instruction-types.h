@@ -59,6 +59,107 @@ typedef enum guac_instruction_parse_state {
 
 } guac_instruction_parse_state;
 
+/**
+ * All opcodes known to libguac which may be received from a Guacamole
+ * client, including those used only during the handshake. Each parsed
+ * instruction is tagged with the value corresponding to its opcode, allowing
+ * instructions to be dispatched without string comparison.
+ */
+typedef enum guac_instruction_opcode {
+
+    /**
+     * The opcode is not one of the opcodes known to libguac.
+     */
+    GUAC_INSTRUCTION_OPCODE_UNKNOWN,
+
+    /**
+     * The "ack" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_ACK,
+
+    /**
+     * The "audio" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_AUDIO,
+
+    /**
+     * The "blob" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_BLOB,
+
+    /**
+     * The "clipboard" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_CLIPBOARD,
+
+    /**
+     * The "connect" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_CONNECT,
+
+    /**
+     * The "disconnect" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_DISCONNECT,
+
+    /**
+     * The "end" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_END,
+
+    /**
+     * The "file" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_FILE,
+
+    /**
+     * The "key" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_KEY,
+
+    /**
+     * The "mouse" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_MOUSE,
+
+    /**
+     * The "pipe" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_PIPE,
+
+    /**
+     * The "select" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_SELECT,
+
+    /**
+     * The "size" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_SIZE,
+
+    /**
+     * The "sync" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_SYNC,
+
+    /**
+     * The "video" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_VIDEO,
+
+    /**
+     * The "image" instruction.
+     */
+    GUAC_INSTRUCTION_OPCODE_IMAGE,
+
+    /**
+     * The number of values defined by this enum. This is not itself an
+     * opcode.
+     */
+    GUAC_INSTRUCTION_OPCODE_COUNT
+
+} guac_instruction_opcode;
+
 /**
  * Represents a single instruction within the Guacamole protocol.
  */
@@ -42,6 +42,13 @@ struct guac_instruction {
      */
     char* opcode;
 
+    /**
+     * The value corresponding to the opcode of the instruction, or
+     * GUAC_INSTRUCTION_OPCODE_UNKNOWN if the opcode is not known to libguac.
+     * This is set as soon as the opcode has been parsed.
+     */
+    guac_instruction_opcode opcode_id;
+
     /**
      * The number of arguments passed to this instruction.
      */
@@ -83,6 +90,19 @@ struct guac_instruction {
  */
 guac_instruction* guac_instruction_alloc();
 
+/**
+ * Returns the guac_instruction_opcode value corresponding to the given
+ * opcode. The opcode need not be null-terminated.
+ *
+ * @param opcode The opcode to look up.
+ * @param length The length of the opcode, in bytes.
+ * @return The value corresponding to the given opcode, or
+ *         GUAC_INSTRUCTION_OPCODE_UNKNOWN if the opcode is not known to
+ *         libguac.
+ */
+guac_instruction_opcode guac_instruction_get_opcode(const char* opcode,
+        int length);
+
 /**
  * Resets the parse state and contents of the given instruction, such that the
  * memory of that instruction can be reused for another parse cycle.
@@ -145,6 +165,51 @@ int guac_instruction_waiting(guac_socket* socket, int usec_timeout);
  */
 guac_instruction* guac_instruction_read(guac_socket* socket, int usec_timeout);
 
+/**
+ * Reads a single instruction from the given guac_socket connection into the
+ * given, caller-provided instruction, which is reset prior to parsing. Unlike
+ * guac_instruction_read(), no memory is allocated, allowing the same
+ * instruction to be reused for every instruction read.
+ *
+ * The opcode and arguments of the parsed instruction point directly into the
+ * internal buffer of the socket, and remain valid only until the next read
+ * from that socket.
+ *
+ * @param socket The guac_socket connection to use.
+ * @param usec_timeout The maximum number of microseconds to wait before
+ *                     giving up.
+ * @param instruction The instruction to populate with the parsed instruction.
+ * @return Zero if an instruction was successfully read, non-zero on error or
+ *         if the instruction could not be read completely because the timeout
+ *         elapsed, in which case guac_error will be set appropriately.
+ */
+int guac_instruction_read_into(guac_socket* socket, int usec_timeout,
+        guac_instruction* instruction);
+
+/**
+ * Parses up to the given number of complete instructions which have already
+ * been received and buffered by the given guac_socket, without reading any
+ * further data. This allows a burst of instructions to be drained after a
+ * single call to guac_instruction_read_into(), without waiting on the socket
+ * for each instruction.
+ *
+ * Parsing stops at the first instruction which is not yet completely
+ * buffered. Malformed data is left unparsed, such that the error is reported
+ * by the next call to guac_instruction_read_into().
+ *
+ * As with guac_instruction_read_into(), the parsed instructions point into the
+ * internal buffer of the socket, and remain valid only until the next read
+ * from that socket.
+ *
+ * @param socket The guac_socket connection to use.
+ * @param instructions An array of at least count instructions which should
+ *                     receive the parsed instructions.
+ * @param count The maximum number of instructions to parse.
+ * @return The number of instructions parsed, which may be zero.
+ */
+int guac_instruction_read_buffered(guac_socket* socket,
+        guac_instruction* instructions, int count);
+
 /**
  * Reads a single instruction with the given opcode from the given guac_socket
  * connection.
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_PACING_CONSTANTS_H
+#define _GUAC_PACING_CONSTANTS_H
+
+/**
+ * Constants related to the pacing of frames sent to the Guacamole client.
+ *
+ * @file pacing-constants.h
+ */
+
+/**
+ * The shortest frame duration which will be recommended, in milliseconds.
+ * Connections which are fast enough for any frame are run at this rate.
+ */
+#define GUAC_PACING_MIN_FRAME_DURATION 16
+
+/**
+ * The frame duration to recommend until the connection has been measured,
+ * in milliseconds.
+ */
+#define GUAC_PACING_DEFAULT_FRAME_DURATION 40
+
+/**
+ * The longest frame duration which will be recommended, in milliseconds,
+ * regardless of how slow the connection is.
+ */
+#define GUAC_PACING_MAX_FRAME_DURATION 250
+
+/**
+ * The longest time which may pass between sending a frame and receiving the
+ * acknowledgement of an earlier frame before no further frames should be
+ * sent, in milliseconds, regardless of the measured round trip time.
+ */
+#define GUAC_PACING_MAX_LAG 2000
+
+/**
+ * The lowest JPEG quality to which lossy updates will be reduced when the
+ * connection is too slow for the shortest frame duration.
+ */
+#define GUAC_PACING_MIN_LOSSY_QUALITY 30
+
+/**
+ * The maximum number of frames which may await acknowledgement. If more
+ * frames are sent without being acknowledged, the oldest are forgotten.
+ */
+#define GUAC_PACING_MAX_PENDING_FRAMES 32
+
+/**
+ * The number of recent bandwidth measurements from which the bandwidth
+ * estimate is taken. The estimate is the largest recent measurement, as
+ * measurements made while little is being sent underestimate bandwidth.
+ */
+#define GUAC_PACING_BANDWIDTH_SAMPLES 8
+
+/**
+ * The shortest time over which bandwidth will be measured, in milliseconds.
+ * Frames which are delivered faster than this say little about bandwidth.
+ */
+#define GUAC_PACING_MIN_SAMPLE_DURATION 4
+
+#endif
+
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_PACING_TYPES_H
+#define _GUAC_PACING_TYPES_H
+
+/**
+ * Type definitions related to the pacing of frames sent to the Guacamole
+ * client.
+ *
+ * @file pacing-types.h
+ */
+
+/**
+ * A frame which has been sent to the Guacamole client, but whose "sync"
+ * instruction has not yet been acknowledged.
+ */
+typedef struct guac_pacing_frame guac_pacing_frame;
+
+/**
+ * Estimates of the round trip time and bandwidth of the connection to the
+ * Guacamole client, based on the acknowledgement of each frame, along with
+ * the frame duration and image quality which those estimates suggest.
+ */
+typedef struct guac_pacing guac_pacing;
+
+#endif
+
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_PACING_H
+#define _GUAC_PACING_H
+
+/**
+ * Provides functions and structures for estimating the round trip time and
+ * bandwidth of the connection to the Guacamole client, and for pacing frames
+ * and choosing image quality accordingly.
+ *
+ * @file pacing.h
+ */
+
+#include "pacing-types.h"
+#include "pacing-constants.h"
+#include "timestamp-types.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+struct guac_pacing_frame {
+
+    /**
+     * The timestamp sent within the "sync" instruction ending the frame.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The total number of bytes written to the client once the frame was
+     * sent, including all prior frames.
+     */
+    int64_t bytes;
+
+};
+
+struct guac_pacing {
+
+    /**
+     * The smoothed round trip time of the connection, in milliseconds, or
+     * zero if not yet measured.
+     */
+    int round_trip;
+
+    /**
+     * The smallest round trip time measured, in milliseconds, or zero if not
+     * yet measured. This approximates the round trip time of the connection
+     * when no data is queued.
+     */
+    int min_round_trip;
+
+    /**
+     * The estimated bandwidth of the connection, in bytes per second, or
+     * zero if not yet measured.
+     */
+    int bandwidth;
+
+    /**
+     * The smoothed size of each non-empty frame, in bytes.
+     */
+    int frame_size;
+
+    /**
+     * The recommended duration of each frame, in milliseconds. Frames are
+     * lengthened when the connection cannot deliver frames of the current
+     * size as quickly as they are produced.
+     */
+    int frame_duration;
+
+    /**
+     * Frames which have been sent but not yet acknowledged, as a circular
+     * buffer, oldest first.
+     */
+    guac_pacing_frame __pending[GUAC_PACING_MAX_PENDING_FRAMES];
+
+    /**
+     * The index of the oldest pending frame within __pending.
+     */
+    int __pending_start;
+
+    /**
+     * The number of pending frames.
+     */
+    int __pending_count;
+
+    /**
+     * The total number of bytes written to the client once the most recent
+     * frame was sent.
+     */
+    int64_t __sent_bytes;
+
+    /**
+     * The total number of bytes written to the client once the most recently
+     * acknowledged frame was sent.
+     */
+    int64_t __acknowledged_bytes;
+
+    /**
+     * The time at which the most recent acknowledgement was received.
+     */
+    guac_timestamp __acknowledged_timestamp;
+
+    /**
+     * Recent bandwidth measurements, in bytes per second, as a circular
+     * buffer.
+     */
+    int __bandwidth_samples[GUAC_PACING_BANDWIDTH_SAMPLES];
+
+    /**
+     * The index within __bandwidth_samples to receive the next measurement.
+     */
+    int __bandwidth_sample_index;
+
+    /**
+     * Lock which is acquired whenever the estimates are read or updated, as
+     * frames are sent and acknowledged by different threads.
+     */
+    pthread_mutex_t __lock;
+
+};
+
+/**
+ * Allocates a new guac_pacing, having no measurements and recommending
+ * GUAC_PACING_DEFAULT_FRAME_DURATION.
+ *
+ * @return A newly-allocated guac_pacing, or NULL if allocation fails.
+ */
+guac_pacing* guac_pacing_alloc();
+
+/**
+ * Frees the given guac_pacing.
+ *
+ * @param pacing The guac_pacing to free.
+ */
+void guac_pacing_free(guac_pacing* pacing);
+
+/**
+ * Records that a frame ending with a "sync" instruction bearing the given
+ * timestamp has been sent and flushed.
+ *
+ * @param pacing The guac_pacing to update.
+ * @param timestamp The timestamp sent within the "sync" instruction.
+ * @param bytes The total number of bytes written to the client once the
+ *              frame was flushed, including all prior frames.
+ */
+void guac_pacing_frame_sent(guac_pacing* pacing, guac_timestamp timestamp,
+        int64_t bytes);
+
+/**
+ * Records that the client has acknowledged the frame ending with a "sync"
+ * instruction bearing the given timestamp, updating all estimates. All
+ * frames sent before that frame are considered acknowledged as well.
+ * Acknowledgements of frames which are not pending are ignored.
+ *
+ * @param pacing The guac_pacing to update.
+ * @param timestamp The timestamp within the "sync" instruction received.
+ * @param now The current time.
+ */
+void guac_pacing_frame_acknowledged(guac_pacing* pacing,
+        guac_timestamp timestamp, guac_timestamp now);
+
+/**
+ * Returns the recommended duration of each frame, in milliseconds.
+ *
+ * @param pacing The guac_pacing to query.
+ * @return The recommended frame duration, in milliseconds.
+ */
+int guac_pacing_get_frame_duration(guac_pacing* pacing);
+
+/**
+ * Returns the longest time which should pass between the most recent frame
+ * sent and the most recent frame acknowledged before further frames are
+ * withheld, such that no more than a couple of frames are ever queued
+ * within the connection.
+ *
+ * @param pacing The guac_pacing to query.
+ * @return The maximum allowed lag, in milliseconds.
+ */
+int guac_pacing_get_max_lag(guac_pacing* pacing);
+
+/**
+ * Returns the JPEG quality which should be used in place of the given
+ * quality, reduced as the recommended frame duration grows beyond
+ * GUAC_PACING_MIN_FRAME_DURATION. A quality of zero, denoting that lossy
+ * compression is disabled, is never changed.
+ *
+ * @param pacing The guac_pacing to query.
+ * @param quality The JPEG quality requested, from 1 to 100, or zero if lossy
+ *                compression is disabled.
+ * @return The JPEG quality to use, or zero if lossy compression is disabled.
+ */
+int guac_pacing_get_lossy_quality(guac_pacing* pacing, int quality);
+
+#endif
+
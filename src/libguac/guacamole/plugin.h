@@ -46,6 +46,13 @@ struct guac_client_plugin {
      */
     guac_client_init_handler* init_handler;
 
+    /**
+     * Reference to the optional preload handler of this client plugin, or
+     * NULL if the plugin does not provide one. This function will be called
+     * if the client plugin is preloaded prior to any client being started.
+     */
+    guac_client_preload_handler* preload_handler;
+
     /**
      * NULL-terminated array of all arguments accepted by this client
      * plugin, in order. The values of these arguments will be passed
@@ -53,6 +60,21 @@ struct guac_client_plugin {
      */
     const char** args;
 
+    /**
+     * Non-zero if this client plugin declares, through the optional
+     * GUAC_CLIENT_EVENT_DRIVEN symbol, that its clients may be driven entirely
+     * by events on their message_fd, such that many clients may safely share
+     * a single process. Zero otherwise.
+     */
+    int event_driven;
+
+    /**
+     * Non-zero if this client plugin declares, through the optional
+     * GUAC_CLIENT_VIEWERS symbol, that its clients define a join_handler,
+     * such that other viewers may be added to those clients. Zero otherwise.
+     */
+    int viewers;
+
 };
 
 /**
@@ -76,6 +98,16 @@ guac_client_plugin* guac_client_plugin_open(const char* protocol);
  */
 int guac_client_plugin_close(guac_client_plugin* plugin);
 
+/**
+ * Performs any process-wide initialization required by the clients of the
+ * given client plugin, using the optional preload handler provided by that
+ * plugin, such that this initialization need not delay the first client. If
+ * the plugin has no preload handler, this function has no effect.
+ * @param plugin The client plugin to preload.
+ * @return Zero if preloading was successful, non-zero otherwise.
+ */
+int guac_client_plugin_preload(guac_client_plugin* plugin);
+
 /**
  * Initializes the given guac_client using the initialization routine provided
  * by the given guac_client_plugin.
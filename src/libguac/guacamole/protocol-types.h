@@ -244,5 +244,55 @@ typedef enum guac_line_join_style {
     GUAC_LINE_JOIN_ROUND = 0x2
 } guac_line_join_style;
 
+/**
+ * Whether an image is known to be representable as PNG using a palette of 256
+ * colors or fewer, as determined by a previous color census of that image.
+ */
+typedef enum guac_palette_hint {
+
+    /**
+     * No census has been performed. The colors of the image will be counted
+     * to determine whether a palette can be used.
+     */
+    GUAC_PALETTE_HINT_UNKNOWN,
+
+    /**
+     * The most recent census found 256 colors or fewer.
+     */
+    GUAC_PALETTE_HINT_PALETTE,
+
+    /**
+     * The most recent census found more than 256 colors. The image will be
+     * encoded without attempting a palette.
+     */
+    GUAC_PALETTE_HINT_TRUECOLOR
+
+} guac_palette_hint;
+
+/**
+ * The tradeoff between encoding speed and output size to use when encoding
+ * images as PNG.
+ */
+typedef enum guac_png_compression {
+
+    /**
+     * Moderate compression at moderate speed.
+     */
+    GUAC_PNG_COMPRESSION_DEFAULT,
+
+    /**
+     * The fastest compression, producing larger images. Suitable for
+     * connections where bandwidth is plentiful, such as within a LAN.
+     */
+    GUAC_PNG_COMPRESSION_FAST,
+
+    /**
+     * The strongest compression, at the cost of significantly more CPU time.
+     * Suitable for connections where bandwidth is scarce, such as over a WAN.
+     */
+    GUAC_PNG_COMPRESSION_SMALL
+
+} guac_png_compression;
+
 #endif
 
@@ -542,6 +542,150 @@ int guac_protocol_send_lstroke(guac_socket* socket,
 int guac_protocol_send_png(guac_socket* socket, guac_composite_mode mode,
         const guac_layer* layer, int x, int y, cairo_surface_t* surface);
 
+/**
+ * Sends a png instruction over the given guac_socket connection using PNG
+ * data which has already been encoded, such as by guac_protocol_encode_png().
+ * The PNG image data given will be automatically base64-encoded for
+ * transmission.
+ *
+ * If an error occurs sending the instruction, a non-zero value is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param socket The guac_socket connection to use.
+ * @param mode The composite mode to use.
+ * @param layer The destination layer.
+ * @param x The destination X coordinate.
+ * @param y The destination Y coordinate.
+ * @param data The encoded PNG image data.
+ * @param length The number of bytes of PNG image data.
+ * @return Zero on success, non-zero on error.
+ */
+int guac_protocol_send_png_data(guac_socket* socket, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, const void* data, int length);
+
+/**
+ * Sends the given surface as a PNG image along the given stream, beginning
+ * with an img instruction having the "image/png" mimetype, followed by blob
+ * instructions containing the PNG data as it is encoded, and finally an end
+ * instruction. Unlike guac_protocol_send_png(), the PNG is never held in
+ * memory in its entirety, and the first blob can be sent as soon as
+ * compression begins producing output. The stream must already have been
+ * allocated, and can be freed once this function returns.
+ *
+ * The img instruction is not understood by older clients, which must be sent
+ * PNG images using guac_protocol_send_png() instead.
+ *
+ * If an error occurs sending the image, a non-zero value is returned, and
+ * guac_error is set appropriately.
+ *
+ * @param socket The guac_socket connection to use.
+ * @param stream The stream along which the PNG data should be sent.
+ * @param mode The composite mode to use.
+ * @param layer The destination layer.
+ * @param x The destination X coordinate.
+ * @param y The destination Y coordinate.
+ * @param surface A cairo surface containing the image data to send.
+ * @param compression The tradeoff between encoding speed and output size to
+ *                    use.
+ * @param hint Pointer to a hint describing whether the image can be
+ *             represented with a palette, as with
+ *             guac_protocol_encode_png_hinted(), or NULL if no hint is
+ *             available.
+ * @return Zero on success, non-zero on error.
+ */
+int guac_protocol_stream_png(guac_socket* socket, const guac_stream* stream,
+        guac_composite_mode mode, const guac_layer* layer, int x, int y,
+        cairo_surface_t* surface, guac_png_compression compression,
+        guac_palette_hint* hint);
+
+/**
+ * Encodes the given surface as PNG into a newly-allocated buffer, exactly as
+ * guac_protocol_send_png() would encode it. The encoding does not involve any
+ * guac_socket, and thus may safely be performed on a different thread than
+ * the one sending instructions, so long as the surface is not modified while
+ * it is being encoded. The buffer returned must eventually be freed with
+ * free().
+ *
+ * If an error occurs while encoding, a non-zero value is returned, and
+ * guac_error is set appropriately.
+ *
+ * @param surface A cairo surface containing the image data to encode.
+ * @param data Pointer to the location where a pointer to the newly-allocated
+ *             buffer containing the encoded PNG should be stored.
+ * @param length Pointer to the location where the number of bytes of encoded
+ *               PNG data should be stored.
+ * @return Zero on success, non-zero on error.
+ */
+int guac_protocol_encode_png(cairo_surface_t* surface, void** data,
+        int* length);
+
+/**
+ * Encodes the given surface as PNG, exactly as guac_protocol_encode_png(),
+ * using the given speed/size tradeoff, and using and updating the given hint
+ * describing whether the image can be represented with a palette. Callers
+ * which repeatedly encode the same region of a changing image can retain the
+ * hint between encodings, avoiding the cost of counting the colors of images
+ * which previously had too many colors for a palette.
+ *
+ * @param surface A cairo surface containing the image data to encode.
+ * @param compression The tradeoff between encoding speed and output size to
+ *                    use.
+ * @param hint Pointer to the hint to use, which will be updated to reflect
+ *             the result of this encoding. If GUAC_PALETTE_HINT_TRUECOLOR,
+ *             the image will be encoded without attempting a palette.
+ * @param data Pointer to the location where a pointer to the newly-allocated
+ *             buffer containing the encoded PNG should be stored.
+ * @param length Pointer to the location where the number of bytes of encoded
+ *               PNG data should be stored.
+ * @return Zero on success, non-zero on error.
+ */
+int guac_protocol_encode_png_hinted(cairo_surface_t* surface,
+        guac_png_compression compression, guac_palette_hint* hint,
+        void** data, int* length);
+
+/**
+ * Encodes the given surface as JPEG into a newly-allocated buffer. As with
+ * guac_protocol_encode_png(), no guac_socket is involved, and the encoding
+ * may be performed on any thread. The buffer returned must eventually be
+ * freed with free(). Only surfaces of format CAIRO_FORMAT_RGB24 can be
+ * encoded as JPEG.
+ *
+ * If libguac was built without JPEG support, or an error occurs while
+ * encoding, a non-zero value is returned, and guac_error is set
+ * appropriately.
+ *
+ * @param surface A cairo surface containing the image data to encode.
+ * @param quality The JPEG quality to use, from 0 (worst) to 100 (best).
+ * @param data Pointer to the location where a pointer to the newly-allocated
+ *             buffer containing the encoded JPEG should be stored.
+ * @param length Pointer to the location where the number of bytes of encoded
+ *               JPEG data should be stored.
+ * @return Zero on success, non-zero on error.
+ */
+int guac_protocol_encode_jpeg(cairo_surface_t* surface, int quality,
+        void** data, int* length);
+
+/**
+ * Sends an img instruction over the given guac_socket connection. The image
+ * data itself, of the given mimetype, must then be sent along the given
+ * stream using blob instructions, followed by an end instruction.
+ *
+ * If an error occurs sending the instruction, a non-zero value is
+ * returned, and guac_error is set appropriately.
+ *
+ * @param socket The guac_socket connection to use.
+ * @param stream The stream along which the image data will be sent.
+ * @param mode The composite mode to use.
+ * @param layer The destination layer.
+ * @param mimetype The mimetype of the image data being sent.
+ * @param x The destination X coordinate.
+ * @param y The destination Y coordinate.
+ * @return Zero on success, non-zero on error.
+ */
+int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
+        guac_composite_mode mode, const guac_layer* layer,
+        const char* mimetype, int x, int y);
+
 /**
  * Sends a pop instruction over the given guac_socket connection.
  *
@@ -34,6 +34,14 @@
  */
 #define GUAC_SOCKET_OUTPUT_BUFFER_SIZE 8192
 
+/**
+ * The maximum number of output buffers, each GUAC_SOCKET_OUTPUT_BUFFER_SIZE
+ * bytes, which may be chained together before flushing. Chained buffers are
+ * only used by sockets having a writev handler, and are written together in
+ * a single call to that handler.
+ */
+#define GUAC_SOCKET_OUTPUT_CHAIN_LENGTH 32
+
 /**
  * The number of milliseconds to wait between keep-alive pings on a socket
  * with keep-alive enabled.
@@ -31,6 +31,7 @@
 
 #include "socket-types.h"
 
+#include <sys/uio.h>
 #include <unistd.h>
 
 /**
@@ -59,6 +60,20 @@ typedef ssize_t guac_socket_read_handler(guac_socket* socket,
 typedef ssize_t guac_socket_write_handler(guac_socket* socket,
         const void* buf, size_t count);
 
+/**
+ * Generic scatter/gather write handler for socket write operations, modeled
+ * after the standard POSIX writev() function. When set within a guac_socket,
+ * a handler of this type will be called instead of the write handler when
+ * multiple buffers need to be written to the socket at once.
+ *
+ * @param socket The guac_socket being written to.
+ * @param iov The array of buffers containing data to be written, in order.
+ * @param iovcnt The number of buffers within the array.
+ * @return The total number of bytes written, or -1 if an error occurs.
+ */
+typedef ssize_t guac_socket_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt);
+
 /**
  * Generic handler for socket select operations, similar to the POSIX select()
  * function. When guac_socket_select() is called on a guac_socket, its
@@ -36,6 +36,7 @@
 
 #include <pthread.h>
 #include <stdint.h>
+#include <sys/uio.h>
 #include <unistd.h>
 
 struct guac_socket {
@@ -57,6 +58,15 @@ struct guac_socket {
      */
     guac_socket_write_handler* write_handler;
 
+    /**
+     * Handler which will be called whenever multiple buffers of data are
+     * written to this socket at once. If defined, buffered output may span
+     * several chained buffers, all of which are passed to this handler when
+     * the socket is flushed. If not defined, the write handler is used for
+     * each buffer in turn.
+     */
+    guac_socket_writev_handler* writev_handler;
+
     /**
      * Handler which will be called whenever guac_socket_select is invoked
      * on this socket.
@@ -79,6 +89,18 @@ struct guac_socket {
      */
     guac_timestamp last_write_timestamp;
 
+    /**
+     * The total number of bytes written to this guac_socket by its write
+     * handlers since the guac_socket was allocated.
+     */
+    int64_t bytes_written;
+
+    /**
+     * The total number of bytes read from this guac_socket by its read
+     * handler since the guac_socket was allocated.
+     */
+    int64_t bytes_read;
+
     /**
      * The number of bytes present in the base64 "ready" buffer.
      */
@@ -97,9 +119,29 @@ struct guac_socket {
 
     /**
      * The main write buffer. Bytes written go here before being flushed
-     * to the open file descriptor.
+     * to the open file descriptor. This is always the buffer at index
+     * __out_chain_current within __out_chain.
      */
-    char __out_buf[GUAC_SOCKET_OUTPUT_BUFFER_SIZE];
+    char* __out_buf;
+
+    /**
+     * All allocated write buffers, each GUAC_SOCKET_OUTPUT_BUFFER_SIZE bytes.
+     * Buffers before the current buffer are complete and awaiting flush,
+     * while buffers after the current buffer (if any) are unused and kept
+     * only for reuse. Unallocated entries are NULL.
+     */
+    char* __out_chain[GUAC_SOCKET_OUTPUT_CHAIN_LENGTH];
+
+    /**
+     * The number of bytes within each complete buffer of __out_chain prior
+     * to the current buffer.
+     */
+    int __out_chain_lengths[GUAC_SOCKET_OUTPUT_CHAIN_LENGTH];
+
+    /**
+     * The index of the current write buffer within __out_chain.
+     */
+    int __out_chain_current;
 
     /**
      * Pointer to the first character of the current in-progress instruction
@@ -313,6 +355,23 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
  */
 ssize_t guac_socket_write(guac_socket* socket, const void* buf, size_t count);
 
+/**
+ * Writes the given buffers to the specified socket, in order. The data
+ * written is not buffered, and will be sent immediately. If the socket has a
+ * writev handler, all buffers are passed to that handler together, otherwise
+ * each buffer is written in turn with the write handler.
+ *
+ * If an error occurs while writing, a non-zero value is returned, and
+ * guac_error is set appropriately.
+ *
+ * @param socket The guac_socket object to write to.
+ * @param iov The array of buffers containing the data to write.
+ * @param iovcnt The number of buffers within the array.
+ * @return Zero on success, or non-zero if an error occurs while writing.
+ */
+int guac_socket_writev(guac_socket* socket, const struct iovec* iov,
+        int iovcnt);
+
 /**
  * Attempts to read data from the socket, filling up to the specified number
  * of bytes in the given buffer.
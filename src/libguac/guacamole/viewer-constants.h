@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_VIEWER_CONSTANTS_H
+#define _GUAC_VIEWER_CONSTANTS_H
+
+/**
+ * Constants related to the viewers sharing a guac_client.
+ *
+ * @file viewer-constants.h
+ */
+
+/**
+ * The maximum number of bytes which may remain queued for a viewer at the
+ * end of a frame. Once a viewer falls further behind, the output of the
+ * client is skipped for that viewer until it catches up, such that a slow
+ * viewer can neither stall the client nor consume unbounded memory.
+ */
+#define GUAC_VIEWER_MAX_BACKLOG 4194304
+
+/**
+ * The minimum amount of time between the points at which a viewer is sent
+ * the current state of the client, in milliseconds. A lagging viewer which
+ * catches up sooner continues to skip output until this much time has
+ * passed, such that the full state of the client is not repeatedly
+ * re-encoded for a viewer which cannot keep up.
+ */
+#define GUAC_VIEWER_RESYNC_INTERVAL 5000
+
+/**
+ * The amount of time a viewer must keep up with the client after being sent
+ * the current state of the client before falling behind again no longer
+ * counts against that viewer, in milliseconds.
+ */
+#define GUAC_VIEWER_STABLE_INTERVAL 30000
+
+/**
+ * The number of times a viewer may fall behind in succession, each time
+ * within GUAC_VIEWER_STABLE_INTERVAL of being sent the current state of the
+ * client, before that viewer is disconnected.
+ */
+#define GUAC_VIEWER_MAX_LAGS 3
+
+#endif
+
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_VIEWER_TYPES_H
+#define _GUAC_VIEWER_TYPES_H
+
+/**
+ * Type definitions related to the viewers sharing a guac_client.
+ *
+ * @file viewer-types.h
+ */
+
+/**
+ * An additional connection which receives the same output as the connection
+ * which created a guac_client, and which may optionally provide input.
+ */
+typedef struct guac_viewer guac_viewer;
+
+/**
+ * The state of a viewer relative to the output of the guac_client it views.
+ */
+typedef enum guac_viewer_state {
+
+    /**
+     * The viewer has joined, but has not yet received the current state of
+     * the client. The state will be sent at the end of the next frame.
+     */
+    GUAC_VIEWER_JOINING,
+
+    /**
+     * The viewer is receiving all output of the client.
+     */
+    GUAC_VIEWER_ACTIVE,
+
+    /**
+     * The viewer fell too far behind, and output of the client is being
+     * skipped until everything already queued for the viewer has been sent,
+     * at which point the viewer will again receive the current state of the
+     * client.
+     */
+    GUAC_VIEWER_LAGGING
+
+} guac_viewer_state;
+
+#endif
+
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_VIEWER_H
+#define _GUAC_VIEWER_H
+
+/**
+ * Provides functions and structures for sharing a single guac_client between
+ * several connections. The output of the client is encoded only once, and
+ * the encoded data is sent both to the connection which created the client
+ * and to each viewer, each viewer having its own queue such that a slow
+ * viewer cannot stall the others.
+ *
+ * @file viewer.h
+ */
+
+#include "client-types.h"
+#include "instruction-types.h"
+#include "socket-types.h"
+#include "timestamp-types.h"
+#include "viewer-constants.h"
+#include "viewer-types.h"
+
+#include <pthread.h>
+#include <stddef.h>
+
+struct guac_viewer {
+
+    /**
+     * The client being viewed.
+     */
+    guac_client* client;
+
+    /**
+     * The connection of this viewer. Output is written to this socket only
+     * by the writer thread of the viewer, while input should be read by the
+     * caller which added the viewer.
+     */
+    guac_socket* socket;
+
+    /**
+     * Non-zero if input from this viewer is ignored, zero if this viewer may
+     * use the mouse and keyboard.
+     */
+    int read_only;
+
+    /**
+     * The timestamp within the most recent "sync" instruction received from
+     * this viewer.
+     */
+    guac_timestamp last_received_timestamp;
+
+    /**
+     * The current state of this viewer. This is accessed only while the
+     * viewer lock of the client is held.
+     */
+    guac_viewer_state __state;
+
+    /**
+     * The time at which this viewer was most recently sent the current
+     * state of the client. This is accessed only while the viewer lock of
+     * the client is held.
+     */
+    guac_timestamp __joined;
+
+    /**
+     * The number of times this viewer has fallen behind in succession, each
+     * time shortly after being sent the current state of the client. This
+     * is accessed only while the viewer lock of the client is held.
+     */
+    int __lag_count;
+
+    /**
+     * Socket whose written data is appended to the queue of this viewer.
+     * The output of the client, as well as the state of the client sent when
+     * the viewer joins, is written to this socket.
+     */
+    guac_socket* __queue;
+
+    /**
+     * Data queued for the writer thread, but not yet taken by that thread.
+     */
+    char* __pending;
+
+    /**
+     * The number of bytes within __pending.
+     */
+    size_t __pending_length;
+
+    /**
+     * The number of bytes allocated for __pending.
+     */
+    size_t __pending_size;
+
+    /**
+     * Non-zero if writing to the socket of this viewer has failed, in which
+     * case all further output is discarded.
+     */
+    int __failed;
+
+    /**
+     * Non-zero if the writer thread should stop.
+     */
+    int __closing;
+
+    /**
+     * Lock which guards the queue of this viewer.
+     */
+    pthread_mutex_t __lock;
+
+    /**
+     * Condition which is signalled whenever data is queued or the viewer is
+     * closing.
+     */
+    pthread_cond_t __queued;
+
+    /**
+     * The thread which writes queued data to the socket of this viewer.
+     */
+    pthread_t __writer_thread;
+
+    /**
+     * The next viewer of the same client, or NULL if this is the last.
+     */
+    guac_viewer* __next;
+
+};
+
+/**
+ * Allows viewers to be added to the given client, replacing the socket of
+ * the client with a socket that sends all data written both to the original
+ * socket and to each viewer. This must be called before the client is
+ * initialized by its client plugin, such that nothing retains the original
+ * socket. The original socket continues to be used for all input, and is not
+ * freed along with the client.
+ *
+ * @param client The client to allow viewers for.
+ * @return Zero on success, non-zero if an error occurs, in which case
+ *         guac_error will be set appropriately.
+ */
+int guac_client_allow_viewers(guac_client* client);
+
+/**
+ * Adds a viewer to the given client, which must allow viewers and must have
+ * a join handler. Once added, the viewer is sent a "ready" instruction
+ * containing the ID of the client, and will receive the current state of the
+ * client at the end of the next frame, and all output of the client from that
+ * point onward. Input from the viewer must be read by the caller and passed to
+ * guac_viewer_handle_instruction().
+ *
+ * @param client The client to add a viewer to.
+ * @param socket The connection of the new viewer, which must already have
+ *               completed the Guacamole protocol handshake up to, but not
+ *               including, the "ready" instruction.
+ * @param read_only Non-zero if input from the viewer should be ignored.
+ * @return The new viewer, or NULL if the viewer cannot be added, in which
+ *         case guac_error will be set appropriately.
+ */
+guac_viewer* guac_client_add_viewer(guac_client* client, guac_socket* socket,
+        int read_only);
+
+/**
+ * Returns whether output can no longer be sent to the given viewer, either
+ * because writing to its socket failed or because it repeatedly fell too
+ * far behind the client. Such viewers should be removed.
+ *
+ * @param viewer The viewer to check.
+ * @return Non-zero if the viewer has failed, zero otherwise.
+ */
+int guac_viewer_failed(guac_viewer* viewer);
+
+/**
+ * Removes the given viewer from the client it views, freeing the viewer. The
+ * socket of the viewer is not freed. Every viewer must be removed before its
+ * client can be freed.
+ *
+ * @param viewer The viewer to remove.
+ */
+void guac_client_remove_viewer(guac_viewer* viewer);
+
+/**
+ * Brings the viewers of the given client up to date with the current frame.
+ * Viewers which have just joined, or which have caught up after falling
+ * behind, receive the current state of the client from its join handler,
+ * while viewers which have fallen too far behind stop receiving output until
+ * they catch up. This function must be called at the end of each frame, after
+ * all output of that frame has been written, and from the same thread that
+ * handles server messages.
+ *
+ * @param client The client whose viewers should be updated.
+ */
+void guac_client_sync_viewers(guac_client* client);
+
+/**
+ * Handles the given instruction, which was received from the given viewer.
+ * Mouse and keyboard input is passed to the client unless the viewer is
+ * read-only. Instructions affecting the client as a whole, such as changes
+ * to the display size or streams, are ignored.
+ *
+ * @param viewer The viewer which sent the instruction.
+ * @param instruction The instruction to handle.
+ * @return Zero if the instruction was handled, a positive value if the
+ *         viewer has disconnected, or a negative value if the handler of the
+ *         client failed.
+ */
+int guac_viewer_handle_instruction(guac_viewer* viewer,
+        guac_instruction* instruction);
+
+#endif
+
@@ -46,8 +46,102 @@ guac_instruction* guac_instruction_alloc() {
 
 }
 
+/**
+ * The opcode corresponding to each guac_instruction_opcode value, indexed by
+ * that value.
+ */
+static const char* __guac_instruction_opcode_names[] = {
+    NULL,         /* GUAC_INSTRUCTION_OPCODE_UNKNOWN */
+    "ack",        /* GUAC_INSTRUCTION_OPCODE_ACK */
+    "audio",      /* GUAC_INSTRUCTION_OPCODE_AUDIO */
+    "blob",       /* GUAC_INSTRUCTION_OPCODE_BLOB */
+    "clipboard",  /* GUAC_INSTRUCTION_OPCODE_CLIPBOARD */
+    "connect",    /* GUAC_INSTRUCTION_OPCODE_CONNECT */
+    "disconnect", /* GUAC_INSTRUCTION_OPCODE_DISCONNECT */
+    "end",        /* GUAC_INSTRUCTION_OPCODE_END */
+    "file",       /* GUAC_INSTRUCTION_OPCODE_FILE */
+    "key",        /* GUAC_INSTRUCTION_OPCODE_KEY */
+    "mouse",      /* GUAC_INSTRUCTION_OPCODE_MOUSE */
+    "pipe",       /* GUAC_INSTRUCTION_OPCODE_PIPE */
+    "select",     /* GUAC_INSTRUCTION_OPCODE_SELECT */
+    "size",       /* GUAC_INSTRUCTION_OPCODE_SIZE */
+    "sync",       /* GUAC_INSTRUCTION_OPCODE_SYNC */
+    "video",      /* GUAC_INSTRUCTION_OPCODE_VIDEO */
+    "image"       /* GUAC_INSTRUCTION_OPCODE_IMAGE */
+};
+
+guac_instruction_opcode guac_instruction_get_opcode(const char* opcode,
+        int length) {
+
+    guac_instruction_opcode candidate = GUAC_INSTRUCTION_OPCODE_UNKNOWN;
+
+    /* Narrow down to a single candidate using length and first character,
+     * which are sufficient to distinguish all known opcodes except "size"
+     * and "sync" */
+    switch (length) {
+
+        case 3:
+            switch (opcode[0]) {
+                case 'a': candidate = GUAC_INSTRUCTION_OPCODE_ACK; break;
+                case 'e': candidate = GUAC_INSTRUCTION_OPCODE_END; break;
+                case 'k': candidate = GUAC_INSTRUCTION_OPCODE_KEY; break;
+            }
+            break;
+
+        case 4:
+            switch (opcode[0]) {
+                case 'b': candidate = GUAC_INSTRUCTION_OPCODE_BLOB; break;
+                case 'f': candidate = GUAC_INSTRUCTION_OPCODE_FILE; break;
+                case 'p': candidate = GUAC_INSTRUCTION_OPCODE_PIPE; break;
+                case 's':
+                    if (opcode[1] == 'i')
+                        candidate = GUAC_INSTRUCTION_OPCODE_SIZE;
+                    else
+                        candidate = GUAC_INSTRUCTION_OPCODE_SYNC;
+                    break;
+            }
+            break;
+
+        case 5:
+            switch (opcode[0]) {
+                case 'a': candidate = GUAC_INSTRUCTION_OPCODE_AUDIO; break;
+                case 'i': candidate = GUAC_INSTRUCTION_OPCODE_IMAGE; break;
+                case 'm': candidate = GUAC_INSTRUCTION_OPCODE_MOUSE; break;
+                case 'v': candidate = GUAC_INSTRUCTION_OPCODE_VIDEO; break;
+            }
+            break;
+
+        case 6:
+            candidate = GUAC_INSTRUCTION_OPCODE_SELECT;
+            break;
+
+        case 7:
+            candidate = GUAC_INSTRUCTION_OPCODE_CONNECT;
+            break;
+
+        case 9:
+            candidate = GUAC_INSTRUCTION_OPCODE_CLIPBOARD;
+            break;
+
+        case 10:
+            candidate = GUAC_INSTRUCTION_OPCODE_DISCONNECT;
+            break;
+
+    }
+
+    /* Verify candidate against full opcode */
+    if (candidate != GUAC_INSTRUCTION_OPCODE_UNKNOWN
+            && memcmp(opcode, __guac_instruction_opcode_names[candidate],
+                length) == 0)
+        return candidate;
+
+    return GUAC_INSTRUCTION_OPCODE_UNKNOWN;
+
+}
+
 void guac_instruction_reset(guac_instruction* instruction) {
     instruction->opcode = NULL;
+    instruction->opcode_id = GUAC_INSTRUCTION_OPCODE_UNKNOWN;
     instruction->argc = 0;
     instruction->state = GUAC_INSTRUCTION_PARSE_LENGTH;
     instruction->__elementc = 0;
@@ -128,6 +222,12 @@ int guac_instruction_append(guac_instruction* instr,
 
                 *char_buffer = '\0';
 
+                /* Identify opcode as soon as it is complete */
+                if (instr->__elementc == 1)
+                    instr->opcode_id = guac_instruction_get_opcode(
+                            instr->__elementv[0],
+                            char_buffer - instr->__elementv[0]);
+
                 /* If semicolon, store end-of-instruction */
                 if (c == ';') {
                     instr->state = GUAC_INSTRUCTION_PARSE_COMPLETE;
@@ -163,9 +263,48 @@ int guac_instruction_append(guac_instruction* instr,
 
 }
 
-/* Returns new instruction if one exists, or NULL if no more instructions. */
-guac_instruction* guac_instruction_read(guac_socket* socket,
-        int usec_timeout) {
+/**
+ * Restores the element terminators within the given partially-parsed
+ * instruction data, which guac_instruction_append() replaces with null
+ * characters as each element is parsed. As the instruction is incomplete,
+ * every terminator parsed thus far must have been a comma. Once restored, the
+ * data can be parsed again from the beginning when more data is available.
+ *
+ * @param start The start of the partially-parsed instruction.
+ * @param end The first byte of the instruction which was not yet parsed.
+ */
+static void __guac_instruction_restore(char* start, char* end) {
+
+    while (start < end) {
+
+        /* Skip element length */
+        int length = 0;
+        while (start < end && *start >= '0' && *start <= '9')
+            length = length*10 + *(start++) - '0';
+
+        /* Skip period */
+        if (start >= end || *start != '.')
+            return;
+        start++;
+
+        /* Skip element content */
+        while (start < end && length > 0) {
+            start += guac_utf8_charsize((unsigned char) *start);
+            length--;
+        }
+
+        /* Restore terminator */
+        if (start < end && *start == '\0')
+            *start = ',';
+
+        start++;
+
+    }
+
+}
+
+int guac_instruction_read_into(guac_socket* socket, int usec_timeout,
+        guac_instruction* instruction) {
 
     char* unparsed_end = socket->__instructionbuf_unparsed_end;
     char* unparsed_start = socket->__instructionbuf_unparsed_start;
@@ -173,7 +312,7 @@ guac_instruction* guac_instruction_read(guac_socket* socket,
     char* buffer_end = socket->__instructionbuf
                             + sizeof(socket->__instructionbuf);
 
-    guac_instruction* instruction = guac_instruction_alloc();
+    guac_instruction_reset(instruction);
 
     while (instruction->state != GUAC_INSTRUCTION_PARSE_COMPLETE
         && instruction->state != GUAC_INSTRUCTION_PARSE_ERROR) {
@@ -215,15 +354,23 @@ guac_instruction* guac_instruction_read(guac_socket* socket,
                 else {
                     guac_error = GUAC_STATUS_NO_MEMORY;
                     guac_error_message = "Instruction too long";
-                    return NULL;
+                    return -1;
                 }
 
             }
 
             /* No instruction yet? Get more data ... */
             retval = guac_socket_select(socket, usec_timeout);
-            if (retval <= 0)
-                return NULL;
+            if (retval <= 0) {
+
+                /* Retain partial instruction such that it will be parsed
+                 * once the remaining data arrives */
+                __guac_instruction_restore(instr_start, unparsed_start);
+                socket->__instructionbuf_unparsed_start = instr_start;
+                socket->__instructionbuf_unparsed_end = unparsed_end;
+
+                return -1;
+            }
            
             /* Attempt to fill buffer */
             retval = guac_socket_read(socket, unparsed_end,
@@ -233,7 +380,7 @@ guac_instruction* guac_instruction_read(guac_socket* socket,
             if (retval < 0) {
                 guac_error = GUAC_STATUS_SEE_ERRNO;
                 guac_error_message = "Error filling instruction buffer";
-                return NULL;
+                return -1;
             }
 
             /* EOF */
@@ -241,7 +388,7 @@ guac_instruction* guac_instruction_read(guac_socket* socket,
                 guac_error = GUAC_STATUS_CLOSED;
                 guac_error_message = "End of stream reached while "
                                      "reading instruction";
-                return NULL;
+                return -1;
             }
 
             /* Update internal buffer */
@@ -259,19 +406,148 @@ guac_instruction* guac_instruction_read(guac_socket* socket,
     if (instruction->state == GUAC_INSTRUCTION_PARSE_ERROR) {
         guac_error = GUAC_STATUS_PROTOCOL_ERROR;
         guac_error_message = "Instruction parse error";
-        return NULL;
+        return -1;
     }
 
     socket->__instructionbuf_unparsed_start = unparsed_start;
     socket->__instructionbuf_unparsed_end = unparsed_end;
+    return 0;
+
+}
+
+/* Returns new instruction if one exists, or NULL if no more instructions. */
+guac_instruction* guac_instruction_read(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_instruction* instruction = guac_instruction_alloc();
+    if (instruction == NULL)
+        return NULL;
+
+    /* Read into newly-allocated instruction */
+    if (guac_instruction_read_into(socket, usec_timeout, instruction)) {
+        guac_instruction_free(instruction);
+        return NULL;
+    }
+
     return instruction;
 
 }
 
+/**
+ * Returns the length of the complete instruction at the beginning of the
+ * given buffer, without modifying the buffer. If the buffer does not begin
+ * with a complete, well-formed instruction, zero is returned.
+ *
+ * @param buffer The buffer to inspect.
+ * @param length The number of bytes available within the buffer.
+ * @return The number of bytes making up the complete instruction at the
+ *         beginning of the buffer, or zero if there is no such instruction.
+ */
+static int __guac_instruction_complete_length(const char* buffer,
+        int length) {
+
+    const char* current = buffer;
+    const char* end = buffer + length;
+    int elementc = 0;
+
+    while (elementc < GUAC_INSTRUCTION_MAX_ELEMENTS) {
+
+        int element_length = 0;
+
+        /* Parse element length */
+        while (current < end && *current >= '0' && *current <= '9') {
+
+            element_length = element_length*10 + *(current++) - '0';
+
+            if (element_length > GUAC_INSTRUCTION_MAX_LENGTH)
+                return 0;
+
+        }
+
+        /* Length must be terminated by a period */
+        if (current >= end || *(current++) != '.')
+            return 0;
+
+        /* Skip element content, measured in UTF-8 characters */
+        while (element_length > 0 && current < end) {
+            current += guac_utf8_charsize((unsigned char) *current);
+            element_length--;
+        }
+
+        /* Content must be followed by a terminator */
+        if (current >= end)
+            return 0;
+
+        elementc++;
+
+        /* Semicolon terminates the instruction */
+        if (*current == ';')
+            return current + 1 - buffer;
+
+        /* Anything other than a comma is an error */
+        if (*(current++) != ',')
+            return 0;
+
+    }
+
+    /* Too many elements */
+    return 0;
+
+}
+
+int guac_instruction_read_buffered(guac_socket* socket,
+        guac_instruction* instructions, int count) {
+
+    char* unparsed_start = socket->__instructionbuf_unparsed_start;
+    char* unparsed_end = socket->__instructionbuf_unparsed_end;
+
+    int parsed_count = 0;
+
+    while (parsed_count < count) {
+
+        guac_instruction* instruction = &(instructions[parsed_count]);
+
+        /* Stop at first instruction that is not yet complete (or is
+         * malformed, as such errors are reported by later reads) */
+        int remaining = __guac_instruction_complete_length(unparsed_start,
+                unparsed_end - unparsed_start);
+        if (remaining == 0)
+            break;
+
+        /* Parse complete instruction in place */
+        guac_instruction_reset(instruction);
+        while (instruction->state != GUAC_INSTRUCTION_PARSE_COMPLETE
+            && instruction->state != GUAC_INSTRUCTION_PARSE_ERROR) {
+
+            int parsed = guac_instruction_append(instruction,
+                    unparsed_start, remaining);
+
+            if (parsed == 0)
+                break;
+
+            unparsed_start += parsed;
+            remaining -= parsed;
+
+        }
+
+        /* Stop if parsing somehow did not complete */
+        if (instruction->state != GUAC_INSTRUCTION_PARSE_COMPLETE)
+            break;
+
+        socket->__instructionbuf_unparsed_start = unparsed_start;
+        parsed_count++;
+
+    }
+
+    return parsed_count;
+
+}
+
 guac_instruction* guac_instruction_expect(guac_socket* socket, int usec_timeout,
         const char* opcode) {
 
     guac_instruction* instruction;
+    guac_instruction_opcode expected_id;
 
     /* Wait for data until timeout */
     if (guac_instruction_waiting(socket, usec_timeout) <= 0)
@@ -282,8 +558,11 @@ guac_instruction* guac_instruction_expect(guac_socket* socket, int usec_timeout,
     if (instruction == NULL)
         return NULL;            
 
-    /* Validate instruction */
-    if (strcmp(instruction->opcode, opcode) != 0) {
+    /* Validate instruction, comparing opcode values where possible */
+    expected_id = guac_instruction_get_opcode(opcode, strlen(opcode));
+    if (expected_id != GUAC_INSTRUCTION_OPCODE_UNKNOWN
+            ? instruction->opcode_id != expected_id
+            : strcmp(instruction->opcode, opcode) != 0) {
         guac_error = GUAC_STATUS_PROTOCOL_ERROR;
         guac_error_message = "Instruction read did not have expected opcode";
         guac_instruction_free(instruction);
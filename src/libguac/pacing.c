@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "pacing.h"
+#include "timestamp.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+guac_pacing* guac_pacing_alloc() {
+
+    guac_pacing* pacing = malloc(sizeof(guac_pacing));
+    if (pacing == NULL)
+        return NULL;
+
+    memset(pacing, 0, sizeof(guac_pacing));
+    pacing->frame_duration = GUAC_PACING_DEFAULT_FRAME_DURATION;
+    pthread_mutex_init(&pacing->__lock, NULL);
+
+    return pacing;
+
+}
+
+void guac_pacing_free(guac_pacing* pacing) {
+    pthread_mutex_destroy(&pacing->__lock);
+    free(pacing);
+}
+
+void guac_pacing_frame_sent(guac_pacing* pacing, guac_timestamp timestamp,
+        int64_t bytes) {
+
+    guac_pacing_frame* frame;
+    int size;
+
+    pthread_mutex_lock(&pacing->__lock);
+
+    /* Track typical size of frames which contain anything */
+    size = bytes - pacing->__sent_bytes;
+    pacing->__sent_bytes = bytes;
+
+    if (size > 0) {
+        if (pacing->frame_size == 0)
+            pacing->frame_size = size;
+        else
+            pacing->frame_size += (size - pacing->frame_size) / 8;
+    }
+
+    /* Forget oldest frame if too many are pending */
+    if (pacing->__pending_count == GUAC_PACING_MAX_PENDING_FRAMES) {
+        pacing->__pending_start = (pacing->__pending_start + 1)
+            % GUAC_PACING_MAX_PENDING_FRAMES;
+        pacing->__pending_count--;
+    }
+
+    frame = &pacing->__pending[(pacing->__pending_start
+            + pacing->__pending_count) % GUAC_PACING_MAX_PENDING_FRAMES];
+    frame->timestamp = timestamp;
+    frame->bytes = bytes;
+    pacing->__pending_count++;
+
+    pthread_mutex_unlock(&pacing->__lock);
+
+}
+
+/**
+ * Records the given bandwidth measurement, updating the bandwidth estimate
+ * of the given guac_pacing to the largest recent measurement.
+ *
+ * @param pacing The guac_pacing to update.
+ * @param sample The bandwidth measured, in bytes per second.
+ */
+static void __guac_pacing_add_bandwidth_sample(guac_pacing* pacing,
+        int sample) {
+
+    int i;
+
+    pacing->__bandwidth_samples[pacing->__bandwidth_sample_index] = sample;
+    pacing->__bandwidth_sample_index = (pacing->__bandwidth_sample_index + 1)
+        % GUAC_PACING_BANDWIDTH_SAMPLES;
+
+    pacing->bandwidth = 0;
+    for (i = 0; i < GUAC_PACING_BANDWIDTH_SAMPLES; i++) {
+        if (pacing->__bandwidth_samples[i] > pacing->bandwidth)
+            pacing->bandwidth = pacing->__bandwidth_samples[i];
+    }
+
+}
+
+/**
+ * Recalculates the recommended frame duration of the given guac_pacing from
+ * its current estimates. Frames are lengthened to the time needed to send a
+ * typical frame at the estimated bandwidth, or to the time frames currently
+ * spend queued within the connection, whichever is longer.
+ *
+ * @param pacing The guac_pacing to update.
+ */
+static void __guac_pacing_update_frame_duration(guac_pacing* pacing) {
+
+    int64_t duration = pacing->round_trip - pacing->min_round_trip;
+
+    if (pacing->bandwidth > 0) {
+        int64_t transmit = (int64_t) pacing->frame_size * 1000
+            / pacing->bandwidth;
+        if (transmit > duration)
+            duration = transmit;
+    }
+
+    if (duration < GUAC_PACING_MIN_FRAME_DURATION)
+        duration = GUAC_PACING_MIN_FRAME_DURATION;
+    else if (duration > GUAC_PACING_MAX_FRAME_DURATION)
+        duration = GUAC_PACING_MAX_FRAME_DURATION;
+
+    pacing->frame_duration = duration;
+
+}
+
+void guac_pacing_frame_acknowledged(guac_pacing* pacing,
+        guac_timestamp timestamp, guac_timestamp now) {
+
+    guac_pacing_frame frame;
+    guac_timestamp start;
+    int64_t delivered;
+    int round_trip;
+
+    pthread_mutex_lock(&pacing->__lock);
+
+    /* Earlier frames are acknowledged implicitly */
+    while (pacing->__pending_count > 0
+            && pacing->__pending[pacing->__pending_start].timestamp
+                < timestamp) {
+        pacing->__pending_start = (pacing->__pending_start + 1)
+            % GUAC_PACING_MAX_PENDING_FRAMES;
+        pacing->__pending_count--;
+    }
+
+    /* Ignore acknowledgements of frames which are not pending */
+    if (pacing->__pending_count == 0
+            || pacing->__pending[pacing->__pending_start].timestamp
+                != timestamp) {
+        pthread_mutex_unlock(&pacing->__lock);
+        return;
+    }
+
+    frame = pacing->__pending[pacing->__pending_start];
+    pacing->__pending_start = (pacing->__pending_start + 1)
+        % GUAC_PACING_MAX_PENDING_FRAMES;
+    pacing->__pending_count--;
+
+    /* Update round trip time, which is never less than 1 ms such that zero
+     * continues to denote the lack of a measurement */
+    round_trip = now - frame.timestamp;
+    if (round_trip < 1)
+        round_trip = 1;
+
+    if (pacing->round_trip == 0)
+        pacing->round_trip = round_trip;
+    else
+        pacing->round_trip += (round_trip - pacing->round_trip) / 8;
+
+    if (pacing->min_round_trip == 0 || round_trip < pacing->min_round_trip)
+        pacing->min_round_trip = round_trip;
+
+    /* The data acknowledged could not have begun arriving before the frame
+     * was sent and crossed the connection, nor before the previous
+     * acknowledgement if the connection was still busy */
+    delivered = frame.bytes - pacing->__acknowledged_bytes;
+    start = frame.timestamp + pacing->min_round_trip;
+    if (pacing->__acknowledged_timestamp > start)
+        start = pacing->__acknowledged_timestamp;
+
+    if (delivered > 0 && now - start >= GUAC_PACING_MIN_SAMPLE_DURATION) {
+        int64_t sample = delivered * 1000 / (now - start);
+        __guac_pacing_add_bandwidth_sample(pacing,
+                sample > INT32_MAX ? INT32_MAX : sample);
+    }
+
+    pacing->__acknowledged_bytes = frame.bytes;
+    pacing->__acknowledged_timestamp = now;
+
+    __guac_pacing_update_frame_duration(pacing);
+
+    pthread_mutex_unlock(&pacing->__lock);
+
+}
+
+int guac_pacing_get_frame_duration(guac_pacing* pacing) {
+
+    int duration;
+
+    pthread_mutex_lock(&pacing->__lock);
+    duration = pacing->frame_duration;
+    pthread_mutex_unlock(&pacing->__lock);
+
+    return duration;
+
+}
+
+int guac_pacing_get_max_lag(guac_pacing* pacing) {
+
+    int lag;
+
+    /* Allow for the connection itself plus a couple of frames */
+    pthread_mutex_lock(&pacing->__lock);
+    lag = pacing->min_round_trip + pacing->frame_duration * 2;
+    pthread_mutex_unlock(&pacing->__lock);
+
+    if (lag > GUAC_PACING_MAX_LAG)
+        return GUAC_PACING_MAX_LAG;
+
+    return lag;
+
+}
+
+int guac_pacing_get_lossy_quality(guac_pacing* pacing, int quality) {
+
+    int duration;
+
+    /* Leave lossless updates and already-low quality alone */
+    if (quality <= GUAC_PACING_MIN_LOSSY_QUALITY)
+        return quality;
+
+    /* Reduce quality in proportion to how far frames have been lengthened */
+    pthread_mutex_lock(&pacing->__lock);
+    duration = pacing->frame_duration;
+    if (pacing->round_trip == 0)
+        duration = GUAC_PACING_MIN_FRAME_DURATION;
+    pthread_mutex_unlock(&pacing->__lock);
+
+    return quality - (quality - GUAC_PACING_MIN_LOSSY_QUALITY)
+        * (duration - GUAC_PACING_MIN_FRAME_DURATION)
+        / (GUAC_PACING_MAX_FRAME_DURATION - GUAC_PACING_MIN_FRAME_DURATION);
+
+}
+
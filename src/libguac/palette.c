@@ -26,11 +26,240 @@
 
 #include <cairo/cairo.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * The number of pixels an image must contain before it is sampled prior to
+ * the full color census. Smaller images are cheap enough to count directly.
+ */
+#define GUAC_PALETTE_SAMPLE_THRESHOLD 4096
+
+/**
+ * The number of points sampled along each axis of an image prior to the full
+ * color census. If the sampled points alone contain more than 256 distinct
+ * colors, the image is rejected without scanning every pixel.
+ */
+#define GUAC_PALETTE_SAMPLES 24
+
+/**
+ * Adds the given color to the given palette, if not already present.
+ *
+ * @param palette The palette to add the color to.
+ * @param color The color to add, in 24-bit RGB.
+ * @return Zero if the color is now present within the palette, non-zero if
+ *         the palette is already at capacity.
+ */
+static int __guac_palette_add(guac_palette* palette, int color) {
+
+    /* Calculate hash code */
+    int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+
+    guac_palette_entry* entry;
+
+    /* Search for open palette entry */
+    for (;;) {
+
+        entry = &(palette->entries[hash]);
+
+        /* If we've found a free space, use it */
+        if (entry->index == 0) {
+
+            png_color* c;
+
+            /* Stop if already at capacity */
+            if (palette->size == 256)
+                return 1;
+
+            /* Store in palette */
+            c = &(palette->colors[palette->size]);
+            c->blue  = (color      ) & 0xFF;
+            c->green = (color >> 8 ) & 0xFF;
+            c->red   = (color >> 16) & 0xFF;
+
+            /* Add color to map */
+            entry->index = ++palette->size;
+            entry->color = color;
+
+            return 0;
+
+        }
+
+        /* Otherwise, if already stored here, done */
+        if (entry->color == color)
+            return 0;
+
+        /* Otherwise, collision. Move on to another bucket */
+        hash = (hash+1) & 0xFFF;
+
+    }
+
+}
+
+/**
+ * Returns the number of leading pixels within the given array which have the
+ * given 24-bit RGB color, ignoring the unused high byte of each pixel.
+ *
+ * @param pixels The pixels to inspect.
+ * @param count The number of pixels within the array.
+ * @param color The 24-bit RGB color to compare against.
+ * @return The length of the run of pixels of the given color at the start of
+ *         the array, which may be zero.
+ */
+static int __guac_palette_run_length_generic(const uint32_t* pixels,
+        int count, uint32_t color) {
+
+    int length = 0;
+
+    while (length < count && (pixels[length] & 0xFFFFFF) == color)
+        length++;
+
+    return length;
+
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * SSE2 implementation of __guac_palette_run_length_generic(), comparing four
+ * pixels at a time.
+ */
+__attribute__((target("sse2")))
+static int __guac_palette_run_length_sse2(const uint32_t* pixels,
+        int count, uint32_t color) {
+
+    const __m128i mask = _mm_set1_epi32(0xFFFFFF);
+    const __m128i expected = _mm_set1_epi32(color);
+
+    int length = 0;
+
+    while (length + 4 <= count) {
+
+        __m128i block = _mm_loadu_si128((const __m128i*) (pixels + length));
+        int equal = _mm_movemask_epi8(_mm_cmpeq_epi32(
+                    _mm_and_si128(block, mask), expected));
+
+        /* Locate first differing pixel, if any */
+        if (equal != 0xFFFF)
+            return length + __builtin_ctz(~equal) / 4;
+
+        length += 4;
+
+    }
+
+    return length + __guac_palette_run_length_generic(pixels + length,
+            count - length, color);
+
+}
+
+/**
+ * AVX2 implementation of __guac_palette_run_length_generic(), comparing eight
+ * pixels at a time.
+ */
+__attribute__((target("avx2")))
+static int __guac_palette_run_length_avx2(const uint32_t* pixels,
+        int count, uint32_t color) {
+
+    const __m256i mask = _mm256_set1_epi32(0xFFFFFF);
+    const __m256i expected = _mm256_set1_epi32(color);
+
+    int length = 0;
+
+    while (length + 8 <= count) {
+
+        __m256i block = _mm256_loadu_si256((const __m256i*) (pixels + length));
+        unsigned int equal = _mm256_movemask_epi8(_mm256_cmpeq_epi32(
+                    _mm256_and_si256(block, mask), expected));
+
+        /* Locate first differing pixel, if any */
+        if (equal != 0xFFFFFFFF)
+            return length + __builtin_ctz(~equal) / 4;
+
+        length += 8;
+
+    }
+
+    return length + __guac_palette_run_length_generic(pixels + length,
+            count - length, color);
+
+}
+
+#endif
+
+/**
+ * The run length implementation in use, selected at runtime based on the
+ * capabilities of the CPU.
+ */
+static int (*__guac_palette_run_length)(const uint32_t* pixels, int count,
+        uint32_t color) = __guac_palette_run_length_generic;
+
+/**
+ * Guard ensuring the run length implementation is selected only once.
+ */
+static pthread_once_t __guac_palette_run_length_selected = PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest run length implementation supported by the current
+ * CPU.
+ */
+static void __guac_palette_select_run_length() {
+
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2"))
+        __guac_palette_run_length = __guac_palette_run_length_avx2;
+
+    else if (__builtin_cpu_supports("sse2"))
+        __guac_palette_run_length = __guac_palette_run_length_sse2;
+#endif
+
+}
+
+/**
+ * Adds the colors of a sparse grid of sample points within the given image
+ * to the given palette, such that images with far more than 256 colors are
+ * rejected after inspecting only a small fraction of their pixels. Colors
+ * added while sampling are present within the image, and thus remain valid
+ * entries within the palette.
+ *
+ * @return Zero if all sampled colors fit within the palette, non-zero if the
+ *         image has more than 256 colors.
+ */
+static int __guac_palette_sample(guac_palette* palette,
+        const unsigned char* data, int width, int height, int stride) {
+
+    int step_x = width  / GUAC_PALETTE_SAMPLES;
+    int step_y = height / GUAC_PALETTE_SAMPLES;
+
+    int x, y;
+
+    if (step_x < 1) step_x = 1;
+    if (step_y < 1) step_y = 1;
+
+    /* Offset grid by half a step to avoid sampling only borders */
+    for (y = step_y / 2; y < height; y += step_y) {
+
+        const uint32_t* row = (const uint32_t*) (data + y * stride);
+
+        for (x = step_x / 2; x < width; x += step_x) {
+            if (__guac_palette_add(palette, row[x] & 0xFFFFFF))
+                return 1;
+        }
+
+    }
+
+    return 0;
+
+}
+
 guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
 
     int x, y;
@@ -40,62 +269,51 @@ guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
     int stride = cairo_image_surface_get_stride(surface);
     unsigned char* data = cairo_image_surface_get_data(surface);
 
+    const uint32_t* previous_row = NULL;
+
     /* Allocate palette */
     guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
     memset(palette, 0, sizeof(guac_palette));
 
-    for (y=0; y<height; y++) {
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Calculate hash code */
-            int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+    pthread_once(&__guac_palette_run_length_selected,
+            __guac_palette_select_run_length);
 
-            guac_palette_entry* entry;
-
-            /* Search for open palette entry */
-            for (;;) {
-                
-                entry = &(palette->entries[hash]);
-
-                /* If we've found a free space, use it */
-                if (entry->index == 0) {
+    /* Reject obviously photographic images early */
+    if (width * height >= GUAC_PALETTE_SAMPLE_THRESHOLD
+            && __guac_palette_sample(palette, data, width, height, stride)) {
+        guac_palette_free(palette);
+        return NULL;
+    }
 
-                    png_color* c;
+    for (y=0; y<height; y++) {
 
-                    /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+        const uint32_t* row = (const uint32_t*) data;
 
-                    /* Store in palette */
-                    c = &(palette->colors[palette->size]);
-                    c->blue  = (color      ) & 0xFF;
-                    c->green = (color >> 8 ) & 0xFF;
-                    c->red   = (color >> 16) & 0xFF;
+        /* Rows identical to the previous row contain no new colors */
+        if (previous_row == NULL
+                || memcmp(row, previous_row, width * sizeof(uint32_t)) != 0) {
 
-                    /* Add color to map */
-                    entry->index = ++palette->size;
-                    entry->color = color;
+            x = 0;
+            while (x < width) {
 
-                    break;
+                /* Get pixel color */
+                uint32_t color = row[x] & 0xFFFFFF;
 
+                if (__guac_palette_add(palette, color)) {
+                    guac_palette_free(palette);
+                    return NULL;
                 }
 
-                /* Otherwise, if already stored here, done */
-                if (entry->color == color)
-                    break;
-
-                /* Otherwise, collision. Move on to another bucket */
-                hash = (hash+1) & 0xFFF;
+                /* Skip remainder of run, which has the same color */
+                x += 1 + __guac_palette_run_length(row + x + 1,
+                        width - x - 1, color);
 
             }
+
         }
 
         /* Advance to next data row */
+        previous_row = row;
         data += stride;
 
     }
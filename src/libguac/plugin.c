@@ -41,6 +41,12 @@ guac_client_plugin* guac_client_plugin_open(const char* protocol) {
     /* Client args description */
     const char** client_args;
 
+    /* Whether clients may be driven by events, if declared */
+    const int* event_driven;
+
+    /* Whether clients may have other viewers, if declared */
+    const int* viewers;
+
     /* Pluggable client */
     char protocol_lib[GUAC_PROTOCOL_LIBRARY_LIMIT] =
         GUAC_PROTOCOL_LIBRARY_PREFIX;
@@ -50,6 +56,11 @@ guac_client_plugin* guac_client_plugin_open(const char* protocol) {
         void* obj;
     } alias;
 
+    union {
+        guac_client_preload_handler* client_preload;
+        void* obj;
+    } preload_alias;
+
     /* Add protocol and .so suffix to protocol_lib */
     strncat(protocol_lib, protocol, GUAC_PROTOCOL_NAME_LIMIT-1);
     strcat(protocol_lib, GUAC_PROTOCOL_LIBRARY_SUFFIX);
@@ -84,6 +95,19 @@ guac_client_plugin* guac_client_plugin_open(const char* protocol) {
         return NULL;
     }
 
+    /* Check whether clients may be driven by events, if declared at all */
+    event_driven = (const int*) dlsym(client_plugin_handle,
+            "GUAC_CLIENT_EVENT_DRIVEN");
+    dlerror(); /* Clear errors */
+
+    /* Check whether clients may have other viewers, if declared at all */
+    viewers = (const int*) dlsym(client_plugin_handle, "GUAC_CLIENT_VIEWERS");
+    dlerror(); /* Clear errors */
+
+    /* Get preload function, if any */
+    preload_alias.obj = dlsym(client_plugin_handle, "guac_client_preload");
+    dlerror(); /* Clear errors */
+
     /* Allocate plugin */
     plugin = malloc(sizeof(guac_client_plugin));
     if (plugin == NULL) {
@@ -95,7 +119,10 @@ guac_client_plugin* guac_client_plugin_open(const char* protocol) {
     /* Init and return plugin */
     plugin->__client_plugin_handle = client_plugin_handle;
     plugin->init_handler = alias.client_init;
+    plugin->preload_handler = preload_alias.client_preload;
     plugin->args = client_args;
+    plugin->event_driven = event_driven != NULL && *event_driven;
+    plugin->viewers = viewers != NULL && *viewers;
     return plugin;
 
 }
@@ -115,6 +142,16 @@ int guac_client_plugin_close(guac_client_plugin* plugin) {
 
 }
 
+int guac_client_plugin_preload(guac_client_plugin* plugin) {
+
+    /* Nothing to do if no preload handler */
+    if (plugin->preload_handler == NULL)
+        return 0;
+
+    return plugin->preload_handler();
+
+}
+
 int guac_client_plugin_init_client(guac_client_plugin* plugin,
         guac_client* client, int argc, char** argv) {
 
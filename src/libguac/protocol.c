@@ -45,6 +45,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <zlib.h>
 
 /* Output formatting functions */
 
@@ -75,19 +76,90 @@ ssize_t __guac_socket_write_length_double(guac_socket* socket, double d) {
 
 /* PNG output formatting */
 
+/**
+ * The number of bytes to allocate for PNG headers, palette, and other
+ * overhead beyond the estimated size of the encoded image data.
+ */
+#define GUAC_PNG_BUFFER_OVERHEAD 1024
+
+/**
+ * The number of bytes of PNG data to send within each blob when streaming PNG
+ * data as it is encoded.
+ */
+#define GUAC_PNG_BLOB_SIZE 4096
+
 typedef struct __guac_socket_write_png_data {
 
     guac_socket* socket;
 
+    /**
+     * The stream along which PNG data should be sent as blobs as soon as
+     * GUAC_PNG_BLOB_SIZE bytes are available, or NULL if all PNG data should
+     * be buffered.
+     */
+    const guac_stream* stream;
+
+    /**
+     * Non-zero if sending a blob along the stream has failed.
+     */
+    int stream_error;
+
     char* buffer;
     int buffer_size;
     int data_size;
 
 } __guac_socket_write_png_data;
 
-cairo_status_t __guac_socket_write_png_cairo(void* closure, const unsigned char* data, unsigned int length) {
+/**
+ * Sends all PNG data currently buffered within the given buffer structure as
+ * a blob along its stream, emptying the buffer.
+ *
+ * @param png_data The buffer structure whose data should be sent.
+ */
+static void __guac_png_data_send_blob(__guac_socket_write_png_data* png_data) {
 
-    __guac_socket_write_png_data* png_data = (__guac_socket_write_png_data*) closure;
+    if (png_data->data_size > 0 && guac_protocol_send_blob(png_data->socket,
+                png_data->stream, png_data->buffer, png_data->data_size))
+        png_data->stream_error = 1;
+
+    png_data->data_size = 0;
+
+}
+
+/**
+ * Appends the given PNG data to the given buffer structure. If the structure
+ * has a stream, full buffers are sent as blobs along that stream rather than
+ * growing the buffer.
+ *
+ * @param png_data The buffer structure which should receive the PNG data.
+ * @param data The PNG data to append.
+ * @param length The number of bytes of PNG data to append.
+ */
+static void __guac_png_data_append(__guac_socket_write_png_data* png_data,
+        const unsigned char* data, int length) {
+
+    /* Send data in blob-sized pieces if streaming */
+    if (png_data->stream != NULL) {
+
+        while (length > 0) {
+
+            int available = png_data->buffer_size - png_data->data_size;
+            if (available > length)
+                available = length;
+
+            memcpy(png_data->buffer + png_data->data_size, data, available);
+            png_data->data_size += available;
+            data += available;
+            length -= available;
+
+            if (png_data->data_size == png_data->buffer_size)
+                __guac_png_data_send_blob(png_data);
+
+        }
+
+        return;
+
+    }
 
     /* Calculate next buffer size */
     int next_size = png_data->data_size + length;
@@ -111,42 +183,110 @@ cairo_status_t __guac_socket_write_png_cairo(void* closure, const unsigned char*
     memcpy(png_data->buffer + png_data->data_size, data, length);
     png_data->data_size += length;
 
-    return CAIRO_STATUS_SUCCESS;
-
 }
 
-int __guac_socket_write_length_png_cairo(guac_socket* socket, cairo_surface_t* surface) {
+cairo_status_t __guac_socket_write_png_cairo(void* closure, const unsigned char* data, unsigned int length) {
 
-    __guac_socket_write_png_data png_data;
-    int base64_length;
+    __guac_socket_write_png_data* png_data = (__guac_socket_write_png_data*) closure;
+    __guac_png_data_append(png_data, data, length);
 
-    /* Write surface */
+    return CAIRO_STATUS_SUCCESS;
 
-    png_data.socket = socket;
-    png_data.buffer_size = 8192;
-    png_data.buffer = malloc(png_data.buffer_size);
-    png_data.data_size = 0;
+}
+
+/**
+ * Encodes the given surface as PNG using Cairo's PNG writer, storing the
+ * encoded image within the given buffer structure, which must already have
+ * been allocated.
+ *
+ * @param surface The surface to encode.
+ * @param png_data The buffer structure which should receive the PNG data.
+ * @return Zero on success, non-zero on error.
+ */
+static int __guac_png_encode_cairo(cairo_surface_t* surface,
+        __guac_socket_write_png_data* png_data) {
 
-    if (cairo_surface_write_to_png_stream(surface, __guac_socket_write_png_cairo, &png_data) != CAIRO_STATUS_SUCCESS) {
+    if (cairo_surface_write_to_png_stream(surface, __guac_socket_write_png_cairo, png_data) != CAIRO_STATUS_SUCCESS) {
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "Cairo PNG backend failed";
         return -1;
     }
 
-    base64_length = (png_data.data_size + 2) / 3 * 4;
+    return 0;
+
+}
+
+/**
+ * Configures the zlib compression level, zlib strategy, and PNG row filters
+ * of the given libpng write structure according to the given speed/size
+ * tradeoff.
+ *
+ * @param png The libpng write structure to configure.
+ * @param compression The tradeoff between encoding speed and output size.
+ * @param paletted Non-zero if the image being written is paletted, in which
+ *                 case row filtering is disabled, as it rarely helps.
+ */
+static void __guac_png_set_compression(png_structp png,
+        guac_png_compression compression, int paletted) {
+
+    int level, strategy, filters;
+
+    switch (compression) {
+
+        /* Run-length matching only, which suits screen content and is
+         * far cheaper than full deflate */
+        case GUAC_PNG_COMPRESSION_FAST:
+            level = 1;
+            strategy = Z_RLE;
+            filters = PNG_FILTER_SUB;
+            break;
+
+        /* Strongest compression, trying every filter for each row */
+        case GUAC_PNG_COMPRESSION_SMALL:
+            level = 9;
+            strategy = Z_DEFAULT_STRATEGY;
+            filters = PNG_ALL_FILTERS;
+            break;
+
+        /* Default deflate level with a single filter, avoiding the cost of
+         * adaptive filter selection */
+        default:
+            level = 6;
+            strategy = Z_DEFAULT_STRATEGY;
+            filters = PNG_FILTER_PAETH;
+            break;
+
+    }
+
+    if (paletted)
+        filters = PNG_FILTER_NONE;
+
+    png_set_compression_level(png, level);
+    png_set_compression_strategy(png, strategy);
+    png_set_filter(png, PNG_FILTER_TYPE_BASE, filters);
+
+}
+
+/**
+ * Writes the given PNG data as a length-prefixed, base64-encoded protocol
+ * element.
+ *
+ * @param socket The guac_socket connection to write to.
+ * @param data The PNG data to write.
+ * @param length The number of bytes of PNG data.
+ * @return Zero on success, non-zero on error.
+ */
+static int __guac_socket_write_length_png_data(guac_socket* socket,
+        const void* data, int length) {
+
+    int base64_length = (length + 2) / 3 * 4;
 
     /* Write length and data */
-    if (
+    return
            guac_socket_write_int(socket, base64_length)
         || guac_socket_write_string(socket, ".")
-        || guac_socket_write_base64(socket, png_data.buffer, png_data.data_size)
-        || guac_socket_flush_base64(socket)) {
-        free(png_data.buffer);
-        return -1;
-    }
-
-    free(png_data.buffer);
-    return 0;
+        || guac_socket_write_base64(socket, data, length)
+        || guac_socket_flush_base64(socket);
 
 }
 
@@ -161,45 +301,137 @@ void __guac_socket_write_png(png_structp png,
     png_data = (__guac_socket_write_png_data*) png->io_ptr;
 #endif
 
-    /* Calculate next buffer size */
-    int next_size = png_data->data_size + length;
+    __guac_png_data_append(png_data, data, length);
 
-    /* If need resizing, double buffer size until big enough */
-    if (next_size > png_data->buffer_size) {
+}
 
-        char* new_buffer;
+void __guac_socket_flush_png(png_structp png) {
+    /* Dummy function */
+}
 
-        do {
-            png_data->buffer_size <<= 1;
-        } while (next_size > png_data->buffer_size);
+/**
+ * Encodes the given RGB24 image data as a truecolor PNG directly with libpng,
+ * storing the encoded image within the given buffer structure, which must
+ * already have been allocated. Rows are passed to libpng directly from the
+ * image data, with libpng stripping the unused byte of each pixel.
+ *
+ * @param data The RGB24 image data to encode.
+ * @param width The width of the image, in pixels.
+ * @param height The height of the image, in pixels.
+ * @param stride The number of bytes in each row of image data.
+ * @param compression The tradeoff between encoding speed and output size.
+ * @param png_data The buffer structure which should receive the PNG data.
+ * @return Zero on success, non-zero on error.
+ */
+static int __guac_png_encode_truecolor(unsigned char* data, int width,
+        int height, int stride, guac_png_compression compression,
+        __guac_socket_write_png_data* png_data) {
 
-        /* Resize buffer */
-        new_buffer = realloc(png_data->buffer, png_data->buffer_size);
-        png_data->buffer = new_buffer;
+    png_structp png;
+    png_infop png_info;
+    png_byte** png_rows;
+    int transforms;
+    int y;
+
+    /* Pixels are native-endian 32-bit XRGB */
+    const uint32_t byte_order = 1;
+    if (*((const unsigned char*) &byte_order))
+        transforms = PNG_TRANSFORM_BGR | PNG_TRANSFORM_STRIP_FILLER_AFTER;
+    else
+        transforms = PNG_TRANSFORM_STRIP_FILLER_BEFORE;
 
+    /* Set up PNG writer */
+    png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    if (!png) {
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "libpng failed to create write structure";
+        return -1;
     }
 
-    /* Append data to buffer */
-    memcpy(png_data->buffer + png_data->data_size, data, length);
-    png_data->data_size += length;
+    png_info = png_create_info_struct(png);
+    if (!png_info) {
+        png_destroy_write_struct(&png, NULL);
+        guac_error = GUAC_STATUS_INTERNAL_ERROR;
+        guac_error_message = "libpng failed to create info structure";
+        return -1;
+    }
 
-}
+    /* Point rows directly at image data */
+    png_rows = (png_byte**) malloc(sizeof(png_byte*) * height);
+    for (y=0; y<height; y++)
+        png_rows[y] = data + y * stride;
+
+    /* Set error handler */
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_write_struct(&png, &png_info);
+        free(png_rows);
+        guac_error = GUAC_STATUS_IO_ERROR;
+        guac_error_message = "libpng output error";
+        return -1;
+    }
+
+    /* Set up writer */
+    png_set_write_fn(png, png_data,
+            __guac_socket_write_png,
+            __guac_socket_flush_png);
+
+    __guac_png_set_compression(png, compression, 0);
+
+    /* Write image info */
+    png_set_IHDR(
+        png,
+        png_info,
+        width,
+        height,
+        8,
+        PNG_COLOR_TYPE_RGB,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_DEFAULT,
+        PNG_FILTER_TYPE_DEFAULT
+    );
+
+    /* Write image */
+    png_set_rows(png, png_info, png_rows);
+    png_write_png(png, png_info, transforms, NULL);
+
+    /* Finish write */
+    png_destroy_write_struct(&png, &png_info);
+    free(png_rows);
+
+    return 0;
 
-void __guac_socket_flush_png(png_structp png) {
-    /* Dummy function */
 }
 
-int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface) {
+/**
+ * Encodes the given surface as PNG, storing the encoded image within the given
+ * buffer structure, which must already have been allocated. Surfaces which
+ * can be represented with a palette of 256 colors or fewer are written
+ * directly with libpng as paletted images. All other RGB24 surfaces are
+ * written directly with libpng as truecolor images, while surfaces of other
+ * formats are written using Cairo's PNG writer.
+ *
+ * @param surface The surface to encode.
+ * @param compression The tradeoff between encoding speed and output size.
+ * @param hint Pointer to a hint describing the result of any previous color
+ *             census of the same image, which will be updated with the result
+ *             of this encoding. If GUAC_PALETTE_HINT_TRUECOLOR, the palette
+ *             is not attempted.
+ * @param png_data The buffer structure which should receive the PNG data.
+ * @return Zero on success, non-zero on error.
+ */
+static int __guac_png_encode(cairo_surface_t* surface,
+        guac_png_compression compression, guac_palette_hint* hint,
+        __guac_socket_write_png_data* png_data) {
 
     png_structp png;
     png_infop png_info;
     png_byte** png_rows;
     int bpp;
 
-    int x, y;
+    int last_color = -1;
+    int last_index = 0;
 
-    __guac_socket_write_png_data png_data;
-    int base64_length;
+    int x, y;
 
     /* Get image surface properties and data */
     cairo_format_t format = cairo_image_surface_get_format(surface);
@@ -210,17 +442,27 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
 
     /* If not RGB24, use Cairo PNG writer */
     if (format != CAIRO_FORMAT_RGB24 || data == NULL)
-        return __guac_socket_write_length_png_cairo(socket, surface);
+        return __guac_png_encode_cairo(surface, png_data);
 
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
+    /* Skip palette if the image is already known to have too many colors */
+    if (*hint == GUAC_PALETTE_HINT_TRUECOLOR)
+        return __guac_png_encode_truecolor(data, width, height, stride,
+                compression, png_data);
+
     /* Attempt to build palette */
     guac_palette* palette = guac_palette_alloc(surface);
 
     /* If not possible, resort to Cairo PNG writer */
-    if (palette == NULL)
-        return __guac_socket_write_length_png_cairo(socket, surface);
+    if (palette == NULL) {
+        *hint = GUAC_PALETTE_HINT_TRUECOLOR;
+        return __guac_png_encode_truecolor(data, width, height, stride,
+                compression, png_data);
+    }
+
+    *hint = GUAC_PALETTE_HINT_PALETTE;
 
     /* Calculate BPP from palette size */
     if      (palette->size <= 2)  bpp = 1;
@@ -231,6 +473,7 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
     /* Set up PNG writer */
     png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
     if (!png) {
+        guac_palette_free(palette);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create write structure";
         return -1;
@@ -239,6 +482,7 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
     png_info = png_create_info_struct(png);
     if (!png_info) {
         png_destroy_write_struct(&png, NULL);
+        guac_palette_free(palette);
         guac_error = GUAC_STATUS_INTERNAL_ERROR;
         guac_error_message = "libpng failed to create info structure";
         return -1;
@@ -247,19 +491,14 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
     /* Set error handler */
     if (setjmp(png_jmpbuf(png))) {
         png_destroy_write_struct(&png, &png_info);
+        guac_palette_free(palette);
         guac_error = GUAC_STATUS_IO_ERROR;
         guac_error_message = "libpng output error";
         return -1;
     }
 
-    /* Set up buffer structure */
-    png_data.socket = socket;
-    png_data.buffer_size = 8192;
-    png_data.buffer = malloc(png_data.buffer_size);
-    png_data.data_size = 0;
-
     /* Set up writer */
-    png_set_write_fn(png, &png_data,
+    png_set_write_fn(png, png_data,
             __guac_socket_write_png,
             __guac_socket_flush_png);
 
@@ -277,8 +516,14 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
             /* Get pixel color */
             int color = ((uint32_t*) data)[x] & 0xFFFFFF;
 
+            /* Look up index only when color changes */
+            if (color != last_color) {
+                last_index = guac_palette_find(palette, color);
+                last_color = color;
+            }
+
             /* Set index in row */
-            row[x] = guac_palette_find(palette, color);
+            row[x] = last_index;
 
         }
 
@@ -287,6 +532,8 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
 
     }
 
+    __guac_png_set_compression(png, compression, 1);
+
     /* Write image info */
     png_set_IHDR(
         png,
@@ -318,23 +565,73 @@ int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface
         free(png_rows[y]);
     free(png_rows);
 
-    base64_length = (png_data.data_size + 2) / 3 * 4;
+    return 0;
 
-    /* Write length and data */
-    if (
-           guac_socket_write_int(socket, base64_length)
-        || guac_socket_write_string(socket, ".")
-        || guac_socket_write_base64(socket, png_data.buffer, png_data.data_size)
-        || guac_socket_flush_base64(socket)) {
+}
+
+int guac_protocol_encode_png(cairo_surface_t* surface, void** data,
+        int* length) {
+
+    guac_palette_hint hint = GUAC_PALETTE_HINT_UNKNOWN;
+    return guac_protocol_encode_png_hinted(surface,
+            GUAC_PNG_COMPRESSION_DEFAULT, &hint, data, length);
+
+}
+
+int guac_protocol_encode_png_hinted(cairo_surface_t* surface,
+        guac_png_compression compression, guac_palette_hint* hint,
+        void** data, int* length) {
+
+    __guac_socket_write_png_data png_data;
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+
+    /* Allocate initial buffer large enough for typical screen content, which
+     * rarely compresses to more than one byte per pixel */
+    png_data.socket = NULL;
+    png_data.stream = NULL;
+    png_data.stream_error = 0;
+    png_data.buffer_size = width * height + GUAC_PNG_BUFFER_OVERHEAD;
+    png_data.buffer = malloc(png_data.buffer_size);
+    png_data.data_size = 0;
+
+    if (png_data.buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Insufficient memory for PNG buffer";
+        return -1;
+    }
+
+    /* Encode surface */
+    if (__guac_png_encode(surface, compression, hint, &png_data)) {
         free(png_data.buffer);
         return -1;
     }
 
-    free(png_data.buffer);
+    *data = png_data.buffer;
+    *length = png_data.data_size;
     return 0;
 
 }
 
+int __guac_socket_write_length_png(guac_socket* socket, cairo_surface_t* surface) {
+
+    void* data;
+    int length;
+    int retval;
+
+    /* Encode surface */
+    if (guac_protocol_encode_png(surface, &data, &length))
+        return -1;
+
+    /* Write encoded PNG */
+    retval = __guac_socket_write_length_png_data(socket, data, length);
+
+    free(data);
+    return retval;
+
+}
+
 /* Protocol functions */
 
 int guac_protocol_send_ack(guac_socket* socket, guac_stream* stream,
@@ -848,6 +1145,33 @@ int guac_protocol_send_identity(guac_socket* socket, const guac_layer* layer) {
 
 }
 
+int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
+        guac_composite_mode mode, const guac_layer* layer,
+        const char* mimetype, int x, int y) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val =
+           guac_socket_write_string(socket, "3.img,")
+        || __guac_socket_write_length_int(socket, stream->index)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, mode)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, layer->index)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_string(socket, mimetype)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, x)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, y)
+        || guac_socket_write_string(socket, ";");
+    guac_socket_instruction_end(socket);
+
+    return ret_val;
+
+}
+
 int guac_protocol_send_lfill(guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer,
         const guac_layer* srcl) {
@@ -1030,6 +1354,66 @@ int guac_protocol_send_png(guac_socket* socket, guac_composite_mode mode,
 
 }
 
+int guac_protocol_send_png_data(guac_socket* socket, guac_composite_mode mode,
+        const guac_layer* layer, int x, int y, const void* data, int length) {
+
+    int ret_val;
+
+    guac_socket_instruction_begin(socket);
+    ret_val =
+           guac_socket_write_string(socket, "3.png,")
+        || __guac_socket_write_length_int(socket, mode)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, layer->index)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, x)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_int(socket, y)
+        || guac_socket_write_string(socket, ",")
+        || __guac_socket_write_length_png_data(socket, data, length)
+        || guac_socket_write_string(socket, ";");
+
+    guac_socket_instruction_end(socket);
+    return ret_val;
+
+}
+
+int guac_protocol_stream_png(guac_socket* socket, const guac_stream* stream,
+        guac_composite_mode mode, const guac_layer* layer, int x, int y,
+        cairo_surface_t* surface, guac_png_compression compression,
+        guac_palette_hint* hint) {
+
+    __guac_socket_write_png_data png_data;
+    guac_palette_hint default_hint = GUAC_PALETTE_HINT_UNKNOWN;
+    char buffer[GUAC_PNG_BLOB_SIZE];
+    int encode_result;
+
+    if (hint == NULL)
+        hint = &default_hint;
+
+    /* Begin image stream */
+    if (guac_protocol_send_img(socket, stream, mode, layer, "image/png", x, y))
+        return -1;
+
+    /* Send PNG data as blobs as it is produced */
+    png_data.socket = socket;
+    png_data.stream = stream;
+    png_data.stream_error = 0;
+    png_data.buffer = buffer;
+    png_data.buffer_size = sizeof(buffer);
+    png_data.data_size = 0;
+
+    encode_result = __guac_png_encode(surface, compression, hint, &png_data);
+    __guac_png_data_send_blob(&png_data);
+
+    /* End stream even if encoding failed, such that it can be reused */
+    if (guac_protocol_send_end(socket, stream) || png_data.stream_error)
+        return -1;
+
+    return encode_result;
+
+}
+
 int guac_protocol_send_pop(guac_socket* socket, const guac_layer* layer) {
 
     int ret_val;
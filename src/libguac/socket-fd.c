@@ -33,8 +33,10 @@
 
 #ifdef __MINGW32__
 #include <winsock2.h>
+#define poll WSAPoll
 #else
-#include <sys/select.h>
+#include <poll.h>
+#include <sys/uio.h>
 #endif
 
 typedef struct __guac_socket_fd_data {
@@ -84,28 +86,44 @@ ssize_t __guac_socket_fd_write_handler(guac_socket* socket,
     return retval;
 }
 
+#ifndef __MINGW32__
+ssize_t __guac_socket_fd_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
+
+    /* Write all buffers with a single call */
+    ssize_t retval = writev(data->fd, iov, iovcnt);
+
+    /* Record errors in guac_error */
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error writing data to socket";
+    }
+
+    return retval;
+}
+#endif
+
 int __guac_socket_fd_select_handler(guac_socket* socket, int usec_timeout) {
 
     __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
 
-    fd_set fds;
-    struct timeval timeout;
+    struct pollfd fds[] = {{
+        .fd      = data->fd,
+        .events  = POLLIN,
+        .revents = 0,
+    }};
+
     int retval;
 
     /* No timeout if usec_timeout is negative */
     if (usec_timeout < 0)
-        retval = select(data->fd + 1, &fds, NULL, NULL, NULL); 
+        retval = poll(fds, 1, -1);
 
-    /* Handle timeout if specified */
-    else {
-        timeout.tv_sec = usec_timeout/1000000;
-        timeout.tv_usec = usec_timeout%1000000;
-
-        FD_ZERO(&fds);
-        FD_SET(data->fd, &fds);
-
-        retval = select(data->fd + 1, &fds, NULL, NULL, &timeout);
-    }
+    /* Handle timeout if specified, rounding up to nearest milliseconds */
+    else
+        retval = poll(fds, 1, (usec_timeout + 999) / 1000);
 
     /* Properly set guac_error */
     if (retval <  0) {
@@ -137,6 +155,11 @@ guac_socket* guac_socket_open(int fd) {
     socket->write_handler  = __guac_socket_fd_write_handler;
     socket->select_handler = __guac_socket_fd_select_handler;
 
+#ifndef __MINGW32__
+    /* Chain output buffers where writev() is available */
+    socket->writev_handler = __guac_socket_fd_writev_handler;
+#endif
+
     return socket;
 
 }
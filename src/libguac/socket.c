@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "error.h"
 #include "protocol.h"
 #include "socket.h"
@@ -33,6 +34,8 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -83,8 +86,15 @@ static ssize_t __guac_socket_write(guac_socket* socket,
     socket->last_write_timestamp = guac_timestamp_current();
 
     /* If handler defined, call it. */
-    if (socket->write_handler)
-        return socket->write_handler(socket, buf, count);
+    if (socket->write_handler) {
+
+        ssize_t written = socket->write_handler(socket, buf, count);
+        if (written > 0)
+            socket->bytes_written += written;
+
+        return written;
+
+    }
 
     /* Otherwise, pretend everything was written. */
     return count;
@@ -114,11 +124,188 @@ ssize_t guac_socket_write(guac_socket* socket,
 
 }
 
+/**
+ * Writes all data within the given buffers using the writev handler of the
+ * given socket, which MUST be defined. The given array of buffers is modified
+ * to track progress as data is written.
+ *
+ * @param socket The guac_socket to write to.
+ * @param iov The array of buffers to write.
+ * @param iovcnt The number of buffers within the array.
+ * @return Zero on success, non-zero if an error occurs while writing.
+ */
+static int __guac_socket_writev_all(guac_socket* socket,
+        struct iovec* iov, int iovcnt) {
+
+    /* Write until completely written */
+    while (iovcnt > 0) {
+
+        ssize_t written;
+
+        /* Update timestamp of last write */
+        socket->last_write_timestamp = guac_timestamp_current();
+
+        /* Attempt to write, return on error */
+        written = socket->writev_handler(socket, iov, iovcnt);
+        if (written == -1)
+            return 1;
+
+        socket->bytes_written += written;
+
+        /* Skip past all buffers which were completely written */
+        while (iovcnt > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+
+        /* Advance within partially-written buffer */
+        if (iovcnt > 0) {
+            iov->iov_base = (char*) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+
+    }
+
+    return 0;
+
+}
+
+int guac_socket_writev(guac_socket* socket, const struct iovec* iov,
+        int iovcnt) {
+
+    struct iovec pending[GUAC_SOCKET_OUTPUT_CHAIN_LENGTH];
+    int i;
+
+    /* Write each buffer individually if writev is not supported */
+    if (socket->writev_handler == NULL) {
+
+        for (i = 0; i < iovcnt; i++) {
+            if (guac_socket_write(socket, iov[i].iov_base, iov[i].iov_len))
+                return 1;
+        }
+
+        return 0;
+
+    }
+
+    /* Otherwise, write buffers in batches, copying each batch such that
+     * progress can be tracked */
+    while (iovcnt > 0) {
+
+        int count = iovcnt;
+        if (count > GUAC_SOCKET_OUTPUT_CHAIN_LENGTH)
+            count = GUAC_SOCKET_OUTPUT_CHAIN_LENGTH;
+
+        memcpy(pending, iov, sizeof(struct iovec) * count);
+        if (__guac_socket_writev_all(socket, pending, count))
+            return 1;
+
+        iov += count;
+        iovcnt -= count;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes all buffered output, including any complete chained buffers and
+ * the current buffer, resetting the output buffer to empty. The buffer lock
+ * of the socket must already be held.
+ *
+ * @param socket The guac_socket to flush.
+ * @return Zero on success, non-zero if an error occurs while writing.
+ */
+static int __guac_socket_write_buffered(guac_socket* socket) {
+
+    int current = socket->__out_chain_current;
+    int retval;
+
+    /* Write current buffer directly if no other buffers are chained */
+    if (current == 0)
+        retval = guac_socket_write(socket, socket->__out_buf,
+                socket->__written);
+
+    /* Otherwise, write all chained buffers at once */
+    else {
+
+        struct iovec iov[GUAC_SOCKET_OUTPUT_CHAIN_LENGTH];
+        int i;
+
+        for (i = 0; i < current; i++) {
+            iov[i].iov_base = socket->__out_chain[i];
+            iov[i].iov_len  = socket->__out_chain_lengths[i];
+        }
+
+        iov[current].iov_base = socket->__out_buf;
+        iov[current].iov_len  = socket->__written;
+
+        retval = __guac_socket_writev_all(socket, iov, current + 1);
+
+    }
+
+    /* Reset to first buffer, even on error, such that the buffer state
+     * remains consistent */
+    socket->__out_chain_current = 0;
+    socket->__out_buf = socket->__out_chain[0];
+    socket->__written = 0;
+
+    return retval;
+
+}
+
+/**
+ * Handles a full output buffer, either by chaining a new buffer after the
+ * current buffer (if the socket has a writev handler and the chain is not
+ * yet full), or by writing all buffered output. The buffer lock of the
+ * socket must already be held.
+ *
+ * @param socket The guac_socket whose output buffer is full.
+ * @return Zero on success, non-zero if an error occurs while writing.
+ */
+static int __guac_socket_next_buffer(guac_socket* socket) {
+
+    int next = socket->__out_chain_current + 1;
+
+    /* Chain another buffer if possible */
+    if (socket->writev_handler != NULL
+            && next < GUAC_SOCKET_OUTPUT_CHAIN_LENGTH) {
+
+        /* Allocate buffer if not yet allocated */
+        if (socket->__out_chain[next] == NULL)
+            socket->__out_chain[next] = malloc(GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+
+        /* Switch to next buffer if available */
+        if (socket->__out_chain[next] != NULL) {
+            socket->__out_chain_lengths[socket->__out_chain_current] =
+                socket->__written;
+            socket->__out_chain_current = next;
+            socket->__out_buf = socket->__out_chain[next];
+            socket->__written = 0;
+            return 0;
+        }
+
+    }
+
+    /* Otherwise, write everything buffered so far */
+    return __guac_socket_write_buffered(socket);
+
+}
+
 ssize_t guac_socket_read(guac_socket* socket, void* buf, size_t count) {
 
     /* If handler defined, call it. */
-    if (socket->read_handler)
-        return socket->read_handler(socket, buf, count);
+    if (socket->read_handler) {
+
+        ssize_t read = socket->read_handler(socket, buf, count);
+        if (read > 0)
+            socket->bytes_read += read;
+
+        return read;
+
+    }
 
     /* Otherwise, pretend nothing was read. */
     return 0;
@@ -148,10 +335,25 @@ guac_socket* guac_socket_alloc() {
         return NULL;
     }
 
+    /* Allocate first output buffer (others are allocated as needed) */
+    memset(socket->__out_chain, 0, sizeof(socket->__out_chain));
+    socket->__out_chain[0] = malloc(GUAC_SOCKET_OUTPUT_BUFFER_SIZE);
+    if (socket->__out_chain[0] == NULL) {
+        free(socket);
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket buffer";
+        return NULL;
+    }
+
+    socket->__out_chain_current = 0;
+    socket->__out_buf = socket->__out_chain[0];
+
     socket->__ready = 0;
     socket->__written = 0;
     socket->data = NULL;
     socket->state = GUAC_SOCKET_OPEN;
+    socket->bytes_written = 0;
+    socket->bytes_read = 0;
     socket->last_write_timestamp = guac_timestamp_current();
 
     /* Init members */
@@ -161,6 +363,9 @@ guac_socket* guac_socket_alloc() {
     /* Default to unsafe threading */
     socket->__threadsafe_instructions = 0;
 
+    /* No keep-alive thread until requested */
+    socket->__keep_alive_enabled = 0;
+
     pthread_mutexattr_init(&lock_attributes);
     pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
 
@@ -170,6 +375,7 @@ guac_socket* guac_socket_alloc() {
     /* No handlers yet */
     socket->read_handler   = NULL;
     socket->write_handler  = NULL;
+    socket->writev_handler = NULL;
     socket->select_handler = NULL;
     socket->free_handler   = NULL;
 
@@ -227,6 +433,8 @@ void guac_socket_update_buffer_end(guac_socket* socket) {
 
 void guac_socket_free(guac_socket* socket) {
 
+    int i;
+
     /* Call free handler if defined */
     if (socket->free_handler)
         socket->free_handler(socket);
@@ -241,6 +449,11 @@ void guac_socket_free(guac_socket* socket) {
         pthread_join(socket->__keep_alive_thread, NULL);
 
     pthread_mutex_destroy(&(socket->__instruction_write_lock));
+
+    /* Free all output buffers */
+    for (i = 0; i < GUAC_SOCKET_OUTPUT_CHAIN_LENGTH; i++)
+        free(socket->__out_chain[i]);
+
     free(socket);
 }
 
@@ -254,26 +467,22 @@ ssize_t guac_socket_write_int(guac_socket* socket, int64_t i) {
 
 ssize_t guac_socket_write_string(guac_socket* socket, const char* str) {
 
-    char* __out_buf = socket->__out_buf;
-
     guac_socket_update_buffer_begin(socket);
 
     for (; *str != '\0'; str++) {
 
-        __out_buf[socket->__written++] = *str; 
+        socket->__out_buf[socket->__written++] = *str; 
 
         /* Flush when necessary, return on error. Note that we must flush within 4 bytes of boundary because
          * __guac_socket_write_base64_triplet ALWAYS writes four bytes, and would otherwise potentially overflow
          * the buffer. */
         if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
 
-            if (guac_socket_write(socket, __out_buf, socket->__written)) {
+            if (__guac_socket_next_buffer(socket)) {
                 guac_socket_update_buffer_end(socket);
                 return 1;
             }
 
-            socket->__written = 0;
-
         }
 
     }
@@ -313,10 +522,9 @@ ssize_t __guac_socket_write_base64_triplet(guac_socket* socket, int a, int b, in
     /* Flush when necessary, return on error */
     if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
 
-        if (guac_socket_write(socket, __out_buf, socket->__written))
+        if (__guac_socket_next_buffer(socket))
             return -1;
 
-        socket->__written = 0;
     }
 
     if (b < 0)
@@ -357,6 +565,44 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
     const unsigned char* end = char_buf + count;
 
     guac_socket_update_buffer_begin(socket);
+
+    /* Complete any partial triplet left over from a previous write */
+    while (socket->__ready > 0 && char_buf < end) {
+
+        retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
+        if (retval < 0) {
+            guac_socket_update_buffer_end(socket);
+            return retval;
+        }
+
+    }
+
+    /* Encode all complete triplets directly into the output buffer */
+    while (end - char_buf >= 3) {
+
+        /* Encode as many triplets as will fit */
+        size_t triplets = (end - char_buf) / 3;
+        size_t available = (GUAC_SOCKET_OUTPUT_BUFFER_SIZE - socket->__written) / 4;
+        if (triplets > available)
+            triplets = available;
+
+        socket->__written += guac_base64_encode_triplets(char_buf, triplets,
+                socket->__out_buf + socket->__written);
+        char_buf += triplets * 3;
+
+        /* Flush when necessary, return on error */
+        if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
+
+            if (__guac_socket_next_buffer(socket)) {
+                guac_socket_update_buffer_end(socket);
+                return -1;
+            }
+
+        }
+
+    }
+
+    /* Buffer any trailing partial triplet until more data is written */
     while (char_buf < end) {
 
         retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
@@ -376,14 +622,13 @@ ssize_t guac_socket_flush(guac_socket* socket) {
 
     /* Flush remaining bytes in buffer */
     guac_socket_update_buffer_begin(socket);
-    if (socket->__written > 0) {
+    if (socket->__written > 0 || socket->__out_chain_current > 0) {
 
-        if (guac_socket_write(socket, socket->__out_buf, socket->__written)) {
+        if (__guac_socket_write_buffered(socket)) {
             guac_socket_update_buffer_end(socket);
             return 1;
         }
 
-        socket->__written = 0;
     }
 
     guac_socket_update_buffer_end(socket);
@@ -0,0 +1,576 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "error.h"
+#include "instruction.h"
+#include "protocol.h"
+#include "socket.h"
+#include "timestamp.h"
+#include "viewer.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+/**
+ * Appends the given data to the queue of the given viewer, waking the writer
+ * thread of that viewer. If the data cannot be queued, the viewer is marked
+ * as failed.
+ *
+ * @param viewer The viewer to queue data for.
+ * @param buf The data to queue.
+ * @param count The number of bytes to queue.
+ */
+static void __guac_viewer_queue(guac_viewer* viewer, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&(viewer->__lock));
+
+    /* Discard all output once the viewer has failed */
+    if (viewer->__failed) {
+        pthread_mutex_unlock(&(viewer->__lock));
+        return;
+    }
+
+    /* Grow queue as necessary */
+    if (viewer->__pending_length + count > viewer->__pending_size) {
+
+        size_t size = viewer->__pending_size * 2;
+        char* pending;
+
+        if (size < viewer->__pending_length + count)
+            size = viewer->__pending_length + count;
+
+        pending = realloc(viewer->__pending, size);
+        if (pending == NULL) {
+            viewer->__failed = 1;
+            viewer->__pending_length = 0;
+            pthread_mutex_unlock(&(viewer->__lock));
+            return;
+        }
+
+        viewer->__pending = pending;
+        viewer->__pending_size = size;
+
+    }
+
+    memcpy(viewer->__pending + viewer->__pending_length, buf, count);
+    viewer->__pending_length += count;
+
+    pthread_cond_signal(&(viewer->__queued));
+    pthread_mutex_unlock(&(viewer->__lock));
+
+}
+
+/**
+ * Queues the given data for every active viewer of the given client.
+ *
+ * @param client The client whose viewers should receive the data.
+ * @param buf The data to queue.
+ * @param count The number of bytes to queue.
+ */
+static void __guac_viewer_broadcast(guac_client* client, const void* buf,
+        size_t count) {
+
+    guac_viewer* viewer;
+
+    pthread_mutex_lock(&(client->__viewers_lock));
+
+    for (viewer = client->__viewers; viewer != NULL; viewer = viewer->__next) {
+        if (viewer->__state == GUAC_VIEWER_ACTIVE)
+            __guac_viewer_queue(viewer, buf, count);
+    }
+
+    pthread_mutex_unlock(&(client->__viewers_lock));
+
+}
+
+static ssize_t __guac_viewer_broadcast_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_client* client = (guac_client*) socket->data;
+
+    if (guac_socket_write(client->__owner_socket, buf, count))
+        return -1;
+
+    __guac_viewer_broadcast(client, buf, count);
+    return count;
+
+}
+
+static ssize_t __guac_viewer_broadcast_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    guac_client* client = (guac_client*) socket->data;
+
+    ssize_t written = 0;
+    int i;
+
+    if (guac_socket_writev(client->__owner_socket, iov, iovcnt))
+        return -1;
+
+    for (i = 0; i < iovcnt; i++) {
+        __guac_viewer_broadcast(client, iov[i].iov_base, iov[i].iov_len);
+        written += iov[i].iov_len;
+    }
+
+    return written;
+
+}
+
+static ssize_t __guac_viewer_broadcast_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guac_client* client = (guac_client*) socket->data;
+    return guac_socket_read(client->__owner_socket, buf, count);
+
+}
+
+static int __guac_viewer_broadcast_select_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    guac_client* client = (guac_client*) socket->data;
+    return guac_socket_select(client->__owner_socket, usec_timeout);
+
+}
+
+static ssize_t __guac_viewer_queue_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    __guac_viewer_queue((guac_viewer*) socket->data, buf, count);
+    return count;
+
+}
+
+/**
+ * Writes all data queued for the given viewer to the socket of that viewer,
+ * until the viewer is removed.
+ *
+ * @param data The viewer whose queue should be written.
+ * @return Always NULL.
+ */
+static void* __guac_viewer_writer_thread(void* data) {
+
+    guac_viewer* viewer = (guac_viewer*) data;
+
+    char* buffer = NULL;
+    size_t size = 0;
+
+    pthread_mutex_lock(&(viewer->__lock));
+
+    while (!viewer->__closing) {
+
+        char* pending;
+        size_t pending_size;
+        size_t length;
+
+        /* Wait for data */
+        if (viewer->__pending_length == 0) {
+            pthread_cond_wait(&(viewer->__queued), &(viewer->__lock));
+            continue;
+        }
+
+        /* Take queued data, leaving the previous buffer for further data */
+        pending = viewer->__pending;
+        pending_size = viewer->__pending_size;
+        length = viewer->__pending_length;
+
+        viewer->__pending = buffer;
+        viewer->__pending_size = size;
+        viewer->__pending_length = 0;
+
+        buffer = pending;
+        size = pending_size;
+
+        pthread_mutex_unlock(&(viewer->__lock));
+
+        /* Write without holding the lock, such that output of the client is
+         * never blocked by this viewer */
+        if (guac_socket_write(viewer->socket, buffer, length)) {
+            pthread_mutex_lock(&(viewer->__lock));
+            viewer->__failed = 1;
+            viewer->__pending_length = 0;
+            continue;
+        }
+
+        pthread_mutex_lock(&(viewer->__lock));
+
+    }
+
+    pthread_mutex_unlock(&(viewer->__lock));
+
+    free(buffer);
+    return NULL;
+
+}
+
+int guac_client_allow_viewers(guac_client* client) {
+
+    guac_socket* owner = client->socket;
+    guac_socket* socket;
+    size_t unparsed;
+
+    /* Viewers are already allowed */
+    if (client->__owner_socket != NULL)
+        return 0;
+
+    /* Anything already written to the original socket must precede all
+     * further output */
+    if (guac_socket_flush(owner))
+        return 1;
+
+    socket = guac_socket_alloc();
+    if (socket == NULL)
+        return 1;
+
+    socket->data = client;
+    socket->read_handler   = __guac_viewer_broadcast_read_handler;
+    socket->write_handler  = __guac_viewer_broadcast_write_handler;
+    socket->writev_handler = __guac_viewer_broadcast_writev_handler;
+    socket->select_handler = __guac_viewer_broadcast_select_handler;
+
+    /* Take over any input received but not yet parsed, such as data which
+     * followed the handshake */
+    unparsed = owner->__instructionbuf_unparsed_end
+             - owner->__instructionbuf_unparsed_start;
+
+    memcpy(socket->__instructionbuf, owner->__instructionbuf_unparsed_start,
+            unparsed);
+    socket->__instructionbuf_unparsed_end = socket->__instructionbuf
+                                          + unparsed;
+
+    owner->__instructionbuf_unparsed_start =
+    owner->__instructionbuf_unparsed_end = owner->__instructionbuf;
+
+    client->__owner_socket = owner;
+    client->socket = socket;
+    return 0;
+
+}
+
+guac_viewer* guac_client_add_viewer(guac_client* client, guac_socket* socket,
+        int read_only) {
+
+    guac_viewer* viewer;
+
+    if (client->__owner_socket == NULL || client->join_handler == NULL) {
+        guac_error = GUAC_STATUS_NOT_SUPPORTED;
+        guac_error_message = "Connection cannot be shared";
+        return NULL;
+    }
+
+    viewer = calloc(1, sizeof(guac_viewer));
+    if (viewer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for viewer";
+        return NULL;
+    }
+
+    viewer->client = client;
+    viewer->socket = socket;
+    viewer->read_only = read_only;
+    viewer->last_received_timestamp = guac_timestamp_current();
+    viewer->__state = GUAC_VIEWER_JOINING;
+
+    /* Allocate socket which queues data for this viewer */
+    viewer->__queue = guac_socket_alloc();
+    if (viewer->__queue == NULL) {
+        free(viewer);
+        return NULL;
+    }
+
+    viewer->__queue->data = viewer;
+    viewer->__queue->write_handler = __guac_viewer_queue_write_handler;
+
+    pthread_mutex_init(&(viewer->__lock), NULL);
+    pthread_cond_init(&(viewer->__queued), NULL);
+
+    /* Complete the handshake ahead of any output of the client, such that
+     * the viewer is only told the connection ID once it has truly joined */
+    if (guac_protocol_send_ready(viewer->__queue, client->connection_id)
+            || guac_socket_flush(viewer->__queue) || viewer->__failed) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not queue \"ready\" for viewer";
+        pthread_mutex_lock(&(client->__viewers_lock));
+        goto fail;
+    }
+
+    pthread_mutex_lock(&(client->__viewers_lock));
+
+    /* Refuse viewers once the client is stopping */
+    if (client->state != GUAC_CLIENT_RUNNING) {
+        guac_error = GUAC_STATUS_CLOSED;
+        guac_error_message = "Connection is closing";
+        goto fail;
+    }
+
+    if (pthread_create(&(viewer->__writer_thread), NULL,
+                __guac_viewer_writer_thread, viewer)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to start viewer thread";
+        goto fail;
+    }
+
+    /* Add to list of viewers, to be brought up to date at end of frame */
+    viewer->__next = client->__viewers;
+    client->__viewers = viewer;
+    client->__viewer_count++;
+
+    pthread_mutex_unlock(&(client->__viewers_lock));
+    return viewer;
+
+fail:
+    pthread_mutex_unlock(&(client->__viewers_lock));
+    pthread_mutex_destroy(&(viewer->__lock));
+    pthread_cond_destroy(&(viewer->__queued));
+    guac_socket_free(viewer->__queue);
+    free(viewer->__pending);
+    free(viewer);
+    return NULL;
+
+}
+
+void guac_client_remove_viewer(guac_viewer* viewer) {
+
+    guac_client* client = viewer->client;
+    guac_viewer** current;
+
+    /* Remove from list of viewers */
+    pthread_mutex_lock(&(client->__viewers_lock));
+
+    for (current = &(client->__viewers); *current != NULL;
+            current = &((*current)->__next)) {
+        if (*current == viewer) {
+            *current = viewer->__next;
+            client->__viewer_count--;
+            break;
+        }
+    }
+
+    pthread_cond_broadcast(&(client->__viewers_changed));
+    pthread_mutex_unlock(&(client->__viewers_lock));
+
+    /* Stop writer thread */
+    pthread_mutex_lock(&(viewer->__lock));
+    viewer->__closing = 1;
+    pthread_cond_signal(&(viewer->__queued));
+    pthread_mutex_unlock(&(viewer->__lock));
+
+    pthread_join(viewer->__writer_thread, NULL);
+
+    guac_socket_free(viewer->__queue);
+    pthread_mutex_destroy(&(viewer->__lock));
+    pthread_cond_destroy(&(viewer->__queued));
+
+    free(viewer->__pending);
+    free(viewer);
+
+}
+
+int guac_viewer_failed(guac_viewer* viewer) {
+
+    int failed;
+
+    pthread_mutex_lock(&(viewer->__lock));
+    failed = viewer->__failed;
+    pthread_mutex_unlock(&(viewer->__lock));
+
+    return failed;
+
+}
+
+/**
+ * Marks the given viewer as failed, discarding all output queued for that
+ * viewer.
+ *
+ * @param viewer The viewer to mark as failed.
+ */
+static void __guac_viewer_fail(guac_viewer* viewer) {
+    pthread_mutex_lock(&(viewer->__lock));
+    viewer->__failed = 1;
+    viewer->__pending_length = 0;
+    pthread_mutex_unlock(&(viewer->__lock));
+}
+
+/**
+ * Stops sending output of the client to the given viewer until it catches
+ * up, or disconnects the viewer if it has repeatedly fallen behind soon
+ * after being sent the current state of the client. The viewer lock of the
+ * client must be held.
+ *
+ * @param viewer The lagging viewer.
+ * @param now The current time.
+ */
+static void __guac_viewer_lag(guac_viewer* viewer, guac_timestamp now) {
+
+    guac_client* client = viewer->client;
+
+    /* Lagging long after catching up does not count against the viewer */
+    if (now - viewer->__joined >= GUAC_VIEWER_STABLE_INTERVAL)
+        viewer->__lag_count = 0;
+
+    if (++viewer->__lag_count > GUAC_VIEWER_MAX_LAGS) {
+        guac_client_log(client, GUAC_LOG_INFO, "Viewer is persistently "
+                "lagging and will be disconnected.");
+        __guac_viewer_fail(viewer);
+        return;
+    }
+
+    guac_client_log(client, GUAC_LOG_DEBUG, "Viewer is lagging. Output will "
+            "be skipped until the viewer catches up.");
+    viewer->__state = GUAC_VIEWER_LAGGING;
+
+}
+
+/**
+ * Sends the current state of the client of the given viewer to that viewer,
+ * after which the viewer receives all further output of the client. The
+ * viewer lock of the client must be held.
+ *
+ * @param viewer The viewer to bring up to date.
+ */
+static void __guac_viewer_join(guac_viewer* viewer) {
+
+    guac_client* client = viewer->client;
+    guac_socket* socket = viewer->__queue;
+
+    if (client->join_handler(client, socket)
+            || guac_protocol_send_sync(socket, client->last_sent_timestamp)
+            || guac_socket_flush(socket)) {
+
+        guac_client_log(client, GUAC_LOG_INFO,
+                "Unable to send current state to viewer");
+
+        __guac_viewer_fail(viewer);
+        return;
+
+    }
+
+    viewer->__state = GUAC_VIEWER_ACTIVE;
+    viewer->__joined = guac_timestamp_current();
+
+}
+
+void guac_client_sync_viewers(guac_client* client) {
+
+    guac_viewer* viewer;
+    guac_timestamp now;
+    int count;
+
+    if (client->__owner_socket == NULL)
+        return;
+
+    pthread_mutex_lock(&(client->__viewers_lock));
+    count = client->__viewer_count;
+    pthread_mutex_unlock(&(client->__viewers_lock));
+
+    if (count == 0)
+        return;
+
+    /* Hold off other output while viewers change state, such that each
+     * viewer receives output only from instruction boundaries */
+    guac_socket_instruction_begin(client->socket);
+    guac_socket_flush(client->socket);
+
+    pthread_mutex_lock(&(client->__viewers_lock));
+    now = guac_timestamp_current();
+
+    for (viewer = client->__viewers; viewer != NULL; viewer = viewer->__next) {
+
+        size_t backlog;
+        int failed;
+
+        pthread_mutex_lock(&(viewer->__lock));
+        backlog = viewer->__pending_length;
+        failed = viewer->__failed;
+        pthread_mutex_unlock(&(viewer->__lock));
+
+        if (failed)
+            continue;
+
+        switch (viewer->__state) {
+
+            /* Stop sending output to viewers which fall too far behind */
+            case GUAC_VIEWER_ACTIVE:
+                if (backlog > GUAC_VIEWER_MAX_BACKLOG)
+                    __guac_viewer_lag(viewer, now);
+                break;
+
+            /* Resume lagging viewers once caught up, but not so often that
+             * the state of the client is constantly re-sent */
+            case GUAC_VIEWER_LAGGING:
+                if (backlog == 0
+                        && now - viewer->__joined
+                            >= GUAC_VIEWER_RESYNC_INTERVAL)
+                    __guac_viewer_join(viewer);
+                break;
+
+            case GUAC_VIEWER_JOINING:
+                __guac_viewer_join(viewer);
+                break;
+
+        }
+
+    }
+
+    pthread_mutex_unlock(&(client->__viewers_lock));
+    guac_socket_instruction_end(client->socket);
+
+}
+
+int guac_viewer_handle_instruction(guac_viewer* viewer,
+        guac_instruction* instruction) {
+
+    switch (instruction->opcode_id) {
+
+        case GUAC_INSTRUCTION_OPCODE_SYNC:
+            if (instruction->argc >= 1)
+                viewer->last_received_timestamp =
+                    atoll(instruction->argv[0]);
+            return 0;
+
+        case GUAC_INSTRUCTION_OPCODE_DISCONNECT:
+            return 1;
+
+        /* Pass input through unless read-only */
+        case GUAC_INSTRUCTION_OPCODE_MOUSE:
+        case GUAC_INSTRUCTION_OPCODE_KEY:
+            if (viewer->read_only)
+                return 0;
+            if (instruction->argc < (instruction->opcode_id
+                        == GUAC_INSTRUCTION_OPCODE_MOUSE ? 3 : 2))
+                return 0;
+            return guac_client_handle_instruction(viewer->client,
+                    instruction) < 0 ? -1 : 0;
+
+        /* Streams and the display size belong to the connection which
+         * created the client */
+        default:
+            return 0;
+
+    }
+
+}
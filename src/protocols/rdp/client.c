@@ -115,9 +115,17 @@ const char* GUAC_CLIENT_ARGS[] = {
     "remote-app-dir",
     "remote-app-args",
     "static-channels",
+    "image-quality",
+    "png-compression",
+    "image-cache-size",
+    "detect-motion",
+    "coalesce-mouse",
     NULL
 };
 
+/* Clients define a join_handler, and thus may have other viewers */
+const int GUAC_CLIENT_VIEWERS = 1;
+
 enum RDP_ARGS_IDX {
 
     IDX_HOSTNAME,
@@ -144,6 +152,11 @@ enum RDP_ARGS_IDX {
     IDX_REMOTE_APP_DIR,
     IDX_REMOTE_APP_ARGS,
     IDX_STATIC_CHANNELS,
+    IDX_IMAGE_QUALITY,
+    IDX_PNG_COMPRESSION,
+    IDX_IMAGE_CACHE_SIZE,
+    IDX_DETECT_MOTION,
+    IDX_COALESCE_MOUSE,
     RDP_ARGS_COUNT
 };
 
@@ -426,6 +439,7 @@ BOOL rdp_freerdp_post_connect(freerdp* instance) {
 
     /* Client handlers */
     client->free_handler = rdp_guac_client_free_handler;
+    client->join_handler = rdp_guac_client_join_handler;
     client->handle_messages = rdp_guac_client_handle_messages;
     client->mouse_handler = rdp_guac_client_mouse_handler;
     client->key_handler = rdp_guac_client_key_handler;
@@ -510,6 +524,26 @@ void __guac_rdp_client_load_keymap(guac_client* client,
 
 }
 
+/**
+ * Guards the process-wide initialization of FreeRDP, which must occur only
+ * once regardless of whether the plugin was preloaded.
+ */
+static pthread_once_t __guac_rdp_global_init_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Performs the process-wide initialization of FreeRDP.
+ */
+static void __guac_rdp_global_init() {
+#ifdef HAVE_FREERDP_CHANNELS_GLOBAL_INIT
+    freerdp_channels_global_init();
+#endif
+}
+
+int guac_client_preload() {
+    pthread_once(&__guac_rdp_global_init_once, __guac_rdp_global_init);
+    return 0;
+}
+
 int guac_client_init(guac_client* client, int argc, char** argv) {
 
     rdp_guac_client_data* guac_client_data;
@@ -530,9 +564,7 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     srandom(time(NULL));
 
     /* Init client */
-#ifdef HAVE_FREERDP_CHANNELS_GLOBAL_INIT
-    freerdp_channels_global_init();
-#endif
+    pthread_once(&__guac_rdp_global_init_once, __guac_rdp_global_init);
     rdp_inst = freerdp_new();
     rdp_inst->PreConnect = rdp_freerdp_pre_connect;
     rdp_inst->PostConnect = rdp_freerdp_post_connect;
@@ -691,6 +723,40 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     if (argv[IDX_STATIC_CHANNELS][0] != '\0')
         settings->svc_names = guac_split(argv[IDX_STATIC_CHANNELS], ',');
 
+    /* Lossy image quality, lossless by default */
+    settings->image_quality = 0;
+    if (argv[IDX_IMAGE_QUALITY][0] != '\0') {
+
+        settings->image_quality = atoi(argv[IDX_IMAGE_QUALITY]);
+
+        /* Zero or less is lossless, otherwise limit specified quality to
+         * the range accepted by libjpeg */
+        if (settings->image_quality < 0)
+            settings->image_quality = 0;
+        else if (settings->image_quality > 100)
+            settings->image_quality = 100;
+
+    }
+
+    /* PNG speed/size tradeoff */
+    if (strcmp(argv[IDX_PNG_COMPRESSION], "fast") == 0)
+        client->png_compression = GUAC_PNG_COMPRESSION_FAST;
+    else if (strcmp(argv[IDX_PNG_COMPRESSION], "small") == 0)
+        client->png_compression = GUAC_PNG_COMPRESSION_SMALL;
+
+    /* Image cache size, disabled by default */
+    settings->image_cache_size =
+        guac_common_image_cache_parse_size(argv[IDX_IMAGE_CACHE_SIZE]);
+
+    /* Motion detection */
+    settings->detect_motion = (strcmp(argv[IDX_DETECT_MOTION], "true") == 0);
+
+    /* Override guacd's mouse coalescing default, if specified */
+    if (strcmp(argv[IDX_COALESCE_MOUSE], "true") == 0)
+        client->coalesce_mouse = 1;
+    else if (strcmp(argv[IDX_COALESCE_MOUSE], "false") == 0)
+        client->coalesce_mouse = 0;
+
     /* Session color depth */
     settings->color_depth = RDP_DEFAULT_DEPTH;
     if (argv[IDX_COLOR_DEPTH][0] != '\0')
@@ -726,6 +792,9 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     guac_client_data->audio = NULL;
     guac_client_data->filesystem = NULL;
     guac_client_data->available_svc = guac_common_list_alloc();
+    guac_client_data->cached_bitmaps = guac_common_list_alloc();
+    guac_client_data->cached_pointers = guac_common_list_alloc();
+    guac_client_data->current_pointer = NULL;
 
     /* Main socket needs to be threadsafe */
     guac_socket_require_threadsafe(client->socket);
@@ -763,10 +832,31 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     __guac_rdp_client_load_keymap(client, settings->server_layout);
 
     /* Create default surface */
-    guac_client_data->default_surface = guac_common_surface_alloc(client->socket, GUAC_DEFAULT_LAYER,
+    guac_client_data->default_surface = guac_common_surface_alloc(client, client->socket, GUAC_DEFAULT_LAYER,
                                                                   settings->width, settings->height);
+    guac_client_data->default_surface->lossy_quality = settings->image_quality;
     guac_client_data->current_surface = guac_client_data->default_surface;
 
+    /* Cache images sent, if requested */
+    guac_client_data->image_cache = NULL;
+    if (settings->image_cache_size > 0) {
+
+        guac_client_data->image_cache = guac_common_image_cache_alloc(client,
+                settings->image_cache_size);
+
+        /* Images will simply not be cached if no cache is available */
+        if (guac_client_data->image_cache == NULL)
+            guac_client_log(client, GUAC_LOG_WARNING,
+                    "Unable to allocate image cache");
+
+        guac_client_data->default_surface->image_cache = guac_client_data->image_cache;
+
+    }
+
+    /* Detect scrolled or moved content, if requested */
+    if (settings->detect_motion)
+        guac_common_surface_set_motion_detection(guac_client_data->default_surface, 1);
+
     /* Send connection name */
     guac_protocol_send_name(client->socket, settings->hostname);
 
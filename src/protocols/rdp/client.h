@@ -27,10 +27,12 @@
 #include "config.h"
 
 #include "guac_clipboard.h"
+#include "guac_image_cache.h"
 #include "guac_list.h"
 #include "guac_surface.h"
 #include "rdp_fs.h"
 #include "rdp_keymap.h"
+#include "rdp_pointer.h"
 #include "rdp_settings.h"
 
 #ifdef HAVE_FREERDP_DISPLAY_UPDATE_SUPPORT
@@ -45,11 +47,6 @@
 #include <pthread.h>
 #include <stdint.h>
 
-/**
- * The maximum duration of a frame in milliseconds.
- */
-#define GUAC_RDP_FRAME_DURATION 60
-
 /**
  * The amount of time to allow per message read within a frame, in
  * milliseconds. If the server is silent for at least this amount of time, the
@@ -112,6 +109,12 @@ typedef struct rdp_guac_client_data {
      */
     guac_common_surface* default_surface;
 
+    /**
+     * The cache of images sent to the client, or NULL if images are not
+     * cached.
+     */
+    guac_common_image_cache* image_cache;
+
     /**
      * The surface that GDI operations should draw to. RDP messages exist which
      * change this surface to allow drawing to occur off-screen.
@@ -169,6 +172,26 @@ typedef struct rdp_guac_client_data {
      */
     guac_common_list* available_svc;
 
+    /**
+     * List of all bitmaps whose contents are cached within client-side
+     * buffers, as guac_rdp_bitmap, used to recreate those buffers for
+     * viewers which join the connection later.
+     */
+    guac_common_list* cached_bitmaps;
+
+    /**
+     * List of all pointers whose images are cached within client-side
+     * buffers, as guac_rdp_pointer, used to recreate those buffers for
+     * viewers which join the connection later.
+     */
+    guac_common_list* cached_pointers;
+
+    /**
+     * The pointer most recently set as the cursor, or NULL if no pointer
+     * has been set.
+     */
+    guac_rdp_pointer* current_pointer;
+
     /**
      * Lock which is locked and unlocked for each RDP message.
      */
@@ -25,11 +25,14 @@
 #include "client.h"
 #include "guac_clipboard.h"
 #include "guac_handlers.h"
+#include "guac_image_cache.h"
 #include "guac_list.h"
 #include "guac_surface.h"
+#include "rdp_bitmap.h"
 #include "rdp_cliprdr.h"
 #include "rdp_keymap.h"
 #include "rdp_fs.h"
+#include "rdp_pointer.h"
 #include "rdp_rail.h"
 #include "rdp_stream.h"
 
@@ -41,7 +44,9 @@
 #include <freerdp/utils/event.h>
 #include <guacamole/client.h>
 #include <guacamole/error.h>
+#include <guacamole/pacing.h>
 #include <guacamole/protocol.h>
+#include <guacamole/socket.h>
 #include <guacamole/timestamp.h>
 
 #ifdef HAVE_FREERDP_DISPLAY_UPDATE_SUPPORT
@@ -61,6 +66,7 @@
 #endif
 
 #include <errno.h>
+#include <inttypes.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <sys/select.h>
@@ -97,9 +103,34 @@ int rdp_guac_client_free_handler(guac_client* client) {
     /* Free SVC list */
     guac_common_list_free(guac_client_data->available_svc);
 
+    /* Free lists of cached bitmaps and pointers, all of which were freed
+     * with the cache */
+    guac_common_list_free(guac_client_data->cached_bitmaps);
+    guac_common_list_free(guac_client_data->cached_pointers);
+
     /* Free client data */
     guac_common_clipboard_free(guac_client_data->clipboard);
+
+    /* Note effectiveness of motion detection, if used */
+    if (guac_client_data->settings.detect_motion) {
+        guac_common_surface_motion_stats* motion =
+            &guac_client_data->default_surface->motion_stats;
+        guac_client_log(client, GUAC_LOG_INFO, "Motion detection: %i of %i "
+                "updates moved (%" PRId64 " pixels).", motion->hits,
+                motion->candidates, motion->pixels);
+    }
+
     guac_common_surface_free(guac_client_data->default_surface);
+
+    /* Free image cache, if used */
+    if (guac_client_data->image_cache != NULL) {
+        guac_common_image_cache* cache = guac_client_data->image_cache;
+        guac_client_log(client, GUAC_LOG_INFO, "Image cache: %i hits, "
+                "%i misses, %i evictions.", cache->hits, cache->misses,
+                cache->evictions);
+        guac_common_image_cache_free(cache);
+    }
+
     free(guac_client_data);
 
     return 0;
@@ -186,6 +217,31 @@ static int rdp_guac_client_wait_for_messages(guac_client* client, int timeout_us
 
 }
 
+int rdp_guac_client_join_handler(guac_client* client, guac_socket* socket) {
+
+    rdp_guac_client_data* guac_client_data = (rdp_guac_client_data*) client->data;
+    guac_common_list_element* current;
+
+    /* Surfaces are only drawn to while handling messages, which never runs
+     * concurrently with this handler, thus the RDP lock is not needed. Any
+     * buffers which later updates may copy from are recreated first. */
+    if (guac_client_data->image_cache != NULL)
+        guac_common_image_cache_dup(guac_client_data->image_cache, socket);
+
+    for (current = guac_client_data->cached_bitmaps->head; current != NULL;
+            current = current->next) {
+        guac_rdp_bitmap* bitmap = (guac_rdp_bitmap*) current->data;
+        guac_common_surface_dup(bitmap->surface, socket);
+    }
+
+    guac_common_surface_dup(guac_client_data->default_surface, socket);
+
+    /* Recreate pointer buffers and set the current cursor */
+    guac_rdp_pointer_dup(client, socket);
+    return 0;
+
+}
+
 int rdp_guac_client_handle_messages(guac_client* client) {
 
     rdp_guac_client_data* guac_client_data = (rdp_guac_client_data*) client->data;
@@ -256,7 +312,8 @@ int rdp_guac_client_handle_messages(guac_client* client) {
 
         /* Calculate time remaining in frame */
         frame_end = guac_timestamp_current();
-        frame_remaining = frame_start + GUAC_RDP_FRAME_DURATION - frame_end;
+        frame_remaining = frame_start
+            + guac_pacing_get_frame_duration(client->pacing) - frame_end;
 
         /* Wait again if frame remaining */
         if (frame_remaining > 0)
@@ -27,8 +27,10 @@
 #include "config.h"
 
 #include <guacamole/client.h>
+#include <guacamole/socket.h>
 
 int rdp_guac_client_free_handler(guac_client* client);
+int rdp_guac_client_join_handler(guac_client* client, guac_socket* socket);
 int rdp_guac_client_handle_messages(guac_client* client);
 int rdp_guac_client_mouse_handler(guac_client* client, int x, int y, int mask);
 int rdp_guac_client_key_handler(guac_client* client, int keysym, int pressed);
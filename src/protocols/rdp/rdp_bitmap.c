@@ -46,11 +46,12 @@
 void guac_rdp_cache_bitmap(rdpContext* context, rdpBitmap* bitmap) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    rdp_guac_client_data* client_data = (rdp_guac_client_data*) client->data;
     guac_socket* socket = client->socket; 
 
     /* Allocate surface */
     guac_layer* buffer = guac_client_alloc_buffer(client);
-    guac_common_surface* surface = guac_common_surface_alloc(socket, buffer, bitmap->width, bitmap->height);
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket, buffer, bitmap->width, bitmap->height);
 
     /* Cache image data if present */
     if (bitmap->data != NULL) {
@@ -72,6 +73,10 @@ void guac_rdp_cache_bitmap(rdpContext* context, rdpBitmap* bitmap) {
     ((guac_rdp_bitmap*) bitmap)->buffer = buffer;
     ((guac_rdp_bitmap*) bitmap)->surface = surface;
 
+    /* Track cached bitmaps for viewers joining later */
+    ((guac_rdp_bitmap*) bitmap)->cached =
+        guac_common_list_add(client_data->cached_bitmaps, bitmap);
+
 }
 
 void guac_rdp_bitmap_new(rdpContext* context, rdpBitmap* bitmap) {
@@ -102,6 +107,7 @@ void guac_rdp_bitmap_new(rdpContext* context, rdpBitmap* bitmap) {
     /* No corresponding surface yet - caching is deferred. */
     ((guac_rdp_bitmap*) bitmap)->buffer = NULL;
     ((guac_rdp_bitmap*) bitmap)->surface = NULL;
+    ((guac_rdp_bitmap*) bitmap)->cached = NULL;
 
     /* Start at zero usage */
     ((guac_rdp_bitmap*) bitmap)->used = 0;
@@ -151,8 +157,14 @@ void guac_rdp_bitmap_paint(rdpContext* context, rdpBitmap* bitmap) {
 void guac_rdp_bitmap_free(rdpContext* context, rdpBitmap* bitmap) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    rdp_guac_client_data* client_data = (rdp_guac_client_data*) client->data;
     guac_layer* buffer = ((guac_rdp_bitmap*) bitmap)->buffer;
     guac_common_surface* surface = ((guac_rdp_bitmap*) bitmap)->surface;
+    guac_common_list_element* cached = ((guac_rdp_bitmap*) bitmap)->cached;
+
+    /* If cached, no longer track for viewers */
+    if (cached != NULL)
+        guac_common_list_remove(client_data->cached_bitmaps, cached);
 
     /* If cached, free surface */
     if (surface != NULL)
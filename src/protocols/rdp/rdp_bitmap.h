@@ -27,6 +27,8 @@
 #include "config.h"
 #include "guac_surface.h"
 
+#include "guac_list.h"
+
 #include <freerdp/freerdp.h>
 #include <guacamole/layer.h>
 
@@ -58,6 +60,12 @@ typedef struct guac_rdp_bitmap {
      */
     int used;
 
+    /**
+     * The element of the list of cached bitmaps which refers to this bitmap,
+     * or NULL if this bitmap is not cached.
+     */
+    guac_common_list_element* cached;
+
 } guac_rdp_bitmap;
 
 void guac_rdp_cache_bitmap(rdpContext* context, rdpBitmap* bitmap);
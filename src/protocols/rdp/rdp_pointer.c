@@ -36,6 +36,7 @@
 void guac_rdp_pointer_new(rdpContext* context, rdpPointer* pointer) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    rdp_guac_client_data* client_data = (rdp_guac_client_data*) client->data;
     guac_socket* socket = client->socket;
 
     /* Allocate data for image */
@@ -62,20 +63,23 @@ void guac_rdp_pointer_new(rdpContext* context, rdpPointer* pointer) {
     /* Send surface to buffer */
     guac_protocol_send_png(socket, GUAC_COMP_SRC, buffer, 0, 0, surface);
 
-    /* Free surface */
-    cairo_surface_destroy(surface);
-    free(data);
-
-    /* Remember buffer */
+    /* Remember buffer, retaining image for viewers joining later */
     ((guac_rdp_pointer*) pointer)->layer = buffer;
+    ((guac_rdp_pointer*) pointer)->surface = surface;
+    ((guac_rdp_pointer*) pointer)->data = data;
+    ((guac_rdp_pointer*) pointer)->cached =
+        guac_common_list_add(client_data->cached_pointers, pointer);
 
 }
 
 void guac_rdp_pointer_set(rdpContext* context, rdpPointer* pointer) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
+    rdp_guac_client_data* client_data = (rdp_guac_client_data*) client->data;
     guac_socket* socket = client->socket;
 
+    client_data->current_pointer = (guac_rdp_pointer*) pointer;
+
     /* Set cursor */
     guac_protocol_send_cursor(socket, pointer->xPos, pointer->yPos,
             ((guac_rdp_pointer*) pointer)->layer,
@@ -86,7 +90,41 @@ void guac_rdp_pointer_set(rdpContext* context, rdpPointer* pointer) {
 void guac_rdp_pointer_free(rdpContext* context, rdpPointer* pointer) {
 
     guac_client* client = ((rdp_freerdp_context*) context)->client;
-    guac_client_free_buffer(client, ((guac_rdp_pointer*) pointer)->layer);
+    rdp_guac_client_data* client_data = (rdp_guac_client_data*) client->data;
+    guac_rdp_pointer* rdp_pointer = (guac_rdp_pointer*) pointer;
+
+    /* No longer track for viewers */
+    if (rdp_pointer->cached != NULL)
+        guac_common_list_remove(client_data->cached_pointers,
+                rdp_pointer->cached);
+
+    if (client_data->current_pointer == rdp_pointer)
+        client_data->current_pointer = NULL;
+
+    cairo_surface_destroy(rdp_pointer->surface);
+    free(rdp_pointer->data);
+
+    guac_client_free_buffer(client, rdp_pointer->layer);
+
+}
+
+void guac_rdp_pointer_dup(guac_client* client, guac_socket* socket) {
+
+    rdp_guac_client_data* client_data = (rdp_guac_client_data*) client->data;
+    guac_rdp_pointer* current = client_data->current_pointer;
+    guac_common_list_element* element;
+
+    for (element = client_data->cached_pointers->head; element != NULL;
+            element = element->next) {
+        guac_rdp_pointer* pointer = (guac_rdp_pointer*) element->data;
+        guac_protocol_send_png(socket, GUAC_COMP_SRC, pointer->layer, 0, 0,
+                pointer->surface);
+    }
+
+    if (current != NULL)
+        guac_protocol_send_cursor(socket, current->pointer.xPos,
+                current->pointer.yPos, current->layer, 0, 0,
+                current->pointer.width, current->pointer.height);
 
 }
 
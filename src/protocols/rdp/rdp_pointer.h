@@ -26,8 +26,13 @@
 
 #include "config.h"
 
+#include "guac_list.h"
+
+#include <cairo/cairo.h>
 #include <freerdp/freerdp.h>
+#include <guacamole/client.h>
 #include <guacamole/layer.h>
+#include <guacamole/socket.h>
 
 typedef struct guac_rdp_pointer {
 
@@ -41,8 +46,34 @@ typedef struct guac_rdp_pointer {
      */
     guac_layer* layer;
 
+    /**
+     * The image data sent to the layer, retained such that the layer can be
+     * recreated for viewers which join the connection later.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The buffer containing the pixels of the surface.
+     */
+    unsigned char* data;
+
+    /**
+     * The element of the list of cached pointers which refers to this
+     * pointer.
+     */
+    guac_common_list_element* cached;
+
 } guac_rdp_pointer;
 
+/**
+ * Recreates the buffers of all cached pointers, and sets the current cursor,
+ * over the given socket. This is intended for use within the join handler.
+ *
+ * @param client The client whose pointers should be sent.
+ * @param socket The socket of the joining viewer.
+ */
+void guac_rdp_pointer_dup(guac_client* client, guac_socket* socket);
+
 void guac_rdp_pointer_new(rdpContext* context, rdpPointer* pointer);
 void guac_rdp_pointer_set(rdpContext* context, rdpPointer* pointer);
 void guac_rdp_pointer_free(rdpContext* context, rdpPointer* pointer);
@@ -30,6 +30,8 @@
 
 #include <freerdp/freerdp.h>
 
+#include <stddef.h>
+
 /**
  * The default RDP port.
  */
@@ -207,6 +209,24 @@ typedef struct guac_rdp_settings {
      */
     char** svc_names;
 
+    /**
+     * The JPEG quality to use for photographic, frequently-changing regions of
+     * the display, from 1 to 100, or zero if all updates should be lossless.
+     */
+    int image_quality;
+
+    /**
+     * The maximum amount of client-side memory which may be used to cache
+     * images sent, in bytes, or zero if images should not be cached.
+     */
+    size_t image_cache_size;
+
+    /**
+     * Whether scrolled or moved content should be detected and sent as
+     * copies of what the client already displays.
+     */
+    int detect_motion;
+
 } guac_rdp_settings;
 
 /**
@@ -50,6 +50,7 @@ const char* GUAC_CLIENT_ARGS[] = {
     "password",
     "font-name",
     "font-size",
+    "enable-glyph-buffers",
     "enable-sftp",
     "private-key",
     "passphrase",
@@ -59,6 +60,10 @@ const char* GUAC_CLIENT_ARGS[] = {
     NULL
 };
 
+/* Clients need only handle terminal output as it becomes available, and thus
+ * may be driven by events on their message_fd */
+const int GUAC_CLIENT_EVENT_DRIVEN = 1;
+
 enum __SSH_ARGS_IDX {
 
     /**
@@ -91,6 +96,12 @@ enum __SSH_ARGS_IDX {
      */
     IDX_FONT_SIZE,
 
+    /**
+     * Whether glyphs should be retained within offscreen buffers on the
+     * client and drawn with copies, rather than sent again as images.
+     */
+    IDX_ENABLE_GLYPH_BUFFERS,
+
     /**
      * Whether SFTP should be enabled.
      */
@@ -116,6 +127,11 @@ enum __SSH_ARGS_IDX {
     SSH_ARGS_COUNT
 };
 
+int guac_client_preload() {
+    ssh_client_global_init();
+    return 0;
+}
+
 int guac_client_init(guac_client* client, int argc, char** argv) {
 
     guac_socket* socket = client->socket;
@@ -158,6 +174,10 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     else
         client_data->font_size = GUAC_SSH_DEFAULT_FONT_SIZE;
 
+    /* Parse glyph buffers enable */
+    client_data->enable_glyph_buffers =
+        strcmp(argv[IDX_ENABLE_GLYPH_BUFFERS], "true") == 0;
+
     /* Parse SFTP enable */
     client_data->enable_sftp = strcmp(argv[IDX_ENABLE_SFTP], "true") == 0;
     client_data->sftp_session = NULL;
@@ -186,6 +206,10 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
         return -1;
     }
 
+    /* Retain glyphs on client, if enabled */
+    guac_terminal_set_glyph_buffers(client_data->term,
+            client_data->enable_glyph_buffers);
+
     /* Ensure main socket is threadsafe */
     guac_socket_require_threadsafe(socket);
 
@@ -202,6 +226,9 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     client->free_handler      = ssh_guac_client_free_handler;
     client->clipboard_handler = guac_ssh_clipboard_handler;
 
+    /* Terminal output is handled whenever its pipe becomes readable */
+    client->message_fd = client_data->term->stdout_pipe_fd[0];
+
     /* Start client thread */
     if (pthread_create(&(client_data->client_thread), NULL, ssh_client_thread, (void*) client)) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR, "Unable to start SSH client thread");
@@ -90,6 +90,11 @@ typedef struct ssh_guac_client_data {
      */
     int font_size;
 
+    /**
+     * Whether glyphs are retained within offscreen buffers on the client.
+     */
+    bool enable_glyph_buffers;
+
     /**
      * Whether SFTP is enabled.
      */
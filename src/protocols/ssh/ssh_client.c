@@ -46,13 +46,13 @@
 #include <errno.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 
@@ -312,15 +312,45 @@ static void __openssl_init_locks(int count) {
 }
 
 /**
- * Frees the given number of mutexes.
+ * Guards the process-wide initialization of libssh2 and its dependencies.
  */
-static void __openssl_free_locks(int count) {
+static pthread_once_t __ssh_global_init_once = PTHREAD_ONCE_INIT;
 
-    int i;
+#ifdef LIBSSH2_USES_GCRYPT
+/**
+ * Whether the version of libgcrypt was found to be compatible during
+ * process-wide initialization.
+ */
+static int __ssh_gcrypt_valid = 0;
+#endif
 
-    for (i=0; i<count; i++)
-        pthread_mutex_destroy(&(__openssl_locks[i]));
+/**
+ * Initializes libssh2 and the libraries it depends upon, including their
+ * threadsafety. The locks used by OpenSSL are never freed, as they may be
+ * used by any connection within the same process.
+ */
+static void __ssh_global_init() {
+
+#ifdef LIBSSH2_USES_GCRYPT
+    /* Init threadsafety in libgcrypt */
+    gcry_control(GCRYCTL_SET_THREAD_CBS, &gcry_threads_pthread);
+    __ssh_gcrypt_valid = gcry_check_version(GCRYPT_VERSION) != NULL;
+#endif
+
+    /* Init threadsafety in OpenSSL */
+    __openssl_init_locks(CRYPTO_num_locks());
+    CRYPTO_set_id_callback(__openssl_id_callback);
+    CRYPTO_set_locking_callback(__openssl_locking_callback);
+
+    /* Init OpenSSL */
+    SSL_library_init();
+    ERR_load_crypto_strings();
+    libssh2_init(0);
+
+}
 
+void ssh_client_global_init() {
+    pthread_once(&__ssh_global_init_once, __ssh_global_init);
 }
 
 void* ssh_client_thread(void* data) {
@@ -338,25 +368,16 @@ void* ssh_client_thread(void* data) {
 
     pthread_t input_thread;
 
+    /* Init libssh2, if not already preloaded */
+    ssh_client_global_init();
+
 #ifdef LIBSSH2_USES_GCRYPT
-    /* Init threadsafety in libgcrypt */
-    gcry_control(GCRYCTL_SET_THREAD_CBS, &gcry_threads_pthread);
-    if (!gcry_check_version(GCRYPT_VERSION)) {
+    if (!__ssh_gcrypt_valid) {
         guac_client_log(client, GUAC_LOG_ERROR, "libgcrypt version mismatch.");
         return NULL;
     }
 #endif
 
-    /* Init threadsafety in OpenSSL */
-    __openssl_init_locks(CRYPTO_num_locks());
-    CRYPTO_set_id_callback(__openssl_id_callback);
-    CRYPTO_set_locking_callback(__openssl_locking_callback);
-
-    /* Init OpenSSL */
-    SSL_library_init();
-    ERR_load_crypto_strings();
-    libssh2_init(0);
-
     /* Get username */
     if (client_data->username[0] == 0)
         guac_terminal_prompt(client_data->term, "Login as: ",
@@ -551,18 +572,17 @@ void* ssh_client_thread(void* data) {
 
         /* Wait for more data if reads turn up empty */
         if (total_read == 0) {
-            fd_set fds;
-            struct timeval timeout;
 
-            FD_ZERO(&fds);
-            FD_SET(socket_fd, &fds);
+            struct pollfd fds[] = {{
+                .fd      = socket_fd,
+                .events  = POLLIN,
+                .revents = 0,
+            }};
 
             /* Wait for one second */
-            timeout.tv_sec = 1;
-            timeout.tv_usec = 0;
-
-            if (select(socket_fd+1, &fds, NULL, NULL, &timeout) < 0)
+            if (poll(fds, 1, 1000) < 0)
                 break;
+
         }
 
     }
@@ -571,7 +591,6 @@ void* ssh_client_thread(void* data) {
     guac_client_stop(client);
     pthread_join(input_thread, NULL);
 
-    __openssl_free_locks(CRYPTO_num_locks());
     pthread_mutex_destroy(&client_data->term_channel_lock);
 
     guac_client_log(client, GUAC_LOG_INFO, "SSH connection ended.");
@@ -33,5 +33,12 @@
  */
 void* ssh_client_thread(void* data);
 
+/**
+ * Initializes libssh2 and the libraries it depends upon, if not already
+ * initialized. This function may safely be called any number of times, from
+ * any thread.
+ */
+void ssh_client_global_init();
+
 #endif
 
@@ -53,9 +53,14 @@ const char* GUAC_CLIENT_ARGS[] = {
     "password-regex",
     "font-name",
     "font-size",
+    "enable-glyph-buffers",
     NULL
 };
 
+/* Clients need only handle terminal output as it becomes available, and thus
+ * may be driven by events on their message_fd */
+const int GUAC_CLIENT_EVENT_DRIVEN = 1;
+
 enum __TELNET_ARGS_IDX {
 
     /**
@@ -100,6 +105,12 @@ enum __TELNET_ARGS_IDX {
      */
     IDX_FONT_SIZE,
 
+    /**
+     * Whether glyphs should be retained within offscreen buffers on the
+     * client and drawn with copies, rather than sent again as images.
+     */
+    IDX_ENABLE_GLYPH_BUFFERS,
+
     TELNET_ARGS_COUNT
 };
 
@@ -136,6 +147,8 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     client_data->socket_fd = -1;
     client_data->naws_enabled = 0;
     client_data->echo_enabled = 1;
+    client_data->regex_line_buffer[0] = '\0';
+    client_data->regex_line_length = 0;
 
     if (argc != TELNET_ARGS_COUNT) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR, "Wrong number of arguments");
@@ -196,6 +209,10 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     else
         client_data->font_size = GUAC_TELNET_DEFAULT_FONT_SIZE;
 
+    /* Parse glyph buffers enable */
+    client_data->enable_glyph_buffers =
+        strcmp(argv[IDX_ENABLE_GLYPH_BUFFERS], "true") == 0;
+
     /* Create terminal */
     client_data->term = guac_terminal_create(client,
             client_data->font_name, client_data->font_size,
@@ -208,6 +225,10 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
         return -1;
     }
 
+    /* Retain glyphs on client, if enabled */
+    guac_terminal_set_glyph_buffers(client_data->term,
+            client_data->enable_glyph_buffers);
+
     /* Send initial name */
     guac_protocol_send_name(socket, client_data->hostname);
 
@@ -221,6 +242,9 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     client->free_handler      = guac_telnet_client_free_handler;
     client->clipboard_handler = guac_telnet_clipboard_handler;
 
+    /* Terminal output is handled whenever its pipe becomes readable */
+    client->message_fd = client_data->term->stdout_pipe_fd[0];
+
     /* Start client thread */
     if (pthread_create(&(client_data->client_thread), NULL, guac_telnet_client_thread, (void*) client)) {
         guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR, "Unable to start telnet client thread");
@@ -28,6 +28,7 @@
 
 #include <pthread.h>
 #include <regex.h>
+#include <stdbool.h>
 #include <sys/types.h>
 
 #include <libtelnet.h>
@@ -74,6 +75,18 @@ typedef struct guac_telnet_client_data {
      */
     regex_t* password_regex;
 
+    /**
+     * The most recent line received from the telnet server, against which
+     * the username and password regular expressions are matched.
+     */
+    char regex_line_buffer[1024];
+
+    /**
+     * The number of characters within regex_line_buffer, excluding the null
+     * terminator.
+     */
+    int regex_line_length;
+
     /**
      * The name of the font to use for display rendering.
      */
@@ -84,6 +97,11 @@ typedef struct guac_telnet_client_data {
      */
     int font_size;
 
+    /**
+     * Whether glyphs are retained within offscreen buffers on the client.
+     */
+    bool enable_glyph_buffers;
+
     /**
      * The telnet client thread.
      */
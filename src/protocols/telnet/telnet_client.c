@@ -32,10 +32,10 @@
 #include <errno.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <unistd.h>
@@ -92,11 +92,11 @@ static int __guac_telnet_write_all(int fd, const char* buffer, int size) {
  */
 static bool __guac_telnet_regex_search(guac_client* client, regex_t* regex, char* value, const char* buffer, int size) {
 
-    static char line_buffer[1024] = {0};
-    static int length = 0;
-
     guac_telnet_client_data* client_data = (guac_telnet_client_data*) client->data;
 
+    char* line_buffer = client_data->regex_line_buffer;
+    int length = client_data->regex_line_length;
+
     int i;
     const char* current;
 
@@ -114,13 +114,14 @@ static bool __guac_telnet_regex_search(guac_client* client, regex_t* regex, char
     }
 
     /* Truncate if necessary */
-    if (size + length + 1 > sizeof(line_buffer))
-        size = sizeof(line_buffer) - length - 1;
+    if (size + length + 1 > sizeof(client_data->regex_line_buffer))
+        size = sizeof(client_data->regex_line_buffer) - length - 1;
 
     /* Append to line */
     memcpy(&(line_buffer[length]), buffer, size);
     length += size;
     line_buffer[length] = '\0';
+    client_data->regex_line_length = length;
 
     /* Send value upon match */
     if (regexec(regex, line_buffer, 0, NULL, 0) == 0) {
@@ -427,7 +428,7 @@ void guac_telnet_send_user(telnet_t* telnet, const char* username) {
 
 /**
  * Waits for data on the given file descriptor for up to one second. The
- * return value is identical to that of select(): 0 on timeout, < 0 on
+ * return value is identical to that of poll(): 0 on timeout, < 0 on
  * error, and > 0 on success.
  *
  * @param socket_fd The file descriptor to wait for.
@@ -436,17 +437,14 @@ void guac_telnet_send_user(telnet_t* telnet, const char* username) {
  */
 static int __guac_telnet_wait(int socket_fd) {
 
-    fd_set fds;
-    struct timeval timeout;
-
-    FD_ZERO(&fds);
-    FD_SET(socket_fd, &fds);
+    struct pollfd fds[] = {{
+        .fd      = socket_fd,
+        .events  = POLLIN,
+        .revents = 0,
+    }};
 
     /* Wait for one second */
-    timeout.tv_sec = 1;
-    timeout.tv_usec = 0;
-
-    return select(socket_fd+1, &fds, NULL, NULL, &timeout);
+    return poll(fds, 1, 1000);
 
 }
 
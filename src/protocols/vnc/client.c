@@ -55,6 +55,11 @@ const char* GUAC_CLIENT_ARGS[] = {
     "color-depth",
     "cursor",
     "autoretry",
+    "image-quality",
+    "png-compression",
+    "image-cache-size",
+    "detect-motion",
+    "coalesce-mouse",
 
 #ifdef ENABLE_VNC_REPEATER
     "dest-host",
@@ -74,6 +79,9 @@ const char* GUAC_CLIENT_ARGS[] = {
     NULL
 };
 
+/* Clients define a join_handler, and thus may have other viewers */
+const int GUAC_CLIENT_VIEWERS = 1;
+
 enum VNC_ARGS_IDX {
 
     IDX_HOSTNAME,
@@ -85,6 +93,11 @@ enum VNC_ARGS_IDX {
     IDX_COLOR_DEPTH,
     IDX_CURSOR,
     IDX_AUTORETRY,
+    IDX_IMAGE_QUALITY,
+    IDX_PNG_COMPRESSION,
+    IDX_IMAGE_CACHE_SIZE,
+    IDX_DETECT_MOTION,
+    IDX_COALESCE_MOUSE,
 
 #ifdef ENABLE_VNC_REPEATER
     IDX_DEST_HOST,
@@ -220,11 +233,13 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     guac_client_data->port = atoi(argv[IDX_PORT]);
     guac_client_data->password = strdup(argv[IDX_PASSWORD]); /* NOTE: freed by libvncclient */
     guac_client_data->default_surface = NULL;
+    guac_client_data->image_cache = NULL;
 
     /* Set flags */
     guac_client_data->remote_cursor = (strcmp(argv[IDX_CURSOR], "remote") == 0);
     guac_client_data->swap_red_blue = (strcmp(argv[IDX_SWAP_RED_BLUE], "true") == 0);
     guac_client_data->read_only     = (strcmp(argv[IDX_READ_ONLY], "true") == 0);
+    guac_client_data->detect_motion = (strcmp(argv[IDX_DETECT_MOTION], "true") == 0);
 
     /* Parse color depth */
     guac_client_data->color_depth = atoi(argv[IDX_COLOR_DEPTH]);
@@ -252,6 +267,38 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     else
         retries_remaining = 0; 
 
+    /* Parse lossy image quality, lossless by default */
+    if (argv[IDX_IMAGE_QUALITY][0] != '\0') {
+
+        guac_client_data->image_quality = atoi(argv[IDX_IMAGE_QUALITY]);
+
+        /* Zero or less is lossless, otherwise limit specified quality to
+         * the range accepted by libjpeg */
+        if (guac_client_data->image_quality < 0)
+            guac_client_data->image_quality = 0;
+        else if (guac_client_data->image_quality > 100)
+            guac_client_data->image_quality = 100;
+
+    }
+    else
+        guac_client_data->image_quality = 0;
+
+    /* Parse PNG speed/size tradeoff */
+    if (strcmp(argv[IDX_PNG_COMPRESSION], "fast") == 0)
+        client->png_compression = GUAC_PNG_COMPRESSION_FAST;
+    else if (strcmp(argv[IDX_PNG_COMPRESSION], "small") == 0)
+        client->png_compression = GUAC_PNG_COMPRESSION_SMALL;
+
+    /* Parse image cache size, disabled by default */
+    guac_client_data->image_cache_size =
+        guac_common_image_cache_parse_size(argv[IDX_IMAGE_CACHE_SIZE]);
+
+    /* Override guacd's mouse coalescing default, if specified */
+    if (strcmp(argv[IDX_COALESCE_MOUSE], "true") == 0)
+        client->coalesce_mouse = 1;
+    else if (strcmp(argv[IDX_COALESCE_MOUSE], "false") == 0)
+        client->coalesce_mouse = 0;
+
 #ifdef ENABLE_VNC_LISTEN
     /* Set reverse-connection flag */
     guac_client_data->reverse_connect =
@@ -345,6 +392,7 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     /* Set handlers */
     client->handle_messages = vnc_guac_client_handle_messages;
     client->free_handler = vnc_guac_client_free_handler;
+    client->join_handler = vnc_guac_client_join_handler;
 
     /* If not read-only, set input handlers and pointer */
     if (guac_client_data->read_only == 0) {
@@ -368,8 +416,29 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     guac_protocol_send_name(client->socket, rfb_client->desktopName);
 
     /* Create default surface */
-    guac_client_data->default_surface = guac_common_surface_alloc(client->socket, GUAC_DEFAULT_LAYER,
+    guac_client_data->default_surface = guac_common_surface_alloc(client, client->socket, GUAC_DEFAULT_LAYER,
                                                                   rfb_client->width, rfb_client->height);
+    guac_client_data->default_surface->lossy_quality = guac_client_data->image_quality;
+
+    /* Cache images sent, if requested */
+    if (guac_client_data->image_cache_size > 0) {
+
+        guac_client_data->image_cache = guac_common_image_cache_alloc(client,
+                guac_client_data->image_cache_size);
+
+        /* Images will simply not be cached if no cache is available */
+        if (guac_client_data->image_cache == NULL)
+            guac_client_log(client, GUAC_LOG_WARNING,
+                    "Unable to allocate image cache");
+
+        guac_client_data->default_surface->image_cache = guac_client_data->image_cache;
+
+    }
+
+    /* Detect scrolled or moved content, if requested */
+    if (guac_client_data->detect_motion)
+        guac_common_surface_set_motion_detection(guac_client_data->default_surface, 1);
+
     return 0;
 
 }
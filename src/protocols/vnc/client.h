@@ -26,6 +26,7 @@
 
 #include "config.h"
 #include "guac_clipboard.h"
+#include "guac_image_cache.h"
 #include "guac_surface.h"
 
 #include <guacamole/audio.h>
@@ -36,11 +37,6 @@
 #include <pulse/pulseaudio.h>
 #endif
 
-/**
- * The maximum duration of a frame in milliseconds.
- */
-#define GUAC_VNC_FRAME_DURATION 40
-
 /**
  * The amount of time to allow per message read within a frame, in
  * milliseconds. If the server is silent for at least this amount of time, the
@@ -119,6 +115,24 @@ typedef struct vnc_guac_client_data {
      */
     int read_only;
 
+    /**
+     * Whether scrolled or moved content should be detected and sent as
+     * copies of what the client already displays.
+     */
+    int detect_motion;
+
+    /**
+     * The JPEG quality to use for photographic, frequently-changing regions of
+     * the display, from 1 to 100, or zero if all updates should be lossless.
+     */
+    int image_quality;
+
+    /**
+     * The maximum amount of client-side memory which may be used to cache
+     * images sent, in bytes, or zero if images should not be cached.
+     */
+    size_t image_cache_size;
+
     /**
      * The VNC host to connect to, if using a repeater.
      */
@@ -186,6 +200,12 @@ typedef struct vnc_guac_client_data {
      */
     guac_common_surface* default_surface;
 
+    /**
+     * The cache of images sent to the client, or NULL if images are not
+     * cached.
+     */
+    guac_common_image_cache* image_cache;
+
 } vnc_guac_client_data;
 
 #endif
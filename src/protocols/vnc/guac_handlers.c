@@ -24,10 +24,13 @@
 
 #include "client.h"
 #include "guac_clipboard.h"
+#include "guac_image_cache.h"
 #include "guac_surface.h"
 
 #include <guacamole/client.h>
+#include <guacamole/pacing.h>
 #include <guacamole/protocol.h>
+#include <guacamole/socket.h>
 #include <guacamole/timestamp.h>
 #include <rfb/rfbclient.h>
 
@@ -35,6 +38,7 @@
 #include "pulse.h"
 #endif
 
+#include <inttypes.h>
 #include <stdlib.h>
 
 int vnc_guac_client_handle_messages(guac_client* client) {
@@ -58,7 +62,8 @@ int vnc_guac_client_handle_messages(guac_client* client) {
 
         /* Calculate time remaining in frame */
         frame_end = guac_timestamp_current();
-        frame_remaining = frame_start + GUAC_VNC_FRAME_DURATION - frame_end;
+        frame_remaining = frame_start
+            + guac_pacing_get_frame_duration(client->pacing) - frame_end;
 
         /* Wait again if frame remaining */
         if (frame_remaining > 0)
@@ -98,6 +103,23 @@ int vnc_guac_client_key_handler(guac_client* client, int keysym, int pressed) {
     return 0;
 }
 
+int vnc_guac_client_join_handler(guac_client* client, guac_socket* socket) {
+
+    vnc_guac_client_data* guac_client_data = (vnc_guac_client_data*) client->data;
+    rfbClient* rfb_client = guac_client_data->rfb_client;
+
+    guac_protocol_send_name(socket, rfb_client->desktopName);
+
+    /* Send cached images before the display, as the display may refer to
+     * them in later updates */
+    if (guac_client_data->image_cache != NULL)
+        guac_common_image_cache_dup(guac_client_data->image_cache, socket);
+
+    guac_common_surface_dup(guac_client_data->default_surface, socket);
+    return 0;
+
+}
+
 int vnc_guac_client_free_handler(guac_client* client) {
 
     vnc_guac_client_data* guac_client_data = (vnc_guac_client_data*) client->data;
@@ -116,9 +138,26 @@ int vnc_guac_client_free_handler(guac_client* client) {
     /* Free clipboard */
     guac_common_clipboard_free(guac_client_data->clipboard);
 
-    /* Free surface */
+    /* Free surface, noting effectiveness of motion detection */
+    if (guac_client_data->default_surface != NULL) {
+        guac_common_surface_motion_stats* motion =
+            &guac_client_data->default_surface->motion_stats;
+        if (guac_client_data->detect_motion)
+            guac_client_log(client, GUAC_LOG_INFO, "Motion detection: %i of "
+                    "%i updates moved (%" PRId64 " pixels).", motion->hits,
+                    motion->candidates, motion->pixels);
+    }
     guac_common_surface_free(guac_client_data->default_surface);
 
+    /* Free image cache, if used */
+    if (guac_client_data->image_cache != NULL) {
+        guac_common_image_cache* cache = guac_client_data->image_cache;
+        guac_client_log(client, GUAC_LOG_INFO, "Image cache: %i hits, "
+                "%i misses, %i evictions.", cache->hits, cache->misses,
+                cache->evictions);
+        guac_common_image_cache_free(cache);
+    }
+
     /* Free generic data struct */
     free(client->data);
 
@@ -24,6 +24,7 @@
 
 #include "buffer.h"
 #include "common.h"
+#include "compression.h"
 
 #include <stdlib.h>
 #include <string.h>
@@ -34,30 +35,16 @@ guac_terminal_buffer* guac_terminal_buffer_alloc(int rows, guac_terminal_char* d
     guac_terminal_buffer* buffer =
         malloc(sizeof(guac_terminal_buffer));
 
-    int i;
-    guac_terminal_buffer_row* row;
-
     /* Init scrollback data */
     buffer->default_character = *default_character;
     buffer->available = rows;
     buffer->top = 0;
     buffer->length = 0;
-    buffer->rows = malloc(sizeof(guac_terminal_buffer_row) *
-            buffer->available);
-
-    /* Init scrollback rows */
-    row = buffer->rows;
-    for (i=0; i<rows; i++) {
+    buffer->workspace = NULL;
+    buffer->workspace_size = 0;
 
-        /* Allocate row  */
-        row->available = 256;
-        row->length = 0;
-        row->characters = malloc(sizeof(guac_terminal_char) * row->available);
-
-        /* Next row */
-        row++;
-
-    }
+    /* Init scrollback rows, allocating characters only when written */
+    buffer->rows = calloc(buffer->available, sizeof(guac_terminal_buffer_row));
 
     return buffer;
 
@@ -71,20 +58,23 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer) {
     /* Free all rows */
     for (i=0; i<buffer->available; i++) {
         free(row->characters);
+        free(row->compressed);
         row++;
     }
 
     /* Free actual buffer */
+    free(buffer->workspace);
     free(buffer->rows);
     free(buffer);
 
 }
 
-guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row, int width) {
-
-    int i;
-    guac_terminal_char* first;
-    guac_terminal_buffer_row* buffer_row;
+/**
+ * Returns the row at the given location, without decompressing or resizing
+ * that row.
+ */
+static guac_terminal_buffer_row* __guac_terminal_buffer_find_row(
+        guac_terminal_buffer* buffer, int row) {
 
     /* Calculate scrollback row index */
     int index = buffer->top + row;
@@ -93,15 +83,79 @@ guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buf
     else if (index >= buffer->available)
         index -= buffer->available;
 
+    return &(buffer->rows[index]);
+
+}
+
+/**
+ * Ensures the workspace of the given buffer is large enough to compress or
+ * decompress a row of the given length, returning that workspace. The
+ * workspace is split in half, with the first half available as the output of
+ * guac_terminal_compress_row(), and the second half available as the
+ * workspace of guac_terminal_compress_row() and
+ * guac_terminal_decompress_row().
+ */
+static unsigned char* __guac_terminal_buffer_get_workspace(
+        guac_terminal_buffer* buffer, int length) {
+
+    int size = guac_terminal_compress_bound(length) * 2;
+
+    /* Expand if necessary */
+    if (size > buffer->workspace_size) {
+        buffer->workspace_size = size;
+        buffer->workspace = realloc(buffer->workspace, size);
+    }
+
+    return buffer->workspace;
+
+}
+
+/**
+ * Restores the characters of the given compressed row.
+ */
+static void __guac_terminal_buffer_decompress_row(guac_terminal_buffer* buffer,
+        guac_terminal_buffer_row* buffer_row) {
+
+    int i;
+    unsigned char* workspace =
+        __guac_terminal_buffer_get_workspace(buffer, buffer_row->length);
+
+    buffer_row->available = buffer_row->length;
+    buffer_row->characters = malloc(sizeof(guac_terminal_char) * buffer_row->available);
+
+    /* Fall back to blank row if data is somehow corrupt */
+    if (guac_terminal_decompress_row(buffer_row->compressed,
+                buffer_row->compressed_length, buffer_row->characters,
+                buffer_row->length, workspace + buffer->workspace_size / 2)) {
+        for (i=0; i<buffer_row->length; i++)
+            buffer_row->characters[i] = buffer->default_character;
+    }
+
+    free(buffer_row->compressed);
+    buffer_row->compressed = NULL;
+    buffer_row->compressed_length = 0;
+
+}
+
+guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row, int width) {
+
+    int i;
+    guac_terminal_char* first;
+
     /* Get row */
-    buffer_row = &(buffer->rows[index]);
+    guac_terminal_buffer_row* buffer_row =
+        __guac_terminal_buffer_find_row(buffer, row);
+
+    /* Restore row if compressed */
+    if (buffer_row->compressed != NULL)
+        __guac_terminal_buffer_decompress_row(buffer, buffer_row);
 
     /* If resizing is needed */
     if (width >= buffer_row->length) {
 
-        /* Expand if necessary */
+        /* Expand if necessary, allocating new rows only as wide as needed */
         if (width > buffer_row->available) {
-            buffer_row->available = width*2;
+            buffer_row->available = buffer_row->characters != NULL ? width*2 : width;
             buffer_row->characters = realloc(buffer_row->characters, sizeof(guac_terminal_char) * buffer_row->available);
         }
 
@@ -119,6 +173,76 @@ guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buf
 
 }
 
+void guac_terminal_buffer_compress_row(guac_terminal_buffer* buffer, int row) {
+
+    int size;
+    unsigned char* workspace;
+    guac_terminal_buffer_row* buffer_row;
+
+    /* Never compress rows within the visible area */
+    if (row >= 0)
+        return;
+
+    /* Ignore rows which are already compressed or are empty */
+    buffer_row = __guac_terminal_buffer_find_row(buffer, row);
+    if (buffer_row->characters == NULL || buffer_row->length == 0)
+        return;
+
+    /* Compress into workspace */
+    workspace = __guac_terminal_buffer_get_workspace(buffer, buffer_row->length);
+    size = guac_terminal_compress_row(buffer_row->characters,
+            buffer_row->length, workspace,
+            workspace + buffer->workspace_size / 2);
+
+    /* Replace characters with compressed copy */
+    buffer_row->compressed = malloc(size);
+    memcpy(buffer_row->compressed, workspace, size);
+    buffer_row->compressed_length = size;
+
+    free(buffer_row->characters);
+    buffer_row->characters = NULL;
+    buffer_row->available = 0;
+
+}
+
+void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int height,
+        int amount) {
+
+    int row;
+
+    /* Advance by scroll amount */
+    buffer->top += amount;
+    if (buffer->top >= buffer->available)
+        buffer->top -= buffer->available;
+
+    buffer->length += amount;
+    if (buffer->length > buffer->available)
+        buffer->length = buffer->available;
+
+    /* Compress rows which have left the visible area */
+    for (row = -amount; row < 0; row++) {
+        if (row >= -height)
+            guac_terminal_buffer_compress_row(buffer, row);
+    }
+
+    /* Empty rows recycled from oldest scrollback */
+    for (row = height - amount; row < height; row++) {
+
+        guac_terminal_buffer_row* buffer_row;
+
+        if (row < 0)
+            continue;
+
+        buffer_row = __guac_terminal_buffer_find_row(buffer, row);
+        free(buffer_row->compressed);
+        buffer_row->compressed = NULL;
+        buffer_row->compressed_length = 0;
+        buffer_row->length = 0;
+
+    }
+
+}
+
 void guac_terminal_buffer_copy_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, int offset) {
 
@@ -212,3 +336,44 @@ void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
 
 }
 
+void guac_terminal_buffer_set_characters(guac_terminal_buffer* buffer, int row,
+        int start_column, const guac_terminal_char* characters, int count) {
+
+    int i, j;
+    int end_column = start_column - 1;
+    bool has_value = false;
+    guac_terminal_char* current;
+    guac_terminal_buffer_row* buffer_row;
+
+    /* Determine extent of characters */
+    for (i = 0; i < count; i++)
+        end_column += characters[i].width;
+
+    /* Get and expand row */
+    buffer_row = guac_terminal_buffer_get_row(buffer, row, end_column+1);
+
+    /* Set values */
+    current = &(buffer_row->characters[start_column]);
+    for (i = 0; i < count; i++) {
+
+        const guac_terminal_char* character = &(characters[i]);
+        *(current++) = *character;
+
+        /* Store any required continuation characters */
+        for (j=1; j < character->width; j++) {
+            current->value = GUAC_CHAR_CONTINUATION;
+            current->attributes = character->attributes;
+            current->width = 0; /* Not applicable for GUAC_CHAR_CONTINUATION */
+            current++;
+        }
+
+        if (character->value != 0)
+            has_value = true;
+
+    }
+
+    /* Update length depending on row written */
+    if (has_value && row >= buffer->length)
+        buffer->length = row+1;
+
+}
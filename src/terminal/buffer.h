@@ -29,15 +29,29 @@
 #include "types.h"
 
 /**
- * A single variable-length row of terminal data.
+ * A single variable-length row of terminal data. Rows are allocated only
+ * once written, and rows which have scrolled out of the visible area of the
+ * terminal may be compressed until next retrieved.
  */
 typedef struct guac_terminal_buffer_row {
 
     /**
-     * Array of guac_terminal_char representing the contents of the row.
+     * Array of guac_terminal_char representing the contents of the row, or
+     * NULL if the row has not yet been allocated or is compressed.
      */
     guac_terminal_char* characters;
 
+    /**
+     * The compressed contents of the row, as produced by
+     * guac_terminal_compress_row(), or NULL if the row is not compressed.
+     */
+    unsigned char* compressed;
+
+    /**
+     * The number of bytes of compressed data, if the row is compressed.
+     */
+    int compressed_length;
+
     /**
      * The length of this row in characters. This is the number of initialized
      * characters in the buffer, usually equal to the number of characters
@@ -88,6 +102,16 @@ typedef struct guac_terminal_buffer {
      */
     int available;
 
+    /**
+     * Temporary storage used while compressing and decompressing rows.
+     */
+    unsigned char* workspace;
+
+    /**
+     * The size of the workspace, in bytes.
+     */
+    int workspace_size;
+
 } guac_terminal_buffer;
 
 /**
@@ -103,10 +127,28 @@ void guac_terminal_buffer_free(guac_terminal_buffer* buffer);
 
 /**
  * Returns the row at the given location. The row returned is guaranteed to be at least the given
- * width.
+ * width, and is decompressed if necessary.
  */
 guac_terminal_buffer_row* guac_terminal_buffer_get_row(guac_terminal_buffer* buffer, int row, int width);
 
+/**
+ * Compresses the given row of scrollback, freeing its characters until it is
+ * next retrieved with guac_terminal_buffer_get_row(). Rows within the visible
+ * area of the terminal (row zero and after) are never compressed, and are
+ * left untouched.
+ */
+void guac_terminal_buffer_compress_row(guac_terminal_buffer* buffer, int row);
+
+/**
+ * Scrolls the entire visible area, having the given height in rows, up by the
+ * given number of rows, such that row N becomes row N - amount. Rows scrolled
+ * out of the visible area become part of the scrollback and are compressed.
+ * The rows scrolled into view at the bottom are recycled from the oldest rows
+ * of the scrollback and are left empty.
+ */
+void guac_terminal_buffer_scroll_up(guac_terminal_buffer* buffer, int height,
+        int amount);
+
 /**
  * Copies the given range of columns to a new location, offset from
  * the original by the given number of columns.
@@ -128,5 +170,13 @@ void guac_terminal_buffer_copy_rows(guac_terminal_buffer* buffer,
 void guac_terminal_buffer_set_columns(guac_terminal_buffer* buffer, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets the columns of the given row beginning at the given column to the
+ * given characters, in order, storing continuation characters after each
+ * character spanning multiple columns.
+ */
+void guac_terminal_buffer_set_characters(guac_terminal_buffer* buffer, int row,
+        int start_column, const guac_terminal_char* characters, int count);
+
 #endif
 
@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "compression.h"
+#include "types.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The shortest repeated sequence which will be stored as a match.
+ */
+#define GUAC_TERMINAL_COMPRESSION_MIN_MATCH 4
+
+/**
+ * The greatest distance back at which a repeated sequence may be found.
+ */
+#define GUAC_TERMINAL_COMPRESSION_MAX_OFFSET 0xFFFF
+
+/**
+ * Flags stored within the first byte of each attribute run.
+ */
+#define GUAC_TERMINAL_RUN_BOLD       0x01
+#define GUAC_TERMINAL_RUN_REVERSE    0x02
+#define GUAC_TERMINAL_RUN_CURSOR     0x04
+#define GUAC_TERMINAL_RUN_UNDERSCORE 0x08
+
+/**
+ * The number of bytes within a single attribute run, excluding its length.
+ */
+#define GUAC_TERMINAL_RUN_SIZE 3
+
+/**
+ * The maximum number of bytes within a single variable-length integer.
+ */
+#define GUAC_TERMINAL_VARINT_MAX_SIZE 5
+
+int guac_terminal_compress_bound(int length) {
+
+    /* Worst case is one attribute run per character, plus the value of each
+     * character, plus the overhead of literals which could not be matched */
+    int size = length * (1 + GUAC_TERMINAL_RUN_SIZE
+            + GUAC_TERMINAL_VARINT_MAX_SIZE);
+
+    return size + size / 255 + 16;
+
+}
+
+/**
+ * Writes the given value as a variable-length integer, seven bits at a
+ * time, least significant bits first. Returns the number of bytes written.
+ */
+static int __guac_terminal_write_varint(unsigned char* output,
+        uint32_t value) {
+
+    int length = 0;
+
+    while (value >= 0x80) {
+        output[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+
+    output[length++] = value;
+    return length;
+
+}
+
+/**
+ * Reads a variable-length integer written by __guac_terminal_write_varint(),
+ * returning the number of bytes read, or zero if the integer is incomplete.
+ */
+static int __guac_terminal_read_varint(const unsigned char* input, int size,
+        uint32_t* value) {
+
+    int length = 0;
+    uint32_t result = 0;
+
+    while (length < size && length < GUAC_TERMINAL_VARINT_MAX_SIZE) {
+
+        unsigned char current = input[length];
+        result |= (uint32_t) (current & 0x7F) << (7 * length);
+        length++;
+
+        if (!(current & 0x80)) {
+            *value = result;
+            return length;
+        }
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes the attribute run beginning at the given character, returning the
+ * number of bytes written and storing the number of characters covered by
+ * the run.
+ */
+static int __guac_terminal_write_run(unsigned char* output,
+        const guac_terminal_char* characters, int length, int* run_length) {
+
+    const guac_terminal_attributes* attributes = &(characters[0].attributes);
+    int width = characters[0].width;
+    int count = 1;
+    int size;
+
+    /* Extend run across all characters sharing attributes and width */
+    while (count < length
+            && characters[count].width                  == width
+            && characters[count].attributes.bold        == attributes->bold
+            && characters[count].attributes.reverse     == attributes->reverse
+            && characters[count].attributes.cursor      == attributes->cursor
+            && characters[count].attributes.underscore  == attributes->underscore
+            && characters[count].attributes.foreground  == attributes->foreground
+            && characters[count].attributes.background  == attributes->background)
+        count++;
+
+    size = __guac_terminal_write_varint(output, count);
+
+    output[size++] = (width << 4)
+        | (attributes->bold       ? GUAC_TERMINAL_RUN_BOLD       : 0)
+        | (attributes->reverse    ? GUAC_TERMINAL_RUN_REVERSE    : 0)
+        | (attributes->cursor     ? GUAC_TERMINAL_RUN_CURSOR     : 0)
+        | (attributes->underscore ? GUAC_TERMINAL_RUN_UNDERSCORE : 0);
+
+    output[size++] = attributes->foreground;
+    output[size++] = attributes->background;
+
+    *run_length = count;
+    return size;
+
+}
+
+/**
+ * Reads a single 32-bit value from the given, possibly unaligned, location.
+ */
+static uint32_t __guac_terminal_read32(const unsigned char* input) {
+    uint32_t value;
+    memcpy(&value, input, sizeof(value));
+    return value;
+}
+
+/**
+ * Writes a length which did not fit within the four bits available in a
+ * sequence token, as a series of bytes which are summed, where every byte
+ * but the last is 255.
+ */
+static int __guac_terminal_write_length(unsigned char* output, int length) {
+
+    int size = 0;
+
+    while (length >= 255) {
+        output[size++] = 255;
+        length -= 255;
+    }
+
+    output[size++] = length;
+    return size;
+
+}
+
+/**
+ * Reads a length written by __guac_terminal_write_length(), returning the
+ * number of bytes read, or zero if the length is incomplete.
+ */
+static int __guac_terminal_read_length(const unsigned char* input, int size,
+        int* length) {
+
+    int read = 0;
+
+    while (read < size) {
+
+        unsigned char current = input[read++];
+        *length += current;
+
+        if (current != 255)
+            return read;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Writes a single sequence of literal bytes followed by an optional match,
+ * returning the number of bytes written. If the match length is zero, only
+ * the literals are written.
+ */
+static int __guac_terminal_write_sequence(unsigned char* output,
+        const unsigned char* literals, int literal_length,
+        int offset, int match_length) {
+
+    unsigned char* token = output;
+    int size = 1;
+
+    int match_token = 0;
+    if (match_length != 0)
+        match_token = match_length - GUAC_TERMINAL_COMPRESSION_MIN_MATCH;
+
+    *token = ((literal_length < 15 ? literal_length : 15) << 4)
+           |  (match_token    < 15 ? match_token    : 15);
+
+    /* Store literals */
+    if (literal_length >= 15)
+        size += __guac_terminal_write_length(output + size,
+                literal_length - 15);
+
+    memcpy(output + size, literals, literal_length);
+    size += literal_length;
+
+    /* Store match, if any */
+    if (match_length != 0) {
+
+        output[size++] = offset & 0xFF;
+        output[size++] = offset >> 8;
+
+        if (match_token >= 15)
+            size += __guac_terminal_write_length(output + size,
+                    match_token - 15);
+
+    }
+
+    return size;
+
+}
+
+/**
+ * Compresses the given data, returning the number of bytes written to the
+ * output buffer.
+ */
+static int __guac_terminal_lz_compress(const unsigned char* input, int size,
+        unsigned char* output) {
+
+    int table[1 << GUAC_TERMINAL_COMPRESSION_HASH_BITS];
+
+    int current = 0;
+    int anchor = 0;
+    int written = 0;
+
+    memset(table, 0xFF, sizeof(table));
+
+    while (current + GUAC_TERMINAL_COMPRESSION_MIN_MATCH <= size) {
+
+        uint32_t sequence = __guac_terminal_read32(input + current);
+        int hash = (sequence * 2654435761u)
+            >> (32 - GUAC_TERMINAL_COMPRESSION_HASH_BITS);
+
+        int candidate = table[hash];
+        table[hash] = current;
+
+        /* Store match if the sequence has been seen recently */
+        if (candidate >= 0
+                && current - candidate <= GUAC_TERMINAL_COMPRESSION_MAX_OFFSET
+                && __guac_terminal_read32(input + candidate) == sequence) {
+
+            int match_length = GUAC_TERMINAL_COMPRESSION_MIN_MATCH;
+            while (current + match_length < size
+                    && input[candidate + match_length]
+                        == input[current + match_length])
+                match_length++;
+
+            written += __guac_terminal_write_sequence(output + written,
+                    input + anchor, current - anchor,
+                    current - candidate, match_length);
+
+            current += match_length;
+            anchor = current;
+
+        }
+
+        else
+            current++;
+
+    }
+
+    /* Store any remaining literals */
+    if (anchor < size || written == 0)
+        written += __guac_terminal_write_sequence(output + written,
+                input + anchor, size - anchor, 0, 0);
+
+    return written;
+
+}
+
+/**
+ * Decompresses data compressed with __guac_terminal_lz_compress(), returning
+ * the number of bytes written to the output buffer, or -1 if the data is
+ * invalid.
+ */
+static int __guac_terminal_lz_decompress(const unsigned char* input, int size,
+        unsigned char* output, int available) {
+
+    int current = 0;
+    int written = 0;
+
+    while (current < size) {
+
+        unsigned char token = input[current++];
+        int literal_length = token >> 4;
+        int match_length = token & 0x0F;
+        int offset, read, i;
+
+        /* Copy literals */
+        if (literal_length == 15) {
+            read = __guac_terminal_read_length(input + current,
+                    size - current, &literal_length);
+            if (read == 0)
+                return -1;
+            current += read;
+        }
+
+        if (literal_length > size - current
+                || literal_length > available - written)
+            return -1;
+
+        memcpy(output + written, input + current, literal_length);
+        current += literal_length;
+        written += literal_length;
+
+        /* Final sequence contains only literals */
+        if (current == size)
+            break;
+
+        /* Copy match */
+        if (size - current < 2)
+            return -1;
+
+        offset = input[current] | (input[current + 1] << 8);
+        current += 2;
+
+        if (offset == 0 || offset > written)
+            return -1;
+
+        if (match_length == 15) {
+            read = __guac_terminal_read_length(input + current,
+                    size - current, &match_length);
+            if (read == 0)
+                return -1;
+            current += read;
+        }
+
+        match_length += GUAC_TERMINAL_COMPRESSION_MIN_MATCH;
+        if (match_length > available - written)
+            return -1;
+
+        /* Matches may overlap their own output, so copy byte by byte */
+        for (i = 0; i < match_length; i++) {
+            output[written] = output[written - offset];
+            written++;
+        }
+
+    }
+
+    return written;
+
+}
+
+int guac_terminal_compress_row(const guac_terminal_char* characters,
+        int length, unsigned char* output, unsigned char* workspace) {
+
+    int i;
+    int size = 0;
+
+    /* Store attribute runs */
+    for (i = 0; i < length;) {
+        int run_length;
+        size += __guac_terminal_write_run(workspace + size,
+                characters + i, length - i, &run_length);
+        i += run_length;
+    }
+
+    /* Store values, offset such that GUAC_CHAR_CONTINUATION is zero */
+    for (i = 0; i < length; i++)
+        size += __guac_terminal_write_varint(workspace + size,
+                (uint32_t) characters[i].value + 1);
+
+    return __guac_terminal_lz_compress(workspace, size, output);
+
+}
+
+int guac_terminal_decompress_row(const unsigned char* input, int size,
+        guac_terminal_char* characters, int length, unsigned char* workspace) {
+
+    int i, read;
+    int current = 0;
+
+    /* Restore stored runs and values */
+    size = __guac_terminal_lz_decompress(input, size, workspace,
+            guac_terminal_compress_bound(length));
+    if (size < 0)
+        return 1;
+
+    /* Apply attribute runs */
+    for (i = 0; i < length;) {
+
+        uint32_t run_length;
+        guac_terminal_char character;
+        unsigned char flags;
+
+        read = __guac_terminal_read_varint(workspace + current,
+                size - current, &run_length);
+        if (read == 0 || size - current - read < GUAC_TERMINAL_RUN_SIZE
+                || run_length == 0 || run_length > (uint32_t) (length - i))
+            return 1;
+
+        current += read;
+        flags = workspace[current++];
+
+        character.value = 0;
+        character.width = flags >> 4;
+        character.attributes.bold       = flags & GUAC_TERMINAL_RUN_BOLD;
+        character.attributes.reverse    = flags & GUAC_TERMINAL_RUN_REVERSE;
+        character.attributes.cursor     = flags & GUAC_TERMINAL_RUN_CURSOR;
+        character.attributes.underscore = flags & GUAC_TERMINAL_RUN_UNDERSCORE;
+        character.attributes.foreground = workspace[current++];
+        character.attributes.background = workspace[current++];
+
+        while (run_length-- > 0)
+            characters[i++] = character;
+
+    }
+
+    /* Apply values */
+    for (i = 0; i < length; i++) {
+
+        uint32_t value;
+
+        read = __guac_terminal_read_varint(workspace + current,
+                size - current, &value);
+        if (read == 0)
+            return 1;
+
+        current += read;
+        characters[i].value = (int32_t) (value - 1);
+
+    }
+
+    return current != size;
+
+}
+
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_TERMINAL_COMPRESSION_H
+#define _GUAC_TERMINAL_COMPRESSION_H
+
+#include "config.h"
+
+#include "types.h"
+
+/**
+ * The number of bits in each hash used to locate repeated data while
+ * compressing a row.
+ */
+#define GUAC_TERMINAL_COMPRESSION_HASH_BITS 12
+
+/**
+ * Returns the number of bytes required both for the output of
+ * guac_terminal_compress_row() and for the workspace used by
+ * guac_terminal_compress_row() and guac_terminal_decompress_row(), for a row
+ * of the given length.
+ *
+ * @param length The number of characters in the row.
+ * @return The number of bytes required to compress or decompress the row.
+ */
+int guac_terminal_compress_bound(int length);
+
+/**
+ * Compresses the given row of characters. The attributes and widths of the
+ * characters are stored as runs, with the character values stored
+ * separately, and the result is then compressed using an LZ77 encoding
+ * similar to that of LZ4.
+ *
+ * @param characters The characters to compress.
+ * @param length The number of characters to compress.
+ * @param output The buffer which should receive the compressed row, which
+ *               must be at least guac_terminal_compress_bound() bytes.
+ * @param workspace A temporary buffer of at least
+ *                  guac_terminal_compress_bound() bytes.
+ * @return The number of bytes written to the output buffer.
+ */
+int guac_terminal_compress_row(const guac_terminal_char* characters,
+        int length, unsigned char* output, unsigned char* workspace);
+
+/**
+ * Decompresses a row which was previously compressed with
+ * guac_terminal_compress_row().
+ *
+ * @param input The compressed row.
+ * @param size The number of bytes of compressed data.
+ * @param characters The buffer which should receive the decompressed
+ *                   characters.
+ * @param length The number of characters in the row, as given when the row
+ *               was compressed.
+ * @param workspace A temporary buffer of at least
+ *                  guac_terminal_compress_bound() bytes.
+ * @return Zero if the row was decompressed successfully, non-zero if the
+ *         compressed data is invalid.
+ */
+int guac_terminal_decompress_row(const unsigned char* input, int size,
+        guac_terminal_char* characters, int length, unsigned char* workspace);
+
+#endif
+
@@ -24,10 +24,12 @@
 
 #include "common.h"
 #include "display.h"
+#include "glyph_cache.h"
 #include "guac_surface.h"
 #include "types.h"
 
 #include <math.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <wchar.h>
@@ -111,6 +113,118 @@ static bool __guac_terminal_display_selected_contains(guac_terminal_display* dis
 
 }
 
+/**
+ * Marks the given range of columns within the given row as having pending
+ * operations, adding the row to the list of dirty rows if necessary. The
+ * range must already be within the bounds of the display.
+ */
+static void __guac_terminal_display_mark_dirty(guac_terminal_display* display,
+        int row, int start_column, int end_column) {
+
+    uint64_t* dirty = &(display->dirty[row * display->dirty_stride]);
+    int column = start_column;
+    int i;
+
+    /* Nothing to mark if range is empty */
+    if (start_column > end_column)
+        return;
+
+    /* Add row to list if not already dirty */
+    for (i=0; i<display->dirty_stride; i++) {
+        if (dirty[i] != 0)
+            break;
+    }
+
+    if (i == display->dirty_stride)
+        display->dirty_rows[display->dirty_row_count++] = row;
+
+    /* Set bit for each column, a word at a time */
+    while (column <= end_column) {
+
+        int bit = column % 64;
+        int count = 64 - bit;
+        uint64_t mask;
+
+        if (count > end_column - column + 1)
+            count = end_column - column + 1;
+
+        if (count == 64)
+            mask = ~((uint64_t) 0);
+        else
+            mask = ((((uint64_t) 1) << count) - 1) << bit;
+
+        dirty[column / 64] |= mask;
+        column += count;
+
+    }
+
+}
+
+/**
+ * Compares two row numbers, for sorting the list of dirty rows.
+ */
+static int __guac_terminal_display_compare_rows(const void* a, const void* b) {
+    return *((const int*) a) - *((const int*) b);
+}
+
+/**
+ * Advances to the next column having pending operations, visiting dirty
+ * rows in the order they are listed and the columns of each row in order.
+ * Before the first call, the index should be zero and the column should be
+ * -1.
+ *
+ * @param display The display whose pending operations should be visited.
+ * @param index Pointer to the index of the current row within the list of
+ *              dirty rows, which will be updated.
+ * @param row Pointer to an int which will receive the next row.
+ * @param column Pointer to the current column, which will be updated.
+ * @return true if another column having pending operations was found, false
+ *         if all such columns have been visited.
+ */
+static bool __guac_terminal_display_next_dirty(guac_terminal_display* display,
+        int* index, int* row, int* column) {
+
+    int start = *column + 1;
+
+    while (*index < display->dirty_row_count) {
+
+        const uint64_t* dirty =
+            &(display->dirty[display->dirty_rows[*index] * display->dirty_stride]);
+
+        int word = start / 64;
+
+        /* Search remaining words of row */
+        if (word < display->dirty_stride) {
+
+            uint64_t bits = dirty[word] & (~((uint64_t) 0) << (start % 64));
+
+            for (;;) {
+
+                if (bits != 0) {
+                    *row = display->dirty_rows[*index];
+                    *column = word * 64 + __builtin_ctzll(bits);
+                    return true;
+                }
+
+                if (++word == display->dirty_stride)
+                    break;
+
+                bits = dirty[word];
+
+            }
+
+        }
+
+        /* Continue with next dirty row */
+        (*index)++;
+        start = 0;
+
+    }
+
+    return false;
+
+}
+
 /* Maps any codepoint onto a number between 0 and 511 inclusive */
 int __guac_terminal_hash_codepoint(int codepoint) {
 
@@ -154,17 +268,18 @@ int __guac_terminal_set_colors(guac_terminal_display* display,
 }
 
 /**
- * Sends the given character to the terminal at the given row and column,
- * rendering the character immediately. This bypasses the guac_terminal_display
- * mechanism and is intended for flushing of updates only.
+ * Renders the given character into the region of the atlas of the glyph
+ * cache claimed by the given glyph, using the current glyph colors of the
+ * display.
  */
-int __guac_terminal_set(guac_terminal_display* display, int row, int col, int codepoint) {
-
-    int width;
+static void __guac_terminal_render_glyph(guac_terminal_display* display,
+        guac_terminal_glyph* glyph, int codepoint) {
 
     int bytes;
     char utf8[4];
 
+    guac_terminal_glyph_cache* cache = display->glyph_cache;
+
     /* Use foreground color */
     const guac_terminal_color* color =
         &guac_terminal_palette[display->glyph_foreground];
@@ -173,7 +288,6 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     const guac_terminal_color* background =
         &guac_terminal_palette[display->glyph_background];
 
-    cairo_surface_t* surface;
     cairo_t* cairo;
     int surface_width, surface_height;
    
@@ -181,28 +295,20 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     int layout_width, layout_height;
     int ideal_layout_width, ideal_layout_height;
 
-    /* Calculate width in columns */
-    width = wcwidth(codepoint);
-    if (width < 0)
-        width = 1;
-
-    /* Do nothing if glyph is empty */
-    if (width == 0)
-        return 0;
-
     /* Convert to UTF-8 */
     bytes = guac_terminal_encode_utf8(codepoint, utf8);
 
-    surface_width = width * display->char_width;
+    surface_width = glyph->width * display->char_width;
     surface_height = display->char_height;
 
     ideal_layout_width = surface_width * PANGO_SCALE;
     ideal_layout_height = surface_height * PANGO_SCALE;
 
-    /* Prepare surface */
-    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
-                                         surface_width, surface_height);
-    cairo = cairo_create(surface);
+    /* Restrict drawing to the glyph's region of the atlas */
+    cairo = cairo_create(cache->atlas);
+    cairo_rectangle(cairo, glyph->x, glyph->y, surface_width, surface_height);
+    cairo_clip(cairo);
+    cairo_translate(cairo, glyph->x, glyph->y);
 
     /* Fill background */
     cairo_set_source_rgb(cairo,
@@ -245,21 +351,104 @@ int __guac_terminal_set(guac_terminal_display* display, int row, int col, int co
     cairo_move_to(cairo, 0.0, 0.0);
     pango_cairo_show_layout(cairo, layout);
 
-    /* Draw */
-    guac_common_surface_draw(display->display_surface,
-        display->char_width * col,
-        display->char_height * row,
-        surface);
-
     /* Free all */
     g_object_unref(layout);
     cairo_destroy(cairo);
-    cairo_surface_destroy(surface);
+
+    /* Atlas data must be current before glyph is copied */
+    cairo_surface_flush(cache->atlas);
+
+}
+
+/**
+ * Sends the given character to the terminal at the given row and column,
+ * rendering the character immediately. This bypasses the guac_terminal_display
+ * mechanism and is intended for flushing of updates only. Characters are
+ * rendered only if not already present within the glyph cache, and are
+ * otherwise copied from the cache.
+ */
+int __guac_terminal_set(guac_terminal_display* display, int row, int col, int codepoint) {
+
+    int width;
+    guac_terminal_glyph* glyph;
+
+    /* Calculate width in columns */
+    width = wcwidth(codepoint);
+    if (width < 0)
+        width = 1;
+
+    /* Do nothing if glyph is empty */
+    if (width == 0)
+        return 0;
+
+    /* Characters are never wider than the widest glyph */
+    if (width > GUAC_TERMINAL_MAX_CHAR_WIDTH)
+        width = GUAC_TERMINAL_MAX_CHAR_WIDTH;
+
+    /* Render glyph only if not already cached */
+    glyph = guac_terminal_glyph_cache_lookup(display->glyph_cache, codepoint,
+            display->glyph_foreground, display->glyph_background, width);
+
+    if (glyph == NULL) {
+
+        glyph = guac_terminal_glyph_cache_add(display->glyph_cache, codepoint,
+                display->glyph_foreground, display->glyph_background, width);
+        __guac_terminal_render_glyph(display, glyph, codepoint);
+
+        /* Update client-side copy of atlas, if any */
+        if (display->glyph_surface != NULL) {
+
+            /* Grow copy of atlas along with atlas itself */
+            int atlas_height =
+                cairo_image_surface_get_height(display->glyph_cache->atlas);
+
+            if (display->glyph_surface->height != atlas_height)
+                guac_common_surface_resize(display->glyph_surface,
+                        display->glyph_surface->width, atlas_height);
+
+            guac_terminal_glyph_cache_draw(display->glyph_cache, glyph,
+                    display->glyph_surface, glyph->x, glyph->y);
+
+        }
+
+    }
+
+    /* Copy from glyph buffer if glyph was sent in a previous flush */
+    if (display->glyph_surface != NULL
+            && glyph->epoch != display->glyph_cache->epoch)
+        guac_common_surface_copy_immediate(display->glyph_surface,
+                glyph->x, glyph->y,
+                glyph->width * display->char_width, display->char_height,
+                display->display_surface,
+                display->char_width * col,
+                display->char_height * row);
+
+    /* Otherwise, draw */
+    else
+        guac_terminal_glyph_cache_draw(display->glyph_cache, glyph,
+                display->display_surface,
+                display->char_width * col,
+                display->char_height * row);
 
     return 0;
 
 }
 
+/**
+ * Frees the layers, surface and font description of a display whose
+ * allocation could not be completed, followed by the display itself.
+ */
+static void __guac_terminal_display_free_partial(
+        guac_terminal_display* display) {
+
+    pango_font_description_free(display->font_desc);
+    guac_common_surface_free(display->display_surface);
+    guac_client_free_layer(display->client, display->select_layer);
+    guac_client_free_layer(display->client, display->display_layer);
+    free(display);
+
+}
+
 guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
         const char* font_name, int font_size, int dpi,
         int foreground, int background) {
@@ -276,7 +465,7 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     /* Create default surface */
     display->display_layer = guac_client_alloc_layer(client);
     display->select_layer = guac_client_alloc_layer(client);
-    display->display_surface = guac_common_surface_alloc(client->socket,
+    display->display_surface = guac_common_surface_alloc(client, client->socket,
             display->display_layer, 0, 0);
 
     /* Select layer is a child of the display layer */
@@ -296,6 +485,8 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     font = pango_font_map_load_font(font_map, context, display->font_desc);
     if (font == NULL) {
         guac_client_abort(display->client, GUAC_PROTOCOL_STATUS_SERVER_ERROR, "Unable to get font \"%s\"", font_name);
+        g_object_unref(context);
+        __guac_terminal_display_free_partial(display);
         return NULL;
     }
 
@@ -303,6 +494,9 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
     if (metrics == NULL) {
         guac_client_abort(display->client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
                 "Unable to get font metrics for font \"%s\"", font_name);
+        g_object_unref(font);
+        g_object_unref(context);
+        __guac_terminal_display_free_partial(display);
         return NULL;
     }
 
@@ -316,10 +510,33 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
         (pango_font_metrics_get_descent(metrics)
             + pango_font_metrics_get_ascent(metrics)) / PANGO_SCALE;
 
+    /* Font itself is no longer needed once dimensions are known */
+    pango_font_metrics_unref(metrics);
+    g_object_unref(font);
+    g_object_unref(context);
+
+    /* Allocate cache of rendered glyphs */
+    display->glyph_cache = guac_terminal_glyph_cache_alloc(
+            display->char_width, display->char_height);
+    if (display->glyph_cache == NULL) {
+        guac_client_abort(display->client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
+                "Unable to allocate glyph cache");
+        __guac_terminal_display_free_partial(display);
+        return NULL;
+    }
+
+    /* Glyph buffers disabled by default */
+    display->glyph_buffer = NULL;
+    display->glyph_surface = NULL;
+
     /* Initially empty */
     display->width = 0;
     display->height = 0;
     display->operations = NULL;
+    display->dirty = NULL;
+    display->dirty_stride = 0;
+    display->dirty_rows = NULL;
+    display->dirty_row_count = 0;
 
     /* Initially nothing selected */
     display->text_selected =
@@ -331,14 +548,66 @@ guac_terminal_display* guac_terminal_display_alloc(guac_client* client,
 
 void guac_terminal_display_free(guac_terminal_display* display) {
 
+    guac_terminal_glyph_cache* cache = display->glyph_cache;
+
+    /* Free glyph buffer, if any */
+    guac_terminal_display_set_glyph_buffers(display, false);
+
+    /* Free glyph cache, noting its effectiveness */
+    guac_client_log(display->client, GUAC_LOG_INFO, "Glyph cache: %i hits, "
+            "%i misses, %i evictions.", cache->hits, cache->misses,
+            cache->evictions);
+    guac_terminal_glyph_cache_free(cache);
+
     /* Free operations buffers */
     free(display->operations);
+    free(display->dirty);
+    free(display->dirty_rows);
 
     /* Free display */
     free(display);
 
 }
 
+void guac_terminal_display_set_glyph_buffers(guac_terminal_display* display,
+        bool enabled) {
+
+    guac_terminal_glyph_cache* cache = display->glyph_cache;
+
+    /* Allocate buffer of atlas dimensions if newly enabled */
+    if (enabled && display->glyph_surface == NULL) {
+
+        display->glyph_buffer = guac_client_alloc_buffer(display->client);
+        display->glyph_surface = guac_common_surface_alloc(display->client,
+                display->client->socket, display->glyph_buffer,
+                cairo_image_surface_get_width(cache->atlas),
+                cairo_image_surface_get_height(cache->atlas));
+
+        /* Upload all glyphs cached thus far, starting a new epoch such that
+         * those glyphs are copied from the buffer, which is always flushed
+         * before being copied */
+        guac_common_surface_draw_buffer(display->glyph_surface, 0, 0,
+                cairo_image_surface_get_width(cache->atlas),
+                cairo_image_surface_get_height(cache->atlas),
+                cache->atlas_buffer, cache->atlas_stride, 1);
+
+        cache->epoch++;
+
+    }
+
+    /* Free buffer if newly disabled */
+    else if (!enabled && display->glyph_surface != NULL) {
+
+        guac_common_surface_free(display->glyph_surface);
+        guac_client_free_buffer(display->client, display->glyph_buffer);
+
+        display->glyph_surface = NULL;
+        display->glyph_buffer = NULL;
+
+    }
+
+}
+
 void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, int offset) {
 
@@ -363,6 +632,9 @@ void guac_terminal_display_copy_columns(guac_terminal_display* display, int row,
     memmove(current, src_current,
         (end_column - start_column + 1) * sizeof(guac_terminal_operation));
 
+    __guac_terminal_display_mark_dirty(display, row,
+            start_column + offset, end_column + offset);
+
     /* Update operations */
     for (i=start_column; i<=end_column; i++) {
 
@@ -409,6 +681,11 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
     for (row=start_row; row<=end_row; row++) {
 
         guac_terminal_operation* current = current_row;
+
+        /* Entire destination row now has pending operations */
+        __guac_terminal_display_mark_dirty(display, row + offset,
+                0, display->width - 1);
+
         for (col=0; col<display->width; col++) {
 
             /* If no operation here, set as copy */
@@ -451,6 +728,8 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
 
     current = &(display->operations[row * display->width + start_column]);
 
+    __guac_terminal_display_mark_dirty(display, row, start_column, end_column);
+
     /* For each column in range */
     for (i = start_column; i <= end_column; i += character->width) {
 
@@ -470,11 +749,53 @@ void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
 
 }
 
+void guac_terminal_display_set_characters(guac_terminal_display* display,
+        int row, int start_column, const guac_terminal_char* characters,
+        int count) {
+
+    int i;
+    int column = start_column;
+    guac_terminal_operation* current;
+
+    /* Ignore operations outside display bounds */
+    if (row < 0 || row >= display->height || start_column < 0)
+        return;
+
+    current = &(display->operations[row * display->width + start_column]);
+
+    /* For each character within display bounds */
+    for (i = 0; i < count && column < display->width; i++) {
+
+        /* Set operation */
+        current->type      = GUAC_CHAR_SET;
+        current->character = characters[i];
+
+        /* Next character */
+        current += characters[i].width;
+        column  += characters[i].width;
+
+    }
+
+    if (column > start_column)
+        __guac_terminal_display_mark_dirty(display, row, start_column,
+                guac_terminal_fit_to_range(column - 1, 0, display->width - 1));
+
+    /* If selection visible and committed, clear if update touches selection */
+    if (display->text_selected && display->selection_committed &&
+        __guac_terminal_display_selected_contains(display, row, start_column,
+            row, column - 1))
+            __guac_terminal_display_clear_select(display);
+
+}
+
 void guac_terminal_display_resize(guac_terminal_display* display, int width, int height) {
 
     guac_terminal_operation* current;
     int x, y;
 
+    int old_width = display->width;
+    int old_height = display->height;
+
     /* Fill with background color (index 0) */
     guac_terminal_char fill = {
         .value = 0,
@@ -493,6 +814,14 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
     display->operations = malloc(width * height *
             sizeof(guac_terminal_operation));
 
+    /* Alloc dirty bitmaps and list, initially clean */
+    free(display->dirty);
+    free(display->dirty_rows);
+    display->dirty_stride = (width + 63) / 64;
+    display->dirty = calloc(height * display->dirty_stride, sizeof(uint64_t));
+    display->dirty_rows = malloc(height * sizeof(int));
+    display->dirty_row_count = 0;
+
     /* Init each operation buffer row */
     current = display->operations;
     for (y=0; y<height; y++) {
@@ -520,6 +849,14 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
     display->width = width;
     display->height = height;
 
+    /* Mark newly-cleared areas as dirty */
+    for (y=0; y<height; y++) {
+        if (y >= old_height)
+            __guac_terminal_display_mark_dirty(display, y, 0, width - 1);
+        else if (width > old_width)
+            __guac_terminal_display_mark_dirty(display, y, old_width, width - 1);
+    }
+
     /* Send display size */
     guac_common_surface_resize(
             display->display_surface,
@@ -539,257 +876,253 @@ void guac_terminal_display_resize(guac_terminal_display* display, int width, int
 
 void __guac_terminal_display_flush_copy(guac_terminal_display* display) {
 
-    guac_terminal_operation* current = display->operations;
-    int row, col;
+    int index = 0;
+    int row, col = -1;
 
-    /* For each operation */
-    for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
-
-            /* If operation is a copy operation */
-            if (current->type == GUAC_CHAR_COPY) {
-
-                /* The determined bounds of the rectangle of contiguous
-                 * operations */
-                int detected_right = -1;
-                int detected_bottom = row;
+    /* For each column having pending operations */
+    while (__guac_terminal_display_next_dirty(display, &index, &row, &col)) {
 
-                /* The current row or column within a rectangle */
-                int rect_row, rect_col;
+        guac_terminal_operation* current =
+            &(display->operations[row * display->width + col]);
 
-                /* The dimensions of the rectangle as determined */
-                int rect_width, rect_height;
+        /* If operation is a copy operation */
+        if (current->type == GUAC_CHAR_COPY) {
 
-                /* The expected row and column source for the next copy
-                 * operation (if adjacent to current) */
-                int expected_row, expected_col;
+            /* The determined bounds of the rectangle of contiguous
+             * operations */
+            int detected_right = -1;
+            int detected_bottom = row;
 
-                /* Current row within a subrect */
-                guac_terminal_operation* rect_current_row;
+            /* The current row or column within a rectangle */
+            int rect_row, rect_col;
 
-                /* Determine bounds of rectangle */
-                rect_current_row = current;
-                expected_row = current->row;
-                for (rect_row=row; rect_row<display->height; rect_row++) {
+            /* The dimensions of the rectangle as determined */
+            int rect_width, rect_height;
 
-                    guac_terminal_operation* rect_current = rect_current_row;
-                    expected_col = current->column;
+            /* The expected row and column source for the next copy
+             * operation (if adjacent to current) */
+            int expected_row, expected_col;
 
-                    /* Find width */
-                    for (rect_col=col; rect_col<display->width; rect_col++) {
+            /* Current row within a subrect */
+            guac_terminal_operation* rect_current_row;
 
-                        /* If not identical operation, stop */
-                        if (rect_current->type != GUAC_CHAR_COPY
-                                || rect_current->row != expected_row
-                                || rect_current->column != expected_col)
-                            break;
+            /* Determine bounds of rectangle */
+            rect_current_row = current;
+            expected_row = current->row;
+            for (rect_row=row; rect_row<display->height; rect_row++) {
 
-                        /* Next column */
-                        rect_current++;
-                        expected_col++;
+                guac_terminal_operation* rect_current = rect_current_row;
+                expected_col = current->column;
 
-                    }
+                /* Find width */
+                for (rect_col=col; rect_col<display->width; rect_col++) {
 
-                    /* If too small, cannot append row */
-                    if (rect_col-1 < detected_right)
+                    /* If not identical operation, stop */
+                    if (rect_current->type != GUAC_CHAR_COPY
+                            || rect_current->row != expected_row
+                            || rect_current->column != expected_col)
                         break;
 
-                    /* As row has been accepted, update rect_row of rect */
-                    detected_bottom = rect_row;
+                    /* Next column */
+                    rect_current++;
+                    expected_col++;
 
-                    /* For now, only set rect_col bound if uninitialized */
-                    if (detected_right == -1)
-                        detected_right = rect_col - 1;
+                }
 
-                    /* Next row */
-                    rect_current_row += display->width;
-                    expected_row++;
+                /* If too small, cannot append row */
+                if (rect_col-1 < detected_right)
+                    break;
 
-                }
+                /* As row has been accepted, update rect_row of rect */
+                detected_bottom = rect_row;
+
+                /* For now, only set rect_col bound if uninitialized */
+                if (detected_right == -1)
+                    detected_right = rect_col - 1;
 
-                /* Calculate dimensions */
-                rect_width  = detected_right  - col + 1;
-                rect_height = detected_bottom - row + 1;
+                /* Next row */
+                rect_current_row += display->width;
+                expected_row++;
 
-                /* Mark rect as NOP (as it has been handled) */
-                rect_current_row = current;
-                expected_row = current->row;
-                for (rect_row=0; rect_row<rect_height; rect_row++) {
-                    
-                    guac_terminal_operation* rect_current = rect_current_row;
-                    expected_col = current->column;
+            }
 
-                    for (rect_col=0; rect_col<rect_width; rect_col++) {
+            /* Calculate dimensions */
+            rect_width  = detected_right  - col + 1;
+            rect_height = detected_bottom - row + 1;
 
-                        /* Mark copy operations as NOP */
-                        if (rect_current->type == GUAC_CHAR_COPY
-                                && rect_current->row == expected_row
-                                && rect_current->column == expected_col)
-                            rect_current->type = GUAC_CHAR_NOP;
+            /* Mark rect as NOP (as it has been handled) */
+            rect_current_row = current;
+            expected_row = current->row;
+            for (rect_row=0; rect_row<rect_height; rect_row++) {
+                
+                guac_terminal_operation* rect_current = rect_current_row;
+                expected_col = current->column;
 
-                        /* Next column */
-                        rect_current++;
-                        expected_col++;
+                for (rect_col=0; rect_col<rect_width; rect_col++) {
 
-                    }
+                    /* Mark copy operations as NOP */
+                    if (rect_current->type == GUAC_CHAR_COPY
+                            && rect_current->row == expected_row
+                            && rect_current->column == expected_col)
+                        rect_current->type = GUAC_CHAR_NOP;
 
-                    /* Next row */
-                    rect_current_row += display->width;
-                    expected_row++;
+                    /* Next column */
+                    rect_current++;
+                    expected_col++;
 
                 }
 
-                /* Send copy */
-                guac_common_surface_copy(
+                /* Next row */
+                rect_current_row += display->width;
+                expected_row++;
 
-                        display->display_surface,
-                        current->column * display->char_width,
-                        current->row * display->char_height,
-                        rect_width * display->char_width,
-                        rect_height * display->char_height,
+            }
 
-                        display->display_surface,
-                        col * display->char_width,
-                        row * display->char_height);
+            /* Send copy */
+            guac_common_surface_copy(
 
-            } /* end if copy operation */
+                    display->display_surface,
+                    current->column * display->char_width,
+                    current->row * display->char_height,
+                    rect_width * display->char_width,
+                    rect_height * display->char_height,
 
-            /* Next operation */
-            current++;
+                    display->display_surface,
+                    col * display->char_width,
+                    row * display->char_height);
+
+        } /* end if copy operation */
 
-        }
     }
 
 }
 
 void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
-    guac_terminal_operation* current = display->operations;
-    int row, col;
-
-    /* For each operation */
-    for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
-
-            /* If operation is a cler operation (set to space) */
-            if (current->type == GUAC_CHAR_SET &&
-                    !guac_terminal_has_glyph(current->character.value)) {
+    int index = 0;
+    int row, col = -1;
 
-                /* The determined bounds of the rectangle of contiguous
-                 * operations */
-                int detected_right = -1;
-                int detected_bottom = row;
+    /* For each column having pending operations */
+    while (__guac_terminal_display_next_dirty(display, &index, &row, &col)) {
 
-                /* The current row or column within a rectangle */
-                int rect_row, rect_col;
+        guac_terminal_operation* current =
+            &(display->operations[row * display->width + col]);
 
-                /* The dimensions of the rectangle as determined */
-                int rect_width, rect_height;
+        /* If operation is a cler operation (set to space) */
+        if (current->type == GUAC_CHAR_SET &&
+                !guac_terminal_has_glyph(current->character.value)) {
 
-                /* Color of the rectangle to draw */
-                int color;
-                if (current->character.attributes.reverse != current->character.attributes.cursor)
-                   color = current->character.attributes.foreground;
-                else
-                   color = current->character.attributes.background;
+            /* The determined bounds of the rectangle of contiguous
+             * operations */
+            int detected_right = -1;
+            int detected_bottom = row;
 
-                const guac_terminal_color* guac_color =
-                    &guac_terminal_palette[color];
+            /* The current row or column within a rectangle */
+            int rect_row, rect_col;
 
-                /* Current row within a subrect */
-                guac_terminal_operation* rect_current_row;
+            /* The dimensions of the rectangle as determined */
+            int rect_width, rect_height;
 
-                /* Determine bounds of rectangle */
-                rect_current_row = current;
-                for (rect_row=row; rect_row<display->height; rect_row++) {
+            /* Color of the rectangle to draw */
+            int color;
+            if (current->character.attributes.reverse != current->character.attributes.cursor)
+               color = current->character.attributes.foreground;
+            else
+               color = current->character.attributes.background;
 
-                    guac_terminal_operation* rect_current = rect_current_row;
+            const guac_terminal_color* guac_color =
+                &guac_terminal_palette[color];
 
-                    /* Find width */
-                    for (rect_col=col; rect_col<display->width; rect_col++) {
+            /* Current row within a subrect */
+            guac_terminal_operation* rect_current_row;
 
-                        int joining_color;
-                        if (rect_current->character.attributes.reverse != rect_current->character.attributes.cursor)
-                           joining_color = rect_current->character.attributes.foreground;
-                        else
-                           joining_color = rect_current->character.attributes.background;
+            /* Determine bounds of rectangle */
+            rect_current_row = current;
+            for (rect_row=row; rect_row<display->height; rect_row++) {
 
-                        /* If not identical operation, stop */
-                        if (rect_current->type != GUAC_CHAR_SET
-                                || guac_terminal_has_glyph(rect_current->character.value)
-                                || joining_color != color)
-                            break;
+                guac_terminal_operation* rect_current = rect_current_row;
 
-                        /* Next column */
-                        rect_current++;
+                /* Find width */
+                for (rect_col=col; rect_col<display->width; rect_col++) {
 
-                    }
+                    int joining_color;
+                    if (rect_current->character.attributes.reverse != rect_current->character.attributes.cursor)
+                       joining_color = rect_current->character.attributes.foreground;
+                    else
+                       joining_color = rect_current->character.attributes.background;
 
-                    /* If too small, cannot append row */
-                    if (rect_col-1 < detected_right)
+                    /* If not identical operation, stop */
+                    if (rect_current->type != GUAC_CHAR_SET
+                            || guac_terminal_has_glyph(rect_current->character.value)
+                            || joining_color != color)
                         break;
 
-                    /* As row has been accepted, update rect_row of rect */
-                    detected_bottom = rect_row;
+                    /* Next column */
+                    rect_current++;
 
-                    /* For now, only set rect_col bound if uninitialized */
-                    if (detected_right == -1)
-                        detected_right = rect_col - 1;
+                }
 
-                    /* Next row */
-                    rect_current_row += display->width;
+                /* If too small, cannot append row */
+                if (rect_col-1 < detected_right)
+                    break;
 
-                }
+                /* As row has been accepted, update rect_row of rect */
+                detected_bottom = rect_row;
+
+                /* For now, only set rect_col bound if uninitialized */
+                if (detected_right == -1)
+                    detected_right = rect_col - 1;
 
-                /* Calculate dimensions */
-                rect_width  = detected_right  - col + 1;
-                rect_height = detected_bottom - row + 1;
+                /* Next row */
+                rect_current_row += display->width;
 
-                /* Mark rect as NOP (as it has been handled) */
-                rect_current_row = current;
-                for (rect_row=0; rect_row<rect_height; rect_row++) {
-                    
-                    guac_terminal_operation* rect_current = rect_current_row;
+            }
 
-                    for (rect_col=0; rect_col<rect_width; rect_col++) {
+            /* Calculate dimensions */
+            rect_width  = detected_right  - col + 1;
+            rect_height = detected_bottom - row + 1;
 
-                        int joining_color;
-                        if (rect_current->character.attributes.reverse != rect_current->character.attributes.cursor)
-                           joining_color = rect_current->character.attributes.foreground;
-                        else
-                           joining_color = rect_current->character.attributes.background;
+            /* Mark rect as NOP (as it has been handled) */
+            rect_current_row = current;
+            for (rect_row=0; rect_row<rect_height; rect_row++) {
+                
+                guac_terminal_operation* rect_current = rect_current_row;
 
-                        /* Mark clear operations as NOP */
-                        if (rect_current->type == GUAC_CHAR_SET
-                                && !guac_terminal_has_glyph(rect_current->character.value)
-                                && joining_color == color)
-                            rect_current->type = GUAC_CHAR_NOP;
+                for (rect_col=0; rect_col<rect_width; rect_col++) {
 
-                        /* Next column */
-                        rect_current++;
+                    int joining_color;
+                    if (rect_current->character.attributes.reverse != rect_current->character.attributes.cursor)
+                       joining_color = rect_current->character.attributes.foreground;
+                    else
+                       joining_color = rect_current->character.attributes.background;
 
-                    }
+                    /* Mark clear operations as NOP */
+                    if (rect_current->type == GUAC_CHAR_SET
+                            && !guac_terminal_has_glyph(rect_current->character.value)
+                            && joining_color == color)
+                        rect_current->type = GUAC_CHAR_NOP;
 
-                    /* Next row */
-                    rect_current_row += display->width;
+                    /* Next column */
+                    rect_current++;
 
                 }
 
-                /* Send rect */
-                guac_common_surface_rect(
-                        display->display_surface,
-                        col * display->char_width,
-                        row * display->char_height,
-                        rect_width * display->char_width,
-                        rect_height * display->char_height,
-                        guac_color->red, guac_color->green, guac_color->blue);
+                /* Next row */
+                rect_current_row += display->width;
 
-            } /* end if clear operation */
+            }
 
-            /* Next operation */
-            current++;
+            /* Send rect */
+            guac_common_surface_rect(
+                    display->display_surface,
+                    col * display->char_width,
+                    row * display->char_height,
+                    rect_width * display->char_width,
+                    rect_height * display->char_height,
+                    guac_color->red, guac_color->green, guac_color->blue);
+
+        } /* end if clear operation */
 
-        }
     }
 
 }
@@ -797,49 +1130,67 @@ void __guac_terminal_display_flush_clear(guac_terminal_display* display) {
 
 void __guac_terminal_display_flush_set(guac_terminal_display* display) {
 
-    guac_terminal_operation* current = display->operations;
-    int row, col;
+    int index = 0;
+    int row, col = -1;
 
-    /* For each operation */
-    for (row=0; row<display->height; row++) {
-        for (col=0; col<display->width; col++) {
+    /* For each column having pending operations */
+    while (__guac_terminal_display_next_dirty(display, &index, &row, &col)) {
 
-            /* Perform given operation */
-            if (current->type == GUAC_CHAR_SET) {
+        guac_terminal_operation* current =
+            &(display->operations[row * display->width + col]);
 
-                int codepoint = current->character.value;
+        /* Perform given operation */
+        if (current->type == GUAC_CHAR_SET) {
 
-                /* Use space if no glyph */
-                if (!guac_terminal_has_glyph(codepoint))
-                    codepoint = ' ';
+            int codepoint = current->character.value;
 
-                /* Set attributes */
-                __guac_terminal_set_colors(display,
-                        &(current->character.attributes));
+            /* Use space if no glyph */
+            if (!guac_terminal_has_glyph(codepoint))
+                codepoint = ' ';
 
-                /* Send character */
-                __guac_terminal_set(display, row, col, codepoint);
+            /* Set attributes */
+            __guac_terminal_set_colors(display,
+                    &(current->character.attributes));
 
-                /* Mark operation as handled */
-                current->type = GUAC_CHAR_NOP;
-
-            }
+            /* Send character */
+            __guac_terminal_set(display, row, col, codepoint);
 
-            /* Next operation */
-            current++;
+            /* Mark operation as handled */
+            current->type = GUAC_CHAR_NOP;
 
         }
+
     }
 
 }
 
 void guac_terminal_display_flush(guac_terminal_display* display) {
 
+    int i;
+
+    /* Visit dirty rows from top to bottom, as a full scan would */
+    qsort(display->dirty_rows, display->dirty_row_count, sizeof(int),
+            __guac_terminal_display_compare_rows);
+
     /* Flush operations, copies first, then clears, then sets. */
     __guac_terminal_display_flush_copy(display);
     __guac_terminal_display_flush_clear(display);
     __guac_terminal_display_flush_set(display);
 
+    /* All operations are now handled */
+    for (i=0; i<display->dirty_row_count; i++)
+        memset(&(display->dirty[display->dirty_rows[i] * display->dirty_stride]),
+                0, display->dirty_stride * sizeof(uint64_t));
+
+    display->dirty_row_count = 0;
+
+    /* Send any newly-rendered glyphs, such that they may be copied by
+     * future flushes */
+    if (display->glyph_surface != NULL) {
+        guac_common_surface_flush(display->glyph_surface);
+        display->glyph_cache->epoch++;
+    }
+
     /* Flush surface */
     guac_common_surface_flush(display->display_surface);
 
@@ -26,6 +26,7 @@
 
 #include "config.h"
 
+#include "glyph_cache.h"
 #include "guac_surface.h"
 #include "types.h"
 
@@ -34,11 +35,7 @@
 #include <pango/pangocairo.h>
 
 #include <stdbool.h>
-
-/**
- * The maximum width of any character, in columns.
- */
-#define GUAC_TERMINAL_MAX_CHAR_WIDTH 2
+#include <stdint.h>
 
 /**
  * The available color palette. All integer colors within structures
@@ -114,6 +111,30 @@ typedef struct guac_terminal_display {
      */
     guac_terminal_operation* operations;
 
+    /**
+     * Bitmap of all columns having pending operations, with one bit per
+     * column, stored as dirty_stride consecutive words for each row. A bit
+     * may remain set after its operation is handled, but every pending
+     * operation has its bit set.
+     */
+    uint64_t* dirty;
+
+    /**
+     * The number of words within the dirty bitmap for each row.
+     */
+    int dirty_stride;
+
+    /**
+     * List of all rows having any bit set within the dirty bitmap, in no
+     * particular order until sorted for flushing.
+     */
+    int* dirty_rows;
+
+    /**
+     * The number of rows within the dirty_rows list.
+     */
+    int dirty_row_count;
+
     /**
      * The width of the screen, in characters.
      */
@@ -149,6 +170,25 @@ typedef struct guac_terminal_display {
      */
     int glyph_background;
 
+    /**
+     * Cache of glyphs which have already been rendered, allowing characters
+     * to be drawn without being rendered again.
+     */
+    guac_terminal_glyph_cache* glyph_cache;
+
+    /**
+     * Buffer containing a client-side copy of the atlas of the glyph cache,
+     * or NULL if glyph buffers are disabled.
+     */
+    guac_layer* glyph_buffer;
+
+    /**
+     * The surface backing the glyph buffer, or NULL if glyph buffers are
+     * disabled. While glyph buffers are enabled, characters whose glyphs
+     * have already been sent are drawn with a "copy" from this surface.
+     */
+    guac_common_surface* glyph_surface;
+
     /**
      * The surface containing the actual terminal.
      */
@@ -232,6 +272,23 @@ void guac_terminal_display_copy_rows(guac_terminal_display* display,
 void guac_terminal_display_set_columns(guac_terminal_display* display, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets the columns of the given row beginning at the given column to the
+ * given characters, in order, each occupying as many columns as its width.
+ */
+void guac_terminal_display_set_characters(guac_terminal_display* display,
+        int row, int start_column, const guac_terminal_char* characters,
+        int count);
+
+/**
+ * Enables or disables glyph buffers. While enabled, each rendered glyph is
+ * sent once to an offscreen buffer on the client, and later characters using
+ * the same glyph are drawn by copying from that buffer, rather than being
+ * sent as part of an image.
+ */
+void guac_terminal_display_set_glyph_buffers(guac_terminal_display* display,
+        bool enabled);
+
 /**
  * Resize the terminal to the given dimensions.
  */
@@ -0,0 +1,349 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "glyph_cache.h"
+#include "guac_surface.h"
+#include "types.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+
+/**
+ * Returns the index of the hash bucket which would contain any glyph having
+ * the given codepoint, colors and width.
+ *
+ * @param codepoint The Unicode codepoint of the character.
+ * @param foreground The foreground color, as a palette index.
+ * @param background The background color, as a palette index.
+ * @param width The width of the glyph, in columns.
+ * @return The index of the corresponding hash bucket.
+ */
+static int __guac_terminal_glyph_cache_bucket(int codepoint,
+        int foreground, int background, int width) {
+
+    unsigned int hash = (unsigned int) codepoint * 2654435761u;
+    hash ^= (foreground << 8) | (background << 4) | width;
+
+    return (hash ^ (hash >> 16)) % GUAC_TERMINAL_GLYPH_CACHE_BUCKETS;
+
+}
+
+/**
+ * Removes the given glyph from the recency list of the given pool.
+ *
+ * @param pool The pool containing the glyph.
+ * @param glyph The glyph to remove.
+ */
+static void __guac_terminal_glyph_pool_unlink(guac_terminal_glyph_pool* pool,
+        guac_terminal_glyph* glyph) {
+
+    if (glyph->newer != NULL)
+        glyph->newer->older = glyph->older;
+    else
+        pool->newest = glyph->older;
+
+    if (glyph->older != NULL)
+        glyph->older->newer = glyph->newer;
+    else
+        pool->oldest = glyph->newer;
+
+}
+
+/**
+ * Adds the given glyph to the recency list of the given pool as the most
+ * recently used glyph.
+ *
+ * @param pool The pool containing the glyph.
+ * @param glyph The glyph to add.
+ */
+static void __guac_terminal_glyph_pool_push(guac_terminal_glyph_pool* pool,
+        guac_terminal_glyph* glyph) {
+
+    glyph->newer = NULL;
+    glyph->older = pool->newest;
+
+    if (pool->newest != NULL)
+        pool->newest->newer = glyph;
+    else
+        pool->oldest = glyph;
+
+    pool->newest = glyph;
+
+}
+
+/**
+ * Removes the given glyph from its hash bucket within the given cache.
+ *
+ * @param cache The glyph cache containing the glyph.
+ * @param glyph The glyph to remove.
+ */
+static void __guac_terminal_glyph_cache_unhash(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph) {
+
+    int bucket = __guac_terminal_glyph_cache_bucket(glyph->codepoint,
+            glyph->foreground, glyph->background, glyph->width);
+
+    guac_terminal_glyph** current = &(cache->buckets[bucket]);
+    while (*current != NULL) {
+
+        if (*current == glyph) {
+            *current = glyph->next_in_bucket;
+            break;
+        }
+
+        current = &((*current)->next_in_bucket);
+
+    }
+
+}
+
+/**
+ * Ensures the atlas of the given cache contains at least the given number of
+ * rows, reallocating the atlas and copying its contents if necessary. The
+ * atlas grows by doubling its height, but never beyond the number of rows
+ * needed to hold every glyph of every pool.
+ *
+ * @param cache The glyph cache whose atlas should be grown.
+ * @param rows The number of rows the atlas must contain.
+ * @return Zero if the atlas contains at least the given number of rows,
+ *         non-zero if the atlas could not be grown.
+ */
+static int __guac_terminal_glyph_cache_grow(guac_terminal_glyph_cache* cache,
+        int rows) {
+
+    int width;
+    int max_rows = 0;
+
+    cairo_surface_t* atlas;
+    int atlas_rows = cairo_image_surface_get_height(cache->atlas)
+                   / cache->char_height;
+
+    /* Do nothing if atlas is already large enough */
+    if (rows <= atlas_rows)
+        return 0;
+
+    /* Calculate number of rows needed to hold all glyphs */
+    for (width = 1; width <= GUAC_TERMINAL_MAX_CHAR_WIDTH; width++) {
+        int per_row = GUAC_TERMINAL_GLYPH_CACHE_ATLAS_COLUMNS / width;
+        max_rows += (cache->pools[width - 1].size + per_row - 1) / per_row;
+    }
+
+    if (rows > max_rows)
+        return 1;
+
+    /* Double height of atlas, within bounds */
+    atlas_rows *= 2;
+    if (atlas_rows < rows)
+        atlas_rows = rows;
+    if (atlas_rows > max_rows)
+        atlas_rows = max_rows;
+
+    atlas = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            GUAC_TERMINAL_GLYPH_CACHE_ATLAS_COLUMNS * cache->char_width,
+            atlas_rows * cache->char_height);
+
+    if (cairo_surface_status(atlas) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(atlas);
+        return 1;
+    }
+
+    /* Copy existing glyphs, which retain their coordinates */
+    cairo_surface_flush(atlas);
+    memcpy(cairo_image_surface_get_data(atlas), cache->atlas_buffer,
+            cache->atlas_stride * cairo_image_surface_get_height(cache->atlas));
+    cairo_surface_mark_dirty(atlas);
+
+    /* Replace old atlas */
+    cairo_surface_destroy(cache->atlas);
+    cache->atlas = atlas;
+    cache->atlas_buffer = cairo_image_surface_get_data(atlas);
+    cache->atlas_stride = cairo_image_surface_get_stride(atlas);
+
+    return 0;
+
+}
+
+guac_terminal_glyph_cache* guac_terminal_glyph_cache_alloc(int char_width,
+        int char_height) {
+
+    int width;
+
+    guac_terminal_glyph_cache* cache = calloc(1,
+            sizeof(guac_terminal_glyph_cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->char_width = char_width;
+    cache->char_height = char_height;
+
+    /* Allocate one pool per glyph width, each starting with its own row */
+    for (width = 1; width <= GUAC_TERMINAL_MAX_CHAR_WIDTH; width++) {
+
+        guac_terminal_glyph_pool* pool = &(cache->pools[width - 1]);
+
+        pool->size = GUAC_TERMINAL_GLYPH_CACHE_SIZE / width;
+        pool->glyphs = calloc(pool->size, sizeof(guac_terminal_glyph));
+        if (pool->glyphs == NULL) {
+            guac_terminal_glyph_cache_free(cache);
+            return NULL;
+        }
+
+        pool->row = cache->atlas_rows++;
+
+    }
+
+    /* Atlas initially holds only the first row of each pool */
+    cache->atlas = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            GUAC_TERMINAL_GLYPH_CACHE_ATLAS_COLUMNS * char_width,
+            cache->atlas_rows * char_height);
+
+    if (cairo_surface_status(cache->atlas) != CAIRO_STATUS_SUCCESS) {
+        guac_terminal_glyph_cache_free(cache);
+        return NULL;
+    }
+
+    cache->atlas_buffer = cairo_image_surface_get_data(cache->atlas);
+    cache->atlas_stride = cairo_image_surface_get_stride(cache->atlas);
+
+    return cache;
+
+}
+
+void guac_terminal_glyph_cache_free(guac_terminal_glyph_cache* cache) {
+
+    int i;
+
+    for (i = 0; i < GUAC_TERMINAL_MAX_CHAR_WIDTH; i++)
+        free(cache->pools[i].glyphs);
+
+    if (cache->atlas != NULL)
+        cairo_surface_destroy(cache->atlas);
+
+    free(cache);
+
+}
+
+guac_terminal_glyph* guac_terminal_glyph_cache_lookup(
+        guac_terminal_glyph_cache* cache, int codepoint,
+        int foreground, int background, int width) {
+
+    int bucket = __guac_terminal_glyph_cache_bucket(codepoint,
+            foreground, background, width);
+
+    guac_terminal_glyph* current = cache->buckets[bucket];
+    while (current != NULL) {
+
+        /* Mark glyph as most recently used if found */
+        if (current->codepoint     == codepoint
+                && current->foreground == foreground
+                && current->background == background
+                && current->width      == width) {
+
+            guac_terminal_glyph_pool* pool = &(cache->pools[width - 1]);
+            __guac_terminal_glyph_pool_unlink(pool, current);
+            __guac_terminal_glyph_pool_push(pool, current);
+
+            cache->hits++;
+            return current;
+
+        }
+
+        current = current->next_in_bucket;
+
+    }
+
+    cache->misses++;
+    return NULL;
+
+}
+
+guac_terminal_glyph* guac_terminal_glyph_cache_add(
+        guac_terminal_glyph_cache* cache, int codepoint,
+        int foreground, int background, int width) {
+
+    guac_terminal_glyph_pool* pool = &(cache->pools[width - 1]);
+    guac_terminal_glyph* glyph;
+    int bucket;
+
+    int per_row = GUAC_TERMINAL_GLYPH_CACHE_ATLAS_COLUMNS / width;
+    int column = pool->used % per_row;
+
+    /* Start a new row of the atlas once the current row is full */
+    if (pool->used < pool->size && pool->used > 0 && column == 0) {
+
+        /* If the atlas cannot grow, reuse the glyphs already claimed */
+        if (__guac_terminal_glyph_cache_grow(cache, cache->atlas_rows + 1))
+            pool->size = pool->used;
+        else
+            pool->row = cache->atlas_rows++;
+
+    }
+
+    /* Claim unused region of atlas, if any remain */
+    if (pool->used < pool->size) {
+        glyph = &(pool->glyphs[pool->used++]);
+        glyph->width = width;
+        glyph->x = column * width * cache->char_width;
+        glyph->y = pool->row * cache->char_height;
+    }
+
+    /* Otherwise, replace least recently used glyph */
+    else {
+        glyph = pool->oldest;
+        __guac_terminal_glyph_cache_unhash(cache, glyph);
+        __guac_terminal_glyph_pool_unlink(pool, glyph);
+        cache->evictions++;
+    }
+
+    glyph->codepoint = codepoint;
+    glyph->foreground = foreground;
+    glyph->background = background;
+    glyph->epoch = cache->epoch;
+
+    /* Add to hash bucket */
+    bucket = __guac_terminal_glyph_cache_bucket(codepoint,
+            foreground, background, width);
+    glyph->next_in_bucket = cache->buckets[bucket];
+    cache->buckets[bucket] = glyph;
+
+    __guac_terminal_glyph_pool_push(pool, glyph);
+    return glyph;
+
+}
+
+void guac_terminal_glyph_cache_draw(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph, guac_common_surface* surface,
+        int x, int y) {
+
+    unsigned char* buffer = cache->atlas_buffer
+        + glyph->y * cache->atlas_stride + glyph->x * 4;
+
+    guac_common_surface_draw_buffer(surface, x, y,
+            glyph->width * cache->char_width, cache->char_height,
+            buffer, cache->atlas_stride, 1);
+
+}
+
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _GUAC_TERMINAL_GLYPH_CACHE_H
+#define _GUAC_TERMINAL_GLYPH_CACHE_H
+
+#include "config.h"
+
+#include "guac_surface.h"
+#include "types.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * The number of hash buckets within each glyph cache.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_BUCKETS 1024
+
+/**
+ * The number of glyphs one column wide which may be cached at once. Glyphs
+ * spanning several columns are cached separately, with each additional
+ * column halving the number which may be cached.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_SIZE 1024
+
+/**
+ * The width of the atlas holding all cached glyphs, in columns.
+ */
+#define GUAC_TERMINAL_GLYPH_CACHE_ATLAS_COLUMNS 32
+
+typedef struct guac_terminal_glyph guac_terminal_glyph;
+
+/**
+ * A single pre-rendered glyph, stored within a region of the atlas of its
+ * glyph cache which is assigned when the glyph is first claimed and never
+ * changes thereafter. A glyph is rendered complete with its background, and
+ * thus covers its character cells entirely.
+ */
+struct guac_terminal_glyph {
+
+    /**
+     * The Unicode codepoint of the character rendered.
+     */
+    int codepoint;
+
+    /**
+     * The foreground color of the glyph, as a palette index.
+     */
+    int foreground;
+
+    /**
+     * The background color of the glyph, as a palette index.
+     */
+    int background;
+
+    /**
+     * The width of the glyph, in columns.
+     */
+    int width;
+
+    /**
+     * The X coordinate of the upper-left corner of this glyph within the
+     * atlas, in pixels.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of this glyph within the
+     * atlas, in pixels.
+     */
+    int y;
+
+    /**
+     * The epoch of the glyph cache at the time this glyph was added.
+     */
+    int epoch;
+
+    /**
+     * The next glyph within the same hash bucket, or NULL if this is the
+     * last glyph of its bucket.
+     */
+    guac_terminal_glyph* next_in_bucket;
+
+    /**
+     * The next more recently used glyph of the same width, or NULL if this
+     * is the most recently used.
+     */
+    guac_terminal_glyph* newer;
+
+    /**
+     * The next less recently used glyph of the same width, or NULL if this
+     * is the least recently used.
+     */
+    guac_terminal_glyph* older;
+
+};
+
+/**
+ * All glyphs of a glyph cache which span a particular number of columns,
+ * ordered by recency of use. Glyphs of each width occupy their own region of
+ * the atlas, such that replacing one glyph never requires moving another.
+ */
+typedef struct guac_terminal_glyph_pool {
+
+    /**
+     * All glyphs of this pool, whether used or not.
+     */
+    guac_terminal_glyph* glyphs;
+
+    /**
+     * The number of glyphs within this pool.
+     */
+    int size;
+
+    /**
+     * The number of glyphs within this pool which have been used at least
+     * once. Unused glyphs are claimed in order before any glyph is evicted.
+     */
+    int used;
+
+    /**
+     * The row of the atlas containing the most recently claimed glyph of
+     * this pool. Unused glyphs are placed within this row until it is full,
+     * at which point the next unclaimed row of the atlas is used.
+     */
+    int row;
+
+    /**
+     * The most recently used glyph, or NULL if no glyph has been used.
+     */
+    guac_terminal_glyph* newest;
+
+    /**
+     * The least recently used glyph, or NULL if no glyph has been used.
+     */
+    guac_terminal_glyph* oldest;
+
+} guac_terminal_glyph_pool;
+
+/**
+ * A cache of pre-rendered glyphs, packed within a single atlas image and
+ * keyed by codepoint, colors and width. Rendering a character which has
+ * been rendered before with the same colors becomes a copy from the atlas,
+ * rather than a new layout and render of the character. When full, the least
+ * recently used glyph of the required width is replaced.
+ */
+typedef struct guac_terminal_glyph_cache {
+
+    /**
+     * The width of each character cell, in pixels.
+     */
+    int char_width;
+
+    /**
+     * The height of each character cell, in pixels.
+     */
+    int char_height;
+
+    /**
+     * The image containing all cached glyphs. The atlas grows as pools claim
+     * additional rows, and thus may be replaced when a glyph is added.
+     */
+    cairo_surface_t* atlas;
+
+    /**
+     * The underlying buffer of the atlas.
+     */
+    unsigned char* atlas_buffer;
+
+    /**
+     * The size of each row of the atlas, in bytes.
+     */
+    int atlas_stride;
+
+    /**
+     * The number of rows of the atlas which have been claimed by pools, each
+     * row being one character cell tall.
+     */
+    int atlas_rows;
+
+    /**
+     * All cached glyphs, grouped by hash.
+     */
+    guac_terminal_glyph* buckets[GUAC_TERMINAL_GLYPH_CACHE_BUCKETS];
+
+    /**
+     * One pool of glyphs for each possible glyph width, where the pool at
+     * index N contains the glyphs which are N + 1 columns wide.
+     */
+    guac_terminal_glyph_pool pools[GUAC_TERMINAL_MAX_CHAR_WIDTH];
+
+    /**
+     * The current epoch of this cache, which is recorded within each glyph
+     * as it is added. Advancing the epoch allows glyphs added before some
+     * event, such as the glyphs being sent to the client, to be
+     * distinguished from glyphs added afterwards.
+     */
+    int epoch;
+
+    /**
+     * The number of lookups which found a cached glyph.
+     */
+    int hits;
+
+    /**
+     * The number of lookups which did not find a cached glyph.
+     */
+    int misses;
+
+    /**
+     * The number of glyphs replaced to make room for other glyphs.
+     */
+    int evictions;
+
+} guac_terminal_glyph_cache;
+
+/**
+ * Allocates a new, empty glyph cache for characters of the given size.
+ *
+ * @param char_width The width of each character cell, in pixels.
+ * @param char_height The height of each character cell, in pixels.
+ * @return A newly-allocated glyph cache, or NULL if the cache or its atlas
+ *         could not be allocated.
+ */
+guac_terminal_glyph_cache* guac_terminal_glyph_cache_alloc(int char_width,
+        int char_height);
+
+/**
+ * Frees the given glyph cache, including its atlas.
+ *
+ * @param cache The glyph cache to free.
+ */
+void guac_terminal_glyph_cache_free(guac_terminal_glyph_cache* cache);
+
+/**
+ * Searches the given cache for a glyph rendered with the given codepoint,
+ * colors and width, marking that glyph as most recently used if found.
+ *
+ * @param cache The glyph cache to search.
+ * @param codepoint The Unicode codepoint of the character.
+ * @param foreground The foreground color, as a palette index.
+ * @param background The background color, as a palette index.
+ * @param width The width of the glyph, in columns.
+ * @return The matching glyph, or NULL if no such glyph is cached.
+ */
+guac_terminal_glyph* guac_terminal_glyph_cache_lookup(
+        guac_terminal_glyph_cache* cache, int codepoint,
+        int foreground, int background, int width);
+
+/**
+ * Claims a region of the atlas of the given cache for a new glyph having the
+ * given codepoint, colors and width, replacing the least recently used glyph
+ * of that width if necessary. The atlas may be reallocated to make room for
+ * the glyph, invalidating any previous atlas pointer. The claimed region, starting at the glyph's
+ * coordinates and spanning width character cells, must then be rendered by
+ * the caller, after which cairo_surface_flush() must be invoked on the atlas
+ * before the glyph is read.
+ *
+ * @param cache The glyph cache to add the glyph to.
+ * @param codepoint The Unicode codepoint of the character.
+ * @param foreground The foreground color, as a palette index.
+ * @param background The background color, as a palette index.
+ * @param width The width of the glyph, in columns, which must be between 1
+ *              and GUAC_TERMINAL_MAX_CHAR_WIDTH inclusive.
+ * @return The new glyph, now the most recently used glyph of its width.
+ */
+guac_terminal_glyph* guac_terminal_glyph_cache_add(
+        guac_terminal_glyph_cache* cache, int codepoint,
+        int foreground, int background, int width);
+
+/**
+ * Draws the given cached glyph to the given surface at the given
+ * coordinates, copying it directly from the atlas.
+ *
+ * @param cache The glyph cache containing the glyph.
+ * @param glyph The glyph to draw.
+ * @param surface The surface to draw to.
+ * @param x The X coordinate of the upper-left corner of the draw location.
+ * @param y The Y coordinate of the upper-left corner of the draw location.
+ */
+void guac_terminal_glyph_cache_draw(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph, guac_common_surface* surface,
+        int x, int y);
+
+#endif
+
@@ -34,12 +34,14 @@
 #include "terminal_handlers.h"
 #include "types.h"
 
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/select.h>
 #include <sys/time.h>
 #include <unistd.h>
 #include <wchar.h>
@@ -156,6 +158,16 @@ void guac_terminal_reset(guac_terminal* term) {
     term->char_mapping[0] =
     term->char_mapping[1] = NULL;
 
+    /* Abandon any partially-parsed characters or sequences */
+    term->utf8_codepoint = 0;
+    term->utf8_bytes_remaining = 0;
+    term->csi_argc = 0;
+    memset(term->csi_argv, 0, sizeof(term->csi_argv));
+    term->csi_private_mode = 0;
+    term->csi_arg_length = 0;
+    term->osc_operation = 0;
+    term->osc_arg_length = 0;
+
     /* Reset cursor location */
     term->cursor_row = term->visible_cursor_row = term->saved_cursor_row = 0;
     term->cursor_col = term->visible_cursor_col = term->saved_cursor_col = 0;
@@ -251,8 +263,22 @@ guac_terminal* guac_terminal_create(guac_client* client,
         return NULL;
     }
 
-    /* Init terminal lock */
+    /* User input must never block the thread handling it */
+    if (fcntl(term->stdin_pipe_fd[1], F_SETFL,
+                fcntl(term->stdin_pipe_fd[1], F_GETFL) | O_NONBLOCK)) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Unable to make STDIN pipe non-blocking";
+        free(term);
+        return NULL;
+    }
+
+    term->stdin_pending = NULL;
+    term->stdin_pending_length = 0;
+    term->stdin_pending_size = 0;
+
+    /* Init terminal locks */
     pthread_mutex_init(&(term->lock), NULL);
+    pthread_mutex_init(&(term->stdin_lock), NULL);
 
     /* Size display */
     guac_protocol_send_size(term->display->client->socket,
@@ -296,6 +322,10 @@ void guac_terminal_free(guac_terminal* term) {
     close(term->stdin_pipe_fd[1]);
     close(term->stdin_pipe_fd[0]);
 
+    /* Free any input which was never written */
+    free(term->stdin_pending);
+    pthread_mutex_destroy(&(term->stdin_lock));
+
     /* Free display */
     guac_terminal_display_free(term->display);
 
@@ -314,6 +344,12 @@ void guac_terminal_free(guac_terminal* term) {
 
 }
 
+void guac_terminal_set_glyph_buffers(guac_terminal* term, bool enabled) {
+    guac_terminal_lock(term);
+    guac_terminal_display_set_glyph_buffers(term->display, enabled);
+    guac_terminal_unlock(term);
+}
+
 int guac_terminal_render_frame(guac_terminal* terminal) {
 
     guac_client* client = terminal->client;
@@ -321,19 +357,15 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
 
     int ret_val;
     int fd = terminal->stdout_pipe_fd[0];
-    struct timeval timeout;
-    fd_set fds;
 
-    /* Build fd_set */
-    FD_ZERO(&fds);
-    FD_SET(fd, &fds);
+    struct pollfd fds[] = {{
+        .fd      = fd,
+        .events  = POLLIN,
+        .revents = 0,
+    }};
 
-    /* Time to wait */
-    timeout.tv_sec =  1;
-    timeout.tv_usec = 0;
-
-    /* Wait for data to be available */
-    ret_val = select(fd+1, &fds, NULL, NULL, &timeout);
+    /* Wait up to one second for data to be available */
+    ret_val = poll(fds, 1, 1000);
     if (ret_val > 0) {
 
         int bytes_read = 0;
@@ -370,9 +402,163 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
 
 }
 
+/**
+ * Writes as much of the queued user input of the given terminal to its STDIN
+ * pipe as possible without blocking. The STDIN lock of the terminal must be
+ * held.
+ *
+ * @param term The terminal whose queued user input should be written.
+ * @return Zero if all queued input was written or the pipe is full, non-zero
+ *         if an error occurred.
+ */
+static int __guac_terminal_flush_stdin(guac_terminal* term) {
+
+    while (term->stdin_pending_length > 0) {
+
+        int written = write(term->stdin_pipe_fd[1], term->stdin_pending,
+                term->stdin_pending_length);
+
+        if (written < 0) {
+
+            if (errno == EINTR)
+                continue;
+
+            /* Remaining input is written once the pipe is read */
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+
+            return 1;
+
+        }
+
+        /* Shift remaining input to start of queue */
+        term->stdin_pending_length -= written;
+        memmove(term->stdin_pending, term->stdin_pending + written,
+                term->stdin_pending_length);
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Appends the given user input to the queue of input which could not yet be
+ * written to the STDIN pipe of the given terminal. The STDIN lock of the
+ * terminal must be held.
+ *
+ * @param term The terminal whose user input should be queued.
+ * @param data The user input to queue.
+ * @param length The number of bytes of user input to queue.
+ * @return Zero if the input was queued, non-zero if the queue would exceed
+ *         GUAC_TERMINAL_STDIN_PENDING_MAX or could not be allocated.
+ */
+static int __guac_terminal_queue_stdin(guac_terminal* term, const char* data,
+        int length) {
+
+    int required = term->stdin_pending_length + length;
+
+    if (required > GUAC_TERMINAL_STDIN_PENDING_MAX)
+        return 1;
+
+    /* Grow queue as necessary */
+    if (required > term->stdin_pending_size) {
+
+        int size = term->stdin_pending_size > 0
+            ? term->stdin_pending_size : 4096;
+
+        char* pending;
+
+        while (size < required)
+            size *= 2;
+
+        pending = realloc(term->stdin_pending, size);
+        if (pending == NULL)
+            return 1;
+
+        term->stdin_pending = pending;
+        term->stdin_pending_size = size;
+
+    }
+
+    memcpy(term->stdin_pending + term->stdin_pending_length, data, length);
+    term->stdin_pending_length = required;
+
+    return 0;
+
+}
+
+/**
+ * Writes the given user input to the STDIN pipe of the given terminal
+ * without blocking, queuing whatever does not fit until the pipe is read.
+ *
+ * @param term The terminal to write user input to.
+ * @param data The user input to write.
+ * @param length The number of bytes of user input to write.
+ * @return The number of bytes given, or a negative value if the input could
+ *         be neither written nor queued.
+ */
+static int __guac_terminal_write_stdin(guac_terminal* term, const char* data,
+        int length) {
+
+    int result = length;
+
+    pthread_mutex_lock(&(term->stdin_lock));
+
+    /* Input is written directly only if no earlier input is queued */
+    if (__guac_terminal_flush_stdin(term))
+        result = -1;
+
+    else {
+
+        while (term->stdin_pending_length == 0 && length > 0) {
+
+            int written = write(term->stdin_pipe_fd[1], data, length);
+
+            if (written < 0) {
+
+                if (errno == EINTR)
+                    continue;
+
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break;
+
+                result = -1;
+                break;
+
+            }
+
+            data += written;
+            length -= written;
+
+        }
+
+        /* Queue whatever could not be written */
+        if (result >= 0 && length > 0
+                && __guac_terminal_queue_stdin(term, data, length))
+            result = -1;
+
+    }
+
+    pthread_mutex_unlock(&(term->stdin_lock));
+    return result;
+
+}
+
 int guac_terminal_read_stdin(guac_terminal* terminal, char* c, int size) {
+
     int stdin_fd = terminal->stdin_pipe_fd[0];
-    return read(stdin_fd, c, size);
+    int bytes_read = read(stdin_fd, c, size);
+
+    /* Reading makes room for any queued input */
+    if (bytes_read > 0) {
+        pthread_mutex_lock(&(terminal->stdin_lock));
+        __guac_terminal_flush_stdin(terminal);
+        pthread_mutex_unlock(&(terminal->stdin_lock));
+    }
+
+    return bytes_read;
+
 }
 
 int guac_terminal_write_stdout(guac_terminal* terminal, const char* c, int size) {
@@ -507,8 +693,19 @@ void guac_terminal_commit_cursor(guac_terminal* term) {
 int guac_terminal_write(guac_terminal* term, const char* c, int size) {
 
     while (size > 0) {
+
+        /* Set runs of printable characters in bulk where possible */
+        int length = guac_terminal_echo_bulk(term, c, size);
+        if (length > 0) {
+            c += length;
+            size -= length;
+            continue;
+        }
+
+        /* Otherwise, pass individual bytes to current char handler */
         term->char_handler(term, *(c++));
         size--;
+
     }
 
     return 0;
@@ -525,13 +722,7 @@ int guac_terminal_scroll_up(guac_terminal* term,
         guac_terminal_display_copy_rows(term->display, start_row + amount, end_row, -amount);
 
         /* Advance by scroll amount */
-        term->buffer->top += amount;
-        if (term->buffer->top >= term->buffer->available)
-            term->buffer->top -= term->buffer->available;
-
-        term->buffer->length += amount;
-        if (term->buffer->length > term->buffer->available)
-            term->buffer->length = term->buffer->available;
+        guac_terminal_buffer_scroll_up(term->buffer, term->term_height, amount);
 
         /* Reset scrollbar bounds */
         guac_terminal_scrollbar_set_bounds(term->scrollbar, term->term_height - term->buffer->length, 0);
@@ -681,6 +872,9 @@ void guac_terminal_scroll_display_down(guac_terminal* terminal,
 
         }
 
+        /* Row is no longer needed uncompressed */
+        guac_terminal_buffer_compress_row(terminal->buffer, row);
+
         /* Next row */
         dest_row++;
 
@@ -748,6 +942,9 @@ void guac_terminal_scroll_display_up(guac_terminal* terminal,
 
         }
 
+        /* Row is no longer needed uncompressed */
+        guac_terminal_buffer_compress_row(terminal->buffer, row);
+
         /* Next row */
         dest_row++;
 
@@ -789,6 +986,9 @@ static int __guac_terminal_find_char(guac_terminal* terminal, int row, int* colu
 
     int start_column = *column;
 
+    /* Default to one column wide */
+    int width = 1;
+
     guac_terminal_buffer_row* buffer_row = guac_terminal_buffer_get_row(terminal->buffer, row, 0);
     if (start_column < buffer_row->length) {
 
@@ -802,13 +1002,15 @@ static int __guac_terminal_find_char(guac_terminal* terminal, int row, int* colu
         /* Use width, if available */
         if (start_char->value != GUAC_CHAR_CONTINUATION) {
             *column = start_column;
-            return start_char->width;
+            width = start_char->width;
         }
 
     }
 
-    /* Default to one column wide */
-    return 1;
+    /* Row is no longer needed uncompressed */
+    guac_terminal_buffer_compress_row(terminal->buffer, row);
+
+    return width;
 
 }
 
@@ -907,6 +1109,7 @@ void guac_terminal_select_end(guac_terminal* terminal, char* string) {
         if (buffer_row->length - 1 < end_col)
             end_col = buffer_row->length - 1;
         string += __guac_terminal_buffer_string(buffer_row, start_col, end_col, string);
+        guac_terminal_buffer_compress_row(terminal->buffer, start_row);
     }
 
     /* Otherwise, copy multiple rows */
@@ -914,6 +1117,7 @@ void guac_terminal_select_end(guac_terminal* terminal, char* string) {
 
         /* Store first row */
         string += __guac_terminal_buffer_string(buffer_row, start_col, buffer_row->length - 1, string);
+        guac_terminal_buffer_compress_row(terminal->buffer, start_row);
 
         /* Store all middle rows */
         for (row=start_row+1; row<end_row; row++) {
@@ -922,6 +1126,7 @@ void guac_terminal_select_end(guac_terminal* terminal, char* string) {
 
             *(string++) = '\n';
             string += __guac_terminal_buffer_string(buffer_row, 0, buffer_row->length - 1, string);
+            guac_terminal_buffer_compress_row(terminal->buffer, row);
 
         }
 
@@ -932,6 +1137,7 @@ void guac_terminal_select_end(guac_terminal* terminal, char* string) {
 
         *(string++) = '\n';
         string += __guac_terminal_buffer_string(buffer_row, 0, end_col, string);
+        guac_terminal_buffer_compress_row(terminal->buffer, end_row);
 
     }
 
@@ -1002,6 +1208,49 @@ void guac_terminal_set_columns(guac_terminal* terminal, int row,
 
 }
 
+void guac_terminal_set_characters(guac_terminal* terminal, int row,
+        int start_column, const guac_terminal_char* characters, int count) {
+
+    int i;
+    int column = start_column;
+    bool cursor_found = false;
+
+    guac_terminal_display_set_characters(terminal->display,
+            row + terminal->scroll_offset, start_column, characters, count);
+
+    guac_terminal_buffer_set_characters(terminal->buffer, row,
+            start_column, characters, count);
+
+    for (i = 0; i < count; i++) {
+
+        const guac_terminal_char* character = &(characters[i]);
+
+        /* If visible cursor on current character, preserve state */
+        if (!cursor_found && row == terminal->visible_cursor_row
+                && terminal->visible_cursor_col >= column
+                && terminal->visible_cursor_col < column + character->width) {
+
+            /* Create copy of character with cursor attribute set */
+            guac_terminal_char cursor_character = *character;
+            cursor_character.attributes.cursor = true;
+
+            __guac_terminal_set_columns(terminal, row, column,
+                    column + character->width - 1, &cursor_character);
+
+            cursor_found = true;
+
+        }
+
+        column += character->width;
+
+    }
+
+    /* Force breaks around destination region */
+    __guac_terminal_force_break(terminal, row, start_column);
+    __guac_terminal_force_break(terminal, row, column);
+
+}
+
 static void __guac_terminal_redraw_rect(guac_terminal* term, int start_row, int start_col, int end_row, int end_col) {
 
     int row, col;
@@ -1026,6 +1275,9 @@ static void __guac_terminal_redraw_rect(guac_terminal* term, int start_row, int
 
         }
 
+        /* Row is no longer needed uncompressed */
+        guac_terminal_buffer_compress_row(term->buffer, row - term->scroll_offset);
+
     }
 
 }
@@ -1051,6 +1303,8 @@ static void __guac_terminal_resize(guac_terminal* term, int width, int height) {
         /* If the new terminal bottom covers N rows, shift up N rows */
         if (shift_amount > 0) {
 
+            int row;
+
             guac_terminal_display_copy_rows(term->display,
                     shift_amount, term->display->height - 1, -shift_amount);
 
@@ -1059,6 +1313,10 @@ static void __guac_terminal_resize(guac_terminal* term, int width, int height) {
             term->cursor_row  -= shift_amount;
             term->visible_cursor_row  -= shift_amount;
 
+            /* Compress rows shifted into scrollback */
+            for (row = -shift_amount; row < 0; row++)
+                guac_terminal_buffer_compress_row(term->buffer, row);
+
             /* Redraw characters within old region */
             __guac_terminal_redraw_rect(term, height - shift_amount, 0, height-1, width-1);
 
@@ -1208,11 +1466,11 @@ void guac_terminal_unlock(guac_terminal* terminal) {
 }
 
 int guac_terminal_send_data(guac_terminal* term, const char* data, int length) {
-    return guac_terminal_write_all(term->stdin_pipe_fd[1], data, length);
+    return __guac_terminal_write_stdin(term, data, length);
 }
 
 int guac_terminal_send_string(guac_terminal* term, const char* data) {
-    return guac_terminal_write_all(term->stdin_pipe_fd[1], data, strlen(data));
+    return __guac_terminal_write_stdin(term, data, strlen(data));
 }
 
 static int __guac_terminal_send_key(guac_terminal* term, int keysym, int pressed) {
@@ -1485,7 +1743,7 @@ int guac_terminal_sendf(guac_terminal* term, const char* format, ...) {
         return written;
 
     /* Write to STDIN */
-    return guac_terminal_write_all(term->stdin_pipe_fd[1], buffer, written);
+    return __guac_terminal_write_stdin(term, buffer, written);
 
 }
 
@@ -54,6 +54,29 @@
  */
 #define GUAC_TERMINAL_CLIPBOARD_MAX_LENGTH 262144
 
+/**
+ * The maximum number of bytes of user input which may be queued while the
+ * STDIN pipe is full.
+ */
+#define GUAC_TERMINAL_STDIN_PENDING_MAX 1048576
+
+/**
+ * The maximum number of arguments of any CSI sequence.
+ */
+#define GUAC_TERMINAL_MAX_CSI_ARGS 16
+
+/**
+ * The maximum length of any single CSI argument, in bytes, including null
+ * terminator.
+ */
+#define GUAC_TERMINAL_MAX_CSI_ARG_LENGTH 256
+
+/**
+ * The maximum length of the string argument of any OSC sequence, in bytes,
+ * including null terminator.
+ */
+#define GUAC_TERMINAL_MAX_OSC_ARG_LENGTH 2048
+
 typedef struct guac_terminal guac_terminal;
 
 /**
@@ -114,10 +137,33 @@ struct guac_terminal {
     /**
      * Pipe which will be the source of user input. When a terminal code
      * generates synthesized user input, that data will be written to
-     * this pipe.
+     * this pipe. Writes to this pipe never block; input which does not fit
+     * is queued within stdin_pending until read from the pipe makes room.
      */
     int stdin_pipe_fd[2];
 
+    /**
+     * User input which could not yet be written to the STDIN pipe, in the
+     * order it was sent, or NULL if no such input has ever been queued.
+     */
+    char* stdin_pending;
+
+    /**
+     * The number of bytes of user input within stdin_pending.
+     */
+    int stdin_pending_length;
+
+    /**
+     * The number of bytes allocated for stdin_pending.
+     */
+    int stdin_pending_size;
+
+    /**
+     * Lock which guards writes to the STDIN pipe and the contents of
+     * stdin_pending, such that input is written in the order it was sent.
+     */
+    pthread_mutex_t stdin_lock;
+
     /**
      * Graphical representation of the current scroll state.
      */
@@ -198,6 +244,61 @@ struct guac_terminal {
      */
     guac_terminal_char_handler* char_handler;
 
+    /**
+     * The codepoint of the UTF-8 sequence currently being decoded, as
+     * decoded thus far.
+     */
+    int utf8_codepoint;
+
+    /**
+     * The number of bytes of the current UTF-8 sequence which have not yet
+     * been received, or zero if no sequence is being decoded.
+     */
+    int utf8_bytes_remaining;
+
+    /**
+     * The number of arguments of the current CSI sequence parsed thus far.
+     */
+    int csi_argc;
+
+    /**
+     * The arguments of the current CSI sequence parsed thus far.
+     */
+    int csi_argv[GUAC_TERMINAL_MAX_CSI_ARGS];
+
+    /**
+     * The private mode character prefixing the current CSI sequence, or zero
+     * if none has been received.
+     */
+    char csi_private_mode;
+
+    /**
+     * The number of digits of the current CSI argument received thus far.
+     */
+    int csi_arg_length;
+
+    /**
+     * The digits of the current CSI argument received thus far.
+     */
+    char csi_arg[GUAC_TERMINAL_MAX_CSI_ARG_LENGTH];
+
+    /**
+     * The operation number of the current OSC sequence parsed thus far.
+     */
+    int osc_operation;
+
+    /**
+     * The number of bytes of the string argument of the current OSC sequence
+     * received thus far.
+     */
+    int osc_arg_length;
+
+    /**
+     * The string argument of the current OSC sequence received thus far,
+     * such as the name of a file to download.
+     */
+    char osc_arg[GUAC_TERMINAL_MAX_OSC_ARG_LENGTH];
+
     /**
      * The difference between the currently-rendered screen and the current
      * state of the terminal.
@@ -342,6 +443,13 @@ guac_terminal* guac_terminal_create(guac_client* client,
  */
 void guac_terminal_free(guac_terminal* term);
 
+/**
+ * Enables or disables glyph buffers, such that characters whose glyphs have
+ * been sent before are drawn by copying them from an offscreen buffer on the
+ * client rather than being sent again as part of an image.
+ */
+void guac_terminal_set_glyph_buffers(guac_terminal* term, bool enabled);
+
 /**
  * Renders a single frame of terminal data. If data is not yet available,
  * this function will block until data is written.
@@ -352,7 +460,8 @@ int guac_terminal_render_frame(guac_terminal* terminal);
  * Reads from this terminal's STDIN. Input comes from key and mouse events
  * supplied by calls to guac_terminal_send_key() and
  * guac_terminal_send_mouse(). If input is not yet available, this function
- * will block.
+ * will block. Any input which was queued because the STDIN pipe was full is
+ * written to the pipe once this read makes room.
  */
 int guac_terminal_read_stdin(guac_terminal* terminal, char* c, int size);
 
@@ -517,6 +626,15 @@ void guac_terminal_copy_rows(guac_terminal* terminal,
 void guac_terminal_set_columns(guac_terminal* terminal, int row,
         int start_column, int end_column, guac_terminal_char* character);
 
+/**
+ * Sets the columns of the given row beginning at the given column to the
+ * given characters, in order, each occupying as many columns as its width.
+ * This is equivalent to setting each character individually, but updates
+ * the buffer and display only once.
+ */
+void guac_terminal_set_characters(guac_terminal* terminal, int row,
+        int start_column, const guac_terminal_char* characters, int count);
+
 /**
  * Resize the terminal to the given dimensions.
  */
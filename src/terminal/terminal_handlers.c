@@ -29,10 +29,15 @@
 
 #include <guacamole/client.h>
 
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <wchar.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
 /**
  * Response string sent when identification is requested.
  */
@@ -48,61 +53,66 @@
  */
 #define GUAC_TERMINAL_OK          "\x1B[0n"
 
+/**
+ * The maximum number of characters set at once by guac_terminal_echo_bulk().
+ */
+#define GUAC_TERMINAL_MAX_BULK_CHARACTERS 256
+
 int guac_terminal_echo(guac_terminal* term, unsigned char c) {
 
     int width;
-
-    static int bytes_remaining = 0;
-    static int codepoint = 0;
+    int codepoint;
 
     const int* char_mapping = term->char_mapping[term->active_char_set];
 
     /* If using non-Unicode mapping, just map straight bytes */
     if (char_mapping != NULL) {
-        codepoint = c;
-        bytes_remaining = 0;
+        term->utf8_codepoint = c;
+        term->utf8_bytes_remaining = 0;
     }
 
     /* 1-byte UTF-8 codepoint */
     else if ((c & 0x80) == 0x00) {    /* 0xxxxxxx */
-        codepoint = c & 0x7F;
-        bytes_remaining = 0;
+        term->utf8_codepoint = c & 0x7F;
+        term->utf8_bytes_remaining = 0;
     }
 
     /* 2-byte UTF-8 codepoint */
     else if ((c & 0xE0) == 0xC0) { /* 110xxxxx */
-        codepoint = c & 0x1F;
-        bytes_remaining = 1;
+        term->utf8_codepoint = c & 0x1F;
+        term->utf8_bytes_remaining = 1;
     }
 
     /* 3-byte UTF-8 codepoint */
     else if ((c & 0xF0) == 0xE0) { /* 1110xxxx */
-        codepoint = c & 0x0F;
-        bytes_remaining = 2;
+        term->utf8_codepoint = c & 0x0F;
+        term->utf8_bytes_remaining = 2;
     }
 
     /* 4-byte UTF-8 codepoint */
     else if ((c & 0xF8) == 0xF0) { /* 11110xxx */
-        codepoint = c & 0x07;
-        bytes_remaining = 3;
+        term->utf8_codepoint = c & 0x07;
+        term->utf8_bytes_remaining = 3;
     }
 
     /* Continuation of UTF-8 codepoint */
     else if ((c & 0xC0) == 0x80) { /* 10xxxxxx */
-        codepoint = (codepoint << 6) | (c & 0x3F);
-        bytes_remaining--;
+        term->utf8_codepoint = (term->utf8_codepoint << 6) | (c & 0x3F);
+        term->utf8_bytes_remaining--;
     }
 
     /* Unrecognized prefix */
     else {
-        codepoint = '?';
-        bytes_remaining = 0;
+        term->utf8_codepoint = '?';
+        term->utf8_bytes_remaining = 0;
     }
 
     /* If we need more bytes, wait for more bytes */
-    if (bytes_remaining != 0)
+    if (term->utf8_bytes_remaining != 0)
         return 0;
 
+    codepoint = term->utf8_codepoint;
+
     switch (codepoint) {
 
         /* Enquiry */
@@ -225,6 +235,306 @@ int guac_terminal_echo(guac_terminal* term, unsigned char c) {
 
 }
 
+/**
+ * Returns the number of bytes at the start of the given data which are
+ * printable ASCII characters, from 0x20 through 0x7E inclusive, examining
+ * at most the given number of bytes.
+ */
+static int __guac_terminal_ascii_length_generic(const unsigned char* c,
+        int size) {
+
+    int length = 0;
+
+    while (length < size && c[length] >= 0x20 && c[length] < 0x7F)
+        length++;
+
+    return length;
+
+}
+
+#ifdef HAVE_X86_SIMD
+/**
+ * SSE2 implementation of __guac_terminal_ascii_length_generic(), examining
+ * sixteen bytes at a time.
+ */
+__attribute__((target("sse2")))
+static int __guac_terminal_ascii_length_sse2(const unsigned char* c,
+        int size) {
+
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del   = _mm_set1_epi8(0x7F);
+
+    int length = 0;
+
+    while (size - length >= 16) {
+
+        __m128i bytes = _mm_loadu_si128((const __m128i*) (c + length));
+
+        /* Bytes below 0x20 and bytes of 0x80 or above (negative if signed)
+         * both compare less than 0x20 */
+        int stop = _mm_movemask_epi8(_mm_or_si128(
+                    _mm_cmplt_epi8(bytes, space),
+                    _mm_cmpeq_epi8(bytes, del)));
+
+        if (stop != 0)
+            return length + __builtin_ctz(stop);
+
+        length += 16;
+
+    }
+
+    return length + __guac_terminal_ascii_length_generic(c + length,
+            size - length);
+
+}
+#endif
+
+/**
+ * The implementation of __guac_terminal_ascii_length() in use, selected at
+ * runtime based on the capabilities of the CPU.
+ */
+static int (*__guac_terminal_ascii_length_impl)(const unsigned char* c,
+        int size) = __guac_terminal_ascii_length_generic;
+
+/**
+ * Guard ensuring the implementation is selected only once.
+ */
+static pthread_once_t __guac_terminal_ascii_length_selected =
+    PTHREAD_ONCE_INIT;
+
+/**
+ * Selects the fastest implementation supported by the current CPU.
+ */
+static void __guac_terminal_select_ascii_length() {
+
+#ifdef HAVE_X86_SIMD
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+        __guac_terminal_ascii_length_impl = __guac_terminal_ascii_length_sse2;
+#endif
+
+}
+
+/**
+ * Returns the number of bytes at the start of the given data which are
+ * printable ASCII characters, examining at most the given number of bytes.
+ */
+static int __guac_terminal_ascii_length(const unsigned char* c, int size) {
+
+    pthread_once(&__guac_terminal_ascii_length_selected,
+            __guac_terminal_select_ascii_length);
+
+    return __guac_terminal_ascii_length_impl(c, size);
+
+}
+
+/**
+ * Decodes the printable character at the start of the given data, exactly
+ * as guac_terminal_echo() would, returning the number of bytes it occupies.
+ * Zero is returned for anything which guac_terminal_echo() must handle
+ * itself: control characters, C1 controls, DEL, characters which are not
+ * one or two columns wide, and UTF-8 sequences which are incomplete or
+ * malformed.
+ *
+ * @param char_mapping The active character mapping, or NULL if UTF-8 is in
+ *                     use.
+ * @param c The data to decode.
+ * @param size The number of bytes of data available.
+ * @param codepoint Pointer to an int which will receive the decoded
+ *                  codepoint, after mapping.
+ * @param width Pointer to an int which will receive the width of the
+ *              character, in columns.
+ * @return The number of bytes decoded, or zero if the character must be
+ *         handled by guac_terminal_echo().
+ */
+static int __guac_terminal_decode_printable(const int* char_mapping,
+        const unsigned char* c, int size, int* codepoint, int* width) {
+
+    int length, i;
+    int value;
+
+    /* Mapped character sets apply only to printable ASCII here */
+    if (char_mapping != NULL) {
+
+        if (c[0] < 0x20 || c[0] >= 0x7F)
+            return 0;
+
+        value = char_mapping[c[0] - 0x20];
+        length = 1;
+
+    }
+
+    /* 1-byte UTF-8 codepoint */
+    else if (c[0] < 0x80) {
+
+        if (c[0] < 0x20 || c[0] == 0x7F)
+            return 0;
+
+        value = c[0];
+        length = 1;
+
+    }
+
+    /* Multi-byte UTF-8 codepoint */
+    else {
+
+        if ((c[0] & 0xE0) == 0xC0) { /* 110xxxxx */
+            value = c[0] & 0x1F;
+            length = 2;
+        }
+
+        else if ((c[0] & 0xF0) == 0xE0) { /* 1110xxxx */
+            value = c[0] & 0x0F;
+            length = 3;
+        }
+
+        else if ((c[0] & 0xF8) == 0xF0) { /* 11110xxx */
+            value = c[0] & 0x07;
+            length = 4;
+        }
+
+        /* Unrecognized prefix or stray continuation */
+        else
+            return 0;
+
+        /* Leave incomplete sequences to be buffered */
+        if (length > size)
+            return 0;
+
+        for (i = 1; i < length; i++) {
+
+            /* Leave malformed sequences to be handled as such */
+            if ((c[i] & 0xC0) != 0x80)
+                return 0;
+
+            value = (value << 6) | (c[i] & 0x3F);
+
+        }
+
+        /* Control characters, including C1 controls like CSI */
+        if (value < 0x20 || (value >= 0x7F && value <= 0x9F))
+            return 0;
+
+    }
+
+    /* Only characters of known width can be set in bulk */
+    *width = wcwidth(value);
+    if (*width != 1 && *width != 2)
+        return 0;
+
+    *codepoint = value;
+    return length;
+
+}
+
+int guac_terminal_echo_bulk(guac_terminal* term, const char* data, int size) {
+
+    const unsigned char* c = (const unsigned char*) data;
+    const int* char_mapping = term->char_mapping[term->active_char_set];
+
+    guac_terminal_char characters[GUAC_TERMINAL_MAX_BULK_CHARACTERS];
+    int consumed = 0;
+
+    /* Only ordinary output between complete characters can be handled */
+    if (term->char_handler != guac_terminal_echo
+            || term->utf8_bytes_remaining != 0
+            || term->insert_mode)
+        return 0;
+
+    while (consumed < size) {
+
+        int count = 0;
+        int start_column, column;
+        int codepoint, width, length;
+
+        /* Stop at anything which is not a printable character */
+        length = __guac_terminal_decode_printable(char_mapping,
+                c + consumed, size - consumed, &codepoint, &width);
+        if (length == 0)
+            break;
+
+        /* Wrap if necessary */
+        if (term->cursor_col >= term->term_width) {
+            term->cursor_col = 0;
+            term->cursor_row++;
+        }
+
+        /* Scroll up if necessary */
+        if (term->cursor_row > term->scroll_end) {
+            term->cursor_row = term->scroll_end;
+
+            /* Scroll up by one row */
+            guac_terminal_scroll_up(term, term->scroll_start,
+                    term->scroll_end, 1);
+
+        }
+
+        start_column = column = term->cursor_col;
+
+        /* Gather all characters which begin within the current row */
+        for (;;) {
+
+            guac_terminal_char* character = &(characters[count++]);
+            character->value = codepoint;
+            character->attributes = term->current_attributes;
+            character->width = width;
+
+            column += width;
+            consumed += length;
+
+            if (column >= term->term_width || consumed == size
+                    || count == GUAC_TERMINAL_MAX_BULK_CHARACTERS)
+                break;
+
+            /* Copy any run of plain ASCII directly */
+            if (char_mapping == NULL) {
+
+                int available = term->term_width - column;
+                int i, run;
+
+                if (available > GUAC_TERMINAL_MAX_BULK_CHARACTERS - count)
+                    available = GUAC_TERMINAL_MAX_BULK_CHARACTERS - count;
+
+                if (available > size - consumed)
+                    available = size - consumed;
+
+                run = __guac_terminal_ascii_length(c + consumed, available);
+                for (i = 0; i < run; i++) {
+                    character = &(characters[count++]);
+                    character->value = c[consumed++];
+                    character->attributes = term->current_attributes;
+                    character->width = 1;
+                }
+
+                column += run;
+                if (column >= term->term_width || consumed == size
+                        || count == GUAC_TERMINAL_MAX_BULK_CHARACTERS)
+                    break;
+
+            }
+
+            /* Continue only while characters remain printable */
+            length = __guac_terminal_decode_printable(char_mapping,
+                    c + consumed, size - consumed, &codepoint, &width);
+            if (length == 0)
+                break;
+
+        }
+
+        /* Write all gathered characters at once */
+        guac_terminal_set_characters(term, term->cursor_row, start_column,
+                characters, count);
+
+        /* Advance cursor */
+        term->cursor_col = column;
+
+    }
+
+    return consumed;
+
+}
+
 int guac_terminal_escape(guac_terminal* term, unsigned char c) {
 
     switch (c) {
@@ -412,23 +722,12 @@ static bool* __guac_terminal_get_flag(guac_terminal* term, int num, char private
 
 int guac_terminal_csi(guac_terminal* term, unsigned char c) {
 
-    /* CSI function arguments */
-    static int argc = 0;
-    static int argv[16] = {0};
-
-    /* Sequence prefix, if any */
-    static char private_mode_character = 0;
-
-    /* Argument building counter and buffer */
-    static int argv_length = 0;
-    static char argv_buffer[256];
-
     /* Digits get concatenated into argv */
     if (c >= '0' && c <= '9') {
 
         /* Concatenate digit if there is space in buffer */
-        if (argv_length < sizeof(argv_buffer)-1)
-            argv_buffer[argv_length++] = c;
+        if (term->csi_arg_length < sizeof(term->csi_arg)-1)
+            term->csi_arg[term->csi_arg_length++] = c;
 
     }
 
@@ -439,14 +738,14 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
         bool* flag;
 
         /* At most 16 parameters */
-        if (argc < 16) {
+        if (term->csi_argc < GUAC_TERMINAL_MAX_CSI_ARGS) {
 
             /* Finish parameter */
-            argv_buffer[argv_length] = 0;
-            argv[argc++] = atoi(argv_buffer);
+            term->csi_arg[term->csi_arg_length] = 0;
+            term->csi_argv[term->csi_argc++] = atoi(term->csi_arg);
 
             /* Prepare for next parameter */
-            argv_length = 0;
+            term->csi_arg_length = 0;
 
         }
 
@@ -456,7 +755,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* @: Insert characters (scroll right) */
             case '@':
 
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Scroll right by amount */
@@ -475,7 +774,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'A':
 
                 /* Get move amount */
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Move cursor */
@@ -490,7 +789,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'B':
 
                 /* Get move amount */
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Move cursor */
@@ -505,7 +804,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'C':
 
                 /* Get move amount */
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Move cursor */
@@ -519,7 +818,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'D':
 
                 /* Get move amount */
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Move cursor */
@@ -533,7 +832,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'E':
 
                 /* Get move amount */
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Move cursor */
@@ -550,7 +849,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'F':
 
                 /* Get move amount */
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Move cursor */
@@ -566,7 +865,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* G: Move cursor, current row */
             case '`':
             case 'G':
-                col = argv[0]; if (col != 0) col--;
+                col = term->csi_argv[0]; if (col != 0) col--;
                 term->cursor_col = col;
                 break;
 
@@ -574,8 +873,8 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'f':
             case 'H':
 
-                row = argv[0]; if (row != 0) row--;
-                col = argv[1]; if (col != 0) col--;
+                row = term->csi_argv[0]; if (row != 0) row--;
+                col = term->csi_argv[1]; if (col != 0) col--;
 
                 term->cursor_row = row;
                 term->cursor_col = col;
@@ -585,19 +884,19 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'J':
  
                 /* Erase from cursor to end of display */
-                if (argv[0] == 0)
+                if (term->csi_argv[0] == 0)
                     guac_terminal_clear_range(term,
                             term->cursor_row, term->cursor_col,
                             term->term_height-1, term->term_width-1);
                 
                 /* Erase from start to cursor */
-                else if (argv[0] == 1)
+                else if (term->csi_argv[0] == 1)
                     guac_terminal_clear_range(term,
                             0, 0,
                             term->cursor_row, term->cursor_col);
 
                 /* Entire screen */
-                else if (argv[0] == 2 || argv[0] == 3)
+                else if (term->csi_argv[0] == 2 || term->csi_argv[0] == 3)
                     guac_terminal_clear_range(term,
                             0, 0, term->term_height - 1, term->term_width - 1);
 
@@ -607,17 +906,17 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'K':
 
                 /* Erase from cursor to end of line */
-                if (argv[0] == 0)
+                if (term->csi_argv[0] == 0)
                     guac_terminal_clear_columns(term, term->cursor_row,
                             term->cursor_col, term->term_width - 1);
 
                 /* Erase from start to cursor */
-                else if (argv[0] == 1)
+                else if (term->csi_argv[0] == 1)
                     guac_terminal_clear_columns(term, term->cursor_row,
                             0, term->cursor_col);
 
                 /* Erase line */
-                else if (argv[0] == 2)
+                else if (term->csi_argv[0] == 2)
                     guac_terminal_clear_columns(term, term->cursor_row,
                             0, term->term_width - 1);
 
@@ -626,7 +925,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* L: Insert blank lines (scroll down) */
             case 'L':
 
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 guac_terminal_scroll_down(term,
@@ -637,7 +936,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* M: Delete lines (scroll up) */
             case 'M':
 
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 guac_terminal_scroll_up(term,
@@ -648,7 +947,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* P: Delete characters (scroll left) */
             case 'P':
 
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Scroll left by amount */
@@ -666,7 +965,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* X: Erase characters (no scroll) */
             case 'X':
 
-                amount = argv[0];
+                amount = term->csi_argv[0];
                 if (amount == 0) amount = 1;
 
                 /* Clear characters */
@@ -682,13 +981,13 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
 
             /* c: Identify */
             case 'c':
-                if (argv[0] == 0 && private_mode_character == 0)
+                if (term->csi_argv[0] == 0 && term->csi_private_mode == 0)
                     guac_terminal_send_string(term, GUAC_TERMINAL_VT102_ID);
                 break;
 
             /* d: Move cursor, current col */
             case 'd':
-                row = argv[0]; if (row != 0) row--;
+                row = term->csi_argv[0]; if (row != 0) row--;
                 term->cursor_row = row;
                 break;
 
@@ -696,11 +995,11 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'g':
 
                 /* Clear tab at current location */
-                if (argv[0] == 0)
+                if (term->csi_argv[0] == 0)
                     guac_terminal_unset_tab(term, term->cursor_col);
 
                 /* Clear all tabs */
-                else if (argv[0] == 3)
+                else if (term->csi_argv[0] == 3)
                     guac_terminal_clear_tabs(term);
 
                 break;
@@ -709,7 +1008,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'h':
              
                 /* Look up flag and set */ 
-                flag = __guac_terminal_get_flag(term, argv[0], private_mode_character);
+                flag = __guac_terminal_get_flag(term, term->csi_argv[0], term->csi_private_mode);
                 if (flag != NULL)
                     *flag = true;
 
@@ -719,7 +1018,7 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'l':
               
                 /* Look up flag and clear */ 
-                flag = __guac_terminal_get_flag(term, argv[0], private_mode_character);
+                flag = __guac_terminal_get_flag(term, term->csi_argv[0], term->csi_private_mode);
                 if (flag != NULL)
                     *flag = false;
 
@@ -728,9 +1027,9 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             /* m: Set graphics rendition */
             case 'm':
 
-                for (i=0; i<argc; i++) {
+                for (i=0; i<term->csi_argc; i++) {
 
-                    int value = argv[i];
+                    int value = term->csi_argv[i];
 
                     /* Reset attributes */
                     if (value == 0)
@@ -795,11 +1094,11 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'n':
 
                 /* Device status report */
-                if (argv[0] == 5 && private_mode_character == 0)
+                if (term->csi_argv[0] == 5 && term->csi_private_mode == 0)
                     guac_terminal_send_string(term, GUAC_TERMINAL_OK);
 
                 /* Cursor position report */
-                else if (argv[0] == 6 && private_mode_character == 0)
+                else if (term->csi_argv[0] == 6 && term->csi_private_mode == 0)
                     guac_terminal_sendf(term, "\x1B[%i;%iR", term->cursor_row+1, term->cursor_col+1);
 
                 break;
@@ -813,9 +1112,9 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             case 'r':
 
                 /* If parameters given, set region */
-                if (argc == 2) {
-                    term->scroll_start = argv[0]-1;
-                    term->scroll_end   = argv[1]-1;
+                if (term->csi_argc == 2) {
+                    term->scroll_start = term->csi_argv[0]-1;
+                    term->scroll_end   = term->csi_argv[1]-1;
                 }
 
                 /* Otherwise, reset scrolling region */
@@ -852,9 +1151,9 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
                     guac_client_log(term->client, GUAC_LOG_INFO,
                             "Unhandled CSI sequence: %c", c);
 
-                    for (i=0; i<argc; i++)
+                    for (i=0; i<term->csi_argc; i++)
                         guac_client_log(term->client, GUAC_LOG_INFO,
-                                " -> argv[%i] = %i", i, argv[i]);
+                                " -> argv[%i] = %i", i, term->csi_argv[i]);
 
                 }
 
@@ -865,22 +1164,22 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
             term->char_handler = guac_terminal_echo;
 
             /* Reset parameters */
-            for (i=0; i<argc; i++)
-                argv[i] = 0;
+            for (i=0; i<term->csi_argc; i++)
+                term->csi_argv[i] = 0;
 
             /* Reset private mode character */
-            private_mode_character = 0;
+            term->csi_private_mode = 0;
 
             /* Reset argument counters */
-            argc = 0;
-            argv_length = 0;
+            term->csi_argc = 0;
+            term->csi_arg_length = 0;
         }
 
     }
 
     /* Set private mode character if given and unset */
-    else if (c >= 0x3A && c <= 0x3F && private_mode_character == 0)
-        private_mode_character = c;
+    else if (c >= 0x3A && c <= 0x3F && term->csi_private_mode == 0)
+        term->csi_private_mode = c;
 
     return 0;
 
@@ -888,24 +1187,21 @@ int guac_terminal_csi(guac_terminal* term, unsigned char c) {
 
 int guac_terminal_set_directory(guac_terminal* term, unsigned char c) {
 
-    static char filename[2048];
-    static int length = 0;
-
     /* Stop on ECMA-48 ST (String Terminator */
     if (c == 0x9C || c == 0x5C || c == 0x07) {
-        filename[length++] = '\0';
+        term->osc_arg[term->osc_arg_length++] = '\0';
         term->char_handler = guac_terminal_echo;
         if (term->upload_path_handler)
-            term->upload_path_handler(term->client, filename);
+            term->upload_path_handler(term->client, term->osc_arg);
         else
             guac_client_log(term->client, GUAC_LOG_DEBUG,
                     "Cannot set upload path. File is transfer not enabled.");
-        length = 0;
+        term->osc_arg_length = 0;
     }
 
     /* Otherwise, store character */
-    else if (length < sizeof(filename)-1)
-        filename[length++] = c;
+    else if (term->osc_arg_length < sizeof(term->osc_arg)-1)
+        term->osc_arg[term->osc_arg_length++] = c;
 
     return 0;
 
@@ -913,24 +1209,21 @@ int guac_terminal_set_directory(guac_terminal* term, unsigned char c) {
 
 int guac_terminal_download(guac_terminal* term, unsigned char c) {
 
-    static char filename[2048];
-    static int length = 0;
-
     /* Stop on ECMA-48 ST (String Terminator */
     if (c == 0x9C || c == 0x5C || c == 0x07) {
-        filename[length++] = '\0';
+        term->osc_arg[term->osc_arg_length++] = '\0';
         term->char_handler = guac_terminal_echo;
         if (term->file_download_handler)
-            term->file_download_handler(term->client, filename);
+            term->file_download_handler(term->client, term->osc_arg);
         else
             guac_client_log(term->client, GUAC_LOG_DEBUG,
                     "Cannot send file. File is transfer not enabled.");
-        length = 0;
+        term->osc_arg_length = 0;
     }
 
     /* Otherwise, store character */
-    else if (length < sizeof(filename)-1)
-        filename[length++] = c;
+    else if (term->osc_arg_length < sizeof(term->osc_arg)-1)
+        term->osc_arg[term->osc_arg_length++] = c;
 
     return 0;
 
@@ -938,25 +1231,23 @@ int guac_terminal_download(guac_terminal* term, unsigned char c) {
 
 int guac_terminal_osc(guac_terminal* term, unsigned char c) {
 
-    static int operation = 0;
-
     /* If digit, append to operation */
     if (c >= '0' && c <= '9')
-        operation = operation * 10 + c - '0';
+        term->osc_operation = term->osc_operation * 10 + c - '0';
 
     /* If end of parameter, check value */
     else if (c == ';') {
 
         /* Download OSC */
-        if (operation == 482200)
+        if (term->osc_operation == 482200)
             term->char_handler = guac_terminal_download;
 
         /* Set upload directory OSC */
-        else if (operation == 482201)
+        else if (term->osc_operation == 482201)
             term->char_handler = guac_terminal_set_directory;
 
         /* Reset parameter for next OSC */
-        operation = 0;
+        term->osc_operation = 0;
 
     }
 
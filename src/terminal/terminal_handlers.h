@@ -29,6 +29,22 @@
 #include "terminal.h"
 
 int guac_terminal_echo(guac_terminal* term, unsigned char c);
+
+/**
+ * Writes the run of printable characters at the start of the given data to
+ * the terminal, exactly as if each byte had been passed to
+ * guac_terminal_echo(), but setting the characters of each row at once. This
+ * is only possible while the terminal is handling characters with
+ * guac_terminal_echo() and is not in the middle of a UTF-8 sequence.
+ * Processing stops at the first byte which must be handled by the current
+ * char handler, such as a control character or an incomplete UTF-8 sequence.
+ *
+ * @param term The terminal to write to.
+ * @param data The data to write.
+ * @param size The number of bytes of data available.
+ * @return The number of bytes written, which may be zero.
+ */
+int guac_terminal_echo_bulk(guac_terminal* term, const char* data, int size);
 int guac_terminal_escape(guac_terminal* term, unsigned char c);
 int guac_terminal_g0_charset(guac_terminal* term, unsigned char c);
 int guac_terminal_g1_charset(guac_terminal* term, unsigned char c);
@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include <stdbool.h>
+#include <stdint.h>
 
 /**
  * A character which is not truly a character, but rather part of an
@@ -37,6 +38,11 @@
  */
 #define GUAC_CHAR_CONTINUATION -1
 
+/**
+ * The maximum width of any character, in columns.
+ */
+#define GUAC_TERMINAL_MAX_CHAR_WIDTH 2
+
 /**
  * An RGB color, where each component ranges from 0 to 255.
  */
@@ -60,40 +66,42 @@ typedef struct guac_terminal_color {
 } guac_terminal_color;
 
 /**
- * Terminal attributes, as can be applied to a single character.
+ * Terminal attributes, as can be applied to a single character. Attributes
+ * are packed into three bytes, such that a complete guac_terminal_char
+ * occupies only eight.
  */
 typedef struct guac_terminal_attributes {
 
     /**
      * Whether the character should be rendered bold.
      */
-    bool bold;
+    bool bold : 1;
 
     /**
      * Whether the character should be rendered with reversed colors
      * (background becomes foreground and vice-versa).
      */
-    bool reverse;
+    bool reverse : 1;
 
     /**
      * Whether the associated character is highlighted by the cursor.
      */
-    bool cursor;
+    bool cursor : 1;
 
     /**
      * Whether to render the character with underscore.
      */
-    bool underscore;
+    bool underscore : 1;
 
     /**
      * The foreground color of this character, as a palette index.
      */
-    int foreground;
+    uint8_t foreground;
 
     /**
      * The background color of this character, as a palette index.
      */
-    int background;
+    uint8_t background;
 
 } guac_terminal_attributes;
 
@@ -108,7 +116,7 @@ typedef struct guac_terminal_char {
      * GUAC_CHAR_CONTINUATION if this character is part of
      * another character which spans multiple columns.
      */
-    int value;
+    int32_t value;
 
     /**
      * The attributes of the character to display.
@@ -119,7 +127,7 @@ typedef struct guac_terminal_char {
      * The number of columns this character occupies. If the character is
      * GUAC_CHAR_CONTINUATION, this value is undefined and not applicable.
      */
-    int width;
+    int8_t width;
 
 } guac_terminal_char;
 
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <guacamole/socket.h>
+
+/**
+ * The total number of bytes to encode for each payload size measured.
+ */
+#define BENCH_TOTAL_BYTES (256 * 1024 * 1024)
+
+/**
+ * Measures the throughput of guac_socket_write_base64() when writing
+ * payloads of the given size to a socket which discards all output,
+ * printing the result in MB/s of input data.
+ */
+static void bench_base64(guac_socket* socket, const unsigned char* data,
+        int payload_size) {
+
+    long iterations = BENCH_TOTAL_BYTES / payload_size;
+    long i;
+
+    double start = bench_now();
+    double elapsed;
+
+    for (i = 0; i < iterations; i++) {
+        guac_socket_write_base64(socket, data, payload_size);
+        guac_socket_flush_base64(socket);
+    }
+
+    guac_socket_flush(socket);
+    elapsed = bench_now() - start;
+
+    printf("base64 %9i-byte payloads: %10.2f MB/s\n", payload_size,
+            (double) iterations * payload_size / elapsed / (1024 * 1024));
+
+}
+
+int main() {
+
+    const int payload_sizes[] = { 16, 256, 4096, 65536, 1048576 };
+
+    unsigned char* data;
+    int i;
+
+    /* A socket without handlers discards everything written */
+    guac_socket* socket = guac_socket_alloc();
+    if (socket == NULL) {
+        fprintf(stderr, "Unable to allocate socket\n");
+        return 1;
+    }
+
+    /* Use incompressible, arbitrary data */
+    data = malloc(1048576);
+    srand(1);
+    for (i = 0; i < 1048576; i++)
+        data[i] = rand() & 0xFF;
+
+    for (i = 0; i < sizeof(payload_sizes) / sizeof(payload_sizes[0]); i++)
+        bench_base64(socket, data, payload_sizes[i]);
+
+    free(data);
+    guac_socket_free(socket);
+    return 0;
+
+}
+
@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <guacamole/client.h>
+#include <guacamole/instruction.h>
+
+/**
+ * The number of instructions within the synthesized input stream, used if
+ * no recorded stream is provided.
+ */
+#define BENCH_STREAM_INSTRUCTIONS 100000
+
+/**
+ * The number of times the input stream is replayed for each measurement.
+ */
+#define BENCH_PASSES 50
+
+/**
+ * The number of mouse and key events received during replay.
+ */
+static long bench_events = 0;
+
+/**
+ * Mouse handler which simply counts received events.
+ */
+static int bench_mouse_handler(guac_client* client, int x, int y, int mask) {
+    bench_events++;
+    return 0;
+}
+
+/**
+ * Key handler which simply counts received events.
+ */
+static int bench_key_handler(guac_client* client, int keysym, int pressed) {
+    bench_events++;
+    return 0;
+}
+
+/**
+ * Legacy-style handler for the mouse instruction, used when dispatching by
+ * string comparison.
+ */
+static int bench_legacy_mouse(guac_client* client,
+        guac_instruction* instruction) {
+    return client->mouse_handler(client, atoi(instruction->argv[0]),
+            atoi(instruction->argv[1]), atoi(instruction->argv[2]));
+}
+
+/**
+ * Legacy-style handler for the key instruction, used when dispatching by
+ * string comparison.
+ */
+static int bench_legacy_key(guac_client* client,
+        guac_instruction* instruction) {
+    return client->key_handler(client, atoi(instruction->argv[0]),
+            atoi(instruction->argv[1]));
+}
+
+/**
+ * Legacy-style handler for the sync instruction, used when dispatching by
+ * string comparison.
+ */
+static int bench_legacy_sync(guac_client* client,
+        guac_instruction* instruction) {
+    client->last_received_timestamp = atol(instruction->argv[0]);
+    return 0;
+}
+
+/**
+ * Handlers for all opcodes handled by libguac, in the order the original
+ * dispatcher compared against. Opcodes not relevant to the replayed stream
+ * have no handler, but are still compared.
+ */
+static const struct {
+    const char* opcode;
+    int (*handler)(guac_client* client, guac_instruction* instruction);
+} bench_legacy_map[] = {
+    {"sync",       bench_legacy_sync},
+    {"mouse",      bench_legacy_mouse},
+    {"key",        bench_legacy_key},
+    {"clipboard",  NULL},
+    {"disconnect", NULL},
+    {"size",       NULL},
+    {"file",       NULL},
+    {"pipe",       NULL},
+    {"ack",        NULL},
+    {"blob",       NULL},
+    {"end",        NULL},
+    {NULL,         NULL}
+};
+
+/**
+ * Dispatches the given instruction by comparing its opcode against each
+ * known opcode in turn, as guac_client_handle_instruction() once did.
+ */
+static int bench_legacy_dispatch(guac_client* client,
+        guac_instruction* instruction) {
+
+    int i;
+    for (i = 0; bench_legacy_map[i].opcode != NULL; i++) {
+        if (strcmp(instruction->opcode, bench_legacy_map[i].opcode) == 0) {
+            if (bench_legacy_map[i].handler != NULL)
+                return bench_legacy_map[i].handler(client, instruction);
+            return 0;
+        }
+    }
+
+    return 0;
+
+}
+
+/**
+ * Synthesizes an input stream resembling user activity: mostly mouse motion,
+ * with occasional key presses and releases and periodic syncs.
+ */
+static char* bench_synthesize_stream(int* length) {
+
+    int size = BENCH_STREAM_INSTRUCTIONS * 32;
+    char* stream = malloc(size);
+    int i, offset = 0;
+
+    srand(1);
+    for (i = 0; i < BENCH_STREAM_INSTRUCTIONS; i++) {
+
+        char x[16], y[16], key[16];
+        int choice = rand() % 100;
+
+        /* Periodic sync */
+        if (choice < 5)
+            offset += sprintf(stream + offset, "4.sync,10.%010i;", i);
+
+        /* Key press or release */
+        else if (choice < 20) {
+            sprintf(key, "%i", 0x61 + rand() % 26);
+            offset += sprintf(stream + offset, "3.key,%i.%s,1.%i;",
+                    (int) strlen(key), key, rand() % 2);
+        }
+
+        /* Mouse motion */
+        else {
+            sprintf(x, "%i", rand() % 1920);
+            sprintf(y, "%i", rand() % 1080);
+            offset += sprintf(stream + offset, "5.mouse,%i.%s,%i.%s,1.%i;",
+                    (int) strlen(x), x, (int) strlen(y), y, rand() % 2);
+        }
+
+    }
+
+    *length = offset;
+    return stream;
+
+}
+
+/**
+ * Reads the entire contents of the given file, which should contain a
+ * recorded stream of Guacamole instructions.
+ */
+static char* bench_read_stream(const char* path, int* length) {
+
+    FILE* file = fopen(path, "rb");
+    char* stream;
+    long size;
+
+    if (file == NULL)
+        return NULL;
+
+    fseek(file, 0, SEEK_END);
+    size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    stream = malloc(size);
+    if (fread(stream, 1, size, file) != size) {
+        free(stream);
+        fclose(file);
+        return NULL;
+    }
+
+    fclose(file);
+    *length = size;
+    return stream;
+
+}
+
+/**
+ * Parses and dispatches every instruction within the given stream
+ * BENCH_PASSES times, printing the achieved instruction rate.
+ */
+static void bench_replay(const char* name, guac_client* client,
+        const char* stream, int length, int legacy) {
+
+    char* buffer = malloc(length);
+    guac_instruction instruction;
+    long instructions = 0;
+    int pass;
+
+    double start = bench_now();
+    double elapsed;
+
+    bench_events = 0;
+
+    for (pass = 0; pass < BENCH_PASSES; pass++) {
+
+        char* current = buffer;
+        int remaining = length;
+
+        /* Parsing modifies the buffer, so replay from a fresh copy */
+        memcpy(buffer, stream, length);
+
+        while (remaining > 0) {
+
+            /* Parse next instruction */
+            guac_instruction_reset(&instruction);
+            while (instruction.state != GUAC_INSTRUCTION_PARSE_COMPLETE) {
+
+                int parsed = guac_instruction_append(&instruction, current,
+                        remaining);
+
+                if (parsed == 0) {
+                    fprintf(stderr, "Malformed or truncated stream\n");
+                    exit(1);
+                }
+
+                current += parsed;
+                remaining -= parsed;
+
+            }
+
+            /* Dispatch */
+            if (legacy)
+                bench_legacy_dispatch(client, &instruction);
+            else
+                guac_client_handle_instruction(client, &instruction);
+
+            instructions++;
+
+        }
+
+    }
+
+    elapsed = bench_now() - start;
+
+    printf("dispatch %-8s %10.2f M instructions/s (%li events)\n", name,
+            instructions / elapsed / 1000000.0, bench_events);
+
+    free(buffer);
+
+}
+
+int main(int argc, char** argv) {
+
+    guac_client* client;
+    char* stream;
+    int length;
+
+    /* Replay recorded stream if given, otherwise synthesize one */
+    if (argc > 1)
+        stream = bench_read_stream(argv[1], &length);
+    else
+        stream = bench_synthesize_stream(&length);
+
+    if (stream == NULL) {
+        fprintf(stderr, "Unable to read input stream\n");
+        return 1;
+    }
+
+    client = guac_client_alloc();
+    if (client == NULL) {
+        fprintf(stderr, "Unable to allocate client\n");
+        return 1;
+    }
+
+    client->mouse_handler = bench_mouse_handler;
+    client->key_handler = bench_key_handler;
+
+    /* Allow any sync timestamp */
+    client->last_sent_timestamp = 0x7FFFFFFFFFFFFFFFLL;
+
+    bench_replay("strcmp", client, stream, length, 1);
+    bench_replay("opcode", client, stream, length, 0);
+
+    guac_client_free(client);
+    free(stream);
+    return 0;
+
+}
+
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "palette.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+
+/**
+ * The width of each synthesized desktop image, in pixels.
+ */
+#define BENCH_WIDTH 1024
+
+/**
+ * The height of each synthesized desktop image, in pixels.
+ */
+#define BENCH_HEIGHT 768
+
+/**
+ * The number of times the colors of each image are counted per measurement.
+ */
+#define BENCH_PASSES 50
+
+/**
+ * The color census as originally implemented, hashing every pixel, used as
+ * the baseline for comparison. Returns the number of colors, or -1 if there
+ * are more than 256.
+ */
+static int bench_legacy_census(cairo_surface_t* surface) {
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    static guac_palette palette;
+    int x, y;
+
+    memset(&palette, 0, sizeof(palette));
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+
+            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
+            int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+
+            for (;;) {
+
+                guac_palette_entry* entry = &(palette.entries[hash]);
+
+                if (entry->index == 0) {
+                    if (palette.size == 256)
+                        return -1;
+                    entry->index = ++palette.size;
+                    entry->color = color;
+                    break;
+                }
+
+                if (entry->color == color)
+                    break;
+
+                hash = (hash+1) & 0xFFF;
+
+            }
+
+        }
+        data += stride;
+    }
+
+    return palette.size;
+
+}
+
+/**
+ * Counts colors using guac_palette_alloc(), returning the number of colors,
+ * or -1 if there are more than 256.
+ */
+static int bench_census(cairo_surface_t* surface) {
+
+    guac_palette* palette = guac_palette_alloc(surface);
+    int size;
+
+    if (palette == NULL)
+        return -1;
+
+    size = palette->size;
+    guac_palette_free(palette);
+    return size;
+
+}
+
+/**
+ * Fills the given rectangle of the given image with a solid color.
+ */
+static void bench_fill(uint32_t* image, int x, int y, int w, int h,
+        uint32_t color) {
+
+    int i, j;
+
+    for (j = y; j < y + h; j++)
+        for (i = x; i < x + w; i++)
+            image[j * BENCH_WIDTH + i] = color;
+
+}
+
+/**
+ * Draws pseudo-text within the given rectangle of the given image: rows of
+ * short horizontal strokes of the given color, resembling glyphs.
+ */
+static void bench_text(uint32_t* image, int x, int y, int w, int h,
+        uint32_t color) {
+
+    int i, j;
+
+    for (j = y; j < y + h; j++) {
+
+        /* Leave gaps between lines of text */
+        if ((j - y) % 16 >= 11)
+            continue;
+
+        for (i = x; i < x + w; i++) {
+            if ((rand() & 7) < 2)
+                image[j * BENCH_WIDTH + i] = color;
+        }
+
+    }
+
+}
+
+/**
+ * Draws smoothly-varying, noisy content within the given rectangle of the
+ * given image, resembling a photograph.
+ */
+static void bench_photo(uint32_t* image, int x, int y, int w, int h) {
+
+    int i, j;
+
+    for (j = y; j < y + h; j++) {
+        for (i = x; i < x + w; i++) {
+            int r = (i * 255 / BENCH_WIDTH) ^ (rand() & 0x0F);
+            int g = (j * 255 / BENCH_HEIGHT) ^ (rand() & 0x0F);
+            int b = ((i + j) & 0xFF) ^ (rand() & 0x0F);
+            image[j * BENCH_WIDTH + i] = (r << 16) | (g << 8) | b;
+        }
+    }
+
+}
+
+/**
+ * Returns a newly-allocated synthesized desktop image of the given kind:
+ * "terminal", "office", "photo", or "mixed" (an office desktop containing a
+ * window showing a photograph).
+ */
+static uint32_t* bench_synthesize(const char* kind) {
+
+    uint32_t* image = malloc(BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint32_t));
+    int y;
+
+    srand(1);
+
+    if (strcmp(kind, "terminal") == 0) {
+        bench_fill(image, 0, 0, BENCH_WIDTH, BENCH_HEIGHT, 0x000000);
+        bench_text(image, 4, 4, BENCH_WIDTH - 8, BENCH_HEIGHT - 8, 0xAAAAAA);
+    }
+
+    else if (strcmp(kind, "photo") == 0)
+        bench_photo(image, 0, 0, BENCH_WIDTH, BENCH_HEIGHT);
+
+    else {
+
+        /* Desktop background, taskbar, and window with gradient title bar */
+        bench_fill(image, 0, 0, BENCH_WIDTH, BENCH_HEIGHT, 0x3A6EA5);
+        bench_fill(image, 0, BENCH_HEIGHT - 32, BENCH_WIDTH, 32, 0xD4D0C8);
+        bench_fill(image, 64, 48, 800, 600, 0xFFFFFF);
+        for (y = 0; y < 24; y++)
+            bench_fill(image, 64, 48 + y, 800, 1, 0x0A246A + y * 0x000204);
+        bench_text(image, 80, 96, 768, 520, 0x000000);
+
+        /* Photo viewer covering the lower portion of the window */
+        if (strcmp(kind, "mixed") == 0)
+            bench_photo(image, 200, 400, 400, 200);
+
+    }
+
+    return image;
+
+}
+
+/**
+ * Reads the binary PPM (P6) image at the given path, such as a desktop
+ * capture, returning a newly-allocated image in the same format as the
+ * synthesized images, or NULL if the file cannot be read. The dimensions of
+ * the image are stored in the given ints.
+ */
+static uint32_t* bench_read_ppm(const char* path, int* width, int* height) {
+
+    FILE* file = fopen(path, "rb");
+    uint32_t* image;
+    int maxval;
+    int i;
+
+    if (file == NULL)
+        return NULL;
+
+    if (fscanf(file, "P6 %i %i %i", width, height, &maxval) != 3
+            || maxval != 255 || fgetc(file) == EOF) {
+        fclose(file);
+        return NULL;
+    }
+
+    image = malloc(*width * *height * sizeof(uint32_t));
+    for (i = 0; i < *width * *height; i++) {
+
+        unsigned char rgb[3];
+        if (fread(rgb, 1, 3, file) != 3) {
+            free(image);
+            fclose(file);
+            return NULL;
+        }
+
+        image[i] = (rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+
+    }
+
+    fclose(file);
+    return image;
+
+}
+
+/**
+ * Measures both the legacy and current color census for the given image,
+ * printing the time taken per image.
+ */
+static void bench_image(const char* name, uint32_t* image, int width,
+        int height) {
+
+    cairo_surface_t* surface = cairo_image_surface_create_for_data(
+            (unsigned char*) image, CAIRO_FORMAT_RGB24, width, height,
+            width * sizeof(uint32_t));
+
+    double start, legacy_time, census_time;
+    int legacy_colors = 0, colors = 0;
+    char result[16];
+    int pass;
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        legacy_colors = bench_legacy_census(surface);
+    legacy_time = (bench_now() - start) / BENCH_PASSES;
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        colors = bench_census(surface);
+    census_time = (bench_now() - start) / BENCH_PASSES;
+
+    if (colors != legacy_colors) {
+        fprintf(stderr, "%s: census mismatch (%i != %i)\n", name, colors,
+                legacy_colors);
+        exit(1);
+    }
+
+    if (colors < 0)
+        sprintf(result, ">256");
+    else
+        sprintf(result, "%i", colors);
+
+    printf("census %-24s %4s colors  legacy %8.3f ms  current %8.3f ms  "
+            "(%.1fx)\n", name, result, legacy_time * 1000, census_time * 1000,
+            legacy_time / census_time);
+
+    cairo_surface_destroy(surface);
+
+}
+
+int main(int argc, char** argv) {
+
+    const char* kinds[] = { "terminal", "office", "photo", "mixed" };
+    int i;
+
+    /* Measure given captures, if any, otherwise synthesized desktops */
+    if (argc > 1) {
+        for (i = 1; i < argc; i++) {
+
+            int width, height;
+            uint32_t* image = bench_read_ppm(argv[i], &width, &height);
+            if (image == NULL) {
+                fprintf(stderr, "Unable to read \"%s\" as binary PPM\n",
+                        argv[i]);
+                return 1;
+            }
+
+            bench_image(argv[i], image, width, height);
+            free(image);
+
+        }
+    }
+
+    else {
+        for (i = 0; i < sizeof(kinds) / sizeof(kinds[0]); i++) {
+            uint32_t* image = bench_synthesize(kinds[i]);
+            bench_image(kinds[i], image, BENCH_WIDTH, BENCH_HEIGHT);
+            free(image);
+        }
+    }
+
+    return 0;
+
+}
+
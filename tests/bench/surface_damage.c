@@ -0,0 +1,762 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Replays traces of display updates against guac_common_surface, comparing
+ * the number of bytes sent by the tile-based damage tracking of the surface
+ * against the single dirty rectangle and update queue it replaced, and
+ * against the same surface with motion detection enabled.
+ *
+ * Each line of a trace is either "flush", ending the current frame, or
+ * "x y w h value", drawing the given rectangle with content derived
+ * deterministically from its absolute coordinates and the given value, such
+ * that redrawing a rectangle with an earlier value restores its earlier
+ * contents. A value of zero draws plain background. A line may instead be
+ * "x y w h value dx dy", drawing the content which would otherwise be drawn
+ * at the given offset from the rectangle, as when scrolling.
+ *
+ * Traces may be given as files on the command line, and are replayed against
+ * a display of BENCH_WIDTH by BENCH_HEIGHT pixels. If none are given,
+ * several typical traces are synthesized.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "guac_rect.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width of the replayed display, in pixels.
+ */
+#define BENCH_WIDTH 1024
+
+/**
+ * The height of the replayed display, in pixels.
+ */
+#define BENCH_HEIGHT 768
+
+/**
+ * The width of the display replayed by the "tiles" trace, in pixels.
+ */
+#define BENCH_LARGE_WIDTH 1920
+
+/**
+ * The height of the display replayed by the "tiles" trace, in pixels.
+ */
+#define BENCH_LARGE_HEIGHT 1088
+
+/**
+ * The number of frames in each synthesized trace.
+ */
+#define BENCH_FRAMES 200
+
+/**
+ * The maximum number of updates the legacy heuristic could queue.
+ */
+#define LEGACY_QUEUE_SIZE 256
+
+/**
+ * The constants of the legacy heuristic, as defined by guac_surface.c.
+ */
+#define LEGACY_NEGLIGIBLE_WIDTH    64
+#define LEGACY_NEGLIGIBLE_HEIGHT   64
+#define LEGACY_BASE_COST           4096
+#define LEGACY_NEGLIGIBLE_INCREASE 4
+#define LEGACY_FILL_PATTERN_FACTOR 3
+
+/**
+ * The state of the legacy heuristic: a single dirty rectangle, plus a queue
+ * of rectangles awaiting the next flush.
+ */
+typedef struct bench_legacy {
+
+    int dirty;
+    guac_common_rect dirty_rect;
+
+    struct {
+        guac_common_rect rect;
+        int flushed;
+    } queue[LEGACY_QUEUE_SIZE];
+
+    int queue_length;
+
+    /**
+     * The total number of updates sent.
+     */
+    int updates;
+
+    /**
+     * The total number of pixels sent.
+     */
+    long pixels;
+
+} bench_legacy;
+
+/**
+ * Write handler which discards all data, counting the bytes written in the
+ * size_t pointed to by the data member of the socket.
+ */
+static ssize_t bench_count_write(guac_socket* socket, const void* buf,
+        size_t count) {
+    *((size_t*) socket->data) += count;
+    return count;
+}
+
+/**
+ * Allocates a socket which counts all bytes written in the given counter.
+ */
+static guac_socket* bench_alloc_counter(size_t* counter) {
+
+    guac_socket* socket = guac_socket_alloc();
+    socket->data = counter;
+    socket->write_handler = bench_count_write;
+
+    return socket;
+
+}
+
+/**
+ * Returns the color of the given pixel of content drawn with the given
+ * value, resembling text: mostly background, with runs of foreground.
+ */
+static uint32_t bench_pixel(int x, int y, int value) {
+
+    uint32_t bits;
+
+    if (value == 0)
+        return 0xFFFFFFFF;
+
+    bits = (uint32_t) (x / 3) * 0x9E3779B1 ^ (uint32_t) (y / 2) * 0x85EBCA77
+         ^ (uint32_t) value * 0xC2B2AE3D;
+    bits ^= bits >> 15;
+    bits *= 0x27D4EB2F;
+    bits ^= bits >> 13;
+
+    if ((bits & 7) < 3)
+        return 0xFF000000 | ((uint32_t) value * 0x010307 & 0x7F7F7F);
+
+    return 0xFFFFFFFF;
+
+}
+
+/**
+ * Draws the given rectangle with the content of the given value, taking that
+ * content from the given offset.
+ */
+static void bench_draw(guac_common_surface* surface, const guac_common_rect* rect,
+        int value, int dx, int dy) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            rect->width, rect->height);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    int x, y;
+
+    for (y = 0; y < rect->height; y++) {
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        for (x = 0; x < rect->width; x++)
+            row[x] = bench_pixel(rect->x + x + dx, rect->y + y + dy, value);
+    }
+
+    cairo_surface_mark_dirty(image);
+    guac_common_surface_draw(surface, rect->x, rect->y, image);
+    cairo_surface_destroy(image);
+
+}
+
+/**
+ * Returns the bounds of the pixels within the given rectangle which differ
+ * between the given snapshot of that rectangle and the surface, storing the
+ * bounds within changed. Returns zero if nothing changed.
+ */
+static int bench_changed(guac_common_surface* surface, const uint32_t* snapshot,
+        const guac_common_rect* rect, guac_common_rect* changed) {
+
+    int min_x = rect->width, min_y = rect->height;
+    int max_x = -1, max_y = -1;
+    int x, y;
+
+    for (y = 0; y < rect->height; y++) {
+
+        const uint32_t* row = (const uint32_t*) (surface->buffer
+                + (rect->y + y) * surface->stride + rect->x * 4);
+
+        for (x = 0; x < rect->width; x++) {
+            if (row[x] != snapshot[y * rect->width + x]) {
+                if (x < min_x) min_x = x;
+                if (y < min_y) min_y = y;
+                if (x > max_x) max_x = x;
+                if (y > max_y) max_y = y;
+            }
+        }
+
+    }
+
+    if (max_x < 0)
+        return 0;
+
+    guac_common_rect_init(changed, rect->x + min_x, rect->y + min_y,
+            max_x - min_x + 1, max_y - min_y + 1);
+    return 1;
+
+}
+
+/**
+ * The legacy test for whether an update should be combined into the dirty
+ * rectangle.
+ */
+static int bench_legacy_combine(bench_legacy* legacy,
+        const guac_common_rect* rect) {
+
+    int combined_cost, dirty_cost, update_cost;
+    guac_common_rect combined;
+
+    if (!legacy->dirty)
+        return 0;
+
+    combined = legacy->dirty_rect;
+    guac_common_rect_extend(&combined, rect);
+
+    if (combined.width <= LEGACY_NEGLIGIBLE_WIDTH
+            && combined.height <= LEGACY_NEGLIGIBLE_HEIGHT)
+        return 1;
+
+    combined_cost = LEGACY_BASE_COST + combined.width * combined.height;
+    dirty_cost    = LEGACY_BASE_COST + legacy->dirty_rect.width * legacy->dirty_rect.height;
+    update_cost   = LEGACY_BASE_COST + rect->width * rect->height;
+
+    if (combined_cost <= update_cost + dirty_cost)
+        return 1;
+
+    if (combined_cost - dirty_cost <= dirty_cost / LEGACY_NEGLIGIBLE_INCREASE)
+        return 1;
+
+    if (combined_cost - update_cost <= update_cost / LEGACY_NEGLIGIBLE_INCREASE)
+        return 1;
+
+    if (rect->x == legacy->dirty_rect.x
+            && rect->y == legacy->dirty_rect.y + legacy->dirty_rect.height
+            && combined_cost <= (dirty_cost + update_cost) * LEGACY_FILL_PATTERN_FACTOR)
+        return 1;
+
+    return 0;
+
+}
+
+/**
+ * Extends the legacy dirty rectangle to contain the given rectangle.
+ */
+static void bench_legacy_mark(bench_legacy* legacy, const guac_common_rect* rect) {
+
+    if (legacy->dirty)
+        guac_common_rect_extend(&legacy->dirty_rect, rect);
+    else {
+        legacy->dirty_rect = *rect;
+        legacy->dirty = 1;
+    }
+
+}
+
+/**
+ * Moves the legacy dirty rectangle to the queue.
+ */
+static void bench_legacy_queue(bench_legacy* legacy) {
+
+    if (!legacy->dirty)
+        return;
+
+    legacy->queue[legacy->queue_length].rect = legacy->dirty_rect;
+    legacy->queue[legacy->queue_length].flushed = 0;
+    legacy->queue_length++;
+    legacy->dirty = 0;
+
+}
+
+/**
+ * Sends the legacy dirty rectangle of the given surface as a "png"
+ * instruction.
+ */
+static void bench_legacy_send(bench_legacy* legacy,
+        guac_common_surface* surface, guac_socket* socket) {
+
+    guac_common_rect* rect = &legacy->dirty_rect;
+    cairo_surface_t* image;
+
+    if (!legacy->dirty)
+        return;
+
+    image = cairo_image_surface_create_for_data(
+            surface->buffer + rect->y * surface->stride + rect->x * 4,
+            CAIRO_FORMAT_RGB24, rect->width, rect->height, surface->stride);
+
+    guac_protocol_send_png(socket, GUAC_COMP_OVER, surface->layer,
+            rect->x, rect->y, image);
+
+    cairo_surface_destroy(image);
+    legacy->dirty = 0;
+    legacy->updates++;
+    legacy->pixels += rect->width * rect->height;
+
+}
+
+/**
+ * Comparator which orders queued legacy updates as the legacy flush did.
+ */
+static int bench_legacy_compare(const void* a, const void* b) {
+
+    const guac_common_rect* ra = (const guac_common_rect*) a;
+    const guac_common_rect* rb = (const guac_common_rect*) b;
+
+    if (ra->y != rb->y) return ra->y - rb->y;
+    if (ra->x != rb->x) return ra->x - rb->x;
+    if (ra->width != rb->width) return rb->width - ra->width;
+    return ra->height - rb->height;
+
+}
+
+/**
+ * Flushes all queued legacy updates, combining them as the legacy flush did.
+ */
+static void bench_legacy_flush(bench_legacy* legacy,
+        guac_common_surface* surface, guac_socket* socket) {
+
+    int original_length;
+    int i, j;
+
+    bench_legacy_queue(legacy);
+    original_length = legacy->queue_length;
+
+    /* The rect is the first member of each queue entry */
+    qsort(legacy->queue, legacy->queue_length, sizeof(legacy->queue[0]),
+            bench_legacy_compare);
+
+    for (i = 0; i < legacy->queue_length; i++) {
+
+        int combined = 0;
+
+        if (legacy->queue[i].flushed)
+            continue;
+
+        for (j = i; j < legacy->queue_length; j++) {
+            if (!legacy->queue[j].flushed
+                    && (bench_legacy_combine(legacy, &legacy->queue[j].rect)
+                        || !legacy->dirty)) {
+                bench_legacy_mark(legacy, &legacy->queue[j].rect);
+                legacy->queue[j].flushed = 1;
+                combined++;
+            }
+        }
+
+        if ((combined > 1 || i < original_length)
+                && legacy->queue_length < LEGACY_QUEUE_SIZE)
+            bench_legacy_queue(legacy);
+        else
+            bench_legacy_send(legacy, surface, socket);
+
+    }
+
+    legacy->queue_length = 0;
+
+}
+
+/**
+ * Records a draw which changed the given rectangle with the legacy
+ * heuristic, flushing early if its queue is full.
+ */
+static void bench_legacy_draw(bench_legacy* legacy,
+        guac_common_surface* surface, guac_socket* socket,
+        const guac_common_rect* rect) {
+
+    if (!bench_legacy_combine(legacy, rect)) {
+
+        if (legacy->dirty && legacy->queue_length == LEGACY_QUEUE_SIZE - 1)
+            bench_legacy_flush(legacy, surface, socket);
+
+        bench_legacy_queue(legacy);
+
+    }
+
+    bench_legacy_mark(legacy, rect);
+
+}
+
+/**
+ * Replays the given trace against a display of the given size, printing the
+ * bytes sent by the current surface implementation and by the legacy
+ * heuristic, and the time spent flushing the current surface.
+ */
+static void bench_replay(const char* name, FILE* trace, int width,
+        int height) {
+
+    size_t bytes = 0;
+    size_t legacy_bytes = 0;
+    size_t motion_bytes = 0;
+
+    guac_socket* socket = bench_alloc_counter(&bytes);
+    guac_socket* legacy_socket = bench_alloc_counter(&legacy_bytes);
+    guac_socket* motion_socket = bench_alloc_counter(&motion_bytes);
+    guac_client* client = guac_client_alloc();
+
+    guac_layer layer = { .index = 1 };
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            &layer, width, height);
+    guac_common_surface* motion = guac_common_surface_alloc(client,
+            motion_socket, &layer, width, height);
+
+    bench_legacy legacy = { .dirty = 0, .queue_length = 0, .updates = 0, .pixels = 0 };
+    uint32_t* snapshot = malloc(width * height * 4);
+
+    int frames = 0;
+    int updates = 0;
+    long pixels = 0;
+    int tiles = 0;
+    int unchanged_tiles = 0;
+    int motion_updates = 0;
+    long motion_pixels = 0;
+    double flush_time = 0;
+
+    char line[256];
+
+    guac_common_surface_set_motion_detection(motion, 1);
+
+    while (fgets(line, sizeof(line), trace) != NULL) {
+
+        guac_common_rect rect, changed;
+        int x, y, w, h, value;
+        int dx = 0, dy = 0;
+        int row;
+
+        if (strncmp(line, "flush", 5) == 0) {
+
+            /* Statistics are only updated by flushes with damage */
+            if (surface->dirty) {
+                double start = bench_now();
+                guac_common_surface_flush(surface);
+                flush_time += bench_now() - start;
+                updates += surface->last_flush.updates;
+                pixels += surface->last_flush.pixels;
+                tiles += surface->last_flush.damaged_tiles;
+                unchanged_tiles += surface->last_flush.unchanged_tiles;
+            }
+
+            if (motion->dirty) {
+                guac_common_surface_flush(motion);
+                motion_updates += motion->last_flush.updates
+                    + motion->last_flush.moved_updates;
+                motion_pixels += motion->last_flush.pixels;
+            }
+
+            guac_socket_flush(socket);
+            guac_socket_flush(motion_socket);
+
+            bench_legacy_flush(&legacy, surface, legacy_socket);
+            guac_socket_flush(legacy_socket);
+
+            frames++;
+            continue;
+
+        }
+
+        if (sscanf(line, "%d %d %d %d %d %d %d", &x, &y, &w, &h, &value,
+                    &dx, &dy) < 5)
+            continue;
+
+        guac_common_rect_init(&rect, x, y, w, h);
+        if (x < 0 || y < 0 || w <= 0 || h <= 0
+                || x + w > width || y + h > height)
+            continue;
+
+        /* Snapshot rect such that the legacy heuristic sees what changed */
+        for (row = 0; row < h; row++)
+            memcpy(snapshot + row * w,
+                    surface->buffer + (y + row) * surface->stride + x * 4,
+                    w * 4);
+
+        bench_draw(surface, &rect, value, dx, dy);
+        bench_draw(motion, &rect, value, dx, dy);
+
+        if (bench_changed(surface, snapshot, &rect, &changed))
+            bench_legacy_draw(&legacy, surface, legacy_socket, &changed);
+
+    }
+
+    printf("damage %-10s %4d frames, %5d/%5d tiles unchanged, "
+            "%d/%d updates moved\n"
+            "    legacy %9zu bytes, %5d updates, %9ld pixels\n"
+            "    tiles  %9zu bytes, %5d updates, %9ld pixels (%5.1f%% of legacy bytes), "
+            "%.2f ms per flush\n"
+            "    motion %9zu bytes, %5d updates, %9ld pixels (%5.1f%% of legacy bytes)\n",
+            name, frames, unchanged_tiles, tiles,
+            motion->motion_stats.hits, motion->motion_stats.candidates,
+            legacy_bytes, legacy.updates, legacy.pixels,
+            bytes, updates, pixels,
+            legacy_bytes ? 100.0 * bytes / legacy_bytes : 100.0,
+            frames ? flush_time * 1000 / frames : 0.0,
+            motion_bytes, motion_updates, motion_pixels,
+            legacy_bytes ? 100.0 * motion_bytes / legacy_bytes : 100.0);
+
+    free(snapshot);
+    guac_common_surface_free(surface);
+    guac_common_surface_free(motion);
+    guac_client_free(client);
+    guac_socket_free(socket);
+    guac_socket_free(legacy_socket);
+    guac_socket_free(motion_socket);
+
+}
+
+/**
+ * A clock which is erased and redrawn every frame, changing once per 30
+ * frames, and a text cursor which is hidden and shown again every frame,
+ * blinking once per 10 frames.
+ */
+static void bench_trace_clock(FILE* trace) {
+
+    int frame;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+
+        fprintf(trace, "%d %d %d %d %d\n", BENCH_WIDTH - 96, 4, 80, 16, 0);
+        fprintf(trace, "%d %d %d %d %d\n", BENCH_WIDTH - 96, 4, 80, 16,
+                1 + frame / 30);
+
+        fprintf(trace, "%d %d %d %d %d\n", 200, 300, 2, 16, 0);
+        fprintf(trace, "%d %d %d %d %d\n", 200, 300, 2, 16, frame / 10 % 2);
+
+        fprintf(trace, "flush\n");
+
+    }
+
+}
+
+/**
+ * Text typed into a line, one character per frame, with the cursor moving
+ * ahead of the text and the line being erased and redrawn in full whenever
+ * it wraps.
+ */
+static void bench_trace_typing(FILE* trace) {
+
+    int frame;
+    int line = 0;
+    int column = 0;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+
+        int x = 16 + column * 8;
+        int y = 64 + line * 16;
+
+        /* Erase cursor, draw character, draw cursor after it */
+        fprintf(trace, "%d %d %d %d %d\n", x, y, 8, 16, 0);
+        fprintf(trace, "%d %d %d %d %d\n", x, y, 8, 16, 2 + frame % 50);
+        fprintf(trace, "%d %d %d %d %d\n", x + 8, y, 2, 16, 1);
+
+        /* Editors commonly redraw the whole line with each keystroke */
+        if (frame % 4 == 0) {
+            fprintf(trace, "%d %d %d %d %d\n", 16, y, x + 10 - 16, 16, 0);
+            fprintf(trace, "%d %d %d %d %d\n", 16, y, x + 8 - 16, 16, 2 + frame % 50);
+        }
+
+        if (++column == 80) {
+            column = 0;
+            line = (line + 1) % 32;
+        }
+
+        fprintf(trace, "flush\n");
+
+    }
+
+}
+
+/**
+ * Small updates scattered across the display, half of which are hover
+ * effects undone within the same frame.
+ */
+static void bench_trace_scattered(FILE* trace) {
+
+    unsigned int seed = 1;
+    int frame, i;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+
+        for (i = 0; i < 24; i++) {
+
+            int w = 16 + rand_r(&seed) % 48;
+            int h = 16 + rand_r(&seed) % 32;
+            int x = rand_r(&seed) % (BENCH_WIDTH - w);
+            int y = rand_r(&seed) % (BENCH_HEIGHT - h);
+
+            fprintf(trace, "%d %d %d %d %d\n", x, y, w, h, 1 + frame);
+            if (i & 1)
+                fprintf(trace, "%d %d %d %d %d\n", x, y, w, h, 0);
+
+        }
+
+        fprintf(trace, "flush\n");
+
+    }
+
+}
+
+/**
+ * A window repainted in strips each frame, each strip being erased and then
+ * redrawn, with only one strip actually changing per frame.
+ */
+static void bench_trace_window(FILE* trace) {
+
+    int frame, strip;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+
+        for (strip = 0; strip < 20; strip++) {
+
+            int value = strip == frame % 20 ? 100 + frame : 1 + strip;
+
+            fprintf(trace, "%d %d %d %d %d\n", 128, 96 + strip * 16, 480, 16, 0);
+            fprintf(trace, "%d %d %d %d %d\n", 128, 96 + strip * 16, 480, 16, value);
+
+        }
+
+        fprintf(trace, "flush\n");
+
+    }
+
+}
+
+/**
+ * A document scrolled within a viewport, mostly vertically by varying
+ * amounts, occasionally horizontally, with a status bar which changes as it
+ * scrolls.
+ */
+static void bench_trace_scroll(FILE* trace) {
+
+    int frame;
+    int scroll_x = 0;
+    int scroll_y = 0;
+
+    for (frame = 0; frame < BENCH_FRAMES; frame++) {
+
+        if (frame % 25 == 24)
+            scroll_x += 40;
+        else
+            scroll_y += 8 + (frame % 5) * 8;
+
+        fprintf(trace, "%d %d %d %d %d %d %d\n", 64, 64, 800, 600, 1,
+                scroll_x, scroll_y);
+        fprintf(trace, "%d %d %d %d %d\n", 64, 664, 800, 16, 2 + frame % 10);
+
+        fprintf(trace, "flush\n");
+
+    }
+
+}
+
+/**
+ * A 2x2 pixel change at a different position within every tile of a large
+ * display, each frame, as the worst case for combining damage across tiles.
+ */
+static void bench_trace_tiles(FILE* trace) {
+
+    int frame, x, y;
+
+    for (frame = 0; frame < BENCH_FRAMES / 10; frame++) {
+
+        int offset = (frame * 7) % (GUAC_COMMON_SURFACE_TILE_SIZE - 2);
+
+        for (y = 0; y < BENCH_LARGE_HEIGHT; y += GUAC_COMMON_SURFACE_TILE_SIZE)
+            for (x = 0; x < BENCH_LARGE_WIDTH; x += GUAC_COMMON_SURFACE_TILE_SIZE)
+                fprintf(trace, "%d %d %d %d %d\n", x + offset, y + offset,
+                        2, 2, 1 + frame);
+
+        fprintf(trace, "flush\n");
+
+    }
+
+}
+
+int main(int argc, char** argv) {
+
+    struct {
+        const char* name;
+        void (*synthesize)(FILE* trace);
+        int width;
+        int height;
+    } traces[] = {
+        { "clock",     bench_trace_clock,     BENCH_WIDTH, BENCH_HEIGHT },
+        { "typing",    bench_trace_typing,    BENCH_WIDTH, BENCH_HEIGHT },
+        { "scattered", bench_trace_scattered, BENCH_WIDTH, BENCH_HEIGHT },
+        { "window",    bench_trace_window,    BENCH_WIDTH, BENCH_HEIGHT },
+        { "scroll",    bench_trace_scroll,    BENCH_WIDTH, BENCH_HEIGHT },
+        { "tiles",     bench_trace_tiles,
+            BENCH_LARGE_WIDTH, BENCH_LARGE_HEIGHT }
+    };
+
+    int i;
+
+    /* Replay any traces given */
+    if (argc > 1) {
+
+        for (i = 1; i < argc; i++) {
+
+            FILE* trace = fopen(argv[i], "r");
+            if (trace == NULL) {
+                perror(argv[i]);
+                return 1;
+            }
+
+            bench_replay(argv[i], trace, BENCH_WIDTH, BENCH_HEIGHT);
+            fclose(trace);
+
+        }
+
+        return 0;
+
+    }
+
+    /* Otherwise replay synthesized traces */
+    for (i = 0; i < sizeof(traces) / sizeof(traces[0]); i++) {
+
+        FILE* trace = tmpfile();
+        traces[i].synthesize(trace);
+        rewind(trace);
+
+        bench_replay(traces[i].name, trace, traces[i].width,
+                traces[i].height);
+        fclose(trace);
+
+    }
+
+    return 0;
+
+}
@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "guac_surface.h"
+#include "guac_surface_kernels.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width of each benchmark image and surface, in pixels.
+ */
+#define BENCH_WIDTH 1024
+
+/**
+ * The height of each benchmark image and surface, in pixels.
+ */
+#define BENCH_HEIGHT 768
+
+/**
+ * The number of times each operation is performed per measurement.
+ */
+#define BENCH_PASSES 100
+
+/**
+ * The kind of row update measured.
+ */
+typedef enum bench_op {
+    BENCH_PUT,
+    BENCH_PUT_ALPHA,
+    BENCH_FILL_MASK,
+    BENCH_FILL
+} bench_op;
+
+/**
+ * Human-readable names of each bench_op.
+ */
+static const char* bench_op_names[] = { "put", "put-alpha", "fill-mask", "fill" };
+
+/**
+ * Updates a row as the surface operations were originally implemented, one
+ * pixel at a time, testing each changed pixel against the bounds of the
+ * changed region. This is used as the baseline for comparison.
+ */
+static void bench_legacy_row(bench_op op, const uint32_t* src, uint32_t* dst,
+        int width, int y, int* min_x, int* min_y, int* max_x, int* max_y) {
+
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        uint32_t value;
+
+        switch (op) {
+
+            case BENCH_PUT:
+                value = src[x] | 0xFF000000;
+                break;
+
+            case BENCH_PUT_ALPHA:
+                if (!(src[x] & 0xFF000000))
+                    continue;
+                value = src[x] | 0xFF000000;
+                break;
+
+            case BENCH_FILL_MASK:
+                if (!(src[x] & 0xFF000000))
+                    continue;
+                value = 0xFF000000;
+                break;
+
+            default:
+                value = 0xFF000000;
+                break;
+
+        }
+
+        if (dst[x] != value) {
+            if (x < *min_x) *min_x = x;
+            if (y < *min_y) *min_y = y;
+            if (x > *max_x) *max_x = x;
+            if (y > *max_y) *max_y = y;
+            dst[x] = value;
+        }
+
+    }
+
+}
+
+/**
+ * Updates a row using the given kernels, adding the changed columns to the
+ * bounds of the changed region.
+ */
+static void bench_kernel_row(const guac_common_surface_kernels* kernels,
+        bench_op op, const uint32_t* src, uint32_t* dst, int width, int y,
+        int* min_x, int* min_y, int* max_x, int* max_y) {
+
+    int first, last;
+    int changed;
+
+    switch (op) {
+
+        case BENCH_PUT:
+            changed = kernels->put(src, dst, width, 0xFF000000,
+                    &first, &last);
+            break;
+
+        case BENCH_PUT_ALPHA:
+            changed = kernels->mask(src, dst, width, 0xFFFFFFFF, 0xFF000000,
+                    &first, &last);
+            break;
+
+        case BENCH_FILL_MASK:
+            changed = kernels->mask(src, dst, width, 0x00000000, 0xFF000000,
+                    &first, &last);
+            break;
+
+        default:
+            changed = kernels->fill(dst, width, 0xFF000000, &first, &last);
+            break;
+
+    }
+
+    if (changed) {
+        if (first < *min_x) *min_x = first;
+        if (y     < *min_y) *min_y = y;
+        if (last  > *max_x) *max_x = last;
+        if (y     > *max_y) *max_y = y;
+    }
+
+}
+
+/**
+ * Applies the given update to every row of the given destination image,
+ * first restoring the destination from the given original image, such that
+ * each pass performs identical work. If kernels is NULL, the legacy
+ * implementation is used. The bounds of the changed region are stored in the
+ * given array as min_x, min_y, max_x, and max_y.
+ */
+static void bench_apply(const guac_common_surface_kernels* kernels,
+        bench_op op, const uint32_t* src, const uint32_t* orig, uint32_t* dst,
+        int* bounds) {
+
+    int y;
+
+    bounds[0] = BENCH_WIDTH - 1;
+    bounds[1] = BENCH_HEIGHT - 1;
+    bounds[2] = 0;
+    bounds[3] = 0;
+
+    memcpy(dst, orig, BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint32_t));
+
+    for (y = 0; y < BENCH_HEIGHT; y++) {
+
+        const uint32_t* src_row = src + y * BENCH_WIDTH;
+        uint32_t* dst_row = dst + y * BENCH_WIDTH;
+
+        if (kernels == NULL)
+            bench_legacy_row(op, src_row, dst_row, BENCH_WIDTH, y,
+                    &bounds[0], &bounds[1], &bounds[2], &bounds[3]);
+        else
+            bench_kernel_row(kernels, op, src_row, dst_row, BENCH_WIDTH, y,
+                    &bounds[0], &bounds[1], &bounds[2], &bounds[3]);
+
+    }
+
+}
+
+/**
+ * Synthesizes source and destination images for the given scenario:
+ * "unchanged" (the destination already contains the result of the update,
+ * as when a VNC server resends an unchanged region), "sparse" (a blinking
+ * cursor and a few scattered pixels differ), or "changed" (every pixel
+ * differs). Roughly three quarters of the source pixels are opaque.
+ */
+static void bench_synthesize(const char* scenario, uint32_t* src,
+        uint32_t* dst) {
+
+    int i;
+
+    srand(1);
+
+    for (i = 0; i < BENCH_WIDTH * BENCH_HEIGHT; i++) {
+
+        uint32_t alpha = (rand() & 3) ? 0xFF000000 : 0x00000000;
+        src[i] = alpha | (((uint32_t) i * 0x010307) & 0xFFFFFF);
+        dst[i] = src[i] | 0xFF000000;
+
+        if (strcmp(scenario, "changed") == 0)
+            dst[i] ^= 0x00808080;
+
+    }
+
+    /* Cursor near the middle of the screen, plus a few scattered pixels */
+    if (strcmp(scenario, "sparse") == 0) {
+        for (i = 0; i < 16; i++)
+            dst[(BENCH_HEIGHT / 2 + i) * BENCH_WIDTH + BENCH_WIDTH / 2] ^= 0xFF;
+        for (i = 0; i < 32; i++)
+            dst[rand() % (BENCH_WIDTH * BENCH_HEIGHT)] ^= 0xFF;
+    }
+
+}
+
+/**
+ * Measures the legacy implementation and the kernels selected for the current
+ * CPU for each kind of row update within the given scenario, printing the
+ * time taken per full-screen update.
+ */
+static void bench_kernels(const char* scenario) {
+
+    const guac_common_surface_kernels* kernels = guac_common_surface_get_kernels();
+
+    size_t size = BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint32_t);
+    uint32_t* src = malloc(size);
+    uint32_t* orig = malloc(size);
+    uint32_t* legacy_dst = malloc(size);
+    uint32_t* dst = malloc(size);
+
+    bench_op op;
+
+    bench_synthesize(scenario, src, orig);
+
+    for (op = BENCH_PUT; op <= BENCH_FILL; op++) {
+
+        double start, legacy_time, kernel_time;
+        int legacy_bounds[4], bounds[4];
+        int pass;
+
+        start = bench_now();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            bench_apply(NULL, op, src, orig, legacy_dst, legacy_bounds);
+        legacy_time = (bench_now() - start) / BENCH_PASSES;
+
+        start = bench_now();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            bench_apply(kernels, op, src, orig, dst, bounds);
+        kernel_time = (bench_now() - start) / BENCH_PASSES;
+
+        if (memcmp(legacy_dst, dst, size) != 0
+                || memcmp(legacy_bounds, bounds, sizeof(bounds)) != 0) {
+            fprintf(stderr, "%s %s: result mismatch\n",
+                    bench_op_names[op], scenario);
+            exit(1);
+        }
+
+        printf("kernel %-10s %-10s legacy %8.3f ms  %-7s %8.3f ms  "
+                "(%.1fx)\n", bench_op_names[op], scenario, legacy_time * 1000,
+                kernels->name, kernel_time * 1000, legacy_time / kernel_time);
+
+    }
+
+    free(src);
+    free(orig);
+    free(legacy_dst);
+    free(dst);
+
+}
+
+/**
+ * Transfers a single pixel as originally implemented, deciding the transfer
+ * function for each pixel. This is used as the baseline for comparison.
+ */
+static int bench_legacy_transfer_int(guac_transfer_function op,
+        const uint32_t* src, uint32_t* dst) {
+
+    uint32_t orig = *dst;
+
+    switch (op) {
+        case GUAC_TRANSFER_BINARY_BLACK:     *dst = 0xFF000000; break;
+        case GUAC_TRANSFER_BINARY_WHITE:     *dst = 0xFFFFFFFF; break;
+        case GUAC_TRANSFER_BINARY_SRC:       *dst = *src; break;
+        case GUAC_TRANSFER_BINARY_DEST:      break;
+        case GUAC_TRANSFER_BINARY_NSRC:      *dst = ~(*src); break;
+        case GUAC_TRANSFER_BINARY_NDEST:     *dst = ~(*dst); break;
+        case GUAC_TRANSFER_BINARY_AND:       *dst = (*dst) & (*src); break;
+        case GUAC_TRANSFER_BINARY_NAND:      *dst = ~((*dst) & (*src)); break;
+        case GUAC_TRANSFER_BINARY_OR:        *dst = (*dst) | (*src); break;
+        case GUAC_TRANSFER_BINARY_NOR:       *dst = ~((*dst) | (*src)); break;
+        case GUAC_TRANSFER_BINARY_XOR:       *dst = (*dst) ^ (*src); break;
+        case GUAC_TRANSFER_BINARY_XNOR:      *dst = ~((*dst) ^ (*src)); break;
+        case GUAC_TRANSFER_BINARY_NSRC_AND:  *dst = (*dst) & ~(*src); break;
+        case GUAC_TRANSFER_BINARY_NSRC_NAND: *dst = ~((*dst) & ~(*src)); break;
+        case GUAC_TRANSFER_BINARY_NSRC_OR:   *dst = (*dst) | ~(*src); break;
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:  *dst = ~((*dst) | ~(*src)); break;
+    }
+
+    return *dst != orig;
+
+}
+
+/**
+ * Transfers every row of the given source image onto the given destination
+ * image using the given transfer function, first restoring the destination
+ * from the given original image. If kernels is NULL, the legacy per-pixel
+ * implementation is used. The bounds of the changed region are stored in the
+ * given array as min_x, min_y, max_x, and max_y.
+ */
+static void bench_transfer(const guac_common_surface_kernels* kernels,
+        guac_transfer_function op, const uint32_t* src, const uint32_t* orig,
+        uint32_t* dst, int* bounds) {
+
+    int x, y;
+
+    bounds[0] = BENCH_WIDTH - 1;
+    bounds[1] = BENCH_HEIGHT - 1;
+    bounds[2] = 0;
+    bounds[3] = 0;
+
+    memcpy(dst, orig, BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint32_t));
+
+    for (y = 0; y < BENCH_HEIGHT; y++) {
+
+        const uint32_t* src_row = src + y * BENCH_WIDTH;
+        uint32_t* dst_row = dst + y * BENCH_WIDTH;
+
+        int first, last;
+
+        if (kernels == NULL) {
+            for (x = 0; x < BENCH_WIDTH; x++) {
+                if (bench_legacy_transfer_int(op, &src_row[x], &dst_row[x])) {
+                    if (x < bounds[0]) bounds[0] = x;
+                    if (y < bounds[1]) bounds[1] = y;
+                    if (x > bounds[2]) bounds[2] = x;
+                    if (y > bounds[3]) bounds[3] = y;
+                }
+            }
+        }
+
+        /* DEST has no kernel, as it never changes anything */
+        else if (kernels->transfer[op] != NULL
+                && kernels->transfer[op](src_row, dst_row, BENCH_WIDTH,
+                    &first, &last)) {
+            if (first < bounds[0]) bounds[0] = first;
+            if (y     < bounds[1]) bounds[1] = y;
+            if (last  > bounds[2]) bounds[2] = last;
+            if (y     > bounds[3]) bounds[3] = y;
+        }
+
+    }
+
+}
+
+/**
+ * Measures the legacy per-pixel implementation and the kernels selected for
+ * the current CPU for each transfer function, printing the time taken per
+ * full-screen transfer.
+ */
+static void bench_transfers() {
+
+    const char* names[] = {
+        "black", "and", "nsrc-nor", "src", "nsrc-and", "dest", "xor", "or",
+        "nor", "xnor", "ndest", "nsrc-nand", "nsrc", "nsrc-or", "nand", "white"
+    };
+
+    const guac_common_surface_kernels* kernels = guac_common_surface_get_kernels();
+
+    size_t size = BENCH_WIDTH * BENCH_HEIGHT * sizeof(uint32_t);
+    uint32_t* src = malloc(size);
+    uint32_t* orig = malloc(size);
+    uint32_t* legacy_dst = malloc(size);
+    uint32_t* dst = malloc(size);
+
+    int op;
+
+    bench_synthesize("sparse", src, orig);
+
+    for (op = 0; op < GUAC_COMMON_SURFACE_TRANSFER_FUNCTIONS; op++) {
+
+        double start, legacy_time, kernel_time;
+        int legacy_bounds[4], bounds[4];
+        int pass;
+
+        start = bench_now();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            bench_transfer(NULL, op, src, orig, legacy_dst, legacy_bounds);
+        legacy_time = (bench_now() - start) / BENCH_PASSES;
+
+        start = bench_now();
+        for (pass = 0; pass < BENCH_PASSES; pass++)
+            bench_transfer(kernels, op, src, orig, dst, bounds);
+        kernel_time = (bench_now() - start) / BENCH_PASSES;
+
+        if (memcmp(legacy_dst, dst, size) != 0
+                || memcmp(legacy_bounds, bounds, sizeof(bounds)) != 0) {
+            fprintf(stderr, "transfer %s: result mismatch\n", names[op]);
+            exit(1);
+        }
+
+        printf("transfer %-10s legacy %8.3f ms  %-7s %8.3f ms  (%.1fx)\n",
+                names[op], legacy_time * 1000, kernels->name,
+                kernel_time * 1000, legacy_time / kernel_time);
+
+    }
+
+    free(src);
+    free(orig);
+    free(legacy_dst);
+    free(dst);
+
+}
+
+/**
+ * Prints the average time taken by the given number of passes of a surface
+ * operation which began at the given time.
+ */
+static void bench_report(const char* name, double start) {
+    printf("surface %-24s %8.3f ms\n", name,
+            (bench_now() - start) / BENCH_PASSES * 1000);
+}
+
+/**
+ * Measures complete guac_common_surface operations on full-screen off-screen
+ * buffers, including clipping, dirty rect tracking, and instruction output
+ * (to a socket which discards all data). Only operations which do not
+ * require image data to be encoded are measured, such that the time taken
+ * reflects the cost of updating the surface itself.
+ */
+static void bench_surface() {
+
+    guac_layer buffer = { .index = -1 };
+    guac_layer other_buffer = { .index = -2 };
+    guac_socket* socket = guac_socket_alloc();
+
+    guac_common_surface* surface = guac_common_surface_alloc(NULL, socket,
+            &buffer, BENCH_WIDTH, BENCH_HEIGHT);
+    guac_common_surface* other = guac_common_surface_alloc(NULL, socket,
+            &other_buffer, BENCH_WIDTH, BENCH_HEIGHT);
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            BENCH_WIDTH, BENCH_HEIGHT);
+    cairo_surface_t* mask = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+            BENCH_WIDTH, BENCH_HEIGHT);
+
+    double start;
+    int pass;
+
+    /* Surfaces and image initially match (all black), so these draws change
+     * nothing and are never flushed */
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_draw(surface, 0, 0, image);
+    bench_report("draw (unchanged)", start);
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_paint(surface, 0, 0, mask, 0x00, 0x00, 0x00);
+    bench_report("paint (unchanged)", start);
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_rect(surface, 0, 0, BENCH_WIDTH, BENCH_HEIGHT,
+                pass & 1 ? 0xFF : 0x00, 0x80, 0x00);
+    bench_report("rect (alternating)", start);
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_copy(surface, 0, 16, BENCH_WIDTH,
+                BENCH_HEIGHT - 16, surface, 0, 0);
+    bench_report("copy (scroll up)", start);
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_copy(surface, 0, 0, BENCH_WIDTH,
+                BENCH_HEIGHT - 16, surface, 0, 16);
+    bench_report("copy (scroll down)", start);
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_copy(other, 0, 0, BENCH_WIDTH, BENCH_HEIGHT,
+                surface, 0, 0);
+    bench_report("copy (between)", start);
+
+    start = bench_now();
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+        guac_common_surface_transfer(other, 0, 0, BENCH_WIDTH, BENCH_HEIGHT,
+                GUAC_TRANSFER_BINARY_XOR, surface, 0, 0);
+    bench_report("transfer (xor)", start);
+
+    cairo_surface_destroy(image);
+    cairo_surface_destroy(mask);
+    guac_common_surface_free(surface);
+    guac_common_surface_free(other);
+    guac_socket_free(socket);
+
+}
+
+int main(int argc, char** argv) {
+
+    const char* scenarios[] = { "unchanged", "sparse", "changed" };
+    int i;
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+        bench_kernels(scenarios[i]);
+
+    bench_transfers();
+    bench_surface();
+
+    return 0;
+
+}
+
@@ -0,0 +1,305 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "buffer.h"
+#include "types.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * The number of rows of scrollback, matching that allocated by the terminal.
+ */
+#define BENCH_SCROLLBACK 1000
+
+/**
+ * The height of the visible area of the terminal, in rows.
+ */
+#define BENCH_HEIGHT 24
+
+/**
+ * The number of rows written per measurement, such that the scrollback is
+ * filled several times over.
+ */
+#define BENCH_ROWS 20000
+
+/**
+ * The size of each cell, and the number of cells eagerly allocated for each
+ * row of scrollback, before cells were packed and rows were allocated
+ * lazily. This is used as the baseline for comparison.
+ */
+#define BENCH_LEGACY_CELL_SIZE 20
+#define BENCH_LEGACY_ROW_CELLS 256
+
+/**
+ * Function which generates the contents of a single row of output, returning
+ * the number of characters stored.
+ */
+typedef int bench_row_generator(int row, int width,
+        guac_terminal_char* characters);
+
+/**
+ * Returns a character having the given value and colors, and no other
+ * attributes.
+ */
+static guac_terminal_char bench_char(int value, int width, int foreground,
+        int background) {
+
+    guac_terminal_char character = {
+        .value = value,
+        .attributes = {
+            .foreground = foreground,
+            .background = background
+        },
+        .width = width
+    };
+
+    return character;
+
+}
+
+/**
+ * Generates plain text resembling build output, padded with blanks to the
+ * full width of the terminal.
+ */
+static int bench_log_row(int row, int width, guac_terminal_char* characters) {
+
+    char text[64];
+    int i, length;
+
+    length = snprintf(text, sizeof(text),
+            "  CC       src/module_%04i/file_%02i.lo", row % 997, row % 53);
+
+    for (i = 0; i < width; i++)
+        characters[i] = bench_char(i < length ? text[i] : 0, 1, 7, 0);
+
+    return width;
+
+}
+
+/**
+ * Generates colored text resembling a directory listing, with several
+ * attribute runs per row.
+ */
+static int bench_listing_row(int row, int width,
+        guac_terminal_char* characters) {
+
+    char text[32];
+    int column = 0;
+    int i, entry;
+
+    for (entry = 0; column < width; entry++) {
+
+        int length = snprintf(text, sizeof(text), "entry%i%s",
+                (row * 7 + entry) % 1000, entry % 3 == 0 ? "/" : ".txt");
+        int foreground = entry % 3 == 0 ? 4 : 2;
+
+        for (i = 0; i < 16 && column < width; i++) {
+            characters[column] = bench_char(i < length ? text[i] : ' ',
+                    1, foreground, 0);
+            characters[column].attributes.bold = (entry % 3 == 0);
+            column++;
+        }
+
+    }
+
+    return width;
+
+}
+
+/**
+ * Generates wide characters, each of which spans two columns.
+ */
+static int bench_wide_row(int row, int width, guac_terminal_char* characters) {
+
+    int i;
+
+    for (i = 0; i < width / 2; i++)
+        characters[i] = bench_char(0x4E00 + (row + i) % 2000, 2, 7, 0);
+
+    return i;
+
+}
+
+/**
+ * Returns whether the given characters have identical values, widths, and
+ * attributes. Characters are compared field by field, as the packed
+ * attributes may contain unused bits.
+ */
+static int bench_char_equal(const guac_terminal_char* a,
+        const guac_terminal_char* b) {
+
+    return a->value == b->value && a->width == b->width
+        && a->attributes.bold       == b->attributes.bold
+        && a->attributes.reverse    == b->attributes.reverse
+        && a->attributes.cursor     == b->attributes.cursor
+        && a->attributes.underscore == b->attributes.underscore
+        && a->attributes.foreground == b->attributes.foreground
+        && a->attributes.background == b->attributes.background;
+
+}
+
+/**
+ * Returns whether the given row begins with exactly the given characters,
+ * each followed by the continuation characters required by its width.
+ */
+static int bench_equal(guac_terminal_buffer_row* row,
+        const guac_terminal_char* expected, int length) {
+
+    int i, j;
+    int column = 0;
+
+    for (i = 0; i < length; i++) {
+
+        guac_terminal_char continuation = expected[i];
+        continuation.value = GUAC_CHAR_CONTINUATION;
+        continuation.width = 0;
+
+        if (column + expected[i].width > row->length
+                || !bench_char_equal(&(row->characters[column++]), &(expected[i])))
+            return 0;
+
+        for (j = 1; j < expected[i].width; j++) {
+            if (!bench_char_equal(&(row->characters[column++]), &continuation))
+                return 0;
+        }
+
+    }
+
+    return 1;
+
+}
+
+/**
+ * Returns the number of bytes of memory used by the rows of the given
+ * buffer, including the row structures themselves.
+ */
+static size_t bench_memory(guac_terminal_buffer* buffer) {
+
+    int i;
+    size_t size = sizeof(guac_terminal_buffer_row) * buffer->available
+        + buffer->workspace_size;
+
+    for (i = 0; i < buffer->available; i++) {
+        guac_terminal_buffer_row* row = &(buffer->rows[i]);
+        size += row->available * sizeof(guac_terminal_char);
+        size += row->compressed_length;
+    }
+
+    return size;
+
+}
+
+/**
+ * Writes rows produced by the given generator to a buffer, scrolling after
+ * each row as the terminal would, then verifies and reports the contents of
+ * the scrollback. Returns zero on success, non-zero if any row was not
+ * restored exactly.
+ */
+static int bench_scrollback(const char* name, bench_row_generator* generate,
+        int width) {
+
+    guac_terminal_char default_character = bench_char(0, 1, 7, 0);
+    guac_terminal_char* expected = malloc(sizeof(guac_terminal_char) * width);
+
+    guac_terminal_buffer* buffer =
+        guac_terminal_buffer_alloc(BENCH_SCROLLBACK, &default_character);
+
+    double start, write_time, read_time;
+    size_t memory, legacy_memory, packed_memory;
+    int i, row, length;
+
+    /* Write and scroll all rows */
+    start = bench_now();
+    for (i = 0; i < BENCH_ROWS; i++) {
+        length = generate(i, width, expected);
+        guac_terminal_buffer_set_characters(buffer, BENCH_HEIGHT - 1, 0,
+                expected, length);
+        guac_terminal_buffer_scroll_up(buffer, BENCH_HEIGHT, 1);
+    }
+    write_time = bench_now() - start;
+
+    memory = bench_memory(buffer);
+
+    legacy_memory = (size_t) BENCH_SCROLLBACK
+        * BENCH_LEGACY_ROW_CELLS * BENCH_LEGACY_CELL_SIZE;
+
+    packed_memory = (size_t) BENCH_SCROLLBACK
+        * width * sizeof(guac_terminal_char);
+
+    /* Read back entire scrollback, verifying each row */
+    start = bench_now();
+    for (row = -1; row >= BENCH_HEIGHT - BENCH_SCROLLBACK; row--) {
+
+        guac_terminal_buffer_row* buffer_row =
+            guac_terminal_buffer_get_row(buffer, row, 0);
+
+        /* Each row scrolls up by one for every row written after it */
+        length = generate(BENCH_ROWS - BENCH_HEIGHT + 1 + row,
+                width, expected);
+
+        if (!bench_equal(buffer_row, expected, length)) {
+            fprintf(stderr, "%s: row %i not restored exactly\n", name, row);
+            return 1;
+        }
+
+        guac_terminal_buffer_compress_row(buffer, row);
+
+    }
+    read_time = bench_now() - start;
+
+    printf("%-8s %3i cols  write %8.0f rows/s  read %8.0f rows/s  "
+           "memory %7.1f KiB (packed %7.1f KiB, legacy %7.1f KiB)\n",
+            name, width,
+            BENCH_ROWS / write_time,
+            (BENCH_SCROLLBACK - BENCH_HEIGHT) / read_time,
+            memory / 1024.0, packed_memory / 1024.0, legacy_memory / 1024.0);
+
+    guac_terminal_buffer_free(buffer);
+    free(expected);
+
+    return 0;
+
+}
+
+int main() {
+
+    int widths[] = { 80, 200 };
+    int i;
+
+    printf("cell size %i bytes (legacy %i bytes)\n",
+            (int) sizeof(guac_terminal_char), BENCH_LEGACY_CELL_SIZE);
+
+    for (i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        if (bench_scrollback("log",     bench_log_row,     widths[i])
+         || bench_scrollback("listing", bench_listing_row, widths[i])
+         || bench_scrollback("wide",    bench_wide_row,    widths[i]))
+            return 1;
+    }
+
+    return 0;
+
+}
+
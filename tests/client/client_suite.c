@@ -48,6 +48,10 @@ int register_client_suite() {
     if (
         CU_add_test(suite, "layer-pool", test_layer_pool) == NULL
      || CU_add_test(suite, "buffer-pool", test_buffer_pool) == NULL
+     || CU_add_test(suite, "pacing", test_pacing) == NULL
+     || CU_add_test(suite, "viewer-state", test_viewer_state) == NULL
+     || CU_add_test(suite, "viewer-ready", test_viewer_ready) == NULL
+     || CU_add_test(suite, "viewer-free", test_viewer_free) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -30,6 +30,10 @@ int register_client_suite();
 
 void test_layer_pool();
 void test_buffer_pool();
+void test_pacing();
+void test_viewer_state();
+void test_viewer_ready();
+void test_viewer_free();
 
 #endif
 
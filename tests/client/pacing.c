@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <CUnit/Basic.h>
+#include <guacamole/pacing.h>
+
+void test_pacing() {
+
+    guac_pacing* pacing;
+
+    /* Defaults are used until measured */
+    pacing = guac_pacing_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pacing);
+    CU_ASSERT_EQUAL(guac_pacing_get_frame_duration(pacing),
+            GUAC_PACING_DEFAULT_FRAME_DURATION);
+    CU_ASSERT_EQUAL(guac_pacing_get_lossy_quality(pacing, 80), 80);
+    CU_ASSERT_EQUAL(guac_pacing_get_max_lag(pacing),
+            GUAC_PACING_DEFAULT_FRAME_DURATION * 2);
+
+    /* Frames delivered almost instantly run at full rate */
+    guac_pacing_frame_sent(pacing, 1000, 10000);
+    guac_pacing_frame_acknowledged(pacing, 1000, 1001);
+    guac_pacing_frame_sent(pacing, 1016, 20000);
+    guac_pacing_frame_acknowledged(pacing, 1016, 1017);
+    CU_ASSERT_EQUAL(pacing->min_round_trip, 1);
+    CU_ASSERT_EQUAL(guac_pacing_get_frame_duration(pacing),
+            GUAC_PACING_MIN_FRAME_DURATION);
+    CU_ASSERT_EQUAL(guac_pacing_get_lossy_quality(pacing, 80), 80);
+
+    /* Acknowledgements of unknown frames are ignored */
+    guac_pacing_frame_acknowledged(pacing, 5000, 5001);
+    CU_ASSERT_EQUAL(pacing->round_trip, 1);
+
+    guac_pacing_free(pacing);
+
+    /* Empty frame measures unloaded round trip of 20 ms */
+    pacing = guac_pacing_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pacing);
+    guac_pacing_frame_sent(pacing, 0, 0);
+    guac_pacing_frame_acknowledged(pacing, 0, 20);
+    CU_ASSERT_EQUAL(pacing->min_round_trip, 20);
+    CU_ASSERT_EQUAL(pacing->bandwidth, 0);
+
+    /* A 100000-byte frame taking 100 ms to arrive measures 1 MB/s, and
+     * lengthens frames to match */
+    guac_pacing_frame_sent(pacing, 100, 100000);
+    guac_pacing_frame_acknowledged(pacing, 100, 220);
+    CU_ASSERT_EQUAL(pacing->bandwidth, 1000000);
+    CU_ASSERT_EQUAL(guac_pacing_get_frame_duration(pacing), 100);
+    CU_ASSERT_EQUAL(guac_pacing_get_max_lag(pacing), 20 + 100 * 2);
+
+    /* Lossy quality is reduced, but lossless updates remain lossless */
+    CU_ASSERT(guac_pacing_get_lossy_quality(pacing, 80) < 80);
+    CU_ASSERT(guac_pacing_get_lossy_quality(pacing, 80)
+            > GUAC_PACING_MIN_LOSSY_QUALITY);
+    CU_ASSERT_EQUAL(guac_pacing_get_lossy_quality(pacing, 0), 0);
+
+    /* Frames acknowledged together are measured together */
+    guac_pacing_frame_sent(pacing, 300, 200000);
+    guac_pacing_frame_sent(pacing, 310, 300000);
+    guac_pacing_frame_acknowledged(pacing, 310, 530);
+    CU_ASSERT_EQUAL(pacing->bandwidth, 1000000);
+    CU_ASSERT_EQUAL(guac_pacing_get_frame_duration(pacing), 100);
+
+    guac_pacing_free(pacing);
+
+}
+
@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/viewer.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The number of viewers added and removed concurrently while the client is
+ * freed.
+ */
+#define VIEWER_THREADS 16
+
+/**
+ * The size of each block of output written by the client.
+ */
+#define OUTPUT_BLOCK_SIZE 65536
+
+/**
+ * Socket output gate, which blocks all writes to the sockets of viewers
+ * while closed, such that output queues for those viewers.
+ */
+typedef struct output_gate {
+
+    /**
+     * Non-zero if writes are currently blocked.
+     */
+    int closed;
+
+    /**
+     * Lock guarding the gate.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition signalled whenever the gate is opened.
+     */
+    pthread_cond_t opened;
+
+} output_gate;
+
+/**
+ * The gate of all viewer sockets used by the tests.
+ */
+static output_gate gate = {
+    .closed = 0,
+    .lock   = PTHREAD_MUTEX_INITIALIZER,
+    .opened = PTHREAD_COND_INITIALIZER
+};
+
+/**
+ * The number of times the join handler has been invoked.
+ */
+static int joins = 0;
+
+/**
+ * Discards all written data, first waiting for the output gate to open.
+ */
+static ssize_t gated_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    pthread_mutex_lock(&gate.lock);
+    while (gate.closed)
+        pthread_cond_wait(&gate.opened, &gate.lock);
+    pthread_mutex_unlock(&gate.lock);
+
+    return count;
+
+}
+
+/**
+ * Discards all written data.
+ */
+static ssize_t sink_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+    return count;
+}
+
+/**
+ * Data written to capturing sockets, guarded by captured_lock.
+ */
+static char captured[1024];
+
+/**
+ * The number of bytes stored within captured.
+ */
+static size_t captured_length = 0;
+
+/**
+ * Lock guarding captured and captured_length.
+ */
+static pthread_mutex_t captured_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Stores all written data within captured, discarding anything which does
+ * not fit.
+ */
+static ssize_t capture_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    size_t length = count;
+
+    pthread_mutex_lock(&captured_lock);
+
+    if (length > sizeof(captured) - captured_length)
+        length = sizeof(captured) - captured_length;
+
+    memcpy(captured + captured_length, buf, length);
+    captured_length += length;
+
+    pthread_mutex_unlock(&captured_lock);
+    return count;
+
+}
+
+/**
+ * Opens or closes the output gate.
+ */
+static void set_gate(int closed) {
+    pthread_mutex_lock(&gate.lock);
+    gate.closed = closed;
+    pthread_cond_broadcast(&gate.opened);
+    pthread_mutex_unlock(&gate.lock);
+}
+
+/**
+ * Join handler which sends nothing, counting each invocation.
+ */
+static int join_handler(guac_client* client, guac_socket* socket) {
+    joins++;
+    return 0;
+}
+
+/**
+ * Allocates a new socket which discards all data written to it, waiting for
+ * the output gate to open if gated is non-zero.
+ */
+static guac_socket* sink_socket(int gated) {
+
+    guac_socket* socket = guac_socket_alloc();
+    if (socket != NULL)
+        socket->write_handler = gated ? gated_write_handler
+                                      : sink_write_handler;
+
+    return socket;
+
+}
+
+/**
+ * Allocates a new client which allows viewers, sending its own output to
+ * the given socket.
+ */
+static guac_client* viewable_client(guac_socket* owner) {
+
+    guac_client* client = guac_client_alloc();
+    if (client == NULL)
+        return NULL;
+
+    client->socket = owner;
+    client->join_handler = join_handler;
+
+    if (guac_client_allow_viewers(client)) {
+        guac_client_free(client);
+        return NULL;
+    }
+
+    return client;
+
+}
+
+/**
+ * Writes the given number of bytes as output of the given client.
+ */
+static void write_output(guac_client* client, size_t length) {
+
+    static char block[OUTPUT_BLOCK_SIZE];
+
+    while (length > 0) {
+
+        size_t count = length;
+        if (count > sizeof(block))
+            count = sizeof(block);
+
+        guac_socket_write(client->socket, block, count);
+        length -= count;
+
+    }
+
+    guac_socket_flush(client->socket);
+
+}
+
+/**
+ * Returns the number of bytes queued for the given viewer.
+ */
+static size_t backlog_of(guac_viewer* viewer) {
+
+    size_t backlog;
+
+    pthread_mutex_lock(&(viewer->__lock));
+    backlog = viewer->__pending_length;
+    pthread_mutex_unlock(&(viewer->__lock));
+
+    return backlog;
+
+}
+
+/**
+ * Waits up to one second for the writer thread of the given viewer to take
+ * all queued data.
+ */
+static void wait_for_drain(guac_viewer* viewer) {
+
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 1000000 };
+    int i;
+
+    for (i = 0; i < 1000 && backlog_of(viewer) > 0; i++)
+        nanosleep(&delay, NULL);
+
+}
+
+void test_viewer_state() {
+
+    guac_socket* owner = sink_socket(0);
+    guac_socket* socket = sink_socket(1);
+    guac_client* client;
+    guac_viewer* viewer;
+    size_t backlog;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(owner);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    client = viewable_client(owner);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_EQUAL(client->socket, owner);
+
+    joins = 0;
+
+    /* Viewers receive the state of the client at the end of the next
+     * frame */
+    viewer = guac_client_add_viewer(client, socket, 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(viewer);
+    CU_ASSERT_EQUAL(viewer->__state, GUAC_VIEWER_JOINING);
+    CU_ASSERT_EQUAL(joins, 0);
+
+    guac_client_sync_viewers(client);
+    CU_ASSERT_EQUAL(viewer->__state, GUAC_VIEWER_ACTIVE);
+    CU_ASSERT_EQUAL(joins, 1);
+
+    /* Output queues while the viewer cannot keep up, once the writer
+     * thread is blocked */
+    set_gate(1);
+    write_output(client, OUTPUT_BLOCK_SIZE);
+    wait_for_drain(viewer);
+    write_output(client, GUAC_VIEWER_MAX_BACKLOG * 2);
+    CU_ASSERT(backlog_of(viewer) > GUAC_VIEWER_MAX_BACKLOG);
+
+    /* Viewers too far behind skip output */
+    guac_client_sync_viewers(client);
+    CU_ASSERT_EQUAL(viewer->__state, GUAC_VIEWER_LAGGING);
+    CU_ASSERT_EQUAL(viewer->__lag_count, 1);
+
+    backlog = backlog_of(viewer);
+    write_output(client, OUTPUT_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(backlog_of(viewer), backlog);
+
+    /* Caught-up viewers are not resynchronized too often */
+    set_gate(0);
+    wait_for_drain(viewer);
+    CU_ASSERT_EQUAL_FATAL(backlog_of(viewer), 0);
+
+    guac_client_sync_viewers(client);
+    CU_ASSERT_EQUAL(viewer->__state, GUAC_VIEWER_LAGGING);
+    CU_ASSERT_EQUAL(joins, 1);
+
+    viewer->__joined -= GUAC_VIEWER_RESYNC_INTERVAL;
+    guac_client_sync_viewers(client);
+    CU_ASSERT_EQUAL(viewer->__state, GUAC_VIEWER_ACTIVE);
+    CU_ASSERT_EQUAL(joins, 2);
+    CU_ASSERT(!guac_viewer_failed(viewer));
+
+    /* Viewers which repeatedly fall behind soon after joining are
+     * disconnected */
+    viewer->__lag_count = GUAC_VIEWER_MAX_LAGS;
+    set_gate(1);
+    write_output(client, OUTPUT_BLOCK_SIZE);
+    wait_for_drain(viewer);
+    write_output(client, GUAC_VIEWER_MAX_BACKLOG * 2);
+    guac_client_sync_viewers(client);
+    CU_ASSERT(guac_viewer_failed(viewer));
+    CU_ASSERT_EQUAL(backlog_of(viewer), 0);
+
+    /* Failed viewers receive nothing further */
+    write_output(client, OUTPUT_BLOCK_SIZE);
+    CU_ASSERT_EQUAL(backlog_of(viewer), 0);
+
+    set_gate(0);
+    guac_client_remove_viewer(viewer);
+    guac_client_free(client);
+
+    guac_socket_free(socket);
+    guac_socket_free(owner);
+
+}
+
+void test_viewer_ready() {
+
+    guac_socket* owner = sink_socket(0);
+    guac_socket* socket = guac_socket_alloc();
+    guac_client* client;
+    guac_viewer* viewer;
+    char expected[256];
+    size_t length;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(owner);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = capture_write_handler;
+
+    client = viewable_client(owner);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    captured_length = 0;
+
+    /* Viewers are told the connection ID ahead of any output of the client,
+     * even output written as the viewer is added */
+    viewer = guac_client_add_viewer(client, socket, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(viewer);
+
+    write_output(client, OUTPUT_BLOCK_SIZE);
+    guac_client_sync_viewers(client);
+    wait_for_drain(viewer);
+
+    snprintf(expected, sizeof(expected), "5.ready,%i.%s;",
+            (int) strlen(client->connection_id), client->connection_id);
+    length = strlen(expected);
+
+    pthread_mutex_lock(&captured_lock);
+    CU_ASSERT_FATAL(captured_length >= length);
+    CU_ASSERT_NSTRING_EQUAL(captured, expected, length);
+    pthread_mutex_unlock(&captured_lock);
+
+    guac_client_remove_viewer(viewer);
+    guac_client_free(client);
+
+    guac_socket_free(socket);
+    guac_socket_free(owner);
+
+}
+
+/**
+ * State shared by the threads adding and removing viewers while the client
+ * is freed.
+ */
+typedef struct viewer_race {
+
+    /**
+     * The client being viewed.
+     */
+    guac_client* client;
+
+    /**
+     * The number of threads which have attempted to add a viewer.
+     */
+    int attempted;
+
+    /**
+     * The number of viewers successfully added.
+     */
+    int added;
+
+    /**
+     * The number of viewers removed.
+     */
+    int removed;
+
+    /**
+     * Non-zero once the threads may add their viewers.
+     */
+    int started;
+
+    /**
+     * Lock guarding the counters and flag of this structure.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition signalled when the threads are started and whenever a
+     * counter changes.
+     */
+    pthread_cond_t changed;
+
+} viewer_race;
+
+/**
+ * Adds a single viewer to the client of the given viewer_race as soon as
+ * started, removing that viewer again shortly after.
+ */
+static void* viewer_race_thread(void* data) {
+
+    viewer_race* race = (viewer_race*) data;
+    struct timespec delay = { .tv_sec = 0, .tv_nsec = 2000000 };
+    guac_socket* socket = sink_socket(0);
+    guac_viewer* viewer;
+
+    pthread_mutex_lock(&race->lock);
+    while (!race->started)
+        pthread_cond_wait(&race->changed, &race->lock);
+    pthread_mutex_unlock(&race->lock);
+
+    viewer = guac_client_add_viewer(race->client, socket, 1);
+
+    pthread_mutex_lock(&race->lock);
+    race->attempted++;
+    if (viewer != NULL)
+        race->added++;
+    pthread_cond_broadcast(&race->changed);
+    pthread_mutex_unlock(&race->lock);
+
+    if (viewer != NULL) {
+
+        nanosleep(&delay, NULL);
+        guac_client_remove_viewer(viewer);
+
+        pthread_mutex_lock(&race->lock);
+        race->removed++;
+        pthread_mutex_unlock(&race->lock);
+
+    }
+
+    guac_socket_free(socket);
+    return NULL;
+
+}
+
+void test_viewer_free() {
+
+    pthread_t threads[VIEWER_THREADS];
+    guac_socket* owner = sink_socket(0);
+    viewer_race race;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(owner);
+
+    memset(&race, 0, sizeof(race));
+    pthread_mutex_init(&race.lock, NULL);
+    pthread_cond_init(&race.changed, NULL);
+
+    race.client = viewable_client(owner);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(race.client);
+
+    for (i = 0; i < VIEWER_THREADS; i++)
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[i], NULL,
+                    viewer_race_thread, &race), 0);
+
+    /* Stop the client while viewers are being added */
+    pthread_mutex_lock(&race.lock);
+    race.started = 1;
+    pthread_cond_broadcast(&race.changed);
+    pthread_mutex_unlock(&race.lock);
+
+    guac_client_stop(race.client);
+
+    /* Viewers can no longer be added once stopped */
+    CU_ASSERT_PTR_NULL(guac_client_add_viewer(race.client, owner, 1));
+
+    /* Free only after every thread is done with the client, waiting for
+     * viewers which are still being removed */
+    pthread_mutex_lock(&race.lock);
+    while (race.attempted < VIEWER_THREADS)
+        pthread_cond_wait(&race.changed, &race.lock);
+    pthread_mutex_unlock(&race.lock);
+
+    guac_client_free(race.client);
+
+    for (i = 0; i < VIEWER_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CU_ASSERT_EQUAL(race.removed, race.added);
+
+    pthread_mutex_destroy(&race.lock);
+    pthread_cond_destroy(&race.changed);
+    guac_socket_free(owner);
+
+}
+
@@ -47,7 +47,14 @@ int register_common_suite() {
     /* Add tests */
     if (
         CU_add_test(suite, "guac-iconv", test_guac_iconv)  == NULL
+     || CU_add_test(suite, "guac-image-cache", test_guac_image_cache) == NULL
+     || CU_add_test(suite, "guac-image-cache-size", test_guac_image_cache_size) == NULL
      || CU_add_test(suite, "guac-string", test_guac_string) == NULL
+     || CU_add_test(suite, "guac-surface-kernels", test_guac_surface_kernels) == NULL
+     || CU_add_test(suite, "guac-surface-copy", test_guac_surface_copy) == NULL
+     || CU_add_test(suite, "guac-surface-damage", test_guac_surface_damage) == NULL
+     || CU_add_test(suite, "guac-surface-image-cache", test_guac_surface_image_cache) == NULL
+     || CU_add_test(suite, "guac-surface-motion", test_guac_surface_motion) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -49,5 +49,42 @@ void test_guac_string();
  */
 void test_guac_iconv();
 
+/**
+ * Unit test for the row kernels used to update surfaces.
+ */
+void test_guac_surface_kernels();
+
+/**
+ * Unit test for copies and transfers within a single surface, and for
+ * flushing a surface which is not associated with any client.
+ */
+void test_guac_surface_copy();
+
+/**
+ * Unit test for the tile-based damage tracking of surfaces.
+ */
+void test_guac_surface_damage();
+
+/**
+ * Unit test for the image cache.
+ */
+void test_guac_image_cache();
+
+/**
+ * Unit test for the parsing of image cache sizes.
+ */
+void test_guac_image_cache_size();
+
+/**
+ * Unit test for surfaces which copy previously-sent images from an image
+ * cache.
+ */
+void test_guac_surface_image_cache();
+
+/**
+ * Unit test for the detection of scrolled or moved content within surfaces.
+ */
+void test_guac_surface_motion();
+
 #endif
 
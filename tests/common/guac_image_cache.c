@@ -0,0 +1,215 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "guac_image_cache.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/hash.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+/**
+ * Allocates a new image of the given size and format, filled with the given
+ * color.
+ */
+static cairo_surface_t* __test_image(cairo_format_t format, int w, int h,
+        uint32_t color) {
+
+    cairo_surface_t* image = cairo_image_surface_create(format, w, h);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    int x, y;
+
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            ((uint32_t*) (data + y * stride))[x] = color;
+
+    cairo_surface_mark_dirty(image);
+    return image;
+
+}
+
+void test_guac_image_cache() {
+
+    guac_layer layer = { .index = 1 };
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_alloc();
+    guac_common_image_cache* cache;
+
+    cairo_surface_t* red;
+    cairo_surface_t* green;
+    cairo_surface_t* blue;
+    cairo_surface_t* clear;
+    cairo_surface_t* small;
+    const guac_layer* red_buffer;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Room for exactly two 64x64 images */
+    cache = guac_common_image_cache_alloc(client, 64 * 64 * 4 * 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    red   = __test_image(CAIRO_FORMAT_RGB24,  64, 64, 0xFFFF0000);
+    green = __test_image(CAIRO_FORMAT_RGB24,  64, 64, 0xFF00FF00);
+    blue  = __test_image(CAIRO_FORMAT_RGB24,  64, 64, 0xFF0000FF);
+    clear = __test_image(CAIRO_FORMAT_ARGB32, 64, 64, 0x00000000);
+    small = __test_image(CAIRO_FORMAT_RGB24,   8,  8, 0xFFFF0000);
+
+    /* Only images which are neither trivial nor excessive are accepted */
+    CU_ASSERT_TRUE(guac_common_image_cache_accepts(cache, 64, 64));
+    CU_ASSERT_TRUE(guac_common_image_cache_accepts(cache, 128, 64));
+    CU_ASSERT_FALSE(guac_common_image_cache_accepts(cache, 8, 8));
+    CU_ASSERT_FALSE(guac_common_image_cache_accepts(cache, 128, 128));
+
+    /* Images are found only once stored */
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, red,
+                guac_hash_surface(red)));
+    guac_common_image_cache_store(cache, socket, red, guac_hash_surface(red),
+            &layer, 0, 0);
+    red_buffer = guac_common_image_cache_lookup(cache, red,
+            guac_hash_surface(red));
+    CU_ASSERT_PTR_NOT_NULL(red_buffer);
+    CU_ASSERT_TRUE(red_buffer->index < 0);
+
+    /* Images sharing a hash must still match exactly */
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, green,
+                guac_hash_surface(red)));
+
+    /* Ignored images are never stored */
+    guac_common_image_cache_store(cache, socket, clear,
+            guac_hash_surface(clear), &layer, 0, 0);
+    guac_common_image_cache_store(cache, socket, small,
+            guac_hash_surface(small), &layer, 0, 0);
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, clear,
+                guac_hash_surface(clear)));
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, small,
+                guac_hash_surface(small)));
+    CU_ASSERT_EQUAL(cache->size, 64 * 64 * 4);
+
+    /* The least recently used image is evicted once full */
+    guac_common_image_cache_store(cache, socket, green,
+            guac_hash_surface(green), &layer, 0, 0);
+    CU_ASSERT_PTR_EQUAL(guac_common_image_cache_lookup(cache, red,
+                guac_hash_surface(red)), red_buffer);
+    guac_common_image_cache_store(cache, socket, blue,
+            guac_hash_surface(blue), &layer, 0, 0);
+
+    CU_ASSERT_EQUAL(cache->evictions, 1);
+    CU_ASSERT_EQUAL(cache->size, 64 * 64 * 4 * 2);
+    CU_ASSERT_PTR_NOT_NULL(guac_common_image_cache_lookup(cache, red,
+                guac_hash_surface(red)));
+    CU_ASSERT_PTR_NOT_NULL(guac_common_image_cache_lookup(cache, blue,
+                guac_hash_surface(blue)));
+    CU_ASSERT_PTR_NULL(guac_common_image_cache_lookup(cache, green,
+                guac_hash_surface(green)));
+
+    cairo_surface_destroy(red);
+    cairo_surface_destroy(green);
+    cairo_surface_destroy(blue);
+    cairo_surface_destroy(clear);
+    cairo_surface_destroy(small);
+
+    guac_common_image_cache_free(cache);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+void test_guac_image_cache_size() {
+
+    /* Valid sizes are given in kilobytes */
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("1"), 1024);
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("16384"),
+            (size_t) 16384 * 1024);
+
+    /* Invalid sizes disable the cache */
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size(""), 0);
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("0"), 0);
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("-1"), 0);
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("12k"), 0);
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("none"), 0);
+
+    /* Excessive sizes, including those which would overflow, are limited */
+    CU_ASSERT_EQUAL(guac_common_image_cache_parse_size("2097152"),
+            (size_t) GUAC_COMMON_IMAGE_CACHE_MAX_SIZE * 1024);
+    CU_ASSERT_EQUAL(
+            guac_common_image_cache_parse_size("99999999999999999999999"),
+            (size_t) GUAC_COMMON_IMAGE_CACHE_MAX_SIZE * 1024);
+
+}
+
+void test_guac_surface_image_cache() {
+
+    guac_layer layer = { .index = 1 };
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_alloc();
+    guac_common_surface* surface;
+
+    cairo_surface_t* first = __test_image(CAIRO_FORMAT_RGB24, 64, 64,
+            0xFF336699);
+    cairo_surface_t* second = __test_image(CAIRO_FORMAT_RGB24, 64, 64,
+            0xFF996633);
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    surface = guac_common_surface_alloc(client, socket, &layer, 256, 256);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+    surface->image_cache = guac_common_image_cache_alloc(client, 1024 * 1024);
+
+    /* Images are sent normally the first time */
+    guac_common_surface_draw(surface, 10, 10, first);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.cached_updates, 0);
+
+    guac_common_surface_draw(surface, 10, 10, second);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.cached_updates, 0);
+
+    /* Images sent again are copied from the cache, even if moved */
+    guac_common_surface_draw(surface, 100, 120, first);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 0);
+    CU_ASSERT_EQUAL(surface->last_flush.cached_updates, 1);
+    CU_ASSERT_EQUAL(surface->image_cache->hits, 1);
+
+    cairo_surface_destroy(first);
+    cairo_surface_destroy(second);
+
+    guac_common_image_cache_free(surface->image_cache);
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+/**
+ * Draws a rectangle of the given solid color to the given surface.
+ */
+static void __test_surface_draw(guac_common_surface* surface,
+        int x, int y, int w, int h, uint32_t color) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            w, h);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    int i, j;
+
+    for (j = 0; j < h; j++)
+        for (i = 0; i < w; i++)
+            ((uint32_t*) (data + j * stride))[i] = color;
+
+    cairo_surface_mark_dirty(image);
+    guac_common_surface_draw(surface, x, y, image);
+    cairo_surface_destroy(image);
+
+}
+
+void test_guac_surface_damage() {
+
+    guac_layer buffer = { .index = -1 };
+    guac_layer glyph_buffer = { .index = -2 };
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_alloc();
+    guac_common_surface* surface;
+    guac_common_surface* glyphs;
+
+    int size = GUAC_COMMON_SURFACE_TILE_SIZE;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    surface = guac_common_surface_alloc(client, socket, &buffer,
+            size * 8, size * 4);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /* Damage split across four tiles is sent as a single update */
+    __test_surface_draw(surface, size / 2, size / 2, size, size, 0xFF336699);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.damaged_tiles, 4);
+    CU_ASSERT_EQUAL(surface->last_flush.unchanged_tiles, 0);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, size * size);
+
+    /* Erasing and redrawing the same content sends nothing */
+    __test_surface_draw(surface, size / 2, size / 2, size, size, 0xFF000000);
+    __test_surface_draw(surface, size / 2, size / 2, size, size, 0xFF336699);
+    CU_ASSERT_TRUE(surface->dirty);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.damaged_tiles, 4);
+    CU_ASSERT_EQUAL(surface->last_flush.unchanged_tiles, 4);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 0);
+    CU_ASSERT_FALSE(surface->dirty);
+
+    /* Distant damage is sent as separate updates covering only the damage */
+    __test_surface_draw(surface, 1, 2, 3, 4, 0xFFFFFFFF);
+    __test_surface_draw(surface, size * 7 + 5, size * 3 + 6, 7, 8, 0xFFFFFFFF);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.damaged_tiles, 2);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 2);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, 3*4 + 7*8);
+
+    /* Nearby damage within different tiles is combined */
+    __test_surface_draw(surface, size - 2, 0, 1, 1, 0xFF000000);
+    __test_surface_draw(surface, size + 1, 1, 1, 1, 0xFF000000);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.damaged_tiles, 2);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, 4 * 2);
+
+    /* Damage beyond the bounds of a resized surface is discarded */
+    __test_surface_draw(surface, size * 7, size * 3, size, size, 0xFF123456);
+    CU_ASSERT_TRUE(surface->dirty);
+    guac_common_surface_resize(surface, size * 4, size * 2);
+    CU_ASSERT_FALSE(surface->dirty);
+
+    /* Damage within the bounds of a resized surface is retained */
+    __test_surface_draw(surface, size * 3, size, size, size, 0xFF123456);
+    guac_common_surface_resize(surface, size * 3 + 5, size * 2);
+    CU_ASSERT_TRUE(surface->dirty);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, 5 * size);
+
+    /* Immediate copies from another surface are never deferred as damage */
+    glyphs = guac_common_surface_alloc(client, socket, &glyph_buffer,
+            size, size);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(glyphs);
+    __test_surface_draw(glyphs, 0, 0, 9, 18, 0xFF00FF00);
+    guac_common_surface_copy_immediate(glyphs, 0, 0, 9, 18, surface, 10, 20);
+    CU_ASSERT_FALSE(glyphs->dirty);
+    CU_ASSERT_FALSE(surface->dirty);
+    CU_ASSERT_EQUAL(((uint32_t*) (surface->buffer + 20 * surface->stride))[10],
+            0xFF00FF00);
+
+    /* Other pending damage is left pending */
+    __test_surface_draw(surface, size * 2, 0, 4, 4, 0xFFFFFFFF);
+    guac_common_surface_copy_immediate(glyphs, 0, 0, 9, 18, surface, 20, 20);
+    CU_ASSERT_TRUE(surface->dirty);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, 4 * 4);
+
+    /* Without a damage map, all damage is sent as one update covering the
+     * bounds of that damage */
+    free(surface->tiles);
+    free(surface->damage);
+    surface->tiles = NULL;
+    surface->damage = NULL;
+    surface->tile_columns = surface->tile_rows = 0;
+
+    __test_surface_draw(surface, 1, 2, 3, 4, 0xFF654321);
+    __test_surface_draw(surface, size * 2 + 5, size + 6, 7, 8, 0xFF654321);
+    CU_ASSERT_TRUE(surface->dirty);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_FALSE(surface->dirty);
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels,
+            (size * 2 + 11) * (size + 12));
+
+    guac_common_surface_free(glyphs);
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
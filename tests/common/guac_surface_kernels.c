@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "guac_surface.h"
+#include "guac_surface_kernels.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <cairo/cairo.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol-types.h>
+#include <guacamole/socket.h>
+
+/**
+ * The widest row tested, in pixels. This is large enough to exercise the
+ * vectorized portion of every kernel as well as each possible remainder.
+ */
+#define TEST_KERNEL_MAX_WIDTH 67
+
+/**
+ * The number of randomized rows tested for each kernel and width.
+ */
+#define TEST_KERNEL_ROUNDS 16
+
+/**
+ * The width and height of the surface used to test copies, in pixels.
+ */
+#define TEST_COPY_SIZE 48
+
+/**
+ * The kind of row update performed by __test_kernel_run().
+ */
+typedef enum test_kernel_op {
+    TEST_KERNEL_PUT_OPAQUE,
+    TEST_KERNEL_PUT_EXACT,
+    TEST_KERNEL_PUT_ALPHA,
+    TEST_KERNEL_FILL_MASK,
+    TEST_KERNEL_FILL
+} test_kernel_op;
+
+/**
+ * Fills the given source and destination rows with random pixels, with the
+ * destination agreeing with the source far more often than not, such that
+ * changed columns are sparse. Roughly half of the source pixels are fully
+ * transparent.
+ */
+static void __test_kernel_randomize(uint32_t* src, uint32_t* dst, int width) {
+
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        uint32_t color = rand() & 0x03;
+
+        src[x] = ((rand() & 1) ? 0xFF000000 : 0x00000000) | color;
+        dst[x] = 0xFF000000 | color;
+
+        /* Occasionally differ from the source */
+        if ((rand() & 7) == 0)
+            dst[x] ^= 0x00010000;
+
+    }
+
+}
+
+/**
+ * Performs the given update on the given row using the given kernels,
+ * returning the result of the kernel.
+ */
+static int __test_kernel_run(const guac_common_surface_kernels* kernels,
+        test_kernel_op op, const uint32_t* src, uint32_t* dst, int width,
+        int* first, int* last) {
+
+    switch (op) {
+
+        case TEST_KERNEL_PUT_OPAQUE:
+            return kernels->put(src, dst, width, 0xFF000000, first, last);
+
+        case TEST_KERNEL_PUT_EXACT:
+            return kernels->put(src, dst, width, 0x00000000, first, last);
+
+        case TEST_KERNEL_PUT_ALPHA:
+            return kernels->mask(src, dst, width, 0xFFFFFFFF, 0xFF000000,
+                    first, last);
+
+        case TEST_KERNEL_FILL_MASK:
+            return kernels->mask(src, dst, width, 0x00000000, 0xFF000003,
+                    first, last);
+
+        case TEST_KERNEL_FILL:
+            return kernels->fill(dst, width, 0xFF000001, first, last);
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Performs the given update on the given row one pixel at a time, without
+ * using any kernel, storing the expected result in the given row.
+ */
+static void __test_kernel_expect(test_kernel_op op, const uint32_t* src,
+        uint32_t* dst, int width) {
+
+    int x;
+
+    for (x = 0; x < width; x++) {
+
+        int opaque = (src[x] & 0xFF000000) != 0;
+
+        switch (op) {
+
+            case TEST_KERNEL_PUT_OPAQUE:
+                dst[x] = src[x] | 0xFF000000;
+                break;
+
+            case TEST_KERNEL_PUT_EXACT:
+                dst[x] = src[x];
+                break;
+
+            case TEST_KERNEL_PUT_ALPHA:
+                if (opaque) dst[x] = src[x] | 0xFF000000;
+                break;
+
+            case TEST_KERNEL_FILL_MASK:
+                if (opaque) dst[x] = 0xFF000003;
+                break;
+
+            case TEST_KERNEL_FILL:
+                dst[x] = 0xFF000001;
+                break;
+
+        }
+
+    }
+
+}
+
+/**
+ * Verifies the given kernels against the expected result of each update,
+ * including the reported range of changed columns.
+ */
+static void __test_kernels_verify(const guac_common_surface_kernels* kernels) {
+
+    uint32_t src[TEST_KERNEL_MAX_WIDTH];
+    uint32_t dst[TEST_KERNEL_MAX_WIDTH];
+    uint32_t orig[TEST_KERNEL_MAX_WIDTH];
+    uint32_t expected[TEST_KERNEL_MAX_WIDTH];
+
+    test_kernel_op op;
+    int width, round;
+
+    for (op = TEST_KERNEL_PUT_OPAQUE; op <= TEST_KERNEL_FILL; op++) {
+        for (width = 0; width <= TEST_KERNEL_MAX_WIDTH; width++) {
+            for (round = 0; round < TEST_KERNEL_ROUNDS; round++) {
+
+                int first = -1, last = -1;
+                int expected_first = -1, expected_last = -1;
+                int changed, x;
+
+                __test_kernel_randomize(src, dst, width);
+                memcpy(orig, dst, sizeof(dst));
+                memcpy(expected, dst, sizeof(dst));
+
+                __test_kernel_expect(op, src, expected, width);
+                changed = __test_kernel_run(kernels, op, src, dst, width,
+                        &first, &last);
+
+                /* Determine expected range of changed columns */
+                for (x = 0; x < width; x++) {
+                    if (expected[x] != orig[x]) {
+                        if (expected_first < 0) expected_first = x;
+                        expected_last = x;
+                    }
+                }
+
+                CU_ASSERT_EQUAL(0, memcmp(expected, dst,
+                            width * sizeof(uint32_t)));
+                CU_ASSERT_EQUAL(expected_first >= 0, changed != 0);
+
+                if (changed) {
+                    CU_ASSERT_EQUAL(expected_first, first);
+                    CU_ASSERT_EQUAL(expected_last, last);
+                }
+
+            }
+        }
+    }
+
+}
+
+/**
+ * Returns the result of applying the given transfer function to the given
+ * source and destination pixels, evaluated independently of any kernel.
+ */
+static uint32_t __test_transfer_expect(guac_transfer_function op,
+        uint32_t src, uint32_t dst) {
+
+    switch (op) {
+        case GUAC_TRANSFER_BINARY_BLACK:     return 0xFF000000;
+        case GUAC_TRANSFER_BINARY_WHITE:     return 0xFFFFFFFF;
+        case GUAC_TRANSFER_BINARY_SRC:       return src;
+        case GUAC_TRANSFER_BINARY_DEST:      return dst;
+        case GUAC_TRANSFER_BINARY_NSRC:      return ~src;
+        case GUAC_TRANSFER_BINARY_NDEST:     return ~dst;
+        case GUAC_TRANSFER_BINARY_AND:       return dst & src;
+        case GUAC_TRANSFER_BINARY_NAND:      return ~(dst & src);
+        case GUAC_TRANSFER_BINARY_OR:        return dst | src;
+        case GUAC_TRANSFER_BINARY_NOR:       return ~(dst | src);
+        case GUAC_TRANSFER_BINARY_XOR:       return dst ^ src;
+        case GUAC_TRANSFER_BINARY_XNOR:      return ~(dst ^ src);
+        case GUAC_TRANSFER_BINARY_NSRC_AND:  return dst & ~src;
+        case GUAC_TRANSFER_BINARY_NSRC_NAND: return ~(dst & ~src);
+        case GUAC_TRANSFER_BINARY_NSRC_OR:   return dst | ~src;
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:  return ~(dst | ~src);
+    }
+
+    return dst;
+
+}
+
+/**
+ * Verifies the transfer kernels of the given kernels against the expected
+ * result of each transfer function, including the reported range of changed
+ * columns.
+ */
+static void __test_transfer_kernels_verify(
+        const guac_common_surface_kernels* kernels) {
+
+    uint32_t src[TEST_KERNEL_MAX_WIDTH];
+    uint32_t dst[TEST_KERNEL_MAX_WIDTH];
+    uint32_t expected[TEST_KERNEL_MAX_WIDTH];
+
+    int op, width, round;
+
+    for (op = 0; op < GUAC_COMMON_SURFACE_TRANSFER_FUNCTIONS; op++) {
+
+        guac_common_surface_transfer_kernel* kernel = kernels->transfer[op];
+
+        /* Only DEST, which never changes anything, lacks a kernel */
+        if (op == GUAC_TRANSFER_BINARY_DEST) {
+            CU_ASSERT_PTR_NULL(kernel);
+            continue;
+        }
+
+        CU_ASSERT_PTR_NOT_NULL_FATAL(kernel);
+
+        for (width = 0; width <= TEST_KERNEL_MAX_WIDTH; width++) {
+            for (round = 0; round < TEST_KERNEL_ROUNDS; round++) {
+
+                int first = -1, last = -1;
+                int expected_first = -1, expected_last = -1;
+                int changed, x;
+
+                /* Sparse bits, such that results frequently match the
+                 * original destination */
+                for (x = 0; x < width; x++) {
+                    src[x] = (uint32_t) (rand() & 0x0101) * 0x01010101;
+                    dst[x] = (uint32_t) (rand() & 0x0101) * 0x01010101;
+                    if (round & 1) src[x] = ~src[x];
+                    if (round & 2) dst[x] = ~dst[x];
+                }
+
+                for (x = 0; x < width; x++) {
+                    expected[x] = __test_transfer_expect(op, src[x], dst[x]);
+                    if (expected[x] != dst[x]) {
+                        if (expected_first < 0) expected_first = x;
+                        expected_last = x;
+                    }
+                }
+
+                changed = kernel(src, dst, width, &first, &last);
+
+                CU_ASSERT_EQUAL(0, memcmp(expected, dst,
+                            width * sizeof(uint32_t)));
+                CU_ASSERT_EQUAL(expected_first >= 0, changed != 0);
+
+                if (changed) {
+                    CU_ASSERT_EQUAL(expected_first, first);
+                    CU_ASSERT_EQUAL(expected_last, last);
+                }
+
+            }
+        }
+
+    }
+
+}
+
+void test_guac_surface_kernels() {
+
+    srand(1);
+
+    /* Both the portable kernels and those selected for this CPU must produce
+     * exactly the expected results */
+    __test_kernels_verify(&guac_common_surface_kernels_generic);
+    __test_kernels_verify(guac_common_surface_get_kernels());
+
+    __test_transfer_kernels_verify(&guac_common_surface_kernels_generic);
+    __test_transfer_kernels_verify(guac_common_surface_get_kernels());
+
+}
+
+/**
+ * Transfers the given rectangle of the given surface to the given destination
+ * coordinates within the same surface using the given transfer function,
+ * verifying the result against a transfer performed through an intermediate
+ * buffer (which cannot be affected by overlap). Plain copies (SRC) are
+ * performed using guac_common_surface_copy().
+ */
+static void __test_surface_copy_verify(guac_common_surface* surface,
+        guac_transfer_function op, int sx, int sy, int w, int h,
+        int dx, int dy) {
+
+    uint32_t expected[TEST_COPY_SIZE][TEST_COPY_SIZE];
+    uint32_t region[TEST_COPY_SIZE][TEST_COPY_SIZE];
+    int x, y;
+
+    /* Fill surface with distinct pixels */
+    for (y = 0; y < TEST_COPY_SIZE; y++) {
+        uint32_t* row = (uint32_t*) (surface->buffer + y * surface->stride);
+        for (x = 0; x < TEST_COPY_SIZE; x++)
+            row[x] = expected[y][x] = 0xFF000000 | (y << 8) | x;
+    }
+
+    /* Copy through intermediate buffer */
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            region[y][x] = expected[sy + y][sx + x];
+
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            expected[dy + y][dx + x] = __test_transfer_expect(op,
+                    region[y][x], expected[dy + y][dx + x]);
+
+    if (op == GUAC_TRANSFER_BINARY_SRC)
+        guac_common_surface_copy(surface, sx, sy, w, h, surface, dx, dy);
+    else
+        guac_common_surface_transfer(surface, sx, sy, w, h, op,
+                surface, dx, dy);
+
+    for (y = 0; y < TEST_COPY_SIZE; y++)
+        CU_ASSERT_EQUAL(0, memcmp(expected[y],
+                    surface->buffer + y * surface->stride,
+                    sizeof(expected[y])));
+
+}
+
+void test_guac_surface_copy() {
+
+    guac_layer buffer = { .index = -1 };
+    guac_socket* socket = guac_socket_alloc();
+    guac_common_surface* surface;
+    cairo_surface_t* image;
+    unsigned char pixels[16 * 16 * 4];
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    surface = guac_common_surface_alloc(NULL, socket, &buffer,
+            TEST_COPY_SIZE, TEST_COPY_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /* Overlapping copies in each direction, as when scrolling */
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 0, 0, 40, 40, 5, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 5, 0, 40, 40, 0, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 0, 0, 40, 40, 0, 5);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 0, 5, 40, 40, 0, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 0, 0, 40, 40, 3, 7);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 3, 7, 40, 40, 0, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 7, 0, 40, 40, 0, 3);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 0, 3, 40, 40, 7, 0);
+
+    /* Overlapping by less than one vector within each row */
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 0, 0, 41, 10, 1, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_SRC, 1, 0, 41, 10, 0, 0);
+
+    /* Overlapping transfers which combine source and destination */
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_XOR, 0, 0, 41, 10, 1, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_XOR, 1, 0, 41, 10, 0, 0);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_NSRC_AND, 0, 0, 40, 40, 3, 7);
+    __test_surface_copy_verify(surface, GUAC_TRANSFER_BINARY_NSRC_AND, 3, 7, 40, 40, 0, 0);
+
+    /* Surfaces without a client can still be flushed */
+    for (i = 0; i < (int) sizeof(pixels); i++)
+        pixels[i] = i * 37;
+
+    image = cairo_image_surface_create_for_data(pixels, CAIRO_FORMAT_RGB24,
+            16, 16, 16 * 4);
+    guac_common_surface_draw(surface, 0, 0, image);
+    cairo_surface_destroy(image);
+    CU_ASSERT(surface->dirty);
+    guac_common_surface_flush(surface);
+    CU_ASSERT(!surface->dirty);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+
+}
+
@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of the test surface, in pixels.
+ */
+#define TEST_SURFACE_SIZE 256
+
+/**
+ * Returns the color of the pixel at the given coordinates of an arbitrary
+ * image in which no two rows and no two columns are alike.
+ */
+static uint32_t __test_pixel(int x, int y) {
+
+    uint32_t bits = (uint32_t) x * 0x9E3779B1 + (uint32_t) y * 0x85EBCA77;
+    bits ^= bits >> 15;
+    bits *= 0x2C1B3C6D;
+    bits ^= bits >> 12;
+
+    return 0xFF000000 | bits;
+
+}
+
+/**
+ * Draws the test image over the entire given surface, taking the image from
+ * the given offset, as if scrolled by that amount.
+ */
+static void __test_draw(guac_common_surface* surface, int dx, int dy) {
+
+    cairo_surface_t* image = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            TEST_SURFACE_SIZE, TEST_SURFACE_SIZE);
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    int x, y;
+
+    for (y = 0; y < TEST_SURFACE_SIZE; y++)
+        for (x = 0; x < TEST_SURFACE_SIZE; x++)
+            ((uint32_t*) (data + y * stride))[x] = __test_pixel(x + dx, y + dy);
+
+    cairo_surface_mark_dirty(image);
+    guac_common_surface_draw(surface, 0, 0, image);
+    cairo_surface_destroy(image);
+
+}
+
+void test_guac_surface_motion() {
+
+    guac_layer layer = { .index = 1 };
+    guac_client* client = guac_client_alloc();
+    guac_socket* socket = guac_socket_alloc();
+    guac_common_surface* surface;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    surface = guac_common_surface_alloc(client, socket, &layer,
+            TEST_SURFACE_SIZE, TEST_SURFACE_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /* Motion is not detected unless enabled */
+    __test_draw(surface, 0, 0);
+    guac_common_surface_flush(surface);
+    __test_draw(surface, 0, 10);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.moved_updates, 0);
+    CU_ASSERT_PTR_NULL(surface->shadow);
+
+    guac_common_surface_set_motion_detection(surface, 1);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface->shadow);
+
+    /* Content scrolled vertically is copied, sending only exposed rows */
+    __test_draw(surface, 0, 20);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.moved_updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.moved_pixels,
+            TEST_SURFACE_SIZE * (TEST_SURFACE_SIZE - 10));
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, TEST_SURFACE_SIZE * 10);
+    CU_ASSERT_EQUAL(memcmp(surface->shadow, surface->buffer,
+                TEST_SURFACE_SIZE * surface->stride), 0);
+
+    /* Content scrolled horizontally is copied, sending only exposed
+     * columns */
+    __test_draw(surface, 20, 20);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.moved_updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.moved_pixels,
+            TEST_SURFACE_SIZE * (TEST_SURFACE_SIZE - 20));
+    CU_ASSERT_EQUAL(surface->last_flush.updates, 1);
+    CU_ASSERT_EQUAL(surface->last_flush.pixels, TEST_SURFACE_SIZE * 20);
+    CU_ASSERT_EQUAL(memcmp(surface->shadow, surface->buffer,
+                TEST_SURFACE_SIZE * surface->stride), 0);
+
+    /* Unrelated content is sent normally */
+    __test_draw(surface, 1000, 1000);
+    guac_common_surface_flush(surface);
+    CU_ASSERT_EQUAL(surface->last_flush.moved_updates, 0);
+    CU_ASSERT_EQUAL(surface->motion_stats.candidates, 3);
+    CU_ASSERT_EQUAL(surface->motion_stats.hits, 2);
+
+    /* Copy of remote display is discarded once disabled */
+    guac_common_surface_set_motion_detection(surface, 0);
+    CU_ASSERT_PTR_NULL(surface->shadow);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
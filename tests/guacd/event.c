@@ -0,0 +1,278 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include "event.h"
+#include "guacd_suite.h"
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/instruction.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+
+/**
+ * The number of bytes written within each frame by the client whose viewer
+ * never reads. A single frame is far larger than the buffer of the
+ * underlying socket.
+ */
+#define STALLED_FRAME_SIZE 1048576
+
+/**
+ * The number of frames which must be received by the viewer which does read.
+ */
+#define EXPECTED_FRAMES 50
+
+/**
+ * The number of milliseconds to wait for the expected frames.
+ */
+#define FRAME_TIMEOUT 10000
+
+/**
+ * A connection handled by the event threads, along with the state of the
+ * test viewer at the other end.
+ */
+typedef struct test_connection {
+
+    /**
+     * The socket pair of the connection. The first descriptor is handled by
+     * guacd, while the second is that of the viewer.
+     */
+    int fds[2];
+
+    /**
+     * The pipe whose read end is the message_fd of the client. A byte is
+     * written once and never read, such that messages are always pending.
+     */
+    int messages[2];
+
+    /**
+     * The client of the connection.
+     */
+    guac_client* client;
+
+    /**
+     * The socket of the connection, as handled by guacd.
+     */
+    guac_socket* socket;
+
+    /**
+     * The number of bytes to write within each frame.
+     */
+    int frame_size;
+
+    /**
+     * The number of frames written by the client.
+     */
+    int frames_written;
+
+    /**
+     * The number of frames received by the viewer.
+     */
+    int frames_received;
+
+    /**
+     * Non-zero once the client has been passed to the free handler.
+     */
+    int freed;
+
+    /**
+     * Lock which guards freed.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Condition signalled once freed is set.
+     */
+    pthread_cond_t freed_cond;
+
+} test_connection;
+
+/**
+ * Writes a frame of frame_size bytes of arbitrary data. This function is
+ * the handle_messages handler of the test clients.
+ */
+static int handle_messages(guac_client* client) {
+
+    static char data[STALLED_FRAME_SIZE];
+
+    test_connection* connection = (test_connection*) client->data;
+
+    connection->frames_written++;
+    if (connection->frame_size > 0)
+        guac_socket_write(connection->socket, data, connection->frame_size);
+
+    return 0;
+
+}
+
+/**
+ * Marks the test connection of the given client as freed. This function is
+ * the guacd_event_free_handler of the test clients.
+ */
+static void free_client(guac_client* client, void* data) {
+
+    test_connection* connection = (test_connection*) data;
+
+    pthread_mutex_lock(&connection->lock);
+    connection->freed = 1;
+    pthread_cond_signal(&connection->freed_cond);
+    pthread_mutex_unlock(&connection->lock);
+
+}
+
+/**
+ * Acknowledges each frame received by the viewer of the given connection
+ * until the expected number of frames has been received or the connection
+ * fails.
+ */
+static void* read_frames(void* data) {
+
+    test_connection* connection = (test_connection*) data;
+    guac_socket* socket = guac_socket_open(connection->fds[1]);
+
+    while (connection->frames_received < EXPECTED_FRAMES) {
+
+        guac_instruction* instruction = guac_instruction_read(socket,
+                FRAME_TIMEOUT * 1000);
+        if (instruction == NULL)
+            break;
+
+        if (instruction->opcode_id == GUAC_INSTRUCTION_OPCODE_SYNC
+                && instruction->argc == 1) {
+            connection->frames_received++;
+            guac_protocol_send_sync(socket, atoll(instruction->argv[0]));
+            guac_socket_flush(socket);
+        }
+
+        guac_instruction_free(instruction);
+
+    }
+
+    guac_socket_free(socket);
+
+    return NULL;
+
+}
+
+/**
+ * Adds a new connection writing frames of the given size to the event
+ * threads, returning zero on success.
+ */
+static int add_connection(test_connection* connection, int frame_size) {
+
+    connection->frame_size = frame_size;
+    pthread_mutex_init(&connection->lock, NULL);
+    pthread_cond_init(&connection->freed_cond, NULL);
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, connection->fds))
+        return 1;
+
+    if (pipe(connection->messages)
+            || write(connection->messages[1], "", 1) != 1)
+        return 1;
+
+    connection->socket = guacd_event_socket_open(connection->fds[0]);
+    connection->client = guac_client_alloc();
+    if (connection->socket == NULL || connection->client == NULL)
+        return 1;
+
+    connection->client->socket = connection->socket;
+    connection->client->data = connection;
+    connection->client->message_fd = connection->messages[0];
+    connection->client->handle_messages = handle_messages;
+
+    return guacd_event_add(connection->client, connection->socket, NULL,
+            free_client, connection);
+
+}
+
+/**
+ * Stops the client of the given connection, waiting for the event threads
+ * to release it, and frees the connection.
+ */
+static void remove_connection(test_connection* connection) {
+
+    guac_client_stop(connection->client);
+
+    pthread_mutex_lock(&connection->lock);
+    while (!connection->freed)
+        pthread_cond_wait(&connection->freed_cond, &connection->lock);
+    pthread_mutex_unlock(&connection->lock);
+
+    guac_socket_free(connection->socket);
+    guac_client_free(connection->client);
+
+    close(connection->fds[0]);
+    close(connection->fds[1]);
+    close(connection->messages[0]);
+    close(connection->messages[1]);
+
+}
+
+#endif
+
+void test_guacd_event() {
+
+#ifdef HAVE_SYS_EPOLL_H
+
+    test_connection stalled = { 0 };
+    test_connection reading = { 0 };
+
+    pthread_t reader;
+    guac_timestamp start;
+
+    /* Both connections share the only event thread */
+    CU_ASSERT_EQUAL_FATAL(guacd_event_start(1), 0);
+    CU_ASSERT_EQUAL_FATAL(add_connection(&stalled, STALLED_FRAME_SIZE), 0);
+    CU_ASSERT_EQUAL_FATAL(add_connection(&reading, 0), 0);
+
+    /* The viewer of the second connection keeps up with all frames */
+    start = guac_timestamp_current();
+    CU_ASSERT_EQUAL_FATAL(
+            pthread_create(&reader, NULL, read_frames, &reading), 0);
+    pthread_join(reader, NULL);
+
+    /* Frames must continue despite the viewer which never reads */
+    CU_ASSERT_EQUAL(reading.frames_received, EXPECTED_FRAMES);
+    CU_ASSERT(guac_timestamp_current() - start < FRAME_TIMEOUT);
+
+    remove_connection(&stalled);
+    remove_connection(&reading);
+
+    /* The stalled client must actually have written more than can be sent */
+    CU_ASSERT(stalled.frames_written > 0);
+
+#endif
+
+}
+
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_TEST_GUACD_SUITE_H
+#define _GUAC_TEST_GUACD_SUITE_H
+
+/**
+ * Test suite containing unit tests for the parts of guacd which do not
+ * depend on the daemon itself, and are thus built directly from the sources
+ * of guacd.
+ *
+ * @file guacd_suite.h
+ */
+
+#include "config.h"
+
+/**
+ * Registers the guacd test suite with CUnit.
+ */
+int register_guacd_suite();
+
+/**
+ * Unit test for the connection registry. This test checks that connections
+ * can be added, found, and removed, including connections stored beyond
+ * entries they collide with, that removed entries become free again once
+ * no lookup depends on them, and that entries of processes which no longer
+ * exist are swept away.
+ */
+void test_guacd_registry();
+
+/**
+ * Unit test for the event threads. This test checks that a connection whose
+ * viewer never reads does not stall other connections handled by the same
+ * event thread.
+ */
+void test_guacd_event();
+
+#endif
+
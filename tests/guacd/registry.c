@@ -0,0 +1,179 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "guacd_suite.h"
+#include "registry.h"
+
+#include <CUnit/Basic.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/**
+ * Returns the index of the entry which the connection having the given ID
+ * would occupy within the given registry if no other connections collided
+ * with it, or -1 if the connection cannot be added. The registry must
+ * contain no connection at or after that entry.
+ */
+static int home_index(guacd_registry* registry, const char* id) {
+
+    guacd_registry_entry* entry = guacd_registry_add(registry, id, "test");
+    if (entry == NULL)
+        return -1;
+
+    guacd_registry_remove(registry, entry);
+    return entry - registry->entries;
+
+}
+
+/**
+ * Stores within the given buffer an ID, distinct from all IDs previously
+ * generated, whose connection would occupy the given entry of the given
+ * registry if no other connections collided with it.
+ */
+static void colliding_id(guacd_registry* registry, int home, char* id,
+        int* counter) {
+
+    int index;
+
+    do {
+        sprintf(id, "collision-%i", (*counter)++);
+        index = home_index(registry, id);
+    } while (index != home && index != -1);
+
+}
+
+/**
+ * Counts each connection, incrementing the int pointed to by the given data.
+ * This function is the guacd_registry_callback used by the test.
+ */
+static void count_entry(const guacd_registry_entry* entry, void* data) {
+    (*((int*) data))++;
+}
+
+/**
+ * Returns the state of the entry at the given index of the given registry.
+ */
+static int state_at(guacd_registry* registry, int index) {
+    return registry->entries[index % GUACD_REGISTRY_SIZE].state;
+}
+
+void test_guacd_registry() {
+
+    guacd_registry_entry found;
+    guacd_registry_entry* entries[3];
+    char ids[3][GUACD_REGISTRY_ID_SIZE];
+    int counter = 0;
+    int count = 0;
+    int home;
+    pid_t pid;
+    int i;
+
+    guacd_registry* registry = guacd_registry_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(registry);
+
+    /* Find three connections which collide */
+    sprintf(ids[0], "collision-base");
+    home = home_index(registry, ids[0]);
+    colliding_id(registry, home, ids[1], &counter);
+    colliding_id(registry, home, ids[2], &counter);
+
+    /* Searching for and removing connections did not leave any entries
+     * behind */
+    for (i = 0; i < GUACD_REGISTRY_SIZE; i++) {
+        if (registry->entries[i].state != GUACD_REGISTRY_FREE) {
+            CU_FAIL("Entry left behind after removal");
+            break;
+        }
+    }
+
+    /* Colliding connections are stored in consecutive entries */
+    for (i = 0; i < 3; i++) {
+        entries[i] = guacd_registry_add(registry, ids[i], "test");
+        CU_ASSERT_PTR_NOT_NULL_FATAL(entries[i]);
+        CU_ASSERT_EQUAL(entries[i] - registry->entries,
+                (home + i) % GUACD_REGISTRY_SIZE);
+    }
+
+    /* All are found */
+    for (i = 0; i < 3; i++) {
+        CU_ASSERT_EQUAL_FATAL(guacd_registry_find(registry, ids[i], &found), 0);
+        CU_ASSERT_STRING_EQUAL(found.connection_id, ids[i]);
+        CU_ASSERT_STRING_EQUAL(found.protocol, "test");
+        CU_ASSERT_EQUAL(found.pid, getpid());
+    }
+
+    CU_ASSERT_NOT_EQUAL(guacd_registry_find(registry, "missing", &found), 0);
+
+    /* All are visited */
+    CU_ASSERT_EQUAL(guacd_registry_foreach(registry, count_entry, &count), 3);
+    CU_ASSERT_EQUAL(count, 3);
+
+    /* Removing the middle connection must leave the last reachable */
+    guacd_registry_remove(registry, entries[1]);
+    CU_ASSERT_EQUAL(state_at(registry, home + 1), GUACD_REGISTRY_REMOVED);
+    CU_ASSERT_NOT_EQUAL(guacd_registry_find(registry, ids[1], &found), 0);
+    CU_ASSERT_EQUAL(guacd_registry_find(registry, ids[2], &found), 0);
+
+    /* Removing the last connection frees both it and the removed entry
+     * before it */
+    guacd_registry_remove(registry, entries[2]);
+    CU_ASSERT_EQUAL(state_at(registry, home + 2), GUACD_REGISTRY_FREE);
+    CU_ASSERT_EQUAL(state_at(registry, home + 1), GUACD_REGISTRY_FREE);
+    CU_ASSERT_EQUAL(state_at(registry, home), GUACD_REGISTRY_ACTIVE);
+    CU_ASSERT_EQUAL(guacd_registry_find(registry, ids[0], &found), 0);
+
+    /* Removing twice has no effect */
+    guacd_registry_remove(registry, entries[2]);
+    CU_ASSERT_EQUAL(state_at(registry, home + 2), GUACD_REGISTRY_FREE);
+
+    /* Removed entries are reused */
+    entries[1] = guacd_registry_add(registry, ids[1], "test");
+    CU_ASSERT_PTR_EQUAL(entries[1], &registry->entries[
+            (home + 1) % GUACD_REGISTRY_SIZE]);
+
+    /* Obtain the ID of a process which no longer exists */
+    pid = fork();
+    CU_ASSERT_FATAL(pid != -1);
+    if (pid == 0)
+        _exit(0);
+    CU_ASSERT_EQUAL_FATAL(waitpid(pid, NULL, 0), pid);
+
+    /* Only the entry of the dead process is swept */
+    entries[0]->pid = pid;
+    CU_ASSERT_EQUAL(guacd_registry_sweep(registry), 1);
+    CU_ASSERT_NOT_EQUAL(guacd_registry_find(registry, ids[0], &found), 0);
+    CU_ASSERT_EQUAL(guacd_registry_find(registry, ids[1], &found), 0);
+    CU_ASSERT_EQUAL(state_at(registry, home), GUACD_REGISTRY_REMOVED);
+
+    /* Once empty, no entries remain in use */
+    guacd_registry_remove(registry, entries[1]);
+    CU_ASSERT_EQUAL(state_at(registry, home), GUACD_REGISTRY_FREE);
+    CU_ASSERT_EQUAL(state_at(registry, home + 1), GUACD_REGISTRY_FREE);
+
+}
+
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * In-memory output buffer receiving all data written to a test socket.
+ */
+typedef struct test_output_buffer {
+
+    char* data;
+    int length;
+    int size;
+
+} test_output_buffer;
+
+static ssize_t __test_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    test_output_buffer* output = (test_output_buffer*) socket->data;
+
+    /* Write only what fits, leaving room for a null terminator */
+    if (count > output->size - output->length - 1)
+        count = output->size - output->length - 1;
+
+    memcpy(output->data + output->length, buf, count);
+    output->length += count;
+    output->data[output->length] = '\0';
+
+    return count;
+
+}
+
+/**
+ * Base64-encodes the given data through a new guac_socket in chunks of the
+ * given sizes, cycling through those sizes until all data is written, and
+ * verifies that decoding the result yields the original data.
+ */
+static void __test_base64_roundtrip(const unsigned char* data, int length,
+        const int* chunk_sizes, int num_chunk_sizes) {
+
+    test_output_buffer output;
+    guac_socket* socket;
+    int offset = 0;
+    int i = 0;
+
+    output.size = (length + 2) / 3 * 4 + 1;
+    output.data = malloc(output.size);
+    output.length = 0;
+
+    socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->data = &output;
+    socket->write_handler = __test_write_handler;
+
+    /* Write data in varying chunk sizes */
+    while (offset < length) {
+
+        int chunk = chunk_sizes[i++ % num_chunk_sizes];
+        if (chunk > length - offset)
+            chunk = length - offset;
+
+        CU_ASSERT_EQUAL(guac_socket_write_base64(socket, data + offset, chunk), 0);
+        offset += chunk;
+
+    }
+
+    CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    guac_socket_free(socket);
+
+    /* Output must be exactly the padded length and decode to the input */
+    CU_ASSERT_EQUAL(output.length, (length + 2) / 3 * 4);
+    CU_ASSERT_EQUAL(guac_protocol_decode_base64(output.data), length);
+    CU_ASSERT(memcmp(output.data, data, length) == 0);
+
+    free(output.data);
+
+}
+
+void test_base64_encode() {
+
+    const int single[] = { 100000 };
+    const int small[] = { 1, 2, 5, 7, 11 };
+    const int mixed[] = { 4095, 1, 8191, 2, 17, 30000 };
+
+    unsigned char* data;
+    int i;
+
+    /* Known encodings, including both padding lengths */
+    test_output_buffer output;
+    char buffer[64];
+    guac_socket* socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    output.data = buffer;
+    output.length = 0;
+    output.size = sizeof(buffer);
+    socket->data = &output;
+    socket->write_handler = __test_write_handler;
+
+    guac_socket_write_base64(socket, "HELLO", 5);
+    guac_socket_flush_base64(socket);
+    guac_socket_write_base64(socket, "AVOCADO", 7);
+    guac_socket_flush_base64(socket);
+    guac_socket_write_base64(socket, "GUACAMOLE", 9);
+    guac_socket_flush_base64(socket);
+    guac_socket_flush(socket);
+    guac_socket_free(socket);
+
+    CU_ASSERT_STRING_EQUAL(buffer, "SEVMTE8=" "QVZPQ0FETw==" "R1VBQ0FNT0xF");
+
+    /* Generate data covering all byte values */
+    data = malloc(100000);
+    for (i = 0; i < 100000; i++)
+        data[i] = (i * 7919 + (i >> 8)) & 0xFF;
+
+    /* Verify across buffer boundaries and partial triplets */
+    __test_base64_roundtrip(data, 100000, single, 1);
+    __test_base64_roundtrip(data, 99999,  single, 1);
+    __test_base64_roundtrip(data, 99998,  small, 5);
+    __test_base64_roundtrip(data, 100000, mixed, 6);
+
+    free(data);
+
+}
+
@@ -0,0 +1,352 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <png.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/error.h>
+#include <guacamole/instruction.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+/**
+ * Returns a new 64x64 image surface containing a horizontal gradient.
+ */
+static cairo_surface_t* __test_gradient_surface() {
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            64, 64);
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    int x, y;
+
+    for (y = 0; y < 64; y++) {
+        unsigned int* row = (unsigned int*) (data + y * stride);
+        for (x = 0; x < 64; x++)
+            row[x] = (x * 4) << 16 | (y * 4) << 8 | ((x + y) * 2);
+    }
+
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+
+/**
+ * The current read position within PNG data being decoded.
+ */
+typedef struct test_png_reader {
+
+    const unsigned char* data;
+    int remaining;
+
+} test_png_reader;
+
+static void __test_png_read(png_structp png, png_bytep data,
+        png_size_t length) {
+
+    test_png_reader* reader = (test_png_reader*) png_get_io_ptr(png);
+
+    if (length > reader->remaining)
+        png_error(png, "Truncated PNG");
+
+    memcpy(data, reader->data, length);
+    reader->data += length;
+    reader->remaining -= length;
+
+}
+
+/**
+ * Decodes the given PNG data, verifying that every pixel matches the
+ * corresponding pixel of the given RGB24 surface.
+ */
+static void __test_png_verify(const unsigned char* data, int length,
+        cairo_surface_t* surface) {
+
+    test_png_reader reader = { data, length };
+    unsigned char* expected = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    unsigned char* row = malloc(width * 3);
+    int x, y;
+
+    png_structp png = png_create_read_struct(PNG_LIBPNG_VER_STRING,
+            NULL, NULL, NULL);
+    png_infop png_info = png_create_info_struct(png);
+
+    if (setjmp(png_jmpbuf(png))) {
+        png_destroy_read_struct(&png, &png_info, NULL);
+        free(row);
+        CU_FAIL("Encoded PNG could not be decoded");
+        return;
+    }
+
+    png_set_read_fn(png, &reader, __test_png_read);
+    png_read_info(png, png_info);
+
+    CU_ASSERT_EQUAL_FATAL(png_get_image_width(png, png_info), width);
+    CU_ASSERT_EQUAL_FATAL(png_get_image_height(png, png_info), height);
+
+    /* Always decode as 8-bit RGB */
+    png_set_expand(png);
+    png_read_update_info(png, png_info);
+    CU_ASSERT_EQUAL_FATAL(png_get_rowbytes(png, png_info), width * 3);
+
+    for (y = 0; y < height; y++) {
+
+        unsigned int* pixels = (unsigned int*) (expected + y * stride);
+        png_read_row(png, row, NULL);
+
+        for (x = 0; x < width; x++) {
+            unsigned int color = (row[x*3] << 16) | (row[x*3+1] << 8)
+                               | row[x*3+2];
+            CU_ASSERT_EQUAL(color, pixels[x] & 0xFFFFFF);
+        }
+
+    }
+
+    png_destroy_read_struct(&png, &png_info, NULL);
+    free(row);
+
+}
+
+void test_image_encode() {
+
+    guac_png_compression compression;
+
+    cairo_surface_t* surface = __test_gradient_surface();
+    unsigned char* data;
+    int length;
+
+    /* PNG encoding must always be available */
+    CU_ASSERT_EQUAL_FATAL(guac_protocol_encode_png(surface,
+                (void**) &data, &length), 0);
+    CU_ASSERT(length >= 8);
+    CU_ASSERT_EQUAL(memcmp(data, "\x89PNG\r\n\x1A\n", 8), 0);
+    free(data);
+
+    /* Every speed/size tradeoff must produce the same image */
+    for (compression = GUAC_PNG_COMPRESSION_DEFAULT;
+            compression <= GUAC_PNG_COMPRESSION_SMALL; compression++) {
+
+        guac_palette_hint hint = GUAC_PALETTE_HINT_UNKNOWN;
+
+        CU_ASSERT_EQUAL_FATAL(guac_protocol_encode_png_hinted(surface,
+                    compression, &hint, (void**) &data, &length), 0);
+        CU_ASSERT_EQUAL(hint, GUAC_PALETTE_HINT_TRUECOLOR);
+        __test_png_verify(data, length, surface);
+        free(data);
+
+    }
+
+    cairo_surface_destroy(surface);
+
+    /* Images with few colors must be encoded with a palette */
+    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 64, 64);
+    memset(cairo_image_surface_get_data(surface), 0x80,
+            cairo_image_surface_get_stride(surface) * 64);
+    cairo_surface_mark_dirty(surface);
+
+    for (compression = GUAC_PNG_COMPRESSION_DEFAULT;
+            compression <= GUAC_PNG_COMPRESSION_SMALL; compression++) {
+
+        guac_palette_hint hint = GUAC_PALETTE_HINT_UNKNOWN;
+
+        CU_ASSERT_EQUAL_FATAL(guac_protocol_encode_png_hinted(surface,
+                    compression, &hint, (void**) &data, &length), 0);
+        CU_ASSERT_EQUAL(hint, GUAC_PALETTE_HINT_PALETTE);
+        __test_png_verify(data, length, surface);
+        free(data);
+
+    }
+
+    cairo_surface_destroy(surface);
+    surface = __test_gradient_surface();
+
+    /* JPEG encoding, if built, must produce a complete JPEG image */
+    if (guac_protocol_encode_jpeg(surface, 75, (void**) &data, &length) == 0) {
+        CU_ASSERT(length > 4);
+        CU_ASSERT_EQUAL(data[0], 0xFF);
+        CU_ASSERT_EQUAL(data[1], 0xD8);
+        CU_ASSERT_EQUAL(data[length-2], 0xFF);
+        CU_ASSERT_EQUAL(data[length-1], 0xD9);
+        free(data);
+    }
+    else
+        CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_NOT_SUPPORTED);
+
+    cairo_surface_destroy(surface);
+
+}
+
+/**
+ * In-memory output buffer receiving all data written to a test socket.
+ */
+typedef struct test_image_output {
+
+    char* data;
+    int length;
+
+} test_image_output;
+
+static ssize_t __test_image_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    test_image_output* output = (test_image_output*) socket->data;
+
+    output->data = realloc(output->data, output->length + count);
+    memcpy(output->data + output->length, buf, count);
+    output->length += count;
+
+    return count;
+
+}
+
+/**
+ * Parses the next complete instruction from the given buffer into the given
+ * instruction, advancing the buffer past the parsed data.
+ */
+static void __test_parse_next(guac_instruction* instruction, char** current,
+        int* remaining) {
+
+    guac_instruction_reset(instruction);
+
+    while (instruction->state != GUAC_INSTRUCTION_PARSE_COMPLETE) {
+
+        int parsed = guac_instruction_append(instruction, *current,
+                *remaining);
+
+        if (parsed == 0)
+            break;
+
+        *current += parsed;
+        *remaining -= parsed;
+
+    }
+
+}
+
+void test_image_stream() {
+
+    test_image_output output = { NULL, 0 };
+    guac_socket* socket;
+    guac_instruction* instruction;
+    guac_layer layer = { 2 };
+    guac_stream stream = { 7 };
+
+    cairo_surface_t* surface;
+    unsigned char* data;
+    int stride, x, y;
+
+    char* current;
+    int remaining;
+    unsigned char* png = NULL;
+    int png_length = 0;
+    int blobs = 0;
+
+    /* Incompressible image, such that several blobs are needed */
+    surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24, 128, 128);
+    data = cairo_image_surface_get_data(surface);
+    stride = cairo_image_surface_get_stride(surface);
+    srand(1);
+    for (y = 0; y < 128; y++) {
+        unsigned int* row = (unsigned int*) (data + y * stride);
+        for (x = 0; x < 128; x++)
+            row[x] = rand() & 0xFFFFFF;
+    }
+    cairo_surface_mark_dirty(surface);
+
+    socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->data = &output;
+    socket->write_handler = __test_image_write_handler;
+
+    CU_ASSERT_EQUAL_FATAL(guac_protocol_stream_png(socket, &stream,
+                GUAC_COMP_OVER, &layer, 10, 20, surface,
+                GUAC_PNG_COMPRESSION_FAST, NULL), 0);
+    guac_socket_flush(socket);
+
+    instruction = guac_instruction_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(instruction);
+
+    current = output.data;
+    remaining = output.length;
+
+    /* Stream must begin with an img instruction */
+    __test_parse_next(instruction, &current, &remaining);
+    CU_ASSERT_EQUAL_FATAL(instruction->state, GUAC_INSTRUCTION_PARSE_COMPLETE);
+    CU_ASSERT_STRING_EQUAL(instruction->opcode, "img");
+    CU_ASSERT_EQUAL_FATAL(instruction->argc, 6);
+    CU_ASSERT_STRING_EQUAL(instruction->argv[0], "7");
+    CU_ASSERT_STRING_EQUAL(instruction->argv[2], "2");
+    CU_ASSERT_STRING_EQUAL(instruction->argv[3], "image/png");
+    CU_ASSERT_STRING_EQUAL(instruction->argv[4], "10");
+    CU_ASSERT_STRING_EQUAL(instruction->argv[5], "20");
+
+    /* Followed by blobs, and finally an end instruction */
+    for (;;) {
+
+        __test_parse_next(instruction, &current, &remaining);
+        CU_ASSERT_EQUAL_FATAL(instruction->state,
+                GUAC_INSTRUCTION_PARSE_COMPLETE);
+
+        if (strcmp(instruction->opcode, "end") == 0)
+            break;
+
+        CU_ASSERT_STRING_EQUAL_FATAL(instruction->opcode, "blob");
+        CU_ASSERT_STRING_EQUAL(instruction->argv[0], "7");
+
+        {
+            int length = guac_protocol_decode_base64(instruction->argv[1]);
+            png = realloc(png, png_length + length);
+            memcpy(png + png_length, instruction->argv[1], length);
+            png_length += length;
+            blobs++;
+        }
+
+    }
+
+    CU_ASSERT_STRING_EQUAL(instruction->argv[0], "7");
+    CU_ASSERT_EQUAL(remaining, 0);
+    CU_ASSERT(blobs > 1);
+
+    /* Reassembled blobs must be the complete image */
+    __test_png_verify(png, png_length, surface);
+
+    free(png);
+    guac_instruction_free(instruction);
+    guac_socket_free(socket);
+    free(output.data);
+    cairo_surface_destroy(surface);
+
+}
+
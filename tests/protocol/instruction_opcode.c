@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/instruction.h>
+
+/**
+ * Asserts that the given opcode is mapped to the given opcode value.
+ */
+static void __assert_opcode(const char* opcode,
+        guac_instruction_opcode expected) {
+    CU_ASSERT_EQUAL(guac_instruction_get_opcode(opcode, strlen(opcode)),
+            expected);
+}
+
+void test_instruction_opcode() {
+
+    guac_instruction* instruction;
+    char buffer[] = "5.mouse,2.10,2.20,1.1;4.sizz,1.0;";
+    char* current = buffer;
+    int remaining = sizeof(buffer) - 1;
+
+    /* All known opcodes */
+    __assert_opcode("ack",        GUAC_INSTRUCTION_OPCODE_ACK);
+    __assert_opcode("audio",      GUAC_INSTRUCTION_OPCODE_AUDIO);
+    __assert_opcode("blob",       GUAC_INSTRUCTION_OPCODE_BLOB);
+    __assert_opcode("clipboard",  GUAC_INSTRUCTION_OPCODE_CLIPBOARD);
+    __assert_opcode("connect",    GUAC_INSTRUCTION_OPCODE_CONNECT);
+    __assert_opcode("disconnect", GUAC_INSTRUCTION_OPCODE_DISCONNECT);
+    __assert_opcode("end",        GUAC_INSTRUCTION_OPCODE_END);
+    __assert_opcode("file",       GUAC_INSTRUCTION_OPCODE_FILE);
+    __assert_opcode("image",      GUAC_INSTRUCTION_OPCODE_IMAGE);
+    __assert_opcode("key",        GUAC_INSTRUCTION_OPCODE_KEY);
+    __assert_opcode("mouse",      GUAC_INSTRUCTION_OPCODE_MOUSE);
+    __assert_opcode("pipe",       GUAC_INSTRUCTION_OPCODE_PIPE);
+    __assert_opcode("select",     GUAC_INSTRUCTION_OPCODE_SELECT);
+    __assert_opcode("size",       GUAC_INSTRUCTION_OPCODE_SIZE);
+    __assert_opcode("sync",       GUAC_INSTRUCTION_OPCODE_SYNC);
+    __assert_opcode("video",      GUAC_INSTRUCTION_OPCODE_VIDEO);
+
+    /* Near misses must not match */
+    __assert_opcode("",           GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("ke",         GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("kez",        GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("sizz",       GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("synd",       GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("mouses",     GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("Mouse",      GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+    __assert_opcode("selected",   GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+
+    /* Opcode values must be assigned during parsing */
+    instruction = guac_instruction_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(instruction);
+    CU_ASSERT_EQUAL(instruction->opcode_id, GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+
+    while (instruction->state != GUAC_INSTRUCTION_PARSE_COMPLETE) {
+        int parsed = guac_instruction_append(instruction, current, remaining);
+        CU_ASSERT_NOT_EQUAL_FATAL(parsed, 0);
+        current += parsed;
+        remaining -= parsed;
+    }
+
+    CU_ASSERT_STRING_EQUAL(instruction->opcode, "mouse");
+    CU_ASSERT_EQUAL(instruction->opcode_id, GUAC_INSTRUCTION_OPCODE_MOUSE);
+    CU_ASSERT_EQUAL(instruction->argc, 3);
+
+    /* Unknown opcodes must reset any previous value */
+    guac_instruction_reset(instruction);
+    while (instruction->state != GUAC_INSTRUCTION_PARSE_COMPLETE) {
+        int parsed = guac_instruction_append(instruction, current, remaining);
+        CU_ASSERT_NOT_EQUAL_FATAL(parsed, 0);
+        current += parsed;
+        remaining -= parsed;
+    }
+
+    CU_ASSERT_STRING_EQUAL(instruction->opcode, "sizz");
+    CU_ASSERT_EQUAL(instruction->opcode_id, GUAC_INSTRUCTION_OPCODE_UNKNOWN);
+
+    guac_instruction_free(instruction);
+
+}
+
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/error.h>
+#include <guacamole/instruction.h>
+#include <guacamole/socket.h>
+
+void test_instruction_read_buffered() {
+
+    int fd[2];
+
+    guac_socket* socket;
+    guac_instruction instructions[4];
+
+    char test_string[] = "4.test,6.a" UTF8_4 "b;"
+                         "5.test2,10.a" UTF8_8 "c;"
+                         "5.test3,10.hellohello;"
+                         "5.test4,15.worldworld";
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    /* Write all data, including an incomplete final instruction */
+    CU_ASSERT_EQUAL_FATAL(
+        write(fd[1], test_string, sizeof(test_string) - 1),
+        sizeof(test_string) - 1
+    );
+
+    /* Open guac socket */
+    socket = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Nothing should be buffered before the first read */
+    CU_ASSERT_EQUAL(guac_instruction_read_buffered(socket, instructions, 4), 0);
+
+    /* Read first instruction */
+    CU_ASSERT_EQUAL_FATAL(
+        guac_instruction_read_into(socket, 1000000, &instructions[0]), 0);
+
+    /* Drain remaining complete instructions */
+    CU_ASSERT_EQUAL_FATAL(
+        guac_instruction_read_buffered(socket, &instructions[1], 3), 2);
+
+    /* Validate contents */
+    CU_ASSERT_STRING_EQUAL(instructions[0].opcode, "test");
+    CU_ASSERT_EQUAL_FATAL(instructions[0].argc, 1);
+    CU_ASSERT_STRING_EQUAL(instructions[0].argv[0], "a" UTF8_4 "b");
+
+    CU_ASSERT_STRING_EQUAL(instructions[1].opcode, "test2");
+    CU_ASSERT_EQUAL_FATAL(instructions[1].argc, 1);
+    CU_ASSERT_STRING_EQUAL(instructions[1].argv[0], "a" UTF8_8 "c");
+
+    CU_ASSERT_STRING_EQUAL(instructions[2].opcode, "test3");
+    CU_ASSERT_EQUAL_FATAL(instructions[2].argc, 1);
+    CU_ASSERT_STRING_EQUAL(instructions[2].argv[0], "hellohello");
+
+    /* Incomplete instruction must remain buffered */
+    CU_ASSERT_EQUAL(guac_instruction_read_buffered(socket, instructions, 4), 0);
+
+    /* Complete final instruction */
+    CU_ASSERT_EQUAL_FATAL(write(fd[1], "world;", 6), 6);
+    close(fd[1]);
+
+    /* Reuse the first instruction for the final read */
+    CU_ASSERT_EQUAL_FATAL(
+        guac_instruction_read_into(socket, 1000000, &instructions[0]), 0);
+    CU_ASSERT_STRING_EQUAL(instructions[0].opcode, "test4");
+    CU_ASSERT_EQUAL_FATAL(instructions[0].argc, 1);
+    CU_ASSERT_STRING_EQUAL(instructions[0].argv[0], "worldworldworld");
+
+    /* End of stream */
+    CU_ASSERT_NOT_EQUAL(
+        guac_instruction_read_into(socket, 1000000, &instructions[0]), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_CLOSED);
+
+    guac_socket_free(socket);
+
+}
+
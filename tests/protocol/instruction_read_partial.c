@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/error.h>
+#include <guacamole/instruction.h>
+#include <guacamole/socket.h>
+
+void test_instruction_read_partial() {
+
+    int fd[2];
+
+    guac_socket* socket;
+    guac_instruction instruction;
+
+    char test_string[] = "4.test,6.a" UTF8_4 "b,5.12";
+
+    /* Create pipe */
+    CU_ASSERT_EQUAL_FATAL(pipe(fd), 0);
+
+    /* Write only part of an instruction */
+    CU_ASSERT_EQUAL_FATAL(
+        write(fd[1], test_string, sizeof(test_string) - 1),
+        sizeof(test_string) - 1
+    );
+
+    /* Open guac socket */
+    socket = guac_socket_open(fd[0]);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Read must time out without losing the partial instruction */
+    CU_ASSERT_NOT_EQUAL(guac_instruction_read_into(socket, 0, &instruction), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_TIMEOUT);
+
+    /* Repeated attempts must not disturb the partial instruction */
+    CU_ASSERT_NOT_EQUAL(guac_instruction_read_into(socket, 0, &instruction), 0);
+    CU_ASSERT_EQUAL(guac_error, GUAC_STATUS_TIMEOUT);
+
+    /* Complete instruction */
+    CU_ASSERT_EQUAL_FATAL(write(fd[1], "345,2.xy;", 9), 9);
+    close(fd[1]);
+
+    /* Instruction should now be read in its entirety */
+    CU_ASSERT_EQUAL_FATAL(guac_instruction_read_into(socket, 0, &instruction), 0);
+    CU_ASSERT_STRING_EQUAL(instruction.opcode, "test");
+    CU_ASSERT_EQUAL_FATAL(instruction.argc, 3);
+    CU_ASSERT_STRING_EQUAL(instruction.argv[0], "a" UTF8_4 "b");
+    CU_ASSERT_STRING_EQUAL(instruction.argv[1], "12345");
+    CU_ASSERT_STRING_EQUAL(instruction.argv[2], "xy");
+
+    guac_socket_free(socket);
+
+}
+
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * In-memory output buffer receiving all data written to a test socket,
+ * tracking the number of calls made to each handler.
+ */
+typedef struct test_writev_output {
+
+    char* data;
+    int length;
+    int write_calls;
+    int writev_calls;
+
+} test_writev_output;
+
+static ssize_t __test_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    test_writev_output* output = (test_writev_output*) socket->data;
+
+    memcpy(output->data + output->length, buf, count);
+    output->length += count;
+    output->write_calls++;
+
+    return count;
+
+}
+
+static ssize_t __test_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    test_writev_output* output = (test_writev_output*) socket->data;
+    ssize_t written = 0;
+    int i;
+
+    /* Write only part of the final buffer to exercise partial writes */
+    for (i = 0; i < iovcnt; i++) {
+
+        size_t length = iov[i].iov_len;
+        if (i == iovcnt - 1 && iovcnt > 1)
+            length /= 2;
+
+        memcpy(output->data + output->length, iov[i].iov_base, length);
+        output->length += length;
+        written += length;
+
+    }
+
+    output->writev_calls++;
+    return written;
+
+}
+
+void test_socket_writev() {
+
+    test_writev_output output;
+    guac_socket* socket;
+
+    char* expected;
+    char* payload;
+    int payload_length = 100000;
+    int i;
+
+    /* Build payload spanning many output buffers */
+    payload = malloc(payload_length + 1);
+    for (i = 0; i < payload_length; i++)
+        payload[i] = 'a' + (i % 26);
+    payload[payload_length] = '\0';
+
+    expected = malloc(payload_length * 2 + 1);
+    strcpy(expected, "4.test,");
+    strcat(expected, payload);
+    strcat(expected, ";");
+
+    output.data = malloc(payload_length * 2);
+    output.length = 0;
+    output.write_calls = 0;
+    output.writev_calls = 0;
+
+    socket = guac_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->data = &output;
+    socket->write_handler = __test_write_handler;
+    socket->writev_handler = __test_writev_handler;
+
+    /* Buffered output should be chained until flushed */
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, "4.test,"), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, payload), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, ";"), 0);
+    CU_ASSERT_EQUAL(output.length, 0);
+
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT_EQUAL(output.write_calls, 0);
+    CU_ASSERT(output.writev_calls > 0);
+    CU_ASSERT_EQUAL(output.length, strlen(expected));
+    CU_ASSERT(memcmp(output.data, expected, output.length) == 0);
+
+    /* Explicit scatter/gather writes should arrive intact and in order */
+    {
+        struct iovec iov[3] = {
+            { .iov_base = "4.test,", .iov_len = 7 },
+            { .iov_base = payload,   .iov_len = payload_length },
+            { .iov_base = ";",       .iov_len = 1 }
+        };
+
+        output.length = 0;
+        CU_ASSERT_EQUAL(guac_socket_writev(socket, iov, 3), 0);
+        CU_ASSERT_EQUAL(output.length, strlen(expected));
+        CU_ASSERT(memcmp(output.data, expected, output.length) == 0);
+    }
+
+    /* Without a writev handler, output must still be complete */
+    socket->writev_handler = NULL;
+    output.length = 0;
+    output.writev_calls = 0;
+
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, "4.test,"), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, payload), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, ";"), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT_EQUAL(output.writev_calls, 0);
+    CU_ASSERT_EQUAL(output.length, strlen(expected));
+    CU_ASSERT(memcmp(output.data, expected, output.length) == 0);
+
+    guac_socket_free(socket);
+
+    free(output.data);
+    free(expected);
+    free(payload);
+
+}
+
@@ -47,10 +47,17 @@ int register_protocol_suite() {
     /* Add tests */
     if (
         CU_add_test(suite, "base64-decode", test_base64_decode) == NULL
+     || CU_add_test(suite, "base64-encode", test_base64_encode) == NULL
+     || CU_add_test(suite, "image-encode", test_image_encode) == NULL
+     || CU_add_test(suite, "image-stream", test_image_stream) == NULL
+     || CU_add_test(suite, "instruction-opcode", test_instruction_opcode) == NULL
      || CU_add_test(suite, "instruction-parse", test_instruction_parse) == NULL
      || CU_add_test(suite, "instruction-read", test_instruction_read) == NULL
+     || CU_add_test(suite, "instruction-read-buffered", test_instruction_read_buffered) == NULL
+     || CU_add_test(suite, "instruction-read-partial", test_instruction_read_partial) == NULL
      || CU_add_test(suite, "instruction-write", test_instruction_write) == NULL
      || CU_add_test(suite, "nest-write", test_nest_write) == NULL
+     || CU_add_test(suite, "socket-writev", test_socket_writev) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -37,10 +37,17 @@
 int register_protocol_suite();
 
 void test_base64_decode();
+void test_base64_encode();
+void test_image_encode();
+void test_image_stream();
+void test_instruction_opcode();
 void test_instruction_parse();
 void test_instruction_read();
+void test_instruction_read_buffered();
+void test_instruction_read_partial();
 void test_instruction_write();
 void test_nest_write();
+void test_socket_writev();
 
 #endif
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "compression.h"
+#include "terminal_suite.h"
+#include "types.h"
+
+#include <CUnit/Basic.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The number of characters within the longest row tested.
+ */
+#define TEST_ROW_LENGTH 2048
+
+/**
+ * The value of the guard character stored immediately after each
+ * decompressed row, which must never be overwritten.
+ */
+#define TEST_GUARD_VALUE 0x7E7E7E
+
+/**
+ * Returns whether the given characters are identical in every field
+ * preserved by compression.
+ */
+static int chars_equal(const guac_terminal_char* a,
+        const guac_terminal_char* b) {
+
+    return a->value                    == b->value
+        && a->width                    == b->width
+        && a->attributes.bold          == b->attributes.bold
+        && a->attributes.reverse       == b->attributes.reverse
+        && a->attributes.cursor        == b->attributes.cursor
+        && a->attributes.underscore    == b->attributes.underscore
+        && a->attributes.foreground    == b->attributes.foreground
+        && a->attributes.background    == b->attributes.background;
+
+}
+
+/**
+ * Initializes the given character with the given value, width and
+ * attributes.
+ */
+static void set_char(guac_terminal_char* character, int value, int width,
+        int bold, int reverse, int cursor, int underscore,
+        int foreground, int background) {
+
+    character->value = value;
+    character->width = width;
+    character->attributes.bold       = bold;
+    character->attributes.reverse    = reverse;
+    character->attributes.cursor     = cursor;
+    character->attributes.underscore = underscore;
+    character->attributes.foreground = foreground;
+    character->attributes.background = background;
+
+}
+
+/**
+ * Decompresses the given compressed row into a buffer of the given length
+ * followed by a guard character, returning the result of decompression.
+ * The guard character must be left untouched regardless of whether
+ * decompression succeeds.
+ */
+static int decompress_guarded(const unsigned char* compressed, int size,
+        guac_terminal_char* characters, int length, unsigned char* workspace) {
+
+    int result;
+
+    characters[length].value = TEST_GUARD_VALUE;
+    result = guac_terminal_decompress_row(compressed, size, characters,
+            length, workspace);
+    CU_ASSERT_EQUAL(characters[length].value, TEST_GUARD_VALUE);
+
+    return result;
+
+}
+
+/**
+ * Compresses and decompresses the given row, verifying that the row is
+ * unchanged and that every truncation of the compressed row is rejected.
+ */
+static void verify_round_trip(const guac_terminal_char* row, int length) {
+
+    int bound = guac_terminal_compress_bound(length);
+    unsigned char* compressed = malloc(bound);
+    unsigned char* workspace = malloc(bound);
+    guac_terminal_char* restored = calloc(length + 1,
+            sizeof(guac_terminal_char));
+
+    int size, i;
+
+    size = guac_terminal_compress_row(row, length, compressed, workspace);
+    CU_ASSERT(size > 0 && size <= bound);
+
+    /* Row is restored exactly */
+    CU_ASSERT_EQUAL(decompress_guarded(compressed, size, restored, length,
+                workspace), 0);
+
+    for (i = 0; i < length; i++) {
+        if (!chars_equal(&row[i], &restored[i])) {
+            CU_FAIL("Character changed by compression");
+            break;
+        }
+    }
+
+    /* Row cannot be restored into a row of a different length */
+    if (length > 1)
+        CU_ASSERT_NOT_EQUAL(decompress_guarded(compressed, size, restored,
+                    length - 1, workspace), 0);
+
+    /* Truncated rows are rejected */
+    for (i = 0; i < size; i++) {
+        if (decompress_guarded(compressed, i, restored, length,
+                    workspace) == 0) {
+            CU_FAIL("Truncated row accepted");
+            break;
+        }
+    }
+
+    free(restored);
+    free(workspace);
+    free(compressed);
+
+}
+
+void test_terminal_compression() {
+
+    guac_terminal_char row[TEST_ROW_LENGTH + 1];
+    unsigned char compressed[64];
+    unsigned char* workspace;
+    int length, size, i;
+
+    /* Wide characters, each followed by its continuation */
+    for (i = 0; i < 64; i += 2) {
+        set_char(&row[i], 0x4E00 + i, 2, 0, 0, 0, 0, 7, 0);
+        set_char(&row[i + 1], GUAC_CHAR_CONTINUATION, 0, 0, 0, 0, 0, 7, 0);
+    }
+
+    verify_round_trip(row, 64);
+
+    /* Every combination of attributes, with extreme colors */
+    for (i = 0; i < 64; i++)
+        set_char(&row[i], 'A' + (i % 26), 1,
+                i & 0x01, i & 0x02, i & 0x04, i & 0x08,
+                (i & 0x10) ? 255 : 0, (i & 0x20) ? 255 : 1);
+
+    verify_round_trip(row, 64);
+
+    /* Long run of literals, with no repeated sequences, exceeding the
+     * lengths which fit within a single length byte */
+    for (i = 0; i < TEST_ROW_LENGTH; i++)
+        set_char(&row[i], 0x10000 + i * 2654435761u % 0xFFFFF, 1,
+                0, 0, 0, 0, i & 0xFF, (i >> 8) & 0xFF);
+
+    verify_round_trip(row, TEST_ROW_LENGTH);
+
+    /* Long run of repeated characters, stored as one long match */
+    for (i = 0; i < TEST_ROW_LENGTH; i++)
+        set_char(&row[i], ' ', 1, 0, 0, 0, 0, 7, 0);
+
+    verify_round_trip(row, TEST_ROW_LENGTH);
+
+    /* Single character */
+    verify_round_trip(row, 1);
+
+    /* Corrupt rows are rejected */
+    length = 16;
+    workspace = malloc(guac_terminal_compress_bound(length));
+
+    size = guac_terminal_compress_row(row, length, compressed, workspace);
+    CU_ASSERT_FATAL(size >= 4);
+
+    /* Match referring to data before the start of the row */
+    {
+        unsigned char corrupt[] = { 0x10, ' ', 0x00, 0x02, 0x00 };
+        CU_ASSERT_NOT_EQUAL(decompress_guarded(corrupt, sizeof(corrupt),
+                    row, length, workspace), 0);
+    }
+
+    /* Match with zero offset */
+    {
+        unsigned char corrupt[] = { 0x10, ' ', 0x00, 0x00, 0x00 };
+        CU_ASSERT_NOT_EQUAL(decompress_guarded(corrupt, sizeof(corrupt),
+                    row, length, workspace), 0);
+    }
+
+    /* Literal length beyond the end of the data */
+    {
+        unsigned char corrupt[] = { 0xF0, 0xFF, 0xFF, 0xFF };
+        CU_ASSERT_NOT_EQUAL(decompress_guarded(corrupt, sizeof(corrupt),
+                    row, length, workspace), 0);
+    }
+
+    /* Match extending beyond the end of the workspace */
+    {
+        unsigned char corrupt[] = { 0x1F, ' ', 0x01, 0x00,
+                                    0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+        CU_ASSERT_NOT_EQUAL(decompress_guarded(corrupt, sizeof(corrupt),
+                    row, length, workspace), 0);
+    }
+
+    /* Any single corrupt byte is either rejected or restores a row of the
+     * expected length, never writing beyond that row */
+    for (i = 0; i < size * 8; i++) {
+        compressed[i / 8] ^= 1 << (i % 8);
+        decompress_guarded(compressed, size, row, length, workspace);
+        compressed[i / 8] ^= 1 << (i % 8);
+    }
+
+    free(workspace);
+
+}
+
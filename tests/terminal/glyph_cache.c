@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "glyph_cache.h"
+#include "terminal_suite.h"
+#include "types.h"
+
+#include <CUnit/Basic.h>
+#include <cairo/cairo.h>
+
+/**
+ * The width of each character cell of the tested caches, in pixels.
+ */
+#define TEST_CHAR_WIDTH 8
+
+/**
+ * The height of each character cell of the tested caches, in pixels.
+ */
+#define TEST_CHAR_HEIGHT 16
+
+/**
+ * A character height so large that the atlas, initially holding one row per
+ * pool, cannot be allocated with any more rows, as Cairo limits image
+ * surfaces to 32767 pixels in either dimension.
+ */
+#define TEST_HUGE_CHAR_HEIGHT (32767 / GUAC_TERMINAL_MAX_CHAR_WIDTH)
+
+/**
+ * The number of glyphs one column wide within each row of the atlas.
+ */
+#define TEST_PER_ROW GUAC_TERMINAL_GLYPH_CACHE_ATLAS_COLUMNS
+
+/**
+ * Returns the height of the atlas of the given cache, in rows.
+ */
+static int atlas_rows(guac_terminal_glyph_cache* cache) {
+    return cairo_image_surface_get_height(cache->atlas) / cache->char_height;
+}
+
+/**
+ * Returns the number of rows the atlas is expected to contain once the
+ * given number of rows have been claimed, as the atlas doubles in height
+ * whenever it grows, up to the number of rows needed by all pools.
+ */
+static int expected_atlas_rows(int claimed) {
+
+    int rows = GUAC_TERMINAL_MAX_CHAR_WIDTH;
+    int max_rows = 0;
+    int width;
+
+    for (width = 1; width <= GUAC_TERMINAL_MAX_CHAR_WIDTH; width++) {
+        int per_row = TEST_PER_ROW / width;
+        max_rows += (GUAC_TERMINAL_GLYPH_CACHE_SIZE / width + per_row - 1)
+                  / per_row;
+    }
+
+    while (rows < claimed)
+        rows *= 2;
+
+    return rows < max_rows ? rows : max_rows;
+
+}
+
+/**
+ * Stores a marker value within the first pixel of the given glyph, which
+ * must survive any growth of the atlas.
+ */
+static void mark_glyph(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph, unsigned char marker) {
+    cache->atlas_buffer[glyph->y * cache->atlas_stride + glyph->x * 4] = marker;
+}
+
+/**
+ * Returns the marker value stored within the first pixel of the given glyph.
+ */
+static unsigned char glyph_marker(guac_terminal_glyph_cache* cache,
+        guac_terminal_glyph* glyph) {
+    return cache->atlas_buffer[glyph->y * cache->atlas_stride + glyph->x * 4];
+}
+
+/**
+ * Verifies that glyphs are claimed row by row, that the atlas grows as rows
+ * are claimed, and that existing glyphs keep both their coordinates and
+ * their contents as the atlas grows.
+ */
+static void test_glyph_cache_growth() {
+
+    guac_terminal_glyph* glyphs[GUAC_TERMINAL_GLYPH_CACHE_SIZE];
+    int claimed = GUAC_TERMINAL_MAX_CHAR_WIDTH;
+    int i;
+
+    guac_terminal_glyph_cache* cache = guac_terminal_glyph_cache_alloc(
+            TEST_CHAR_WIDTH, TEST_CHAR_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Atlas initially holds only the first row of each pool */
+    CU_ASSERT_EQUAL(atlas_rows(cache), GUAC_TERMINAL_MAX_CHAR_WIDTH);
+    CU_ASSERT_EQUAL(cache->atlas_rows, GUAC_TERMINAL_MAX_CHAR_WIDTH);
+
+    for (i = 0; i < GUAC_TERMINAL_GLYPH_CACHE_SIZE; i++) {
+
+        glyphs[i] = guac_terminal_glyph_cache_add(cache, i, 7, 0, 1);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(glyphs[i]);
+        mark_glyph(cache, glyphs[i], i & 0xFF);
+
+        /* Each new row is claimed only once the previous row is full */
+        if (i >= TEST_PER_ROW && i % TEST_PER_ROW == 0)
+            claimed++;
+
+        CU_ASSERT_EQUAL(cache->atlas_rows, claimed);
+        CU_ASSERT_EQUAL(atlas_rows(cache), expected_atlas_rows(claimed));
+
+        /* Glyphs fill each row from left to right */
+        CU_ASSERT_EQUAL(glyphs[i]->x, (i % TEST_PER_ROW) * TEST_CHAR_WIDTH);
+        CU_ASSERT(glyphs[i]->y + TEST_CHAR_HEIGHT
+                <= cairo_image_surface_get_height(cache->atlas));
+
+    }
+
+    /* No glyph moved or lost its contents as the atlas grew */
+    for (i = 0; i < GUAC_TERMINAL_GLYPH_CACHE_SIZE; i++) {
+        guac_terminal_glyph* glyph =
+            guac_terminal_glyph_cache_lookup(cache, i, 7, 0, 1);
+        CU_ASSERT_PTR_EQUAL(glyph, glyphs[i]);
+        CU_ASSERT_EQUAL(glyph->x, (i % TEST_PER_ROW) * TEST_CHAR_WIDTH);
+        CU_ASSERT_EQUAL(glyph_marker(cache, glyph), i & 0xFF);
+    }
+
+    /* Rows of the first pool are never shared with the second */
+    glyphs[0] = guac_terminal_glyph_cache_add(cache, 'W', 7, 0, 2);
+    CU_ASSERT_EQUAL(glyphs[0]->y, TEST_CHAR_HEIGHT);
+    CU_ASSERT_EQUAL(glyphs[0]->width, 2);
+
+    guac_terminal_glyph_cache_free(cache);
+
+}
+
+/**
+ * Verifies that the least recently used glyph of the required width is
+ * evicted once a pool is full, that evicted glyphs can no longer be found,
+ * and that hits, misses and evictions are counted.
+ */
+static void test_glyph_cache_eviction() {
+
+    guac_terminal_glyph* oldest;
+    guac_terminal_glyph* glyph;
+    int x, y;
+    int i;
+
+    int size = GUAC_TERMINAL_GLYPH_CACHE_SIZE;
+
+    guac_terminal_glyph_cache* cache = guac_terminal_glyph_cache_alloc(
+            TEST_CHAR_WIDTH, TEST_CHAR_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    /* Fill the pool of single-column glyphs */
+    for (i = 0; i < size; i++)
+        guac_terminal_glyph_cache_add(cache, i, 7, 0, 1);
+
+    CU_ASSERT_EQUAL(cache->pools[0].used, size);
+    CU_ASSERT_EQUAL(cache->evictions, 0);
+
+    /* Use the oldest glyph, such that the second oldest is least recent */
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache, 0, 7, 0, 1));
+    CU_ASSERT_EQUAL(cache->hits, 1);
+
+    CU_ASSERT_EQUAL(cache->pools[0].oldest->codepoint, 1);
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache, 1, 7, 0, 1));
+    CU_ASSERT_EQUAL(cache->hits, 2);
+
+    /* Glyphs differing only in color or width are distinct */
+    CU_ASSERT_PTR_NULL(guac_terminal_glyph_cache_lookup(cache, 2, 7, 1, 1));
+    CU_ASSERT_PTR_NULL(guac_terminal_glyph_cache_lookup(cache, 2, 7, 0, 2));
+    CU_ASSERT_EQUAL(cache->misses, 2);
+
+    /* Misses do not affect recency */
+    CU_ASSERT_EQUAL(cache->pools[0].oldest->codepoint, 2);
+
+    /* Use glyphs 2 and 3, such that glyph 4 becomes least recently used */
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache, 2, 7, 0, 1));
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache, 3, 7, 0, 1));
+    CU_ASSERT_EQUAL(cache->hits, 4);
+
+    /* Least recently used glyph is replaced in place */
+    oldest = cache->pools[0].oldest;
+    CU_ASSERT_EQUAL(oldest->codepoint, 4);
+    x = oldest->x;
+    y = oldest->y;
+
+    glyph = guac_terminal_glyph_cache_add(cache, size, 7, 0, 1);
+    CU_ASSERT_PTR_EQUAL(glyph, oldest);
+    CU_ASSERT_EQUAL(glyph->x, x);
+    CU_ASSERT_EQUAL(glyph->y, y);
+    CU_ASSERT_EQUAL(cache->evictions, 1);
+    CU_ASSERT_PTR_EQUAL(cache->pools[0].newest, glyph);
+
+    /* Evicted glyph is gone, while its replacement and others remain */
+    CU_ASSERT_PTR_NULL(guac_terminal_glyph_cache_lookup(cache, 4, 7, 0, 1));
+    CU_ASSERT_PTR_EQUAL(guac_terminal_glyph_cache_lookup(cache, size, 7, 0, 1),
+            glyph);
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache, 5, 7, 0, 1));
+    CU_ASSERT_EQUAL(cache->misses, 3);
+    CU_ASSERT_EQUAL(cache->hits, 6);
+
+    /* Glyphs of other widths do not evict glyphs of this width */
+    for (i = 0; i < size; i++)
+        guac_terminal_glyph_cache_add(cache, i, 7, 0, 2);
+
+    CU_ASSERT_EQUAL(cache->evictions, size / 2 + 1);
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache, 5, 7, 0, 1));
+
+    /* Only the most recent half of the wider glyphs remain */
+    CU_ASSERT_PTR_NULL(guac_terminal_glyph_cache_lookup(cache,
+                size / 2 - 1, 7, 0, 2));
+    CU_ASSERT_PTR_NOT_NULL(guac_terminal_glyph_cache_lookup(cache,
+                size / 2, 7, 0, 2));
+
+    guac_terminal_glyph_cache_free(cache);
+
+}
+
+/**
+ * Verifies that, if the atlas cannot grow, a pool reuses the glyphs it has
+ * already claimed rather than failing.
+ */
+static void test_glyph_cache_grow_failure() {
+
+    guac_terminal_glyph* first;
+    guac_terminal_glyph* glyph;
+    int height;
+    int i;
+
+    guac_terminal_glyph_cache* cache = guac_terminal_glyph_cache_alloc(
+            1, TEST_HUGE_CHAR_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cache);
+
+    height = cairo_image_surface_get_height(cache->atlas);
+
+    /* Fill the only row available to the pool */
+    first = guac_terminal_glyph_cache_add(cache, 0, 7, 0, 1);
+    for (i = 1; i < TEST_PER_ROW; i++)
+        guac_terminal_glyph_cache_add(cache, i, 7, 0, 1);
+
+    CU_ASSERT_EQUAL(cache->evictions, 0);
+
+    /* Next glyph cannot claim a new row, and so replaces the oldest */
+    glyph = guac_terminal_glyph_cache_add(cache, TEST_PER_ROW, 7, 0, 1);
+    CU_ASSERT_PTR_EQUAL(glyph, first);
+    CU_ASSERT_EQUAL(cache->evictions, 1);
+    CU_ASSERT_EQUAL(cache->pools[0].size, TEST_PER_ROW);
+    CU_ASSERT_EQUAL(cache->pools[0].used, TEST_PER_ROW);
+    CU_ASSERT_EQUAL(cache->atlas_rows, GUAC_TERMINAL_MAX_CHAR_WIDTH);
+    CU_ASSERT_EQUAL(cairo_image_surface_get_height(cache->atlas), height);
+
+    CU_ASSERT_PTR_NULL(guac_terminal_glyph_cache_lookup(cache, 0, 7, 0, 1));
+    CU_ASSERT_PTR_EQUAL(guac_terminal_glyph_cache_lookup(cache,
+                TEST_PER_ROW, 7, 0, 1), glyph);
+
+    guac_terminal_glyph_cache_free(cache);
+
+}
+
+void test_terminal_glyph_cache() {
+    test_glyph_cache_growth();
+    test_glyph_cache_eviction();
+    test_glyph_cache_grow_failure();
+}
+
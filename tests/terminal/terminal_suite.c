@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "terminal_suite.h"
+
+#include <CUnit/Basic.h>
+
+int terminal_suite_init() {
+    return 0;
+}
+
+int terminal_suite_cleanup() {
+    return 0;
+}
+
+int register_terminal_suite() {
+
+    /* Add terminal test suite */
+    CU_pSuite suite = CU_add_suite("terminal",
+            terminal_suite_init, terminal_suite_cleanup);
+    if (suite == NULL) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    /* Add tests */
+    if (
+           CU_add_test(suite, "terminal-compression", test_terminal_compression) == NULL
+        || CU_add_test(suite, "terminal-glyph-cache", test_terminal_glyph_cache) == NULL
+       ) {
+        CU_cleanup_registry();
+        return CU_get_error();
+    }
+
+    return 0;
+
+}
+
@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_TEST_TERMINAL_SUITE_H
+#define _GUAC_TEST_TERMINAL_SUITE_H
+
+/**
+ * Test suite containing unit tests for the parts of the terminal emulator
+ * which do not depend on Pango, and are thus built directly from the
+ * sources of the terminal.
+ *
+ * @file terminal_suite.h
+ */
+
+#include "config.h"
+
+/**
+ * Registers the terminal test suite with CUnit.
+ */
+int register_terminal_suite();
+
+/**
+ * Unit test for row compression. This test checks that rows of wide
+ * characters, of every combination of attributes, and of long runs of
+ * unrepeated and repeated characters survive compression unchanged, and
+ * that truncated or corrupt compressed rows are rejected without writing
+ * beyond the decompressed row.
+ */
+void test_terminal_compression();
+
+/**
+ * Unit test for the glyph cache. This test checks that the atlas grows row
+ * by row as glyphs are added without moving existing glyphs, that the least
+ * recently used glyph of the required width is evicted once its pool is
+ * full and can no longer be found, that hits, misses and evictions are
+ * counted, and that a pool reuses its glyphs if the atlas cannot grow.
+ */
+void test_terminal_glyph_cache();
+
+#endif
+
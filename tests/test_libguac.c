@@ -24,7 +24,9 @@
 
 #include "client/client_suite.h"
 #include "common/common_suite.h"
+#include "guacd/guacd_suite.h"
 #include "protocol/suite.h"
+#include "terminal/terminal_suite.h"
 #include "util/util_suite.h"
 
 #include <CUnit/Basic.h>
@@ -40,6 +42,8 @@ int main() {
     register_client_suite();
     register_util_suite();
     register_common_suite();
+    register_guacd_suite();
+    register_terminal_suite();
 
     /* Run tests */
     CU_basic_set_mode(CU_BRM_VERBOSE);
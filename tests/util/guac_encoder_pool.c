@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "util_suite.h"
+
+#include <CUnit/Basic.h>
+#include <guacamole/encoder-pool.h>
+
+#include <pthread.h>
+
+#define JOB_COUNT 256
+
+/**
+ * The number of jobs within the batch which is held running while another
+ * batch is submitted.
+ */
+#define HELD_JOB_COUNT 4
+
+/**
+ * Lock guarding the state of the held batch.
+ */
+static pthread_mutex_t __held_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Condition signalled when a held job starts, or when held jobs are
+ * released.
+ */
+static pthread_cond_t __held_changed = PTHREAD_COND_INITIALIZER;
+
+/**
+ * The number of held jobs which have started.
+ */
+static int __held_started = 0;
+
+/**
+ * Whether held jobs may complete.
+ */
+static int __held_released = 0;
+
+/**
+ * Job which records that it has run by incrementing the integer given.
+ */
+static void __count_job(void* data) {
+    int* count = (int*) data;
+    (*count)++;
+}
+
+/**
+ * Job which records that it has started, then waits until released.
+ */
+static void __held_job(void* data) {
+
+    pthread_mutex_lock(&__held_lock);
+
+    __held_started++;
+    pthread_cond_broadcast(&__held_changed);
+
+    while (!__held_released)
+        pthread_cond_wait(&__held_changed, &__held_lock);
+
+    pthread_mutex_unlock(&__held_lock);
+
+}
+
+/**
+ * Runs a batch of HELD_JOB_COUNT held jobs through the encoder pool.
+ */
+static void* __held_batch_thread(void* data) {
+
+    void* held[HELD_JOB_COUNT] = { NULL };
+    guac_encoder_pool_run(__held_job, held, HELD_JOB_COUNT);
+
+    return NULL;
+
+}
+
+/**
+ * Runs JOB_COUNT jobs through the encoder pool, verifying that each job runs
+ * exactly once and that all jobs have completed when the pool returns.
+ */
+static void __test_encoder_pool_batch() {
+
+    int counts[JOB_COUNT] = {0};
+    void* data[JOB_COUNT];
+    int i;
+
+    for (i = 0; i < JOB_COUNT; i++)
+        data[i] = &counts[i];
+
+    guac_encoder_pool_run(__count_job, data, JOB_COUNT);
+
+    for (i = 0; i < JOB_COUNT; i++)
+        CU_ASSERT_EQUAL(counts[i], 1);
+
+}
+
+void test_guac_encoder_pool() {
+
+    int batch;
+
+    /* Serial operation */
+    guac_encoder_pool_set_threads(0);
+    CU_ASSERT_EQUAL(guac_encoder_pool_get_threads(), 0);
+    __test_encoder_pool_batch();
+
+    /* Thread count must be limited */
+    guac_encoder_pool_set_threads(GUAC_ENCODER_POOL_MAX_THREADS + 1);
+    CU_ASSERT_EQUAL(guac_encoder_pool_get_threads(),
+            GUAC_ENCODER_POOL_MAX_THREADS);
+
+    /* Parallel operation, reusing the same threads for several batches */
+    guac_encoder_pool_set_threads(3);
+    CU_ASSERT_EQUAL(guac_encoder_pool_get_threads(), 3);
+    for (batch = 0; batch < 16; batch++)
+        __test_encoder_pool_batch();
+
+    /* Batches submitted while another batch runs must not wait for it */
+    {
+        pthread_t held_thread;
+
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&held_thread, NULL,
+                    __held_batch_thread, NULL), 0);
+
+        pthread_mutex_lock(&__held_lock);
+        while (__held_started == 0)
+            pthread_cond_wait(&__held_changed, &__held_lock);
+        pthread_mutex_unlock(&__held_lock);
+
+        __test_encoder_pool_batch();
+
+        pthread_mutex_lock(&__held_lock);
+        __held_released = 1;
+        pthread_cond_broadcast(&__held_changed);
+        pthread_mutex_unlock(&__held_lock);
+
+        pthread_join(held_thread, NULL);
+        CU_ASSERT_EQUAL(__held_started, HELD_JOB_COUNT);
+    }
+
+    /* Automatic thread count */
+    guac_encoder_pool_set_threads(-1);
+    CU_ASSERT(guac_encoder_pool_get_threads() >= 0);
+    CU_ASSERT(guac_encoder_pool_get_threads() <= GUAC_ENCODER_POOL_MAX_THREADS);
+
+}
+
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2014 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "palette.h"
+#include "util_suite.h"
+
+#include <stdint.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+
+/**
+ * The height of each test image, in pixels.
+ */
+#define TEST_PALETTE_HEIGHT 8
+
+/**
+ * Returns a new test image of the given width in which the first
+ * "colors" pixels each have a distinct color, with all remaining pixels
+ * forming runs of those colors of varying lengths.
+ */
+static cairo_surface_t* __test_palette_surface(int width, int colors) {
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, TEST_PALETTE_HEIGHT);
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    int x, y;
+
+    for (y = 0; y < TEST_PALETTE_HEIGHT; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+
+        for (x = 0; x < width; x++) {
+
+            int index = y * width + x;
+
+            /* Distinct colors first, followed by runs, with garbage in the
+             * unused high byte which must be ignored */
+            if (index < colors)
+                row[x] = 0xAB000000 | (index * 0x010307);
+            else
+                row[x] = ((index / 5 + y) % colors) * 0x010307;
+
+        }
+
+    }
+
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+
+/**
+ * Verifies that every pixel of the given surface maps to a palette entry of
+ * the same color.
+ */
+static void __test_palette_verify(guac_palette* palette,
+        cairo_surface_t* surface) {
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int x, y;
+
+    for (y = 0; y < TEST_PALETTE_HEIGHT; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+
+        for (x = 0; x < width; x++) {
+
+            int color = row[x] & 0xFFFFFF;
+            int index = guac_palette_find(palette, color);
+
+            CU_ASSERT_FATAL(index >= 0 && index < palette->size);
+            CU_ASSERT_EQUAL(palette->colors[index].red,   (color >> 16) & 0xFF);
+            CU_ASSERT_EQUAL(palette->colors[index].green, (color >> 8)  & 0xFF);
+            CU_ASSERT_EQUAL(palette->colors[index].blue,  color & 0xFF);
+
+        }
+
+    }
+
+}
+
+void test_guac_palette() {
+
+    int width;
+
+    /* Runs of every length and alignment must be counted correctly */
+    for (width = 1; width <= 40; width++) {
+
+        cairo_surface_t* surface = __test_palette_surface(width, 3);
+        guac_palette* palette = guac_palette_alloc(surface);
+
+        CU_ASSERT_PTR_NOT_NULL_FATAL(palette);
+        CU_ASSERT_EQUAL(palette->size, width * TEST_PALETTE_HEIGHT < 3
+                ? width * TEST_PALETTE_HEIGHT : 3);
+        __test_palette_verify(palette, surface);
+
+        guac_palette_free(palette);
+        cairo_surface_destroy(surface);
+
+    }
+
+    /* Exactly 256 colors fit within a palette, even in a sampled image */
+    {
+        cairo_surface_t* surface = __test_palette_surface(1024, 256);
+        guac_palette* palette = guac_palette_alloc(surface);
+
+        CU_ASSERT_PTR_NOT_NULL_FATAL(palette);
+        CU_ASSERT_EQUAL(palette->size, 256);
+        __test_palette_verify(palette, surface);
+
+        guac_palette_free(palette);
+        cairo_surface_destroy(surface);
+    }
+
+    /* 257 colors do not */
+    {
+        cairo_surface_t* surface = __test_palette_surface(1024, 257);
+        CU_ASSERT_PTR_NULL(guac_palette_alloc(surface));
+        cairo_surface_destroy(surface);
+    }
+
+}
+
@@ -46,7 +46,9 @@ int register_util_suite() {
 
     /* Add tests */
     if (
-           CU_add_test(suite, "guac-pool",    test_guac_pool)    == NULL
+           CU_add_test(suite, "guac-encoder-pool", test_guac_encoder_pool) == NULL
+        || CU_add_test(suite, "guac-palette", test_guac_palette) == NULL
+        || CU_add_test(suite, "guac-pool",    test_guac_pool)    == NULL
         || CU_add_test(suite, "guac-unicode", test_guac_unicode) == NULL
        ) {
         CU_cleanup_registry();
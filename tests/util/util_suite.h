@@ -59,6 +59,21 @@
  */
 int register_util_suite();
 
+/**
+ * Unit test for the encoder pool. This test checks that every job submitted
+ * to the pool is run exactly once, both serially and in parallel, that a
+ * batch submitted while another batch is running completes without waiting
+ * for that batch, and that the number of threads is limited as documented.
+ */
+void test_guac_encoder_pool();
+
+/**
+ * Unit test for the color census used when encoding PNG images. This test
+ * checks that runs of pixels of every length and alignment are counted
+ * correctly, and that images with more than 256 colors are rejected.
+ */
+void test_guac_palette();
+
 /**
  * Unit test for the guac_pool structure and related functions. The guac_pool
  * structure provides a consistent source of pooled integers. This unit test